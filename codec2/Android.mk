@@ -160,6 +160,54 @@ LOCAL_CFLAGS += $(EXYNOS_GLOBAL_CFLAGS)
 include $(BUILD_SHARED_LIBRARY)
 
 
+#########################################
+####  libExynosC2ComponentStore_test  ###
+#########################################
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS := optional
+
+# the store loads the fake codec libraries of the test
+LOCAL_SRC_FILES := \
+        Exynos_C2_ComponentStore.cpp \
+        tests/ExynosC2ComponentStoreTest.cpp
+
+LOCAL_MODULE := libExynosC2ComponentStore_test
+LOCAL_LICENSE_KINDS := SPDX-license-identifier-Apache-2.0
+LOCAL_LICENSE_CONDITIONS := notice
+LOCAL_NOTICE_FILE := $(LOCAL_PATH)/NOTICE
+
+LOCAL_PROPRIETARY_MODULE := true
+
+LOCAL_HEADER_LIBRARIES := libexynosc2_base_headers libexynosc2_osal_headers
+LOCAL_HEADER_LIBRARIES += $(EXYNOS_VENDOR_HEADER_LIBS)
+
+LOCAL_STATIC_LIBRARIES := libExynosC2OSAL
+
+LOCAL_SHARED_LIBRARIES := \
+        liblog \
+        libcutils \
+        libion \
+        libhidlbase \
+        libcodec2 \
+        libcodec2_vndk \
+        libsfplugin_ccodec_utils \
+        libstagefright_xmlparser
+
+LOCAL_SHARED_LIBRARIES += $(EXYNOS_VENDOR_SHARED_LIBS)
+
+LOCAL_CFLAGS +=	-Werror \
+                -Wall \
+                -Wno-deprecated-enum-enum-conversion \
+                -std=c++2a \
+                -Ddlopen=ExynosC2TestDlopen \
+                -Ddlsym=ExynosC2TestDlsym \
+                -Ddlclose=ExynosC2TestDlclose
+LOCAL_CFLAGS += $(EXYNOS_GLOBAL_CFLAGS)
+
+include $(BUILD_NATIVE_TEST)
+
+
 #############################
 ####  libExynosC2H264Dec  ###
 #############################
@@ -35,6 +35,7 @@
 #include "C2ExynosSupport.h"
 #include "ExynosDef.h"
 #include "ExynosIONUtils.h"
+#include "ExynosModulePool.h"
 #include "Exynos_C2_ComponentRM.h"
 
 #define LOG_ON
@@ -47,6 +48,10 @@
 #define MAX_DEC_RESOURCE 16
 #define MAX_ENC_RESOURCE 16
 
+/* modules kept loaded after their last component or interface is gone */
+#define MODULE_POOL_SIZE        4
+#define MODULE_IDLE_TIMEOUT_MS  10000
+
 static std::mutex gMutex;
 static std::shared_ptr<ExynosC2ComponentRM> gComponentRM;
 static std::shared_ptr<ExynosC2ComponentInfo> gComponentInfo;
@@ -182,6 +187,10 @@ private:
 
         std::shared_ptr<const C2Component::Traits> getTraits();
 
+        /* an interface built beforehand, or a new one when there is none */
+        c2_status_t takeInterface(std::shared_ptr<C2ComponentInterface>* const interface);
+        void prepareInterface();
+
         ComponentModule() : mInit(C2_NO_INIT),
                             mLibHandle(nullptr),
                             createFactory(nullptr),
@@ -197,6 +206,8 @@ private:
     protected:
         std::recursive_mutex mLock;
         std::shared_ptr<C2Component::Traits> mTraits;
+        /* owned by the module only, so it does not hold a module reference */
+        std::unique_ptr<C2ComponentInterface> mSpareInterface;
 
         c2_status_t mInit;
 
@@ -206,22 +217,28 @@ private:
         C2ComponentFactory *mComponentFactory;
     };
 
+    using ModulePool = ExynosModulePool<ComponentModule>;
+
     class ComponentLoader : public ExynosLog {
     public:
-        ComponentLoader(std::string libPath, bool isSecure = false) : mLibPath(libPath), mIsSecure(isSecure) {
+        ComponentLoader(std::string libPath, ModulePool *pool, bool isSecure = false)
+            : mLibPath(libPath), mModulePool(pool), mIsSecure(isSecure) {
             mObjName = "ComponentLoader";
         }
 
         // ~ComponentLoader();
 
-        c2_status_t getModule(std::shared_ptr<ComponentModule> *const module);
+        /* a retained module stays in the pool for a while after its last use */
+        c2_status_t getModule(std::shared_ptr<ComponentModule> *const module, bool retain = true);
         c2_status_t getComponent(std::shared_ptr<C2Component> *const component);
         c2_status_t getInterface(std::shared_ptr<C2ComponentInterface> *const interface);
+        std::shared_ptr<const C2Component::Traits> getTraits();
 
     private:
         std::mutex mMutex;
         std::string mLibPath;
         std::weak_ptr<ComponentModule> mModule;
+        ModulePool *mModulePool;
         bool mIsSecure;
     };
 
@@ -303,12 +320,19 @@ private:
     void buildComponentList();
 
     std::map<std::string, std::string> mComponentInfo;
+    /* declared before the loaders so that the pooled modules outlive them */
+    ModulePool mModulePool;
     std::map<C2String, ComponentLoader> mComponents;
     std::shared_ptr<C2ReflectorHelper> mReflector;
     Interface mInterface;
 };
 
-ExynosC2ComponentStore::ExynosC2ComponentStore() : mReflector(std::make_shared<C2ReflectorHelper>()),
+ExynosC2ComponentStore::ExynosC2ComponentStore() : mModulePool(MODULE_POOL_SIZE,
+                                                               std::chrono::milliseconds(MODULE_IDLE_TIMEOUT_MS),
+                                                               [](const std::shared_ptr<ComponentModule> &module) {
+                                                                   module->prepareInterface();
+                                                               }),
+                                                   mReflector(std::make_shared<C2ReflectorHelper>()),
                                                    mInterface(mReflector) {
     mObjName = "ExynosC2ComponentStore";
     mbLogOff = false;
@@ -389,10 +413,10 @@ void ExynosC2ComponentStore::buildComponentList() {
 
         if (name.find(".secure") != std::string::npos) {
             mComponents.emplace(std::piecewise_construct, std::forward_as_tuple(name.c_str()),
-                                std::forward_as_tuple(libName.c_str(), true));
+                                std::forward_as_tuple(libName.c_str(), &mModulePool, true));
         } else {
             mComponents.emplace(std::piecewise_construct, std::forward_as_tuple(name.c_str()),
-                                std::forward_as_tuple(libName.c_str()));
+                                std::forward_as_tuple(libName.c_str(), &mModulePool));
         }
 
         ExynosLogI("[%s] %s", __FUNCTION__, name.c_str());
@@ -457,14 +481,9 @@ std::vector<std::shared_ptr<const C2Component::Traits>> ExynosC2ComponentStore::
     std::vector<std::shared_ptr<const C2Component::Traits>> list;
 
     for (auto &productInfo : mComponents) {
-        ComponentLoader &loader = productInfo.second;
-        std::shared_ptr<ComponentModule> module = nullptr;
-
-        if (C2_OK == loader.getModule(&module)) {
-            auto traits = module->getTraits();
-            if (traits) {
-                list.push_back(traits);
-            }
+        auto traits = productInfo.second.getTraits();
+        if (traits) {
+            list.push_back(traits);
         }
     }
     return list;
@@ -563,6 +582,8 @@ c2_status_t ExynosC2ComponentStore::ComponentModule::init(std::string libPath, b
 }
 
 ExynosC2ComponentStore::ComponentModule::~ComponentModule() {
+    mSpareInterface.reset();
+
     if ((destroyFactory != nullptr) &&
         (mComponentFactory != nullptr)) {
         destroyFactory(mComponentFactory);
@@ -621,6 +642,56 @@ c2_status_t ExynosC2ComponentStore::ComponentModule::createInterface(
                                                 });
 }
 
+c2_status_t ExynosC2ComponentStore::ComponentModule::takeInterface(
+    std::shared_ptr<C2ComponentInterface>* const interface) {
+    ExynosLogFunctionTrace();
+
+    std::unique_ptr<C2ComponentInterface> spare;
+
+    {
+        std::unique_lock<std::recursive_mutex> lock(mLock);
+        spare = std::move(mSpareInterface);
+    }
+
+    if (spare == nullptr) {
+        return createInterface(0, interface);
+    }
+
+    std::shared_ptr<ComponentModule> module = shared_from_this();
+    C2ComponentInterface *p = spare.release();
+
+    *interface = std::shared_ptr<C2ComponentInterface>(p,
+                                                       [module](C2ComponentInterface *intf) mutable {
+                                                         delete intf;    // delete interface first
+                                                         module.reset();
+                                                       });
+
+    return C2_OK;
+}
+
+/* builds the interface handed out by the next takeInterface() */
+void ExynosC2ComponentStore::ComponentModule::prepareInterface() {
+    ExynosLogFunctionTrace();
+
+    std::unique_lock<std::recursive_mutex> lock(mLock);
+
+    if ((mInit != C2_OK) ||
+        (mSpareInterface != nullptr)) {
+        return;
+    }
+
+    std::shared_ptr<C2ComponentInterface> interface = nullptr;
+
+    if (mComponentFactory->createInterface(0, &interface,
+                                           [](C2ComponentInterface *p) { UNUSED(p); }) != C2_OK) {
+        ExynosLogW("[%s] createInterface() is failed", __FUNCTION__);
+        return;
+    }
+
+    /* the no-op deleter hands the ownership over to mSpareInterface */
+    mSpareInterface.reset(interface.get());
+}
+
 std::shared_ptr<const C2Component::Traits> ExynosC2ComponentStore::ComponentModule::getTraits() {
     ExynosLogFunctionTrace();
 
@@ -700,7 +771,7 @@ std::shared_ptr<const C2Component::Traits> ExynosC2ComponentStore::ComponentModu
     return mTraits;
 }
 
-c2_status_t ExynosC2ComponentStore::ComponentLoader::getModule(std::shared_ptr<ComponentModule> *const module) {
+c2_status_t ExynosC2ComponentStore::ComponentLoader::getModule(std::shared_ptr<ComponentModule> *const module, bool retain) {
     c2_status_t ret = C2_OK;
     ExynosLogFunctionTrace();
 
@@ -721,6 +792,12 @@ c2_status_t ExynosC2ComponentStore::ComponentLoader::getModule(std::shared_ptr<C
         }
     }
 
+    if ((ret == C2_OK) &&
+        (retain == true) &&
+        (mModulePool != nullptr)) {
+        mModulePool->retain(localModule);
+    }
+
     *module = localModule;
 
     return ret;
@@ -750,12 +827,50 @@ c2_status_t ExynosC2ComponentStore::ComponentLoader::getInterface(std::shared_pt
 
     ret = getModule(&module);
     if (ret == C2_OK) {
-        module->createInterface(0, interface);
+        ret = module->takeInterface(interface);
     }
 
     return ret;
 }
 
+std::shared_ptr<const C2Component::Traits> ExynosC2ComponentStore::ComponentLoader::getTraits() {
+    ExynosLogFunctionTrace();
+
+    /*
+     * the traits only depend on the library and the factory used, and the
+     * libraries are never unloaded (RTLD_NODELETE). so they are computed once
+     * for the process instead of once per module instance.
+     */
+    static std::mutex sTraitsMutex;
+    static std::map<std::string, std::shared_ptr<const C2Component::Traits>> sTraits;
+
+    std::string key = mLibPath + ((mIsSecure == true)? ":secure":"");
+
+    {
+        std::lock_guard<std::mutex> lock(sTraitsMutex);
+
+        auto cached = sTraits.find(key);
+        if (cached != sTraits.end()) {
+            return cached->second;
+        }
+    }
+
+    std::shared_ptr<ComponentModule> module = nullptr;
+
+    /* listing the components does not make them recently used */
+    if (getModule(&module, false) != C2_OK) {
+        return nullptr;
+    }
+
+    auto traits = module->getTraits();
+    if (traits) {
+        std::lock_guard<std::mutex> lock(sTraitsMutex);
+        sTraits.emplace(key, traits);
+    }
+
+    return traits;
+}
+
 
 namespace android {
 
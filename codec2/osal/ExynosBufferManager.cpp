@@ -21,7 +21,10 @@
 
 #include "ExynosBufferManager.h"
 
+/* idle fixed fds kept for buffers that come back */
 #define GARBAGE_CLEANUP_BASELINE 32
+/* idle fixed fds closed per call at most, so that no single call pays for a sweep */
+#define GARBAGE_CLEANUP_BUDGET   2
 
 fds_t BufferFdManager::getFixedFds(std::shared_ptr<ExynosBuffer> buffer) {
     fds_t fds;
@@ -40,90 +43,79 @@ fds_t BufferFdManager::getFixedFds(std::shared_ptr<ExynosBuffer> buffer) {
         StaticExynosLog(Level::Trace, "BufferFdManager", "[%s] buffer info : fd(%d)", __FUNCTION__, nFD[i]);
     }
 
-    auto optKey = buffer->getStIno();
-    if (!optKey) {
-        fds.key = getStIno(nFD[0]);
-        buffer->setStIno(fds.key);
-    } else {
-        fds.key = *optKey;
-    }
-
-    int count = 0;
-
-    if (mFdMap.size() > GARBAGE_CLEANUP_BASELINE) {
-        /* clear reserved FDs */
-        int cnt = 0;
-
-        for (auto it = mFdMap.begin(); it != mFdMap.end(); ) {
-            if (it->second.dupCount > 0) {
-                it++;
-                continue;
-            }
+    fds.key = getStIno(buffer);
 
-            for (int i = 0; i < it->second.plane; i++) {
-                close(it->second.fd[i]);
-            }
+    std::lock_guard<std::mutex> lock(mFdMutex);
 
-            it = mFdMap.erase(it);
-            cnt++;
-        }
+    int count = 0;
 
-        StaticExynosLog(Level::Trace, "BufferFdManager", "[%s] clear reserved FDs (%d)", __FUNCTION__, cnt);
-    }
+    reclaimIdleFds();
 
-    auto search = mFdMap.find(fds.key);
-    if (search == mFdMap.end()) {
+    int id = mFdTable.find(fds.key);
+    if (id == ExynosInodeTable<fds_t>::INVALID_ID) {
         fds.plane = plane;
         count = fds.dupCount = 1;
         for (int i = 0; i< fds.plane; i++) {
             fds.fd[i] = dup(nFD[i]);
         }
-        mFdMap.emplace(fds.key, fds);
+        mFdTable.insert(fds.key, fds);
     } else {
-        fds.plane = search->second.plane;
-        for (int i = 0; i < search->second.plane; i++) {
-            if (fixedFd(nFD[i], search->second.fd[i]) >= 0) {
-                fds.fd[i] = search->second.fd[i];
+        fds_t &fixed = mFdTable.at(id);
+
+        mFdTable.setBusy(id);
+
+        fds.plane = fixed.plane;
+        for (int i = 0; i < fixed.plane; i++) {
+            if (fixedFd(nFD[i], fixed.fd[i]) >= 0) {
+                fds.fd[i] = fixed.fd[i];
             } else {
-                StaticExynosLog(Level::Trace, "BufferFdManager", "[%s] Someone intercepted fd:%d.", __FUNCTION__, search->second.fd[i]);
-                fds.fd[i] = search->second.fd[i] = dup(nFD[i]);
-                StaticExynosLog(Level::Trace, "BufferFdManager", "[%s] New fixed fd:%d.", __FUNCTION__, search->second.fd[i]);
+                StaticExynosLog(Level::Trace, "BufferFdManager", "[%s] Someone intercepted fd:%d.", __FUNCTION__, fixed.fd[i]);
+                fds.fd[i] = fixed.fd[i] = dup(nFD[i]);
+                StaticExynosLog(Level::Trace, "BufferFdManager", "[%s] New fixed fd:%d.", __FUNCTION__, fixed.fd[i]);
             }
         }
-        search->second.dupCount++;
-        count = search->second.dupCount;
+        fixed.dupCount++;
+        count = fixed.dupCount;
     }
 
     StaticExynosLog(Level::Trace, "BufferFdManager", "[%s] getFixedFds inode number:%zu, fd[0]:%d, fd[1]:%d, fd[2]:%d, plane:%d, mapSize:%zu, dupCount:%d",
-                                __FUNCTION__, fds.key, fds.fd[0], fds.fd[1], fds.fd[2], fds.plane, mFdMap.size(), count);
+                                __FUNCTION__, fds.key, fds.fd[0], fds.fd[1], fds.fd[2], fds.plane, mFdTable.size(), count);
 
     return fds;
 }
 
 void BufferFdManager::returnFixedFds(uint64_t key) {
-    auto search = mFdMap.find(key);
-    if (search != mFdMap.end()) {
-        if (search->second.dupCount == 1) {
-            for (int i = 0; i < search->second.plane; i++) {
-                if (fixedFd(STDOUT_FILENO, search->second.fd[i]) < 0) {
-                    search->second.fd[i] = -1;
-
-                    for (int i = 0; i < search->second.plane; i++) {
-                        if (search->second.fd[i] >= 0)
-                            close(search->second.fd[i]);
+    std::lock_guard<std::mutex> lock(mFdMutex);
+
+    int id = mFdTable.find(key);
+    if (id != ExynosInodeTable<fds_t>::INVALID_ID) {
+        fds_t &fixed = mFdTable.at(id);
+
+        if (fixed.dupCount == 1) {
+            for (int i = 0; i < fixed.plane; i++) {
+                if (fixedFd(STDOUT_FILENO, fixed.fd[i]) < 0) {
+                    fixed.fd[i] = -1;
+
+                    for (int i = 0; i < fixed.plane; i++) {
+                        if (fixed.fd[i] >= 0)
+                            close(fixed.fd[i]);
                     }
 
-                    mFdMap.erase(search);
+                    mFdTable.erase(id);
                     StaticExynosLog(Level::Trace, "BufferFdManager", "[%s] Someone intercepted fd. keep failed.", __FUNCTION__);
 
                     return;
                 }
             }
         }
-        search->second.dupCount--;
-        search->second.dupCount = (search->second.dupCount < 0) ? 0 : search->second.dupCount;
+        fixed.dupCount--;
+        fixed.dupCount = (fixed.dupCount < 0) ? 0 : fixed.dupCount;
 
-        StaticExynosLog(Level::Trace, "BufferFdManager", "[%s] returnFixedFds inode number:%zu, dupCount:%d", __FUNCTION__, key, search->second.dupCount);
+        if (fixed.dupCount == 0) {
+            mFdTable.setIdle(id);
+        }
+
+        StaticExynosLog(Level::Trace, "BufferFdManager", "[%s] returnFixedFds inode number:%zu, dupCount:%d", __FUNCTION__, key, fixed.dupCount);
     }
 }
 
@@ -133,35 +125,45 @@ void BufferFdManager::returnFixedFds(std::shared_ptr<ExynosBuffer> buffer) {
         return;
     }
 
-    auto handle = buffer->handle();
-    auto plane = buffer->plane();
-    unsigned long nFD[BASE_BUFFER_MAX_PLANES] = {0, 0, 0};
-
-    for (int i = 0; i < plane; i++) {
-        nFD[i]       = handle->data[i];
-        StaticExynosLog(Level::Trace, "BufferFdManager", "[%s] output buffer info : fd(%d)", __FUNCTION__, nFD[i]);
-    }
-
-    struct stat statInfo;
-    fstat(nFD[0], &statInfo);
-    uint64_t key = (uint64_t)statInfo.st_ino;
-
-    returnFixedFds(key);
+    returnFixedFds(getStIno(buffer));
 }
 
 void BufferFdManager::allFdClear() {
     StaticExynosLog(Level::Trace, "[%s] BufferFdManager", "[%s] allFdClear++", __FUNCTION__);
-    if (mFdMap.size() > 0) {
-        for (auto it = mFdMap.begin(); it != mFdMap.end(); ) {
-            for (int i = 0; i < it->second.plane; i++) {
-                close(it->second.fd[i]);
-            }
-            it = mFdMap.erase(it);
+    std::lock_guard<std::mutex> lock(mFdMutex);
+
+    mFdTable.forEach([](fds_t &fixed) {
+        for (int i = 0; i < fixed.plane; i++) {
+            if (fixed.fd[i] >= 0)
+                close(fixed.fd[i]);
         }
-    }
+    });
+    mFdTable.clear();
     StaticExynosLog(Level::Trace, "BufferFdManager", "[%s] allFdClear--", __FUNCTION__);
 }
 
+void BufferFdManager::reclaimIdleFds() {
+    int cnt = 0;
+
+    while ((mFdTable.idleCount() > GARBAGE_CLEANUP_BASELINE) &&
+           (cnt < GARBAGE_CLEANUP_BUDGET)) {
+        int id = mFdTable.oldestIdle();
+        fds_t &fixed = mFdTable.at(id);
+
+        for (int i = 0; i < fixed.plane; i++) {
+            if (fixed.fd[i] >= 0)
+                close(fixed.fd[i]);
+        }
+
+        mFdTable.erase(id);
+        cnt++;
+    }
+
+    if (cnt > 0) {
+        StaticExynosLog(Level::Trace, "BufferFdManager", "[%s] clear reserved FDs (%d), idle:%zu", __FUNCTION__, cnt, mFdTable.idleCount());
+    }
+}
+
 int BufferFdManager::fixedFd(int orgFd, int targetFd) {
     int ret = -1;
 
@@ -191,15 +193,29 @@ uint64_t BufferFdManager::getStIno(int fd) {
     return (uint64_t)statInfo.st_ino;
 }
 
+uint64_t BufferFdManager::getStIno(std::shared_ptr<ExynosBuffer> buffer) {
+    auto optKey = buffer->getStIno();
+    if (optKey) {
+        return *optKey;
+    }
+
+    uint64_t key = getStIno((buffer->handle())->data[0]);
+    buffer->setStIno(key);
+
+    return key;
+}
+
 
 void* SharedPtrManager::swapSharedPtrToPtr(std::shared_ptr<ExynosBuffer> shPtr, fds_t &fds) {
-    std::lock_guard<std::mutex> lock(mMutex);
     if (shPtr.get() != nullptr) {
+        std::lock_guard<std::mutex> lock(mMutex);
         auto swapData = std::make_shared<swap_data>();
         swapData.get()->mShPtr = shPtr;
         mQueue.enqueue((uint64_t)shPtr.get(), swapData);
     }
 
+    /* fixed fds are serialized by BufferFdManager itself */
+
     memset(&fds, 0, sizeof(fds));
 
     if (mFixedFDEnable == true) {
@@ -210,8 +226,8 @@ void* SharedPtrManager::swapSharedPtrToPtr(std::shared_ptr<ExynosBuffer> shPtr,
 }
 
 void* SharedPtrManager::swapSharedPtrToPtr(std::shared_ptr<ExynosBuffer> shPtr, fds_t &fds, ExynosParams params) {
-    std::lock_guard<std::mutex> lock(mMutex);
     if (shPtr.get() != nullptr) {
+        std::lock_guard<std::mutex> lock(mMutex);
         auto swapData = std::make_shared<swap_data>();
         swapData.get()->mShPtr = shPtr;
         swapData.get()->params = params;
@@ -229,11 +245,11 @@ void* SharedPtrManager::swapSharedPtrToPtr(std::shared_ptr<ExynosBuffer> shPtr,
 }
 
 std::shared_ptr<ExynosBuffer> SharedPtrManager::swapPtrToSharedPtr(void *ptr, bool bDelayReturn) {
-    std::lock_guard<std::mutex> lock(mMutex);
     std::shared_ptr<swap_data> swapData = nullptr;
     std::shared_ptr<ExynosBuffer> shPtr = nullptr;
 
     if (ptr != nullptr) {
+        std::lock_guard<std::mutex> lock(mMutex);
         if (true == mQueue.dequeue((uint64_t)ptr, swapData)) {
             if (swapData.get() != nullptr) {
                 shPtr = swapData.get()->mShPtr;
@@ -255,11 +271,11 @@ EXIT:
 }
 
 std::shared_ptr<ExynosBuffer> SharedPtrManager::swapPtrToSharedPtr(void *ptr, ExynosParams &params, bool bDelayReturn) {
-    std::lock_guard<std::mutex> lock(mMutex);
     std::shared_ptr<swap_data> swapData = nullptr;
     std::shared_ptr<ExynosBuffer> shPtr = nullptr;
 
     if (ptr != nullptr) {
+        std::lock_guard<std::mutex> lock(mMutex);
         if (true == mQueue.dequeue((uint64_t)ptr, swapData)) {
             if (swapData.get() != nullptr) {
                 shPtr = swapData.get()->mShPtr;
@@ -282,10 +298,10 @@ EXIT:
 }
 
 void SharedPtrManager::eraseSharedPtr(std::shared_ptr<ExynosBuffer> shPtr) {
-    std::lock_guard<std::mutex> lock(mMutex);
     std::shared_ptr<swap_data> temp = nullptr;
 
     if (shPtr != nullptr) {
+        std::lock_guard<std::mutex> lock(mMutex);
         mQueue.dequeue((uint64_t)shPtr.get(), temp);
     }
 
@@ -23,6 +23,7 @@
 #include <map>
 #include <sys/mman.h>
 
+#include "ExynosInodeTable.h"
 #include "ExynosQueue.h"
 #include "ExynosMutex.h"
 #include "ExynosDef.h"
@@ -54,11 +55,16 @@ public:
     void returnFixedFds(std::shared_ptr<ExynosBuffer> buffer);
     void allFdClear();
     static uint64_t getStIno(int fd);
+    /* inode of the first plane, cached in the buffer after the first fstat */
+    static uint64_t getStIno(std::shared_ptr<ExynosBuffer> buffer);
 
 private:
     int fixedFd(int orgFd, int targetFd);
+    void reclaimIdleFds();
 
-    std::map<uint64_t, fds_t> mFdMap;
+    std::mutex mFdMutex;
+    /* fixed fds by inode, idle entries (dupCount == 0) are kept in LRU order */
+    ExynosInodeTable<fds_t> mFdTable;
 };
 
 
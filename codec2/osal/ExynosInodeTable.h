@@ -0,0 +1,236 @@
+/*
+ *
+ * Copyright 2020 Samsung Electronics S.LSI Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef EXYNOS_INODE_TABLE_H
+#define EXYNOS_INODE_TABLE_H
+
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Open addressed (linear probing) table keyed by inode number.
+ * Entries live in a slab and keep a stable id until they are erased, so the
+ * idle entries can be chained into an intrusive LRU list by id.
+ * Not thread safe; the owner serializes the accesses.
+ */
+template<class T>
+class ExynosInodeTable {
+public:
+    static constexpr int INVALID_ID = -1;
+
+    ExynosInodeTable() : mCount(0), mIdleCount(0), mIdleHead(INVALID_ID), mIdleTail(INVALID_ID) {
+        mSlots.assign(INITIAL_SLOTS, INVALID_ID);
+    }
+
+    int find(uint64_t key) const {
+        size_t mask = mSlots.size() - 1;
+
+        for (size_t slot = hash(key) & mask; mSlots[slot] != INVALID_ID; slot = (slot + 1) & mask) {
+            if (mEntries[mSlots[slot]].key == key) {
+                return mSlots[slot];
+            }
+        }
+
+        return INVALID_ID;
+    }
+
+    /* the key must not be in the table yet */
+    int insert(uint64_t key, const T &value) {
+        if ((mCount + 1) * 2 > mSlots.size()) {
+            rehash(mSlots.size() * 2);
+        }
+
+        int id;
+        if (!mFreeIds.empty()) {
+            id = mFreeIds.back();
+            mFreeIds.pop_back();
+        } else {
+            id = static_cast<int>(mEntries.size());
+            mEntries.emplace_back();
+        }
+
+        Entry &entry = mEntries[id];
+        entry.key   = key;
+        entry.value = value;
+        entry.used  = true;
+        entry.idle  = false;
+        entry.prev  = entry.next = INVALID_ID;
+
+        place(id);
+        mCount++;
+
+        return id;
+    }
+
+    void erase(int id) {
+        size_t mask = mSlots.size() - 1;
+        size_t slot = hash(mEntries[id].key) & mask;
+
+        while (mSlots[slot] != id) {
+            slot = (slot + 1) & mask;
+        }
+
+        /* backward shift deletion keeps the probe sequences intact without tombstones */
+        for (size_t next = (slot + 1) & mask; mSlots[next] != INVALID_ID; next = (next + 1) & mask) {
+            size_t home = hash(mEntries[mSlots[next]].key) & mask;
+
+            if (((next - home) & mask) >= ((next - slot) & mask)) {
+                mSlots[slot] = mSlots[next];
+                slot = next;
+            }
+        }
+        mSlots[slot] = INVALID_ID;
+
+        setBusy(id);
+        mEntries[id].used = false;
+        mFreeIds.push_back(id);
+        mCount--;
+    }
+
+    T& at(int id) {
+        return mEntries[id].value;
+    }
+
+    uint64_t keyOf(int id) const {
+        return mEntries[id].key;
+    }
+
+    bool isIdle(int id) const {
+        return mEntries[id].idle;
+    }
+
+    /* appends the entry to the tail (most recently used end) of the idle list */
+    void setIdle(int id) {
+        Entry &entry = mEntries[id];
+
+        if (entry.idle) {
+            return;
+        }
+
+        entry.idle = true;
+        entry.prev = mIdleTail;
+        entry.next = INVALID_ID;
+
+        if (mIdleTail != INVALID_ID) {
+            mEntries[mIdleTail].next = id;
+        } else {
+            mIdleHead = id;
+        }
+        mIdleTail = id;
+        mIdleCount++;
+    }
+
+    void setBusy(int id) {
+        Entry &entry = mEntries[id];
+
+        if (!entry.idle) {
+            return;
+        }
+
+        if (entry.prev != INVALID_ID) {
+            mEntries[entry.prev].next = entry.next;
+        } else {
+            mIdleHead = entry.next;
+        }
+
+        if (entry.next != INVALID_ID) {
+            mEntries[entry.next].prev = entry.prev;
+        } else {
+            mIdleTail = entry.prev;
+        }
+
+        entry.idle = false;
+        entry.prev = entry.next = INVALID_ID;
+        mIdleCount--;
+    }
+
+    /* least recently used idle entry */
+    int oldestIdle() const {
+        return mIdleHead;
+    }
+
+    template<class F>
+    void forEach(F func) {
+        for (size_t id = 0; id < mEntries.size(); id++) {
+            if (mEntries[id].used) {
+                func(mEntries[id].value);
+            }
+        }
+    }
+
+    void clear() {
+        mEntries.clear();
+        mFreeIds.clear();
+        mSlots.assign(INITIAL_SLOTS, INVALID_ID);
+        mCount = mIdleCount = 0;
+        mIdleHead = mIdleTail = INVALID_ID;
+    }
+
+    size_t size() const {
+        return mCount;
+    }
+
+    size_t idleCount() const {
+        return mIdleCount;
+    }
+
+private:
+    static constexpr size_t INITIAL_SLOTS = 64;
+
+    struct Entry {
+        uint64_t key;
+        T        value;
+        bool     used;
+        bool     idle;
+        int      prev;
+        int      next;
+    };
+
+    static size_t hash(uint64_t key) {
+        /* fibonacci hashing spreads the mostly sequential inode numbers */
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 32);
+    }
+
+    void place(int id) {
+        size_t mask = mSlots.size() - 1;
+        size_t slot = hash(mEntries[id].key) & mask;
+
+        while (mSlots[slot] != INVALID_ID) {
+            slot = (slot + 1) & mask;
+        }
+        mSlots[slot] = id;
+    }
+
+    void rehash(size_t slots) {
+        mSlots.assign(slots, INVALID_ID);
+
+        for (size_t id = 0; id < mEntries.size(); id++) {
+            if (mEntries[id].used) {
+                place(static_cast<int>(id));
+            }
+        }
+    }
+
+    std::vector<Entry> mEntries;
+    std::vector<int>   mFreeIds;
+    std::vector<int>   mSlots;
+    size_t mCount;
+    size_t mIdleCount;
+    int    mIdleHead;
+    int    mIdleTail;
+};
+
+#endif // EXYNOS_INODE_TABLE_H
@@ -0,0 +1,176 @@
+/*
+ *
+ * Copyright 2020 Samsung Electronics S.LSI Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef EXYNOS_MODULE_POOL_H
+#define EXYNOS_MODULE_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Keeps the most recently used objects alive after their last user is gone,
+ * so that using them again does not pay for their creation.
+ * At most `capacity` objects are kept. An object is released once it was not
+ * used for `idleTimeout`, or when newer ones push it out. Retained objects
+ * are handed to `warmUp` on the pool thread, outside of the caller's path.
+ * The objects are always released without the pool lock held.
+ */
+template<class T>
+class ExynosModulePool {
+public:
+    using WarmUpFunc = std::function<void(const std::shared_ptr<T> &)>;
+
+    ExynosModulePool(size_t capacity, std::chrono::milliseconds idleTimeout, WarmUpFunc warmUp = nullptr)
+        : mCapacity(capacity), mIdleTimeout(idleTimeout), mWarmUp(std::move(warmUp)), mExit(false) {
+    }
+
+    ~ExynosModulePool() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mExit = true;
+        }
+        mCondition.notify_all();
+
+        if (mThread.joinable()) {
+            mThread.join();
+        }
+
+        clear();
+    }
+
+    /* marks obj as used now */
+    void retain(const std::shared_ptr<T> &obj) {
+        std::vector<std::shared_ptr<T>> released;
+
+        if (obj == nullptr) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            bool found = false;
+
+            for (auto it = mEntries.begin(); it != mEntries.end(); it++) {
+                if (it->obj == obj) {
+                    mEntries.splice(mEntries.begin(), mEntries, it);
+                    found = true;
+                    break;
+                }
+            }
+
+            if (!found) {
+                mEntries.push_front({ obj, Clock::now(), (mWarmUp != nullptr) });
+            }
+
+            mEntries.front().lastUsed = Clock::now();
+            mEntries.front().needWarmUp = (mWarmUp != nullptr);
+
+            while (mEntries.size() > mCapacity) {
+                released.push_back(std::move(mEntries.back().obj));
+                mEntries.pop_back();
+            }
+
+            if (!mThread.joinable()) {
+                mThread = std::thread([this]() { run(); });
+            }
+        }
+        mCondition.notify_all();
+    }
+
+    void clear() {
+        std::list<Entry> released;
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        released.swap(mEntries);
+        /* the objects go away once the lock is dropped */
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mEntries.size();
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::shared_ptr<T> obj;
+        Clock::time_point lastUsed;
+        bool needWarmUp;
+    };
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mMutex);
+
+        while (!mExit) {
+            std::shared_ptr<T> warmUp;
+            std::vector<std::shared_ptr<T>> released;
+            Clock::time_point now = Clock::now();
+            Clock::time_point wakeUp = Clock::time_point::max();
+
+            for (auto it = mEntries.begin(); it != mEntries.end(); ) {
+                if (now - it->lastUsed >= mIdleTimeout) {
+                    released.push_back(std::move(it->obj));
+                    it = mEntries.erase(it);
+                    continue;
+                }
+
+                if (it->needWarmUp && (warmUp == nullptr)) {
+                    it->needWarmUp = false;
+                    warmUp = it->obj;
+                }
+
+                wakeUp = std::min(wakeUp, it->lastUsed + mIdleTimeout);
+                it++;
+            }
+
+            if ((warmUp != nullptr) || !released.empty()) {
+                lock.unlock();
+                released.clear();
+                if (warmUp != nullptr) {
+                    mWarmUp(warmUp);
+                    warmUp.reset();
+                }
+                lock.lock();
+                continue;
+            }
+
+            if (wakeUp == Clock::time_point::max()) {
+                mCondition.wait(lock);
+            } else {
+                mCondition.wait_until(lock, wakeUp);
+            }
+        }
+    }
+
+    const size_t mCapacity;
+    const std::chrono::milliseconds mIdleTimeout;
+    const WarmUpFunc mWarmUp;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::list<Entry> mEntries;
+    std::thread mThread;
+    bool mExit;
+};
+
+#endif  // EXYNOS_MODULE_POOL_H
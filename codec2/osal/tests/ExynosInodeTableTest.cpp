@@ -0,0 +1,301 @@
+/*
+ *
+ * Copyright 2020 Samsung Electronics S.LSI Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "ExynosInodeTable.h"
+
+namespace {
+
+struct FixedFd {
+    int dupCount;
+    int fd;
+};
+
+/* the queue path of BufferFdManager before the inode table: std::map and a full sweep */
+class LegacyFdCache {
+public:
+    ~LegacyFdCache() {
+        for (auto &it : mFdMap) {
+            close(it.second.fd);
+        }
+    }
+
+    int get(uint64_t key, int orgFd) {
+        if (mFdMap.size() > 32) {
+            for (auto it = mFdMap.begin(); it != mFdMap.end(); ) {
+                if (it->second.dupCount > 0) {
+                    it++;
+                    continue;
+                }
+                close(it->second.fd);
+                it = mFdMap.erase(it);
+            }
+        }
+
+        auto search = mFdMap.find(key);
+        if (search == mFdMap.end()) {
+            int fd = dup(orgFd);
+            mFdMap.emplace(key, FixedFd{1, fd});
+            return fd;
+        }
+
+        dup2(orgFd, search->second.fd);
+        search->second.dupCount++;
+        return search->second.fd;
+    }
+
+    void put(uint64_t key) {
+        auto search = mFdMap.find(key);
+        if (search != mFdMap.end()) {
+            if (search->second.dupCount == 1) {
+                dup2(STDOUT_FILENO, search->second.fd);
+            }
+            search->second.dupCount--;
+        }
+    }
+
+    size_t fds() const {
+        return mFdMap.size();
+    }
+
+private:
+    std::map<uint64_t, FixedFd> mFdMap;
+};
+
+/* the queue path of BufferFdManager with the inode table and bounded reclaim */
+class TableFdCache {
+public:
+    ~TableFdCache() {
+        mTable.forEach([](FixedFd &fixed) { close(fixed.fd); });
+    }
+
+    int get(uint64_t key, int orgFd) {
+        for (int cnt = 0; (mTable.idleCount() > 32) && (cnt < 2); cnt++) {
+            int id = mTable.oldestIdle();
+            close(mTable.at(id).fd);
+            mTable.erase(id);
+        }
+
+        int id = mTable.find(key);
+        if (id == ExynosInodeTable<FixedFd>::INVALID_ID) {
+            int fd = dup(orgFd);
+            mTable.insert(key, FixedFd{1, fd});
+            return fd;
+        }
+
+        FixedFd &fixed = mTable.at(id);
+        mTable.setBusy(id);
+        dup2(orgFd, fixed.fd);
+        fixed.dupCount++;
+        return fixed.fd;
+    }
+
+    void put(uint64_t key) {
+        int id = mTable.find(key);
+        if (id != ExynosInodeTable<FixedFd>::INVALID_ID) {
+            FixedFd &fixed = mTable.at(id);
+            if (fixed.dupCount == 1) {
+                dup2(STDOUT_FILENO, fixed.fd);
+            }
+            if (--fixed.dupCount == 0) {
+                mTable.setIdle(id);
+            }
+        }
+    }
+
+    size_t fds() const {
+        return mTable.size();
+    }
+
+private:
+    ExynosInodeTable<FixedFd> mTable;
+};
+
+struct PoolBuffer {
+    int fd;
+    uint64_t ino;
+};
+
+std::vector<PoolBuffer> allocatePool(int count) {
+    std::vector<PoolBuffer> pool;
+
+    for (int i = 0; i < count; i++) {
+        struct stat st;
+        int fd = memfd_create("c2buf", 0);
+
+        if (fd < 0 || fstat(fd, &st)) {
+            break;
+        }
+        pool.push_back({fd, (uint64_t)st.st_ino});
+    }
+
+    return pool;
+}
+
+void freePool(std::vector<PoolBuffer> &pool) {
+    for (auto &buffer : pool) {
+        close(buffer.fd);
+    }
+    pool.clear();
+}
+
+/*
+ * Decodes `seconds` of video at `fps` out of a pool of `poolSize` buffers with
+ * `inFlight` of them queued to the driver. The pool is reallocated every two
+ * seconds like on a resolution change. Returns the p99 of the queue path in ns.
+ */
+template<class Cache>
+int64_t decode(int fps, int seconds, int poolSize, int inFlight, size_t *maxFds) {
+    Cache cache;
+    std::mt19937 rng(fps);
+    std::vector<PoolBuffer> pool;
+    std::deque<uint64_t> queued;
+    std::vector<int64_t> latency;
+
+    *maxFds = 0;
+
+    for (int frame = 0; frame < fps * seconds; frame++) {
+        if (frame % (fps * 2) == 0) {
+            freePool(pool);
+            pool = allocatePool(poolSize);
+            if ((int)pool.size() != poolSize) {
+                ADD_FAILURE() << "cannot allocate the buffer pool";
+                break;
+            }
+        }
+
+        /* the client hands out the free buffers in a loosely round robin order */
+        const PoolBuffer &buffer = pool[(frame + rng() % 4) % pool.size()];
+
+        auto start = std::chrono::steady_clock::now();
+        cache.get(buffer.ino, buffer.fd);
+        latency.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - start).count());
+
+        queued.push_back(buffer.ino);
+        if ((int)queued.size() > inFlight) {
+            cache.put(queued.front());
+            queued.pop_front();
+        }
+        *maxFds = std::max(*maxFds, cache.fds());
+    }
+
+    while (!queued.empty()) {
+        cache.put(queued.front());
+        queued.pop_front();
+    }
+    freePool(pool);
+
+    if (latency.empty()) {
+        return 0;
+    }
+
+    std::sort(latency.begin(), latency.end());
+    return latency[latency.size() * 99 / 100];
+}
+
+} // namespace
+
+TEST(ExynosInodeTableTest, MatchesStdMap) {
+    ExynosInodeTable<int> table;
+    std::map<uint64_t, int> reference;
+    std::mt19937 rng(1234);
+
+    for (int i = 0; i < 200000; i++) {
+        /* sequential-ish inode numbers collide a lot in a plain modulo hash */
+        uint64_t key = 4096 + (rng() % 512) * 8;
+        int id = table.find(key);
+
+        ASSERT_EQ(reference.count(key) > 0, id != ExynosInodeTable<int>::INVALID_ID);
+
+        if (id == ExynosInodeTable<int>::INVALID_ID) {
+            table.insert(key, i);
+            reference[key] = i;
+        } else if (rng() % 2) {
+            ASSERT_EQ(reference[key], table.at(id));
+            table.erase(id);
+            reference.erase(key);
+        } else if (rng() % 2) {
+            table.setIdle(id);
+        } else {
+            table.setBusy(id);
+        }
+
+        ASSERT_EQ(reference.size(), table.size());
+    }
+}
+
+TEST(ExynosInodeTableTest, IdleEntriesInLruOrder) {
+    ExynosInodeTable<int> table;
+    int ids[4];
+
+    for (int i = 0; i < 4; i++) {
+        ids[i] = table.insert(100 + i, i);
+    }
+
+    table.setIdle(ids[2]);
+    table.setIdle(ids[0]);
+    table.setIdle(ids[3]);
+    table.setIdle(ids[0]);  /* already idle, keeps its position */
+    EXPECT_EQ(3u, table.idleCount());
+    EXPECT_EQ(ids[2], table.oldestIdle());
+
+    table.setBusy(ids[2]);
+    EXPECT_EQ(ids[0], table.oldestIdle());
+
+    table.erase(ids[0]);
+    EXPECT_EQ(ids[3], table.oldestIdle());
+    EXPECT_EQ(1u, table.idleCount());
+    EXPECT_EQ(ExynosInodeTable<int>::INVALID_ID, table.find(100));
+    EXPECT_EQ(ids[1], table.find(101));
+}
+
+TEST(ExynosInodeTableTest, QueuePathLatency) {
+    const struct {
+        int fps;
+        int poolSize;
+        int inFlight;
+    } kCases[] = {
+        {  60,  48,  8 },
+        { 120,  96, 16 },
+        { 120, 160, 24 },
+    };
+
+    for (auto &c : kCases) {
+        size_t legacyFds, tableFds;
+        int64_t legacy = decode<LegacyFdCache>(c.fps, 10, c.poolSize, c.inFlight, &legacyFds);
+        int64_t table  = decode<TableFdCache>(c.fps, 10, c.poolSize, c.inFlight, &tableFds);
+
+        printf("%3d fps, pool %3d: p99 queue path %7.2f us -> %7.2f us, fixed fds %zu -> %zu\n",
+               c.fps, c.poolSize, legacy / 1000.0, table / 1000.0, legacyFds, tableFds);
+
+        /* fixed fds stay around GARBAGE_CLEANUP_BASELINE idle ones plus the queued ones */
+        EXPECT_LE(tableFds, (size_t)(32 + c.inFlight + 8));
+    }
+}
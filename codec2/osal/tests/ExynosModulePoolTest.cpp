@@ -0,0 +1,128 @@
+/*
+ *
+ * Copyright 2020 Samsung Electronics S.LSI Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "ExynosModulePool.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+struct Counted {
+    explicit Counted(std::atomic_int *alive) : mAlive(alive) {
+        (*mAlive)++;
+    }
+    ~Counted() {
+        (*mAlive)--;
+    }
+
+    std::atomic_int *mAlive;
+};
+
+bool waitFor(std::function<bool()> cond, std::chrono::milliseconds timeout) {
+    auto end = Clock::now() + timeout;
+
+    while (!cond()) {
+        if (Clock::now() > end) {
+            return false;
+        }
+        std::this_thread::sleep_for(1ms);
+    }
+
+    return true;
+}
+
+} // namespace
+
+TEST(ExynosModulePoolTest, KeepsMostRecentlyUsed) {
+    std::atomic_int alive(0);
+    ExynosModulePool<Counted> pool(2, 10s);
+    std::weak_ptr<Counted> a, b, c;
+
+    {
+        auto objA = std::make_shared<Counted>(&alive);
+        auto objB = std::make_shared<Counted>(&alive);
+        auto objC = std::make_shared<Counted>(&alive);
+
+        a = objA;
+        b = objB;
+        c = objC;
+
+        pool.retain(objA);
+        pool.retain(objB);
+        pool.retain(objA);  /* b is now the least recently used */
+        pool.retain(objC);
+    }
+
+    EXPECT_FALSE(a.expired());
+    EXPECT_TRUE(b.expired());
+    EXPECT_FALSE(c.expired());
+    EXPECT_EQ(2, alive);
+    EXPECT_EQ(2u, pool.size());
+
+    pool.clear();
+    EXPECT_EQ(0, alive);
+}
+
+TEST(ExynosModulePoolTest, ReleasesIdleObjects) {
+    std::atomic_int alive(0);
+    ExynosModulePool<Counted> pool(4, 100ms);
+    std::weak_ptr<Counted> first, second;
+
+    {
+        auto obj = std::make_shared<Counted>(&alive);
+        first = obj;
+        pool.retain(obj);
+    }
+
+    std::this_thread::sleep_for(60ms);
+    {
+        auto obj = std::make_shared<Counted>(&alive);
+        second = obj;
+        pool.retain(obj);
+    }
+
+    EXPECT_TRUE(waitFor([&]() { return first.expired(); }, 1s));
+    EXPECT_FALSE(second.expired());
+    EXPECT_TRUE(waitFor([&]() { return second.expired(); }, 1s));
+    EXPECT_EQ(0, alive);
+}
+
+TEST(ExynosModulePoolTest, WarmsUpOffTheCaller) {
+    std::atomic_int warmUps(0);
+    std::thread::id caller = std::this_thread::get_id();
+    std::thread::id worker;
+    ExynosModulePool<int> pool(4, 10s, [&](const std::shared_ptr<int> &) {
+        worker = std::this_thread::get_id();
+        warmUps++;
+    });
+    auto obj = std::make_shared<int>(0);
+
+    pool.retain(obj);
+    ASSERT_TRUE(waitFor([&]() { return warmUps == 1; }, 1s));
+    EXPECT_NE(caller, worker);
+
+    pool.retain(obj);
+    EXPECT_TRUE(waitFor([&]() { return warmUps == 2; }, 1s));
+}
@@ -0,0 +1,358 @@
+/*
+ *
+ * Copyright 2020 Samsung Electronics S.LSI Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <C2Component.h>
+#include <C2ComponentFactory.h>
+#include <C2Config.h>
+#include <util/C2InterfaceHelper.h>
+
+#include <ctype.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "C2ExynosSupport.h"
+
+/*
+ * The store is built into this test with dlopen(), dlsym() and dlclose()
+ * renamed to the functions below (see Android.mk), so that it loads fake
+ * codec libraries. A fake library is named as the real one, and its
+ * factories count what the store asks them for.
+ */
+namespace {
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+std::mutex gLock;
+std::map<std::string, std::unique_ptr<std::string>> gLibraries;
+std::thread::id gCaller;
+
+std::atomic_int gFactories(0);          // factories alive
+std::atomic_int gFactoryCreations(0);
+std::atomic_int gInterfaces(0);         // interfaces alive, the prepared ones included
+std::atomic_int gInterfaceCreations(0);
+std::atomic_int gCallerCreations(0);    // interfaces created on the thread of the test
+
+/* libExynosC2H264Dec.so -> c2.exynos.h264.decoder */
+C2String componentName(const std::string &libPath, bool isSecure) {
+    std::string codec = libPath.substr(strlen("libExynosC2"), libPath.size() - strlen("libExynosC2Dec.so"));
+    bool encoder = (libPath.find("Enc.so") != std::string::npos);
+
+    for (auto &c : codec) {
+        c = tolower(c);
+    }
+
+    return "c2.exynos." + codec + ((encoder == true)? ".encoder":".decoder") + ((isSecure == true)? ".secure":"");
+}
+
+class FakeInterface : public C2ComponentInterface {
+public:
+    struct Params : public C2InterfaceHelper {
+        std::shared_ptr<C2ComponentKindSetting> mKind;
+        std::shared_ptr<C2ComponentDomainSetting> mDomain;
+        std::shared_ptr<C2PortMediaTypeSetting::input> mInputMediaType;
+        std::shared_ptr<C2PortMediaTypeSetting::output> mOutputMediaType;
+
+        Params(std::shared_ptr<C2ReflectorHelper> reflector, bool encoder) : C2InterfaceHelper(reflector) {
+            setDerivedInstance(this);
+
+            addParameter(
+                DefineParam(mKind, C2_PARAMKEY_COMPONENT_KIND)
+                .withConstValue(new C2ComponentKindSetting((encoder == true)? C2Component::KIND_ENCODER:C2Component::KIND_DECODER))
+                .build());
+
+            addParameter(
+                DefineParam(mDomain, C2_PARAMKEY_COMPONENT_DOMAIN)
+                .withConstValue(new C2ComponentDomainSetting(C2Component::DOMAIN_VIDEO))
+                .build());
+
+            addParameter(
+                DefineParam(mInputMediaType, C2_PARAMKEY_INPUT_MEDIA_TYPE)
+                .withConstValue(AllocSharedString<C2PortMediaTypeSetting::input>((encoder == true)? "video/raw":"video/x-test"))
+                .build());
+
+            addParameter(
+                DefineParam(mOutputMediaType, C2_PARAMKEY_OUTPUT_MEDIA_TYPE)
+                .withConstValue(AllocSharedString<C2PortMediaTypeSetting::output>((encoder == true)? "video/x-test":"video/raw"))
+                .build());
+        }
+    };
+
+    FakeInterface(C2String name, c2_node_id_t id, bool encoder)
+        : mName(name),
+          mId(id),
+          mHelper(std::make_shared<C2ReflectorHelper>(), encoder) {
+        gInterfaces++;
+        gInterfaceCreations++;
+        if (std::this_thread::get_id() == gCaller) {
+            gCallerCreations++;
+        }
+    }
+    ~FakeInterface() override {
+        gInterfaces--;
+    }
+
+    C2String getName() const override { return mName; }
+    c2_node_id_t getId() const override { return mId; }
+
+    c2_status_t query_vb(
+            const std::vector<C2Param*> &stackParams,
+            const std::vector<C2Param::Index> &heapParamIndices,
+            c2_blocking_t mayBlock,
+            std::vector<std::unique_ptr<C2Param>>* const heapParams) const override {
+        return mHelper.query(stackParams, heapParamIndices, mayBlock, heapParams);
+    }
+    c2_status_t config_vb(
+            const std::vector<C2Param*> &params,
+            c2_blocking_t mayBlock,
+            std::vector<std::unique_ptr<C2SettingResult>>* const failures) override {
+        return mHelper.config(params, mayBlock, failures);
+    }
+    c2_status_t querySupportedParams_nb(
+            std::vector<std::shared_ptr<C2ParamDescriptor>> * const params) const override {
+        return mHelper.querySupportedParams(params);
+    }
+    c2_status_t querySupportedValues_vb(
+            std::vector<C2FieldSupportedValuesQuery> &fields,
+            c2_blocking_t mayBlock) const override {
+        return mHelper.querySupportedValues(fields, mayBlock);
+    }
+    c2_status_t createTunnel_sm(c2_node_id_t) override { return C2_OMITTED; }
+    c2_status_t releaseTunnel_sm(c2_node_id_t) override { return C2_OMITTED; }
+
+private:
+    C2String mName;
+    c2_node_id_t mId;
+    Params mHelper;
+};
+
+class FakeFactory : public C2ComponentFactory {
+public:
+    FakeFactory(const std::string &libPath, bool isSecure)
+        : mName(componentName(libPath, isSecure)),
+          mEncoder(libPath.find("Enc.so") != std::string::npos) {
+        gFactories++;
+        gFactoryCreations++;
+    }
+    ~FakeFactory() override {
+        gFactories--;
+    }
+
+    c2_status_t createComponent(
+        c2_node_id_t,
+        std::shared_ptr<C2Component> * const component,
+        std::function<void(C2Component*)>) override {
+        component->reset();
+        return C2_OMITTED;
+    }
+
+    c2_status_t createInterface(
+        c2_node_id_t id,
+        std::shared_ptr<C2ComponentInterface> * const interface,
+        std::function<void(C2ComponentInterface*)> deleter) override {
+        *interface = std::shared_ptr<C2ComponentInterface>(new FakeInterface(mName, id, mEncoder), deleter);
+        return C2_OK;
+    }
+
+private:
+    C2String mName;
+    bool mEncoder;
+};
+
+/*
+ * the symbols resolve to these, the handle is the path of the library. the
+ * modules are loaded one at a time by the test, so the factory is created for
+ * the library looked up last.
+ */
+std::string *gLoading;
+
+::C2ComponentFactory *createCodec2Factory() {
+    return new FakeFactory(*gLoading, false);
+}
+
+::C2ComponentFactory *createSecureCodec2Factory() {
+    return new FakeFactory(*gLoading, true);
+}
+
+void destroyCodec2Factory(::C2ComponentFactory *factory) {
+    delete factory;
+}
+
+bool waitFor(std::function<bool()> cond, std::chrono::milliseconds timeout) {
+    auto end = Clock::now() + timeout;
+
+    while (!cond()) {
+        if (Clock::now() > end) {
+            return false;
+        }
+        std::this_thread::sleep_for(1ms);
+    }
+
+    return true;
+}
+
+} // namespace
+
+extern "C" void *ExynosC2TestDlopen(const char *filename, int /* flags */) {
+    std::lock_guard<std::mutex> lock(gLock);
+
+    auto &library = gLibraries[filename];
+    if (library == nullptr) {
+        library.reset(new std::string(filename));
+    }
+
+    return library.get();
+}
+
+extern "C" void *ExynosC2TestDlsym(void *handle, const char *symbol) {
+    gLoading = static_cast<std::string *>(handle);
+
+    if (strcmp(symbol, "CreateCodec2Factory") == 0) {
+        return reinterpret_cast<void *>(createCodec2Factory);
+    }
+    if (strcmp(symbol, "CreateSecureCodec2Factory") == 0) {
+        return reinterpret_cast<void *>(createSecureCodec2Factory);
+    }
+    if (strcmp(symbol, "DestroyCodec2Factory") == 0) {
+        return reinterpret_cast<void *>(destroyCodec2Factory);
+    }
+
+    return nullptr;
+}
+
+extern "C" int ExynosC2TestDlclose(void * /* handle */) {
+    return 0;
+}
+
+class ExynosC2ComponentStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        gCaller = std::this_thread::get_id();
+
+        mStore = android::GetCodec2ExynosComponentStore();
+        ASSERT_NE(nullptr, mStore);
+
+        /* the codecs are the ones of media_codecs_c2.xml */
+        mTraits = mStore->listComponents();
+        if (mTraits.empty()) {
+            GTEST_SKIP() << "no c2.exynos component in media_codecs_c2.xml";
+        }
+
+        for (auto &traits : mTraits) {
+            mNames.push_back(traits->name);
+        }
+    }
+
+    void TearDown() override {
+        /* the pooled modules go away with the store */
+        mStore.reset();
+        EXPECT_EQ(0, gFactories);
+        EXPECT_EQ(0, gInterfaces);
+    }
+
+    std::shared_ptr<C2ComponentStore> mStore;
+    std::vector<std::shared_ptr<const C2Component::Traits>> mTraits;
+    std::vector<C2String> mNames;
+};
+
+TEST_F(ExynosC2ComponentStoreTest, ListsFromCachedTraits) {
+    int factories = gFactoryCreations;
+    int interfaces = gInterfaceCreations;
+
+    for (int i = 0; i < 3; i++) {
+        auto traits = mStore->listComponents();
+
+        ASSERT_EQ(mTraits.size(), traits.size());
+        for (size_t j = 0; j < traits.size(); j++) {
+            EXPECT_EQ(mTraits[j], traits[j]);
+        }
+    }
+
+    EXPECT_EQ(factories, gFactoryCreations);
+    EXPECT_EQ(interfaces, gInterfaceCreations);
+
+    /* listing does not keep the modules */
+    EXPECT_EQ(0, gFactories);
+}
+
+TEST_F(ExynosC2ComponentStoreTest, TraitsDescribeTheInterface) {
+    for (auto &traits : mTraits) {
+        bool encoder = (traits->name.find(".encoder") != std::string::npos);
+
+        EXPECT_EQ((encoder == true)? C2Component::KIND_ENCODER:C2Component::KIND_DECODER, traits->kind) << traits->name;
+        EXPECT_EQ(C2Component::DOMAIN_VIDEO, traits->domain) << traits->name;
+        EXPECT_EQ("video/x-test", traits->mediaType) << traits->name;
+    }
+}
+
+TEST_F(ExynosC2ComponentStoreTest, HandsOutPreparedInterface) {
+    std::shared_ptr<C2ComponentInterface> interface;
+    C2String name = mNames[0];
+
+    /* the first one is built on the caller, the module is then pooled */
+    ASSERT_EQ(C2_OK, mStore->createInterface(name, &interface));
+    EXPECT_EQ(name, interface->getName());
+    interface.reset();
+
+    /* the pool thread prepares the next one */
+    ASSERT_TRUE(waitFor([]() { return gInterfaces == 1; }, 1s));
+    EXPECT_EQ(1, gFactories);
+
+    int callerCreations = gCallerCreations;
+    int factories = gFactoryCreations;
+
+    ASSERT_EQ(C2_OK, mStore->createInterface(name, &interface));
+    EXPECT_EQ(name, interface->getName());
+    EXPECT_EQ(callerCreations, gCallerCreations);
+    EXPECT_EQ(factories, gFactoryCreations);
+    interface.reset();
+
+    /* and again for the next user */
+    EXPECT_TRUE(waitFor([]() { return gInterfaces == 1; }, 1s));
+}
+
+TEST_F(ExynosC2ComponentStoreTest, KeepsRecentlyUsedModules) {
+    std::vector<C2String> names;
+
+    /* one component per module, a secure one has its own factory */
+    for (auto &name : mNames) {
+        std::shared_ptr<C2ComponentInterface> interface;
+
+        ASSERT_EQ(C2_OK, mStore->createInterface(name, &interface));
+        names.push_back(name);
+    }
+
+    /* MODULE_POOL_SIZE of them stay loaded */
+    EXPECT_TRUE(waitFor([&]() { return gFactories == std::min<int>(4, names.size()); }, 1s));
+
+    /* the most recently used one is still there */
+    int factories = gFactoryCreations;
+    std::shared_ptr<C2ComponentInterface> interface;
+
+    ASSERT_EQ(C2_OK, mStore->createInterface(names.back(), &interface));
+    EXPECT_EQ(factories, gFactoryCreations);
+}
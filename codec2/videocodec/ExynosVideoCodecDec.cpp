@@ -393,11 +393,6 @@ public:
     void *swapSharedPtrToPtr(std::shared_ptr<ExynosBuffer> shPtr, fds_t &fds) override {
         std::lock_guard<std::mutex> lock(mMutex);
         if (shPtr.get() != nullptr) {
-            auto optKey = shPtr->getStIno();
-            if (!optKey) {
-                shPtr->setStIno(BufferFdManager::getStIno((shPtr->handle())->data[0]));
-            }
-
             addRefDPB(shPtr);
 
             return SharedPtrManager::swapSharedPtrToPtr(shPtr, fds);
@@ -413,14 +408,7 @@ public:
         auto shPtr = SharedPtrManager::swapPtrToSharedPtr(ptr, bDelayReturn);
 
         if (shPtr.get() != nullptr) {
-            uint64_t key;
-            auto optKey = shPtr->getStIno();
-            if (!optKey) {
-                key = (uint64_t)BufferFdManager::getStIno((shPtr->handle())->data[0]);
-                shPtr->setStIno(key);
-            } else {
-                key = *optKey;
-            }
+            uint64_t key = BufferFdManager::getStIno(shPtr);
 
             if (!findRefDPB(key)) {
                 ExynosLogW("[%s] ref count is already decreased: fd(%d)", __FUNCTION__, (shPtr->handle())->data[0]);
@@ -436,14 +424,7 @@ public:
         if (shPtr != nullptr) {
             SharedPtrManager::eraseSharedPtr(shPtr);
 
-            uint64_t key;
-            auto optKey = shPtr->getStIno();
-            if (!optKey) {
-                key = (uint64_t)BufferFdManager::getStIno((shPtr->handle())->data[0]);
-                shPtr->setStIno(key);
-            } else {
-                key = *optKey;
-            }
+            uint64_t key = BufferFdManager::getStIno(shPtr);
 
             auto search = mMap.find(key);
             if (search != mMap.end()) {
@@ -538,14 +519,7 @@ public:
 private:
     bool findRefDPB(std::shared_ptr<ExynosBuffer> buffer) {
         if ((mMap.size() > 0) && (buffer.get() != nullptr)) {
-            uint64_t key;
-            auto optKey = buffer->getStIno();
-            if (!optKey) {
-                key = (uint64_t)BufferFdManager::getStIno((buffer->handle())->data[0]);
-                buffer->setStIno(key);
-            } else {
-                key = *optKey;
-            }
+            uint64_t key = BufferFdManager::getStIno(buffer);
 
             return (mMap.count(key) == 0)? false:true;
         }
@@ -559,14 +533,7 @@ private:
 
     void addRefDPB(std::shared_ptr<ExynosBuffer> buffer) {
         if (buffer.get() != nullptr) {
-            uint64_t key;
-            auto optKey = buffer->getStIno();
-            if (!optKey) {
-                key = (uint64_t)BufferFdManager::getStIno((buffer->handle())->data[0]);
-                buffer->setStIno(key);
-            } else {
-                key = *optKey;
-            }
+            uint64_t key = BufferFdManager::getStIno(buffer);
 
             auto search = mMap.find(key);
             if (search == mMap.end()) {
@@ -15,17 +15,27 @@
  */
 
 #include <algos/ap_hub_sync.h>
-#include <cpu/cpuMath.h>
+#include <floatRt.h>
 
 #include <limits.h>
+#include <math.h>
 #include <seos.h>
 
 #define S_IN_NS(s)          (UINT64_C(1000000000)*(s))
+#define US_IN_NS(us)        (UINT64_C(1000)*(us))
 
-#define SYNC_EXPIRATION     S_IN_NS(50) //50 sec in ns, at max 500us diff
 #define SYNC_WINDOW_TIMEOUT S_IN_NS(1)  //1 sec in ns
-#define SYNC_FILTER_B       8
-#define SYNC_FILTER_A       3
+#define SYNC_POINT_WINDOW   S_IN_NS(4)  //window of the maxima
+#define SYNC_ERROR_MIN      US_IN_NS(20) //latency jitter the window max cannot see
+#define SYNC_SKEW_MAX       100e-6f     //skew error until it is measured, 100 ppm
+#define SYNC_SKEW_ERROR_MIN 0.1e-6f     //0.1 ppm
+#define SYNC_SKEW_DRIFT     0.1e-15f    //0.1 ppm per sec, change of the skew with temperature
+#define SYNC_HISTORY_MAX    S_IN_NS(40) //age of the maxima dropped when there are enough newer
+#define SYNC_MIN_POINTS     3           //window maxima needed to fit the skew
+#define SYNC_SKEW_SPAN_MIN  S_IN_NS(4)  //time the maxima have to cover to fit the skew
+#define SYNC_FIT_TOLERANCE  1000.0f     //1us, float rounding of the maxima
+#define SYNC_INTERVAL_MIN   SYNC_WINDOW_TIMEOUT
+#define SYNC_INTERVAL_MAX   S_IN_NS(60) //60 sec in ns
 
 #define DEBUG_SYNC          false
 
@@ -34,83 +44,176 @@ static uint64_t abnormalStartTime;
 
 enum ApHubSyncState {
     NOT_INITED = 0,
-    USE_MAX,
-    USE_FILTERED
+    USE_FIT
 };
 
+static void resetPoints(struct ApHubSync* sync) {
+    sync->pointHead = 0;
+    sync->pointCount = 0;
+    sync->fitValid = false;
+    sync->state = NOT_INITED;
+}
+
 void apHubSyncReset(struct ApHubSync* sync) {
-    //sync->state = 0;
+    // the AP going to sleep only resets the detection of abnormal deltas
+    if (sync)
+        resetPoints(sync);
     isAbnormal = 0;
     if (DEBUG_SYNC) {
         osLog(LOG_DEBUG, "ApHub sync reset");
     }
 }
 
+static uint8_t newestPoint(const struct ApHubSync* sync) {
+    return (sync->pointHead + sync->pointCount - 1) % AP_HUB_SYNC_POINTS;
+}
+
+// Line over the window maxima that no maximum is above and that is the closest to them: as a
+// packet is never early, it follows the packets of least latency. It goes through two of the
+// maxima, and there are few enough of them to try every pair. The pair is taken at least half
+// the span apart when it can be, a line through close maxima is far off at the newest one.
+static bool fitSkew(struct ApHubSync* sync, const float *x, const float *y, uint8_t n,
+                    float minDist, float *dist, float *last) {
+    uint8_t i, j, k;
+    float slope, gap, cost, bestCost = -1.0f;
+
+    for (i = 0; i < n; i++) {
+        for (j = i + 1; j < n; j++) {
+            if (x[j] - x[i] < minDist)
+                continue;
+            slope = (y[j] - y[i]) / (x[j] - x[i]);
+            for (k = 0, cost = 0.0f; k < n; k++) {
+                gap = y[i] + slope * (x[k] - x[i]) - y[k];
+                if (gap < -SYNC_FIT_TOLERANCE)
+                    break;
+                cost += gap;
+            }
+            if (k == n && (bestCost < 0.0f || cost < bestCost)) {
+                bestCost = cost;
+                sync->skew = slope;
+                *dist = x[j] - x[i];
+                *last = -x[j];
+            }
+        }
+    }
+    return bestCost >= 0.0f;
+}
+
+static void fitLine(struct ApHubSync* sync) {
+    float x[AP_HUB_SYNC_POINTS], y[AP_HUB_SYNC_POINTS];
+    uint8_t newest = newestPoint(sync);
+    uint8_t n = sync->pointCount;
+    uint8_t i, a;
+    uint64_t span;
+    float top, gap, error = 0.0f, dist = 0.0f, last = 0.0f;
+    bool fitted = false;
+
+    sync->baseHubTs = sync->pointHubTs[newest];
+    span = sync->baseHubTs - sync->pointHubTs[sync->pointHead];
+
+    // relative to the newest maximum to keep the floats small
+    for (i = 0; i < n; i++) {
+        a = (sync->pointHead + i) % AP_HUB_SYNC_POINTS;
+        x[i] = floatFromInt64(sync->pointHubTs[a] - sync->baseHubTs);
+        y[i] = floatFromInt64(sync->pointDelta[a] - sync->pointDelta[newest]);
+    }
+
+    sync->skew = 0.0f;
+    if (n >= SYNC_MIN_POINTS && span >= SYNC_SKEW_SPAN_MIN) {
+        // close points only add jitter to the slope
+        fitted = fitSkew(sync, x, y, n, floatFromUint64(span) * 0.5f, &dist, &last) ||
+                 fitSkew(sync, x, y, n, floatFromUint64(SYNC_WINDOW_TIMEOUT), &dist, &last);
+    }
+
+    for (i = 0, top = 0.0f; i < n; i++) {
+        if (i == 0 || y[i] - sync->skew * x[i] > top)
+            top = y[i] - sync->skew * x[i];
+    }
+    for (i = 0; i < n; i++) {
+        gap = top - (y[i] - sync->skew * x[i]);
+        if (gap > error)
+            error = gap;
+    }
+
+    // the most a window fell under the line estimates the jitter of the maxima. The points of
+    // the line have one too that the others do not see, it is taken as large, so the line can
+    // be that far from the least latency on top. The skew error is what it makes of the slope
+    // between them, and the newest maximum can be past them. It is no bound: with few points
+    // the jitter seen can be smaller than the one of the line
+    sync->deltaEstimation = sync->pointDelta[newest] + floatToInt64(top);
+    error *= 2.0f;
+    if (error < floatFromUint64(SYNC_ERROR_MIN))
+        error = floatFromUint64(SYNC_ERROR_MIN);
+    if (fitted) {
+        sync->skewError = 2.0f * error / dist;
+        error += sync->skewError * last;
+        sync->skewError += SYNC_SKEW_DRIFT * floatFromUint64(span) * 0.5f;
+        if (sync->skewError < SYNC_SKEW_ERROR_MIN)
+            sync->skewError = SYNC_SKEW_ERROR_MIN;
+    } else {
+        sync->skewError = SYNC_SKEW_MAX;
+    }
+    sync->fitError = floatToInt64(error);
+    sync->fitValid = true;
+
+    if (DEBUG_SYNC) {
+        osLog(LOG_DEBUG, "ApHub new sync offset = %" PRId64 ", skew = %d ppb, error = %" PRId64,
+              sync->deltaEstimation, (int)(sync->skew * 1e9f), sync->fitError);
+    }
+}
+
 void apHubSyncAddDelta(struct ApHubSync* sync, uint64_t apTime, uint64_t hubTime) {
 
     int64_t delta = apTime - hubTime;
     int64_t deltaAp, deltaHub;
+    uint8_t point;
 
-    /*
-    // if data is expired or lastTs is not set before, reset
-    if (apTime > sync->lastTs + SYNC_EXPIRATION || sync->lastTs == 0) {
-        apHubSyncReset(sync);
-    }
-    */
-
-    if (sync->lastTs != 0 ) {
-	    deltaAp = apTime - sync->lastTs;
-	    deltaHub = hubTime - sync->lastHubTs;
-	    if ((deltaAp < deltaHub && (deltaHub - deltaAp) > SYNC_WINDOW_TIMEOUT) ||
-			    (deltaAp > deltaHub && (deltaAp - deltaHub) > SYNC_WINDOW_TIMEOUT)){
-		    //abnormal case = delta is different more than 1 sec
-		    if(isAbnormal == 0){
-			isAbnormal = 1;
-			abnormalStartTime = apTime;
-			osLog(LOG_DEBUG, "abnormal Time\n");
-		    }else{
-			if(apTime - abnormalStartTime > SYNC_WINDOW_TIMEOUT){
-				sync->lastTs = apTime;
-				sync->lastHubTs = hubTime;
-				isAbnormal = 0;
-				osLog(LOG_DEBUG, "abnormal Time fixed\n");
-			}
-		    }
-		    return;
-	    }
+    if (sync->lastTs != 0) {
+        deltaAp = apTime - sync->lastTs;
+        deltaHub = hubTime - sync->lastHubTs;
+        if ((deltaAp < deltaHub && (uint64_t)(deltaHub - deltaAp) > SYNC_WINDOW_TIMEOUT) ||
+                (deltaAp > deltaHub && (uint64_t)(deltaAp - deltaHub) > SYNC_WINDOW_TIMEOUT)) {
+            //abnormal case = delta is different more than 1 sec
+            if (isAbnormal == 0) {
+                isAbnormal = 1;
+                abnormalStartTime = apTime;
+                osLog(LOG_DEBUG, "abnormal Time\n");
+                return;
+            } else if (apTime - abnormalStartTime <= SYNC_WINDOW_TIMEOUT) {
+                return;
+            }
+            // the clocks did jump, the points before do not fit any more
+            resetPoints(sync);
+            osLog(LOG_DEBUG, "abnormal Time fixed\n");
+        }
     }
 
     sync->lastTs = apTime;
     sync->lastHubTs = hubTime;
     isAbnormal = 0;
 
-    if (sync->state == NOT_INITED) {
-        // setup the windowMax before switching state
-        sync->windowMax = delta;
-        sync->windowTimeout = apTime + SYNC_WINDOW_TIMEOUT;
-
-        sync->state = USE_MAX;
-    } else {
-        sync->windowMax = (delta > sync->windowMax) ? delta : sync->windowMax;
-	if (apTime > sync->windowTimeout || delta < sync->deltaEstimation) {
-            // collected a window
-
-            // setup deltaEstimation before switching state
-            if (sync->state == USE_MAX) {
-                sync->deltaEstimation = sync->windowMax;
-            } else {
-                sync->deltaEstimation = ((SYNC_FILTER_B - SYNC_FILTER_A) * sync->deltaEstimation +
-                                   SYNC_FILTER_A * sync->windowMax) / SYNC_FILTER_B;
-            }
-            sync->state = USE_FILTERED;
-            if (DEBUG_SYNC) {
-                osLog(LOG_DEBUG, "ApHub new sync offset = %" PRId64, sync->deltaEstimation);
-            }
-            // start new window by resetting windowMax and windowTimeout after this window is done
-            sync->windowMax = INT64_MIN;
-            sync->windowTimeout = apTime + SYNC_WINDOW_TIMEOUT;
+    if (sync->state == NOT_INITED || hubTime >= sync->windowTimeout) {
+        // start a new window with this data point
+        while (sync->pointCount == AP_HUB_SYNC_POINTS ||
+               (sync->pointCount >= SYNC_MIN_POINTS &&
+                hubTime - sync->pointHubTs[sync->pointHead] > SYNC_HISTORY_MAX)) {
+            sync->pointHead = (sync->pointHead + 1) % AP_HUB_SYNC_POINTS;
+            sync->pointCount--;
         }
+        point = (sync->pointHead + sync->pointCount) % AP_HUB_SYNC_POINTS;
+        sync->pointCount++;
+        sync->windowTimeout = hubTime + SYNC_POINT_WINDOW;
+        sync->state = USE_FIT;
+    } else if (delta > sync->pointDelta[newestPoint(sync)]) {
+        // new max of the window
+        point = newestPoint(sync);
+    } else {
+        return;
     }
+
+    sync->pointHubTs[point] = hubTime;
+    sync->pointDelta[point] = delta;
+    sync->fitValid = false;
 }
 
 int64_t apHubSyncGetDelta(struct ApHubSync* sync, uint64_t hubTime) {
@@ -119,11 +222,11 @@ int64_t apHubSyncGetDelta(struct ApHubSync* sync, uint64_t hubTime) {
         case NOT_INITED:
             ret = 0;
             break;
-        case USE_MAX:
-            ret = sync->windowMax;
-            break;
-        case USE_FILTERED:
-            ret = sync->deltaEstimation;
+        case USE_FIT:
+            if (!sync->fitValid)
+                fitLine(sync);
+            ret = sync->deltaEstimation +
+                  floatToInt64(sync->skew * floatFromInt64(hubTime - sync->baseHubTs));
             break;
         default:
             // indicate error, should never happen
@@ -134,4 +237,39 @@ int64_t apHubSyncGetDelta(struct ApHubSync* sync, uint64_t hubTime) {
     return ret;
 }
 
+uint64_t apHubSyncGetError(struct ApHubSync* sync, uint64_t hubTime) {
+    float dt;
+
+    if (sync->state != USE_FIT)
+        return UINT64_MAX;
+    if (!sync->fitValid)
+        fitLine(sync);
+
+    dt = floatFromUint64(hubTime > sync->baseHubTs ? hubTime - sync->baseHubTs :
+                                                     sync->baseHubTs - hubTime);
+    return (uint64_t)sync->fitError + floatToUint64((sync->skewError + SYNC_SKEW_DRIFT * dt * 0.5f) * dt);
+}
+
+uint64_t apHubSyncGetSyncInterval(struct ApHubSync* sync, uint64_t maxError) {
+    uint64_t end;
+    float margin;
 
+    if (sync->state != USE_FIT)
+        return SYNC_INTERVAL_MIN;
+    if (!sync->fitValid)
+        fitLine(sync);
+    if ((uint64_t)sync->fitError >= maxError)
+        return SYNC_INTERVAL_MIN;
+
+    // the error grows from the newest point as in apHubSyncGetError(), the interval is counted
+    // from the last data point
+    margin = floatFromUint64(maxError - (uint64_t)sync->fitError);
+    end = sync->baseHubTs + floatToUint64(
+            (sqrtf(sync->skewError * sync->skewError + 2.0f * SYNC_SKEW_DRIFT * margin) -
+             sync->skewError) / SYNC_SKEW_DRIFT);
+    if (end < sync->lastHubTs + SYNC_INTERVAL_MIN)
+        return SYNC_INTERVAL_MIN;
+    if (end > sync->lastHubTs + SYNC_INTERVAL_MAX)
+        return SYNC_INTERVAL_MAX;
+    return end - sync->lastHubTs;
+}
@@ -80,9 +80,15 @@
 // numbers don't buy us that much
 #define MAX_APP_SEC_RX_DATA_LEN 64
 
+// chunks a host with credits can have in flight; each slot takes a packet payload
+#define MAX_DOWNLOAD_SLOTS      8
+
 #define REQUIRE_SIGNED_IMAGE    true
 #define DEBUG_APHUB_TIME_SYNC   false
 
+// sensor timestamp error the AP is asked for sync points to stay under
+#define APHUB_SYNC_MAX_ERROR    500000 // 500us in ns
+
 #if DEBUG_APHUB_TIME_SYNC
 static void syncDebugAdd(uint64_t, uint64_t);
 #endif
@@ -95,6 +101,14 @@ static void syncDebugAdd(uint64_t, uint64_t);
 #endif
 #endif
 
+struct DownloadSlot
+{
+    void    *cookie;    // HAL reply, NULL if the chunk came from the kernel
+    uint8_t  data[NANOHUB_PACKET_PAYLOAD_MAX];
+    uint8_t  len;
+    uint8_t  lenLeft;
+};
+
 struct DownloadState
 {
     struct AppSecState *appSecState;
@@ -104,12 +118,14 @@ struct DownloadState
     struct AppHdr *start;     // start of flash segment, where to write
     uint32_t crc;       // document CRC-32, as reported by client
     uint32_t srcCrc;    // current state of CRC-32 we generate from input
-    uint8_t  data[NANOHUB_PACKET_PAYLOAD_MAX];
-    uint8_t  len;
-    uint8_t  lenLeft;
     uint8_t  chunkReply;
     bool     erase;
     bool     eraseScheduled;
+    bool     credits;   // client gets the free slots in chunk replies
+    uint8_t  window;    // number of slots
+    uint8_t  head;      // slot being written
+    uint8_t  count;     // slots holding a chunk, written in order from head
+    struct DownloadSlot slots[];
 };
 
 static struct DownloadState *mDownloadState;
@@ -121,6 +137,7 @@ static uint8_t mTxCurrLength, mTxNextLength;
 static uint8_t mPrefetchActive, mPrefetchTx;
 static uint32_t mTxWakeCnt[2];
 static struct ApHubSync mTimeSync;
+static bool mTimeSyncActive;
 
 static inline bool isSensorEvent(uint32_t evtType)
 {
@@ -314,6 +331,15 @@ static AppSecErr osSecretKeyAdd(uint64_t keyId, void *keyBuf)
 
 static void freeDownloadState()
 {
+    struct DownloadSlot *slot;
+    uint8_t i;
+
+    // chunks queued behind a failed one are dropped with the upload
+    for (i = 0; i < mDownloadState->count; i++) {
+        slot = &mDownloadState->slots[(mDownloadState->head + i) % mDownloadState->window];
+        if (slot->cookie)
+            heapFree(slot->cookie);
+    }
     if (mDownloadState->appSecState)
         appSecDeinit(mDownloadState->appSecState);
     heapFree(mDownloadState);
@@ -330,6 +356,7 @@ static bool resetDownloadState(bool initial, bool erase)
     mDownloadState->appSecState = appSecInit(writeCbk, pubKeyFindCbk, osSecretKeyLookup, REQUIRE_SIGNED_IMAGE);
     mDownloadState->srcOffset = 0;
     mDownloadState->srcCrc = ~0;
+    mDownloadState->head = 0;
     if (!initial) {
         // if no data was written, we can reuse the same segment
         if (mDownloadState->dstOffset)
@@ -349,17 +376,37 @@ static bool resetDownloadState(bool initial, bool erase)
     return true;
 }
 
-static bool doStartFirmwareUpload(struct NanohubStartFirmwareUploadRequest *req, bool erase)
+// window is 0 for clients that do not handle chunk credits
+static bool doStartFirmwareUpload(struct NanohubStartFirmwareUploadRequest *req, bool erase, uint8_t window)
 {
+    bool credits = window > 0;
+    size_t size;
+
+    if (!window)
+        window = 1;
+    else if (window > MAX_DOWNLOAD_SLOTS)
+        window = MAX_DOWNLOAD_SLOTS;
+
+    if (mDownloadState) {
+        // chunks of the previous upload are still being written
+        if (mDownloadState->count)
+            return false;
+        if (mDownloadState->window != window)
+            freeDownloadState();
+    }
+
     if (!mDownloadState) {
-        mDownloadState = heapAlloc(sizeof(struct DownloadState));
+        size = sizeof(struct DownloadState) + window * sizeof(struct DownloadSlot);
+        mDownloadState = heapAlloc(size);
 
         if (!mDownloadState)
             return false;
         else
-            memset(mDownloadState, 0x00, sizeof(struct DownloadState));
+            memset(mDownloadState, 0x00, size);
+        mDownloadState->window = window;
     }
 
+    mDownloadState->credits = credits;
     mDownloadState->size = le32toh(req->size);
     mDownloadState->crc = le32toh(req->crc);
     mDownloadState->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED;
@@ -368,10 +415,16 @@ static bool doStartFirmwareUpload(struct NanohubStartFirmwareUploadRequest *req,
 
 static uint32_t startFirmwareUpload(void *rx, uint8_t rx_len, void *tx, uint64_t timestamp)
 {
-    struct NanohubStartFirmwareUploadRequest *req = rx;
-    struct NanohubStartFirmwareUploadResponse *resp = tx;
+    struct NanohubStartFirmwareUploadWindowRequest *req = rx;
+    struct NanohubStartFirmwareUploadWindowResponse *resp = tx;
 
-    resp->accepted = doStartFirmwareUpload(req, true);
+    if (rx_len < sizeof(*req)) {
+        resp->accepted = doStartFirmwareUpload(&req->req, true, 0);
+        return sizeof(struct NanohubStartFirmwareUploadResponse);
+    }
+
+    resp->accepted = doStartFirmwareUpload(&req->req, true, req->window);
+    resp->window = resp->accepted ? mDownloadState->window : 0;
 
     return sizeof(*resp);
 }
@@ -588,15 +641,16 @@ static void firmwareWrite(void *cookie)
 {
     bool valid;
     bool finished = false;
-    struct FirmwareWriteCookie *resp = cookie;
+    struct DownloadSlot *slot = &mDownloadState->slots[mDownloadState->head];
+    struct FirmwareWriteCookie *resp = slot->cookie;
     // only check crc when cookie is NULL (write came from kernel, not HAL)
-    bool checkCrc = !cookie;
+    bool checkCrc = !resp;
 
     if (mAppSecStatus == APP_SEC_NEED_MORE_TIME) {
         mAppSecStatus = appSecDoSomeProcessing(mDownloadState->appSecState);
-    } else if (mDownloadState->lenLeft) {
-        const uint8_t *data = mDownloadState->data + mDownloadState->len - mDownloadState->lenLeft;
-        uint32_t len = mDownloadState->lenLeft, lenLeft, lenRem = 0;
+    } else if (slot->lenLeft) {
+        const uint8_t *data = slot->data + slot->len - slot->lenLeft;
+        uint32_t len = slot->lenLeft, lenLeft, lenRem = 0;
 
         if (len > MAX_APP_SEC_RX_DATA_LEN) {
             lenRem = len - MAX_APP_SEC_RX_DATA_LEN;
@@ -604,15 +658,23 @@ static void firmwareWrite(void *cookie)
         }
 
         mAppSecStatus = appSecRxData(mDownloadState->appSecState, data, len, &lenLeft);
-        mDownloadState->lenLeft = lenLeft + lenRem;
+        slot->lenLeft = lenLeft + lenRem;
     }
 
     valid = (mAppSecStatus == APP_SEC_NO_ERROR);
-    if (mAppSecStatus == APP_SEC_NEED_MORE_TIME || mDownloadState->lenLeft) {
-        osDefer(firmwareWrite, cookie, false);
+    if (mAppSecStatus == APP_SEC_NEED_MORE_TIME || slot->lenLeft) {
+        osDefer(firmwareWrite, NULL, false);
         return;
-    } else if (valid) {
-        if (mDownloadState->srcOffset == mDownloadState->size) {
+    }
+
+    // the chunk is written, its slot can take another one
+    slot->cookie = NULL;
+    mDownloadState->head = (mDownloadState->head + 1) % mDownloadState->window;
+    mDownloadState->count--;
+    if (valid) {
+        if (mDownloadState->count) {
+            osDefer(firmwareWrite, NULL, false);
+        } else if (mDownloadState->srcOffset == mDownloadState->size) {
             mAppSecStatus = appSecRxDataOver(mDownloadState->appSecState);
             finished = true;
             valid = !checkCrc || mDownloadState->crc == ~mDownloadState->srcCrc;
@@ -641,11 +703,15 @@ static void firmwareWrite(void *cookie)
 
 static uint32_t doFirmwareChunk(uint8_t *data, uint32_t offset, uint32_t len, void *cookie)
 {
+    struct DownloadSlot *slot;
     uint32_t reply, ret;
 
     if (!mDownloadState) {
         reply = NANOHUB_FIRMWARE_CHUNK_REPLY_CANCEL_NO_RETRY;
-    } else if (mAppSecStatus == APP_SEC_NEED_MORE_TIME || mDownloadState->lenLeft) {
+    } else if (mDownloadState->count == mDownloadState->window ||
+               (mDownloadState->count && (offset != mDownloadState->srcOffset ||
+                mDownloadState->chunkReply != NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED))) {
+        // only the next chunk can be queued while earlier ones are written
         reply = NANOHUB_FIRMWARE_CHUNK_REPLY_RESEND;
     } else if (mDownloadState->chunkReply != NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED) {
         reply = mDownloadState->chunkReply;
@@ -666,13 +732,17 @@ static uint32_t doFirmwareChunk(uint8_t *data, uint32_t offset, uint32_t len, vo
             reply = NANOHUB_FIRMWARE_CHUNK_REPLY_RESTART;
             resetDownloadState(false, true);
         } else {
+            slot = &mDownloadState->slots[(mDownloadState->head + mDownloadState->count) % mDownloadState->window];
             if (!cookie)
                 mDownloadState->srcCrc = soft_crc32(data, len, mDownloadState->srcCrc);
             mDownloadState->srcOffset += len;
-            memcpy(mDownloadState->data, data, len);
-            mDownloadState->lenLeft = mDownloadState->len = len;
+            memcpy(slot->data, data, len);
+            slot->lenLeft = slot->len = len;
+            slot->cookie = cookie;
             reply = NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED;
-            osDefer(firmwareWrite, cookie, false);
+            // firmwareWrite moves on to the next slot by itself
+            if (!mDownloadState->count++)
+                osDefer(firmwareWrite, NULL, false);
         }
     }
 
@@ -682,11 +752,15 @@ static uint32_t doFirmwareChunk(uint8_t *data, uint32_t offset, uint32_t len, vo
 static uint32_t firmwareChunk(void *rx, uint8_t rx_len, void *tx, uint64_t timestamp)
 {
     struct NanohubFirmwareChunkRequest *req = rx;
-    struct NanohubFirmwareChunkResponse *resp = tx;
+    struct NanohubFirmwareChunkWindowResponse *resp = tx;
     uint32_t offset = le32toh(req->offset);
     uint8_t len = rx_len - sizeof(req->offset);
 
     resp->chunkReply = doFirmwareChunk(req->data, offset, len, NULL);
+    if (!mDownloadState || !mDownloadState->credits)
+        return sizeof(struct NanohubFirmwareChunkResponse);
+
+    resp->credits = mDownloadState->window - mDownloadState->count;
 
     return sizeof(*resp);
 }
@@ -709,7 +783,8 @@ static uint32_t doFinishFirmwareUpload(uint32_t *addr, uint32_t *crc)
             else
                 *crc = 0xFFFFFFFF;
         }
-    } else if (mDownloadState->srcOffset == mDownloadState->size) {
+    } else if (mDownloadState->srcOffset == mDownloadState->size || mDownloadState->count) {
+        // queued chunks are written before the upload can be cancelled
         reply = NANOHUB_FIRMWARE_UPLOAD_PROCESSING;
     } else {
         reply = firmwareFinish(false);
@@ -767,6 +842,37 @@ static uint32_t unmaskInterrupt(void *rx, uint8_t rx_len, void *tx, uint64_t tim
     return sizeof(*resp);
 }
 
+#if !defined (MCT_SUPPORT)
+static void timeSyncCheck(void *cookie);
+
+static void timeSyncTimerCallback(uint32_t timerId, void *data)
+{
+    osDefer(timeSyncCheck, NULL, false);
+}
+
+// ask the AP for a sync point once the estimated error gets too large
+static void timeSyncCheck(void *cookie)
+{
+    uint64_t now = sensorGetTime();
+    uint64_t interval = apHubSyncGetSyncInterval(&mTimeSync, APHUB_SYNC_MAX_ERROR);
+
+    // any event read, even an empty one, brings a sync point; the interrupt
+    // is masked while the AP sleeps. The check stops until that sync point
+    // comes, addDelta() starts it again
+    if (mTimeSync.lastHubTs + interval <= now) {
+        if (!hostIntfGetInterrupt(NANOHUB_INT_NONWAKEUP))
+            hostIntfSetInterrupt(NANOHUB_INT_NONWAKEUP);
+        mTimeSyncActive = false;
+        return;
+    }
+
+    // a sync point coming before the timer only pushes the next check back
+    interval = mTimeSync.lastHubTs + interval - now;
+    if (!timTimerSet(interval, 0, 50, timeSyncTimerCallback, NULL, true))
+        mTimeSyncActive = false;
+}
+#endif
+
 static void addDelta(struct ApHubSync *sync, uint64_t apTime, uint64_t hubTime)
 {
 #if defined (MCT_SUPPORT)
@@ -776,15 +882,17 @@ static void addDelta(struct ApHubSync *sync, uint64_t apTime, uint64_t hubTime)
     syncDebugAdd(apTime, hubTime);
     #endif
     apHubSyncAddDelta(sync, apTime, hubTime);
+    if (!mTimeSyncActive)
+        mTimeSyncActive = osDefer(timeSyncCheck, NULL, false);
 #endif
 }
 
-static int64_t getAvgDelta(struct ApHubSync *sync)
+static int64_t getAvgDelta(struct ApHubSync *sync, uint64_t hubTime)
 {
 #if defined (MCT_SUPPORT)
     return 0;
 #else
-    return apHubSyncGetDelta(sync, sensorGetTime());
+    return apHubSyncGetDelta(sync, hubTime);
 #endif
 }
 
@@ -827,7 +935,7 @@ static int fillBuffer(void *tx, uint32_t totLength, uint32_t *wakeup, uint32_t *
         } else {
             packet->evtType = htole32(EVT_NO_FIRST_SENSOR_EVENT + packet->sensType);
             if (packet->referenceTime)
-                packet->referenceTime += getAvgDelta(&mTimeSync);
+                packet->referenceTime += getAvgDelta(&mTimeSync, packet->referenceTime);
 
             if (*wakeup > 0)
                 packet->firstSample.interrupt = NANOHUB_INT_WAKEUP;
@@ -1140,7 +1248,7 @@ const static struct NanohubCommand mBuiltinCommands[] = {
                     NULL,
                     startFirmwareUpload,
                     struct NanohubStartFirmwareUploadRequest,
-                    struct NanohubStartFirmwareUploadRequest),
+                    struct NanohubStartFirmwareUploadWindowRequest),
     NANOHUB_COMMAND(NANOHUB_REASON_FIRMWARE_CHUNK,
                     NULL,
                     firmwareChunk,
@@ -1304,7 +1412,7 @@ static void halLegacyStartUpload(void *rx, uint8_t rx_len)
     resp->hdr.appId = APP_ID_MAKE(NANOHUB_VENDOR_GOOGLE, 0);
     resp->hdr.len = sizeof(*resp) - sizeof(struct NanohubHalLegacyHdr) + 1;
     resp->hdr.msg = NANOHUB_HAL_LEGACY_START_UPLOAD;
-    resp->success = doStartFirmwareUpload(&hwReq, true);
+    resp->success = doStartFirmwareUpload(&hwReq, true, 0);
 
     osEnqueueEvtOrFree(EVT_APP_TO_HOST, resp, heapFree);
 }
@@ -1854,7 +1962,7 @@ static void halStartUpload(void *rx, uint8_t rx_len, uint32_t transactionId)
     };
 
     resp->ret.msg = NANOHUB_HAL_START_UPLOAD;
-    if (doStartFirmwareUpload(&hwReq, false))
+    if (doStartFirmwareUpload(&hwReq, false, 0))
         resp->ret.status = NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED;
     else
         resp->ret.status = NANOHUB_FIRMWARE_CHUNK_REPLY_NO_SPACE;
@@ -1980,7 +2088,7 @@ const struct NanohubHalCommand *nanohubHalFindCommand(uint8_t msg)
 
 int64_t hostGetTimeDelta(void)
 {
-    int64_t delta = getAvgDelta(&mTimeSync);
+    int64_t delta = getAvgDelta(&mTimeSync, sensorGetTime());
 
     if (delta == INT64_MIN)
         return 0ULL;
@@ -1990,7 +2098,7 @@ int64_t hostGetTimeDelta(void)
 
 uint64_t hostGetTime(void)
 {
-    int64_t delta = getAvgDelta(&mTimeSync);
+    int64_t delta = getAvgDelta(&mTimeSync, sensorGetTime());
 
     if (!delta || delta == INT64_MIN)
         return 0ULL;
@@ -30,21 +30,41 @@ extern "C" {
  * avoiding communication latency jitter.
  *
  * It uses max of (apTime - hubTime) in a window, which is more consistent than average, to
- * establish mapping between ap timestamp and hub stamp. Additional low pass filtering is added
- * to further lowering jitter (it is not expected for two clocks to drift much in short time).
+ * establish mapping between ap timestamp and hub stamp. The window maxima of the last
+ * AP_HUB_SYNC_POINTS windows are fitted with a line, so that the drift of the two clocks is
+ * followed between sync points. The line is the one no maximum is above, so like the maxima it
+ * follows the packets of least latency, and a window hit by an unusual latency does not move it.
  *
  * Max is slightly anti-intuitive here because difference is defined as apTime - hubTime. Max of
  * that is equivalent to min of hubTime - apTime, which corresponds to a packet that get delayed
  * by system scheduling minimally (closer to the more consistent hardware related latency).
+ *
+ * How far the maxima fall under the line estimates the error of the estimation, which grows
+ * with the time since the last sync point. It is an estimate, not a bound: the fixed part of
+ * the latency is not in it, no one way sync can see it, and the jitter of the maxima the line
+ * goes through is only seen through the other maxima. apHubSyncGetSyncInterval() turns that into how often
+ * the AP has to send sync points to keep the error under a target.
  */
 
+#define AP_HUB_SYNC_POINTS 8
+
 struct ApHubSync {
     uint64_t lastTs;           // AP time of previous data point, used for control expiration
     uint64_t lastHubTs;        // CHUB time of previous data point, used for control expiration
-    int64_t deltaEstimation;   // the estimated delta between two clocks, filtered.
+    uint64_t windowTimeout;    // CHUB time the window of the newest point ends
+
+    uint64_t pointHubTs[AP_HUB_SYNC_POINTS];    // CHUB time of the window maxima, a ring
+    int64_t pointDelta[AP_HUB_SYNC_POINTS];     // window maxima of apTime - hubTime
+    uint8_t pointHead;         // oldest point
+    uint8_t pointCount;
 
-    int64_t windowMax;         // track the maximum timestamp difference in a window
-    uint64_t windowTimeout;    // track window expiration time
+    // delta(hubTime) = deltaEstimation + skew * (hubTime - baseHubTs)
+    uint64_t baseHubTs;        // CHUB time of the newest point
+    int64_t deltaEstimation;   // the estimated delta between two clocks at baseHubTs
+    float skew;                // drift of the AP clock against the CHUB clock, in ns per ns
+    float skewError;           // estimated error of the skew
+    int64_t fitError;          // estimated error of the delta at baseHubTs, in ns
+    bool fitValid;             // the line is fitted to the current points
     uint8_t state;             // internal state of the sync
 };
 
@@ -54,9 +74,16 @@ void apHubSyncReset(struct ApHubSync* sync);
 // add a data point (a pair of apTime and the corresponding hub time).
 void apHubSyncAddDelta(struct ApHubSync* sync, uint64_t apTime, uint64_t hubTime);
 
-// get the estimation of time delta
+// get the estimation of time delta at hubTime
 int64_t apHubSyncGetDelta(struct ApHubSync* sync, uint64_t hubTime);
 
+// get the estimated error of apHubSyncGetDelta() at hubTime, in ns
+uint64_t apHubSyncGetError(struct ApHubSync* sync, uint64_t hubTime);
+
+// get the CHUB time after the last data point within which the next one keeps the error
+// under maxError
+uint64_t apHubSyncGetSyncInterval(struct ApHubSync* sync, uint64_t maxError);
+
 #ifdef __cplusplus
 }
 #endif
@@ -158,12 +158,34 @@ struct NanohubStartFirmwareUploadRequest {
 } ATTRIBUTE_PACKED;
 SET_PACKED_STRUCT_MODE_OFF
 
+/*
+ * Hosts that handle chunk credits append the number of chunks they want to
+ * keep in flight. The hub answers with the window it grants, and every chunk
+ * reply then carries the credits left, ie. how many more chunks the host can
+ * send before it has to wait for one of them to be written. A chunk reply
+ * without credits grants none. Hosts sending the plain request get the
+ * one chunk at a time protocol.
+ */
+SET_PACKED_STRUCT_MODE_ON
+struct NanohubStartFirmwareUploadWindowRequest {
+    struct NanohubStartFirmwareUploadRequest req;
+    uint8_t window;
+} ATTRIBUTE_PACKED;
+SET_PACKED_STRUCT_MODE_OFF
+
 SET_PACKED_STRUCT_MODE_ON
 struct NanohubStartFirmwareUploadResponse {
     uint8_t accepted;
 } ATTRIBUTE_PACKED;
 SET_PACKED_STRUCT_MODE_OFF
 
+SET_PACKED_STRUCT_MODE_ON
+struct NanohubStartFirmwareUploadWindowResponse {
+    uint8_t accepted;
+    uint8_t window;
+} ATTRIBUTE_PACKED;
+SET_PACKED_STRUCT_MODE_OFF
+
 #define NANOHUB_REASON_FIRMWARE_CHUNK         0x00001041
 
 SET_PACKED_STRUCT_MODE_ON
@@ -189,6 +211,13 @@ struct NanohubFirmwareChunkResponse {
 } ATTRIBUTE_PACKED;
 SET_PACKED_STRUCT_MODE_OFF
 
+SET_PACKED_STRUCT_MODE_ON
+struct NanohubFirmwareChunkWindowResponse {
+    uint8_t chunkReply;
+    uint8_t credits;
+} ATTRIBUTE_PACKED;
+SET_PACKED_STRUCT_MODE_OFF
+
 #define NANOHUB_REASON_FINISH_FIRMWARE_UPLOAD 0x00001042
 
 #if defined(__GNUC__)
@@ -0,0 +1,36 @@
+#
+# Copyright (C) 2021 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := ap_hub_sync_replay
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_HOST_OS := linux
+
+LOCAL_CFLAGS := -Wall -Werror -Wextra
+
+# seos.h of this directory stands in for the one of the firmware
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/../../firmware/os/inc
+
+LOCAL_SRC_FILES := \
+	ap_hub_sync_replay.c \
+	../../firmware/os/algos/ap_hub_sync.c
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replay of the AP-HUB time sync against synthetic clocks.
+ *
+ * The hub clock is the reference. The AP clock runs off it by a constant
+ * skew plus a slow sinusoidal wander, like a crystal warming up and cooling
+ * down. Every sync point the AP sends reaches the hub after a latency made
+ * of a fixed part, an exponential jitter and rare long scheduling delays.
+ *
+ * Every 10ms the AP time the hub would put on a sensor event is compared
+ * with the real AP time, and the error is reported against the number of
+ * sync points per minute. The fixed part of the latency is in the error, no
+ * one way sync can see it. apHubSyncGetError() only estimates how far the
+ * estimation is from the packets of least latency, so it is checked against
+ * the error less the fixed latency. The sync points are sent at a fixed
+ * interval, or at the interval apHubSyncGetSyncInterval() asks for. The offset only estimator
+ * the hub used before (max of a 1 sec window, 3/8 low pass) is replayed
+ * with the same points for comparison.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algos/ap_hub_sync.h>
+#include <seos.h>
+
+#define S_IN_NS(s)          (UINT64_C(1000000000) * (s))
+#define MS_IN_NS(ms)        (UINT64_C(1000000) * (ms))
+#define EVAL_INTERVAL       MS_IN_NS(10)
+#define WARMUP              S_IN_NS(10)
+
+struct ReplayConfig
+{
+    uint32_t durationS;
+    double skewPpm;         // constant drift of the AP clock
+    double wanderPpm;       // amplitude of the slow drift change
+    double wanderPeriodS;
+    double latencyUs;       // fixed part of the transport latency
+    double jitterUs;        // mean of the exponential jitter
+    double spikeUs;         // scheduling delay of a few sync points
+    double spikeRate;       // fraction of the sync points delayed
+    uint32_t seed;
+};
+
+struct ReplayResult
+{
+    uint32_t syncs;
+    uint32_t evals;
+    uint32_t inEstimate;
+    double meanUs;
+    double p99Us;
+    double maxUs;
+    double legacyP99Us;
+    double legacyMaxUs;
+};
+
+// offset only estimator the hub used before the line fit
+struct LegacySync
+{
+    bool inited;
+    bool filtered;
+    int64_t windowMax;
+    uint64_t windowTimeout;
+    int64_t delta;
+};
+
+static const struct ReplayConfig *mCfg;
+static uint64_t mRand;
+
+void osLog(enum LogLevel level, const char *str, ...)
+{
+    va_list vl;
+
+    (void)level;
+    va_start(vl, str);
+    vfprintf(stderr, str, vl);
+    va_end(vl);
+    fputc('\n', stderr);
+}
+
+static double randUniform(void)
+{
+    // xorshift64*
+    mRand ^= mRand >> 12;
+    mRand ^= mRand << 25;
+    mRand ^= mRand >> 27;
+    return ((mRand * UINT64_C(2685821657736338717)) >> 11) * (1.0 / (UINT64_C(1) << 53));
+}
+
+// AP time at hub time t
+static uint64_t apClock(uint64_t t)
+{
+    double s = t * 1e-9;
+    double w = 2 * M_PI / mCfg->wanderPeriodS;
+    double drift = mCfg->skewPpm * s + mCfg->wanderPpm / w * (1 - cos(w * s));
+
+    return S_IN_NS(1000) + t + (uint64_t)(drift * 1e3 + 0.5);
+}
+
+static uint64_t latency(void)
+{
+    double us = mCfg->latencyUs - mCfg->jitterUs * log(1.0 - randUniform());
+
+    if (randUniform() < mCfg->spikeRate)
+        us += mCfg->spikeUs * randUniform();
+    return (uint64_t)(us * 1e3);
+}
+
+static void legacyAdd(struct LegacySync *sync, uint64_t apTime, uint64_t hubTime)
+{
+    int64_t delta = apTime - hubTime;
+
+    if (!sync->inited) {
+        sync->inited = true;
+        sync->windowMax = delta;
+        sync->windowTimeout = apTime + S_IN_NS(1);
+        return;
+    }
+
+    sync->windowMax = delta > sync->windowMax ? delta : sync->windowMax;
+    if (apTime > sync->windowTimeout || (sync->filtered && delta < sync->delta)) {
+        sync->delta = sync->filtered ? (5 * sync->delta + 3 * sync->windowMax) / 8 : sync->windowMax;
+        sync->filtered = true;
+        sync->windowMax = INT64_MIN;
+        sync->windowTimeout = apTime + S_IN_NS(1);
+    }
+}
+
+static int64_t legacyGet(const struct LegacySync *sync)
+{
+    return sync->filtered ? sync->delta : sync->windowMax;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+// intervalNs is 0 to follow apHubSyncGetSyncInterval(maxError)
+static void replay(uint64_t intervalNs, uint64_t maxError, struct ReplayResult *res)
+{
+    uint64_t end = S_IN_NS((uint64_t)mCfg->durationS);
+    uint32_t maxEvals = (end - WARMUP) / EVAL_INTERVAL + 1;
+    double *errs = calloc(maxEvals, sizeof(*errs));
+    double *legacyErrs = calloc(maxEvals, sizeof(*legacyErrs));
+    struct ApHubSync sync;
+    struct LegacySync legacy;
+    uint64_t fixed = (uint64_t)(mCfg->latencyUs * 1e3);
+    uint64_t send = 0, recv, t, est;
+    double err, sum = 0;
+    uint32_t n = 0;
+
+    memset(&sync, 0x00, sizeof(sync));
+    memset(&legacy, 0x00, sizeof(legacy));
+    memset(res, 0x00, sizeof(*res));
+    mRand = mCfg->seed ? mCfg->seed : 1;
+    apHubSyncReset(&sync);
+
+    recv = send + latency();
+    for (t = EVAL_INTERVAL; t < end; t += EVAL_INTERVAL) {
+        while (recv <= t) {
+            apHubSyncAddDelta(&sync, apClock(send), recv);
+            legacyAdd(&legacy, apClock(send), recv);
+            res->syncs++;
+
+            if (intervalNs)
+                send += intervalNs;
+            else
+                send = recv + apHubSyncGetSyncInterval(&sync, maxError);
+            recv = send + latency();
+        }
+
+        if (t < WARMUP || sync.lastTs == 0)
+            continue;
+
+        est = t + apHubSyncGetDelta(&sync, t);
+        err = fabs((double)(int64_t)(est - apClock(t))) * 1e-3;
+        if (llabs((int64_t)(est + fixed - apClock(t))) <= (int64_t)apHubSyncGetError(&sync, t))
+            res->inEstimate++;
+        errs[n] = err;
+        sum += err;
+        if (err > res->maxUs)
+            res->maxUs = err;
+
+        est = t + legacyGet(&legacy);
+        legacyErrs[n] = fabs((double)(int64_t)(est - apClock(t))) * 1e-3;
+        n++;
+    }
+
+    if (n) {
+        qsort(errs, n, sizeof(*errs), compareDouble);
+        qsort(legacyErrs, n, sizeof(*legacyErrs), compareDouble);
+        res->evals = n;
+        res->meanUs = sum / n;
+        res->p99Us = errs[n * 99 / 100];
+        res->legacyP99Us = legacyErrs[n * 99 / 100];
+        res->legacyMaxUs = legacyErrs[n - 1];
+    }
+
+    free(errs);
+    free(legacyErrs);
+}
+
+static void printResult(const char *name, const struct ReplayResult *res)
+{
+    printf("%-16s %10.1f %9.1f %9.1f %9.1f %8.1f%% %11.1f %11.1f\n", name,
+           res->syncs * 60.0 / mCfg->durationS, res->meanUs, res->p99Us, res->maxUs,
+           res->evals ? 100.0 * res->inEstimate / res->evals : 0.0,
+           res->legacyP99Us, res->legacyMaxUs);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-d seconds] [-s skew_ppm] [-w wander_ppm] [-W wander_period_s]\n"
+            "          [-l latency_us] [-j jitter_us] [-k spike_us] [-K spike_rate] [-r seed]\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint64_t intervals[] = {
+        MS_IN_NS(100), S_IN_NS(1), S_IN_NS(5), S_IN_NS(20),
+    };
+    static const uint64_t maxErrors[] = {
+        100000, 500000, 2000000,
+    };
+    struct ReplayConfig cfg = {
+        .durationS = 600,
+        .skewPpm = 30,
+        .wanderPpm = 5,
+        .wanderPeriodS = 300,
+        .latencyUs = 50,
+        .jitterUs = 100,
+        .spikeUs = 5000,
+        .spikeRate = 0.02,
+        .seed = 1,
+    };
+    struct ReplayResult res;
+    char name[32];
+    size_t i;
+    int c;
+
+    while ((c = getopt(argc, argv, "d:s:w:W:l:j:k:K:r:h")) != -1) {
+        switch (c) {
+        case 'd':
+            cfg.durationS = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            cfg.skewPpm = strtod(optarg, NULL);
+            break;
+        case 'w':
+            cfg.wanderPpm = strtod(optarg, NULL);
+            break;
+        case 'W':
+            cfg.wanderPeriodS = strtod(optarg, NULL);
+            break;
+        case 'l':
+            cfg.latencyUs = strtod(optarg, NULL);
+            break;
+        case 'j':
+            cfg.jitterUs = strtod(optarg, NULL);
+            break;
+        case 'k':
+            cfg.spikeUs = strtod(optarg, NULL);
+            break;
+        case 'K':
+            cfg.spikeRate = strtod(optarg, NULL);
+            break;
+        case 'r':
+            cfg.seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (cfg.durationS * UINT64_C(1000000000) <= WARMUP || cfg.wanderPeriodS <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    mCfg = &cfg;
+
+    printf("%" PRIu32 " s, skew %.1f ppm + %.1f ppm over %.0f s, latency %.0f us + %.0f us jitter"
+           ", %.1f%% delayed up to %.0f us\n\n",
+           cfg.durationS, cfg.skewPpm, cfg.wanderPpm, cfg.wanderPeriodS, cfg.latencyUs,
+           cfg.jitterUs, cfg.spikeRate * 100, cfg.spikeUs);
+    printf("%-16s %10s %9s %9s %9s %9s %11s %11s\n", "sync", "syncs/min", "mean us",
+           "p99 us", "max us", "in est", "offset p99", "offset max");
+
+    for (i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++) {
+        replay(intervals[i], 0, &res);
+        snprintf(name, sizeof(name), "every %.1f s", intervals[i] * 1e-9);
+        printResult(name, &res);
+    }
+
+    for (i = 0; i < sizeof(maxErrors) / sizeof(maxErrors[0]); i++) {
+        replay(0, maxErrors[i], &res);
+        snprintf(name, sizeof(name), "error < %" PRIu64 " us", maxErrors[i] / 1000);
+        printResult(name, &res);
+    }
+
+    return 0;
+}
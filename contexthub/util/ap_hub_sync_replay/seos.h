@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _AP_HUB_SYNC_REPLAY_SEOS_H_
+#define _AP_HUB_SYNC_REPLAY_SEOS_H_
+
+// the part of the firmware seos.h that algos/ap_hub_sync.c uses
+
+#include <inttypes.h>
+#include <stdarg.h>
+
+enum LogLevel {
+    LOG_ERROR   = 'E',
+    LOG_WARN    = 'W',
+    LOG_CAUTION = 'C',
+    LOG_INFO    = 'I',
+    LOG_DEBUG   = 'D',
+    LOG_VERBOSE = 'V',
+    LOG_TIME    = 'T',
+    LOG_ALL     = 'A',
+};
+
+void osLog(enum LogLevel level, const char *str, ...) __attribute__((format(printf, 2, 3)));
+
+#endif
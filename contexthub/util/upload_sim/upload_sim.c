@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulation of the nanohub firmware chunk protocol.
+ *
+ * The host sends NANOHUB_REASON_FIRMWARE_CHUNK commands one at a time, each
+ * taking a link round trip. The hub queues accepted chunks in the slots of
+ * its download state and writes them in order, MAX_APP_SEC_RX_DATA_LEN bytes
+ * per flash step, like firmwareWrite() in nanohubCommand.c. A chunk arriving
+ * while all the slots are busy gets NANOHUB_FIRMWARE_CHUNK_REPLY_RESEND and
+ * the host sends it again after the retry delay.
+ *
+ * Writes get slower at the start of every flash page, which is when a
+ * legacy host, with a single slot, starts getting RESENDs. A host with
+ * credits keeps sending while the slots absorb the slow write; with no
+ * credits left it behaves like a legacy host.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// must match firmware/os/core/nanohubCommand.c and nanohubPacket.h
+#define MAX_APP_SEC_RX_DATA_LEN 64
+#define MAX_DOWNLOAD_SLOTS      8
+#define MAX_CHUNK_LEN           (255 - sizeof(uint32_t))
+
+struct SimConfig
+{
+    uint32_t size;      // bytes uploaded
+    uint32_t chunkLen;  // payload bytes of a chunk
+    uint64_t linkUs;    // round trip of a chunk command and its reply
+    uint64_t flashUs;   // time to verify and write MAX_APP_SEC_RX_DATA_LEN bytes
+    uint32_t pageLen;   // bytes of a flash page
+    uint64_t pageUs;    // extra time of the first write to a page
+    uint64_t retryUs;   // host delay before sending a chunk again after RESEND
+};
+
+struct SimHub
+{
+    uint8_t  window;
+    uint8_t  head;
+    uint8_t  count;
+    uint64_t done[MAX_DOWNLOAD_SLOTS]; // time the chunk of the slot is written
+    uint64_t writeEnd;                 // time the last queued chunk is written
+    uint32_t written;                  // bytes queued for writing
+};
+
+struct SimResult
+{
+    uint64_t timeUs;
+    uint32_t resends;
+};
+
+// returns the credits left after the chunk, or -1 when it has to be resent
+static int hubChunk(struct SimHub *hub, const struct SimConfig *cfg, uint64_t now, uint32_t len)
+{
+    uint32_t steps = (len + MAX_APP_SEC_RX_DATA_LEN - 1) / MAX_APP_SEC_RX_DATA_LEN;
+    uint64_t start, writeUs;
+
+    while (hub->count && hub->done[hub->head] <= now) {
+        hub->head = (hub->head + 1) % hub->window;
+        hub->count--;
+    }
+
+    if (hub->count == hub->window)
+        return -1;
+
+    writeUs = steps * cfg->flashUs;
+    if (cfg->pageLen && (hub->written % cfg->pageLen == 0 ||
+                         hub->written / cfg->pageLen != (hub->written + len - 1) / cfg->pageLen))
+        writeUs += cfg->pageUs;
+    hub->written += len;
+
+    start = hub->writeEnd > now ? hub->writeEnd : now;
+    hub->writeEnd = start + writeUs;
+    hub->done[(hub->head + hub->count) % hub->window] = hub->writeEnd;
+    hub->count++;
+
+    return hub->window - hub->count;
+}
+
+static void simulate(const struct SimConfig *cfg, uint8_t window, struct SimResult *res)
+{
+    struct SimHub hub;
+    uint32_t offset = 0, len;
+    uint64_t now = 0;
+
+    memset(&hub, 0x00, sizeof(hub));
+    memset(res, 0x00, sizeof(*res));
+    hub.window = window;
+
+    while (offset < cfg->size) {
+        len = cfg->size - offset;
+        if (len > cfg->chunkLen)
+            len = cfg->chunkLen;
+
+        // the hub handles the command halfway through the round trip
+        if (hubChunk(&hub, cfg, now + cfg->linkUs / 2, len) < 0) {
+            res->resends++;
+            now += cfg->linkUs + cfg->retryUs;
+            continue;
+        }
+
+        now += cfg->linkUs;
+        offset += len;
+    }
+
+    // the finish command reports success once the last chunk is written
+    if (hub.writeEnd > now)
+        now = hub.writeEnd;
+    res->timeUs = now + cfg->linkUs;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-s size] [-c chunk_len] [-l link_us] [-f flash_us] [-p page_len]\n"
+            "          [-P page_us] [-r retry_us]\n"
+            "  -s  bytes to upload (default 65536)\n"
+            "  -c  payload bytes of a chunk, at most %zu (default 128)\n"
+            "  -l  round trip of a chunk command in us (default 1000)\n"
+            "  -f  time to verify and write %d bytes in us (default 300)\n"
+            "  -p  bytes of a flash page, 0 for none (default 2048)\n"
+            "  -P  extra time of the first write to a page in us (default 8000)\n"
+            "  -r  host delay before sending again when the hub is busy, in us (default 2000)\n",
+            name, MAX_CHUNK_LEN, MAX_APP_SEC_RX_DATA_LEN);
+}
+
+int main(int argc, char **argv)
+{
+    struct SimConfig cfg = {
+        .size = 65536,
+        .chunkLen = 128,
+        .linkUs = 1000,
+        .flashUs = 300,
+        .pageLen = 2048,
+        .pageUs = 8000,
+        .retryUs = 2000,
+    };
+    struct SimResult res;
+    uint64_t linkBound, flashBound;
+    uint32_t chunks, steps;
+    uint8_t window;
+    int c;
+
+    while ((c = getopt(argc, argv, "s:c:l:f:p:P:r:h")) != -1) {
+        switch (c) {
+        case 's':
+            cfg.size = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            cfg.chunkLen = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            cfg.linkUs = strtoull(optarg, NULL, 0);
+            break;
+        case 'f':
+            cfg.flashUs = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            cfg.pageLen = strtoul(optarg, NULL, 0);
+            break;
+        case 'P':
+            cfg.pageUs = strtoull(optarg, NULL, 0);
+            break;
+        case 'r':
+            cfg.retryUs = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (!cfg.size || !cfg.chunkLen || cfg.chunkLen > MAX_CHUNK_LEN) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    chunks = (cfg.size + cfg.chunkLen - 1) / cfg.chunkLen;
+    steps = (cfg.chunkLen + MAX_APP_SEC_RX_DATA_LEN - 1) / MAX_APP_SEC_RX_DATA_LEN;
+    linkBound = (uint64_t)chunks * cfg.linkUs;
+    flashBound = (uint64_t)chunks * steps * cfg.flashUs;
+    if (cfg.pageLen)
+        flashBound += (uint64_t)((cfg.size + cfg.pageLen - 1) / cfg.pageLen) * cfg.pageUs;
+
+    printf("%" PRIu32 " bytes in %" PRIu32 " byte chunks, link %" PRIu64 " us, flash %" PRIu64
+           " us per %d bytes + %" PRIu64 " us per %" PRIu32 " byte page, retry %" PRIu64 " us\n",
+           cfg.size, cfg.chunkLen, cfg.linkUs, cfg.flashUs, MAX_APP_SEC_RX_DATA_LEN,
+           cfg.pageUs, cfg.pageLen, cfg.retryUs);
+    printf("bound: %.1f KiB/s (%s)\n\n",
+           cfg.size * 1e6 / 1024 / (linkBound > flashBound ? linkBound : flashBound),
+           linkBound > flashBound ? "link" : "flash");
+    printf("%-8s %10s %10s %8s\n", "window", "time ms", "KiB/s", "resends");
+
+    // a window of 1 is the legacy protocol
+    for (window = 1; window <= MAX_DOWNLOAD_SLOTS; window++) {
+        simulate(&cfg, window, &res);
+        printf("%-8u %10.1f %10.1f %8" PRIu32 "\n", window,
+               res.timeUs / 1e3, cfg.size * 1e6 / 1024 / res.timeUs, res.resends);
+    }
+
+    return 0;
+}
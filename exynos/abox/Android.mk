@@ -1,9 +1,19 @@
 LOCAL_PATH := $(call my-dir)
 
 include $(CLEAR_VARS)
-LOCAL_SRC_FILES := main_abox.cpp
+LOCAL_SRC_FILES := main_abox.cpp abox_dump.cpp
 LOCAL_MODULE := main_abox
-LOCAL_SHARED_LIBRARIES := libc libcutils liblog
+LOCAL_SHARED_LIBRARIES := libc libcutils liblog libz
 LOCAL_MODULE_TAGS := optional
 LOCAL_PROPRIETARY_MODULE := true
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := abox_dump.cpp tests/main_abox_test.cpp
+LOCAL_MODULE := main_abox_test
+LOCAL_CFLAGS := -DSYS_PATH=\"sys\" -DDEBUG_PATH=\"d/abox\" \
+	-DPROC_PATH=\"proc/abox\" -DREGMAP_PATH=\"d/regmap\"
+LOCAL_HEADER_LIBRARIES := libcutils_headers
+LOCAL_SHARED_LIBRARIES := liblog libz
+LOCAL_MODULE_TAGS := tests
+include $(BUILD_HOST_NATIVE_TEST)
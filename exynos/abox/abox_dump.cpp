@@ -0,0 +1,600 @@
+/*
+ * Copyright (C) 2017 Samsung Electronics Co. Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "main_abox"
+//#define LOG_NDEBUG 0
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
+#include <linux/memfd.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <log/log.h>
+#include <cutils/uevent.h>
+#include <zlib.h>
+
+#include "abox_dump.h"
+
+#define MAX_DUMP_COUNT (3)
+#define MAX_DUMP_SIZE (64 << 20)
+#define MAX_PENDING_DUMPS (2)
+#define COPY_CHUNK_SIZE (1 << 20)
+#define DUMP_WORKER_NICE (10)
+
+#define DEVPATH "DEVPATH="
+#ifndef SYS_PATH
+#define SYS_PATH "/sys"
+#endif
+#define SERVICE_FILE "/service"
+#define RESET_FILE "/reset"
+#define FAILSAFE_RESET_FILE "/failsafe/reset"
+#define DEBUG_FILE "/0.abox-debug"
+#define DEBUG_FILE_LEG "/0.abox_debug"
+#define SRAM_FILE "/calliope_sram"
+#define DRAM_FILE "/calliope_dram"
+#define IVA_FILE "/calliope_iva"
+#define PRIV_FILE "/calliope_priv"
+#define SLOG_FILE "/calliope_slog"
+#define GPR_FILE "/gpr"
+#ifndef DEBUG_PATH
+#define DEBUG_PATH "/d/abox"
+#endif
+#ifndef PROC_PATH
+#define PROC_PATH "/proc/abox"
+#endif
+#ifndef REGMAP_PATH
+#define REGMAP_PATH "/d/regmap"
+#endif
+#define REGISTERS_FILE "/registers"
+#define LOG_FILE "/log-00"
+#define COUNT "COUNT="
+
+static char dev_path[128];
+static int dev_path_len;
+static char sys_path[128];
+static int sys_path_len;
+static char debug_path[128];
+static int debug_path_len;
+static char debug_path_leg[128];
+static int debug_path_leg_len;
+static char regmap_path[128];
+static int regmap_path_len;
+static char out_path[128];
+static int out_path_len;
+
+struct dump_file {
+    const char *file;
+    const char *prefix;
+    const char *alt_prefix;
+    bool volatile_region;   /* lost on reset, snapshotted before it */
+    bool compress;
+};
+
+/*
+ * In capture order: SRAM and GPR do not survive the reset at all. The memory
+ * images are kept over the reset and streamed to the storage after it.
+ */
+static const struct dump_file dump_files[] = {
+    { SRAM_FILE, debug_path, debug_path_leg, true, false },
+    { GPR_FILE, debug_path, debug_path_leg, true, false },
+    /* the firmware starts logging again right after the reset */
+    { LOG_FILE, DEBUG_PATH, PROC_PATH, true, false },
+    { REGISTERS_FILE, regmap_path, NULL, false, false },
+    { DRAM_FILE, debug_path, debug_path_leg, false, true },
+    { PRIV_FILE, debug_path, debug_path_leg, false, true },
+    { SLOG_FILE, debug_path, debug_path_leg, false, false },
+};
+
+#define DUMP_FILE_COUNT ((int)(sizeof(dump_files) / sizeof(dump_files[0])))
+
+struct dump_set {
+    char str_time[32];
+    int fd[DUMP_FILE_COUNT];    /* memfd snapshots, -1 if not taken */
+    struct dump_set *next;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct dump_set *head;
+    int count;
+    bool started;
+} dump_queue = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, false };
+
+static void rm_old_dumps(const char *path)
+{
+    struct dirent **list;
+    int count[DUMP_FILE_COUNT] = { 0 };
+    int n, i;
+
+    ALOGD("%s(%s)", __func__, path);
+
+    n = scandir(path, &list, NULL, alphasort);
+    if (n < 0) {
+        ALOGE("%s: scandir failed: %s", __func__, strerror(errno));
+        return;
+    }
+    /* newest first, the time suffix sorts in time order */
+    while (n--) {
+        for (i = 0; i < DUMP_FILE_COUNT; i++) {
+            const char *prefix = dump_files[i].file + 1;
+
+            if (!strncmp(list[n]->d_name, prefix, strlen(prefix))) {
+                if (++count[i] > MAX_DUMP_COUNT) {
+                    char *tgt;
+
+                    if (asprintf(&tgt, "%s/%s", path, list[n]->d_name) != -1) {
+                        remove(tgt);
+                        free(tgt);
+                    }
+                }
+                break;
+            }
+        }
+        free(list[n]);
+    }
+    free(list);
+}
+
+/* Copies at most limit bytes in the kernel if possible, in large chunks otherwise. */
+static ssize_t copy_fd(int fd_in, int fd_out, size_t limit)
+{
+    char *buf;
+    size_t total = 0;
+    ssize_t n;
+
+    while (total < limit) {
+        n = sendfile(fd_out, fd_in, NULL, limit - total);
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS))
+            break;
+        if (n <= 0)
+            return (n < 0 && total == 0) ? -1 : (ssize_t)total;
+        total += n;
+    }
+
+    if (total == limit)
+        return total;
+
+    /* debugfs and sysfs files may not support splicing */
+    buf = (char *)malloc(COPY_CHUNK_SIZE);
+    if (buf == NULL)
+        return -1;
+    while (total < limit) {
+        size_t len = limit - total < COPY_CHUNK_SIZE ? limit - total : COPY_CHUNK_SIZE;
+
+        n = read(fd_in, buf, len);
+        if (n <= 0)
+            break;
+        if (write(fd_out, buf, n) != n) {
+            ALOGE("%s: write error: %s", __func__, strerror(errno));
+            break;
+        }
+        total += n;
+    }
+    free(buf);
+
+    return total;
+}
+
+static int open_source(const char *prefix, const char *alt_prefix, const char *file)
+{
+    char path[128];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s%s", prefix, file);
+    fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0 && alt_prefix) {
+        snprintf(path, sizeof(path), "%s%s", alt_prefix, file);
+        fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+    if (fd < 0)
+        ALOGE("%s: open error: %s, fd_in=%s", __func__, strerror(errno), path);
+
+    return fd;
+}
+
+/* Copies a volatile region to memory, within the budget of the dump. */
+static int snapshot(struct dump_set *set, int index, size_t *budget)
+{
+    const struct dump_file *file = &dump_files[index];
+    int fd_in, fd_mem;
+    ssize_t n = -1;
+
+    fd_mem = syscall(__NR_memfd_create, file->file + 1, MFD_CLOEXEC);
+    if (fd_mem < 0) {
+        ALOGE("%s: memfd error: %s", __func__, strerror(errno));
+        return -1;
+    }
+
+    /* an empty file is retried with the alternative path, as it used to be */
+    fd_in = open_source(file->prefix, NULL, file->file);
+    if (fd_in >= 0) {
+        n = copy_fd(fd_in, fd_mem, *budget);
+        close(fd_in);
+    }
+    if (n <= 0 && file->alt_prefix) {
+        fd_in = open_source(file->alt_prefix, NULL, file->file);
+        if (fd_in >= 0) {
+            if (ftruncate(fd_mem, 0) < 0)
+                ALOGW("%s: truncate error: %s", __func__, strerror(errno));
+            lseek(fd_mem, 0, SEEK_SET);
+            n = copy_fd(fd_in, fd_mem, *budget);
+            close(fd_in);
+        }
+    }
+    if (n < 0) {
+        close(fd_mem);
+        return -1;
+    }
+
+    if ((size_t)n == *budget)
+        ALOGW("%s: %s truncated to %zd bytes", __func__, file->file + 1, n);
+    *budget -= n;
+    set->fd[index] = fd_mem;
+    return 0;
+}
+
+static int store_compressed(int fd_in, int fd_out)
+{
+    unsigned char *in, *out;
+    z_stream zs;
+    ssize_t n;
+    int flush, ret;
+
+    memset(&zs, 0, sizeof(zs));
+    /* gzip stream, speed over ratio: the dump is mostly code and zeroes */
+    if (deflateInit2(&zs, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+
+    in = (unsigned char *)malloc(COPY_CHUNK_SIZE);
+    out = (unsigned char *)malloc(COPY_CHUNK_SIZE);
+    ret = (in && out) ? 0 : -1;
+    do {
+        n = read(fd_in, in, COPY_CHUNK_SIZE);
+        if (n < 0) {
+            ret = -1;
+            break;
+        }
+        flush = n == 0 ? Z_FINISH : Z_NO_FLUSH;
+        zs.next_in = in;
+        zs.avail_in = n;
+        do {
+            zs.next_out = out;
+            zs.avail_out = COPY_CHUNK_SIZE;
+            deflate(&zs, flush);
+            n = COPY_CHUNK_SIZE - zs.avail_out;
+            if (n > 0 && write(fd_out, out, n) != n) {
+                ALOGE("%s: write error: %s", __func__, strerror(errno));
+                ret = -1;
+            }
+        } while (zs.avail_out == 0 && ret == 0);
+    } while (flush != Z_FINISH && ret == 0);
+    deflateEnd(&zs);
+    free(in);
+    free(out);
+
+    return ret;
+}
+
+static void store(const struct dump_set *set, int index)
+{
+    const struct dump_file *file = &dump_files[index];
+    char path[256];
+    int fd_in, fd_out;
+    mode_t mask;
+
+    if (set->fd[index] >= 0) {
+        fd_in = set->fd[index];
+        lseek(fd_in, 0, SEEK_SET);
+    } else if (!file->volatile_region) {
+        fd_in = open_source(file->prefix, file->alt_prefix, file->file);
+        if (fd_in < 0)
+            return;
+    } else {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s%s_%s%s", out_path, file->file, set->str_time,
+             file->compress ? ".gz" : "");
+
+    mask = umask(002);
+    fd_out = open(path, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC,
+                  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    umask(mask);
+    if (fd_out < 0) {
+        ALOGE("%s: open error: %s, fd_out=%s", __func__, strerror(errno), path);
+    } else {
+        if (file->compress) {
+            if (store_compressed(fd_in, fd_out) < 0)
+                ALOGE("%s: compression of %s failed", __func__, path);
+        } else {
+            copy_fd(fd_in, fd_out, MAX_DUMP_SIZE);
+        }
+        close(fd_out);
+    }
+
+    if (fd_in != set->fd[index])
+        close(fd_in);
+}
+
+static void *dump_worker(void *)
+{
+    struct dump_set *set;
+    int i;
+
+    /* storing the dump must not compete with the recovered audio, nor lower the daemon */
+    if (setpriority(PRIO_PROCESS, syscall(__NR_gettid), DUMP_WORKER_NICE) < 0)
+        ALOGW("%s: setpriority error: %s", __func__, strerror(errno));
+
+    while (true) {
+        pthread_mutex_lock(&dump_queue.lock);
+        while (dump_queue.head == NULL)
+            pthread_cond_wait(&dump_queue.cond, &dump_queue.lock);
+        set = dump_queue.head;
+        pthread_mutex_unlock(&dump_queue.lock);
+
+        ALOGD("%s: %s", __func__, set->str_time);
+        if (mkdir(out_path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) < 0 && errno != EEXIST) {
+            ALOGW("mkdir(%s) failed: %s", out_path, strerror(errno));
+        }
+        for (i = 0; i < DUMP_FILE_COUNT; i++) {
+            store(set, i);
+            if (set->fd[i] >= 0)
+                close(set->fd[i]);
+        }
+        rm_old_dumps(out_path);
+
+        pthread_mutex_lock(&dump_queue.lock);
+        dump_queue.head = set->next;
+        dump_queue.count--;
+        pthread_mutex_unlock(&dump_queue.lock);
+        free(set);
+    }
+
+    return NULL;
+}
+
+/*
+ * Snapshots the volatile regions of the failed firmware to memory. The
+ * regions which are gone after reset are captured first and nothing is
+ * written to the storage here, so that the firmware can be reset right away.
+ */
+static struct dump_set *dump(void)
+{
+    struct dump_set *set;
+    size_t budget = MAX_DUMP_SIZE;
+    time_t t;
+    struct tm *lt;
+    int i;
+
+    ALOGD("%s", __func__);
+
+    pthread_mutex_lock(&dump_queue.lock);
+    i = dump_queue.count;
+    pthread_mutex_unlock(&dump_queue.lock);
+    if (i >= MAX_PENDING_DUMPS) {
+        ALOGW("%s: %d dumps are still being stored, skipped", __func__, i);
+        return NULL;
+    }
+
+    set = (struct dump_set *)calloc(1, sizeof(*set));
+    if (set == NULL)
+        return NULL;
+
+    t = time(NULL);
+    lt = localtime(&t);
+    if (lt == NULL) {
+        ALOGE("%s: time conversion error: %s", __func__, strerror(errno));
+        free(set);
+        return NULL;
+    }
+    if (strftime(set->str_time, sizeof(set->str_time), "%Y%m%d_%H%M%S", lt) == 0) {
+        ALOGE("%s: time error: %s", __func__, strerror(errno));
+    }
+
+    for (i = 0; i < DUMP_FILE_COUNT; i++) {
+        set->fd[i] = -1;
+        if (dump_files[i].volatile_region)
+            snapshot(set, i, &budget);
+    }
+
+    return set;
+}
+
+/* Hands the snapshot over to the worker, which stores it at low priority. */
+static void queue_dump(struct dump_set *set)
+{
+    struct dump_set **tail;
+
+    if (set == NULL)
+        return;
+
+    pthread_mutex_lock(&dump_queue.lock);
+    if (!dump_queue.started) {
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, dump_worker, NULL) == 0) {
+            pthread_detach(thread);
+            dump_queue.started = true;
+        } else {
+            ALOGE("%s: cannot start the dump worker", __func__);
+        }
+    }
+    for (tail = &dump_queue.head; *tail; tail = &(*tail)->next) {}
+    *tail = set;
+    dump_queue.count++;
+    pthread_cond_signal(&dump_queue.cond);
+    pthread_mutex_unlock(&dump_queue.lock);
+}
+
+static void reset(void)
+{
+    int fd, n;
+    const char str[] = "CALLIOPE";
+    char *path;
+
+    ALOGD("%s", __func__);
+
+    n = asprintf(&path, "%s%s", sys_path, RESET_FILE);
+    if (n >= 0) {
+        ALOGD("%s : %s", __func__, path);
+        if (access(path, F_OK) != 0) {
+            free(path);
+            n = asprintf(&path, "%s%s", PROC_PATH, FAILSAFE_RESET_FILE);
+            ALOGD("%s = %s", __func__, path);
+        }
+    }
+
+    if (n >= 0) {
+        fd = open(path, O_WRONLY);
+        if (fd < 0) {
+            ALOGE("%s: open error: %s", __func__, strerror(errno));
+        } else {
+            n = write(fd, str, strlen(str));
+            if (n < (int)strlen(str)) {
+                ALOGE("%s: write error: %s", __func__, strerror(errno));
+            }
+            close(fd);
+        }
+        free(path);
+    } else {
+        ALOGE("%s: path error: %s", __func__, strerror(errno));
+    }
+}
+
+int abox_recv_event(int fd)
+{
+    char msg[BUFFER_SIZE + 2];
+    char *cp;
+    int count;
+    int n;
+
+    n = uevent_kernel_multicast_recv(fd, msg, BUFFER_SIZE);
+    if (n <= 0)
+        return n;
+
+    msg[n] = 0;
+    msg[n+1] = 0;
+    cp = msg;
+
+    while (*cp) {
+        // ALOGV("UEVENT: %s", cp);
+        if (!strncmp(cp, DEVPATH, sizeof(DEVPATH) - 1) &&
+            !strncmp(cp + sizeof(DEVPATH) - 1, dev_path, dev_path_len)) {
+            do {
+                while (*cp++) {}
+                // ALOGD("UEVENT: %s", cp);
+                if (sscanf(cp, COUNT"%d", &count) > 0) {
+                    ALOGD("%s, count=%d", cp, count);
+                    if (count > 0) {
+                        ALOGW("fault report from Calliope: %d", count);
+                        struct dump_set *set = dump();
+                        reset();
+                        queue_dump(set);
+                    }
+                    break;
+                }
+            } while (*cp);
+        }
+        /* advance to after the next \0 */
+        while (*cp++) {}
+    }
+
+    return 0;
+}
+
+void abox_report_service(void)
+{
+    int fd, n;
+    const char str[] = "1";
+    char *path;
+
+    ALOGI("%s", __func__);
+
+    n = asprintf(&path, "%s%s", sys_path, SERVICE_FILE);
+    if (n >= 0) {
+        fd = open(path, O_WRONLY);
+        if (fd < 0) {
+            ALOGE("%s: open error: %s", __func__, strerror(errno));
+        } else {
+            n = write(fd, str, strlen(str));
+            if (n < (int)strlen(str)) {
+                ALOGE("%s: write error: %s", __func__, strerror(errno));
+            }
+            close(fd);
+        }
+        free(path);
+    } else {
+        ALOGE("%s: path error: %s", __func__, strerror(errno));
+    }
+}
+
+int abox_init(const char *dev, const char *out)
+{
+    dev_path_len = snprintf(dev_path, sizeof(dev_path), "/devices/platform/%s", dev);
+    if (dev_path_len < 0 || (size_t)dev_path_len >= sizeof(dev_path)) {
+        ALOGE("invalid argument: %s", dev);
+        return -1;
+    }
+    ALOGD("dev_path=%s", dev_path);
+
+    sys_path_len = snprintf(sys_path, sizeof(sys_path), "%s%s", SYS_PATH, dev_path);
+    if (sys_path_len < 0 || (size_t)sys_path_len >= sizeof(sys_path)) {
+        ALOGE("invalid argument: %s", dev);
+        return -1;
+    }
+    ALOGD("sys_path=%s", sys_path);
+
+    debug_path_len = snprintf(debug_path, sizeof(debug_path), "%s%s", sys_path, DEBUG_FILE);
+    if (debug_path_len < 0 || (size_t)debug_path_len >= sizeof(debug_path)) {
+        ALOGE("invalid argument: %s", dev);
+        return -1;
+    }
+    ALOGD("debug_path=%s", debug_path);
+
+    /* compatibility with legacy kernel */
+    debug_path_leg_len = snprintf(debug_path_leg, sizeof(debug_path_leg), "%s%s", sys_path, DEBUG_FILE_LEG);
+    if (debug_path_leg_len < 0 || (size_t)debug_path_leg_len >= sizeof(debug_path_leg)) {
+        ALOGE("invalid argument: %s", dev);
+        return -1;
+    }
+    ALOGD("debug_path_leg=%s", debug_path_leg);
+
+    regmap_path_len = snprintf(regmap_path, sizeof(regmap_path), "%s/%s", REGMAP_PATH, dev);
+    if (regmap_path_len < 0 || (size_t)regmap_path_len >= sizeof(regmap_path)) {
+        ALOGE("invalid argument: %s", dev);
+        return -1;
+    }
+    ALOGD("regmap_path=%s", regmap_path);
+
+    out_path_len = snprintf(out_path, sizeof(out_path), "%s", out);
+    if (out_path_len < 0 || (size_t)out_path_len >= sizeof(out_path)) {
+        ALOGE("invalid argument: %s", out);
+        return -1;
+    }
+    ALOGD("out_path=%s", out_path);
+
+    return 0;
+}
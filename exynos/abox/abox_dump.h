@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) 2026 Samsung Electronics Co. Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ABOX_DUMP_H__
+#define __ABOX_DUMP_H__
+
+#define BUFFER_SIZE (4096)
+
+/* dev is the platform device of abox, out the directory of the dumps */
+int abox_init(const char *dev, const char *out);
+/* dumps and resets the firmware on a fault reported by the uevent socket fd */
+int abox_recv_event(int fd);
+void abox_report_service(void);
+
+#endif /* __ABOX_DUMP_H__ */
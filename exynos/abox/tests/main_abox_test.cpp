@@ -0,0 +1,372 @@
+/*
+ * Copyright (C) 2017 Samsung Electronics Co. Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the fault handling of the daemon on a synthetic tree: abox_dump.cpp is
+ * built with its sysfs, debugfs and procfs roots relative to the working
+ * directory, and the uevents are sent on a socket pair.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <gtest/gtest.h>
+
+#include "../abox_dump.h"
+
+#define ABOX_DEV "14a50000.abox"
+#define ABOX_SYS "sys/devices/platform/" ABOX_DEV
+#define ABOX_DEBUG ABOX_SYS "/0.abox-debug"
+
+extern "C" ssize_t uevent_kernel_multicast_recv(int socket, void *buffer, size_t length)
+{
+    return recv(socket, buffer, length, 0);
+}
+
+namespace {
+
+using std::chrono::steady_clock;
+
+struct Region {
+    const char *path;
+    size_t size;
+    bool compressed;
+    bool volatileRegion;
+};
+
+/* in the order the daemon stores them */
+const Region kRegions[] = {
+    { ABOX_DEBUG "/calliope_sram", 512 << 10, false, true },
+    { ABOX_DEBUG "/gpr", 2 << 10, false, true },
+    { "d/abox/log-00", 1 << 20, false, true },
+    { "d/regmap/" ABOX_DEV "/registers", 16 << 10, false, false },
+    { ABOX_DEBUG "/calliope_dram", 24 << 20, true, false },
+    { ABOX_DEBUG "/calliope_priv", 2 << 20, true, false },
+    { ABOX_DEBUG "/calliope_slog", 1 << 20, false, false },
+};
+
+const size_t kRegionCount = sizeof(kRegions) / sizeof(kRegions[0]);
+const size_t kDram = 4;
+const size_t kMaxDumpCount = 3;
+
+std::string readFile(const std::string &path)
+{
+    std::string data;
+    char buf[65536];
+    int fd = open(path.c_str(), O_RDONLY);
+    ssize_t n;
+
+    if (fd < 0)
+        return data;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    close(fd);
+    return data;
+}
+
+std::string gunzip(const std::string &path)
+{
+    std::string data;
+    char buf[65536];
+    gzFile gz = gzopen(path.c_str(), "rb");
+    int n;
+
+    if (gz == NULL)
+        return data;
+    while ((n = gzread(gz, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    gzclose(gz);
+    return data;
+}
+
+void writeFile(const std::string &path, size_t size, unsigned seed)
+{
+    std::string data(size, 0);
+
+    /* firmware images: code-like bytes in the first half, mostly zero after */
+    for (size_t i = 0; i < size / 2; i++)
+        data[i] = (char)((i * 2654435761u + seed) >> 13);
+    for (size_t i = size / 2; i < size; i += 4096)
+        data[i] = (char)(seed + i);
+
+    FILE *f = fopen(path.c_str(), "w");
+    ASSERT_NE(nullptr, f) << path;
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+}
+
+std::vector<std::string> listDir(const std::string &dir, const char *pattern)
+{
+    std::vector<std::string> names;
+    DIR *d = opendir(dir.c_str());
+    struct dirent *entry;
+
+    if (d == NULL)
+        return names;
+    while ((entry = readdir(d)) != NULL) {
+        if (!fnmatch(pattern, entry->d_name, 0))
+            names.push_back(entry->d_name);
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+/* what the daemon did before: 4 KiB copies and a directory scan per file */
+void legacyDump(const std::string &outDir, const std::string &suffix)
+{
+    char buf[4096];
+
+    mkdir(outDir.c_str(), 0775);
+    for (const Region &region : kRegions) {
+        std::string name = strrchr(region.path, '/');
+        std::string out = outDir + name + "_" + suffix;
+        int fd_in = open(region.path, O_RDONLY | O_NONBLOCK);
+        int fd_out = open(out.c_str(), O_CREAT | O_WRONLY, 0664);
+        ssize_t n;
+
+        while ((n = read(fd_in, buf, sizeof(buf))) > 0) {
+            if (write(fd_out, buf, n) < 0)
+                break;
+        }
+        close(fd_out);
+        close(fd_in);
+
+        std::vector<std::string> dumps = listDir(outDir, (name.substr(1) + "*").c_str());
+        for (size_t i = 0; i + 3 < dumps.size(); i++)
+            remove((outDir + "/" + dumps[i]).c_str());
+    }
+}
+
+std::string regionName(const Region &region)
+{
+    return strrchr(region.path, '/') + 1;
+}
+
+/*
+ * The daemon has process wide state and its worker never returns: it is set
+ * up once for all the tests. Each test starts from its own regions and an
+ * empty output.
+ */
+class MainAboxTest : public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        char dir[] = "/tmp/main_abox_test.XXXXXX";
+
+        ASSERT_NE(nullptr, mkdtemp(dir));
+        ASSERT_EQ(0, chdir(dir));
+        for (const char *path : { "sys", "sys/devices", "sys/devices/platform", ABOX_SYS,
+                                  ABOX_DEBUG, "d", "d/abox", "d/regmap", "d/regmap/" ABOX_DEV }) {
+            ASSERT_EQ(0, mkdir(path, 0775)) << path;
+        }
+        writeRegions(1);
+        writeFile(ABOX_SYS "/service", 0, 0);
+
+        ASSERT_EQ(0, mkfifo(ABOX_SYS "/reset", 0664));
+        resetFd = open(ABOX_SYS "/reset", O_RDONLY | O_NONBLOCK);
+        ASSERT_GE(resetFd, 0);
+        /* a writer of our own, so that poll() only wakes up on data */
+        ASSERT_GE(open(ABOX_SYS "/reset", O_WRONLY | O_NONBLOCK), 0);
+
+        ASSERT_EQ(0, abox_init(ABOX_DEV, "out"));
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, ueventFd));
+    }
+
+    void SetUp() override {
+        char buf[32];
+
+        ASSERT_GE(ueventFd[1], 0);
+        writeRegions(seed);
+        seed += kRegionCount;
+
+        mkdir("out", 0775);
+        for (const std::string &name : listDir("out", "*")) {
+            if (name[0] != '.') {
+                ASSERT_EQ(0, remove(("out/" + name).c_str())) << name;
+            }
+        }
+        while (read(resetFd, buf, sizeof(buf)) > 0) {}
+        lastDump.clear();
+    }
+
+    static void writeRegions(unsigned first) {
+        for (size_t i = 0; i < kRegionCount; i++)
+            writeFile(kRegions[i].path, kRegions[i].size, first + i);
+    }
+
+    static std::vector<std::string> readRegions() {
+        std::vector<std::string> data;
+
+        for (const Region &region : kRegions)
+            data.push_back(readFile(region.path));
+        return data;
+    }
+
+    /* what the firmware does once it is reset: the memory images are kept */
+    void rewriteRegions() {
+        for (size_t i = 0; i < kRegionCount; i++) {
+            if (kRegions[i].volatileRegion)
+                writeFile(kRegions[i].path, kRegions[i].size, seed + i);
+        }
+        seed += kRegionCount;
+    }
+
+    /* reports a failure and returns the time until the reset, in us */
+    int64_t failure() {
+        static const char msg[] = "change@/devices/platform/" ABOX_DEV "\0"
+                                  "DEVPATH=/devices/platform/" ABOX_DEV "\0"
+                                  "COUNT=1\0";
+        struct pollfd pfd = { resetFd, POLLIN, 0 };
+        char buf[32];
+
+        auto start = steady_clock::now();
+        if (send(ueventFd[1], msg, sizeof(msg), 0) < 0)
+            return -1;
+        if (abox_recv_event(ueventFd[0]) < 0)
+            return -1;
+        if (poll(&pfd, 1, 5000) != 1)
+            return -1;
+        auto end = steady_clock::now();
+
+        if (read(resetFd, buf, sizeof(buf)) != 8 || memcmp(buf, "CALLIOPE", 8))
+            return -1;
+        return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    }
+
+    /* waits for the worker to store the last file of a new dump */
+    std::string waitStored() {
+        const Region &last = kRegions[kRegionCount - 1];
+        std::string prefix = regionName(last) + "_";
+
+        for (int i = 0; i < 5000; i++) {
+            std::vector<std::string> dumps = listDir("out", (prefix + "*").c_str());
+            struct stat st;
+
+            if (!dumps.empty() && dumps.back() > lastDump &&
+                !stat(("out/" + dumps.back()).c_str(), &st) && (size_t)st.st_size == last.size) {
+                usleep(20000);   /* old dumps are removed right after */
+                lastDump = dumps.back();
+                return lastDump.substr(prefix.size());
+            }
+            usleep(1000);
+        }
+        return "";
+    }
+
+    /* the dump named suffix holds the regions as they were before the reset */
+    void expectStored(const std::string &suffix, const std::vector<std::string> &before) {
+        for (size_t i = 0; i < kRegionCount; i++) {
+            std::string path = "out/" + regionName(kRegions[i]) + "_" + suffix;
+
+            if (kRegions[i].compressed)
+                EXPECT_EQ(before[i], gunzip(path + ".gz")) << path;
+            else
+                EXPECT_EQ(before[i], readFile(path)) << path;
+        }
+    }
+
+    static int resetFd;
+    static int ueventFd[2];
+    static unsigned seed;
+    std::string lastDump;
+};
+
+int MainAboxTest::resetFd = -1;
+int MainAboxTest::ueventFd[2] = { -1, -1 };
+unsigned MainAboxTest::seed = 1 + kRegionCount;
+
+} // namespace
+
+TEST_F(MainAboxTest, StoresDumpAfterReset) {
+    std::vector<std::string> before = readRegions();
+
+    ASSERT_GE(failure(), 0);
+    rewriteRegions();
+    std::string suffix = waitStored();
+    ASSERT_FALSE(suffix.empty());
+
+    expectStored(suffix, before);
+
+    /* the large memory images are compressed */
+    struct stat st;
+    ASSERT_EQ(0, stat(("out/calliope_dram_" + suffix + ".gz").c_str(), &st));
+    EXPECT_LT((size_t)st.st_size, before[kDram].size() / 2);
+}
+
+TEST_F(MainAboxTest, FailureToResetLatency) {
+    std::vector<int64_t> legacy, latency;
+
+    for (int i = 0; i < 4; i++) {
+        std::vector<std::string> before = readRegions();
+
+        /* one second apart, the dumps are named after the time */
+        sleep(1);
+        int64_t us = failure();
+        ASSERT_GE(us, 0);
+        latency.push_back(us);
+
+        /* the reset did not wait for the dump: it holds what was there before it */
+        rewriteRegions();
+        std::string suffix = waitStored();
+        ASSERT_FALSE(suffix.empty());
+        expectStored(suffix, before);
+
+        auto start = steady_clock::now();
+        legacyDump("legacy_out", std::to_string(i));
+        legacy.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                             steady_clock::now() - start).count());
+    }
+
+    std::sort(legacy.begin(), legacy.end());
+    std::sort(latency.begin(), latency.end());
+    printf("failure to reset, median of %zu: %.2f ms -> %.2f ms\n", latency.size(),
+           legacy[legacy.size() / 2] / 1000.0, latency[latency.size() / 2] / 1000.0);
+}
+
+TEST_F(MainAboxTest, KeepsLastDumps) {
+    std::vector<std::string> suffixes;
+
+    for (size_t i = 0; i < kMaxDumpCount + 1; i++) {
+        sleep(1);
+        ASSERT_GE(failure(), 0);
+        rewriteRegions();
+        suffixes.push_back(waitStored());
+        ASSERT_FALSE(suffixes.back().empty());
+    }
+
+    /* the oldest dump is removed, file by file */
+    for (const Region &region : kRegions) {
+        std::string pattern = regionName(region) + "_*";
+        std::vector<std::string> expected;
+
+        for (size_t i = 1; i < suffixes.size(); i++)
+            expected.push_back(regionName(region) + "_" + suffixes[i] + (region.compressed ? ".gz" : ""));
+        EXPECT_EQ(expected, listDir("out", pattern.c_str())) << pattern;
+    }
+}
@@ -23,11 +23,7 @@
 
 #include <ion/ion.h>
 
-#include "DumpstateUtil.h"
-
-using android::os::dumpstate::DumpFileToFd;
-using android::os::dumpstate::RunCommandToFd;
-using android::os::dumpstate::CommandOptions;
+#include "DumpstateSections.h"
 
 namespace android {
 namespace hardware {
@@ -67,24 +63,34 @@ Return<void> DumpstateDevice::dumpstateBoard(const hidl_handle& handle) {
 	    ion_close(ionfd);
     }
 
+    // The sections are independent, so they are collected concurrently and
+    // written out in this order once done.
+    std::vector<DumpSection> sections;
+
     if (modern_ion) {
-	    DumpFileToFd(fd, "ION: List of allocated buffers", "/d/ion/buffers");
-	    RunCommandToFd(fd, "ION: Heap details", {"/vendor/bin/sh", "-c", "cout=0;for heap in $(ls /d/ion/heaps); do count=$(($count+1));cat /d/ion/heaps/$heap; echo; done; echo ::: total $count heaps found; echo"});
-	    DumpFileToFd(fd, "ION: Latest activities", "/d/ion/event");
+	    sections.push_back(fileSection("ION: List of allocated buffers", "/d/ion/buffers"));
+	    sections.push_back(dirSection("ION: Heap details", "/d/ion/heaps", "", nullptr, "\n", "heaps"));
+	    sections.push_back(fileSection("ION: Latest activities", "/d/ion/event"));
     } else {
-	    DumpFileToFd(fd, "ION: List of allocated buffers", "/d/ion/buffer");
-	    RunCommandToFd(fd, "ION: Heap details", {"/vendor/bin/sh", "-c", "cout=0;for heap in $(ls /d/ion/heaps); do count=$(($count+1));echo \\[ $heap \\];cat /d/ion/heaps/$heap; echo; done; echo ::: total $count heaps found; echo"});
-	    RunCommandToFd(fd, "ION: Client details", {"/vendor/bin/sh", "-c", "cout=0;for client in $(ls /d/ion/clients); do count=$(($count+1));echo \\[ $client \\];cat /d/ion/clients/$client; echo; done; echo ::: total $count clients found; echo"});
-	    DumpFileToFd(fd, "ION: Latest activities", "/d/ion/event");
+	    sections.push_back(fileSection("ION: List of allocated buffers", "/d/ion/buffer"));
+	    sections.push_back(dirSection("ION: Heap details", "/d/ion/heaps", "",
+		    [](const std::string& heap) { return "[ " + heap + " ]\n"; }, "\n", "heaps"));
+	    sections.push_back(dirSection("ION: Client details", "/d/ion/clients", "",
+		    [](const std::string& client) { return "[ " + client + " ]\n"; }, "\n", "clients"));
+	    sections.push_back(fileSection("ION: Latest activities", "/d/ion/event"));
     }
 
-    DumpFileToFd(fd, "dma-buf: bufinfo", "/d/dma_buf/bufinfo");
+    sections.push_back(fileSection("dma-buf: bufinfo", "/d/dma_buf/bufinfo"));
 
     if (modern_ion)
-	    RunCommandToFd(fd, "dma-buf: footprint", {"/vendor/bin/sh", "-c", "for pid in $(ls /d/dma_buf/footprint); do echo -n \\[$pid\\]; cat /d/dma_buf/footprint/$pid; echo; done"});
+	    sections.push_back(dirSection("dma-buf: footprint", "/d/dma_buf/footprint", "",
+		    [](const std::string& pid) { return "[" + pid + "]"; }, "\n", ""));
+
+    sections.push_back(fileSection("Mali: gpu_memory", "/d/mali/gpu_memory"));
+    sections.push_back(dirSection("Mali: mem_profile", "/d/mali/mem", "/mem_profile",
+	    [](const std::string& d) { return "[ " + d + "/mem_profile ]\n"; }, "", ""));
 
-    DumpFileToFd(fd, "Mali: gpu_memory", "/d/mali/gpu_memory");
-    RunCommandToFd(fd, "Mali: mem_profile", {"/vendor/bin/sh", "-c", "for d in $(ls /d/mali/mem); do if [ -f /d/mali/mem/$d/mem_profile ]; then echo \\[ $d/mem_profile \\];cat /d/mali/mem/$d/mem_profile; fi; done"});
+    dumpSections(fd, sections);
 
     return Void();
 }
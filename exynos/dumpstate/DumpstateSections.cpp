@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "dumpstate"
+
+#include "DumpstateSections.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <log/log.h>
+
+using android::base::StringPrintf;
+using android::base::unique_fd;
+using android::base::WriteStringToFd;
+
+namespace android {
+namespace hardware {
+namespace dumpstate {
+namespace V1_0 {
+namespace implementation {
+
+using std::chrono::steady_clock;
+
+DumpSectionBuffer::DumpSectionBuffer(steady_clock::time_point deadline, size_t limit)
+    : mDeadline(deadline), mLimit(limit) {}
+
+bool DumpSectionBuffer::appendLocked(const char* data, size_t len) {
+    if (!mTruncation.empty())
+        return false;
+
+    if (steady_clock::now() >= mDeadline) {
+        mTruncation = "timed out";
+        return false;
+    }
+
+    if (mData.size() + len > mLimit) {
+        mData.append(data, mLimit - mData.size());
+        mTruncation = StringPrintf("size limit of %zu bytes reached", mLimit);
+        return false;
+    }
+
+    mData.append(data, len);
+    return true;
+}
+
+void DumpSectionBuffer::append(const std::string& text) {
+    std::lock_guard<std::mutex> lock(mLock);
+    appendLocked(text.data(), text.size());
+}
+
+int DumpSectionBuffer::appendFile(const std::string& path) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+    char buf[64 * 1024];
+
+    if (fd == -1)
+        return errno;
+
+    // debugfs files are produced as they are read, so the deadline is
+    // checked between the reads.
+    while (true) {
+        ssize_t len = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf)));
+        if (len < 0)
+            return errno;  // before the fd is closed
+        if (len == 0)
+            return 0;
+
+        std::lock_guard<std::mutex> lock(mLock);
+        if (!appendLocked(buf, len))
+            return 0;
+    }
+}
+
+bool DumpSectionBuffer::exhausted() {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (mTruncation.empty() && steady_clock::now() >= mDeadline)
+        mTruncation = "timed out";
+
+    return !mTruncation.empty();
+}
+
+std::string DumpSectionBuffer::snapshot(std::string* truncation) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    *truncation = mTruncation;
+    return mData;
+}
+
+DumpSection fileSection(const std::string& title, const std::string& path) {
+    DumpSection section;
+
+    section.title = title;
+    section.source = path;
+    section.collect = [path](DumpSectionBuffer* out) {
+        int error = out->appendFile(path);
+
+        if (error)
+            out->append(StringPrintf("*** %s: %s\n", path.c_str(), strerror(error)));
+    };
+
+    return section;
+}
+
+static std::vector<std::string> listDir(const std::string& dir) {
+    std::unique_ptr<DIR, int (*)(DIR*)> d(opendir(dir.c_str()), closedir);
+    std::vector<std::string> entries;
+    struct dirent* entry;
+
+    if (!d)
+        return entries;
+
+    while ((entry = readdir(d.get())) != nullptr) {
+        if (entry->d_name[0] == '.')
+            continue;
+        entries.push_back(entry->d_name);
+    }
+    std::sort(entries.begin(), entries.end());
+
+    return entries;
+}
+
+DumpSection dirSection(const std::string& title, const std::string& dir,
+                       const std::string& entryFile,
+                       std::function<std::string(const std::string& entry)> header,
+                       const std::string& separator, const std::string& countNoun) {
+    DumpSection section;
+
+    section.title = title;
+    section.source = dir;
+    section.collect = [=](DumpSectionBuffer* out) {
+        int count = 0;
+
+        for (const std::string& entry : listDir(dir)) {
+            std::string path = dir + "/" + entry + entryFile;
+
+            if (out->exhausted())
+                return;
+
+            if (!entryFile.empty() && access(path.c_str(), R_OK))
+                continue;
+
+            if (header)
+                out->append(header(entry));
+            out->appendFile(path);
+            out->append(separator);
+            count++;
+        }
+
+        if (!countNoun.empty())
+            out->append(StringPrintf("::: total %d %s found\n\n", count, countNoun.c_str()));
+    };
+
+    return section;
+}
+
+namespace {
+
+// State shared between the writer and a collector thread. The thread keeps
+// its own reference so that it can be left behind when it misses its deadline.
+struct SectionState {
+    SectionState(steady_clock::time_point deadline, size_t limit)
+        : buffer(deadline, limit), done(false) {}
+
+    DumpSectionBuffer buffer;
+    std::mutex lock;
+    std::condition_variable cv;
+    bool done;
+    steady_clock::time_point finish;
+};
+
+}  // namespace
+
+void dumpSections(int fd, const std::vector<DumpSection>& sections) {
+    std::vector<std::shared_ptr<SectionState>> states;
+    steady_clock::time_point start = steady_clock::now();
+
+    for (const DumpSection& section : sections) {
+        auto state = std::make_shared<SectionState>(start + section.timeout, section.limit);
+        auto collect = section.collect;
+
+        states.push_back(state);
+        std::thread([state, collect] {
+            collect(&state->buffer);
+
+            std::lock_guard<std::mutex> lock(state->lock);
+            state->done = true;
+            state->finish = steady_clock::now();
+            state->cv.notify_all();
+        }).detach();
+    }
+
+    for (size_t i = 0; i < sections.size(); i++) {
+        const DumpSection& section = sections[i];
+        SectionState* state = states[i].get();
+        std::string truncation;
+        steady_clock::time_point finish;
+        bool done;
+
+        {
+            std::unique_lock<std::mutex> lock(state->lock);
+            // A collector stuck in a read is given up on shortly after its
+            // deadline; whatever it produced so far is still written.
+            done = state->cv.wait_until(lock,
+                                        start + section.timeout + std::chrono::milliseconds(100),
+                                        [state] { return state->done; });
+            finish = done ? state->finish : steady_clock::now();
+        }
+
+        std::string data = state->buffer.snapshot(&truncation);
+        if (!done && truncation.empty())
+            truncation = "timed out";
+
+        WriteStringToFd(StringPrintf("------ %s (%s) ------\n", section.title.c_str(),
+                                     section.source.c_str()), fd);
+        WriteStringToFd(data, fd);
+        if (!data.empty() && data.back() != '\n')
+            WriteStringToFd("\n", fd);
+        if (!truncation.empty()) {
+            WriteStringToFd(StringPrintf("*** %s: %s, output truncated\n", section.title.c_str(),
+                                         truncation.c_str()), fd);
+            ALOGW("%s: %s", section.title.c_str(), truncation.c_str());
+        }
+        WriteStringToFd(StringPrintf("------ %.3fs was the duration of '%s' ------\n",
+                                     std::chrono::duration<double>(finish - start).count(),
+                                     section.title.c_str()), fd);
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace dumpstate
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ANDROID_HARDWARE_DUMPSTATE_V1_0_DUMPSTATESECTIONS_H
+#define ANDROID_HARDWARE_DUMPSTATE_V1_0_DUMPSTATESECTIONS_H
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace dumpstate {
+namespace V1_0 {
+namespace implementation {
+
+constexpr std::chrono::milliseconds kDefaultSectionTimeout = std::chrono::seconds(10);
+constexpr size_t kDefaultSectionLimit = 8 * 1024 * 1024;
+
+// In-memory output of one section. Collectors append to it from their own
+// thread; the writer may snapshot it when the section runs out of time.
+class DumpSectionBuffer {
+  public:
+    DumpSectionBuffer(std::chrono::steady_clock::time_point deadline, size_t limit);
+
+    // Appends the contents of the file at path. Returns the errno of the
+    // open or read that failed, or 0, also when the section ran out of time
+    // or space.
+    int appendFile(const std::string& path);
+    void append(const std::string& text);
+
+    // True once the deadline passed or the size limit was hit; collectors
+    // should stop adding output.
+    bool exhausted();
+
+    // Copies the output collected so far and the reason it was cut, if any.
+    std::string snapshot(std::string* truncation);
+
+  private:
+    // Appends at most the remaining space; records the truncation otherwise.
+    bool appendLocked(const char* data, size_t len);
+
+    std::mutex mLock;
+    std::string mData;
+    std::string mTruncation;
+    const std::chrono::steady_clock::time_point mDeadline;
+    const size_t mLimit;
+};
+
+struct DumpSection {
+    std::string title;
+    // Shown next to the title, like the file or directory being dumped.
+    std::string source;
+    std::function<void(DumpSectionBuffer*)> collect;
+    std::chrono::milliseconds timeout = kDefaultSectionTimeout;
+    size_t limit = kDefaultSectionLimit;
+};
+
+// Dumps a single file, as DumpFileToFd does.
+DumpSection fileSection(const std::string& title, const std::string& path);
+
+// Dumps <dir>/<entry><entryFile> for every entry of dir in name order,
+// replacing the "for e in $(ls dir)" shell loops. header() is written before
+// each entry and separator after it; entries without entryFile are skipped.
+// A "::: total N <noun> found" line closes the section when countNoun is set.
+DumpSection dirSection(const std::string& title, const std::string& dir,
+                       const std::string& entryFile,
+                       std::function<std::string(const std::string& entry)> header,
+                       const std::string& separator, const std::string& countNoun);
+
+// Collects all the sections concurrently, each within its own timeout, and
+// writes them to fd in the given order with their duration and any
+// truncation note.
+void dumpSections(int fd, const std::vector<DumpSection>& sections);
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace dumpstate
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_DUMPSTATE_V1_0_DUMPSTATESECTIONS_H
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+
+#include "../DumpstateSections.h"
+
+using android::base::ReadFileToString;
+using android::base::StringPrintf;
+using android::base::WriteStringToFile;
+using namespace android::hardware::dumpstate::V1_0::implementation;
+
+namespace {
+
+constexpr int kClients = 5000;
+
+// A debugfs-like tree: a few heaps, one footprint file per client and mali
+// contexts of which only some have a mem_profile.
+class DumpstateSectionsTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        char root[] = "/tmp/dumpstate_test.XXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(root));
+        mRoot = root;
+
+        mkdir((mRoot + "/heaps").c_str(), 0755);
+        for (const char* heap : {"system", "crypto", "vframe", "vstream"})
+            WriteStringToFile(StringPrintf("heap %s\n", heap), mRoot + "/heaps/" + heap);
+
+        mkdir((mRoot + "/footprint").c_str(), 0755);
+        for (int pid = 1; pid <= kClients; pid++)
+            WriteStringToFile(StringPrintf("%d: 4096 kB\n", pid),
+                              StringPrintf("%s/footprint/%d", mRoot.c_str(), pid));
+
+        mkdir((mRoot + "/mem").c_str(), 0755);
+        for (int ctx = 0; ctx < 8; ctx++) {
+            std::string dir = StringPrintf("%s/mem/%d_%d", mRoot.c_str(), 1000 + ctx, ctx);
+            mkdir(dir.c_str(), 0755);
+            if (ctx % 2 == 0)
+                WriteStringToFile(StringPrintf("ctx %d\n", ctx), dir + "/mem_profile");
+        }
+
+        WriteStringToFile("bufinfo\n", mRoot + "/bufinfo");
+    }
+
+    void TearDown() override {
+        std::string cmd = "rm -rf " + mRoot;
+        system(cmd.c_str());
+    }
+
+    std::string dump(const std::vector<DumpSection>& sections) {
+        int fd = memfd_create("dumpstate", 0);
+        std::string out;
+
+        dumpSections(fd, sections);
+        lseek(fd, 0, SEEK_SET);
+        android::base::ReadFdToString(fd, &out);
+        close(fd);
+
+        return out;
+    }
+
+    std::string mRoot;
+};
+
+}  // namespace
+
+TEST_F(DumpstateSectionsTest, WritesSectionsInOrder) {
+    std::vector<DumpSection> sections;
+
+    sections.push_back(dirSection("ION: Heap details", mRoot + "/heaps", "",
+            [](const std::string& heap) { return "[ " + heap + " ]\n"; }, "\n", "heaps"));
+    sections.push_back(fileSection("dma-buf: bufinfo", mRoot + "/bufinfo"));
+    sections.push_back(dirSection("dma-buf: footprint", mRoot + "/footprint", "",
+            [](const std::string& pid) { return "[" + pid + "]"; }, "\n", ""));
+    sections.push_back(dirSection("Mali: mem_profile", mRoot + "/mem", "/mem_profile",
+            [](const std::string& d) { return "[ " + d + "/mem_profile ]\n"; }, "", ""));
+    sections.push_back(fileSection("missing", mRoot + "/missing"));
+    sections.push_back(fileSection("unreadable", mRoot + "/heaps"));
+
+    std::string out = dump(sections);
+
+    size_t heaps = out.find("------ ION: Heap details (" + mRoot + "/heaps) ------\n");
+    size_t bufinfo = out.find("------ dma-buf: bufinfo");
+    size_t footprint = out.find("------ dma-buf: footprint");
+    size_t mali = out.find("------ Mali: mem_profile");
+    size_t missing = out.find("------ missing");
+    ASSERT_NE(std::string::npos, heaps);
+    EXPECT_LT(heaps, bufinfo);
+    EXPECT_LT(bufinfo, footprint);
+    EXPECT_LT(footprint, mali);
+    EXPECT_LT(mali, missing);
+
+    EXPECT_NE(std::string::npos, out.find("[ crypto ]\nheap crypto\n\n[ system ]\nheap system\n\n"));
+    EXPECT_NE(std::string::npos, out.find("::: total 4 heaps found\n"));
+    EXPECT_NE(std::string::npos, out.find(StringPrintf("[%d]%d: 4096 kB\n\n", kClients, kClients)));
+    EXPECT_NE(std::string::npos, out.find("[ 1000_0/mem_profile ]\nctx 0\n"));
+    EXPECT_EQ(std::string::npos, out.find("1001_1"));
+    EXPECT_NE(std::string::npos, out.find("*** " + mRoot + "/missing: No such file or directory\n"));
+    EXPECT_NE(std::string::npos, out.find("*** " + mRoot + "/heaps: Is a directory\n"));
+    EXPECT_NE(std::string::npos, out.find("was the duration of 'dma-buf: footprint'"));
+    EXPECT_EQ(std::string::npos, out.find("output truncated"));
+}
+
+TEST_F(DumpstateSectionsTest, SlowSectionIsCutAtItsDeadline) {
+    std::vector<DumpSection> sections;
+    DumpSection slow;
+
+    slow.title = "slow";
+    slow.source = "test";
+    slow.timeout = std::chrono::milliseconds(50);
+    slow.collect = [](DumpSectionBuffer* out) {
+        out->append("partial\n");
+        // a read that does not come back
+        std::this_thread::sleep_for(std::chrono::seconds(2));
+        out->append("late\n");
+    };
+    sections.push_back(slow);
+    sections.push_back(fileSection("dma-buf: bufinfo", mRoot + "/bufinfo"));
+
+    auto start = std::chrono::steady_clock::now();
+    std::string out = dump(sections);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_LT(elapsed, std::chrono::seconds(1));
+    EXPECT_NE(std::string::npos, out.find("partial\n*** slow: timed out, output truncated\n"));
+    EXPECT_EQ(std::string::npos, out.find("late"));
+    EXPECT_NE(std::string::npos, out.find("bufinfo\n------"));
+}
+
+TEST_F(DumpstateSectionsTest, LargeSectionIsTruncated) {
+    DumpSection footprint = dirSection("dma-buf: footprint", mRoot + "/footprint", "",
+            [](const std::string& pid) { return "[" + pid + "]"; }, "\n", "");
+
+    footprint.limit = 4096;
+    std::string out = dump({footprint});
+
+    EXPECT_NE(std::string::npos,
+              out.find("*** dma-buf: footprint: size limit of 4096 bytes reached, output truncated\n"));
+    EXPECT_LT(out.size(), 4096u + 256u);
+}
+
+TEST_F(DumpstateSectionsTest, ManyClients) {
+    std::vector<DumpSection> sections;
+
+    for (int i = 0; i < 4; i++)
+        sections.push_back(dirSection(StringPrintf("footprint %d", i), mRoot + "/footprint", "",
+                [](const std::string& pid) { return "[" + pid + "]"; }, "\n", ""));
+
+    auto start = std::chrono::steady_clock::now();
+    std::string out = dump(sections);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("%d sections of %d entries: %zu bytes in %.1f ms\n", 4, kClients, out.size(),
+           std::chrono::duration<double, std::milli>(elapsed).count());
+    EXPECT_EQ(std::string::npos, out.find("output truncated"));
+}
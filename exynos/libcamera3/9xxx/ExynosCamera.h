@@ -61,6 +61,9 @@
 
 namespace android {
 
+/* bound of the wait in flush() for processCaptureRequest() to leave m_flushLock */
+#define FLUSH_LOCK_WAIT_TIMEOUT     (33000000)      /* 33ms */
+
 #define SET_STREAM_CONFIG_BIT(_BIT,_STREAM_ID) \
     ((_BIT) |= (1 << ((_STREAM_ID) % HAL_STREAM_ID_MAX)))
 
@@ -593,6 +596,8 @@ private:
 
     mutable Mutex                   m_flushLock;
     bool                            m_flushLockWait;
+    /* signaled when processCaptureRequest() leaves m_flushLock */
+    mutable Condition               m_flushLockWaitCondition;
 
     /* Thread */
     sp<mainCameraThread>            m_mainPreviewThread;
@@ -218,6 +218,8 @@ status_t ExynosCamera::m_vendorReInit(void)
 status_t ExynosCamera::releaseDevice(void)
 {
     status_t ret = NO_ERROR;
+    ExynosCameraPhaseTimer phaseTimer;
+    char phaseStr[256];
     CLOGD("");
 #ifdef TIME_LOGGER_CLOSE_ENABLE
     TIME_LOGGER_INIT(m_cameraId);
@@ -235,10 +237,12 @@ status_t ExynosCamera::releaseDevice(void)
     m_startPictureBufferThread->requestExitAndWait();
     m_framefactoryCreateThread->requestExitAndWait();
     m_monitorThread->requestExit();
+    phaseTimer.lap("setupThreadStop");
 
     if (m_getState() > EXYNOS_CAMERA_STATE_CONFIGURED) {
         flush();
     }
+    phaseTimer.lap("flush");
 
     m_deinitBufferSupplierThread = new mainCameraThread(this, &ExynosCamera::m_deinitBufferSupplierThreadFunc, "deinitBufferSupplierThread");
     m_deinitBufferSupplierThread->run();
@@ -247,9 +251,14 @@ status_t ExynosCamera::releaseDevice(void)
     TIME_LOGGER_UPDATE(m_cameraId, 0, 0, CUMULATIVE_CNT, MONITOR_THREAD_STOP_START, 0);
     m_monitorThread->requestExitAndWait();
     TIME_LOGGER_UPDATE(m_cameraId, 0, 0, CUMULATIVE_CNT, MONITOR_THREAD_STOP_END, 0);
+    phaseTimer.lap("monitorThreadStop");
 
     m_frameMgr->stop();
     m_frameMgr->deleteAllFrame();
+    phaseTimer.lap("frameMgrStop");
+
+    phaseTimer.getPhaseString(phaseStr, sizeof(phaseStr));
+    CLOGI("close phase time(usec) : total(%d)%s", (int)phaseTimer.durationUsecs(), phaseStr);
 
     TIME_LOGGER_UPDATE(m_cameraId, 0, 0, CUMULATIVE_CNT, RELEASE_DEVICE_END, 0);
     return ret;
@@ -1300,7 +1309,10 @@ func_exit:
 
 status_t ExynosCamera::flush()
 {
-    int retryCount;
+    nsecs_t waitStartTime = 0;
+    nsecs_t waitTime = 0;
+    ExynosCameraPhaseTimer phaseTimer;
+    char phaseStr[256];
 
     /* flush lock */
     m_flushLock.lock();
@@ -1380,6 +1392,7 @@ status_t ExynosCamera::flush()
 #endif
     stopThreadAndInputQ(m_selectBayerThread, 1, m_selectBayerQ);
     TIME_LOGGER_UPDATE(m_cameraId, 0, 0, CUMULATIVE_CNT, FRAME_CREATE_THREAD_STOP_END, 0);
+    phaseTimer.lap("frameCreateThreadStop");
 
     /* Stop pipeline */
     for (int i = FRAME_FACTORY_TYPE_MAX - 1; i >= 0; i--) {
@@ -1403,6 +1416,7 @@ status_t ExynosCamera::flush()
             CLOGD("m_frameFactory[%d] stopPipes", i);
         }
     }
+    phaseTimer.lap("factoryStop");
 
 #ifdef SAMSUNG_TN_FEATURE
     m_deinitUniPP();
@@ -1438,6 +1452,7 @@ status_t ExynosCamera::flush()
     }
 #endif /* SAMSUNG_DUAL_PORTRAIT_SOLUTION */
     TIME_LOGGER_UPDATE(m_cameraId, 0, 0, CUMULATIVE_CNT, LIBRARY_DEINIT_END, 0);
+    phaseTimer.lap("libraryDeinit");
 
     /* Wait for finishing post-processing thread */
     stopThreadAndInputQ(m_previewStreamBayerThread, 1, m_pipeFrameDoneQ[PIPE_FLITE]);
@@ -1494,6 +1509,7 @@ status_t ExynosCamera::flush()
 #endif
 
     TIME_LOGGER_UPDATE(m_cameraId, 0, 0, CUMULATIVE_CNT, STREAM_THREAD_STOP_END, 0);
+    phaseTimer.lap("streamThreadStop");
 
     for (int i = 0; i < CAMERA_ID_MAX; i++) {
         if (m_captureSelector[i] != NULL) {
@@ -1505,6 +1521,7 @@ status_t ExynosCamera::flush()
         m_requestMgr->flush();
         TIME_LOGGER_UPDATE(m_cameraId, 0, 0, CUMULATIVE_CNT, REQUEST_FLUSH_END, 0);
     }
+    phaseTimer.lap("requestFlush");
     ret = m_clearRequestList(&m_requestPreviewWaitingList, &m_requestPreviewWaitingLock);
     if (ret < 0) {
         CLOGE("m_clearList(m_processList) failed [%d]", ret);
@@ -1534,6 +1551,7 @@ status_t ExynosCamera::flush()
     TIME_LOGGER_UPDATE(m_cameraId, 0, 0, CUMULATIVE_CNT, BUFFER_RESET_START, 0);
     ret = m_bufferSupplier->resetBuffers();
     TIME_LOGGER_UPDATE(m_cameraId, 0, 0, CUMULATIVE_CNT, BUFFER_RESET_END, 0);
+    phaseTimer.lap("bufferReset");
     if (ret != NO_ERROR) {
         CLOGE("Failed to resetBuffers. ret %d", ret);
     }
@@ -1549,20 +1567,25 @@ status_t ExynosCamera::flush()
     }
 
     /*
-     * do unlock/lock of flushLock to give a chance to processCaptureRequest()
+     * release flushLock while waiting to give a chance to processCaptureRequest()
      * to flush remained requests and wait maximum 33ms for finishing current
-     * processCaptureRequest().
+     * processCaptureRequest(). It signals when it leaves flushLock.
      */
     TIME_LOGGER_UPDATE(m_cameraId, 0, 0, CUMULATIVE_CNT, WAIT_PROCESS_CAPTURE_REQUEST_START, 0);
-    m_flushLock.unlock();
-    retryCount = 33; /* 33ms */
-    while (m_flushLockWait && retryCount > 0) {
-        CLOGW("wait for done current processCaptureRequest(%d)!!", retryCount);
-        retryCount--;
-        usleep(1000);
+    waitStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    waitTime = 0;
+    while (m_flushLockWait == true) {
+        if (waitTime >= FLUSH_LOCK_WAIT_TIMEOUT) {
+            CLOGW("wait for done current processCaptureRequest timeout(%d)ms",
+                    (int)ns2ms(FLUSH_LOCK_WAIT_TIMEOUT));
+            break;
+        }
+
+        m_flushLockWaitCondition.waitRelative(m_flushLock, FLUSH_LOCK_WAIT_TIMEOUT - waitTime);
+        waitTime = systemTime(SYSTEM_TIME_MONOTONIC) - waitStartTime;
     }
-    m_flushLock.lock();
     TIME_LOGGER_UPDATE(m_cameraId, 0, 0, CUMULATIVE_CNT, WAIT_PROCESS_CAPTURE_REQUEST_END, 0);
+    phaseTimer.lap("waitProcessCaptureRequest");
 
     if (m_getState() != EXYNOS_CAMERA_STATE_ERROR) {
         /*
@@ -1583,6 +1606,10 @@ func_exit:
     /* flush unlock */
     m_flushLock.unlock();
 
+    phaseTimer.lap("exit");
+    phaseTimer.getPhaseString(phaseStr, sizeof(phaseStr));
+    CLOGI("flush phase time(usec) : total(%d)%s", (int)phaseTimer.durationUsecs(), phaseStr);
+
     CLOGD(" : OUT---");
     TIME_LOGGER_UPDATE(m_cameraId, 0, 0, CUMULATIVE_CNT, FLUSH_END, 0);
     return ret;
@@ -2913,10 +2940,13 @@ status_t ExynosCamera::processCaptureRequest(camera3_capture_request *request)
                         entryState, m_getState());
                 m_requestMgr->flush();
                 m_flushLockWait = false;
+                m_flushLockWaitCondition.signal();
                 goto req_err;
             }
+
+            m_flushLockWait = false;
+            m_flushLockWaitCondition.signal();
         }
-        m_flushLockWait = false;
     }
 
     /* 7. Get FactoryAddr */
@@ -90,6 +90,7 @@ void ExynosCameraBufferManager::init(void)
     m_allowedMaxBufCount = 0;
     m_defaultAllocator = NULL;
     m_isCreateDefaultAllocator = false;
+    m_retentionPool = NULL;
     for (int bufIndex = 0; bufIndex < VIDEO_MAX_FRAME; bufIndex++) {
         for (int planeIndex = 0; planeIndex < EXYNOS_CAMERA_BUFFER_MAX_PLANES; planeIndex++) {
             m_buffer[bufIndex].fd[planeIndex] = -1;
@@ -210,6 +211,16 @@ int ExynosCameraBufferManager::getContigBufCount(void)
     return m_reservedMemoryCount;
 }
 
+void ExynosCameraBufferManager::setRetentionPool(ExynosCameraBufferRetentionPool *pool)
+{
+    Mutex::Autolock lock(m_lock);
+
+    if (m_flagAllocated == true)
+        CLOGW("retention pool is set after the allocation");
+
+    m_retentionPool = pool;
+}
+
 /*  If Image buffer color format equals YV12, and buffer has MetaDataPlane..
 
     planeCount = 4      (set by user)
@@ -787,13 +798,7 @@ status_t ExynosCameraBufferManager::m_defaultAlloc(int bIndex, int eIndex, bool
                 continue;
             }
 
-            if (m_defaultAllocator->alloc(
-                    m_buffer[bufIndex].size[planeIndex],
-                    &(m_buffer[bufIndex].fd[planeIndex]),
-                    &(m_buffer[bufIndex].addr[planeIndex]),
-                    mask,
-                    flags,
-                    mapNeeded) != NO_ERROR) {
+            if (m_allocPlane(bufIndex, planeIndex, mask, flags, mapNeeded, isMetaPlane) != NO_ERROR) {
 #if defined(RESERVED_MEMORY_ENABLE) && defined(RESERVED_MEMORY_REALLOC_WITH_ION)
                 if (m_buffer[bufIndex].type == EXYNOS_CAMERA_BUFFER_ION_RESERVED_TYPE) {
                     CLOGE("Realloc with ion:bufIndex(%d), m_reservedMemoryCount(%d),"
@@ -827,13 +832,7 @@ status_t ExynosCameraBufferManager::m_defaultAlloc(int bIndex, int eIndex, bool
                     goto func_exit;
                 }
 
-                if (m_defaultAllocator->alloc(
-                        m_buffer[bufIndex].size[planeIndex],
-                        &(m_buffer[bufIndex].fd[planeIndex]),
-                        &(m_buffer[bufIndex].addr[planeIndex]),
-                        mask,
-                        flags,
-                        mapNeeded) != NO_ERROR) {
+                if (m_allocPlane(bufIndex, planeIndex, mask, flags, mapNeeded, isMetaPlane) != NO_ERROR) {
                     CLOGE("m_defaultAllocator->alloc(bufIndex=%d, planeIndex=%d, size=%d) failed",
                         bufIndex, planeIndex, m_buffer[bufIndex].size[planeIndex]);
                     ret = INVALID_OPERATION;
@@ -928,6 +927,9 @@ status_t ExynosCameraBufferManager::m_defaultFree(int bIndex, int eIndex, bool i
     }
 
     for (int bufIndex = bIndex; bufIndex < eIndex; bufIndex++) {
+        /* a buffer forcedly freed can still be in use : not for the next one */
+        bool reuse = true;
+
         if (isAvaliable(bufIndex) == false) {
             CLOGE("buffer [bufIndex=%d] in InProcess state", bufIndex);
             if (m_isDestructor == false) {
@@ -935,6 +937,7 @@ status_t ExynosCameraBufferManager::m_defaultFree(int bIndex, int eIndex, bool i
                 continue;
             } else {
                 CLOGE("buffer [bufIndex=%d] in InProcess state, but try to forcedly free", bufIndex);
+                reuse = false;
             }
         }
 
@@ -947,6 +950,16 @@ status_t ExynosCameraBufferManager::m_defaultFree(int bIndex, int eIndex, bool i
         }
 
         for (int planeIndex = planeIndexStart; planeIndex < planeIndexEnd; planeIndex++) {
+            if (m_retentionPool != NULL
+                && m_retentionPool->release(
+                    m_buffer[bufIndex].fd[planeIndex],
+                    m_buffer[bufIndex].addr[planeIndex],
+                    reuse) == true) {
+                m_buffer[bufIndex].fd[planeIndex] = -1;
+                m_buffer[bufIndex].addr[planeIndex] = NULL;
+                continue;
+            }
+
             if (m_defaultAllocator->free(
                     m_buffer[bufIndex].size[planeIndex],
                     &(m_buffer[bufIndex].fd[planeIndex]),
@@ -980,6 +993,60 @@ func_exit:
     return ret;
 }
 
+status_t ExynosCameraBufferManager::m_allocPlane(int bufIndex, int planeIndex, int mask, int flags, bool mapNeeded, bool isMetaPlane)
+{
+    status_t ret = NO_ERROR;
+    bool retainable = (m_retentionPool != NULL
+                       && m_isRetainable(bufIndex, mask, flags, isMetaPlane) == true);
+
+    if (retainable == true
+        && m_retentionPool->adopt(
+            m_buffer[bufIndex].size[planeIndex],
+            mask,
+            flags,
+            mapNeeded,
+            &(m_buffer[bufIndex].fd[planeIndex]),
+            &(m_buffer[bufIndex].addr[planeIndex])) == NO_ERROR) {
+        return NO_ERROR;
+    }
+
+    ret = m_defaultAllocator->alloc(
+            m_buffer[bufIndex].size[planeIndex],
+            &(m_buffer[bufIndex].fd[planeIndex]),
+            &(m_buffer[bufIndex].addr[planeIndex]),
+            mask,
+            flags,
+            mapNeeded);
+    if (ret == NO_ERROR && retainable == true) {
+        m_retentionPool->track(
+            m_buffer[bufIndex].fd[planeIndex],
+            m_buffer[bufIndex].addr[planeIndex],
+            m_buffer[bufIndex].size[planeIndex],
+            mask,
+            flags,
+            mapNeeded);
+    }
+
+    return ret;
+}
+
+bool ExynosCameraBufferManager::m_isRetainable(int bufIndex, int mask, int flags, bool isMetaPlane)
+{
+    /* the meta plane is small, and its contents are expected from a clean buffer */
+    if (isMetaPlane == true)
+        return false;
+
+    /* the single fds of a batch buffer are closed when the container is made */
+    if (m_buffer[bufIndex].batchSize > 1)
+        return false;
+
+    /* reserved and secure heaps are not given back to the system */
+    if (mask != (int)EXYNOS_ION_HEAP_SYSTEM_MASK || (flags & ION_FLAG_PROTECTED) != 0)
+        return false;
+
+    return true;
+}
+
 bool ExynosCameraBufferManager::m_checkInfoForAlloc(void)
 {
     EXYNOS_CAMERA_BUFFER_IN();
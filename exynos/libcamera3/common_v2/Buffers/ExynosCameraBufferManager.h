@@ -48,6 +48,7 @@
 #include "ExynosCameraBuffer.h"
 #include "ExynosCameraMemory.h"
 #include "ExynosCameraThread.h"
+#include "ExynosCameraBufferRetentionPool.h"
 
 namespace android {
 
@@ -151,6 +152,9 @@ public:
     void             setContigBufCount(int reservedMemoryCount);
     int              getContigBufCount(void);
 
+    /* released planes go to pool, and new ones are taken from it first */
+    void             setRetentionPool(ExynosCameraBufferRetentionPool *pool);
+
     virtual status_t setInfo(buffer_manager_configuration_t info);
     virtual status_t alloc(void) = 0;
 
@@ -205,6 +209,8 @@ protected:
     status_t         m_setDefaultAllocator(void *allocator);
     virtual status_t m_defaultAlloc(int bIndex, int eIndex, bool isMetaPlane);
     virtual status_t m_defaultFree(int bIndex, int eIndex, bool isMetaPlane);
+    status_t         m_allocPlane(int bufIndex, int planeIndex, int mask, int flags, bool mapNeeded, bool isMetaPlane);
+    bool             m_isRetainable(int bufIndex, int mask, int flags, bool isMetaPlane);
     virtual bool     m_checkInfoForAlloc(void);
     status_t         m_createDefaultAllocator(bool isCached = false);
     int              m_getTotalPlaneCount(int planeCount, int batchSize, bool hasMetaPlane);
@@ -233,6 +239,7 @@ protected:
     /* using internal allocator (ION) for MetaData plane */
     ExynosCameraIonAllocator    *m_defaultAllocator;
     bool                        m_isCreateDefaultAllocator;
+    ExynosCameraBufferRetentionPool *m_retentionPool;
     struct ExynosCameraBuffer   m_buffer[VIDEO_MAX_FRAME];
     List<int>                   m_availableBufferIndexQ;
     mutable Mutex               m_availableBufferIndexQLock;
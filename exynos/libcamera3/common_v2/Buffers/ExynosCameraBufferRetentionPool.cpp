@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2020, Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* #define LOG_NDEBUG 0 */
+#define LOG_TAG "ExynosCameraBufferRetentionPool"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <utils/Log.h>
+
+#include "ExynosCameraBufferRetentionPool.h"
+
+namespace android {
+
+#define BUFFER_RETENTION_POOL_PAGE_SHIFT    (12)
+
+ExynosCameraBufferRetentionPool::ExynosCameraBufferRetentionPool()
+{
+    m_flagExit = false;
+
+    m_budget = (int64_t)BUFFER_RETENTION_POOL_BUDGET_MB * 1024 * 1024;
+    m_timeout = BUFFER_RETENTION_POOL_TIMEOUT;
+
+    m_retainedSize = 0;
+    m_peakRetainedSize = 0;
+
+    m_hitCount = 0;
+    m_missCount = 0;
+}
+
+ExynosCameraBufferRetentionPool::~ExynosCameraBufferRetentionPool()
+{
+    m_lock.lock();
+    m_flagExit = true;
+    m_trimCondition.broadcast();
+    m_lock.unlock();
+
+    if (m_trimThread != NULL) {
+        m_trimThread->requestExitAndWait();
+        m_trimThread.clear();
+    }
+
+    flush();
+}
+
+status_t ExynosCameraBufferRetentionPool::adopt(int size, int mask, int flags, bool mapNeeded, int *fd, char **addr)
+{
+    retained_list_t victims;
+    int sizeClass = getSizeClass(size);
+    retained_list_t::iterator best;
+
+    m_lock.lock();
+
+    best = m_retainedList.end();
+
+    for (retained_list_t::iterator it = m_retainedList.begin(); it != m_retainedList.end(); it++) {
+        if (it->mask != mask || it->flags != flags || it->mapNeeded != mapNeeded)
+            continue;
+
+        if (it->size < size || getSizeClass(it->size) != sizeClass)
+            continue;
+
+        /* the smallest one, and the most recently released of them */
+        if (best == m_retainedList.end() || it->size <= best->size)
+            best = it;
+    }
+
+    if (best == m_retainedList.end()) {
+        /*
+         * The caller allocates instead : give back as much first,
+         * so retained and used planes do not take more than without the pool.
+         */
+        m_collectOverBudget(m_budget - m_retainedSize + size, &victims);
+        m_missCount++;
+        m_lock.unlock();
+
+        m_free(&victims);
+
+        return NAME_NOT_FOUND;
+    }
+
+    *fd = best->fd;
+    *addr = best->addr;
+
+    m_retainedSize -= best->size;
+    m_trackedMap[best->fd] = *best;
+    m_retainedList.erase(best);
+    m_hitCount++;
+
+    m_lock.unlock();
+
+    return NO_ERROR;
+}
+
+void ExynosCameraBufferRetentionPool::track(int fd, char *addr, int size, int mask, int flags, bool mapNeeded)
+{
+    Mutex::Autolock lock(m_lock);
+    struct retained_allocation allocation;
+
+    if (fd < 0 || size <= 0)
+        return;
+
+    if (m_trackedMap.find(fd) != m_trackedMap.end())
+        ALOGW("WARN(%s[%d]):fd(%d) is tracked already, it was closed out of the pool",
+                __FUNCTION__, __LINE__, fd);
+
+    allocation.fd = fd;
+    allocation.addr = addr;
+    allocation.size = size;
+    allocation.mask = mask;
+    allocation.flags = flags;
+    allocation.mapNeeded = mapNeeded;
+    allocation.releaseTime = 0;
+
+    m_trackedMap[fd] = allocation;
+}
+
+bool ExynosCameraBufferRetentionPool::release(int fd, char *addr, bool reuse)
+{
+    retained_list_t victims;
+    std::map<int, struct retained_allocation>::iterator it;
+    struct retained_allocation allocation;
+
+    m_lock.lock();
+
+    it = m_trackedMap.find(fd);
+    if (it == m_trackedMap.end()) {
+        m_lock.unlock();
+        return false;
+    }
+
+    allocation = it->second;
+    m_trackedMap.erase(it);
+
+    if (allocation.addr != addr)
+        ALOGW("WARN(%s[%d]):fd(%d) addr(%p) is released with addr(%p)",
+                __FUNCTION__, __LINE__, fd, allocation.addr, addr);
+
+    if (reuse == false
+        || allocation.size > m_budget
+        || (allocation.mapNeeded == true && allocation.addr == NULL)) {
+        victims.push_back(allocation);
+    } else {
+        m_collectOverBudget(allocation.size, &victims);
+
+        allocation.releaseTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        m_retainedList.push_back(allocation);
+        m_retainedSize += allocation.size;
+        if (m_peakRetainedSize < m_retainedSize)
+            m_peakRetainedSize = m_retainedSize;
+
+        m_startTrimThread();
+        m_trimCondition.signal();
+    }
+
+    m_lock.unlock();
+
+    m_free(&victims);
+
+    return true;
+}
+
+void ExynosCameraBufferRetentionPool::trim(void)
+{
+    retained_list_t victims;
+
+    m_lock.lock();
+    m_collectExpired(systemTime(SYSTEM_TIME_MONOTONIC), &victims);
+    m_lock.unlock();
+
+    m_free(&victims);
+}
+
+void ExynosCameraBufferRetentionPool::flush(void)
+{
+    retained_list_t victims;
+
+    m_lock.lock();
+    victims.swap(m_retainedList);
+    m_retainedSize = 0;
+    m_lock.unlock();
+
+    m_free(&victims);
+}
+
+void ExynosCameraBufferRetentionPool::setBudget(int64_t budget)
+{
+    retained_list_t victims;
+
+    m_lock.lock();
+    m_budget = (budget < 0) ? 0 : budget;
+    m_collectOverBudget(0, &victims);
+    m_lock.unlock();
+
+    m_free(&victims);
+}
+
+int64_t ExynosCameraBufferRetentionPool::getBudget(void)
+{
+    Mutex::Autolock lock(m_lock);
+
+    return m_budget;
+}
+
+void ExynosCameraBufferRetentionPool::setTimeout(nsecs_t timeout)
+{
+    Mutex::Autolock lock(m_lock);
+
+    m_timeout = timeout;
+    m_trimCondition.signal();
+}
+
+int64_t ExynosCameraBufferRetentionPool::getRetainedSize(void)
+{
+    Mutex::Autolock lock(m_lock);
+
+    return m_retainedSize;
+}
+
+int ExynosCameraBufferRetentionPool::getRetainedCount(void)
+{
+    Mutex::Autolock lock(m_lock);
+
+    return (int)m_retainedList.size();
+}
+
+int64_t ExynosCameraBufferRetentionPool::getPeakRetainedSize(void)
+{
+    Mutex::Autolock lock(m_lock);
+
+    return m_peakRetainedSize;
+}
+
+int ExynosCameraBufferRetentionPool::getHitCount(void)
+{
+    Mutex::Autolock lock(m_lock);
+
+    return m_hitCount;
+}
+
+int ExynosCameraBufferRetentionPool::getMissCount(void)
+{
+    Mutex::Autolock lock(m_lock);
+
+    return m_missCount;
+}
+
+void ExynosCameraBufferRetentionPool::dump(void)
+{
+    Mutex::Autolock lock(m_lock);
+
+    ALOGD("DEBUG(%s[%d]):retained(%d, %lld KB) peak(%lld KB) budget(%lld KB) tracked(%d) hit(%d) miss(%d)",
+            __FUNCTION__, __LINE__,
+            (int)m_retainedList.size(), (long long)(m_retainedSize / 1024),
+            (long long)(m_peakRetainedSize / 1024), (long long)(m_budget / 1024),
+            (int)m_trackedMap.size(), m_hitCount, m_missCount);
+}
+
+int ExynosCameraBufferRetentionPool::getSizeClass(int size)
+{
+    int pages = (size + (1 << BUFFER_RETENTION_POOL_PAGE_SHIFT) - 1) >> BUFFER_RETENTION_POOL_PAGE_SHIFT;
+    int msb = 0;
+    int shift = 0;
+
+    if (pages < BUFFER_RETENTION_POOL_CLASS_STEP)
+        return pages;
+
+    for (msb = 0; (pages >> (msb + 1)) != 0; msb++)
+        ;
+
+    /* BUFFER_RETENTION_POOL_CLASS_STEP classes from 2^msb to 2^(msb + 1) pages */
+    shift = msb - 3;
+
+    return ((pages + (1 << shift) - 1) >> shift) << shift;
+}
+
+bool ExynosCameraBufferRetentionPool::m_trimThreadFunc(void)
+{
+    retained_list_t victims;
+    nsecs_t now = 0;
+    nsecs_t expireTime = 0;
+
+    m_lock.lock();
+
+    if (m_flagExit == true) {
+        m_lock.unlock();
+        return false;
+    }
+
+    if (m_retainedList.empty() == true) {
+        m_trimCondition.wait(m_lock);
+    } else {
+        now = systemTime(SYSTEM_TIME_MONOTONIC);
+        expireTime = m_retainedList.front().releaseTime + m_timeout;
+        if (now < expireTime)
+            m_trimCondition.waitRelative(m_lock, expireTime - now);
+
+        m_collectExpired(systemTime(SYSTEM_TIME_MONOTONIC), &victims);
+    }
+
+    m_lock.unlock();
+
+    m_free(&victims);
+
+    return true;
+}
+
+void ExynosCameraBufferRetentionPool::m_collectExpired(nsecs_t now, retained_list_t *victims)
+{
+    while (m_retainedList.empty() == false
+           && m_retainedList.front().releaseTime + m_timeout <= now) {
+        m_retainedSize -= m_retainedList.front().size;
+        victims->splice(victims->end(), m_retainedList, m_retainedList.begin());
+    }
+}
+
+void ExynosCameraBufferRetentionPool::m_collectOverBudget(int64_t incoming, retained_list_t *victims)
+{
+    while (m_retainedList.empty() == false
+           && m_retainedSize + incoming > m_budget) {
+        m_retainedSize -= m_retainedList.front().size;
+        victims->splice(victims->end(), m_retainedList, m_retainedList.begin());
+    }
+}
+
+void ExynosCameraBufferRetentionPool::m_free(retained_list_t *victims)
+{
+    for (retained_list_t::iterator it = victims->begin(); it != victims->end(); it++)
+        m_free(&(*it));
+
+    victims->clear();
+}
+
+void ExynosCameraBufferRetentionPool::m_free(struct retained_allocation *allocation)
+{
+    /* as ExynosCameraIonAllocator::free(), with the allocated size */
+    if (allocation->mapNeeded == true && allocation->addr != NULL) {
+        if (munmap(allocation->addr, allocation->size) < 0)
+            ALOGE("ERR(%s[%d]):munmap(fd %d, size %d) fail, errno(%d)",
+                    __FUNCTION__, __LINE__, allocation->fd, allocation->size, errno);
+    }
+
+    close(allocation->fd);
+
+    allocation->fd = -1;
+    allocation->addr = NULL;
+}
+
+void ExynosCameraBufferRetentionPool::m_startTrimThread(void)
+{
+    if (m_trimThread != NULL)
+        return;
+
+    m_trimThread = new RetentionPoolThread(this,
+            &ExynosCameraBufferRetentionPool::m_trimThreadFunc, "retentionPoolTrimThread");
+    m_trimThread->run();
+}
+
+}; /* namespace android */
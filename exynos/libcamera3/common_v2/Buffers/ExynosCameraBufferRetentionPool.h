@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2020, Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EXYNOS_CAMERA_BUFFER_RETENTION_POOL_H
+#define EXYNOS_CAMERA_BUFFER_RETENTION_POOL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <list>
+#include <map>
+
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+#include "ExynosCameraSingleton.h"
+#include "ExynosCameraThread.h"
+
+namespace android {
+
+#ifndef BUFFER_RETENTION_POOL_BUDGET_MB
+#define BUFFER_RETENTION_POOL_BUDGET_MB     (192)
+#endif
+/* a released allocation is freed when it is not taken in this time */
+#ifndef BUFFER_RETENTION_POOL_TIMEOUT
+#define BUFFER_RETENTION_POOL_TIMEOUT       (3000000000LL) /* 3sec */
+#endif
+/* size classes between two powers of 2 */
+#define BUFFER_RETENTION_POOL_CLASS_STEP    (8)
+
+/*
+ * Allocations released by the internal buffer managers, kept for the next ones.
+ *
+ * configureStreams() and releaseDevice() deinit every internal buffer manager,
+ * and the next configuration allocates nearly the same planes again.
+ * A plane the manager frees goes to the pool instead, up to the budget,
+ * and is freed when it was not taken in BUFFER_RETENTION_POOL_TIMEOUT.
+ *
+ * An allocation is keyed by its size class, ion heap mask, ion flags and
+ * mapping. A request takes the smallest retained allocation of its key
+ * that is not smaller than the request : at most 1/8 larger.
+ * When there is none, the oldest ones are freed for the new allocation,
+ * so the pool does not raise the peak of a reconfiguration it cannot serve.
+ *
+ * The pool only knows the fds it handed out or was told about with track(),
+ * and it frees them with the size they were allocated with.
+ * One pool is shared by the cameras of the process.
+ */
+class ExynosCameraBufferRetentionPool : public ExynosCameraSingleton<ExynosCameraBufferRetentionPool> {
+protected:
+    friend class ExynosCameraSingleton<ExynosCameraBufferRetentionPool>;
+
+    ExynosCameraBufferRetentionPool();
+    virtual ~ExynosCameraBufferRetentionPool();
+
+public:
+    /* NO_ERROR with fd and addr of a retained allocation, NAME_NOT_FOUND if none */
+    status_t        adopt(int size, int mask, int flags, bool mapNeeded, int *fd, char **addr);
+    /* fd is a fresh allocation : it can be retained when it is released */
+    void            track(int fd, char *addr, int size, int mask, int flags, bool mapNeeded);
+    /*
+     * Return false if fd is not known : the caller frees it.
+     * Otherwise the pool owns fd, retained if reuse is true and it fits in the budget.
+     */
+    bool            release(int fd, char *addr, bool reuse);
+
+    /* free the allocations retained longer than the timeout */
+    void            trim(void);
+    /* free all retained allocations */
+    void            flush(void);
+
+    void            setBudget(int64_t budget);
+    int64_t         getBudget(void);
+    void            setTimeout(nsecs_t timeout);
+
+    int64_t         getRetainedSize(void);
+    int             getRetainedCount(void);
+    int64_t         getPeakRetainedSize(void);
+    /* adopt() calls served from the pool, and left to the caller to allocate */
+    int             getHitCount(void);
+    int             getMissCount(void);
+    void            dump(void);
+
+    static int      getSizeClass(int size);
+
+private:
+    struct retained_allocation {
+        int         fd;
+        char        *addr;
+        int         size;
+        int         mask;
+        int         flags;
+        bool        mapNeeded;
+        nsecs_t     releaseTime;
+    };
+
+    typedef std::list<struct retained_allocation>   retained_list_t;
+
+    bool            m_trimThreadFunc(void);
+
+    /* m_lock is held. oldest first */
+    void            m_collectExpired(nsecs_t now, retained_list_t *victims);
+    void            m_collectOverBudget(int64_t incoming, retained_list_t *victims);
+    void            m_free(retained_list_t *victims);
+    void            m_free(struct retained_allocation *allocation);
+    void            m_startTrimThread(void);
+
+private:
+    typedef ExynosCameraThread<ExynosCameraBufferRetentionPool> RetentionPoolThread;
+
+    Mutex                                       m_lock;
+    Condition                                   m_trimCondition;
+    sp<RetentionPoolThread>                     m_trimThread;
+    bool                                        m_flagExit;
+
+    int64_t                                     m_budget;
+    nsecs_t                                     m_timeout;
+
+    /* released, in release order */
+    retained_list_t                             m_retainedList;
+    int64_t                                     m_retainedSize;
+    int64_t                                     m_peakRetainedSize;
+    /* handed out or tracked, by fd */
+    std::map<int, struct retained_allocation>   m_trackedMap;
+
+    int                                         m_hitCount;
+    int                                         m_missCount;
+};
+
+}; /* namespace android */
+
+#endif
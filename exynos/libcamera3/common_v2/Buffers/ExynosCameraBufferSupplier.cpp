@@ -69,6 +69,10 @@ status_t ExynosCameraBufferSupplier::createBufferManager(const char *name,
     case BUFFER_MANAGER_ION_TYPE:
     case BUFFER_MANAGER_FASTEN_AE_ION_TYPE:
         newBufferMgr = (ExynosCameraBufferManager *)new InternalExynosCameraBufferManager();
+#ifdef USE_BUFFER_RETENTION_POOL
+        /* take the planes released by the last configuration */
+        newBufferMgr->setRetentionPool(ExynosCameraBufferRetentionPool::getInstance());
+#endif
         break;
     case BUFFER_MANAGER_SERVICE_GRALLOC_TYPE:
         newBufferMgr = (ExynosCameraBufferManager *)new ServiceExynosCameraBufferManager(actualFormat);
@@ -131,6 +131,61 @@ private:
     char         *m_logStr;
 };
 
+#define PHASE_TIMER_MAX_PHASE   (16)
+
+/*
+ * Durations of the consecutive phases of one operation (ex. flush, close),
+ * to be reported in one log line.
+ */
+class ExynosCameraPhaseTimer {
+public:
+    ExynosCameraPhaseTimer()
+    {
+        m_numOfPhase = 0;
+        m_startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        m_lapTime = m_startTime;
+    }
+    ~ExynosCameraPhaseTimer() {}
+
+    /* the phase ends now, and the next one starts */
+    void lap(const char *phase)
+    {
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        if (m_numOfPhase < PHASE_TIMER_MAX_PHASE) {
+            m_phase[m_numOfPhase] = phase;
+            m_duration[m_numOfPhase] = now - m_lapTime;
+            m_numOfPhase++;
+        }
+
+        m_lapTime = now;
+    }
+
+    uint64_t durationUsecs() const
+    {
+        return ns2us(m_lapTime - m_startTime);
+    }
+
+    /* " phase(usec)" of each phase into str */
+    void getPhaseString(char *str, int size) const
+    {
+        int len = 0;
+
+        str[0] = '\0';
+        for (int i = 0; i < m_numOfPhase && len < size; i++) {
+            len += snprintf(str + len, size - len, " %s(%d)",
+                            m_phase[i], (int)ns2us(m_duration[i]));
+        }
+    }
+
+private:
+    int          m_numOfPhase;
+    const char  *m_phase[PHASE_TIMER_MAX_PHASE];
+    nsecs_t      m_duration[PHASE_TIMER_MAX_PHASE];
+    nsecs_t      m_startTime;
+    nsecs_t      m_lapTime;
+};
+
 }; /* namespace android */
 
 #endif /* EXYNOS_CAMERA_AUTO_TIMER_H */
@@ -152,6 +152,14 @@ status_t ExynosCameraFrameFactoryBase::destroy(void)
         }
     }
 
+#ifdef USE_NODE_COMPLETION_DISPATCHER
+    /* the pipes left it in destroy() */
+    if (m_nodeDispatcher != NULL) {
+        m_nodeDispatcher->destroy();
+        SAFE_DELETE(m_nodeDispatcher);
+    }
+#endif
+
     ret = m_transitState(FRAME_FACTORY_STATE_NONE);
 
     return ret;
@@ -223,6 +231,21 @@ status_t ExynosCameraFrameFactoryBase::startThread(uint32_t pipeId)
 
     CLOGI("pipeId=%d", pipeId);
 
+#ifdef USE_NODE_COMPLETION_DISPATCHER
+    /* the reprocessing pipes are run by their request frame queue */
+    if (m_nodeDispatcher == NULL && m_flagReprocessing == false) {
+        m_nodeDispatcher = new ExynosCameraNodeDispatcher(m_name);
+        if (m_nodeDispatcher->create() != NO_ERROR) {
+            CLOGE("node dispatcher create fail, pipes run their own thread");
+            SAFE_DELETE(m_nodeDispatcher);
+        }
+    }
+
+    /* INVALID_OPERATION : the pipe keeps its get thread */
+    if (m_nodeDispatcher != NULL)
+        m_pipes[INDEX(pipeId)]->setNodeDispatcher(m_nodeDispatcher);
+#endif
+
     ret = m_pipes[INDEX(pipeId)]->startThread();
     if (ret != NO_ERROR) {
         CLOGE("start thread fail, pipeId(%d), ret(%d)", pipeId, ret);
@@ -755,6 +778,9 @@ void ExynosCameraFrameFactoryBase::m_init(void)
         m_pipes[i] = NULL;
         m_request[i] = false;
     }
+#ifdef USE_NODE_COMPLETION_DISPATCHER
+    m_nodeDispatcher = NULL;
+#endif
 
     m_frameMgr = NULL;
     m_frameCreateHandler = NULL;
@@ -195,6 +195,10 @@ protected:
     camera_device_info_t        m_deviceInfo[MAX_NUM_PIPES];
 
     ExynosCameraPipe           *m_pipes[MAX_NUM_PIPES];
+#ifdef USE_NODE_COMPLETION_DISPATCHER
+    /* runs the get side of the pipes which support it, instead of their get thread */
+    ExynosCameraNodeDispatcher *m_nodeDispatcher;
+#endif
     ExynosCameraConfigurations *m_configurations;
     ExynosCameraParameters     *m_parameters;
     ExynosCameraFrameManager   *m_frameMgr;
@@ -0,0 +1,512 @@
+/*
+ * Copyright (C) 2020, Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* #define LOG_NDEBUG 0 */
+#define LOG_TAG "ExynosCameraNodeDispatcher"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <utils/Log.h>
+
+#include "ExynosCameraNodeDispatcher.h"
+
+namespace android {
+
+/* epoll data of the eventfd, the nodes carry generation << 32 | index */
+#define NODE_DISPATCHER_WAKEUP_DATA     (0xFFFFFFFFFFFFFFFFULL)
+
+ExynosCameraNodeDispatcher::ExynosCameraNodeDispatcher(const char *name, int workerNum)
+{
+    memset(m_name, 0x00, sizeof(m_name));
+    if (name != NULL)
+        strncpy(m_name, name, sizeof(m_name) - 1);
+
+    m_epollFd = -1;
+    m_eventFd = -1;
+
+    if (workerNum < 1)
+        workerNum = 1;
+    else if (NODE_DISPATCHER_MAX_WORKER < workerNum)
+        workerNum = NODE_DISPATCHER_MAX_WORKER;
+    m_workerNum = workerNum;
+
+    for (int i = 0; i < NODE_DISPATCHER_MAX_NODE; i++) {
+        m_entry[i].fd = -1;
+        m_entry[i].handler = NULL;
+        m_entry[i].state = NODE_ENTRY_STATE_FREE;
+        m_entry[i].generation = 0;
+        m_entry[i].events = 0;
+        m_entry[i].flagPendingArm = false;
+        m_entry[i].flagRemoved = false;
+        m_entry[i].runningTid = 0;
+        m_workQ[i] = -1;
+    }
+
+    m_nodeCount = 0;
+    m_generation = 0;
+    m_flagExit = false;
+    m_workQHead = 0;
+    m_workQSize = 0;
+}
+
+ExynosCameraNodeDispatcher::~ExynosCameraNodeDispatcher()
+{
+    destroy();
+}
+
+status_t ExynosCameraNodeDispatcher::create(void)
+{
+    struct epoll_event event;
+
+    if (m_epollFd >= 0) {
+        ALOGW("WARN(%s[%d]):[%s] already created", __FUNCTION__, __LINE__, m_name);
+        return NO_ERROR;
+    }
+
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollFd < 0) {
+        ALOGE("ERR(%s[%d]):[%s] epoll_create1 fail, errno(%d)", __FUNCTION__, __LINE__, m_name, errno);
+        return INVALID_OPERATION;
+    }
+
+    m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_eventFd < 0) {
+        ALOGE("ERR(%s[%d]):[%s] eventfd fail, errno(%d)", __FUNCTION__, __LINE__, m_name, errno);
+        goto err;
+    }
+
+    memset(&event, 0x00, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = NODE_DISPATCHER_WAKEUP_DATA;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_eventFd, &event) < 0) {
+        ALOGE("ERR(%s[%d]):[%s] add eventfd fail, errno(%d)", __FUNCTION__, __LINE__, m_name, errno);
+        goto err;
+    }
+
+    m_flagExit = false;
+
+    m_dispatchThread = new NodeDispatcherThread(this,
+            &ExynosCameraNodeDispatcher::m_dispatchThreadFunc, "nodeDispatchThread", PRIORITY_URGENT_DISPLAY);
+    m_dispatchThread->run(PRIORITY_URGENT_DISPLAY);
+
+    for (int i = 0; i < m_workerNum; i++) {
+        m_workerThread[i] = new NodeDispatcherThread(this,
+                &ExynosCameraNodeDispatcher::m_workerThreadFunc, "nodeWorkerThread", PRIORITY_URGENT_DISPLAY);
+        m_workerThread[i]->run(PRIORITY_URGENT_DISPLAY);
+    }
+
+    ALOGD("DEBUG(%s[%d]):[%s] created, worker(%d)", __FUNCTION__, __LINE__, m_name, m_workerNum);
+
+    return NO_ERROR;
+
+err:
+    if (m_eventFd >= 0) {
+        close(m_eventFd);
+        m_eventFd = -1;
+    }
+
+    close(m_epollFd);
+    m_epollFd = -1;
+
+    return INVALID_OPERATION;
+}
+
+status_t ExynosCameraNodeDispatcher::destroy(void)
+{
+    if (m_epollFd < 0)
+        return NO_ERROR;
+
+    m_lock.lock();
+    m_flagExit = true;
+    m_workCondition.broadcast();
+    if (m_nodeCount > 0)
+        ALOGW("WARN(%s[%d]):[%s] %d node(s) still registered", __FUNCTION__, __LINE__, m_name, m_nodeCount);
+    m_lock.unlock();
+
+    m_wakeupDispatchThread();
+
+    if (m_dispatchThread != NULL) {
+        m_dispatchThread->requestExitAndWait();
+        m_dispatchThread = NULL;
+    }
+
+    for (int i = 0; i < m_workerNum; i++) {
+        if (m_workerThread[i] != NULL) {
+            m_workerThread[i]->requestExitAndWait();
+            m_workerThread[i] = NULL;
+        }
+    }
+
+    m_lock.lock();
+    for (int i = 0; i < NODE_DISPATCHER_MAX_NODE; i++) {
+        if (m_entry[i].state != NODE_ENTRY_STATE_FREE)
+            m_releaseEntry(i);
+    }
+    m_workQHead = 0;
+    m_workQSize = 0;
+    m_lock.unlock();
+
+    close(m_eventFd);
+    m_eventFd = -1;
+    close(m_epollFd);
+    m_epollFd = -1;
+
+    return NO_ERROR;
+}
+
+status_t ExynosCameraNodeDispatcher::registerNode(int fd, ExynosCameraNodeHandlerBase *handler)
+{
+    Mutex::Autolock lock(m_lock);
+    struct epoll_event event;
+    int index = -1;
+
+    if (fd < 0 || handler == NULL) {
+        ALOGE("ERR(%s[%d]):[%s] invalid fd(%d) or handler(%p)", __FUNCTION__, __LINE__, m_name, fd, handler);
+        return BAD_VALUE;
+    }
+
+    if (m_epollFd < 0 || m_flagExit == true) {
+        ALOGE("ERR(%s[%d]):[%s] not created", __FUNCTION__, __LINE__, m_name);
+        return INVALID_OPERATION;
+    }
+
+    if (m_findEntry(fd) >= 0) {
+        ALOGE("ERR(%s[%d]):[%s] fd(%d) already registered", __FUNCTION__, __LINE__, m_name, fd);
+        return ALREADY_EXISTS;
+    }
+
+    for (int i = 0; i < NODE_DISPATCHER_MAX_NODE; i++) {
+        if (m_entry[i].state == NODE_ENTRY_STATE_FREE) {
+            index = i;
+            break;
+        }
+    }
+
+    if (index < 0) {
+        ALOGE("ERR(%s[%d]):[%s] no free entry for fd(%d)", __FUNCTION__, __LINE__, m_name, fd);
+        return NO_MEMORY;
+    }
+
+    m_entry[index].fd = fd;
+    m_entry[index].handler = handler;
+    m_entry[index].generation = ++m_generation;
+    m_entry[index].events = 0;
+    m_entry[index].flagPendingArm = false;
+    m_entry[index].flagRemoved = false;
+    m_entry[index].runningTid = 0;
+
+    memset(&event, 0x00, sizeof(event));
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.u64 = ((uint64_t)m_entry[index].generation << 32) | (uint32_t)index;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        ALOGE("ERR(%s[%d]):[%s] add fd(%d) fail, errno(%d)", __FUNCTION__, __LINE__, m_name, fd, errno);
+        m_entry[index].fd = -1;
+        m_entry[index].handler = NULL;
+        return INVALID_OPERATION;
+    }
+
+    m_entry[index].state = NODE_ENTRY_STATE_ARMED;
+    m_nodeCount++;
+
+    ALOGV("DEBUG(%s[%d]):[%s] fd(%d) registered, nodeCount(%d)", __FUNCTION__, __LINE__, m_name, fd, m_nodeCount);
+
+    return NO_ERROR;
+}
+
+status_t ExynosCameraNodeDispatcher::unregisterNode(int fd, nsecs_t timeout)
+{
+    Mutex::Autolock lock(m_lock);
+    int index = m_findEntry(fd);
+
+    if (index < 0) {
+        /* unregistered already, but the handler did not return in time */
+        for (int i = 0; i < NODE_DISPATCHER_MAX_NODE; i++) {
+            if (m_entry[i].flagRemoved == true && m_entry[i].fd == fd)
+                return m_waitHandlerDone(i, timeout);
+        }
+
+        return NAME_NOT_FOUND;
+    }
+
+    /* the fd can be closed already, it left the set by itself then */
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, NULL) < 0 && errno != EBADF && errno != ENOENT)
+        ALOGW("WARN(%s[%d]):[%s] del fd(%d) fail, errno(%d)", __FUNCTION__, __LINE__, m_name, fd, errno);
+
+    switch (m_entry[index].state) {
+    case NODE_ENTRY_STATE_QUEUED:
+        for (int i = 0; i < m_workQSize; i++) {
+            int pos = (m_workQHead + i) % NODE_DISPATCHER_MAX_NODE;
+            if (m_workQ[pos] != index)
+                continue;
+
+            /* close the gap : the order of the others is kept */
+            for (int j = i; j < m_workQSize - 1; j++) {
+                m_workQ[(m_workQHead + j) % NODE_DISPATCHER_MAX_NODE] =
+                    m_workQ[(m_workQHead + j + 1) % NODE_DISPATCHER_MAX_NODE];
+            }
+            m_workQSize--;
+            break;
+        }
+        m_releaseEntry(index);
+        break;
+    case NODE_ENTRY_STATE_RUNNING:
+        m_entry[index].flagRemoved = true;
+
+        /* from its own handler : the worker releases it on return */
+        if (m_entry[index].runningTid == gettid())
+            break;
+
+        if (m_waitHandlerDone(index, timeout) != NO_ERROR)
+            return TIMED_OUT;
+        break;
+    default:
+        m_releaseEntry(index);
+        break;
+    }
+
+    ALOGV("DEBUG(%s[%d]):[%s] fd(%d) unregistered, nodeCount(%d)", __FUNCTION__, __LINE__, m_name, fd, m_nodeCount);
+
+    return NO_ERROR;
+}
+
+status_t ExynosCameraNodeDispatcher::armNode(int fd)
+{
+    Mutex::Autolock lock(m_lock);
+    int index = m_findEntry(fd);
+
+    if (index < 0)
+        return NAME_NOT_FOUND;
+
+    switch (m_entry[index].state) {
+    case NODE_ENTRY_STATE_PARKED:
+        return m_arm(index);
+    case NODE_ENTRY_STATE_QUEUED:
+    case NODE_ENTRY_STATE_RUNNING:
+        /* the handler may have decided to park already : arm it on return */
+        m_entry[index].flagPendingArm = true;
+        break;
+    default:
+        break;
+    }
+
+    return NO_ERROR;
+}
+
+bool ExynosCameraNodeDispatcher::isRegistered(int fd)
+{
+    Mutex::Autolock lock(m_lock);
+
+    return (m_findEntry(fd) >= 0);
+}
+
+int ExynosCameraNodeDispatcher::getNodeCount(void)
+{
+    Mutex::Autolock lock(m_lock);
+
+    return m_nodeCount;
+}
+
+int ExynosCameraNodeDispatcher::getWorkerNum(void)
+{
+    return m_workerNum;
+}
+
+bool ExynosCameraNodeDispatcher::m_dispatchThreadFunc(void)
+{
+    struct epoll_event events[NODE_DISPATCHER_BATCH_SIZE];
+    int eventNum;
+    int queueNum = 0;
+
+    eventNum = epoll_wait(m_epollFd, events, NODE_DISPATCHER_BATCH_SIZE, -1);
+    if (eventNum < 0) {
+        if (errno == EINTR)
+            return true;
+
+        ALOGE("ERR(%s[%d]):[%s] epoll_wait fail, errno(%d)", __FUNCTION__, __LINE__, m_name, errno);
+        return false;
+    }
+
+    Mutex::Autolock lock(m_lock);
+
+    if (m_flagExit == true)
+        return false;
+
+    for (int i = 0; i < eventNum; i++) {
+        uint64_t data = events[i].data.u64;
+
+        if (data == NODE_DISPATCHER_WAKEUP_DATA) {
+            uint64_t count;
+            if (read(m_eventFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                ALOGW("WARN(%s[%d]):[%s] read eventfd fail, errno(%d)", __FUNCTION__, __LINE__, m_name, errno);
+            continue;
+        }
+
+        uint32_t index = (uint32_t)(data & 0xFFFFFFFF);
+        uint32_t generation = (uint32_t)(data >> 32);
+
+        /* an event taken before the fd was unregistered */
+        if (NODE_DISPATCHER_MAX_NODE <= index
+            || m_entry[index].generation != generation
+            || m_entry[index].state != NODE_ENTRY_STATE_ARMED)
+            continue;
+
+        m_entry[index].state = NODE_ENTRY_STATE_QUEUED;
+        m_entry[index].events = events[i].events;
+        m_workQ[(m_workQHead + m_workQSize) % NODE_DISPATCHER_MAX_NODE] = index;
+        m_workQSize++;
+        queueNum++;
+    }
+
+    if (queueNum == 1)
+        m_workCondition.signal();
+    else if (queueNum > 1)
+        m_workCondition.broadcast();
+
+    return true;
+}
+
+bool ExynosCameraNodeDispatcher::m_workerThreadFunc(void)
+{
+    ExynosCameraNodeHandlerBase *handler = NULL;
+    uint32_t events = 0;
+    int index = -1;
+    bool flagArm = false;
+
+    m_lock.lock();
+
+    while (m_workQSize == 0 && m_flagExit == false)
+        m_workCondition.wait(m_lock);
+
+    if (m_flagExit == true) {
+        m_lock.unlock();
+        return false;
+    }
+
+    index = m_workQ[m_workQHead];
+    m_workQHead = (m_workQHead + 1) % NODE_DISPATCHER_MAX_NODE;
+    m_workQSize--;
+
+    m_entry[index].state = NODE_ENTRY_STATE_RUNNING;
+    m_entry[index].runningTid = gettid();
+    m_entry[index].flagPendingArm = false;
+    handler = m_entry[index].handler;
+    events = m_entry[index].events;
+
+    m_lock.unlock();
+
+    flagArm = handler->handle(events);
+
+    m_lock.lock();
+
+    m_entry[index].runningTid = 0;
+
+    if (m_entry[index].flagRemoved == true) {
+        m_releaseEntry(index);
+        m_handlerDoneCondition.broadcast();
+    } else if (flagArm == true || m_entry[index].flagPendingArm == true) {
+        m_arm(index);
+    } else {
+        m_entry[index].state = NODE_ENTRY_STATE_PARKED;
+    }
+
+    m_lock.unlock();
+
+    return true;
+}
+
+int ExynosCameraNodeDispatcher::m_findEntry(int fd)
+{
+    for (int i = 0; i < NODE_DISPATCHER_MAX_NODE; i++) {
+        if (m_entry[i].state != NODE_ENTRY_STATE_FREE
+            && m_entry[i].flagRemoved == false
+            && m_entry[i].fd == fd)
+            return i;
+    }
+
+    return -1;
+}
+
+status_t ExynosCameraNodeDispatcher::m_arm(int index)
+{
+    struct epoll_event event;
+
+    memset(&event, 0x00, sizeof(event));
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.u64 = ((uint64_t)m_entry[index].generation << 32) | (uint32_t)index;
+
+    m_entry[index].flagPendingArm = false;
+
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_MOD, m_entry[index].fd, &event) < 0) {
+        ALOGE("ERR(%s[%d]):[%s] arm fd(%d) fail, errno(%d)",
+                __FUNCTION__, __LINE__, m_name, m_entry[index].fd, errno);
+        m_entry[index].state = NODE_ENTRY_STATE_PARKED;
+        return INVALID_OPERATION;
+    }
+
+    m_entry[index].state = NODE_ENTRY_STATE_ARMED;
+
+    return NO_ERROR;
+}
+
+status_t ExynosCameraNodeDispatcher::m_waitHandlerDone(int index, nsecs_t timeout)
+{
+    int fd = m_entry[index].fd;
+    uint32_t generation = m_entry[index].generation;
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t remainTime = timeout;
+
+    while (m_entry[index].state != NODE_ENTRY_STATE_FREE
+           && m_entry[index].generation == generation) {
+        if (remainTime <= 0) {
+            ALOGE("ERR(%s[%d]):[%s] fd(%d) handler is not done in %d msec",
+                    __FUNCTION__, __LINE__, m_name, fd, (int)ns2ms(timeout));
+            return TIMED_OUT;
+        }
+
+        m_handlerDoneCondition.waitRelative(m_lock, remainTime);
+        remainTime = timeout - (systemTime(SYSTEM_TIME_MONOTONIC) - startTime);
+    }
+
+    return NO_ERROR;
+}
+
+void ExynosCameraNodeDispatcher::m_releaseEntry(int index)
+{
+    m_entry[index].fd = -1;
+    m_entry[index].handler = NULL;
+    m_entry[index].state = NODE_ENTRY_STATE_FREE;
+    m_entry[index].events = 0;
+    m_entry[index].flagPendingArm = false;
+    m_entry[index].flagRemoved = false;
+    m_entry[index].runningTid = 0;
+
+    m_nodeCount--;
+}
+
+void ExynosCameraNodeDispatcher::m_wakeupDispatchThread(void)
+{
+    uint64_t count = 1;
+
+    if (write(m_eventFd, &count, sizeof(count)) < 0)
+        ALOGW("WARN(%s[%d]):[%s] write eventfd fail, errno(%d)", __FUNCTION__, __LINE__, m_name, errno);
+}
+
+}; /* namespace android */
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2020, Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EXYNOS_CAMERA_NODE_DISPATCHER_H
+#define EXYNOS_CAMERA_NODE_DISPATCHER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+#include "ExynosCameraThread.h"
+
+namespace android {
+
+#define NODE_DISPATCHER_MAX_NODE            (32)
+/* readiness events taken by one epoll_wait() */
+#define NODE_DISPATCHER_BATCH_SIZE          (16)
+#define NODE_DISPATCHER_MAX_WORKER          (4)
+#define NODE_DISPATCHER_DEFAULT_WORKER      (2)
+/* as the poll of ExynosCameraNode : 50 msec * 40 */
+#define NODE_DISPATCHER_UNREGISTER_TIMEOUT  (2000000000) /* 2sec */
+
+/*
+ * Completion handler of a node.
+ * handle() runs on a worker of the dispatcher when the node fd is ready.
+ * It returns true to be called again on the next readiness,
+ * false to be parked until ExynosCameraNodeDispatcher::armNode().
+ */
+class ExynosCameraNodeHandlerBase {
+public:
+    virtual ~ExynosCameraNodeHandlerBase() {}
+
+    virtual bool handle(uint32_t events) = 0;
+};
+
+template<typename T>
+class ExynosCameraNodeHandler : public ExynosCameraNodeHandlerBase {
+
+typedef bool (T::*node_handler)(uint32_t events);
+public:
+    ExynosCameraNodeHandler(T *hw, node_handler handler)
+    {
+        m_hardware = hw;
+        m_handler  = handler;
+    }
+
+    virtual bool handle(uint32_t events)
+    {
+        return (m_hardware->*m_handler)(events);
+    }
+
+private:
+    T            *m_hardware;
+    node_handler m_handler;
+};
+
+/*
+ * Completion dispatcher of the V4L2 nodes of a frame factory.
+ *
+ * The node fds are in one epoll set, armed one shot: a ready fd is handed
+ * once to a worker and is not watched again until its handler returned.
+ * So the handler of a node never runs on two workers at once, and a
+ * handler is free to block in dqbuf like the get thread of a pipe did.
+ * One dispatcher thread takes up to NODE_DISPATCHER_BATCH_SIZE ready fds
+ * per wake up, and a few workers run the handlers, instead of one thread
+ * per pipe blocked in poll().
+ */
+class ExynosCameraNodeDispatcher {
+public:
+    ExynosCameraNodeDispatcher(const char *name, int workerNum = NODE_DISPATCHER_DEFAULT_WORKER);
+    virtual ~ExynosCameraNodeDispatcher();
+
+    status_t        create(void);
+    status_t        destroy(void);
+
+    /* handler is owned by the caller, and used until unregisterNode() returned NO_ERROR */
+    status_t        registerNode(int fd, ExynosCameraNodeHandlerBase *handler);
+    /*
+     * Remove fd from the set and wait for its running handler.
+     * Return TIMED_OUT if the handler did not return in timeout :
+     * fd is not watched anymore, but handler is still in use.
+     */
+    status_t        unregisterNode(int fd, nsecs_t timeout = NODE_DISPATCHER_UNREGISTER_TIMEOUT);
+    /* watch a parked fd again */
+    status_t        armNode(int fd);
+
+    bool            isRegistered(int fd);
+    int             getNodeCount(void);
+    int             getWorkerNum(void);
+
+private:
+    enum NODE_ENTRY_STATE {
+        NODE_ENTRY_STATE_FREE = 0,
+        /* in the epoll set, waiting for the readiness */
+        NODE_ENTRY_STATE_ARMED,
+        /* ready, in the work queue */
+        NODE_ENTRY_STATE_QUEUED,
+        NODE_ENTRY_STATE_RUNNING,
+        /* handler returned false, waiting for armNode() */
+        NODE_ENTRY_STATE_PARKED,
+    };
+
+    struct node_entry {
+        int                             fd;
+        ExynosCameraNodeHandlerBase     *handler;
+        enum NODE_ENTRY_STATE           state;
+        uint32_t                        generation;
+        uint32_t                        events;
+        bool                            flagPendingArm;
+        bool                            flagRemoved;
+        pid_t                           runningTid;
+    };
+
+    bool            m_dispatchThreadFunc(void);
+    bool            m_workerThreadFunc(void);
+
+    int             m_findEntry(int fd);
+    status_t        m_arm(int index);
+    /* m_lock is held */
+    status_t        m_waitHandlerDone(int index, nsecs_t timeout);
+    void            m_releaseEntry(int index);
+    void            m_wakeupDispatchThread(void);
+
+private:
+    typedef ExynosCameraThread<ExynosCameraNodeDispatcher> NodeDispatcherThread;
+
+    char                        m_name[32];
+    int                         m_epollFd;
+    int                         m_eventFd;
+    int                         m_workerNum;
+
+    sp<NodeDispatcherThread>    m_dispatchThread;
+    sp<NodeDispatcherThread>    m_workerThread[NODE_DISPATCHER_MAX_WORKER];
+
+    Mutex                       m_lock;
+    Condition                   m_workCondition;
+    Condition                   m_handlerDoneCondition;
+    struct node_entry           m_entry[NODE_DISPATCHER_MAX_NODE];
+    int                         m_nodeCount;
+    uint32_t                    m_generation;
+    bool                        m_flagExit;
+
+    /* ring of the entry index, a node is queued once at most */
+    int                         m_workQ[NODE_DISPATCHER_MAX_NODE];
+    int                         m_workQHead;
+    int                         m_workQSize;
+};
+
+}; /* namespace android */
+
+#endif
@@ -1997,8 +1997,10 @@ status_t ExynosCameraRequestManager::flush()
         }
     } while (getServiceRequestCount() > 0);
 
+    m_requestLock.lock();
     m_serviceRequests.clear();
     m_runningRequests.clear();
+    m_requestLock.unlock();
 
     m_requestFrameCountMap.clear();
 
@@ -2362,6 +2364,9 @@ void ExynosCameraRequestManager::m_setFlushFlag(bool flag)
 {
     Mutex::Autolock l(m_flushLock);
     m_flushFlag = flag;
+
+    if (m_flushFlag == false)
+        m_flushDoneCondition.broadcast();
 }
 
 bool ExynosCameraRequestManager::m_getFlushFlag(void)
@@ -2372,10 +2377,19 @@ bool ExynosCameraRequestManager::m_getFlushFlag(void)
 
 void ExynosCameraRequestManager::m_waitFlushDone(void)
 {
-    int32_t retryCount = 30;
-    while (m_getFlushFlag() == true && retryCount-- > 0) {
-        CLOGD("Wait flush done. retryCount %d", retryCount);
-        usleep(1000); //1msec
+    Mutex::Autolock l(m_flushLock);
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t remainTime = REQUEST_FLUSH_DONE_WAIT_TIMEOUT;
+
+    while (m_flushFlag == true) {
+        if (remainTime <= 0) {
+            CLOGW("Wait flush done timeout(%d)ms", (int)ns2ms(REQUEST_FLUSH_DONE_WAIT_TIMEOUT));
+            break;
+        }
+
+        CLOGD("Wait flush done. remainTime %d us", (int)ns2us(remainTime));
+        m_flushDoneCondition.waitRelative(m_flushLock, remainTime);
+        remainTime = REQUEST_FLUSH_DONE_WAIT_TIMEOUT - (systemTime(SYSTEM_TIME_MONOTONIC) - startTime);
     }
 }
 
@@ -2839,33 +2853,6 @@ bool ExynosCameraRequestManager::m_notifyErrorCallback(ExynosCameraRequestSP_spr
     return ret;
 }
 
-status_t ExynosCameraRequestManager::waitforRequestflush()
-{
-    int count = 0;
-
-    CLOGD("m_serviceRequest size(%zu) m_runningRequest size(%zu)",
-           m_serviceRequests.size(), m_runningRequests.size());
-
-    while (true) {
-        if (m_serviceRequests.size() == 0 && m_runningRequests.size() == 0)
-            break;
-
-        usleep(50000);
-
-        if (count++ == 200)
-            break;
-    }
-
-    if (count > 200) {
-        CLOGW("m_serviceRequest size(%zu) m_runningRequest size(%zu), count(%d)",
-               m_serviceRequests.size(), m_runningRequests.size(), count);
-    } else {
-        CLOGD("Done : count(%d)", count);
-    }
-
-    return 0;
-}
-
 void ExynosCameraRequestManager::m_adjustFaceDetectMetadata(ExynosCameraRequestSP_sprt_t request)
 {
     struct camera2_shot_ext *shot_ext = NULL;
@@ -39,6 +39,9 @@ namespace android {
 
 using namespace std;
 
+/* bound of the wait for the end of a flush, before a new request is registered */
+#define REQUEST_FLUSH_DONE_WAIT_TIMEOUT     (30000000)      /* 30ms */
+
 namespace EXYNOS_REQUEST_RESULT {
     enum TYPE {
         CALLBACK_INVALID         = -1,
@@ -386,7 +389,6 @@ public:
     uint32_t                       getRunningRequestCount(void);
 
     status_t                       setFrameCount(uint32_t frameCount, uint32_t requestKey);
-    status_t                       waitforRequestflush();
 
     int32_t                        getResultRenew(void);
     void                           incResultRenew(void);
@@ -460,6 +462,7 @@ private:
 private:
     bool                          m_flushFlag;
     mutable Mutex                 m_flushLock;
+    Condition                     m_flushDoneCondition;
 
     RequestInfoList               m_serviceRequests;
     RequestInfoMap                m_runningRequests;
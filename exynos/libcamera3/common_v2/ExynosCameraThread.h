@@ -19,11 +19,102 @@
 #define EXYNOS_CAMERA_THREAD_H
 
 #include <utils/threads.h>
+#include <utils/Timers.h>
 
 using namespace android;
 
+/* the longest a waiter sleeps before it looks at isRunning() again */
+#define EXYNOS_CAMERA_THREAD_EXIT_WAIT_SLICE    (2000000) /* 2ms */
+
+/*
+ * Thread with an exit notification.
+ * The loop broadcasts when it returns for the last time, so the stop path
+ * can wait for it with a bound instead of polling isRunning().
+ */
+class ExynosCameraThreadBase : public Thread {
+public:
+    ExynosCameraThreadBase()
+    {
+        m_flagLoopRunning = false;
+    }
+
+    virtual status_t run(const char *name, int32_t priority = PRIORITY_DEFAULT, size_t stack = 0)
+    {
+        status_t ret;
+        bool prevLoopRunning;
+
+        m_exitLock.lock();
+        prevLoopRunning = m_flagLoopRunning;
+        m_flagLoopRunning = true;
+        m_exitLock.unlock();
+
+        ret = Thread::run(name, priority, stack);
+        if (ret != NO_ERROR) {
+            m_exitLock.lock();
+            m_flagLoopRunning = prevLoopRunning;
+            m_exitLock.unlock();
+        }
+
+        return ret;
+    }
+
+    /*
+     * Wait until the loop is over and the thread is not running.
+     * Return TIMED_OUT if it is still running after timeout.
+     * It does not request the exit.
+     */
+    virtual status_t waitExit(nsecs_t timeout)
+    {
+        nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        nsecs_t remainTime = timeout;
+
+        m_exitLock.lock();
+        /*
+         * requestExit() can land between the loop and the exitPending check of
+         * Thread, which ends the thread without notification : wait by slices
+         */
+        while (m_flagLoopRunning == true && isRunning() == true) {
+            if (remainTime <= 0) {
+                m_exitLock.unlock();
+                return TIMED_OUT;
+            }
+
+            m_exitCondition.waitRelative(m_exitLock,
+                                         (remainTime < EXYNOS_CAMERA_THREAD_EXIT_WAIT_SLICE) ?
+                                         remainTime : EXYNOS_CAMERA_THREAD_EXIT_WAIT_SLICE);
+
+            remainTime = timeout - (systemTime(SYSTEM_TIME_MONOTONIC) - startTime);
+        }
+        m_exitLock.unlock();
+
+        /* the loop is over, only the exit of Thread is left */
+        if (isRunning() == true)
+            join();
+
+        return NO_ERROR;
+    }
+
+protected:
+    /* ret : the return of one loop */
+    void m_loopDone(bool ret)
+    {
+        if (ret == true && exitPending() == false)
+            return;
+
+        m_exitLock.lock();
+        m_flagLoopRunning = false;
+        m_exitCondition.broadcast();
+        m_exitLock.unlock();
+    }
+
+private:
+    Mutex       m_exitLock;
+    Condition   m_exitCondition;
+    bool        m_flagLoopRunning;
+};
+
 template<typename T>
-class ExynosCameraThread : public Thread {
+class ExynosCameraThread : public ExynosCameraThreadBase {
 
 typedef bool (T::*thread_loop)(void);
 public:
@@ -63,7 +154,7 @@ public:
 
         ALOGV("DEBUG(%s):Thread(%s) start running", __FUNCTION__, m_name);
 
-        return Thread::run(m_name, m_priority, 0);
+        return ExynosCameraThreadBase::run(m_name, m_priority, 0);
     }
 
     virtual status_t run(int32_t priority, size_t stack = 0) {
@@ -72,7 +163,7 @@ public:
         if (m_priority != priority)
             m_priority = priority;
 
-        return Thread::run(m_name, m_priority, stack);
+        return ExynosCameraThreadBase::run(m_name, m_priority, stack);
     }
 
     virtual void stop(void) {
@@ -87,6 +178,8 @@ private:
         if (m_flatStart == false)
             ret = m_flatStart;
 
+        m_loopDone(ret);
+
         return ret;
     }
 
@@ -99,6 +99,14 @@ status_t ExynosCameraMCPipe::destroy(void)
     CLOGI("");
     status_t ret = NO_ERROR;
 
+    /* the node fd leaves the dispatcher before it is closed */
+    if (m_unregisterGetBuffer(NODE_DISPATCHER_UNREGISTER_TIMEOUT) == NO_ERROR) {
+        SAFE_DELETE(m_getBufferHandler);
+        m_nodeDispatcher = NULL;
+    } else {
+        CLOGE("getBuffer handler is still running, it is not released");
+    }
+
     for (int i = (MAX_NODE - 1); i >= OUTPUT_NODE; i--) {
         if (m_node[i] != NULL) {
             if (i == m_sensorNodeIndex) {
@@ -265,7 +273,7 @@ status_t ExynosCameraMCPipe::start(void)
     m_lastFrameCount = 0;
     m_lastMetaFrameCount = 0;
     m_flagStartPipe = true;
-    m_flagTryStop = false;
+    m_setTryStop(false);
 #ifdef DEBUG_DUMP_IMAGE
     m_dumpBufferCount = 0;
 #endif
@@ -288,8 +296,13 @@ status_t ExynosCameraMCPipe::stop(void)
         funcRet |= ret;
     }
 
+    m_putBufferThread->requestExit();
+    m_getBufferThread->requestExit();
+    m_wakeupTryStop();
+
     m_putBufferThread->requestExitAndWait();
     m_getBufferThread->requestExitAndWait();
+    m_unregisterGetBuffer(NODE_DISPATCHER_UNREGISTER_TIMEOUT);
 
     CLOGD("Thread exited");
 
@@ -317,7 +330,7 @@ status_t ExynosCameraMCPipe::stop(void)
     m_flagSensorStandby = SENSOR_STANDBY_OFF;
     m_sensorStandbyLock.unlock();
     m_flagStartPipe = false;
-    m_flagTryStop = false;
+    m_setTryStop(false);
 
 #ifdef DEBUG_DUMP_IMAGE
     m_dumpBufferThread->requestExitAndWait();
@@ -349,8 +362,9 @@ status_t ExynosCameraMCPipe::startThread(void)
     m_getInternalFrameLogCnt = 0;
 
     if (m_flagSensorStandby != SENSOR_STANDBY_ON) {
+        m_resetTryStopWakeup();
         m_putBufferThread->run(PRIORITY_URGENT_DISPLAY);
-        m_getBufferThread->run(PRIORITY_URGENT_DISPLAY);
+        m_startGetBuffer();
     }
 
     CLOGI("startThread is succeed, Pipe(%d), standby(%d)", getPipeId(), m_flagSensorStandby);
@@ -365,6 +379,8 @@ status_t ExynosCameraMCPipe::stopThread(void)
 
     m_putBufferThread->requestExit();
     m_getBufferThread->requestExit();
+    m_flagDispatchRunning = false;
+    m_wakeupTryStop();
 
     m_inputFrameQ->sendCmd(WAKE_UP);
     m_requestFrameQ->sendCmd(WAKE_UP);
@@ -389,21 +405,24 @@ status_t ExynosCameraMCPipe::stopThreadAndWait(int sleep, int times)
 {
     CLOGD(" IN");
     status_t status = NO_ERROR;
-    int i = 0;
-
-    for (i = 0; i < times ; i++) {
-        if (m_putBufferThread->isRunning() == false && m_getBufferThread->isRunning() == false) {
-            break;
-        }
-        usleep(sleep * 1000);
+    nsecs_t timeout = ms2ns(sleep * times);
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    /* sleep * times is the bound of the wait for both threads */
+    status = m_putBufferThread->waitExit(timeout);
+    if (status == NO_ERROR) {
+        if (m_flagDispatchRegistered == true)
+            status = m_unregisterGetBuffer(timeout - (systemTime(SYSTEM_TIME_MONOTONIC) - startTime));
+        else
+            status = m_getBufferThread->waitExit(timeout - (systemTime(SYSTEM_TIME_MONOTONIC) - startTime));
     }
 
-    if (i >= times) {
+    if (status != NO_ERROR) {
         status = TIMED_OUT;
         CLOGE(" stopThreadAndWait failed, waitTime(%d)ms", sleep*times);
     }
 
-    CLOGV(" OUT");
+    CLOGV(" OUT, waitTime(%d)us", (int)ns2us(systemTime(SYSTEM_TIME_MONOTONIC) - startTime));
     return status;
 }
 
@@ -466,6 +485,7 @@ status_t ExynosCameraMCPipe::sensorStandby(bool on)
 
             CLOGI("Wait for getBufferThread Exit!!(%d)", m_requestFrameQ->getSizeOfProcessQ());
             m_getBufferThread->requestExitAndWait();
+            m_unregisterGetBuffer(NODE_DISPATCHER_UNREGISTER_TIMEOUT);
             CLOGI("Wait Done for getBufferThread Exit!!");
 
             ret = prepare();
@@ -1068,6 +1088,9 @@ bool ExynosCameraMCPipe::isThreadRunning(void)
     if (m_putBufferThread->isRunning() || m_getBufferThread->isRunning())
         return true;
 
+    if (m_flagDispatchRegistered == true)
+        return true;
+
     return false;
 }
 
@@ -1103,7 +1126,7 @@ status_t ExynosCameraMCPipe::setStopFlag(void)
 {
     CLOGD("");
 
-    m_flagTryStop = true;
+    m_setTryStop(true);
 
     return NO_ERROR;
 }
@@ -1405,10 +1428,8 @@ bool ExynosCameraMCPipe::m_putBufferThreadFunc(void)
         m_threadState = ERROR_POLLING_DETECTED;
 #endif
 
-    if (m_flagTryStop == true) {
-        usleep(5000);
+    if (m_waitTryStop() == true)
         return true;
-    }
 
     ret = m_putBuffer();
     if (ret != NO_ERROR)
@@ -1421,10 +1442,8 @@ bool ExynosCameraMCPipe::m_getBufferThreadFunc(void)
 {
     status_t ret = NO_ERROR;
 
-    if (m_flagTryStop == true) {
-        usleep(5000);
+    if (m_waitTryStop() == true)
         return true;
-    }
 
     ret = m_getBuffer();
     if (ret != NO_ERROR && m_putInternalFrameLogCnt == 0
@@ -1469,6 +1488,22 @@ bool ExynosCameraMCPipe::m_getBufferThreadFunc(void)
     return m_checkThreadLoop(m_requestFrameQ);
 }
 
+bool ExynosCameraMCPipe::m_getBufferHandlerFunc(__unused uint32_t events)
+{
+    /* where the get thread would be exited or parked in the try stop */
+    if (m_flagDispatchRunning == false || m_flagTryStop == true)
+        return false;
+
+    /*
+     * A node without a queued buffer polls as an error : park until m_putBuffer()
+     * pushes the next frame, instead of spinning on it.
+     */
+    if (m_requestFrameQ->getSizeOfProcessQ() == 0)
+        return false;
+
+    return m_getBufferThreadFunc();
+}
+
 status_t ExynosCameraMCPipe::m_putBuffer(void)
 {
     CLOGV("-IN-");
@@ -1799,6 +1834,8 @@ status_t ExynosCameraMCPipe::m_putBuffer(void)
 
     /* 8. Push frame to getBufferThread */
     m_requestFrameQ->pushProcessQ(&newFrame);
+    if (m_flagDispatchRegistered == true)
+        m_nodeDispatcher->armNode(m_dispatchFd);
 
     if ((int) blockingTimer[0].durationMsecs() > 1000) { /* Over 1 sec */
         CLOGW("[F%d]putBuffer is delayed!! total %d waitInputFrameQ %d captureQ %d OutputQ %d",
@@ -3615,6 +3652,12 @@ void ExynosCameraMCPipe::m_init(camera_device_info_t *deviceInfo)
 
     m_lastFrameCount = 0;
     m_lastMetaFrameCount = 0;
+
+    m_nodeDispatcher = NULL;
+    m_getBufferHandler = NULL;
+    m_dispatchFd = -1;
+    m_flagDispatchRunning = false;
+    m_flagDispatchRegistered = false;
 }
 
 status_t ExynosCameraMCPipe::m_createSensorNode(int32_t *sensorIds)
@@ -3733,6 +3776,95 @@ status_t ExynosCameraMCPipe::setDeviceInfo(camera_device_info_t *deviceInfo)
     return NO_ERROR;
 }
 
+status_t ExynosCameraMCPipe::setNodeDispatcher(ExynosCameraNodeDispatcher *nodeDispatcher)
+{
+    int fd = -1;
+
+    if (m_nodeDispatcher == nodeDispatcher)
+        return NO_ERROR;
+
+    if (m_flagDispatchRegistered == true) {
+        CLOGE("getBuffer is on the node dispatcher, fd(%d)", m_dispatchFd);
+        return INVALID_OPERATION;
+    }
+
+    if (nodeDispatcher == NULL) {
+        m_nodeDispatcher = NULL;
+        return NO_ERROR;
+    }
+
+    /* the request frame queue of the reprocessing runs the get thread by itself */
+    if (m_reprocessing == true)
+        return INVALID_OPERATION;
+
+    /* dummy node and HAL node have no fd to poll */
+    if (m_node[OUTPUT_NODE] == NULL)
+        return INVALID_OPERATION;
+
+    m_node[OUTPUT_NODE]->getFd(&fd);
+    if (fd < 0)
+        return INVALID_OPERATION;
+
+    if (m_getBufferHandler == NULL)
+        m_getBufferHandler = new MCPipeNodeHandler(this, &ExynosCameraMCPipe::m_getBufferHandlerFunc);
+
+    m_nodeDispatcher = nodeDispatcher;
+    m_dispatchFd = fd;
+
+    CLOGI("getBuffer on the node dispatcher, Pipe(%d), fd(%d)", getPipeId(), fd);
+
+    return NO_ERROR;
+}
+
+status_t ExynosCameraMCPipe::m_startGetBuffer(void)
+{
+    status_t ret = NO_ERROR;
+
+    if (m_nodeDispatcher == NULL)
+        return m_getBufferThread->run(PRIORITY_URGENT_DISPLAY);
+
+    m_flagDispatchRunning = true;
+
+    if (m_flagDispatchRegistered == true) {
+        /* stopThread() parked it, but it was not unregistered yet */
+        return m_nodeDispatcher->armNode(m_dispatchFd);
+    }
+
+    ret = m_nodeDispatcher->registerNode(m_dispatchFd, m_getBufferHandler);
+    if (ret != NO_ERROR) {
+        CLOGW("registerNode fail, fd(%d), ret(%d). run getBufferThread", m_dispatchFd, ret);
+        m_flagDispatchRunning = false;
+        return m_getBufferThread->run(PRIORITY_URGENT_DISPLAY);
+    }
+
+    m_flagDispatchRegistered = true;
+
+    return NO_ERROR;
+}
+
+status_t ExynosCameraMCPipe::m_unregisterGetBuffer(nsecs_t timeout)
+{
+    status_t ret = NO_ERROR;
+
+    if (m_flagDispatchRegistered == false)
+        return NO_ERROR;
+
+    m_flagDispatchRunning = false;
+
+    ret = m_nodeDispatcher->unregisterNode(m_dispatchFd, timeout);
+    if (ret == NAME_NOT_FOUND)
+        ret = NO_ERROR;
+
+    if (ret != NO_ERROR) {
+        CLOGE("unregisterNode fail, fd(%d), ret(%d)", m_dispatchFd, ret);
+        return ret;
+    }
+
+    m_flagDispatchRegistered = false;
+
+    return NO_ERROR;
+}
+
 #ifdef USE_MCPIPE_SERIALIZATION_MODE
 void ExynosCameraMCPipe::m_lockSerializeOperation(enum pipeline pipeId)
 {
@@ -20,6 +20,7 @@
 
 #include "ExynosCameraPipeFlite.h"
 #include <array>
+#include <atomic>
 namespace android {
 
 using namespace std;
@@ -145,10 +146,12 @@ public:
 
     virtual status_t        setDeviceInfo(camera_device_info_t *deviceInfo);
 
+    virtual status_t        setNodeDispatcher(ExynosCameraNodeDispatcher *nodeDispatcher);
 
 protected:
     virtual bool            m_putBufferThreadFunc(void);
     virtual bool            m_getBufferThreadFunc(void);
+            bool            m_getBufferHandlerFunc(uint32_t events);
 #ifdef DEBUG_DUMP_IMAGE
     virtual bool            m_dumpBufferThreadFunc(void);
 #endif
@@ -206,12 +209,24 @@ private:
 
     status_t                m_createSensorNode(int32_t *sensorIds);
 
+    status_t                m_startGetBuffer(void);
+    status_t                m_unregisterGetBuffer(nsecs_t timeout);
+
 protected:
     typedef ExynosCameraThread<ExynosCameraMCPipe> MCPipeThread;
     sp<MCPipeThread>            m_putBufferThread;
     sp<MCPipeThread>            m_getBufferThread;
     String8                     m_putBufferThreadName;
     String8                     m_getBufferThreadName;
+
+    /* the get thread is replaced by a handler on the node dispatcher */
+    typedef ExynosCameraNodeHandler<ExynosCameraMCPipe> MCPipeNodeHandler;
+    ExynosCameraNodeDispatcher *m_nodeDispatcher;
+    MCPipeNodeHandler          *m_getBufferHandler;
+    int                         m_dispatchFd;
+    /* read by the dispatcher worker running m_getBufferHandlerFunc() */
+    std::atomic<bool>           m_flagDispatchRunning;
+    std::atomic<bool>           m_flagDispatchRegistered;
 #ifdef DEBUG_DUMP_IMAGE
     sp<Thread>                  m_dumpBufferThread;
     uint32_t                    m_dumpBufferCount;
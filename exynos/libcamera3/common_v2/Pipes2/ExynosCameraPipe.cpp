@@ -250,7 +250,7 @@ status_t ExynosCameraPipe::start(void)
     m_timeInterval = 0;
 
     m_flagStartPipe = true;
-    m_flagTryStop = false;
+    m_setTryStop(false);
 
     return NO_ERROR;
 }
@@ -274,6 +274,8 @@ status_t ExynosCameraPipe::stop(void)
         return ret;
     }
 
+    m_mainThread->requestExit();
+    m_wakeupTryStop();
     stopThreadAndInputQ(m_mainThread, 1, m_inputFrameQ);
 
     ret = m_mainNode->clrBuffers();
@@ -301,7 +303,7 @@ status_t ExynosCameraPipe::stop(void)
     m_threadRenew = 0;
     m_threadCommand = 0;
     m_timeInterval = 0;
-    m_flagTryStop= false;
+    m_setTryStop(false);
 
     return NO_ERROR;
 }
@@ -321,6 +323,7 @@ status_t ExynosCameraPipe::startThread(void)
 
     m_timer.start();
     if (m_mainThread->isRunning() == false) {
+        m_resetTryStopWakeup();
         m_mainThread->run(m_name);
         CLOGI("startThread is succeed Pipe(%d)", getPipeId());
     } else {
@@ -333,6 +336,7 @@ status_t ExynosCameraPipe::startThread(void)
 status_t ExynosCameraPipe::stopThread(void)
 {
     m_mainThread->requestExit();
+    m_wakeupTryStop();
     m_inputFrameQ->sendCmd(WAKE_UP);
 
     m_dumpRunningFrameList();
@@ -349,21 +353,19 @@ status_t ExynosCameraPipe::stopThreadAndWait(int sleep, int times)
 {
     CLOGD(" IN");
     status_t status = NO_ERROR;
-    int i = 0;
+    ExynosCameraDurationTimer waitTimer;
 
-    for (i = 0; i < times ; i++) {
-        if (m_mainThread->isRunning() == false) {
-            break;
-        }
-        usleep(sleep * 1000);
-    }
+    /* sleep * times is the bound of the wait, the exit of the thread wakes it up */
+    waitTimer.start();
+    status = m_mainThread->waitExit(ms2ns(sleep * times));
+    waitTimer.stop();
 
-    if (i >= times) {
+    if (status != NO_ERROR) {
         status = TIMED_OUT;
         CLOGE(" stopThreadAndWait failed, waitTime(%d)ms", sleep*times);
     }
 
-    CLOGI(" OUT");
+    CLOGI(" OUT, waitTime(%d)us", (int)waitTimer.durationUsecs());
     return status;
 }
 
@@ -806,7 +808,7 @@ status_t ExynosCameraPipe::setStopFlag(void)
 {
     CLOGD("");
 
-    m_flagTryStop = true;
+    m_setTryStop(true);
 
     return NO_ERROR;
 }
@@ -885,10 +887,8 @@ bool ExynosCameraPipe::m_mainThreadFunc(void)
     /* TODO: check exit condition */
     /*       running list != empty */
 
-    if (m_flagTryStop == true) {
-        usleep(5000);
+    if (m_waitTryStop() == true)
         return true;
-    }
 
     ret = m_getBuffer();
     if (ret < 0) {
@@ -1804,6 +1804,51 @@ bool ExynosCameraPipe::m_checkThreadLoop(void)
     return loop;
 }
 
+void ExynosCameraPipe::m_setTryStop(bool flag)
+{
+    Mutex::Autolock lock(m_tryStopLock);
+
+    m_flagTryStop = flag;
+    /* a wake up for the exit stays until the next start */
+    if (flag == false)
+        m_flagTryStopWakeup = false;
+
+    m_tryStopCondition.broadcast();
+}
+
+/* return true while the stop is tried : the thread must not touch the nodes */
+bool ExynosCameraPipe::m_waitTryStop(void)
+{
+    Mutex::Autolock lock(m_tryStopLock);
+
+    if (m_flagTryStop == false)
+        return false;
+
+    /* start(), stop() and stopThread() wake it up */
+    if (m_flagTryStopWakeup == false)
+        m_tryStopCondition.waitRelative(m_tryStopLock, PIPE_TRY_STOP_WAIT_TIMEOUT);
+
+    return true;
+}
+
+/* let the thread see its exit request, the try stop flag is kept */
+void ExynosCameraPipe::m_wakeupTryStop(void)
+{
+    Mutex::Autolock lock(m_tryStopLock);
+
+    m_flagTryStopWakeup = true;
+
+    m_tryStopCondition.broadcast();
+}
+
+/* a new run of the thread waits again, the wake up was for the previous exit */
+void ExynosCameraPipe::m_resetTryStopWakeup(void)
+{
+    Mutex::Autolock lock(m_tryStopLock);
+
+    m_flagTryStopWakeup = false;
+}
+
 void ExynosCameraPipe::m_init(void)
 {
     m_mainNodeNum = -1;
@@ -1847,6 +1892,7 @@ void ExynosCameraPipe::m_init(void)
 
     m_flagStartPipe = false;
     m_flagTryStop = false;
+    m_flagTryStopWakeup = false;
 
     m_flagFrameDoneQ = false;
 
@@ -24,6 +24,7 @@
 #include "ExynosCameraCommonInclude.h"
 
 #include "ExynosCameraThread.h"
+#include "ExynosCameraNodeDispatcher.h"
 
 #include "ExynosCameraNode.h"
 #include "ExynosCameraNodeJpegHAL.h"
@@ -57,6 +58,9 @@ typedef List<ExynosCameraFrameSP_sptr_t> raw_frame_queue_t;
 /* for reprocessing pipe, if timeout happend, prohibit loging until this define */
 #define TIME_LOG_COUNT 5
 
+/* the thread looks at the stop flag again after this, even without a wake up */
+#define PIPE_TRY_STOP_WAIT_TIMEOUT  (100000000) /* 100ms */
+
 enum PIPE_POSITION {
     SRC_PIPE            = 0,
     DST_PIPE
@@ -376,6 +380,11 @@ public:
     virtual status_t        setDeviceInfo(__unused camera_device_info_t *deviceInfo) { return NO_ERROR; }
     virtual status_t        setUseLatestFrame(__unused bool flag) { return NO_ERROR; }
 
+/* The get thread of a pipe can be replaced by the node dispatcher of its frame factory.
+ * Only the pipes which dequeue from a V4L2 node support it, the others keep their thread.
+ */
+    virtual status_t        setNodeDispatcher(__unused ExynosCameraNodeDispatcher *nodeDispatcher) { return INVALID_OPERATION; }
+
 protected:
     virtual bool            m_mainThreadFunc(void);
 
@@ -417,6 +426,11 @@ protected:
     virtual bool            m_isReprocessing(void);
     virtual bool            m_checkThreadLoop(void);
 
+            void            m_setTryStop(bool flag);
+            bool            m_waitTryStop(void);
+            void            m_wakeupTryStop(void);
+            void            m_resetTryStopWakeup(void);
+
 private:
     void                    m_init(void);
 
@@ -427,7 +441,7 @@ protected:
     ExynosCameraBufferManager   *m_bufferManager[MAX_NODE];
     ExynosCameraActivityControl *m_activityControl;
 
-    sp<Thread>                  m_mainThread;
+    sp<ExynosCameraThreadBase>  m_mainThread;
 
     struct ExynosConfigInfo     *m_exynosconfig;
 
@@ -457,6 +471,9 @@ protected:
     bool                        m_oneShotMode;
     bool                        m_flagStartPipe;
     bool                        m_flagTryStop;
+    bool                        m_flagTryStopWakeup;
+    Mutex                       m_tryStopLock;
+    Condition                   m_tryStopCondition;
     bool                        m_dvfsLocked;
     bool                        m_isBoosting;
     bool                        m_metadataTypeShot;
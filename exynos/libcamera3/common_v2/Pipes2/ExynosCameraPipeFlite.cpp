@@ -391,10 +391,8 @@ bool ExynosCameraPipeFlite::m_mainThreadFunc(void)
 {
     int ret = 0;
 
-    if (m_flagTryStop == true) {
-        usleep(5000);
+    if (m_waitTryStop() == true)
         return true;
-    }
 
     ret = m_getBuffer();
     if (m_flagTryStop == true) {
@@ -354,10 +354,8 @@ bool ExynosCameraPipeVRA::m_mainThreadFunc(void)
 {
     status_t ret = NO_ERROR;
 
-    if (m_flagTryStop == true) {
-        usleep(5000);
+    if (m_waitTryStop() == true)
         return true;
-    }
 
     ret = m_putBuffer();
     if (ret == TIMED_OUT) {
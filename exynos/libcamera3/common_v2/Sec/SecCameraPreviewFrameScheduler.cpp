@@ -19,7 +19,9 @@
 #include <utils/Log.h>
 #include <utils/Trace.h>
 
+#include <errno.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include <binder/IServiceManager.h>
 #include <gui/ISurfaceComposer.h>
@@ -38,7 +40,8 @@ SecCameraPreviewFrameScheduler::SecCameraPreviewFrameScheduler()
       m_enableSkip(false),
       m_scpBufferMgr(NULL),
       m_previewWindow(NULL),
-      m_frameMgr(NULL)
+      m_frameMgr(NULL),
+      m_flagThreadStop(false)
 {
     ALOGV("(%s[%d])", __FUNCTION__, __LINE__);
 }
@@ -68,7 +71,9 @@ void SecCameraPreviewFrameScheduler::m_setHandles(ExynosCameraBufferManager *scp
 void SecCameraPreviewFrameScheduler::m_reset(frame_schedule_mode_t mode, float targetFps, bool skip)
 {
     if(m_frameCount > 240) {
-        ALOGD("(%s[%d]) m_frameCount=%lld, m_frameDropCount=%lld", __FUNCTION__, __LINE__, m_frameCount, m_frameDropCount);
+        ALOGD("(%s[%d]) m_frameCount=%lld, m_frameDropCount=%lld, late=%lld, repeat=%lld, latency=%lld",
+            __FUNCTION__, __LINE__, m_frameCount, m_frameDropCount,
+            m_pacer.getLateCount(), m_pacer.getRepeatCount(), m_pacer.getLatency());
     }
 
     m_vsyncTime = 0;
@@ -78,10 +83,10 @@ void SecCameraPreviewFrameScheduler::m_reset(frame_schedule_mode_t mode, float t
     m_videoSyncPeriod = (nsecs_t)(1e9 / targetFps + 0.5);
     m_frameScheduleMode = mode;
     m_enableSkip = skip;
-    m_frameDurationUs = m_videoSyncPeriod / 1000;
 
-    if (m_frameDurationUs > FRAME_DURATION_OFFSET_US) {
-        m_frameDurationUs -= FRAME_DURATION_OFFSET_US;
+    {
+        Mutex::Autolock lock(m_updateVsyncLock);
+        m_pacer.reset(m_videoSyncPeriod);
     }
 
     if(mode == FRAME_SCHEDULE_MODE_SCHEDULE) {
@@ -89,15 +94,14 @@ void SecCameraPreviewFrameScheduler::m_reset(frame_schedule_mode_t mode, float t
         ALOGD("(%s[%d] m_vsyncPeriod=%lld", __FUNCTION__, __LINE__, m_vsyncPeriod);
     }
 
-    ALOGD("(%s[%d] targetFps=%f, videoSyncPeriod=%lld, frameScheduleMode=%d, enableSkip=%d, frameDurationUs=%lld)",
-         __FUNCTION__, __LINE__, targetFps, m_videoSyncPeriod, m_frameScheduleMode, m_enableSkip, m_frameDurationUs);
+    ALOGD("(%s[%d] targetFps=%f, videoSyncPeriod=%lld, frameScheduleMode=%d, enableSkip=%d)",
+         __FUNCTION__, __LINE__, targetFps, m_videoSyncPeriod, m_frameScheduleMode, m_enableSkip);
 }
 
 void SecCameraPreviewFrameScheduler::m_updateVsync()
 {
     Mutex::Autolock lock(m_updateVsyncLock);
     m_vsyncPeriod = 0;
-    m_vsyncTimeOld = m_vsyncTime;
     m_vsyncTime = 0;
 
     // For now, surface flinger only schedules frames on the primary display
@@ -115,6 +119,7 @@ void SecCameraPreviewFrameScheduler::m_updateVsync()
                     (long long)stats.vsyncTime, (long long)stats.vsyncPeriod);
             m_vsyncTime = stats.vsyncTime;
             m_vsyncPeriod = stats.vsyncPeriod;
+            m_pacer.updateVsync(m_vsyncTime, m_vsyncPeriod);
         } else {
             ALOGW("getDisplayStats returned %d", res);
         }
@@ -123,46 +128,44 @@ void SecCameraPreviewFrameScheduler::m_updateVsync()
     }
 }
 
-nsecs_t SecCameraPreviewFrameScheduler::m_schedule()
+/*
+ * DURATION mode paces the frames on a grid of the frame period, SCHEDULE mode
+ * on the vsync grid. Without vsync information, SCHEDULE mode falls back to
+ * the frame period grid as well.
+ */
+preview_pacing_decision_t SecCameraPreviewFrameScheduler::m_schedule(nsecs_t timeStamp, nsecs_t readyTime,
+                                                                      bool newerFrameQueued, nsecs_t *deadline)
 {
-    nsecs_t curTime = systemTime(SYSTEM_TIME_MONOTONIC);
-    nsecs_t delayTime = 0;
-
-    m_updateVsync();
-
-    // without VSYNC info, there is nothing to do
-    if (m_vsyncPeriod == 0) {
-        ALOGE("no vsync: render=%lld", (long long)curTime);
-        goto func_exit;
-    }
+    nsecs_t curTime;
+    preview_pacing_decision_t decision;
 
-    if (m_vsyncTime < m_vsyncTimeOld) {
-        ALOGE("Invalid vsync time m_vsyncTime(%lld) < m_vsyncTimeOld(%lld)", m_vsyncTime, m_vsyncTimeOld);
-        goto func_exit;
+    if (m_frameScheduleMode == FRAME_SCHEDULE_MODE_SCHEDULE) {
+        m_updateVsync();
     }
 
-    if (m_vsyncTime < curTime) {
-        ALOGE("Vsync is older than now : m_vsyncTime(%lld), curTime(%lld)", m_vsyncTime, curTime);
-        goto func_exit;
-    }
+    /* after the vsync query : the deadline is absolute, the binder call does not delay it */
+    Mutex::Autolock lock(m_updateVsyncLock);
+    curTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    decision = m_pacer.schedule(timeStamp, readyTime, curTime, newerFrameQueued, deadline);
 
-    if (m_vsyncTime - m_vsyncTimeOld > m_videoSyncPeriod*3/2 + MULTIPLE_VSYNC_DETECT_OFFSET_NS) {
-        ALOGV("Multiple vsyncs have been triggered: %lld, %lld", m_vsyncTimeOld, m_vsyncTime);
-        goto func_exit;
-    }
+    ALOGV("schedule() Vsync(%lld), cur(%lld), VsyncPeriod(%lld), VideoPeriod(%lld), latency(%lld), deadline(%lld), %s",
+            m_vsyncTime, curTime, m_pacer.getVsyncPeriod(), m_videoSyncPeriod, m_pacer.getLatency(), *deadline,
+            (decision == PREVIEW_PACING_DROP) ? "drop" : "present");
 
-    if (m_videoSyncPeriod > m_vsyncPeriod) {
-        delayTime = (m_vsyncTime - curTime + (m_videoSyncPeriod - m_vsyncPeriod) + FRAME_SCHEDULE_OFFSET_NS) % m_videoSyncPeriod;
-    } else {
-        delayTime = (m_vsyncTime - curTime + FRAME_SCHEDULE_OFFSET_NS) % m_videoSyncPeriod;
-    }
+    return decision;
+}
 
-func_exit:
+void SecCameraPreviewFrameScheduler::m_waitUntil(nsecs_t deadline)
+{
+    struct timespec ts;
+    int ret;
 
-    ALOGV("schedule() VsyncOld(%lld), Vsync(%lld), cur(%lld), VsyncPeriod(%lld), VideoPeriod(%lld), Delay(%lld), target(%lld)",
-            m_vsyncTimeOld, m_vsyncTime, curTime, m_vsyncPeriod, m_videoSyncPeriod, delayTime, curTime+delayTime);
+    ts.tv_sec = deadline / 1000000000LL;
+    ts.tv_nsec = deadline % 1000000000LL;
 
-    return delayTime;
+    do {
+        ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    } while (ret == EINTR && m_flagThreadStop == false);
 }
 
 void SecCameraPreviewFrameScheduler::m_run()
@@ -180,6 +183,7 @@ void SecCameraPreviewFrameScheduler::m_stop()
     m_flagThreadStop = true;
     stopThreadAndInputQ(m_scheduler, 1, &m_previewFrameQ);
     m_clearList(&m_previewFrameQ);
+    m_readyTimeQ.release();
 }
 
 void SecCameraPreviewFrameScheduler::m_release()
@@ -188,11 +192,15 @@ void SecCameraPreviewFrameScheduler::m_release()
 
     m_composer.clear();
     m_previewFrameQ.release();
+    m_readyTimeQ.release();
 }
 
 status_t SecCameraPreviewFrameScheduler::m_pushProcessQ(ExynosCameraFrameSP_dptr_t frame)
 {
     status_t ret = NO_ERROR;
+    nsecs_t readyTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    m_readyTimeQ.pushProcessQ(&readyTime);
     m_previewFrameQ.pushProcessQ(frame);
 
     return ret;
@@ -201,6 +209,7 @@ status_t SecCameraPreviewFrameScheduler::m_pushProcessQ(ExynosCameraFrameSP_dptr
 status_t SecCameraPreviewFrameScheduler::m_clearList(frame_queue_t *queue)
 {
     ExynosCameraFrameSP_sptr_t curFrame = NULL;
+    nsecs_t readyTime = 0;
 
     if(queue->getSizeOfProcessQ() == 0) {
         return NO_ERROR;
@@ -210,6 +219,10 @@ status_t SecCameraPreviewFrameScheduler::m_clearList(frame_queue_t *queue)
 
     while (0 < queue->getSizeOfProcessQ()) {
         queue->popProcessQ(&curFrame);
+        /* the ready time is pushed before its preview frame : drop them together */
+        if (queue == &m_previewFrameQ) {
+            m_readyTimeQ.popProcessQ(&readyTime);
+        }
         if (curFrame != NULL) {
             ALOGV("DEBUG(%s):remove frame count %d", __FUNCTION__, curFrame->getFrameCount() );
             curFrame = NULL;
@@ -224,9 +237,11 @@ bool SecCameraPreviewFrameScheduler::m_schedulerThreadFunc(void)
 {
     int ret = 0;
     ExynosCameraBuffer buffer;
-    uint64_t delayUs = 0;
     int qnum = 0;
-    uint32_t offset = FRAME_DURATION_OFFSET_US;
+    int64_t timeStamp = 0;
+    nsecs_t readyTime = 0;
+    nsecs_t deadline = 0;
+    preview_pacing_decision_t decision = PREVIEW_PACING_PRESENT;
     ExynosCameraFrameSP_sptr_t frame = NULL;
 
     /* Wait and pop preview frame */
@@ -240,6 +255,10 @@ bool SecCameraPreviewFrameScheduler::m_schedulerThreadFunc(void)
         goto func_exit;
     }
 
+    if (m_readyTimeQ.popProcessQ(&readyTime) != OK) {
+        readyTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+
     /* Get destBuffer form frame */
     ret = frame->getDstBuffer(PIPE_SCP, &buffer);
     if (ret < 0) {
@@ -250,9 +269,16 @@ bool SecCameraPreviewFrameScheduler::m_schedulerThreadFunc(void)
     ALOGV("(%s[%d])index:%d", __FUNCTION__, __LINE__, buffer.index);
 
     qnum = m_previewFrameQ.getSizeOfProcessQ();
+    timeStamp = (int64_t)frame->getTimeStamp();
 
-    /* Do skip frame by stacked qnum  */
-    if ((m_enableSkip == true) && (qnum >= 1)) {
+    /* Do frame scheduling : drop on a missed deadline, not on the queue depth */
+    if (m_frameScheduleMode != FRAME_SCHEDULE_MODE_OFF) {
+        decision = m_schedule(timeStamp, readyTime, (qnum >= 1), &deadline);
+    } else if ((m_enableSkip == true) && (qnum >= 1)) {
+        decision = PREVIEW_PACING_DROP;
+    }
+
+    if (decision == PREVIEW_PACING_DROP) {
         m_frameDropCount++;
         ALOGD("(%s[%d])skip frame Qnum=%d", __FUNCTION__, __LINE__, qnum);
         frame->setFrameState(FRAME_STATE_SKIPPED);
@@ -268,46 +294,15 @@ bool SecCameraPreviewFrameScheduler::m_schedulerThreadFunc(void)
 
     m_frameCount++;
 
-    /* Do frame scheduling */
-    if (m_frameScheduleMode == FRAME_SCHEDULE_MODE_SCHEDULE) {
-        if ((m_enableSkip == false) && (qnum >= 1)) {
-            m_frameDropCount++;
-            ALOGD("(%s[%d])overwrite frame Qnum=%d", __FUNCTION__, __LINE__, qnum);
-        } else {
-            delayUs = m_schedule() / 1000;
-        }
-    } else if (m_frameScheduleMode == FRAME_SCHEDULE_MODE_DURATION) {
-        m_previewDurationTimer.stop();
-        m_previewDurationTime = m_previewDurationTimer.durationUsecs();
-        if (qnum == 1) {
-            if (m_frameDurationUs > offset) {
-                m_frameDurationUs -= offset;
-            }
-        } else if (qnum >= 2) {
-            if (m_frameDurationUs > offset*2) {
-                m_frameDurationUs -= offset*2;
-            }
-        }
-        if (m_frameDurationUs > m_previewDurationTime) {
-            delayUs = m_frameDurationUs - m_previewDurationTime;
-        }
-    }
-
-    /* Delay frame using delayUs value */
-    if (delayUs > 0) {
-        ALOGV("(%s[%d])m_frameScheduleMode=%d delayUs=%lld", __FUNCTION__, __LINE__,
-            m_frameScheduleMode, delayUs);
-        usleep(delayUs);
-    }
-
-    if(m_frameScheduleMode == FRAME_SCHEDULE_MODE_DURATION) {
-        m_previewDurationTimer.start();
+    /* Wait for the deadline of the frame */
+    if (m_frameScheduleMode != FRAME_SCHEDULE_MODE_OFF) {
+        ALOGV("(%s[%d])m_frameScheduleMode=%d deadline=%lld", __FUNCTION__, __LINE__,
+            m_frameScheduleMode, deadline);
+        m_waitUntil(deadline);
     }
 
     /* Set time stamp */
     if (m_previewWindow != NULL) {
-        int64_t timeStamp = (int64_t)frame->getTimeStamp();
-
         if (timeStamp > 0L) {
             m_previewWindow->set_timestamp(m_previewWindow, timeStamp);
         } else {
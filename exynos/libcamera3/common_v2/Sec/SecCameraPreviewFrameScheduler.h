@@ -25,6 +25,7 @@
 #include "ExynosCameraCommonInclude.h"
 #include "ExynosCameraThread.h"
 #include "ExynosCameraDefine.h"
+#include "SecCameraPreviewPacer.h"
 
 namespace android {
 
@@ -49,7 +50,8 @@ struct SecCameraPreviewFrameScheduler : public RefBase {
     void    m_setHandles(ExynosCameraBufferManager *scpBufferMgr = NULL, preview_stream_ops *previewWindow = NULL,
         ExynosCameraFrameManager *frameMgr = NULL);
     void    m_reset(frame_schedule_mode_t mode = FRAME_SCHEDULE_MODE_OFF, float targetFps = -1, bool skip = false);
-    nsecs_t    m_schedule();
+    preview_pacing_decision_t    m_schedule(nsecs_t timeStamp, nsecs_t readyTime, bool newerFrameQueued,
+                                           nsecs_t *deadline);
 
     status_t    m_pushProcessQ(ExynosCameraFrameSP_dptr_t frame);
     status_t    m_clearList(frame_queue_t *queue);
@@ -59,16 +61,16 @@ protected:
 
 private:
     void    m_updateVsync();
+    void    m_waitUntil(nsecs_t deadline);
     bool    m_schedulerThreadFunc(void);
 
-    nsecs_t    m_vsyncTimeOld;
     nsecs_t    m_vsyncTime;
     nsecs_t    m_vsyncPeriod;
     nsecs_t    m_videoSyncPeriod;
     uint64_t    m_frameCount;
-    uint64_t    m_frameDurationUs;
     uint64_t    m_frameDropCount;
     mutable Mutex        m_updateVsyncLock;
+    SecCameraPreviewPacer    m_pacer;
 
     sp<ISurfaceComposer>    m_composer;
 
@@ -76,11 +78,11 @@ private:
     typedef ExynosCameraList<ExynosCameraFrameSP_sptr_t> frame_queue_t;
 
     frame_queue_t    m_previewFrameQ;
+    /* when each frame of m_previewFrameQ was pushed, in the same order */
+    ExynosCameraList<nsecs_t>    m_readyTimeQ;
     sp<m_schedulerThread>    m_scheduler;
     frame_schedule_mode_t    m_frameScheduleMode;
     bool        m_enableSkip;
-    ExynosCameraDurationTimer    m_previewDurationTimer;
-    uint64_t        m_previewDurationTime;
 #ifdef PREVIEW_DURATION_DEBUG
     ExynosCameraDurationTimer    m_previewDurationDebugTimer;
 #endif
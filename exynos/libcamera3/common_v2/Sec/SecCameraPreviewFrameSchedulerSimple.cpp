@@ -19,7 +19,9 @@
 #include <utils/Log.h>
 #include <utils/Trace.h>
 
+#include <errno.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include <binder/IServiceManager.h>
 #include <gui/ISurfaceComposer.h>
@@ -40,13 +42,11 @@ SecCameraPreviewFrameScheduler::SecCameraPreviewFrameScheduler()
 void SecCameraPreviewFrameScheduler::m_reset(float targetFps)
 {
     m_vsyncTime = 0;
-    m_lastTargetTime = 0;
-    m_syncAdjustCount = 0;
     m_dropCount = 0;
 
     m_targetFps = targetFps;
     m_videoSyncPeriod = (nsecs_t)(1e9 / targetFps + 0.5);
-    m_fpsScale = targetFps / 60.0;
+    m_pacer.reset(m_videoSyncPeriod);
 
     ALOGD("(%s[%d] targetFps=%f, m_videoSyncPeriod=%lld)",
         __FUNCTION__, __LINE__, targetFps, m_videoSyncPeriod);
@@ -58,7 +58,6 @@ void SecCameraPreviewFrameScheduler::m_updateVsync()
 {
     Mutex::Autolock lock(m_updateVsyncLock);
     m_vsyncPeriod = 0;
-    m_vsyncTimeOld = m_vsyncTime;
     m_vsyncTime = 0;
 
     // For now, surface flinger only schedules frames on the primary display
@@ -84,87 +83,50 @@ void SecCameraPreviewFrameScheduler::m_updateVsync()
     }
 }
 
-nsecs_t SecCameraPreviewFrameScheduler::m_schedule()
+void SecCameraPreviewFrameScheduler::m_waitUntil(nsecs_t deadline)
 {
-    nsecs_t curTime = systemTime(SYSTEM_TIME_MONOTONIC);
-    nsecs_t delayTime = 0;
-    nsecs_t targetTime = 0;
+    struct timespec ts;
+    int ret;
 
-    m_updateVsync();
+    ts.tv_sec = deadline / 1000000000LL;
+    ts.tv_nsec = deadline % 1000000000LL;
 
-    // without VSYNC info, there is nothing to do
-    if (m_vsyncPeriod == 0) {
-        ALOGE("no vsync: render=%lld", (long long)curTime);
-        goto func_exit;
-    }
+    do {
+        ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    } while (ret == EINTR);
+}
 
-    if (m_vsyncTime < m_vsyncTimeOld) {
-        ALOGE("Invalid vsync time m_vsyncTime(%lld) < m_vsyncTimeOld(%lld)", m_vsyncTime, m_vsyncTimeOld);
-        goto func_exit;
-    }
+bool SecCameraPreviewFrameScheduler::m_schedulePreviewFrame(float targetFps, nsecs_t sensorTimestamp)
+{
+    nsecs_t now = 0;
+    nsecs_t deadline = 0;
+    preview_pacing_decision_t decision = PREVIEW_PACING_PRESENT;
 
-    if (m_vsyncTime < curTime) {
-        ALOGE("Vsync is older than now : m_vsyncTime(%lld), curTime(%lld)", m_vsyncTime, curTime);
-        goto func_exit;
+    if (m_targetFps != targetFps) {
+        m_reset(targetFps);
     }
 
-    if ((m_vsyncTime - m_vsyncTimeOld) > (nsecs_t)(m_videoSyncPeriod * 1.5 + MULTIPLE_VSYNC_DETECT_OFFSET_NS)) {
-        ALOGV("Multiple vsyncs have been triggered: %lld, %lld", m_vsyncTimeOld, m_vsyncTime);
-        if (m_vsyncPeriod > m_videoSyncPeriod * m_fpsScale) {
-            if (m_targetFps == 30) {
-                ALOGE("Multiple vsyncs have been triggered, missed vsync");
-            }
-            goto func_exit;
-        }
-    }
+    m_updateVsync();
+    m_pacer.updateVsync(m_vsyncTime, m_vsyncPeriod);
 
-    delayTime = (m_vsyncTime - curTime + FRAME_SCHEDULE_OFFSET_NS) % m_vsyncPeriod;
-    targetTime = curTime + delayTime;
-
-    if ((targetTime - m_lastTargetTime) < (m_videoSyncPeriod - MULTIPLE_VSYNC_DETECT_OFFSET_NS)) {
-        ALOGV("Adjust Target Time: TargetDiff(%lld), delayTime(%lld), count(%d)",
-        targetTime - m_lastTargetTime, delayTime, m_syncAdjustCount);
-        if (m_syncAdjustCount < SYNC_ADJUST_COUNT) {
-            delayTime += m_vsyncPeriod;
-            if (m_vsyncPeriod > m_videoSyncPeriod * m_fpsScale) {
-                m_syncAdjustCount++;
-            }
-        } else {
-            m_syncAdjustCount = 0;
-        }
-    } else {
-        m_syncAdjustCount = 0;
+    now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (sensorTimestamp <= 0) {
+        sensorTimestamp = now;
     }
 
-func_exit:
-
-    if (((curTime + delayTime - m_lastTargetTime) >= (m_vsyncPeriod * 2 * (2 - m_fpsScale) - DROP_OFFSET_NS)) ||
-        ((curTime + delayTime - m_lastTargetTime) <= (m_vsyncPeriod * 2 * (1 - m_fpsScale) + DROP_OFFSET_NS)))
-    {
+    /* the caller holds the frame : nothing newer is waiting */
+    decision = m_pacer.schedule(sensorTimestamp, now, now, false, &deadline);
+    if (decision == PREVIEW_PACING_DROP) {
         m_dropCount++;
+        return false;
     }
 
-    m_lastTargetTime = curTime + delayTime;
-
-    ALOGV("schedule() VsyncOld(%lld), Vsync(%lld), cur(%lld), VsyncPeriod(%lld), VideoPeriod(%lld), Delay(%lld), target(%lld)",
-            m_vsyncTimeOld, m_vsyncTime, curTime, m_vsyncPeriod, m_videoSyncPeriod, delayTime, curTime+delayTime);
-
-    return delayTime;
-}
-
-void SecCameraPreviewFrameScheduler::m_schedulePreviewFrame(float targetFps)
-{
-    uint64_t delayUs = 0;
-
-    if (m_targetFps != targetFps) {
-        m_reset(targetFps);
-    }
+    ALOGV("schedule() Vsync(%lld), VsyncPeriod(%lld), VideoPeriod(%lld), now(%lld), deadline(%lld)",
+            m_vsyncTime, m_vsyncPeriod, m_videoSyncPeriod, now, deadline);
 
-    delayUs = m_schedule() / 1000;
+    m_waitUntil(deadline);
 
-    if (delayUs > 0) {
-        usleep(delayUs);
-    }
+    return true;
 }
 
 void SecCameraPreviewFrameScheduler::m_release()
@@ -22,12 +22,9 @@
 #include <utils/List.h>
 #include <utils/threads.h>
 
-namespace android {
+#include "SecCameraPreviewPacer.h"
 
-#define MULTIPLE_VSYNC_DETECT_OFFSET_NS    (4000000)
-#define FRAME_SCHEDULE_OFFSET_NS    (3000000)
-#define DROP_OFFSET_NS    (1000000)
-#define SYNC_ADJUST_COUNT    (12)
+namespace android {
 
 struct ISurfaceComposer;
 
@@ -35,28 +32,30 @@ struct SecCameraPreviewFrameScheduler : public RefBase {
     SecCameraPreviewFrameScheduler();
 
     void    m_release();
-    void    m_schedulePreviewFrame(float targetFps = 30);
+    /*
+     * Waits until the deadline of the frame given by SecCameraPreviewPacer.
+     * sensorTimestamp : 0 paces on the time of the call.
+     * Returns false when the frame is to be dropped.
+     */
+    bool    m_schedulePreviewFrame(float targetFps = 30, nsecs_t sensorTimestamp = 0);
 
 protected:
     virtual    ~SecCameraPreviewFrameScheduler();
 
 private:
     void    m_reset(float targetFps = 30);
-    nsecs_t    m_schedule();
     void    m_updateVsync();
+    void    m_waitUntil(nsecs_t deadline);
 
-    nsecs_t    m_vsyncTimeOld;
     nsecs_t    m_vsyncTime;
-    nsecs_t    m_lastTargetTime;
     nsecs_t    m_vsyncPeriod;
     nsecs_t    m_videoSyncPeriod;
-    int    m_syncAdjustCount;
     mutable Mutex        m_updateVsyncLock;
-    float    m_fpsScale;
     int    m_dropCount;
     float    m_targetFps;
 
     sp<ISurfaceComposer>    m_composer;
+    SecCameraPreviewPacer    m_pacer;
 
 };
 
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2020, Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SEC_CAMERA_PREVIEW_PACER_H_
+#define SEC_CAMERA_PREVIEW_PACER_H_
+
+#include <stdint.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+/* a frame is queued this long before its vsync : wakeup latency, queueBuffer and the latch by SurfaceFlinger */
+#define PREVIEW_PACING_LATCH_LEAD_NS        (4000000)
+/* a frame is late once its deadline passed by more than this */
+#define PREVIEW_PACING_MISS_TOLERANCE_NS    (1000000)
+/* frames over which the processing time is watched before latency is given back */
+#define PREVIEW_PACING_WINDOW_FRAMES        (120)
+
+enum preview_pacing_decision {
+    PREVIEW_PACING_PRESENT = 0,
+    PREVIEW_PACING_DROP,
+};
+
+typedef enum preview_pacing_decision preview_pacing_decision_t;
+
+/*
+ * Absolute presentation deadlines for the preview frames.
+ *
+ * The display grid is a phase-locked estimate of the vsync (updateVsync()),
+ * or a grid of the frame period when there is no vsync information.
+ * A frame is presented on the grid slot of its sensor timestamp plus a fixed
+ * latency, so the presentation follows the sensor cadence and the processing
+ * jitter does not reach the display. The latency is locked on the first frame,
+ * grows by one slot on a missed deadline and shrinks by one slot once the
+ * processing time left a slot unused over a whole window.
+ * The deadline returned by schedule() is the time to queue the frame at,
+ * PREVIEW_PACING_LATCH_LEAD_NS ahead of its slot.
+ *
+ * A frame is dropped when its slot is already taken by the previous frame,
+ * or when it missed its deadline while a newer frame is waiting.
+ * Slots left empty because the sensor skipped frames are counted as repeats:
+ * the display keeps showing the previous frame.
+ * Not thread safe. Defined in the header : the schedulers including it are
+ * built from the source lists of the boards.
+ */
+class SecCameraPreviewPacer {
+public:
+    SecCameraPreviewPacer();
+
+    void    reset(nsecs_t framePeriod);
+    /* a vsync time and period as reported by the display */
+    void    updateVsync(nsecs_t vsyncTime, nsecs_t vsyncPeriod);
+    /* readyTime : when the frame was handed to the scheduler */
+    preview_pacing_decision_t    schedule(nsecs_t sensorTimestamp, nsecs_t readyTime, nsecs_t now,
+                                          bool newerFrameQueued, nsecs_t *deadline);
+
+    nsecs_t    getVsyncPeriod(void) const { return m_gridPeriod; }
+    nsecs_t    getLatency(void) const { return m_latency; }
+    uint64_t    getPresentCount(void) const { return m_presentCount; }
+    uint64_t    getDropCount(void) const { return m_dropCount; }
+    uint64_t    getRepeatCount(void) const { return m_repeatCount; }
+    uint64_t    getLateCount(void) const { return m_lateCount; }
+
+private:
+    int64_t    m_slotOf(nsecs_t time) const;
+    void    m_updateCadence(nsecs_t sensorTimestamp);
+    void    m_updateLatency(nsecs_t processing);
+
+    nsecs_t    m_framePeriod;
+    nsecs_t    m_cadence;
+    nsecs_t    m_lastSensorTimestamp;
+
+    bool    m_hasVsync;
+    nsecs_t    m_gridPhase;
+    nsecs_t    m_gridPeriod;
+
+    bool    m_latencyLocked;
+    nsecs_t    m_latency;
+    int64_t    m_lastSlot;
+    nsecs_t    m_lastDesired;
+    int    m_windowCount;
+    nsecs_t    m_windowMaxProcessing;
+
+    uint64_t    m_presentCount;
+    uint64_t    m_dropCount;
+    uint64_t    m_repeatCount;
+    uint64_t    m_lateCount;
+};
+
+static inline int64_t previewPacingFloorDiv(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+
+    if ((a % b != 0) && ((a < 0) != (b < 0)))
+        q--;
+
+    return q;
+}
+
+static inline nsecs_t previewPacingAbsDiff(nsecs_t a, nsecs_t b)
+{
+    return (a > b) ? (a - b) : (b - a);
+}
+
+inline SecCameraPreviewPacer::SecCameraPreviewPacer()
+{
+    reset(0);
+}
+
+inline void SecCameraPreviewPacer::reset(nsecs_t framePeriod)
+{
+    m_framePeriod = framePeriod;
+    m_cadence = framePeriod;
+    m_lastSensorTimestamp = 0;
+
+    /* a grid of the frame period until a vsync is reported */
+    m_hasVsync = false;
+    m_gridPhase = 0;
+    m_gridPeriod = framePeriod;
+
+    m_latencyLocked = false;
+    m_latency = 0;
+    m_lastSlot = INT64_MIN;
+    m_lastDesired = 0;
+    m_windowCount = 0;
+    m_windowMaxProcessing = 0;
+
+    m_presentCount = 0;
+    m_dropCount = 0;
+    m_repeatCount = 0;
+    m_lateCount = 0;
+}
+
+inline void SecCameraPreviewPacer::updateVsync(nsecs_t vsyncTime, nsecs_t vsyncPeriod)
+{
+    if (vsyncTime <= 0 || vsyncPeriod <= 0)
+        return;
+
+    if (m_hasVsync == false || previewPacingAbsDiff(vsyncPeriod, m_gridPeriod) > m_gridPeriod / 8) {
+        /* first sample or a new display mode : lock on it */
+        m_hasVsync = true;
+        m_gridPhase = vsyncTime;
+        m_gridPeriod = vsyncPeriod;
+        m_latencyLocked = false;
+        m_lastSlot = INT64_MIN;
+        return;
+    }
+
+    int64_t n = previewPacingFloorDiv(vsyncTime - m_gridPhase + m_gridPeriod / 2, m_gridPeriod);
+    nsecs_t predicted = m_gridPhase + n * m_gridPeriod;
+    nsecs_t error = vsyncTime - predicted;
+
+    if (previewPacingAbsDiff(error, 0) > m_gridPeriod / 4) {
+        /* the display jumped : the slots of the frames already queued are lost */
+        m_gridPhase = vsyncTime;
+        m_latencyLocked = false;
+        m_lastSlot = INT64_MIN;
+        return;
+    }
+
+    /* keep the phase on a recent edge, the slot numbers follow */
+    if (m_lastSlot != INT64_MIN)
+        m_lastSlot -= n;
+    m_gridPhase = predicted + error / 4;
+    m_gridPeriod += (vsyncPeriod - m_gridPeriod) / 8;
+}
+
+inline int64_t SecCameraPreviewPacer::m_slotOf(nsecs_t time) const
+{
+    return previewPacingFloorDiv(time - m_gridPhase + m_gridPeriod / 2, m_gridPeriod);
+}
+
+inline void SecCameraPreviewPacer::m_updateCadence(nsecs_t sensorTimestamp)
+{
+    if (m_lastSensorTimestamp > 0 && sensorTimestamp > m_lastSensorTimestamp && m_cadence > 0) {
+        nsecs_t delta = sensorTimestamp - m_lastSensorTimestamp;
+
+        /* only consecutive frames tell the sensor period */
+        if (previewPacingAbsDiff(delta, m_cadence) < m_cadence / 4)
+            m_cadence += (delta - m_cadence) / 8;
+    }
+
+    m_lastSensorTimestamp = sensorTimestamp;
+}
+
+inline void SecCameraPreviewPacer::m_updateLatency(nsecs_t processing)
+{
+    if (processing > m_windowMaxProcessing)
+        m_windowMaxProcessing = processing;
+
+    if (++m_windowCount < PREVIEW_PACING_WINDOW_FRAMES)
+        return;
+
+    /* the slowest frame of the window would still make one slot earlier */
+    if (m_windowMaxProcessing + PREVIEW_PACING_LATCH_LEAD_NS + PREVIEW_PACING_MISS_TOLERANCE_NS
+        < m_latency - m_gridPeriod)
+        m_latency -= m_gridPeriod;
+
+    m_windowCount = 0;
+    m_windowMaxProcessing = 0;
+}
+
+inline preview_pacing_decision_t SecCameraPreviewPacer::schedule(nsecs_t sensorTimestamp, nsecs_t readyTime, nsecs_t now,
+                                                          bool newerFrameQueued, nsecs_t *deadline)
+{
+    int64_t slot;
+    int64_t slotsPerFrame;
+    nsecs_t desired;
+    nsecs_t error;
+    nsecs_t slotTime;
+
+    *deadline = now;
+
+    if (m_gridPeriod <= 0 || sensorTimestamp <= 0) {
+        m_presentCount++;
+        return PREVIEW_PACING_PRESENT;
+    }
+
+    m_updateCadence(sensorTimestamp);
+
+    if (m_hasVsync == false && m_gridPhase == 0)
+        m_gridPhase = now;
+
+    if (m_latencyLocked == false) {
+        /* the first slot this frame can still make */
+        slot = m_slotOf(now + PREVIEW_PACING_LATCH_LEAD_NS);
+        if (m_gridPhase + slot * m_gridPeriod - PREVIEW_PACING_LATCH_LEAD_NS < now)
+            slot++;
+
+        m_latency = m_gridPhase + slot * m_gridPeriod - sensorTimestamp;
+        m_latencyLocked = true;
+        m_windowCount = 0;
+        m_windowMaxProcessing = 0;
+    }
+
+    m_updateLatency(readyTime - sensorTimestamp);
+
+    desired = sensorTimestamp + m_latency;
+    if (m_lastSlot == INT64_MIN) {
+        slot = m_slotOf(desired);
+    } else {
+        /*
+         * Step from the previous frame and stay on that step while its slot
+         * is within a quarter of a slot of the first one at or after the
+         * desired time : a sensor drifting against the display repeats or
+         * drops one vsync at a time, instead of toggling on the jitter, and
+         * the slot is never much earlier than the latency allows.
+         */
+        slot = m_lastSlot + previewPacingFloorDiv(desired - m_lastDesired + m_gridPeriod / 2, m_gridPeriod);
+        error = desired - (m_gridPhase + slot * m_gridPeriod);
+        if (error > m_gridPeriod / 4)
+            slot++;
+        else if (error < -(m_gridPeriod + m_gridPeriod / 4))
+            slot--;
+    }
+    slotTime = m_gridPhase + slot * m_gridPeriod;
+
+    if (m_lastSlot != INT64_MIN && slot <= m_lastSlot) {
+        /* the display shows the previous frame on this slot already */
+        m_dropCount++;
+        return PREVIEW_PACING_DROP;
+    }
+
+    if (now > slotTime - PREVIEW_PACING_LATCH_LEAD_NS + PREVIEW_PACING_MISS_TOLERANCE_NS) {
+        m_lateCount++;
+
+        /* the following frames get one more slot */
+        m_latency += m_gridPeriod;
+        m_windowCount = 0;
+        m_windowMaxProcessing = 0;
+
+        if (newerFrameQueued == true) {
+            m_dropCount++;
+            return PREVIEW_PACING_DROP;
+        }
+
+        /* queue it now, for the first slot it can still make */
+        slot = m_slotOf(now + PREVIEW_PACING_LATCH_LEAD_NS);
+        if (m_gridPhase + slot * m_gridPeriod - PREVIEW_PACING_LATCH_LEAD_NS < now)
+            slot++;
+        /* the next frames step from where this one is shown */
+        desired = m_gridPhase + slot * m_gridPeriod;
+        if (desired > sensorTimestamp + m_latency)
+            desired = sensorTimestamp + m_latency;
+    } else {
+        *deadline = slotTime - PREVIEW_PACING_LATCH_LEAD_NS;
+    }
+
+    if (m_lastSlot != INT64_MIN) {
+        slotsPerFrame = (m_cadence + m_gridPeriod / 2) / m_gridPeriod;
+        if (slotsPerFrame < 1)
+            slotsPerFrame = 1;
+        if (slot - m_lastSlot > slotsPerFrame)
+            m_repeatCount += slot - m_lastSlot - slotsPerFrame;
+    }
+
+    m_lastSlot = slot;
+    m_lastDesired = desired;
+    m_presentCount++;
+
+    return PREVIEW_PACING_PRESENT;
+}
+
+}  // namespace android
+
+#endif  // SEC_CAMERA_PREVIEW_PACER_H_
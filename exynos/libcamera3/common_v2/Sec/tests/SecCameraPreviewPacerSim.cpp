@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2020, Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host simulation of the preview frame scheduler.
+ *
+ * Synthetic timelines: sensor timestamps with jitter and an optional clock
+ * drift against the display, a processing delay per frame, the vsync grid,
+ * the binder call to getDisplayStats() and the wakeup latency of the
+ * scheduler thread. The display latches a frame on the first vsync at least
+ * kDisplayLatch after it was queued; a newer frame queued for the same vsync
+ * replaces the older one.
+ *
+ * The legacy scheduler (relative sleep computed by m_schedule(), skip by
+ * queue depth) and SecCameraPreviewPacer run on the same timelines.
+ * Reported: the presentation interval deviation, the intervals that differ
+ * from the sensor period (judder), the frames shown and the latency added
+ * between the end of the processing and the presentation.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../SecCameraPreviewPacer.h"
+
+using namespace android;
+
+namespace {
+
+/* the constants of the legacy scheduler */
+const nsecs_t kLegacyMultipleVsyncDetectOffset = 4000000;
+const nsecs_t kLegacyScheduleOffset = 3000000;
+
+/* SurfaceFlinger latches a buffer queued this long before the vsync */
+const nsecs_t kDisplayLatch = 1000000;
+const nsecs_t kPutBufferCost = 200000;
+
+struct Timeline {
+    const char *name;
+    double sensorFps;
+    double displayHz;
+    double sensorDrift;         /* sensor clock against the display clock */
+    nsecs_t sensorJitter;       /* standard deviation of the timestamps */
+    nsecs_t processingMin;
+    nsecs_t processingMax;
+    nsecs_t binderMin;          /* getDisplayStats() */
+    nsecs_t binderMax;
+    nsecs_t wakeupMax;          /* wakeup latency of the scheduler thread */
+    int frames;
+};
+
+struct Frame {
+    nsecs_t timestamp;
+    nsecs_t ready;              /* pushed to the scheduler */
+};
+
+struct Result {
+    double intervalStdDevUs;
+    int judder;
+    int shown;
+    int dropped;
+    double addedLatencyMs;
+};
+
+class Simulation {
+public:
+    explicit Simulation(const Timeline &timeline)
+        : mTimeline(timeline),
+          mRandom(20200615)
+    {
+        nsecs_t sensorPeriod = (nsecs_t)(1e9 / timeline.sensorFps * (1.0 + timeline.sensorDrift));
+        std::normal_distribution<double> jitter(0, (double)timeline.sensorJitter);
+        std::uniform_int_distribution<nsecs_t> processing(timeline.processingMin, timeline.processingMax);
+        nsecs_t last = 0;
+
+        mVsyncPeriod = (nsecs_t)(1e9 / timeline.displayHz);
+        mVsyncPhase = 1000000000LL + 1234567;
+
+        for (int i = 0; i < timeline.frames; i++) {
+            Frame frame;
+
+            frame.timestamp = 1000000000LL + i * sensorPeriod + (nsecs_t)jitter(mRandom);
+            /* the pipeline keeps the frame order */
+            frame.ready = std::max(last, frame.timestamp + processing(mRandom));
+            last = frame.ready;
+            mFrames.push_back(frame);
+        }
+    }
+
+    Result runLegacy(void) {
+        nsecs_t vsyncOld = 0;
+        nsecs_t videoSyncPeriod = (nsecs_t)(1e9 / mTimeline.sensorFps + 0.5);
+        nsecs_t threadTime = 0;
+
+        mQueued.clear();
+        mDropped = 0;
+
+        for (size_t i = 0; i < mFrames.size(); i++) {
+            nsecs_t curTime = std::max(threadTime, mFrames[i].ready);
+
+            /* m_enableSkip */
+            if (newerFrameQueued(i, curTime)) {
+                mDropped++;
+                threadTime = curTime;
+                continue;
+            }
+
+            /* m_schedule() : curTime is taken before the binder call */
+            nsecs_t binder = random(mTimeline.binderMin, mTimeline.binderMax);
+            nsecs_t vsyncTime = nextVsync(curTime + binder);
+            nsecs_t delayTime = 0;
+
+            if (vsyncTime - vsyncOld <= videoSyncPeriod * 3 / 2 + kLegacyMultipleVsyncDetectOffset) {
+                if (videoSyncPeriod > mVsyncPeriod)
+                    delayTime = (vsyncTime - curTime + (videoSyncPeriod - mVsyncPeriod) + kLegacyScheduleOffset) % videoSyncPeriod;
+                else
+                    delayTime = (vsyncTime - curTime + kLegacyScheduleOffset) % videoSyncPeriod;
+            }
+            vsyncOld = vsyncTime;
+
+            /* usleep(delayUs) starts after the binder call */
+            nsecs_t wakeup = curTime + binder + (delayTime / 1000) * 1000 + random(0, mTimeline.wakeupMax);
+
+            threadTime = wakeup + kPutBufferCost;
+            mQueued.push_back({ i, threadTime });
+        }
+
+        return present();
+    }
+
+    Result runPacer(bool vsync) {
+        SecCameraPreviewPacer pacer;
+        nsecs_t threadTime = 0;
+
+        pacer.reset((nsecs_t)(1e9 / mTimeline.sensorFps + 0.5));
+        mQueued.clear();
+        mDropped = 0;
+
+        for (size_t i = 0; i < mFrames.size(); i++) {
+            nsecs_t popTime = std::max(threadTime, mFrames[i].ready);
+            nsecs_t now = popTime;
+            nsecs_t deadline = 0;
+
+            if (vsync) {
+                now += random(mTimeline.binderMin, mTimeline.binderMax);
+                /* the display stats give the next vsync, with a small error */
+                pacer.updateVsync(nextVsync(now) + random(-100000, 100000), mVsyncPeriod);
+            }
+
+            if (pacer.schedule(mFrames[i].timestamp, mFrames[i].ready, now, newerFrameQueued(i, popTime),
+                               &deadline)
+                == PREVIEW_PACING_DROP) {
+                mDropped++;
+                threadTime = now;
+                continue;
+            }
+
+            /* clock_nanosleep(TIMER_ABSTIME) */
+            nsecs_t wakeup = std::max(now, deadline) + random(0, mTimeline.wakeupMax);
+
+            threadTime = wakeup + kPutBufferCost;
+            mQueued.push_back({ i, threadTime });
+        }
+
+        return present();
+    }
+
+private:
+    struct Queued {
+        size_t frame;
+        nsecs_t time;
+    };
+
+    nsecs_t random(nsecs_t min, nsecs_t max) {
+        return std::uniform_int_distribution<nsecs_t>(min, max)(mRandom);
+    }
+
+    nsecs_t nextVsync(nsecs_t time) {
+        nsecs_t n = (time - mVsyncPhase) / mVsyncPeriod + 1;
+        return mVsyncPhase + n * mVsyncPeriod;
+    }
+
+    bool newerFrameQueued(size_t index, nsecs_t time) {
+        return (index + 1 < mFrames.size()) && (mFrames[index + 1].ready <= time);
+    }
+
+    /* what the display shows : the newest buffer latched on each vsync */
+    Result present(void) {
+        std::vector<std::pair<nsecs_t, size_t>> shown;     /* vsync, frame */
+        Result result = {};
+        double latency = 0;
+        double sum = 0, sum2 = 0;
+        int intervals = 0;
+        nsecs_t sensorPeriod = (nsecs_t)(1e9 / mTimeline.sensorFps);
+
+        for (const Queued &q : mQueued) {
+            nsecs_t vsync = nextVsync(q.time + kDisplayLatch);
+
+            if (!shown.empty() && shown.back().first == vsync)
+                shown.back().second = q.frame;
+            else
+                shown.push_back({ vsync, q.frame });
+        }
+
+        /* skip the start up */
+        size_t first = shown.size() / 10;
+
+        for (size_t i = first; i < shown.size(); i++) {
+            const Frame &frame = mFrames[shown[i].second];
+
+            latency += (double)(shown[i].first - frame.ready);
+            if (i > first) {
+                double interval = (double)(shown[i].first - shown[i - 1].first);
+
+                sum += interval;
+                sum2 += interval * interval;
+                intervals++;
+                if (fabs(interval - sensorPeriod) > mVsyncPeriod / 2)
+                    result.judder++;
+            }
+        }
+
+        double mean = sum / intervals;
+
+        result.intervalStdDevUs = sqrt(std::max(0.0, sum2 / intervals - mean * mean)) / 1000;
+        result.shown = (int)shown.size();
+        result.dropped = (int)(mFrames.size() - shown.size());
+        result.addedLatencyMs = latency / (shown.size() - first) / 1000000;
+
+        return result;
+    }
+
+    const Timeline mTimeline;
+    std::mt19937_64 mRandom;
+    std::vector<Frame> mFrames;
+    std::vector<Queued> mQueued;
+    nsecs_t mVsyncPhase;
+    nsecs_t mVsyncPeriod;
+    int mDropped;
+};
+
+void print(const char *name, const char *scheduler, const Result &result)
+{
+    printf("%-26s %-9s interval stddev %7.1f us, judder %4d, shown %5d, dropped %4d, added latency %5.2f ms\n",
+           name, scheduler, result.intervalStdDevUs, result.judder, result.shown, result.dropped,
+           result.addedLatencyMs);
+}
+
+const Timeline kTimelines[] = {
+    { "60fps on 60Hz",          60,  60,  0,      200000, 4000000, 22000000, 200000, 800000, 2000000, 3600 },
+    { "30fps on 60Hz",          30,  60,  0,      200000, 6000000, 30000000, 200000, 800000, 2000000, 1800 },
+    { "120fps on 120Hz",        120, 120, 0,      100000, 2000000, 12000000, 200000, 800000, 1000000, 7200 },
+    { "60fps on 60Hz, drift",   60,  60,  0.0005, 200000, 4000000, 22000000, 200000, 800000, 2000000, 3600 },
+};
+
+} // namespace
+
+TEST(SecCameraPreviewPacerSim, Schedule) {
+    int legacyJudder = 0;
+    int pacerJudder = 0;
+
+    for (const Timeline &timeline : kTimelines) {
+        Simulation simulation(timeline);
+        Result legacy = simulation.runLegacy();
+        Result pacer = simulation.runPacer(true);
+
+        print(timeline.name, "legacy", legacy);
+        print(timeline.name, "deadline", pacer);
+
+        EXPECT_LE(pacer.intervalStdDevUs, legacy.intervalStdDevUs + 1) << timeline.name;
+        EXPECT_LE(pacer.judder, legacy.judder) << timeline.name;
+        EXPECT_LE(pacer.dropped, legacy.dropped) << timeline.name;
+        EXPECT_LT(pacer.addedLatencyMs, legacy.addedLatencyMs + 1) << timeline.name;
+
+        legacyJudder += legacy.judder;
+        pacerJudder += pacer.judder;
+    }
+
+    EXPECT_LT(pacerJudder * 10, legacyJudder);
+}
+
+TEST(SecCameraPreviewPacerSim, DurationWithoutVsync) {
+    const Timeline &timeline = kTimelines[0];
+    Simulation simulation(timeline);
+    Result pacer = simulation.runPacer(false);
+
+    print(timeline.name, "duration", pacer);
+
+    EXPECT_LT(pacer.judder, timeline.frames / 100);
+}
+
+TEST(SecCameraPreviewPacerSim, DropsOnlyLateFramesWithNewerOnes) {
+    SecCameraPreviewPacer pacer;
+    nsecs_t period = 16666667;
+    nsecs_t deadline;
+
+    pacer.reset(period);
+    pacer.updateVsync(1000000000LL, period);
+
+    /* locks the latency on the first frame */
+    ASSERT_EQ(PREVIEW_PACING_PRESENT, pacer.schedule(990000000LL, 1000000000LL, 1000000000LL, false, &deadline));
+    EXPECT_GE(deadline, 1000000000LL);
+    EXPECT_EQ(0, (deadline + PREVIEW_PACING_LATCH_LEAD_NS - 1000000000LL) % period);
+
+    /* late, alone : presented right away */
+    nsecs_t late = deadline + period + 2 * PREVIEW_PACING_MISS_TOLERANCE_NS;
+    ASSERT_EQ(PREVIEW_PACING_PRESENT, pacer.schedule(990000000LL + period, late, late, false, &deadline));
+    EXPECT_EQ(late, deadline);
+    EXPECT_EQ(1u, pacer.getLateCount());
+
+    /* late, with a newer frame waiting : dropped */
+    EXPECT_EQ(PREVIEW_PACING_DROP, pacer.schedule(990000000LL + 2 * period, late + 2 * period, late + 2 * period, true, &deadline));
+
+    /* two frames for the same vsync */
+    nsecs_t latency = pacer.getLatency();
+    nsecs_t ts = 990000000LL + 6 * period;
+    ASSERT_EQ(PREVIEW_PACING_PRESENT, pacer.schedule(ts, ts + latency - 2 * period, ts + latency - 2 * period, false, &deadline));
+    EXPECT_EQ(PREVIEW_PACING_DROP, pacer.schedule(ts + period / 4, ts + latency - 2 * period, ts + latency - 2 * period, false, &deadline));
+}
+
+TEST(SecCameraPreviewPacerSim, CountsRepeatedVsyncs) {
+    SecCameraPreviewPacer pacer;
+    nsecs_t period = 16666667;
+    nsecs_t deadline;
+    nsecs_t ts = 990000000LL;
+
+    pacer.reset(period);
+    pacer.updateVsync(1000000000LL, period);
+
+    ASSERT_EQ(PREVIEW_PACING_PRESENT, pacer.schedule(ts, 1000000000LL, 1000000000LL, false, &deadline));
+    nsecs_t latency = pacer.getLatency();
+
+    /* the sensor skips two frames */
+    ts += 3 * period;
+    ASSERT_EQ(PREVIEW_PACING_PRESENT, pacer.schedule(ts, ts + latency - period, ts + latency - period, false, &deadline));
+    EXPECT_EQ(2u, pacer.getRepeatCount());
+}
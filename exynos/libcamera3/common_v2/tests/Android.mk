@@ -0,0 +1,93 @@
+# Copyright (C) 2020 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Included by the libcamera3 makefile of the board, after libexynoscamera3 :
+# the classes of the library are built with its flags and include paths.
+
+LOCAL_PATH:= $(call my-dir)
+
+#################
+# ExynosCameraPipeStopTest
+
+include $(CLEAR_VARS)
+
+LOCAL_PROPRIETARY_MODULE := true
+
+LOCAL_SRC_FILES := ExynosCameraPipeStopTest.cpp
+
+LOCAL_C_INCLUDES := $(EXYNOS_CAMERA3_C_INCLUDES)
+LOCAL_CFLAGS := $(EXYNOS_CAMERA3_CFLAGS)
+
+LOCAL_SHARED_LIBRARIES := libutils libcutils liblog libexynoscamera3
+
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := ExynosCameraPipeStopTest
+
+include $(BUILD_NATIVE_TEST)
+
+#################
+# ExynosCameraBufferRetentionPoolTest
+
+include $(CLEAR_VARS)
+
+LOCAL_PROPRIETARY_MODULE := true
+
+LOCAL_SRC_FILES := ExynosCameraBufferRetentionPoolTest.cpp
+
+LOCAL_C_INCLUDES := $(EXYNOS_CAMERA3_C_INCLUDES)
+LOCAL_CFLAGS := $(EXYNOS_CAMERA3_CFLAGS)
+
+LOCAL_SHARED_LIBRARIES := libutils libcutils liblog libexynoscamera3
+
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := ExynosCameraBufferRetentionPoolTest
+
+include $(BUILD_NATIVE_TEST)
+
+#################
+# ExynosCameraNodeDispatcherTest
+
+include $(CLEAR_VARS)
+
+LOCAL_PROPRIETARY_MODULE := true
+
+LOCAL_SRC_FILES := ExynosCameraNodeDispatcherTest.cpp
+
+LOCAL_C_INCLUDES := $(EXYNOS_CAMERA3_C_INCLUDES)
+LOCAL_CFLAGS := $(EXYNOS_CAMERA3_CFLAGS)
+
+LOCAL_SHARED_LIBRARIES := libutils libcutils liblog libexynoscamera3
+
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := ExynosCameraNodeDispatcherTest
+
+include $(BUILD_NATIVE_TEST)
+
+ifeq ($(BOARD_CAMERA_GED_FEATURE), false)
+#################
+# SecCameraPreviewPacerSim
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := ../Sec/tests/SecCameraPreviewPacerSim.cpp
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../Sec
+
+LOCAL_SHARED_LIBRARIES := libutils liblog
+
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := SecCameraPreviewPacerSim
+
+include $(BUILD_HOST_NATIVE_TEST)
+endif
@@ -0,0 +1,472 @@
+/*
+ * Copyright (C) 2020, Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of ExynosCameraBufferRetentionPool.
+ *
+ * The pool itself is tested on planes of FakeIonAllocator : a memfd of the
+ * size, zero filled as the ion system heap does, and mapped if asked.
+ *
+ * The reconfigurations run InternalExynosCameraBufferManager on the ion
+ * allocator of the HAL. A configuration is a set of internal buffer managers.
+ * A reconfiguration deinits all of them and allocates the next configuration,
+ * as configureStreams() does through ExynosCameraBufferSupplier.
+ * Checked: the planes taken from the pool instead of ion, and the peak
+ * footprint (planes in use + planes retained), without and with the pool.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <utils/Log.h>
+#include <utils/threads.h>
+
+#include "../Buffers/ExynosCameraBufferManager.h"
+#include "../Buffers/ExynosCameraBufferRetentionPool.h"
+
+using namespace android;
+
+namespace {
+
+const int kMaskSystem = 1;
+const int kMaskReserved = 2;
+const int kFlagNonCached = 0;
+const int kFlagCached = 3;
+const int64_t kBudget = 128LL * 1024 * 1024;
+const int kRounds = 6;
+
+class TestPool : public ExynosCameraBufferRetentionPool {
+public:
+    TestPool() {}
+    virtual ~TestPool() {}
+};
+
+bool isOpen(int fd)
+{
+    return fcntl(fd, F_GETFD) >= 0;
+}
+
+class FakeIonAllocator {
+public:
+    FakeIonAllocator() : m_allocCount(0) {}
+
+    status_t alloc(int size, int *fd, char **addr, __attribute__((unused)) int mask,
+                   __attribute__((unused)) int flags, bool mapNeeded)
+    {
+        char *ionAddr = NULL;
+        int ionFd = (int)syscall(SYS_memfd_create, "fakeIon", 0);
+
+        if (ionFd < 0 || ftruncate(ionFd, size) < 0) {
+            if (ionFd >= 0)
+                close(ionFd);
+            return INVALID_OPERATION;
+        }
+
+        /* the heap hands out zeroed pages */
+        ionAddr = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ionFd, 0);
+        if (ionAddr == MAP_FAILED) {
+            close(ionFd);
+            return INVALID_OPERATION;
+        }
+        memset(ionAddr, 0x00, size);
+
+        if (mapNeeded == false) {
+            munmap(ionAddr, size);
+            ionAddr = NULL;
+        }
+
+        *fd = ionFd;
+        *addr = ionAddr;
+        m_allocCount++;
+
+        return NO_ERROR;
+    }
+
+    status_t free(int size, int *fd, char **addr, bool mapNeeded)
+    {
+        if (mapNeeded == true && *addr != NULL)
+            munmap(*addr, size);
+        close(*fd);
+
+        *fd = -1;
+        *addr = NULL;
+
+        return NO_ERROR;
+    }
+
+    int getAllocCount(void) { return m_allocCount; }
+
+private:
+    int m_allocCount;
+};
+
+struct PlaneSpec {
+    const char *name;
+    int size;
+    int count;
+    bool cached;
+    bool mapNeeded;
+};
+
+#define BAYER_SIZE(w, h)    ((w) * (h) * 12 / 8)
+#define YUV_SIZE(w, h)      ((w) * (h) * 3 / 2)
+
+/* 12M wide sensor, photo in 16:9 */
+const PlaneSpec kPhotoWide[] = {
+    {"FLITE",     BAYER_SIZE(4032, 3024), 4, false, false},
+    {"3AA_ISP",   YUV_SIZE(4032, 3024),   2, false, false},
+    {"MCSC_PREV", YUV_SIZE(1920, 1080),   6, true,  true},
+    {"THUMBNAIL", YUV_SIZE(512, 384),     4, true,  true},
+};
+
+/* 12M tele sensor, photo : a bit different sizes */
+const PlaneSpec kPhotoTele[] = {
+    {"FLITE",     BAYER_SIZE(4000, 3000), 4, false, false},
+    {"3AA_ISP",   YUV_SIZE(4000, 3000),   2, false, false},
+    {"MCSC_PREV", YUV_SIZE(1920, 1080),   6, true,  true},
+    {"THUMBNAIL", YUV_SIZE(512, 384),     4, true,  true},
+};
+
+/* 4K video */
+const PlaneSpec kVideo[] = {
+    {"FLITE",     BAYER_SIZE(3840, 2160), 4, false, false},
+    {"3AA_ISP",   YUV_SIZE(3840, 2160),   2, false, false},
+    {"MCSC_PREV", YUV_SIZE(1920, 1080),   6, true,  true},
+    {"MCSC_REC",  YUV_SIZE(3840, 2160),   4, true,  false},
+};
+
+struct Config {
+    const PlaneSpec *specs;
+    int count;
+};
+
+#define CONFIG(specs) {specs, (int)(sizeof(specs) / sizeof(specs[0]))}
+
+/* as ExynosCamera::m_allocBuffers() for an internal buffer of the pipes */
+ExynosCameraBufferManager *newBufferManager(ExynosCameraIonAllocator *allocator,
+                                            ExynosCameraBufferRetentionPool *pool,
+                                            const PlaneSpec &spec)
+{
+    buffer_manager_configuration_t bufConfig;
+    ExynosCameraBufferManager *bufferMgr = new InternalExynosCameraBufferManager();
+
+    if (bufferMgr->create(spec.name, allocator) != NO_ERROR) {
+        delete bufferMgr;
+        return NULL;
+    }
+
+    if (pool != NULL)
+        bufferMgr->setRetentionPool(pool);
+
+    bufConfig.planeCount = 2;
+    bufConfig.size[0] = spec.size;
+    bufConfig.reqBufCount = spec.count;
+    bufConfig.allowedMaxBufCount = spec.count;
+    bufConfig.batchSize = 1;
+    bufConfig.type = spec.cached ? EXYNOS_CAMERA_BUFFER_ION_CACHED_TYPE : EXYNOS_CAMERA_BUFFER_ION_NONCACHED_TYPE;
+    bufConfig.allocMode = BUFFER_MANAGER_ALLOCATION_ATONCE;
+    bufConfig.createMetaPlane = true;
+    bufConfig.needMmap = spec.mapNeeded;
+    bufConfig.reservedMemoryCount = 0;
+
+    if (bufferMgr->setInfo(bufConfig) != NO_ERROR || bufferMgr->alloc() != NO_ERROR) {
+        delete bufferMgr;
+        return NULL;
+    }
+
+    return bufferMgr;
+}
+
+struct ReplayResult {
+    int64_t peakFootprint;
+    int planeCount;
+};
+
+/* configure configs[0], configs[1], ... kRounds times, then close */
+ReplayResult replay(const std::vector<Config> &configs, ExynosCameraBufferRetentionPool *pool)
+{
+    ExynosCameraIonAllocator allocator;
+    std::vector<ExynosCameraBufferManager *> managers;
+    ReplayResult result = {0, 0};
+    int64_t live = 0;
+    int64_t liveConfig = 0;
+
+    EXPECT_EQ(NO_ERROR, allocator.init(false));
+
+    for (int round = 0; round < kRounds; round++) {
+        for (size_t c = 0; c < configs.size(); c++) {
+            /* configureStreams() : the supplier deinit, then the new managers alloc */
+            for (size_t i = 0; i < managers.size(); i++) {
+                managers[i]->deinit();
+                delete managers[i];
+            }
+            managers.clear();
+            live -= liveConfig;
+            liveConfig = 0;
+
+            for (int i = 0; i < configs[c].count; i++) {
+                const PlaneSpec &spec = configs[c].specs[i];
+                ExynosCameraBufferManager *manager = newBufferManager(&allocator, pool, spec);
+
+                EXPECT_TRUE(manager != NULL) << spec.name;
+                if (manager == NULL)
+                    continue;
+
+                managers.push_back(manager);
+                liveConfig += (int64_t)spec.size * spec.count;
+                live += (int64_t)spec.size * spec.count;
+                result.planeCount += spec.count;
+
+                int64_t footprint = live + ((pool != NULL) ? pool->getRetainedSize() : 0);
+                if (result.peakFootprint < footprint)
+                    result.peakFootprint = footprint;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < managers.size(); i++) {
+        managers[i]->deinit();
+        delete managers[i];
+    }
+
+    return result;
+}
+
+void compare(const char *name, const std::vector<Config> &configs)
+{
+    TestPool pool;
+    pool.setBudget(kBudget);
+
+    ReplayResult legacy = replay(configs, NULL);
+    ReplayResult retained = replay(configs, &pool);
+
+    printf("%s : peak footprint (MB), image planes allocated from ion\n", name);
+    printf("  legacy   : peak %4d allocs %4d\n",
+           (int)(legacy.peakFootprint >> 20), legacy.planeCount);
+    printf("  retained : peak %4d allocs %4d (retained %d MB after close)\n",
+           (int)(retained.peakFootprint >> 20), pool.getMissCount(),
+           (int)(pool.getRetainedSize() >> 20));
+
+    EXPECT_EQ(legacy.planeCount, retained.planeCount);
+    /* every image plane is asked from the pool first : taken from it or allocated */
+    EXPECT_EQ(retained.planeCount, pool.getHitCount() + pool.getMissCount());
+    EXPECT_LT(pool.getMissCount(), legacy.planeCount);
+    /* a miss frees retained planes first : no more than without the pool */
+    EXPECT_LE(retained.peakFootprint, legacy.peakFootprint);
+    EXPECT_LE(pool.getPeakRetainedSize(), kBudget);
+
+    pool.flush();
+    EXPECT_EQ(0, pool.getRetainedCount());
+}
+
+}  // namespace
+
+TEST(ExynosCameraBufferRetentionPoolTest, SizeClass)
+{
+    /* below 8 pages, a class per page */
+    EXPECT_EQ(1, ExynosCameraBufferRetentionPool::getSizeClass(1));
+    EXPECT_EQ(1, ExynosCameraBufferRetentionPool::getSizeClass(4096));
+    EXPECT_EQ(2, ExynosCameraBufferRetentionPool::getSizeClass(4097));
+
+    /* 8 classes from 2^n to 2^(n + 1) pages */
+    EXPECT_EQ(1024, ExynosCameraBufferRetentionPool::getSizeClass(1024 * 4096));
+    EXPECT_EQ(1152, ExynosCameraBufferRetentionPool::getSizeClass(1024 * 4096 + 1));
+    EXPECT_EQ(1152, ExynosCameraBufferRetentionPool::getSizeClass(1152 * 4096));
+
+    /* wide and tele bayer are in one class, 4K is not */
+    EXPECT_EQ(ExynosCameraBufferRetentionPool::getSizeClass(BAYER_SIZE(4032, 3024)),
+              ExynosCameraBufferRetentionPool::getSizeClass(BAYER_SIZE(4000, 3000)));
+    EXPECT_NE(ExynosCameraBufferRetentionPool::getSizeClass(BAYER_SIZE(4032, 3024)),
+              ExynosCameraBufferRetentionPool::getSizeClass(BAYER_SIZE(3840, 2160)));
+}
+
+TEST(ExynosCameraBufferRetentionPoolTest, AdoptMatchesKey)
+{
+    TestPool pool;
+    FakeIonAllocator allocator;
+    int fd = -1;
+    char *addr = NULL;
+    int newFd = -1;
+    char *newAddr = NULL;
+    int size = YUV_SIZE(1920, 1080);
+
+    ASSERT_EQ(NO_ERROR, allocator.alloc(size, &fd, &addr, kMaskSystem, kFlagCached, true));
+    pool.track(fd, addr, size, kMaskSystem, kFlagCached, true);
+    EXPECT_TRUE(pool.release(fd, addr, true));
+    EXPECT_EQ(1, pool.getRetainedCount());
+    EXPECT_EQ(size, pool.getRetainedSize());
+    EXPECT_TRUE(isOpen(fd));
+
+    EXPECT_EQ(NO_ERROR, pool.adopt(size - 4096, kMaskSystem, kFlagCached, true, &newFd, &newAddr));
+    EXPECT_EQ(fd, newFd);
+    EXPECT_EQ(addr, newAddr);
+    EXPECT_EQ(0, pool.getRetainedCount());
+
+    /* the mapping is the allocated one : the whole size is there */
+    memset(newAddr, 0x5a, size);
+
+    /* other flags, heap, mapping, larger, or too small for the class */
+    struct {
+        int size;
+        int mask;
+        int flags;
+        bool mapNeeded;
+    } misses[] = {
+        {size,     kMaskSystem,   kFlagNonCached, true},
+        {size,     kMaskReserved, kFlagCached,    true},
+        {size,     kMaskSystem,   kFlagCached,    false},
+        {size + 1, kMaskSystem,   kFlagCached,    true},
+        {size / 2, kMaskSystem,   kFlagCached,    true},
+    };
+
+    for (size_t i = 0; i < sizeof(misses) / sizeof(misses[0]); i++) {
+        EXPECT_TRUE(pool.release(fd, addr, true));
+        EXPECT_EQ(NAME_NOT_FOUND, pool.adopt(misses[i].size, misses[i].mask, misses[i].flags, misses[i].mapNeeded, &newFd, &newAddr));
+
+        /* a miss frees as much for the new allocation */
+        EXPECT_EQ(0, pool.getRetainedCount());
+        EXPECT_FALSE(isOpen(fd));
+
+        ASSERT_EQ(NO_ERROR, allocator.alloc(size, &fd, &addr, kMaskSystem, kFlagCached, true));
+        pool.track(fd, addr, size, kMaskSystem, kFlagCached, true);
+    }
+
+    /* not reused : freed with the allocated size */
+    EXPECT_TRUE(pool.release(fd, addr, false));
+    EXPECT_EQ(0, pool.getRetainedCount());
+    EXPECT_FALSE(isOpen(fd));
+}
+
+TEST(ExynosCameraBufferRetentionPoolTest, UntrackedIsNotTaken)
+{
+    TestPool pool;
+    FakeIonAllocator allocator;
+    int fd = -1;
+    char *addr = NULL;
+
+    ASSERT_EQ(NO_ERROR, allocator.alloc(65536, &fd, &addr, kMaskSystem, kFlagNonCached, false));
+    EXPECT_FALSE(pool.release(fd, addr, true));
+    EXPECT_TRUE(isOpen(fd));
+    allocator.free(65536, &fd, &addr, false);
+}
+
+TEST(ExynosCameraBufferRetentionPoolTest, BudgetEvictsOldest)
+{
+    TestPool pool;
+    FakeIonAllocator allocator;
+    const int size = 1024 * 1024;
+    int fd[4];
+    char *addr[4];
+
+    pool.setBudget(3 * size);
+
+    for (int i = 0; i < 4; i++) {
+        ASSERT_EQ(NO_ERROR, allocator.alloc(size, &fd[i], &addr[i], kMaskSystem, kFlagNonCached, false));
+        pool.track(fd[i], addr[i], size, kMaskSystem, kFlagNonCached, false);
+    }
+    for (int i = 0; i < 4; i++)
+        EXPECT_TRUE(pool.release(fd[i], addr[i], true));
+
+    EXPECT_EQ(3, pool.getRetainedCount());
+    EXPECT_EQ(3 * size, pool.getRetainedSize());
+    EXPECT_FALSE(isOpen(fd[0]));
+    EXPECT_TRUE(isOpen(fd[3]));
+
+    /* larger than the budget : not retained */
+    int bigFd = -1;
+    char *bigAddr = NULL;
+    ASSERT_EQ(NO_ERROR, allocator.alloc(4 * size, &bigFd, &bigAddr, kMaskSystem, kFlagNonCached, false));
+    pool.track(bigFd, bigAddr, 4 * size, kMaskSystem, kFlagNonCached, false);
+    EXPECT_TRUE(pool.release(bigFd, bigAddr, true));
+    EXPECT_FALSE(isOpen(bigFd));
+    EXPECT_EQ(3, pool.getRetainedCount());
+
+    pool.setBudget(size);
+    EXPECT_EQ(1, pool.getRetainedCount());
+    EXPECT_TRUE(isOpen(fd[3]));
+
+    pool.setBudget(0);
+    EXPECT_EQ(0, pool.getRetainedCount());
+    EXPECT_FALSE(isOpen(fd[3]));
+}
+
+TEST(ExynosCameraBufferRetentionPoolTest, TimedTrim)
+{
+    TestPool pool;
+    FakeIonAllocator allocator;
+    int fd = -1;
+    char *addr = NULL;
+
+    pool.setTimeout(ms2ns(50));
+
+    ASSERT_EQ(NO_ERROR, allocator.alloc(65536, &fd, &addr, kMaskSystem, kFlagCached, true));
+    pool.track(fd, addr, 65536, kMaskSystem, kFlagCached, true);
+    EXPECT_TRUE(pool.release(fd, addr, true));
+
+    pool.trim();
+    EXPECT_EQ(1, pool.getRetainedCount());
+
+    /* the trim thread frees it without a call */
+    for (int i = 0; i < 40 && pool.getRetainedCount() > 0; i++)
+        usleep(10000);
+
+    EXPECT_EQ(0, pool.getRetainedCount());
+    EXPECT_EQ(0, pool.getRetainedSize());
+    EXPECT_FALSE(isOpen(fd));
+}
+
+TEST(ExynosCameraBufferRetentionPoolTest, PhotoVideoSwitch)
+{
+    std::vector<Config> configs;
+    Config photo = CONFIG(kPhotoWide);
+    Config video = CONFIG(kVideo);
+
+    configs.push_back(photo);
+    configs.push_back(video);
+
+    /* only the preview planes are shared */
+    compare("photo <-> video", configs);
+}
+
+TEST(ExynosCameraBufferRetentionPoolTest, LensSwitch)
+{
+    std::vector<Config> configs;
+    Config wide = CONFIG(kPhotoWide);
+    Config tele = CONFIG(kPhotoTele);
+
+    configs.push_back(wide);
+    configs.push_back(tele);
+
+    compare("wide <-> tele", configs);
+}
+
+TEST(ExynosCameraBufferRetentionPoolTest, Reopen)
+{
+    std::vector<Config> configs;
+    Config photo = CONFIG(kPhotoWide);
+
+    configs.push_back(photo);
+
+    compare("close / open", configs);
+}
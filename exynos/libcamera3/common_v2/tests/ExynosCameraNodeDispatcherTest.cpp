@@ -0,0 +1,514 @@
+/*
+ * Copyright (C) 2020, Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Native test of ExynosCameraNodeDispatcher, run on the device.
+ *
+ * MockNode stands for a V4L2 node : an eventfd counts the done buffers, so
+ * the fd polls readable while a buffer can be dequeued, and dqbuf() returns
+ * the time the buffer was done. MockPipe gets a buffer from its node, works
+ * on it and queues it to the node of the next stage, the last stage counts
+ * the frame. A session is kCameraNum cameras of kStageNum stages.
+ *
+ * The thread per pipe model runs the get side of each pipe on its own
+ * ExynosCameraThread, blocked in poll() as ExynosCameraNode::m_polling().
+ * The dispatcher model registers all the node fds in one dispatcher.
+ * Reported: the handoff latency of a stage (buffer done to dqbuf returned),
+ * the process CPU time and the context switches of the session.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <utils/Log.h>
+#include <utils/threads.h>
+
+#include "../ExynosCameraNodeDispatcher.h"
+
+using namespace android;
+
+namespace {
+
+const int kCameraNum = 4;
+const int kStageNum = 4;
+const int kFrameNum = 120;
+const nsecs_t kFramePeriod = 8333333;  /* 120fps */
+const nsecs_t kStageWork = 20000;      /* 20us of work per stage */
+
+class MockNode {
+public:
+    MockNode() : m_streaming(true)
+    {
+        m_fd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE | EFD_CLOEXEC);
+    }
+
+    ~MockNode()
+    {
+        close(m_fd);
+    }
+
+    int getFd(void)
+    {
+        return m_fd;
+    }
+
+    /* the driver is done with a buffer */
+    void done(nsecs_t doneTime)
+    {
+        uint64_t count = 1;
+
+        m_lock.lock();
+        m_doneTime.push_back(doneTime);
+        m_lock.unlock();
+
+        if (write(m_fd, &count, sizeof(count)) < 0)
+            ALOGE("write eventfd fail, errno(%d)", errno);
+    }
+
+    /* stream off : a blocked poll returns and dqbuf fails */
+    void streamOff(void)
+    {
+        uint64_t count = 1;
+
+        m_lock.lock();
+        m_streaming = false;
+        m_lock.unlock();
+
+        if (write(m_fd, &count, sizeof(count)) < 0)
+            ALOGE("write eventfd fail, errno(%d)", errno);
+    }
+
+    /* as ExynosCameraNode::m_polling() : 50 msec * 40 */
+    int polling(void)
+    {
+        struct pollfd events;
+        int cnt = 40;
+
+        events.fd = m_fd;
+        events.events = POLLIN | POLLERR;
+
+        while (cnt--) {
+            events.revents = 0;
+            int pollRet = poll(&events, 1, 50);
+            if (pollRet < 0)
+                return -1;
+            if (pollRet > 0 && (events.revents & POLLIN))
+                return 0;
+        }
+
+        return -1;
+    }
+
+    status_t dqbuf(nsecs_t *doneTime)
+    {
+        uint64_t count;
+
+        if (read(m_fd, &count, sizeof(count)) < 0)
+            return INVALID_OPERATION;
+
+        Mutex::Autolock lock(m_lock);
+
+        if (m_streaming == false || m_doneTime.empty() == true)
+            return INVALID_OPERATION;
+
+        *doneTime = m_doneTime.front();
+        m_doneTime.pop_front();
+
+        return NO_ERROR;
+    }
+
+private:
+    int m_fd;
+    Mutex m_lock;
+    bool m_streaming;
+    std::deque<nsecs_t> m_doneTime;
+};
+
+void busyWork(nsecs_t duration)
+{
+    nsecs_t endTime = systemTime(SYSTEM_TIME_MONOTONIC) + duration;
+
+    while (systemTime(SYSTEM_TIME_MONOTONIC) < endTime)
+        ;
+}
+
+class MockPipe {
+public:
+    MockPipe(MockNode *node, MockNode *nextNode, std::atomic<int> *frameDoneCount)
+        : m_node(node), m_nextNode(nextNode), m_frameDoneCount(frameDoneCount), m_runningCount(0)
+    {
+        m_getBufferThread = new ExynosCameraThread<MockPipe>(this, &MockPipe::m_getBufferThreadFunc, "getBuf");
+        m_getBufferHandler = new ExynosCameraNodeHandler<MockPipe>(this, &MockPipe::m_getBufferHandlerFunc);
+        m_latency.reserve(kFrameNum);
+    }
+
+    ~MockPipe()
+    {
+        delete m_getBufferHandler;
+    }
+
+    void startThread(void)
+    {
+        m_getBufferThread->run();
+    }
+
+    void stopThread(void)
+    {
+        m_getBufferThread->requestExitAndWait();
+    }
+
+    ExynosCameraNodeHandlerBase *getHandler(void)
+    {
+        return m_getBufferHandler;
+    }
+
+    std::vector<nsecs_t> &getLatency(void)
+    {
+        return m_latency;
+    }
+
+private:
+    bool m_getBufferThreadFunc(void)
+    {
+        if (m_node->polling() < 0)
+            return false;
+
+        return m_getBuffer();
+    }
+
+    bool m_getBufferHandlerFunc(uint32_t)
+    {
+        /* one shot : never on two workers at once */
+        EXPECT_EQ(1, ++m_runningCount);
+        bool ret = m_getBuffer();
+        m_runningCount--;
+
+        return ret;
+    }
+
+    bool m_getBuffer(void)
+    {
+        nsecs_t doneTime;
+
+        if (m_node->dqbuf(&doneTime) != NO_ERROR)
+            return false;
+
+        m_latency.push_back(systemTime(SYSTEM_TIME_MONOTONIC) - doneTime);
+
+        busyWork(kStageWork);
+
+        if (m_nextNode != NULL)
+            m_nextNode->done(systemTime(SYSTEM_TIME_MONOTONIC));
+        else
+            (*m_frameDoneCount)++;
+
+        return true;
+    }
+
+    MockNode *m_node;
+    MockNode *m_nextNode;
+    std::atomic<int> *m_frameDoneCount;
+    std::atomic<int> m_runningCount;
+    sp<ExynosCameraThread<MockPipe> > m_getBufferThread;
+    ExynosCameraNodeHandlerBase *m_getBufferHandler;
+    std::vector<nsecs_t> m_latency;
+};
+
+struct Result {
+    int frameDoneCount;
+    int threadNum;
+    nsecs_t meanLatency;
+    nsecs_t p99Latency;
+    nsecs_t cpuTime;
+    long contextSwitch;
+};
+
+nsecs_t processCpuTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+    return (nsecs_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+long contextSwitchCount(void)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+Result runSession(bool useDispatcher)
+{
+    Result result;
+    std::atomic<int> frameDoneCount(0);
+    std::vector<MockNode *> nodes;
+    std::vector<MockPipe *> pipes;
+    ExynosCameraNodeDispatcher dispatcher("testDispatcher");
+
+    for (int i = 0; i < kCameraNum * kStageNum; i++)
+        nodes.push_back(new MockNode());
+
+    for (int cam = 0; cam < kCameraNum; cam++) {
+        for (int stage = 0; stage < kStageNum; stage++) {
+            int index = cam * kStageNum + stage;
+            MockNode *nextNode = (stage < kStageNum - 1) ? nodes[index + 1] : NULL;
+            pipes.push_back(new MockPipe(nodes[index], nextNode, &frameDoneCount));
+        }
+    }
+
+    if (useDispatcher == true) {
+        EXPECT_EQ(NO_ERROR, dispatcher.create());
+        for (size_t i = 0; i < pipes.size(); i++)
+            EXPECT_EQ(NO_ERROR, dispatcher.registerNode(nodes[i]->getFd(), pipes[i]->getHandler()));
+        result.threadNum = 1 + dispatcher.getWorkerNum();
+    } else {
+        for (size_t i = 0; i < pipes.size(); i++)
+            pipes[i]->startThread();
+        result.threadNum = (int)pipes.size();
+    }
+
+    /* let the threads settle in poll */
+    usleep(20000);
+
+    nsecs_t cpuTime = processCpuTime();
+    long contextSwitch = contextSwitchCount();
+    nsecs_t frameTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    for (int frame = 0; frame < kFrameNum; frame++) {
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (frameTime > now)
+            usleep(ns2us(frameTime - now));
+
+        /* the sensor frame is done on the first stage of each camera */
+        for (int cam = 0; cam < kCameraNum; cam++)
+            nodes[cam * kStageNum]->done(systemTime(SYSTEM_TIME_MONOTONIC));
+
+        frameTime += kFramePeriod;
+    }
+
+    for (int i = 0; i < 200 && frameDoneCount < kCameraNum * kFrameNum; i++)
+        usleep(1000);
+
+    result.cpuTime = processCpuTime() - cpuTime;
+    result.contextSwitch = contextSwitchCount() - contextSwitch;
+    result.frameDoneCount = frameDoneCount;
+
+    if (useDispatcher == true) {
+        for (size_t i = 0; i < pipes.size(); i++)
+            EXPECT_EQ(NO_ERROR, dispatcher.unregisterNode(nodes[i]->getFd()));
+        EXPECT_EQ(0, dispatcher.getNodeCount());
+        dispatcher.destroy();
+    } else {
+        for (size_t i = 0; i < nodes.size(); i++)
+            nodes[i]->streamOff();
+        for (size_t i = 0; i < pipes.size(); i++)
+            pipes[i]->stopThread();
+    }
+
+    std::vector<nsecs_t> latency;
+    for (size_t i = 0; i < pipes.size(); i++)
+        latency.insert(latency.end(), pipes[i]->getLatency().begin(), pipes[i]->getLatency().end());
+
+    nsecs_t sum = 0;
+    for (size_t i = 0; i < latency.size(); i++)
+        sum += latency[i];
+    std::sort(latency.begin(), latency.end());
+    result.meanLatency = latency.empty() ? 0 : sum / (nsecs_t)latency.size();
+    result.p99Latency = latency.empty() ? 0 : latency[(latency.size() * 99) / 100];
+
+    for (size_t i = 0; i < pipes.size(); i++)
+        delete pipes[i];
+    for (size_t i = 0; i < nodes.size(); i++)
+        delete nodes[i];
+
+    return result;
+}
+
+void printResult(const char *name, const Result &result)
+{
+    printf("  %-10s : thread %2d, frame %4d, handoff mean %5d p99 %5d usec, cpu %6d usec, context switch %5ld\n",
+           name, result.threadNum, result.frameDoneCount,
+           (int)ns2us(result.meanLatency), (int)ns2us(result.p99Latency),
+           (int)ns2us(result.cpuTime), result.contextSwitch);
+}
+
+/* a node whose handler is driven by the test */
+class StubHandler : public ExynosCameraNodeHandlerBase {
+public:
+    StubHandler(MockNode *node) : m_node(node), m_callCount(0), m_blockTime(0), m_rearm(true),
+        m_dispatcher(NULL), m_unregisterRet(NO_ERROR) {}
+
+    virtual bool handle(uint32_t)
+    {
+        nsecs_t doneTime;
+
+        m_callCount++;
+        m_node->dqbuf(&doneTime);
+
+        if (m_blockTime > 0)
+            usleep(ns2us(m_blockTime));
+
+        if (m_dispatcher != NULL)
+            m_unregisterRet = m_dispatcher->unregisterNode(m_node->getFd());
+
+        return m_rearm;
+    }
+
+    MockNode *m_node;
+    std::atomic<int> m_callCount;
+    nsecs_t m_blockTime;
+    std::atomic<bool> m_rearm;
+    ExynosCameraNodeDispatcher *m_dispatcher;
+    status_t m_unregisterRet;
+};
+
+}  // namespace
+
+TEST(ExynosCameraNodeDispatcherTest, SessionHandoff)
+{
+    Result thread = runSession(false);
+    Result dispatch = runSession(true);
+
+    printf("%d cameras x %d stages, %d frames at %d fps, %d usec of work per stage\n",
+           kCameraNum, kStageNum, kFrameNum, (int)(1000000000LL / kFramePeriod), (int)ns2us(kStageWork));
+    printResult("per pipe", thread);
+    printResult("dispatcher", dispatch);
+
+    EXPECT_EQ(kCameraNum * kFrameNum, thread.frameDoneCount);
+    EXPECT_EQ(kCameraNum * kFrameNum, dispatch.frameDoneCount);
+    EXPECT_LT(dispatch.threadNum, thread.threadNum);
+    /* a stage is a wake up away in both models */
+    EXPECT_LT(dispatch.meanLatency, ms2ns(2));
+}
+
+TEST(ExynosCameraNodeDispatcherTest, ParkUntilArm)
+{
+    ExynosCameraNodeDispatcher dispatcher("testDispatcher", 1);
+    MockNode node;
+    StubHandler handler(&node);
+
+    ASSERT_EQ(NO_ERROR, dispatcher.create());
+    handler.m_rearm = false;
+    ASSERT_EQ(NO_ERROR, dispatcher.registerNode(node.getFd(), &handler));
+
+    node.done(systemTime(SYSTEM_TIME_MONOTONIC));
+    node.done(systemTime(SYSTEM_TIME_MONOTONIC));
+    usleep(20000);
+    /* parked with a buffer left */
+    EXPECT_EQ(1, handler.m_callCount);
+
+    EXPECT_EQ(NO_ERROR, dispatcher.armNode(node.getFd()));
+    usleep(20000);
+    EXPECT_EQ(2, handler.m_callCount);
+
+    EXPECT_EQ(NO_ERROR, dispatcher.unregisterNode(node.getFd()));
+    EXPECT_EQ(NAME_NOT_FOUND, dispatcher.armNode(node.getFd()));
+}
+
+TEST(ExynosCameraNodeDispatcherTest, UnregisterWaitsForHandler)
+{
+    ExynosCameraNodeDispatcher dispatcher("testDispatcher");
+    MockNode node;
+    StubHandler handler(&node);
+
+    ASSERT_EQ(NO_ERROR, dispatcher.create());
+    handler.m_blockTime = ms2ns(30);
+    ASSERT_EQ(NO_ERROR, dispatcher.registerNode(node.getFd(), &handler));
+
+    node.done(systemTime(SYSTEM_TIME_MONOTONIC));
+    usleep(5000);
+
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    EXPECT_EQ(NO_ERROR, dispatcher.unregisterNode(node.getFd()));
+    EXPECT_GE(systemTime(SYSTEM_TIME_MONOTONIC) - startTime, ms2ns(15));
+    EXPECT_FALSE(dispatcher.isRegistered(node.getFd()));
+
+    /* not called anymore */
+    node.done(systemTime(SYSTEM_TIME_MONOTONIC));
+    usleep(20000);
+    EXPECT_EQ(1, handler.m_callCount);
+}
+
+TEST(ExynosCameraNodeDispatcherTest, UnregisterTimeout)
+{
+    ExynosCameraNodeDispatcher dispatcher("testDispatcher");
+    MockNode node;
+    StubHandler handler(&node);
+
+    ASSERT_EQ(NO_ERROR, dispatcher.create());
+    handler.m_blockTime = ms2ns(80);
+    ASSERT_EQ(NO_ERROR, dispatcher.registerNode(node.getFd(), &handler));
+
+    node.done(systemTime(SYSTEM_TIME_MONOTONIC));
+    usleep(5000);
+
+    EXPECT_EQ(TIMED_OUT, dispatcher.unregisterNode(node.getFd(), ms2ns(10)));
+    /* the handler is still in use until the next unregister returns */
+    EXPECT_EQ(NO_ERROR, dispatcher.unregisterNode(node.getFd()));
+    EXPECT_EQ(NAME_NOT_FOUND, dispatcher.unregisterNode(node.getFd()));
+    EXPECT_EQ(0, dispatcher.getNodeCount());
+}
+
+TEST(ExynosCameraNodeDispatcherTest, UnregisterFromHandler)
+{
+    ExynosCameraNodeDispatcher dispatcher("testDispatcher", 1);
+    MockNode node;
+    StubHandler handler(&node);
+
+    ASSERT_EQ(NO_ERROR, dispatcher.create());
+    handler.m_dispatcher = &dispatcher;
+    ASSERT_EQ(NO_ERROR, dispatcher.registerNode(node.getFd(), &handler));
+
+    node.done(systemTime(SYSTEM_TIME_MONOTONIC));
+    usleep(20000);
+
+    EXPECT_EQ(1, handler.m_callCount);
+    EXPECT_EQ(NO_ERROR, handler.m_unregisterRet);
+    EXPECT_EQ(0, dispatcher.getNodeCount());
+}
+
+TEST(ExynosCameraNodeDispatcherTest, RegisterErrors)
+{
+    ExynosCameraNodeDispatcher dispatcher("testDispatcher");
+    MockNode node;
+    StubHandler handler(&node);
+
+    EXPECT_EQ(INVALID_OPERATION, dispatcher.registerNode(node.getFd(), &handler));
+
+    ASSERT_EQ(NO_ERROR, dispatcher.create());
+    EXPECT_EQ(BAD_VALUE, dispatcher.registerNode(-1, &handler));
+    EXPECT_EQ(BAD_VALUE, dispatcher.registerNode(node.getFd(), NULL));
+    EXPECT_EQ(NO_ERROR, dispatcher.registerNode(node.getFd(), &handler));
+    EXPECT_EQ(ALREADY_EXISTS, dispatcher.registerNode(node.getFd(), &handler));
+    EXPECT_EQ(NO_ERROR, dispatcher.unregisterNode(node.getFd()));
+    EXPECT_EQ(NAME_NOT_FOUND, dispatcher.unregisterNode(node.getFd()));
+}
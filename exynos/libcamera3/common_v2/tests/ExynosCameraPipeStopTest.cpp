@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2020, Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of the pipe thread teardown.
+ *
+ * TestPipe is an ExynosCameraPipe : start(), stop(), startThread(),
+ * stopThread(), setStopFlag(), stopThreadAndWait(), the thread function and
+ * the try stop handling are the ones of the HAL. Only the device is replaced :
+ * FakeNode stands for a V4L2 capture node, its dqbuf blocks until the next
+ * frame or until the stream off. The output side of the pipe does nothing.
+ *
+ * The tests check the order of the node calls and the state of the thread,
+ * never how long a stop took.
+ */
+
+#include <unistd.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <utils/Log.h>
+#include <utils/threads.h>
+
+#include "../Pipes2/ExynosCameraPipe.h"
+
+using namespace android;
+
+namespace {
+
+const nsecs_t kFramePeriod = 33333333;
+const int kStopSleepMs = 5;     /* ExynosCameraFrameFactoryBase::stopThreadAndWait() */
+const int kStopTimes = 40;
+
+enum NodeEvent {
+    EVENT_STREAM_ON,
+    EVENT_DQBUF,
+    EVENT_STREAM_OFF,
+};
+
+class FakeNode : public ExynosCameraNode {
+public:
+    FakeNode() : m_streaming(false), m_frameCount(0), m_nextFrameTime(0) {}
+
+    virtual status_t start(void)
+    {
+        Mutex::Autolock lock(m_lock);
+        m_streaming = true;
+        m_nextFrameTime = systemTime(SYSTEM_TIME_MONOTONIC) + kFramePeriod;
+        m_events.push_back(EVENT_STREAM_ON);
+        return NO_ERROR;
+    }
+
+    /* stream off : a blocked dqbuf returns with an error */
+    virtual status_t stop(void)
+    {
+        Mutex::Autolock lock(m_lock);
+        m_streaming = false;
+        m_events.push_back(EVENT_STREAM_OFF);
+        m_condition.broadcast();
+        return NO_ERROR;
+    }
+
+    virtual status_t getBuffer(__unused ExynosCameraBuffer *buf, int *dqIndex)
+    {
+        Mutex::Autolock lock(m_lock);
+        m_events.push_back(EVENT_DQBUF);
+
+        while (m_streaming == true) {
+            nsecs_t remain = m_nextFrameTime - systemTime(SYSTEM_TIME_MONOTONIC);
+            if (remain <= 0) {
+                m_nextFrameTime += kFramePeriod;
+                *dqIndex = m_frameCount++;
+                m_condition.broadcast();
+                return NO_ERROR;
+            }
+            m_condition.waitRelative(m_lock, remain);
+        }
+
+        return INVALID_OPERATION;
+    }
+
+    virtual status_t clrBuffers(void)
+    {
+        return NO_ERROR;
+    }
+
+    virtual void removeItemBufferQ(void)
+    {
+    }
+
+    virtual status_t close(void)
+    {
+        return NO_ERROR;
+    }
+
+    /* the frames dequeued so far, false if fewer came before the bound */
+    bool waitFrames(int count, nsecs_t timeout)
+    {
+        Mutex::Autolock lock(m_lock);
+        nsecs_t endTime = systemTime(SYSTEM_TIME_MONOTONIC) + timeout;
+
+        while (m_frameCount < count) {
+            nsecs_t remain = endTime - systemTime(SYSTEM_TIME_MONOTONIC);
+            if (remain <= 0)
+                return false;
+            m_condition.waitRelative(m_lock, remain);
+        }
+
+        return true;
+    }
+
+    int getFrameCount(void)
+    {
+        Mutex::Autolock lock(m_lock);
+        return m_frameCount;
+    }
+
+    std::vector<NodeEvent> getEvents(void)
+    {
+        Mutex::Autolock lock(m_lock);
+        return m_events;
+    }
+
+private:
+    Mutex m_lock;
+    Condition m_condition;
+    bool m_streaming;
+    int m_frameCount;
+    nsecs_t m_nextFrameTime;
+    std::vector<NodeEvent> m_events;
+};
+
+class TestPipe : public ExynosCameraPipe {
+public:
+    TestPipe() : ExynosCameraPipe(), m_loopCount(0)
+    {
+        setName("TestPipe");
+
+        m_fakeNode = new FakeNode();
+        m_node[OUTPUT_NODE] = m_fakeNode;
+        m_mainNodeNum = OUTPUT_NODE;
+        m_mainNode = m_node[OUTPUT_NODE];
+
+        /* as create(), without a device to open */
+        m_mainThread = new ExynosCameraThread<TestPipe>(this, &TestPipe::m_mainThreadFunc, "mainThread");
+        m_inputFrameQ = new frame_queue_t;
+
+        setOutputFrameQ(&m_outputQ);
+    }
+
+    virtual ~TestPipe()
+    {
+        m_mainThread->requestExitAndWait();
+        destroy();
+    }
+
+    FakeNode *node(void)
+    {
+        return m_fakeNode;
+    }
+
+    int getLoopCount(void)
+    {
+        Mutex::Autolock lock(m_countLock);
+        return m_loopCount;
+    }
+
+protected:
+    virtual bool m_mainThreadFunc(void)
+    {
+        {
+            Mutex::Autolock lock(m_countLock);
+            m_loopCount++;
+        }
+
+        return ExynosCameraPipe::m_mainThreadFunc();
+    }
+
+    virtual status_t m_getBuffer(void)
+    {
+        ExynosCameraBuffer buffer;
+        int index = -1;
+
+        return m_mainNode->getBuffer(&buffer, &index);
+    }
+
+    virtual status_t m_putBuffer(void)
+    {
+        return NO_ERROR;
+    }
+
+private:
+    FakeNode *m_fakeNode;
+    frame_queue_t m_outputQ;
+    Mutex m_countLock;
+    int m_loopCount;
+};
+
+/* no dqbuf is started once the stream is off */
+void expectNoDqbufAfterStreamOff(const std::vector<NodeEvent> &events)
+{
+    bool streamOff = false;
+
+    for (size_t i = 0; i < events.size(); i++) {
+        if (events[i] == EVENT_STREAM_ON)
+            streamOff = false;
+        else if (events[i] == EVENT_STREAM_OFF)
+            streamOff = true;
+        else
+            EXPECT_FALSE(streamOff) << "dqbuf after the stream off, event " << i;
+    }
+}
+
+}  // namespace
+
+/* ExynosCameraFrameFactory::stopPipes() : stopThread, stop flag, pipe stop, wait */
+TEST(ExynosCameraPipeStopTest, FactoryStopOrder)
+{
+    TestPipe pipe;
+
+    ASSERT_EQ(NO_ERROR, pipe.start());
+    ASSERT_EQ(NO_ERROR, pipe.startThread());
+    ASSERT_TRUE(pipe.node()->waitFrames(2, s2ns(2)));
+
+    EXPECT_EQ(NO_ERROR, pipe.stopThread());
+    EXPECT_EQ(NO_ERROR, pipe.setStopFlag());
+    EXPECT_EQ(NO_ERROR, pipe.stop());
+
+    EXPECT_EQ(NO_ERROR, pipe.stopThreadAndWait(kStopSleepMs, kStopTimes));
+    EXPECT_FALSE(pipe.flagStartThread());
+
+    std::vector<NodeEvent> events = pipe.node()->getEvents();
+    ASSERT_FALSE(events.empty());
+    EXPECT_EQ(EVENT_STREAM_ON, events.front());
+    EXPECT_EQ(EVENT_STREAM_OFF, events.back());
+    expectNoDqbufAfterStreamOff(events);
+}
+
+/* the thread runs into a stop flag already set : it never touches the node */
+TEST(ExynosCameraPipeStopTest, ParkedInTryStop)
+{
+    TestPipe pipe;
+
+    ASSERT_EQ(NO_ERROR, pipe.start());
+    ASSERT_EQ(NO_ERROR, pipe.setStopFlag());
+    ASSERT_EQ(NO_ERROR, pipe.startThread());
+    usleep(50000);
+
+    EXPECT_TRUE(pipe.flagStartThread());
+
+    EXPECT_EQ(NO_ERROR, pipe.stopThread());
+    EXPECT_EQ(NO_ERROR, pipe.stopThreadAndWait(kStopSleepMs, kStopTimes));
+    EXPECT_FALSE(pipe.flagStartThread());
+    EXPECT_EQ(NO_ERROR, pipe.stop());
+
+    std::vector<NodeEvent> events = pipe.node()->getEvents();
+    ASSERT_EQ(2u, events.size());
+    EXPECT_EQ(EVENT_STREAM_ON, events[0]);
+    EXPECT_EQ(EVENT_STREAM_OFF, events[1]);
+}
+
+/* no exit request and no stream off : the wait gives up and the thread keeps streaming */
+TEST(ExynosCameraPipeStopTest, WaitExitIsBounded)
+{
+    TestPipe pipe;
+
+    ASSERT_EQ(NO_ERROR, pipe.start());
+    ASSERT_EQ(NO_ERROR, pipe.startThread());
+    ASSERT_TRUE(pipe.node()->waitFrames(1, s2ns(2)));
+
+    EXPECT_EQ(TIMED_OUT, pipe.stopThreadAndWait(kStopSleepMs, 4));
+    EXPECT_TRUE(pipe.flagStartThread());
+
+    int frameCount = pipe.node()->getFrameCount();
+    EXPECT_TRUE(pipe.node()->waitFrames(frameCount + 1, s2ns(2)));
+
+    EXPECT_EQ(NO_ERROR, pipe.stopThread());
+    EXPECT_EQ(NO_ERROR, pipe.setStopFlag());
+    EXPECT_EQ(NO_ERROR, pipe.stop());
+    EXPECT_EQ(NO_ERROR, pipe.stopThreadAndWait(kStopSleepMs, kStopTimes));
+    EXPECT_FALSE(pipe.flagStartThread());
+}
+
+TEST(ExynosCameraPipeStopTest, WaitExitNotStarted)
+{
+    TestPipe pipe;
+
+    EXPECT_FALSE(pipe.flagStartThread());
+    EXPECT_EQ(NO_ERROR, pipe.stopThreadAndWait(kStopSleepMs, kStopTimes));
+}
+
+TEST(ExynosCameraPipeStopTest, RestartAfterStop)
+{
+    TestPipe pipe;
+
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(NO_ERROR, pipe.start());
+        ASSERT_EQ(NO_ERROR, pipe.startThread());
+        ASSERT_TRUE(pipe.node()->waitFrames(i + 1, s2ns(2)));
+
+        EXPECT_EQ(NO_ERROR, pipe.stopThread());
+        EXPECT_EQ(NO_ERROR, pipe.setStopFlag());
+        EXPECT_EQ(NO_ERROR, pipe.stop());
+        EXPECT_EQ(NO_ERROR, pipe.stopThreadAndWait(kStopSleepMs, kStopTimes));
+        EXPECT_FALSE(pipe.flagStartThread());
+    }
+
+    expectNoDqbufAfterStreamOff(pipe.node()->getEvents());
+}
+
+/*
+ * stopThread() wakes the try stop for the exit. A thread started again while
+ * the stop is still tried must wait in it, not spin on the stale wake up.
+ */
+TEST(ExynosCameraPipeStopTest, RestartParksInTryStop)
+{
+    TestPipe pipe;
+
+    ASSERT_EQ(NO_ERROR, pipe.start());
+    ASSERT_EQ(NO_ERROR, pipe.setStopFlag());
+    ASSERT_EQ(NO_ERROR, pipe.startThread());
+    EXPECT_EQ(NO_ERROR, pipe.stopThread());
+    EXPECT_EQ(NO_ERROR, pipe.stopThreadAndWait(kStopSleepMs, kStopTimes));
+    ASSERT_FALSE(pipe.flagStartThread());
+
+    int loopCount = pipe.getLoopCount();
+    ASSERT_EQ(NO_ERROR, pipe.startThread());
+    usleep(50000);
+
+    /* one loop per PIPE_TRY_STOP_WAIT_TIMEOUT at most, plus the one in progress */
+    EXPECT_TRUE(pipe.flagStartThread());
+    EXPECT_LE(pipe.getLoopCount() - loopCount, 2);
+
+    EXPECT_EQ(NO_ERROR, pipe.stopThread());
+    EXPECT_EQ(NO_ERROR, pipe.stopThreadAndWait(kStopSleepMs, kStopTimes));
+    EXPECT_FALSE(pipe.flagStartThread());
+    EXPECT_EQ(NO_ERROR, pipe.stop());
+
+    std::vector<NodeEvent> events = pipe.node()->getEvents();
+    ASSERT_EQ(2u, events.size());
+    EXPECT_EQ(EVENT_STREAM_ON, events[0]);
+    EXPECT_EQ(EVENT_STREAM_OFF, events[1]);
+}
@@ -35,7 +35,8 @@ LOCAL_SRC_FILES:= \
 	SecCameraParameters.cpp \
 	ISecCameraHardware.cpp \
 	SecCameraInterface.cpp \
-	SecCameraHardware.cpp
+	SecCameraHardware.cpp \
+	SecCameraFrameConv.cpp
 
 LOCAL_SHARED_LIBRARIES:= libutils libcutils libbinder liblog libcamera_client libhardware
 
@@ -0,0 +1,340 @@
+/*
+ * Copyright 2026, Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+ /*!
+ * \file      SecCameraFrameConv.cpp
+ * \brief     software frame conversion for Android Camera Ext HAL
+ *
+ */
+
+#define LOG_TAG "SecCameraFrameConv"
+
+#include <string.h>
+#include <log/log.h>
+#include <linux/videodev2.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SEC_FRAME_CONV_NEON
+#endif
+
+#include "SecCameraFrameConv.h"
+
+namespace android {
+
+static const char *kFramePathName[SEC_FRAME_PATH_MAX] = {
+    "sw_conv", "hw_csc", "copy",
+};
+
+SecCameraFrameStats::SecCameraFrameStats(const char *statName, uint32_t interval)
+    : name(statName),
+      reportInterval(interval)
+{
+    reset();
+}
+
+void SecCameraFrameStats::reset(void)
+{
+    memset(frames, 0, sizeof(frames));
+    bytesCopied = 0;
+    totalLatency = 0;
+    maxLatency = 0;
+}
+
+void SecCameraFrameStats::account(sec_frame_path path, uint32_t bytes, nsecs_t startTime)
+{
+    nsecs_t latency = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
+
+    if (path >= SEC_FRAME_PATH_MAX)
+        return;
+
+    frames[path]++;
+    bytesCopied += bytes;
+    totalLatency += latency;
+    if (latency > maxLatency)
+        maxLatency = latency;
+
+    if (reportInterval && (totalFrames() % reportInterval) == 0)
+        dump();
+}
+
+uint64_t SecCameraFrameStats::totalFrames(void) const
+{
+    uint64_t total = 0;
+
+    for (int i = 0; i < SEC_FRAME_PATH_MAX; i++)
+        total += frames[i];
+
+    return total;
+}
+
+void SecCameraFrameStats::dump(void) const
+{
+    uint64_t total = totalFrames();
+
+    if (total == 0)
+        return;
+
+    ALOGD("%s: frames %llu (%s %llu, %s %llu, %s %llu), copied %llu KB/frame, latency avg %lld us max %lld us",
+        name, (unsigned long long)total,
+        kFramePathName[SEC_FRAME_PATH_SW_CONV], (unsigned long long)frames[SEC_FRAME_PATH_SW_CONV],
+        kFramePathName[SEC_FRAME_PATH_HW_CSC], (unsigned long long)frames[SEC_FRAME_PATH_HW_CSC],
+        kFramePathName[SEC_FRAME_PATH_COPY], (unsigned long long)frames[SEC_FRAME_PATH_COPY],
+        (unsigned long long)(bytesCopied / total / 1024),
+        (long long)ns2us(totalLatency / (nsecs_t)total), (long long)ns2us(maxLatency));
+}
+
+void secCameraCopyPlane(uint8_t *dst, int dstStride,
+                        const uint8_t *src, int srcStride,
+                        int widthBytes, int height)
+{
+    if (dstStride == widthBytes && srcStride == widthBytes) {
+        memcpy(dst, src, (size_t)widthBytes * height);
+        return;
+    }
+
+    for (int y = 0; y < height; y++) {
+        memcpy(dst, src, widthBytes);
+        dst += dstStride;
+        src += srcStride;
+    }
+}
+
+/* Two YUYV lines -> two luma lines and one chroma line */
+static void yuyvLinePairToYUV420SP(const uint8_t *src0, const uint8_t *src1,
+                                   uint8_t *dstY0, uint8_t *dstY1, uint8_t *dstC,
+                                   int width, bool crFirst)
+{
+    int x = 0;
+
+#ifdef SEC_FRAME_CONV_NEON
+    for (; x + 16 <= width; x += 16) {
+        /* val[0] = Y0, val[1] = Cb, val[2] = Y1, val[3] = Cr */
+        uint8x8x4_t l0 = vld4_u8(src0 + x * 2);
+        uint8x8x4_t l1 = vld4_u8(src1 + x * 2);
+        uint8x8x2_t y0, y1, c;
+
+        y0.val[0] = l0.val[0];
+        y0.val[1] = l0.val[2];
+        y1.val[0] = l1.val[0];
+        y1.val[1] = l1.val[2];
+        vst2_u8(dstY0 + x, y0);
+        vst2_u8(dstY1 + x, y1);
+
+        uint8x8_t cb = vrhadd_u8(l0.val[1], l1.val[1]);
+        uint8x8_t cr = vrhadd_u8(l0.val[3], l1.val[3]);
+        c.val[0] = crFirst ? cr : cb;
+        c.val[1] = crFirst ? cb : cr;
+        vst2_u8(dstC + x, c);
+    }
+#endif
+
+    for (; x < width; x += 2) {
+        const uint8_t *p0 = src0 + x * 2;
+        const uint8_t *p1 = src1 + x * 2;
+        uint8_t cb = (uint8_t)((p0[1] + p1[1] + 1) >> 1);
+        uint8_t cr = (uint8_t)((p0[3] + p1[3] + 1) >> 1);
+
+        dstY0[x]     = p0[0];
+        dstY0[x + 1] = p0[2];
+        dstY1[x]     = p1[0];
+        dstY1[x + 1] = p1[2];
+        dstC[x]      = crFirst ? cr : cb;
+        dstC[x + 1]  = crFirst ? cb : cr;
+    }
+}
+
+bool secCameraYUYVToYUV420SP(const uint8_t *src, int srcStride,
+                             uint8_t *dstY, int dstYStride,
+                             uint8_t *dstC, int dstCStride,
+                             int width, int height, bool crFirst)
+{
+    if (src == NULL || dstY == NULL || dstC == NULL ||
+        width <= 0 || height <= 0 || (width & 1) || (height & 1) ||
+        srcStride < width * 2 || dstYStride < width || dstCStride < width) {
+        ALOGE("ERR(%s): invalid param src(%p) dst(%p, %p) %dx%d stride(%d, %d, %d)", __func__,
+            src, dstY, dstC, width, height, srcStride, dstYStride, dstCStride);
+        return false;
+    }
+
+    for (int y = 0; y < height; y += 2) {
+        yuyvLinePairToYUV420SP(src, src + srcStride,
+                               dstY, dstY + dstYStride, dstC,
+                               width, crFirst);
+        src  += srcStride * 2;
+        dstY += dstYStride * 2;
+        dstC += dstCStride;
+    }
+
+    return true;
+}
+
+static void interleaveChromaLine(const uint8_t *first, const uint8_t *second,
+                                 uint8_t *dstC, int chromaWidth)
+{
+    int x = 0;
+
+#ifdef SEC_FRAME_CONV_NEON
+    for (; x + 16 <= chromaWidth; x += 16) {
+        uint8x16x2_t c;
+
+        c.val[0] = vld1q_u8(first + x);
+        c.val[1] = vld1q_u8(second + x);
+        vst2q_u8(dstC + x * 2, c);
+    }
+#endif
+
+    for (; x < chromaWidth; x++) {
+        dstC[x * 2]     = first[x];
+        dstC[x * 2 + 1] = second[x];
+    }
+}
+
+bool secCameraYUV420PToYUV420SP(const uint8_t *srcY, int srcYStride,
+                                const uint8_t *srcCb, const uint8_t *srcCr, int srcCStride,
+                                uint8_t *dstY, int dstYStride,
+                                uint8_t *dstC, int dstCStride,
+                                int width, int height, bool crFirst)
+{
+    if (srcY == NULL || srcCb == NULL || srcCr == NULL || dstY == NULL || dstC == NULL ||
+        width <= 0 || height <= 0 || (width & 1) || (height & 1) ||
+        srcYStride < width || srcCStride < width / 2 ||
+        dstYStride < width || dstCStride < width) {
+        ALOGE("ERR(%s): invalid param %dx%d stride(%d, %d, %d, %d)", __func__,
+            width, height, srcYStride, srcCStride, dstYStride, dstCStride);
+        return false;
+    }
+
+    secCameraCopyPlane(dstY, dstYStride, srcY, srcYStride, width, height);
+
+    for (int y = 0; y < height / 2; y++) {
+        interleaveChromaLine(crFirst ? srcCr : srcCb, crFirst ? srcCb : srcCr,
+                             dstC, width / 2);
+        srcCb += srcCStride;
+        srcCr += srcCStride;
+        dstC  += dstCStride;
+    }
+
+    return true;
+}
+
+bool secCameraYUV420SPCopy(const uint8_t *srcY, int srcYStride,
+                           const uint8_t *srcC, int srcCStride,
+                           uint8_t *dstY, int dstYStride,
+                           uint8_t *dstC, int dstCStride,
+                           int width, int height, bool swapChroma)
+{
+    if (srcY == NULL || srcC == NULL || dstY == NULL || dstC == NULL ||
+        width <= 0 || height <= 0 || (width & 1) || (height & 1) ||
+        srcYStride < width || srcCStride < width ||
+        dstYStride < width || dstCStride < width) {
+        ALOGE("ERR(%s): invalid param %dx%d stride(%d, %d, %d, %d)", __func__,
+            width, height, srcYStride, srcCStride, dstYStride, dstCStride);
+        return false;
+    }
+
+    secCameraCopyPlane(dstY, dstYStride, srcY, srcYStride, width, height);
+
+    if (!swapChroma) {
+        secCameraCopyPlane(dstC, dstCStride, srcC, srcCStride, width, height / 2);
+        return true;
+    }
+
+    for (int y = 0; y < height / 2; y++) {
+        int x = 0;
+
+#ifdef SEC_FRAME_CONV_NEON
+        for (; x + 16 <= width; x += 16)
+            vst1q_u8(dstC + x, vrev16q_u8(vld1q_u8(srcC + x)));
+#endif
+        for (; x < width; x += 2) {
+            dstC[x]     = srcC[x + 1];
+            dstC[x + 1] = srcC[x];
+        }
+        srcC += srcCStride;
+        dstC += dstCStride;
+    }
+
+    return true;
+}
+
+bool secCameraConvertFrame(const uint8_t *srcY, const uint8_t *srcC, int srcFormat,
+                           int srcW, int srcH,
+                           int cropX, int cropY, int cropW, int cropH,
+                           int dstFormat, int dstW, int dstH,
+                           uint8_t *dstY, uint8_t *dstC, int dstStride)
+{
+    bool crFirst;
+
+    if (srcY == NULL || dstY == NULL || dstC == NULL)
+        return false;
+
+    if (cropW != dstW || cropH != dstH || cropX < 0 || cropY < 0 ||
+        (cropX & 1) || (cropY & 1) ||
+        cropX + cropW > srcW || cropY + cropH > srcH)
+        return false;
+
+    switch (dstFormat) {
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_NV21M:
+        crFirst = true;
+        break;
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV12M:
+        crFirst = false;
+        break;
+    default:
+        return false;
+    }
+
+    switch (srcFormat) {
+    case V4L2_PIX_FMT_YUYV:
+        return secCameraYUYVToYUV420SP(srcY + cropY * srcW * 2 + cropX * 2, srcW * 2,
+                                       dstY, dstStride, dstC, dstStride,
+                                       dstW, dstH, crFirst);
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_NV12M:
+    case V4L2_PIX_FMT_NV21M:
+        if (srcC == NULL)
+            return false;
+        return secCameraYUV420SPCopy(srcY + cropY * srcW + cropX, srcW,
+                                     srcC + cropY / 2 * srcW + cropX, srcW,
+                                     dstY, dstStride, dstC, dstStride,
+                                     dstW, dstH,
+                                     crFirst != (srcFormat == V4L2_PIX_FMT_NV21 ||
+                                                 srcFormat == V4L2_PIX_FMT_NV21M));
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_YVU420:
+    {
+        /* e.g. MJPEG decoded into a contiguous planar frame */
+        const uint8_t *srcP1 = srcY + srcW * srcH;
+        const uint8_t *srcP2 = srcP1 + (srcW / 2) * (srcH / 2);
+        int cOffset = cropY / 2 * (srcW / 2) + cropX / 2;
+        const uint8_t *srcCb = (srcFormat == V4L2_PIX_FMT_YUV420) ? srcP1 : srcP2;
+        const uint8_t *srcCr = (srcFormat == V4L2_PIX_FMT_YUV420) ? srcP2 : srcP1;
+
+        return secCameraYUV420PToYUV420SP(srcY + cropY * srcW + cropX, srcW,
+                                          srcCb + cOffset, srcCr + cOffset, srcW / 2,
+                                          dstY, dstStride, dstC, dstStride,
+                                          dstW, dstH, crFirst);
+    }
+    default:
+        return false;
+    }
+}
+
+}; /* namespace android */
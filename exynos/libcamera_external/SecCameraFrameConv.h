@@ -0,0 +1,108 @@
+/*
+ * Copyright 2026, Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+ /*!
+ * \file      SecCameraFrameConv.h
+ * \brief     software frame conversion for Android Camera Ext HAL
+ *
+ * The FLite output of a USB/external sensor is usually YUYV (or a planar
+ * YUV420 frame decoded from MJPEG). When the frame does not need scaling,
+ * converting it on the CPU directly into the destination buffer is cheaper
+ * than a memcpy into an intermediate buffer followed by a FIMC CSC pass.
+ */
+
+#ifndef ANDROID_HARDWARE_SECCAMERAFRAMECONV_H
+#define ANDROID_HARDWARE_SECCAMERAFRAMECONV_H
+
+#include <stdint.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+enum sec_frame_path {
+    SEC_FRAME_PATH_SW_CONV = 0, /* fused CPU conversion into the destination */
+    SEC_FRAME_PATH_HW_CSC,      /* FIMC/GSC color conversion */
+    SEC_FRAME_PATH_COPY,        /* plain plane copy */
+    SEC_FRAME_PATH_MAX,
+};
+
+/* Per-stream frame accounting. Not thread safe; each stream owns one. */
+struct SecCameraFrameStats {
+    const char  *name;
+    uint64_t    frames[SEC_FRAME_PATH_MAX];
+    uint64_t    bytesCopied;
+    nsecs_t     totalLatency;
+    nsecs_t     maxLatency;
+    uint32_t    reportInterval;
+
+    explicit SecCameraFrameStats(const char *statName, uint32_t interval = 300);
+
+    void    reset(void);
+    void    account(sec_frame_path path, uint32_t bytes, nsecs_t startTime);
+    uint64_t totalFrames(void) const;
+    void    dump(void) const;
+};
+
+/* Copies a plane of widthBytes x height honoring both strides. */
+void secCameraCopyPlane(uint8_t *dst, int dstStride,
+                        const uint8_t *src, int srcStride,
+                        int widthBytes, int height);
+
+/*
+ * Converts interleaved YUYV (V4L2_PIX_FMT_YUYV) to semi-planar YUV420.
+ * Chroma is vertically averaged over each pair of lines.
+ * crFirst selects NV21 (CrCb) when true, NV12 (CbCr) otherwise.
+ * width and height must be even.
+ */
+bool secCameraYUYVToYUV420SP(const uint8_t *src, int srcStride,
+                             uint8_t *dstY, int dstYStride,
+                             uint8_t *dstC, int dstCStride,
+                             int width, int height, bool crFirst);
+
+/*
+ * Converts planar YUV420 (e.g. a decoded MJPEG frame) to semi-planar YUV420.
+ * crFirst selects NV21 (CrCb) when true, NV12 (CbCr) otherwise.
+ */
+bool secCameraYUV420PToYUV420SP(const uint8_t *srcY, int srcYStride,
+                                const uint8_t *srcCb, const uint8_t *srcCr, int srcCStride,
+                                uint8_t *dstY, int dstYStride,
+                                uint8_t *dstC, int dstCStride,
+                                int width, int height, bool crFirst);
+
+/* Copies semi-planar YUV420, optionally swapping the chroma order (NV12 <-> NV21). */
+bool secCameraYUV420SPCopy(const uint8_t *srcY, int srcYStride,
+                           const uint8_t *srcC, int srcCStride,
+                           uint8_t *dstY, int dstYStride,
+                           uint8_t *dstC, int dstCStride,
+                           int width, int height, bool swapChroma);
+
+/*
+ * Converts the crop of a FLite frame into a semi-planar YUV420 destination.
+ * srcFormat is the V4L2 format of the FLite node (YUYV, NV12/NV21 with
+ * srcC pointing at the chroma plane, or contiguous planar YUV420/YVU420),
+ * dstFormat is V4L2_PIX_FMT_NV21(M) or V4L2_PIX_FMT_NV12(M).
+ * Returns false when the crop needs scaling or the format pair is not
+ * handled in software.
+ */
+bool secCameraConvertFrame(const uint8_t *srcY, const uint8_t *srcC, int srcFormat,
+                           int srcW, int srcH,
+                           int cropX, int cropY, int cropW, int cropH,
+                           int dstFormat, int dstW, int dstH,
+                           uint8_t *dstY, uint8_t *dstC, int dstStride);
+
+}; /* namespace android */
+
+#endif /* ANDROID_HARDWARE_SECCAMERAFRAMECONV_H */
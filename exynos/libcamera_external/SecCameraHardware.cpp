@@ -78,7 +78,10 @@ struct record_heap {
 gralloc_module_t const* SecCameraHardware::mGrallocHal;
 
 SecCameraHardware::SecCameraHardware(int cameraId, camera_device_t *dev)
-    : ISecCameraHardware(cameraId, dev)
+    : ISecCameraHardware(cameraId, dev),
+      mPreviewFrameStats("preview"),
+      mPreviewCbFrameStats("preview_cb"),
+      mRecordFrameStats("recording")
 {
     if (cameraId == CAMERA_FACING_BACK)
         mFliteFormat = CAM_PIXEL_FORMAT_YUV422I;
@@ -1809,16 +1812,36 @@ bool SecCameraHardware::nativeFlushSurface(uint32_t width, uint32_t height, uint
                                *buf_handle,
                                GRALLOC_LOCK_FOR_CAMERA,
                                0, 0, width, height, (void **)vaddr)) {
-
-            /* csc start flite(s) -> fimc0 -> gralloc(d) */
-            if (mFimc1CSC) {
-                /* set zoom info */
-                mPreviewZoomRect.w = ALIGN_DOWN((mFLiteSize.width * 10 / mZoomValue), 2);
-                mPreviewZoomRect.h = ALIGN_DOWN((mFLiteSize.height * 10 / mZoomValue), 2);
-
-                mPreviewZoomRect.x = ALIGN_DOWN(((mFLiteSize.width - mPreviewZoomRect.w) / 2), 2);
-                mPreviewZoomRect.y = ALIGN_DOWN(((mFLiteSize.height - mPreviewZoomRect.h) / 2), 2);
-
+            nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
+            /* set zoom info */
+            mPreviewZoomRect.w = ALIGN_DOWN((mFLiteSize.width * 10 / mZoomValue), 2);
+            mPreviewZoomRect.h = ALIGN_DOWN((mFLiteSize.height * 10 / mZoomValue), 2);
+
+            mPreviewZoomRect.x = ALIGN_DOWN(((mFLiteSize.width - mPreviewZoomRect.w) / 2), 2);
+            mPreviewZoomRect.y = ALIGN_DOWN(((mFLiteSize.height - mPreviewZoomRect.h) / 2), 2);
+
+            /* gralloc(d), also the source of the preview callback copy */
+            const private_handle_t *priv_handle = private_handle_t::dynamicCast(*buf_handle);
+            dstBuf.fd.extFd[0]  = priv_handle->fd;
+            dstBuf.fd.extFd[1]  = priv_handle->fd1;
+            dstBuf.virt.extP[0] = (char *)vaddr[0];
+            dstBuf.virt.extP[1] = (char *)vaddr[1];
+            dstBuf.size.extS[0] = mPreviewSize.width * mPreviewSize.height;
+            dstBuf.size.extS[1] = mPreviewSize.width * mPreviewSize.height / 2;
+
+            /*
+             * Unscaled preview: convert flite(s) -> gralloc(d) on the CPU.
+             * Movie mode keeps the FIMC path for its narrow color range.
+             */
+            if (type != CAMERA_HEAP_POSTVIEW && !mMovieMode &&
+                nativeSwConvertFrame(&mFliteNode.buffer[index], &mPreviewZoomRect,
+                        V4L2_PIX_FMT_NV21, mPreviewSize.width, mPreviewSize.height,
+                        (char *)vaddr[0], (char *)vaddr[1], stride)) {
+                mPreviewFrameStats.account(SEC_FRAME_PATH_SW_CONV,
+                        mPreviewSize.width * mPreviewSize.height * 3 / 2, startTime);
+            } else if (mFimc1CSC) {
+                /* csc start flite(s) -> fimc0 -> gralloc(d) */
                 /* src : FLite */
                 csc_set_src_format(mFimc1CSC,
                         mFLiteSize.width, mFLiteSize.height,
@@ -1851,14 +1874,6 @@ bool SecCameraHardware::nativeFlushSurface(uint32_t width, uint32_t height, uint
                         halPixelFormat,
                         0);
 
-                const private_handle_t *priv_handle = private_handle_t::dynamicCast(*buf_handle);
-                dstBuf.fd.extFd[0]  = priv_handle->fd;
-                dstBuf.fd.extFd[1]  = priv_handle->fd1;
-                dstBuf.virt.extP[0] = (char *)vaddr[0];
-                dstBuf.virt.extP[1] = (char *)vaddr[1];
-                dstBuf.size.extS[0] = mPreviewSize.width * mPreviewSize.height;
-                dstBuf.size.extS[1] = mPreviewSize.width * mPreviewSize.height / 2;
-
                 csc_set_dst_buffer(mFimc1CSC,
                                    (void **)dstBuf.fd.extFd, CSC_MEMORY_DMABUF);
 
@@ -1869,6 +1884,7 @@ bool SecCameraHardware::nativeFlushSurface(uint32_t width, uint32_t height, uint
                     goto CANCEL;
                 }
                 mFimc1CSCLock.unlock();
+                mPreviewFrameStats.account(SEC_FRAME_PATH_HW_CSC, 0, startTime);
             }
 
             mGrallocHal->unlock(mGrallocHal, *buf_handle);
@@ -2454,7 +2470,18 @@ status_t SecCameraHardware::nativePreviewCallback(int index, ExynosBuffer *grall
         dstBuf.virt.extP[2] = dstBuf.virt.extP[1] + dstBuf.size.extS[1];
     }
 
-    if (grallocBuf == NULL ||
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    uint32_t cbFrameBytes = mOrgPreviewSize.width * mOrgPreviewSize.height * 3 / 2;
+
+    /*
+     * Unscaled callback: convert flite(s) -> callback(d) on the CPU.
+     * This also avoids reading back the (uncached) gralloc buffer.
+     */
+    if (nativeSwConvertFrame(&mFliteNode.buffer[index], &mPreviewZoomRect,
+            mPreviewFormat, mOrgPreviewSize.width, mOrgPreviewSize.height,
+            dstBuf.virt.extP[0], dstBuf.virt.extP[1], mOrgPreviewSize.width)) {
+        mPreviewCbFrameStats.account(SEC_FRAME_PATH_SW_CONV, cbFrameBytes, startTime);
+    } else if (grallocBuf == NULL ||
         mOrgPreviewSize.width != mPreviewSize.width ||
         mOrgPreviewSize.height != mPreviewSize.height ||
         HAL_PIXEL_FORMAT_CUSTOM_YCbCr_420_SP != V4L2_PIX_2_HAL_PIXEL_FORMAT(mPreviewFormat)) {
@@ -2493,19 +2520,19 @@ status_t SecCameraHardware::nativePreviewCallback(int index, ExynosBuffer *grall
                 return false;
             }
             mFimc2CSCLock.unlock();
+            mPreviewCbFrameStats.account(SEC_FRAME_PATH_HW_CSC, 0, startTime);
         } else {
             ALOGE("ERR(%s): mFimc1CSC == NULL", __func__);
             return false;
         }
     } else {
-		for (int plane = 0; plane < 2; plane++) {
-			/* just memcpy only */
-			char *srcAddr = NULL;
-			char *dstAddr = NULL;
-			srcAddr = grallocBuf->virt.extP[plane];
-			dstAddr = dstBuf.virt.extP[plane];
-			memcpy(dstAddr, srcAddr, dstBuf.size.extS[plane]);
-		}
+        /* just copy the displayed frame */
+        secCameraYUV420SPCopy((const uint8_t *)grallocBuf->virt.extP[0], mOrgPreviewSize.width,
+                              (const uint8_t *)grallocBuf->virt.extP[1], mOrgPreviewSize.width,
+                              (uint8_t *)dstBuf.virt.extP[0], mOrgPreviewSize.width,
+                              (uint8_t *)dstBuf.virt.extP[1], mOrgPreviewSize.width,
+                              mOrgPreviewSize.width, mOrgPreviewSize.height, false);
+        mPreviewCbFrameStats.account(SEC_FRAME_PATH_COPY, cbFrameBytes, startTime);
     }
     /* mSaveDump("/data/camera_preview%d.yuv", &dstBuf, index); */
 
@@ -2551,6 +2578,10 @@ void SecCameraHardware::nativeStopPreview(void)
     if (mFlite.reqBufZero(&mFliteNode) < 0)
         ALOGE("ERR(%s): mFlite.reqBufZero() fail", __func__);
 #endif
+    mPreviewFrameStats.dump();
+    mPreviewFrameStats.reset();
+    mPreviewCbFrameStats.dump();
+    mPreviewCbFrameStats.reset();
     ALOGD("nativeStopPreview EX");
 }
 
@@ -2817,6 +2848,9 @@ void SecCameraHardware::nativeStopRecording()
     mInitRecSrcQ();
     mInitRecDstBuf();
 
+    mRecordFrameStats.dump();
+    mRecordFrameStats.reset();
+
     ALOGD("nativeStopRecording EX");
 }
 
@@ -2912,6 +2946,32 @@ bool SecCameraHardware::getRectZoomAlign(unsigned int src_w, unsigned int src_h,
     return true;
 }
 
+/*
+ * Converts a FLite frame on the CPU directly into the destination planes.
+ * Returns false when the frame needs scaling or the format pair is not
+ * handled in software; the caller then falls back to the FIMC CSC.
+ */
+bool SecCameraHardware::nativeSwConvertFrame(ExynosBuffer *srcBuf, const s5p_rect *crop,
+                                             int dstFormat, int dstW, int dstH,
+                                             char *dstY, char *dstC, int dstStride)
+{
+    const uint8_t *srcC = NULL;
+
+    if (srcBuf == NULL)
+        return false;
+
+    if (mFliteNode.format == V4L2_PIX_FMT_NV12M || mFliteNode.format == V4L2_PIX_FMT_NV21M)
+        srcC = (const uint8_t *)srcBuf->virt.extP[1];
+    else if (srcBuf->virt.extP[0] != NULL)
+        srcC = (const uint8_t *)srcBuf->virt.extP[0] + mFLiteSize.width * mFLiteSize.height;
+
+    return secCameraConvertFrame((const uint8_t *)srcBuf->virt.extP[0], srcC, mFliteNode.format,
+                                 mFLiteSize.width, mFLiteSize.height,
+                                 crop->x, crop->y, crop->w, crop->h,
+                                 dstFormat, dstW, dstH,
+                                 (uint8_t *)dstY, (uint8_t *)dstC, dstStride);
+}
+
 status_t SecCameraHardware::nativeCSCPreview(int index, int type)
 {
     ExynosBuffer dstBuf;
@@ -2919,14 +2979,25 @@ status_t SecCameraHardware::nativeCSCPreview(int index, int type)
     dstAdr = (char *)mPreviewHeap->data;
     dstAdr += (index * mPreviewFrameSize);
 
-    if (mFimc1CSC) {
-        /* set zoom info */
-        mPreviewZoomRect.w = ALIGN_DOWN((mFLiteSize.width * 10 / mZoomValue), 2);
-        mPreviewZoomRect.h = ALIGN_DOWN((mFLiteSize.height * 10 / mZoomValue), 2);
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
-        mPreviewZoomRect.x = ALIGN_DOWN(((mFLiteSize.width - mPreviewZoomRect.w) / 2), 2);
-        mPreviewZoomRect.y = ALIGN_DOWN(((mFLiteSize.height - mPreviewZoomRect.h) / 2), 2);
+    /* set zoom info */
+    mPreviewZoomRect.w = ALIGN_DOWN((mFLiteSize.width * 10 / mZoomValue), 2);
+    mPreviewZoomRect.h = ALIGN_DOWN((mFLiteSize.height * 10 / mZoomValue), 2);
 
+    mPreviewZoomRect.x = ALIGN_DOWN(((mFLiteSize.width - mPreviewZoomRect.w) / 2), 2);
+    mPreviewZoomRect.y = ALIGN_DOWN(((mFLiteSize.height - mPreviewZoomRect.h) / 2), 2);
+
+    if (type != CAMERA_HEAP_POSTVIEW &&
+        nativeSwConvertFrame(&mFliteNode.buffer[index], &mPreviewZoomRect,
+            V4L2_PIX_FMT_NV21, mPreviewSize.width, mPreviewSize.height,
+            dstAdr, dstAdr + mPreviewSize.width * mPreviewSize.height, mPreviewSize.width)) {
+        mPreviewFrameStats.account(SEC_FRAME_PATH_SW_CONV,
+                mPreviewSize.width * mPreviewSize.height * 3 / 2, startTime);
+        return true;
+    }
+
+    if (mFimc1CSC) {
         /* src : FLite */
         csc_set_src_format(mFimc1CSC,
             mFLiteSize.width, mFLiteSize.height,
@@ -2968,6 +3039,7 @@ status_t SecCameraHardware::nativeCSCPreview(int index, int type)
             return false;
         }
         mFimc1CSCLock.unlock();
+        mPreviewFrameStats.account(SEC_FRAME_PATH_HW_CSC, 0, startTime);
     }
     return true;
 }
@@ -3000,25 +3072,7 @@ status_t SecCameraHardware::nativeCSCRecording(rec_src_buf_t *srcBuf, int dstIdx
             , dstIdx
         );
 #endif
-        /* src : FLite */
-        csc_set_src_format(mFimc2CSC,
-                mFLiteSize.width, mFLiteSize.height,
-                mRecordZoomRect.x, mRecordZoomRect.y,
-                mRecordZoomRect.w, mRecordZoomRect.h,
-                V4L2_PIX_2_HAL_PIXEL_FORMAT(mFliteNode.format),
-                0);
-
-        csc_set_src_buffer(mFimc2CSC, (void **)srcBuf->buf->fd.extFd, CSC_MEMORY_DMABUF);
-        //csc_set_src_buffer(mFimc2CSC, (void **)srcBuf->buf->virt.extP, CSC_MEMORY_USERPTR);
-
-        /* dst : MHB(callback */
-        csc_set_dst_format(mFimc2CSC,
-                mVideoSize.width, mVideoSize.height,
-                0, 0, mVideoSize.width, mVideoSize.height,
-                V4L2_PIX_2_HAL_PIXEL_FORMAT(mRecordingFormat),
-                /* HAL_PIXEL_FORMAT_CUSTOM_YCbCr_420_SP, */
-                0);
-
+        nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
         ExynosBuffer dstBuf;
         getAlignedYUVSize(mRecordingFormat, mVideoSize.width, mVideoSize.height, &dstBuf);
         for (int i = 0; i < REC_PLANE_CNT; i++) {
@@ -3042,15 +3096,47 @@ status_t SecCameraHardware::nativeCSCRecording(rec_src_buf_t *srcBuf, int dstIdx
             , dstIdx
         );
 #endif
-        csc_set_dst_buffer(mFimc2CSC, (void **)dstBuf.fd.extFd, CSC_MEMORY_DMABUF);
+        if (nativeSwConvertFrame(srcBuf->buf, &mRecordZoomRect,
+                mRecordingFormat, mVideoSize.width, mVideoSize.height,
+                dstBuf.virt.extP[0], dstBuf.virt.extP[1], mVideoSize.width)) {
+            /* written through the (cached) CPU mapping, flush it for the encoder */
+            for (int i = 0; i < REC_PLANE_CNT; i++) {
+                if (dstBuf.fd.extFd[i] >= 0 && ion_sync(mIonCameraClient, dstBuf.fd.extFd[i]) < 0)
+                    ALOGE("ERR(%s):ion_sync(plane %d) fail", __func__, i);
+            }
+            mRecordFrameStats.account(SEC_FRAME_PATH_SW_CONV,
+                    mVideoSize.width * mVideoSize.height * 3 / 2, startTime);
+        } else {
+            /* src : FLite */
+            csc_set_src_format(mFimc2CSC,
+                    mFLiteSize.width, mFLiteSize.height,
+                    mRecordZoomRect.x, mRecordZoomRect.y,
+                    mRecordZoomRect.w, mRecordZoomRect.h,
+                    V4L2_PIX_2_HAL_PIXEL_FORMAT(mFliteNode.format),
+                    0);
+
+            csc_set_src_buffer(mFimc2CSC, (void **)srcBuf->buf->fd.extFd, CSC_MEMORY_DMABUF);
+            //csc_set_src_buffer(mFimc2CSC, (void **)srcBuf->buf->virt.extP, CSC_MEMORY_USERPTR);
+
+            /* dst : MHB(callback */
+            csc_set_dst_format(mFimc2CSC,
+                    mVideoSize.width, mVideoSize.height,
+                    0, 0, mVideoSize.width, mVideoSize.height,
+                    V4L2_PIX_2_HAL_PIXEL_FORMAT(mRecordingFormat),
+                    /* HAL_PIXEL_FORMAT_CUSTOM_YCbCr_420_SP, */
+                    0);
+
+            csc_set_dst_buffer(mFimc2CSC, (void **)dstBuf.fd.extFd, CSC_MEMORY_DMABUF);
 
-        mFimc2CSCLock.lock();
-        if (csc_convert(mFimc2CSC) != 0) {
-            ALOGE("ERR(%s):csc_convert(mFimc2CSC) fail", __func__);
+            mFimc2CSCLock.lock();
+            if (csc_convert(mFimc2CSC) != 0) {
+                ALOGE("ERR(%s):csc_convert(mFimc2CSC) fail", __func__);
+                mFimc2CSCLock.unlock();
+                return false;
+            }
             mFimc2CSCLock.unlock();
-            return false;
+            mRecordFrameStats.account(SEC_FRAME_PATH_HW_CSC, 0, startTime);
         }
-        mFimc2CSCLock.unlock();
 
         addrs = (struct addrs *)mRecordingHeap->data;
         addrs[dstIdx].type      = kMetadataBufferTypeCameraSource;
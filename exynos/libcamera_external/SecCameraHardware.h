@@ -43,6 +43,7 @@
 
 #include <ExynosJpegApi.h>
 #include "ISecCameraHardware.h"
+#include "SecCameraFrameConv.h"
 #include "Exif.h"
 
 namespace android {
@@ -379,6 +380,11 @@ private:
     s5p_rect        mRecordZoomRect;
     int             mZoomValue;
 
+    /* per-frame copy/latency counters */
+    SecCameraFrameStats mPreviewFrameStats;
+    SecCameraFrameStats mPreviewCbFrameStats;
+    SecCameraFrameStats mRecordFrameStats;
+
     addrs_t             mWindowBuffer;
 
     cam_pixel_format    mRecordingFormat;
@@ -392,6 +398,10 @@ private:
     bool            setAllMCSubdevFormat(int w, int h, int ext_cam_mode);
 
 
+    bool    nativeSwConvertFrame(ExynosBuffer *srcBuf, const s5p_rect *crop,
+                                 int dstFormat, int dstW, int dstH,
+                                 char *dstY, char *dstC, int dstStride);
+
     bool    allocatePreviewHeap();
     bool    allocateRecordingHeap();
 
@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2026 Samsung Electronics Co. Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <linux/videodev2.h>
+
+#include "../SecCameraFrameConv.h"
+
+using namespace android;
+
+namespace {
+
+/*
+ * Minimal stand-in for SecCameraHardware::FLiteV4l2: owns a ring of
+ * capture buffers and fills a synthetic YUYV frame on every dqbuf.
+ */
+class StubFLiteV4l2 {
+public:
+    StubFLiteV4l2(int width, int height, int stride, int numBufs)
+        : mWidth(width), mHeight(height), mStride(stride), mSequence(0), mNext(0)
+    {
+        mBuffers.resize(numBufs);
+        mQueued.resize(numBufs, false);
+        for (auto &buf : mBuffers)
+            buf.resize((size_t)stride * height);
+    }
+
+    int qbuf2(int index)
+    {
+        if (index < 0 || index >= (int)mBuffers.size() || mQueued[index])
+            return -1;
+        mQueued[index] = true;
+        return 0;
+    }
+
+    int dqbuf2()
+    {
+        for (size_t i = 0; i < mBuffers.size(); i++) {
+            int index = (mNext + i) % mBuffers.size();
+            if (!mQueued[index])
+                continue;
+            mQueued[index] = false;
+            mNext = (index + 1) % mBuffers.size();
+            fill(mBuffers[index].data(), mSequence++);
+            return index;
+        }
+        return -1;
+    }
+
+    const uint8_t *data(int index) const { return mBuffers[index].data(); }
+    int stride() const { return mStride; }
+
+private:
+    void fill(uint8_t *p, int seq)
+    {
+        for (int y = 0; y < mHeight; y++) {
+            uint8_t *line = p + y * mStride;
+            for (int x = 0; x < mWidth; x += 2) {
+                line[x * 2]     = (uint8_t)(x + y + seq);
+                line[x * 2 + 1] = (uint8_t)(x * 3 + seq);
+                line[x * 2 + 2] = (uint8_t)(x + y + 1 + seq);
+                line[x * 2 + 3] = (uint8_t)(y * 5 + seq);
+            }
+        }
+    }
+
+    int mWidth;
+    int mHeight;
+    int mStride;
+    int mSequence;
+    int mNext;
+    std::vector<std::vector<uint8_t> > mBuffers;
+    std::vector<bool> mQueued;
+};
+
+void referenceYUYVToNV(const uint8_t *src, int srcStride, uint8_t *y, int yStride,
+                       uint8_t *c, int cStride, int w, int h, bool crFirst)
+{
+    for (int row = 0; row < h; row++)
+        for (int x = 0; x < w; x++)
+            y[row * yStride + x] = src[row * srcStride + x * 2];
+
+    for (int row = 0; row < h; row += 2) {
+        const uint8_t *s0 = src + row * srcStride;
+        const uint8_t *s1 = s0 + srcStride;
+        for (int x = 0; x < w; x += 2) {
+            uint8_t cb = (uint8_t)((s0[x * 2 + 1] + s1[x * 2 + 1] + 1) >> 1);
+            uint8_t cr = (uint8_t)((s0[x * 2 + 3] + s1[x * 2 + 3] + 1) >> 1);
+            c[row / 2 * cStride + x]     = crFirst ? cr : cb;
+            c[row / 2 * cStride + x + 1] = crFirst ? cb : cr;
+        }
+    }
+}
+
+} /* namespace */
+
+TEST(SecCameraFrameConvTest, YUYVToNV21MatchesReference)
+{
+    const int w = 646, h = 482, srcStride = 1312, dstStride = 704;
+    StubFLiteV4l2 flite(w, h, srcStride, 4);
+
+    for (int i = 0; i < 4; i++)
+        ASSERT_EQ(0, flite.qbuf2(i));
+
+    std::vector<uint8_t> y(dstStride * h), c(dstStride * h / 2);
+    std::vector<uint8_t> refY(dstStride * h), refC(dstStride * h / 2);
+
+    for (int frame = 0; frame < 8; frame++) {
+        int index = flite.dqbuf2();
+        ASSERT_GE(index, 0);
+
+        bool crFirst = (frame & 1) == 0;
+        ASSERT_TRUE(secCameraYUYVToYUV420SP(flite.data(index), flite.stride(),
+                                            y.data(), dstStride, c.data(), dstStride,
+                                            w, h, crFirst));
+        referenceYUYVToNV(flite.data(index), flite.stride(),
+                          refY.data(), dstStride, refC.data(), dstStride, w, h, crFirst);
+
+        for (int row = 0; row < h; row++)
+            ASSERT_EQ(0, memcmp(&y[row * dstStride], &refY[row * dstStride], w)) << "row " << row;
+        for (int row = 0; row < h / 2; row++)
+            ASSERT_EQ(0, memcmp(&c[row * dstStride], &refC[row * dstStride], w)) << "row " << row;
+
+        ASSERT_EQ(0, flite.qbuf2(index));
+    }
+}
+
+TEST(SecCameraFrameConvTest, ConvertFrameCropsYUYV)
+{
+    /* FLite frame larger than the preview, centered crop as set by the zoom info */
+    const int srcW = 1280, srcH = 720, dstW = 640, dstH = 480, dstStride = 704;
+    const int cropX = 320, cropY = 120;
+    StubFLiteV4l2 flite(srcW, srcH, srcW * 2, 2);
+
+    for (int i = 0; i < 2; i++)
+        ASSERT_EQ(0, flite.qbuf2(i));
+
+    std::vector<uint8_t> y(dstStride * dstH), c(dstStride * dstH / 2);
+    std::vector<uint8_t> refY(dstStride * dstH), refC(dstStride * dstH / 2);
+
+    for (int frame = 0; frame < 4; frame++) {
+        int index = flite.dqbuf2();
+        ASSERT_GE(index, 0);
+
+        bool nv21 = (frame & 1) == 0;
+        ASSERT_TRUE(secCameraConvertFrame(flite.data(index), NULL, V4L2_PIX_FMT_YUYV,
+                                          srcW, srcH, cropX, cropY, dstW, dstH,
+                                          nv21 ? V4L2_PIX_FMT_NV21 : V4L2_PIX_FMT_NV12M,
+                                          dstW, dstH, y.data(), c.data(), dstStride));
+        referenceYUYVToNV(flite.data(index) + cropY * srcW * 2 + cropX * 2, srcW * 2,
+                          refY.data(), dstStride, refC.data(), dstStride, dstW, dstH, nv21);
+
+        for (int row = 0; row < dstH; row++)
+            ASSERT_EQ(0, memcmp(&y[row * dstStride], &refY[row * dstStride], dstW)) << "row " << row;
+        for (int row = 0; row < dstH / 2; row++)
+            ASSERT_EQ(0, memcmp(&c[row * dstStride], &refC[row * dstStride], dstW)) << "row " << row;
+
+        ASSERT_EQ(0, flite.qbuf2(index));
+    }
+}
+
+TEST(SecCameraFrameConvTest, ConvertFrameSemiPlanarAndPlanarSources)
+{
+    const int w = 64, h = 32, cropX = 16, cropY = 8, dstW = 32, dstH = 16;
+    std::vector<uint8_t> src(w * h * 3 / 2);
+    std::vector<uint8_t> y(dstW * dstH), c(dstW * dstH / 2);
+
+    for (size_t i = 0; i < src.size(); i++)
+        src[i] = (uint8_t)(i * 7);
+
+    const uint8_t *srcY = src.data();
+    const uint8_t *srcC = src.data() + w * h;
+
+    /* NV12M FLite buffer (chroma in its own plane) into NV21: chroma swapped */
+    ASSERT_TRUE(secCameraConvertFrame(srcY, srcC, V4L2_PIX_FMT_NV12M, w, h,
+                                      cropX, cropY, dstW, dstH,
+                                      V4L2_PIX_FMT_NV21, dstW, dstH, y.data(), c.data(), dstW));
+    for (int row = 0; row < dstH; row++)
+        ASSERT_EQ(0, memcmp(&y[row * dstW], srcY + (cropY + row) * w + cropX, dstW));
+    for (int row = 0; row < dstH / 2; row++) {
+        const uint8_t *s = srcC + (cropY / 2 + row) * w + cropX;
+        for (int x = 0; x < dstW; x += 2) {
+            ASSERT_EQ(s[x + 1], c[row * dstW + x]);
+            ASSERT_EQ(s[x], c[row * dstW + x + 1]);
+        }
+    }
+
+    /* planar YVU420 (Cr plane first) into NV12 */
+    const uint8_t *srcCr = srcY + w * h;
+    const uint8_t *srcCb = srcCr + (w / 2) * (h / 2);
+    ASSERT_TRUE(secCameraConvertFrame(srcY, NULL, V4L2_PIX_FMT_YVU420, w, h,
+                                      cropX, cropY, dstW, dstH,
+                                      V4L2_PIX_FMT_NV12, dstW, dstH, y.data(), c.data(), dstW));
+    for (int row = 0; row < dstH / 2; row++) {
+        int offset = (cropY / 2 + row) * (w / 2) + cropX / 2;
+        for (int x = 0; x < dstW / 2; x++) {
+            ASSERT_EQ(srcCb[offset + x], c[row * dstW + x * 2]);
+            ASSERT_EQ(srcCr[offset + x], c[row * dstW + x * 2 + 1]);
+        }
+    }
+}
+
+TEST(SecCameraFrameConvTest, ConvertFrameLeavesScalingToCSC)
+{
+    const int w = 64, h = 32;
+    std::vector<uint8_t> src(w * h * 2), y(w * h), c(w * h / 2);
+
+    /* zoomed: the crop is smaller than the destination */
+    EXPECT_FALSE(secCameraConvertFrame(src.data(), NULL, V4L2_PIX_FMT_YUYV, w, h,
+                                       8, 4, 48, 24, V4L2_PIX_FMT_NV21, w, h, y.data(), c.data(), w));
+    /* odd crop origin, crop out of the frame */
+    EXPECT_FALSE(secCameraConvertFrame(src.data(), NULL, V4L2_PIX_FMT_YUYV, w, h,
+                                       1, 0, 32, 16, V4L2_PIX_FMT_NV21, 32, 16, y.data(), c.data(), 32));
+    EXPECT_FALSE(secCameraConvertFrame(src.data(), NULL, V4L2_PIX_FMT_YUYV, w, h,
+                                       40, 0, 32, 16, V4L2_PIX_FMT_NV21, 32, 16, y.data(), c.data(), 32));
+    /* formats the FIMC handles only */
+    EXPECT_FALSE(secCameraConvertFrame(src.data(), NULL, V4L2_PIX_FMT_YUYV, w, h,
+                                       0, 0, w, h, V4L2_PIX_FMT_YVU420, w, h, y.data(), c.data(), w));
+    EXPECT_FALSE(secCameraConvertFrame(src.data(), NULL, V4L2_PIX_FMT_UYVY, w, h,
+                                       0, 0, w, h, V4L2_PIX_FMT_NV21, w, h, y.data(), c.data(), w));
+    /* semi-planar source without its chroma plane, missing destination */
+    EXPECT_FALSE(secCameraConvertFrame(src.data(), NULL, V4L2_PIX_FMT_NV21M, w, h,
+                                       0, 0, w, h, V4L2_PIX_FMT_NV21, w, h, y.data(), c.data(), w));
+    EXPECT_FALSE(secCameraConvertFrame(src.data(), NULL, V4L2_PIX_FMT_YUYV, w, h,
+                                       0, 0, w, h, V4L2_PIX_FMT_NV21, w, h, y.data(), NULL, w));
+}
+
+TEST(SecCameraFrameConvTest, RejectsOddSizeAndShortStride)
+{
+    uint8_t buf[64] = {0};
+
+    EXPECT_FALSE(secCameraYUYVToYUV420SP(buf, 8, buf, 4, buf, 4, 3, 2, true));
+    EXPECT_FALSE(secCameraYUYVToYUV420SP(buf, 6, buf, 4, buf, 4, 4, 2, true));
+    EXPECT_FALSE(secCameraYUYVToYUV420SP(NULL, 8, buf, 4, buf, 4, 4, 2, true));
+}
+
+TEST(SecCameraFrameConvTest, PlanarAndSemiPlanarConversion)
+{
+    const int w = 36, h = 6;
+    std::vector<uint8_t> srcY(w * h), srcCb(w / 2 * h / 2), srcCr(w / 2 * h / 2);
+    std::vector<uint8_t> dstY(w * h), dstC(w * h / 2), swapped(w * h / 2);
+
+    for (size_t i = 0; i < srcY.size(); i++)
+        srcY[i] = (uint8_t)i;
+    for (size_t i = 0; i < srcCb.size(); i++) {
+        srcCb[i] = (uint8_t)(0x40 + i);
+        srcCr[i] = (uint8_t)(0x80 + i);
+    }
+
+    ASSERT_TRUE(secCameraYUV420PToYUV420SP(srcY.data(), w, srcCb.data(), srcCr.data(), w / 2,
+                                           dstY.data(), w, dstC.data(), w, w, h, true));
+    EXPECT_EQ(0, memcmp(srcY.data(), dstY.data(), srcY.size()));
+    for (size_t i = 0; i < srcCb.size(); i++) {
+        ASSERT_EQ(srcCr[i], dstC[i * 2]);
+        ASSERT_EQ(srcCb[i], dstC[i * 2 + 1]);
+    }
+
+    ASSERT_TRUE(secCameraYUV420SPCopy(dstY.data(), w, dstC.data(), w,
+                                      dstY.data(), w, swapped.data(), w, w, h, true));
+    for (size_t i = 0; i < srcCb.size(); i++) {
+        ASSERT_EQ(srcCb[i], swapped[i * 2]);
+        ASSERT_EQ(srcCr[i], swapped[i * 2 + 1]);
+    }
+}
+
+TEST(SecCameraFrameConvTest, PreviewStreamCounters)
+{
+    const int w = 1280, h = 720, frames = 120;
+    StubFLiteV4l2 flite(w, h, w * 2, 4);
+    SecCameraFrameStats stats("test", 0);
+    std::vector<uint8_t> y(w * h), c(w * h / 2);
+    std::vector<uint8_t> staging(w * h * 2);
+
+    for (int i = 0; i < 4; i++)
+        ASSERT_EQ(0, flite.qbuf2(i));
+
+    /* legacy shape: copy out of the capture buffer, then convert */
+    nsecs_t legacyStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < frames; i++) {
+        int index = flite.dqbuf2();
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        memcpy(staging.data(), flite.data(index), staging.size());
+        secCameraYUYVToYUV420SP(staging.data(), w * 2, y.data(), w, c.data(), w, w, h, true);
+        stats.account(SEC_FRAME_PATH_COPY, staging.size() + w * h * 3 / 2, start);
+        flite.qbuf2(index);
+    }
+    nsecs_t legacyTime = systemTime(SYSTEM_TIME_MONOTONIC) - legacyStart;
+    uint64_t legacyBytes = stats.bytesCopied;
+
+    stats.reset();
+    nsecs_t fusedStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < frames; i++) {
+        int index = flite.dqbuf2();
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        secCameraConvertFrame(flite.data(index), NULL, V4L2_PIX_FMT_YUYV, w, h, 0, 0, w, h,
+                              V4L2_PIX_FMT_NV21, w, h, y.data(), c.data(), w);
+        stats.account(SEC_FRAME_PATH_SW_CONV, w * h * 3 / 2, start);
+        flite.qbuf2(index);
+    }
+    nsecs_t fusedTime = systemTime(SYSTEM_TIME_MONOTONIC) - fusedStart;
+
+    EXPECT_EQ((uint64_t)frames, stats.frames[SEC_FRAME_PATH_SW_CONV]);
+    EXPECT_EQ((uint64_t)frames, stats.totalFrames());
+    EXPECT_LT(stats.bytesCopied, legacyBytes);
+    EXPECT_GE(stats.maxLatency, stats.totalLatency / frames);
+
+    printf("%dx%d x %d frames: copy+convert %lld us/frame, fused %lld us/frame\n",
+           w, h, frames,
+           (long long)ns2us(legacyTime / frames), (long long)ns2us(fusedTime / frames));
+    stats.dump();
+}
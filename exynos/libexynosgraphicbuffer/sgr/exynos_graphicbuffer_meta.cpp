@@ -18,6 +18,7 @@
 
 #include "ExynosGraphicBufferCore.h"
 #include "ExynosGraphicBufferUtils.h"
+#include "exynos_graphicbuffer_meta_cache.h"
 #include "metadata_gpu.h"
 #include "metadata_gralloc.h"
 #include "private_handle.h"
@@ -32,6 +33,7 @@ using namespace vendor::graphics;
 
 #define UNUSED(x) ((void)x)
 #define SZ_4k 0x1000
+#define SGR_METADATA_CACHE_ENTRIES 64
 
 #define SGR_LOGD(...)
 #define SGR_LOGE(...) ALOGE(__VA_ARGS__)
@@ -43,27 +45,29 @@ enum METADATA_TYPE {
     TYPE_GPU,
 };
 
-static void *map_and_get_metadata(buffer_handle_t hnd, METADATA_TYPE type, bool write) {
+static MetadataMappingCache &metadata_cache() {
+    // never destroyed, the mappings may be used by other threads at exit
+    static MetadataMappingCache &cache = *new MetadataMappingCache(SGR_METADATA_SIZE_SUB_TOTAL, SGR_METADATA_CACHE_ENTRIES);
+    return cache;
+}
+
+/* The metadata stays mapped as long as `mapping` is held */
+static void *map_and_get_metadata(buffer_handle_t hnd, METADATA_TYPE type, bool write,
+                                  MetadataMappingCache::Lease *mapping) {
     if (hnd == nullptr) {
         SGR_LOGD("[%s] buffer handle is null", __func__);
         return nullptr;
     }
     const private_handle_t *phnd = static_cast<const private_handle_t *>(hnd);
     const uint32_t metadata_fd_index = phnd->numFds - 1;
-    int prot = write ? PROT_READ | PROT_WRITE : PROT_READ;
 
-    void *metadata = mmap(0, SGR_METADATA_SIZE_SUB_TOTAL, prot, MAP_SHARED, phnd->fds[metadata_fd_index], 0);
-    if (metadata == MAP_FAILED) {
+    *mapping = metadata_cache().get(phnd->fds[metadata_fd_index], write);
+    if (*mapping == nullptr) {
         SGR_LOGE("[%s] mmap failed: %s", __func__, strerror(errno));
         return nullptr;
     }
 
-    return reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(metadata) + SGR_META_OFFSET[type]);
-}
-
-static void unmap_metadata(void *metadata, METADATA_TYPE type) {
-    void *addr = reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(metadata) - SGR_META_OFFSET[type]);
-    munmap(addr, SGR_METADATA_SIZE_SUB_TOTAL);
+    return reinterpret_cast<void *>(reinterpret_cast<uintptr_t>((*mapping)->addr) + SGR_META_OFFSET[type]);
 }
 
 int ExynosGraphicBufferMeta::get_video_metadata_fd(buffer_handle_t hnd) {
@@ -91,13 +95,13 @@ int ExynosGraphicBufferMeta::get_dataspace(buffer_handle_t hnd) {
     SGR_LOGD("[%s] entry", __func__);
 
     int ret = HAL_DATASPACE_UNKNOWN;
-    struct sgr_metadata *metadata = (struct sgr_metadata *)map_and_get_metadata(hnd, TYPE_GRALLOC, false);
+    MetadataMappingCache::Lease mapping;
+    struct sgr_metadata *metadata = (struct sgr_metadata *)map_and_get_metadata(hnd, TYPE_GRALLOC, false, &mapping);
     if (metadata == nullptr) {
         SGR_LOGE("[%s] metadata is null", __func__);
         return ret;
     }
     ret = metadata->dataspace;
-    unmap_metadata((void *)metadata, TYPE_GRALLOC);
 
     return ret;
 }
@@ -105,14 +109,14 @@ int ExynosGraphicBufferMeta::get_dataspace(buffer_handle_t hnd) {
 int ExynosGraphicBufferMeta::set_dataspace(buffer_handle_t hnd, android_dataspace_t dataspace) {
     SGR_LOGD("[%s] entry", __func__);
 
-    struct sgr_metadata *metadata = (struct sgr_metadata *)map_and_get_metadata(hnd, TYPE_GRALLOC, true);
+    MetadataMappingCache::Lease mapping;
+    struct sgr_metadata *metadata = (struct sgr_metadata *)map_and_get_metadata(hnd, TYPE_GRALLOC, true, &mapping);
     if (metadata == nullptr) {
         SGR_LOGE("[%s] metadata is null", __func__);
         return -1;
     }
     int temp = metadata->dataspace;
     metadata->dataspace = dataspace;
-    unmap_metadata((void *)metadata, TYPE_GRALLOC);
 
     SGR_LOGD("[%s] dataspace changed %d to %d", __func__, temp, dataspace);
     UNUSED(temp);
@@ -143,13 +147,13 @@ uint64_t ExynosGraphicBufferMeta::get_buffer_id(buffer_handle_t hnd) {
     if (metadata == nullptr) {
         SGR_LOGD("metadata is null(not imported), so mmap gralloc metadata");
 
-        metadata = (struct sgr_metadata *)map_and_get_metadata(hnd, TYPE_GRALLOC, false);
+        MetadataMappingCache::Lease mapping;
+        metadata = (struct sgr_metadata *)map_and_get_metadata(hnd, TYPE_GRALLOC, false, &mapping);
         if (metadata == nullptr) {
             SGR_LOGE("[%s] metadata is null, return id as 0", __func__);
             return 0;
         }
         uint64_t ret = metadata->buffer_id;
-        unmap_metadata((void *)metadata, TYPE_GRALLOC);
 
         return ret;
     }
@@ -349,7 +353,8 @@ int32_t ExynosGraphicBufferMeta::get_sajc_independent_block_size(buffer_handle_t
         if (gpu_meta == nullptr) {
             SGR_LOGD("metadata is null(not imported), so mmap gpu metadata");
 
-            gpu_meta = (struct sgr_metadata_gpu *)map_and_get_metadata(hnd, TYPE_GPU, false);
+            MetadataMappingCache::Lease mapping;
+            gpu_meta = (struct sgr_metadata_gpu *)map_and_get_metadata(hnd, TYPE_GPU, false, &mapping);
             if (gpu_meta == nullptr) {
                 SGR_LOGE("[%s] metadata is null", __func__);
                 return ret;
@@ -357,7 +362,6 @@ int32_t ExynosGraphicBufferMeta::get_sajc_independent_block_size(buffer_handle_t
             sajc_independent_64 = gpu_meta->dcc_independent_block_size_64;
             sajc_independent_128 = gpu_meta->dcc_independent_block_size_128;
             ret = (sajc_independent_128 << 1) | (sajc_independent_64);
-            unmap_metadata((void *)gpu_meta, TYPE_GPU);
 
             return ret;
         }
@@ -476,14 +480,14 @@ bool ExynosGraphicBufferMeta::get_sub_valid(buffer_handle_t hnd) {
         return false;
     }
 
-    struct sgr_metadata *metadata = (struct sgr_metadata *)map_and_get_metadata(hnd, TYPE_GRALLOC, false);
+    MetadataMappingCache::Lease mapping;
+    struct sgr_metadata *metadata = (struct sgr_metadata *)map_and_get_metadata(hnd, TYPE_GRALLOC, false, &mapping);
     if (metadata == nullptr) {
         SGR_LOGE("[%s] metadata is null", __func__);
         return false;
     }
 
     bool ret = metadata->sub_valid;
-    unmap_metadata((void *)metadata, TYPE_GRALLOC);
 
     return ret;
 }
@@ -502,14 +506,14 @@ int ExynosGraphicBufferMeta::set_sub_valid(buffer_handle_t hnd, bool valid) {
         return -EINVAL;
     }
 
-    struct sgr_metadata *metadata = (struct sgr_metadata *)map_and_get_metadata(hnd, TYPE_GRALLOC, true);
+    MetadataMappingCache::Lease mapping;
+    struct sgr_metadata *metadata = (struct sgr_metadata *)map_and_get_metadata(hnd, TYPE_GRALLOC, true, &mapping);
     if (metadata == nullptr) {
         SGR_LOGE("[%s] metadata is null", __func__);
         return -EINVAL;
     }
 
     metadata->sub_valid = valid;
-    unmap_metadata((void *)metadata, TYPE_GRALLOC);
 
     return 0;
 }
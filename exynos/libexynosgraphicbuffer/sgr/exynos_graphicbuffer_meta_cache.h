@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2020 Samsung Electronics Co. Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EXYNOS_GRAPHICBUFFER_META_CACHE_H
+#define EXYNOS_GRAPHICBUFFER_META_CACHE_H
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace vendor {
+namespace graphics {
+
+/*
+ * Mappings of the metadata buffers of the handles that were not imported in
+ * this process, shared by the accessors of ExynosGraphicBufferMeta.
+ * A mapping is looked up by the identity of the dmabuf behind the fd, its
+ * inode, so an fd closed and reused for another buffer never hits the mapping
+ * of the previous one. As a mapping holds a reference to its dmabuf, the
+ * inode cannot be reused while it is cached.
+ * A buffer is mapped read-write when its fd allows it, and the same mapping
+ * serves the getters and the setters. The least recently used mapping is
+ * dropped beyond `capacity`, and unmapped when the last accessor using it
+ * returns.
+ */
+class MetadataMappingCache {
+public:
+    struct Stats {
+        uint64_t lookups;
+        uint64_t hits;
+        uint64_t maps;
+        uint64_t unmaps;
+    };
+
+    class Mapping {
+    public:
+        Mapping(void *addr, size_t size, bool writable, std::atomic<uint64_t> *unmaps)
+            : addr(addr), size(size), writable(writable), mUnmaps(unmaps) {}
+        ~Mapping() {
+            munmap(addr, size);
+            (*mUnmaps)++;
+        }
+
+        void *const addr;
+        const size_t size;
+        const bool writable;
+
+    private:
+        Mapping(const Mapping &) = delete;
+        Mapping &operator=(const Mapping &) = delete;
+
+        std::atomic<uint64_t> *mUnmaps;
+    };
+
+    using Lease = std::shared_ptr<Mapping>;
+
+    MetadataMappingCache(size_t size, size_t capacity)
+        : mSize(size), mCapacity(capacity), mLookups(0), mHits(0), mMaps(0), mUnmaps(0) {}
+
+    /* Mapping of the buffer of fd, nullptr when it cannot be mapped as asked */
+    Lease get(int fd, bool write) {
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+            return nullptr;
+
+        Key key(st.st_dev, st.st_ino);
+        std::lock_guard<std::mutex> lock(mMutex);
+        mLookups++;
+
+        auto it = mMap.find(key);
+        if (it != mMap.end()) {
+            mLru.splice(mLru.begin(), mLru, it->second);
+            if (!write || it->second->second->writable) {
+                mHits++;
+                return it->second->second;
+            }
+
+            // mapped read-only through another fd, this one may allow writes
+            Lease mapping = map(fd, true);
+            if (mapping)
+                it->second->second = mapping;
+            return mapping;
+        }
+
+        Lease mapping = map(fd, true);
+        if (!mapping && !write)
+            mapping = map(fd, false);
+        if (!mapping)
+            return nullptr;
+
+        if (mCapacity == 0)
+            return mapping;
+        if (mMap.size() >= mCapacity) {
+            mMap.erase(mLru.back().first);
+            mLru.pop_back();
+        }
+        mLru.emplace_front(key, mapping);
+        mMap[key] = mLru.begin();
+
+        return mapping;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mMap.clear();
+        mLru.clear();
+    }
+
+    Stats stats() {
+        return {mLookups, mHits, mMaps, mUnmaps};
+    }
+
+private:
+    using Key = std::pair<dev_t, ino_t>;
+    using Entry = std::pair<Key, Lease>;
+
+    Lease map(int fd, bool write) {
+        int prot = write ? PROT_READ | PROT_WRITE : PROT_READ;
+
+        void *addr = mmap(0, mSize, prot, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED)
+            return nullptr;
+
+        mMaps++;
+        return std::make_shared<Mapping>(addr, mSize, write, &mUnmaps);
+    }
+
+    const size_t mSize;
+    const size_t mCapacity;
+
+    std::mutex mMutex;
+    std::list<Entry> mLru;
+    std::map<Key, std::list<Entry>::iterator> mMap;
+
+    std::atomic<uint64_t> mLookups;
+    std::atomic<uint64_t> mHits;
+    std::atomic<uint64_t> mMaps;
+    std::atomic<uint64_t> mUnmaps;
+};
+
+} // namespace graphics
+} // namespace vendor
+
+#endif
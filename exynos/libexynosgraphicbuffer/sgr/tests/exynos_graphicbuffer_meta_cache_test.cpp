@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2020 Samsung Electronics Co. Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "../exynos_graphicbuffer_meta_cache.h"
+
+using namespace vendor::graphics;
+
+namespace {
+
+// SGR_METADATA_SIZE_SUB_TOTAL is private to the gralloc, any size does for memfds
+constexpr size_t METADATA_SIZE = 0x3000;
+constexpr size_t DATASPACE_OFFSET = 0x1000;
+
+/* The fds of a handle not imported in this process, the last one is the metadata */
+struct FakeHandle {
+    int numFds;
+    int fds[3];
+};
+
+int new_metadata_fd(int dataspace) {
+    int fd = memfd_create("sgr_metadata", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, METADATA_SIZE) != 0)
+        return -1;
+    if (pwrite(fd, &dataspace, sizeof(dataspace), DATASPACE_OFFSET) != sizeof(dataspace))
+        return -1;
+    return fd;
+}
+
+FakeHandle new_handle(int dataspace) {
+    FakeHandle hnd;
+    hnd.numFds = 3;
+    hnd.fds[0] = memfd_create("sgr_plane0", MFD_CLOEXEC);
+    hnd.fds[1] = memfd_create("sgr_plane1", MFD_CLOEXEC);
+    hnd.fds[2] = new_metadata_fd(dataspace);
+    return hnd;
+}
+
+void free_handle(const FakeHandle &hnd) {
+    for (int i = 0; i < hnd.numFds; i++)
+        close(hnd.fds[i]);
+}
+
+int read_dataspace(MetadataMappingCache &cache, int fd) {
+    MetadataMappingCache::Lease mapping = cache.get(fd, false);
+    if (mapping == nullptr)
+        return -1;
+    return *reinterpret_cast<int *>(reinterpret_cast<uintptr_t>(mapping->addr) + DATASPACE_OFFSET);
+}
+
+TEST(MetadataMappingCacheTest, SharesMapping) {
+    MetadataMappingCache cache(METADATA_SIZE, 4);
+    int fd = new_metadata_fd(1);
+    ASSERT_GE(fd, 0);
+
+    MetadataMappingCache::Lease reader = cache.get(fd, false);
+    MetadataMappingCache::Lease writer = cache.get(fd, true);
+    ASSERT_NE(reader, nullptr);
+    EXPECT_EQ(reader, writer);
+
+    // another fd of the same buffer
+    int dup_fd = dup(fd);
+    EXPECT_EQ(cache.get(dup_fd, false), reader);
+
+    MetadataMappingCache::Stats stats = cache.stats();
+    EXPECT_EQ(stats.lookups, 3u);
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.maps, 1u);
+
+    close(dup_fd);
+    close(fd);
+}
+
+TEST(MetadataMappingCacheTest, ReusedFdMapsNewBuffer) {
+    MetadataMappingCache cache(METADATA_SIZE, 4);
+    int fd = new_metadata_fd(1);
+    ASSERT_GE(fd, 0);
+    EXPECT_EQ(read_dataspace(cache, fd), 1);
+    close(fd);
+
+    // the lowest free fd, the one just closed
+    int reused = new_metadata_fd(2);
+    ASSERT_EQ(reused, fd);
+    EXPECT_EQ(read_dataspace(cache, reused), 2);
+    EXPECT_EQ(cache.stats().maps, 2u);
+
+    close(reused);
+}
+
+TEST(MetadataMappingCacheTest, ReadOnlyFd) {
+    MetadataMappingCache cache(METADATA_SIZE, 4);
+    int fd = new_metadata_fd(1);
+    ASSERT_GE(fd, 0);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    int ro_fd = open(path, O_RDONLY | O_CLOEXEC);
+    ASSERT_GE(ro_fd, 0);
+
+    MetadataMappingCache::Lease reader = cache.get(ro_fd, false);
+    ASSERT_NE(reader, nullptr);
+    EXPECT_FALSE(reader->writable);
+    EXPECT_EQ(cache.get(ro_fd, true), nullptr);
+
+    // a writable fd of the same buffer replaces the read-only mapping
+    MetadataMappingCache::Lease writer = cache.get(fd, true);
+    ASSERT_NE(writer, nullptr);
+    EXPECT_TRUE(writer->writable);
+    EXPECT_EQ(cache.get(ro_fd, false), writer);
+
+    close(ro_fd);
+    close(fd);
+}
+
+TEST(MetadataMappingCacheTest, EvictsLeastRecentlyUsed) {
+    MetadataMappingCache cache(METADATA_SIZE, 2);
+    int fds[3];
+    for (int i = 0; i < 3; i++) {
+        fds[i] = new_metadata_fd(i);
+        ASSERT_GE(fds[i], 0);
+    }
+
+    MetadataMappingCache::Lease first = cache.get(fds[0], false);
+    cache.get(fds[1], false);
+    cache.get(fds[0], false);
+    cache.get(fds[2], false);
+    EXPECT_EQ(cache.stats().unmaps, 1u);
+
+    // fds[0] was used more recently than fds[1], and it is still mapped
+    EXPECT_EQ(cache.get(fds[0], false), first);
+    EXPECT_EQ(read_dataspace(cache, fds[1]), 1);
+    EXPECT_EQ(cache.stats().maps, 4u);
+
+    // evicted while in use, unmapped once its last user is done
+    cache.get(fds[2], false);
+    cache.get(fds[1], false);
+    uint64_t unmaps = cache.stats().unmaps;
+    EXPECT_EQ(*reinterpret_cast<int *>(reinterpret_cast<uintptr_t>(first->addr) + DATASPACE_OFFSET), 0);
+    first.reset();
+    EXPECT_EQ(cache.stats().unmaps, unmaps + 1);
+
+    cache.clear();
+    EXPECT_EQ(cache.stats().unmaps, cache.stats().maps);
+
+    for (int i = 0; i < 3; i++)
+        close(fds[i]);
+}
+
+/*
+ * A frame of HWC: for every layer the buffer id to find its cached state, the
+ * dataspace, the downscaled plane, and the dataspace written back after the
+ * color conversion. The buffers rotate through a triple buffered queue.
+ */
+constexpr int LAYERS = 8;
+constexpr int QUEUE_DEPTH = 3;
+constexpr int FRAMES = 300;
+constexpr int CALLS_PER_LAYER = 4;
+
+struct FrameResult {
+    double usPerCall;
+    double syscallsPerCall;
+};
+
+/* map_and_get_metadata() before the cache: mmap, one field, munmap */
+FrameResult run_uncached(const std::vector<FakeHandle> &handles) {
+    uint64_t syscalls = 0;
+    volatile int sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        for (int layer = 0; layer < LAYERS; layer++) {
+            const FakeHandle &hnd = handles[layer * QUEUE_DEPTH + frame % QUEUE_DEPTH];
+            int fd = hnd.fds[hnd.numFds - 1];
+
+            for (int call = 0; call < CALLS_PER_LAYER; call++) {
+                bool write = (call == CALLS_PER_LAYER - 1);
+                int prot = write ? PROT_READ | PROT_WRITE : PROT_READ;
+                void *addr = mmap(0, METADATA_SIZE, prot, MAP_SHARED, fd, 0);
+                int *dataspace = reinterpret_cast<int *>(reinterpret_cast<uintptr_t>(addr) + DATASPACE_OFFSET);
+                if (write)
+                    *dataspace = frame;
+                else
+                    sink = *dataspace;
+                munmap(addr, METADATA_SIZE);
+                syscalls += 2;
+            }
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+    (void)sink;
+
+    double calls = double(FRAMES) * LAYERS * CALLS_PER_LAYER;
+    return {elapsed.count() / calls, syscalls / calls};
+}
+
+FrameResult run_cached(const std::vector<FakeHandle> &handles, MetadataMappingCache &cache) {
+    volatile int sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        for (int layer = 0; layer < LAYERS; layer++) {
+            const FakeHandle &hnd = handles[layer * QUEUE_DEPTH + frame % QUEUE_DEPTH];
+            int fd = hnd.fds[hnd.numFds - 1];
+
+            for (int call = 0; call < CALLS_PER_LAYER; call++) {
+                bool write = (call == CALLS_PER_LAYER - 1);
+                MetadataMappingCache::Lease mapping = cache.get(fd, write);
+                int *dataspace = reinterpret_cast<int *>(reinterpret_cast<uintptr_t>(mapping->addr) + DATASPACE_OFFSET);
+                if (write)
+                    *dataspace = frame;
+                else
+                    sink = *dataspace;
+            }
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+    (void)sink;
+
+    // a lookup is one fstat
+    MetadataMappingCache::Stats stats = cache.stats();
+    double calls = double(FRAMES) * LAYERS * CALLS_PER_LAYER;
+    return {elapsed.count() / calls, (stats.lookups + stats.maps + stats.unmaps) / calls};
+}
+
+TEST(MetadataMappingCacheTest, HwcFrameBenchmark) {
+    std::vector<FakeHandle> handles;
+    for (int i = 0; i < LAYERS * QUEUE_DEPTH; i++) {
+        handles.push_back(new_handle(i));
+        ASSERT_GE(handles.back().fds[2], 0);
+    }
+
+    MetadataMappingCache cache(METADATA_SIZE, 64);
+    FrameResult uncached = run_uncached(handles);
+    FrameResult cached = run_cached(handles, cache);
+
+    printf("%d layers, %d buffers each, %d calls per layer and frame, %d frames\n", LAYERS, QUEUE_DEPTH,
+           CALLS_PER_LAYER, FRAMES);
+    printf("%-10s %12s %14s\n", "", "us/call", "syscalls/call");
+    printf("%-10s %12.2f %14.2f\n", "mmap", uncached.usPerCall, uncached.syscallsPerCall);
+    printf("%-10s %12.2f %14.2f\n", "cache", cached.usPerCall, cached.syscallsPerCall);
+
+    EXPECT_EQ(cache.stats().maps, static_cast<uint64_t>(LAYERS * QUEUE_DEPTH));
+    EXPECT_LT(cached.syscallsPerCall, 1.1);
+    EXPECT_LT(cached.usPerCall, uncached.usPerCall);
+
+    for (auto &hnd : handles)
+        free_handle(hnd);
+}
+
+} // namespace
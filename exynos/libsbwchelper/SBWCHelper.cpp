@@ -14,10 +14,21 @@
  * limitations under the License.
  */
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
 #include <utility>
 #include <unordered_map>
+#include <vector>
 
 #include <log/log.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <utils/Trace.h>
 #include <utils/StrongPointer.h>
@@ -29,6 +40,7 @@
 #include <vendor/samsung_slsi/hardware/SbwcDecompService/1.0/ISbwcDecompService.h>
 
 #include "SBWCHelper.h"
+#include "SBWCHelperInternal.h"
 #include "exynos_format.h"
 #include "ExynosGraphicBufferCore.h"
 
@@ -38,14 +50,103 @@ using namespace vendor::graphics;
 namespace SBWCHelper
 {
 
-static std::unordered_map<AHardwareBuffer*, AHardwareBuffer*> yuvToSbwc;
-static std::unordered_map<AHardwareBuffer*, AHardwareBuffer*> sbwcToYuv;
-static std::unordered_map<AHardwareBuffer*, int32_t> ref;
+/* Decompression holding both buffers, fenceFd is signaled once it is done unless it is -1 */
+struct DecompJob
+{
+	AHardwareBuffer *yuvAHB;
+	AHardwareBuffer *sbwcAHB;
+	int fenceFd;
+	bool *result;	// set, helperMutex held, before fenceFd signals, nullptr if no one waits for it
+};
+
+/* What the users of a YUV buffer said when they freed it, the pool does not reuse it before */
+struct ReleaseGate
+{
+	std::vector<int> fenceFds;	// release fences of the GPU work reading it
+	bool unfenced = false;		// freed without a fence, never given to the pool
+};
+
+/* YUV buffer no one uses, kept to be given to the next SBWC buffer with the same desc */
+struct PooledAHB
+{
+	AHardwareBuffer *ahb;
+	AHardwareBuffer_Desc desc;
+	size_t size;
+	std::chrono::steady_clock::time_point freedAt;
+	ReleaseGate gate;
+};
+
+/* Threads doing the async decompressions and releasing the pool, joined at exit */
+class HelperThreads
+{
+public:
+	~HelperThreads();
+
+	/** Queue a decompression for a worker, one is started if none is idle, helperMutex held
+	 *
+	 * @param[in] inJob first decompression of its YUV AHardwareBuffer
+	 */
+	void post(const DecompJob &inJob);
+
+	/** Start the thread releasing the buffers of the pool once they time out, helperMutex held
+	 */
+	void startPool();
+
+private:
+	void workerLoop();
+
+	std::vector<std::thread> mWorkers;
+	std::thread mPoolThread;
+	std::deque<DecompJob> mJobs;
+	size_t mIdle = 0;
+	bool mStopping = false;
+};
+
+/*
+ * Signal count of a fence once the decompression is done. The fence is a semaphore,
+ * a read() takes 1 of it, so it stays signaled for every poll() and sync_wait() after.
+ */
+static constexpr uint64_t FENCE_SIGNALED = UINT64_MAX / 2;
+
+// The workers started at most, the decompressions of more buffers wait for one of them
+static constexpr size_t MAX_WORKERS = 4;
+
+/*
+ * Protects everything below, the calls to SbwcDecompService are made without it.
+ * The threads are joined by the destructor of helperThreads at exit, so what they
+ * use is never destroyed.
+ */
+static std::mutex &helperMutex = *new std::mutex();
+
+static auto &yuvToSbwc = *new std::unordered_map<AHardwareBuffer*, AHardwareBuffer*>();
+static auto &sbwcToYuv = *new std::unordered_map<AHardwareBuffer*, AHardwareBuffer*>();
+static auto &ref = *new std::unordered_map<AHardwareBuffer*, int32_t>();
 
 static buffer_handle_t lastSrc, lastDst;
 
+static auto &decompService = *new android::sp<ISbwcDecompService>();
+
+// YUV buffers being decompressed to, with the decompressions queued after the current one
+static auto &busyYuv = *new std::unordered_map<AHardwareBuffer*, std::deque<DecompJob>>();
+
+// desc the YUV buffers in use were allocated with
+static auto &yuvDesc = *new std::unordered_map<AHardwareBuffer*, AHardwareBuffer_Desc>();
+// release fences of the YUV buffers freed by some of their users only
+static auto &yuvGates = *new std::unordered_map<AHardwareBuffer*, ReleaseGate>();
+static auto &yuvPool = *new std::list<PooledAHB>();
+static size_t yuvPoolSize;
+static PoolStats yuvPoolStats;
+
+static auto &poolCondition = *new std::condition_variable();
+static auto &workerCondition = *new std::condition_variable();
+
 static bool debugEnabled = android::base::GetBoolProperty("vendor.sbwchelper.debug.enabled", false);
 static bool traceEnabled = android::base::GetBoolProperty("vendor.sbwchelper.trace.enabled", false);
+static size_t poolBudget = android::base::GetUintProperty<size_t>("vendor.sbwchelper.pool.size_kb", 65536) * 1024;
+static std::chrono::milliseconds poolTimeout(
+		android::base::GetUintProperty<uint32_t>("vendor.sbwchelper.pool.timeout_ms", 1000));
+
+static HelperThreads helperThreads;
 
 /** Check format is 10bit or not
  *
@@ -54,7 +155,28 @@ static bool traceEnabled = android::base::GetBoolProperty("vendor.sbwchelper.tra
  */
 static bool is10Bit(uint32_t format);
 
-/** Allocate YUV AHardwareBuffer used SBWC AHardwareBuffer's information
+/** Get the desc of the YUV AHardwareBuffer of a SBWC AHardwareBuffer
+ *
+ * @param[in] inSbwcAHB SBWC AHardwareBuffer
+ * @param[out] outDesc desc of the YUV AHardwareBuffer
+ */
+static void getYuvDesc(AHardwareBuffer *inSbwcAHB, AHardwareBuffer_Desc *outDesc);
+
+/** Whether the GPU is done with a pooled YUV AHardwareBuffer, helperMutex held
+ *
+ * @param[in] inPooled pooled YUV AHardwareBuffer, its signaled fences are closed
+ * @return whether it can be given to another SBWC AHardwareBuffer
+ */
+static bool isReusable(PooledAHB &inPooled);
+
+/** Release a YUV AHardwareBuffer of the pool and close its fences, helperMutex held
+ *
+ * @param[in] inPooled pooled YUV AHardwareBuffer
+ */
+static void releasePooled(PooledAHB &inPooled);
+
+/** Get YUV AHardwareBuffer used SBWC AHardwareBuffer's information, from the pool or allocated,
+ *  helperMutex held
  *
  * @param[in] inSbwcAHB SBWC AHardwareBuffer
  * @param[out] outYuvAHB YUV AHardwareaBuffer
@@ -62,6 +184,83 @@ static bool is10Bit(uint32_t format);
  */
 static int64_t allocAHB(AHardwareBuffer *inSbwcAHB, AHardwareBuffer **outYuvAHB);
 
+/** Give a YUV AHardwareBuffer no one uses to the pool, helperMutex held
+ *
+ * It is released instead if one of its users freed it without a release fence, the GPU
+ * may still read it then.
+ *
+ * @param[in] inYuvAHB YUV AHardwareBuffer
+ * @param[in] inGate what its users freed it with
+ */
+static void poolAHB(AHardwareBuffer *inYuvAHB, ReleaseGate &&inGate);
+
+/** Release the buffers of the pool freed for longer than the time out, helperMutex held
+ *
+ * @param[in] now current time
+ * @return the time the next buffer times out, time_point::max() if the pool is empty
+ */
+static std::chrono::steady_clock::time_point expirePool(std::chrono::steady_clock::time_point now);
+
+/** Get a YUV AHardwareBuffer for a SBWC AHardwareBuffer and count the reference
+ *
+ * @param[in] inSbwcAHB SBWC AHardwareBuffer
+ * @param[out] outYuvAHB YUV AHardwareBuffer
+ * @return result
+ */
+static bool acquireYuvAHB(AHardwareBuffer *inSbwcAHB, AHardwareBuffer **outYuvAHB);
+
+/** Drop a reference to a YUV AHardwareBuffer
+ *
+ * @param[in] inYuvAHB YUV AHardwareBuffer
+ * @param[in] inFenced whether inFenceFd tells when the caller's GPU work is done
+ * @param[in] inFenceFd release fence, -1 if already done, closed by this function
+ * @param[out] outLast whether it was the last reference
+ * @return result
+ */
+static bool releaseYuvAHB(AHardwareBuffer *inYuvAHB, bool inFenced, int inFenceFd, bool *outLast);
+
+/** Create a fence for a decompression, and the fd its worker signals
+ *
+ * @param[out] outWorkerFd fd signaling the fence
+ * @return fence fd, -1 on failure
+ */
+static int createFence(int *outWorkerFd);
+
+/** Start a decompression, after the ones of the same YUV AHardwareBuffer requested before
+ *
+ * A decompression is queued to a worker thread, so the decompressions of different buffers
+ * are not serialized here, up to MAX_WORKERS at a time. When inAsync is false and none is
+ * in flight for the buffer, it is left to the calling thread instead, in outJob.
+ *
+ * @param[in] inSbwcAHB SBWC AHardwareBuffer
+ * @param[in] inAsync whether the caller waits on a fence
+ * @param[in,out] outJob its result is where the result is set, decompression for the calling
+ *                thread to do, its fenceFd is -1
+ * @param[out] outFenceFd fence fd of the decompression, -1 if it is in outJob
+ * @return result
+ */
+static bool startDecompress(AHardwareBuffer *inSbwcAHB, bool inAsync, DecompJob *outJob, int *outFenceFd);
+
+/** Do a decompression, signal its fence and take the next one of its YUV AHardwareBuffer
+ *
+ * @param[in] inJob decompression to do, its buffers are released
+ * @param[out] outNext next decompression, its yuvAHB is nullptr if there is none
+ * @return result of the decompression
+ */
+static bool doDecompress(const DecompJob &inJob, DecompJob *outNext);
+
+/** Do the decompressions of a YUV AHardwareBuffer until none is queued
+ *
+ * @param[in] inJob first decompression
+ */
+static void decompressLoop(DecompJob inJob);
+
+/** Release the buffers of the pool once they time out, until stopping is set
+ *
+ * @param[in] stopping set, helperMutex held, to return
+ */
+static void poolLoop(const bool &stopping);
+
 /** Get attribute for SbwcDecompService
  *
  * @param[in] handle native handle used to set attribute
@@ -174,88 +373,92 @@ bool ContainsSbwcData(AHardwareBuffer *inAHB)
 
 bool newYuvAHB(AHardwareBuffer *inSbwcAHB, AHardwareBuffer **outYuvAHB)
 {
-	AHardwareBuffer *yuvAHB = nullptr;
-	int64_t result = android::NO_ERROR;
-
 	if (traceEnabled)
 	{
 		ATRACE_CALL();
 	}
 
-	if (inSbwcAHB == nullptr || (!isSbwcFormat(inSbwcAHB)))
+	if (inSbwcAHB == nullptr || outYuvAHB == nullptr || (!isSbwcFormat(inSbwcAHB)))
 	{
 		ALOGE("[SBWC] %s: Invalid value \"%s\" %s:%d",
 				__func__,
-				(inSbwcAHB == nullptr) ? "Null pointer" : "No SBWC",
+				(inSbwcAHB == nullptr || outYuvAHB == nullptr) ? "Null pointer" : "No SBWC",
 				__FILE__,
 				__LINE__);
 		return false;
 	}
 
-	if (sbwcToYuv.count(inSbwcAHB) > 0)
-	{
-		AHardwareBuffer *yuvAHB = sbwcToYuv.at(inSbwcAHB);
-
-		*outYuvAHB = yuvAHB;
+	return acquireYuvAHB(inSbwcAHB, outYuvAHB);
+}
 
-		ref.at(yuvAHB) += 1;
+bool decompress(AHardwareBuffer *inSbwcAHB)
+{
+	bool result = false;
 
-		if (debugEnabled)
-		{
-			ALOGD("[SBWC] %s: Increase ref counter AHB: %p ref: %" PRId32 "", __func__, yuvAHB, ref.at(yuvAHB));
-		}
+	if (traceEnabled)
+	{
+		ATRACE_CALL();
+	}
 
-		AHardwareBuffer_acquire(inSbwcAHB);
+	if (inSbwcAHB == nullptr)
+	{
+		ALOGE("[SBWC] %s: Invalid value \"%s\" %s:%d",
+				__func__,
+				"Null pointer",
+				__FILE__,
+				__LINE__);
+		return false;
+	}
 
-		return true;
+	if (debugEnabled)
+	{
+		ALOGD("[SBWC] %s: inSbwcAHB: %p", __func__, inSbwcAHB);
 	}
 
-	// Allocate AHB per every request now
-	// To do: Make more efficiently
-	result = allocAHB(inSbwcAHB, &yuvAHB);
+	DecompJob job = {nullptr, nullptr, -1, &result};
+	int fenceFd = -1;
 
-	if (result != android::NO_ERROR)
+	if (!startDecompress(inSbwcAHB, false, &job, &fenceFd))
 	{
-		ALOGE("[SBWC] %s: \"YUV allocation failed\" %s:%d",
-				__func__, __FILE__, __LINE__);
 		return false;
 	}
 
-	yuvToSbwc.insert({yuvAHB, inSbwcAHB});
-	sbwcToYuv.insert({inSbwcAHB, yuvAHB});
+	if (fenceFd < 0)
+	{
+		DecompJob next = {nullptr, nullptr, -1, nullptr};
 
-	ref.insert({yuvAHB, 1});
+		// Nothing to wait for, decompressed on the calling thread
+		bool done = doDecompress(job, &next);
 
-	*outYuvAHB = yuvAHB;
+		if (next.yuvAHB != nullptr)
+		{
+			std::lock_guard<std::mutex> lock(helperMutex);
+			helperThreads.post(next);
+		}
 
-	if (debugEnabled)
-	{
-		const native_handle_t *handle = AHardwareBuffer_getNativeHandle(inSbwcAHB);
-		uint32_t format = ExynosGraphicBufferMeta::get_format(handle);
+		return done;
+	}
 
-		ALOGD("[SBWC] %s: inSbwcAHB: %p format: 0x%" PRIX32 "",
-				__func__, inSbwcAHB, format);
+	// Blocks until the worker thread set the result
+	struct pollfd pfd = { .fd = fenceFd, .events = POLLIN, .revents = 0 };
 
-		handle = AHardwareBuffer_getNativeHandle(*outYuvAHB);
-		format = ExynosGraphicBufferMeta::get_format(handle);
+	while ((poll(&pfd, 1, -1) < 0) && (errno == EINTR));
 
-		ALOGD("[SBWC] %s: outYuvAHB: %p format: 0x%" PRIX32 "",
-				__func__, yuvAHB, format);
-	}
+	close(fenceFd);
 
-	AHardwareBuffer_acquire(inSbwcAHB);
+	std::lock_guard<std::mutex> lock(helperMutex);
 
-	return true;
+	return result;
 }
 
-bool decompress(AHardwareBuffer *inSbwcAHB)
+bool decompressAsync(AHardwareBuffer *inSbwcAHB, int *outFenceFd)
 {
 	if (traceEnabled)
 	{
 		ATRACE_CALL();
 	}
 
-	if (inSbwcAHB == nullptr)
+	if (inSbwcAHB == nullptr || outFenceFd == nullptr)
 	{
 		ALOGE("[SBWC] %s: Invalid value \"%s\" %s:%d",
 				__func__,
@@ -270,22 +473,22 @@ bool decompress(AHardwareBuffer *inSbwcAHB)
 		ALOGD("[SBWC] %s: inSbwcAHB: %p", __func__, inSbwcAHB);
 	}
 
-	if (sbwcToYuv.count(inSbwcAHB) <= 0)
+	DecompJob job = {nullptr, nullptr, -1, nullptr};
+	int fenceFd = -1;
+
+	if (!startDecompress(inSbwcAHB, true, &job, &fenceFd))
 	{
-		ALOGE("[SBWC] %s: Invalid value \"Not registered SBWC AHB\" AHB: %p %s:%d",
-				__func__, inSbwcAHB, __FILE__, __LINE__);
 		return false;
 	}
 
-	AHardwareBuffer *yuvAHB = sbwcToYuv.at(inSbwcAHB);
+	*outFenceFd = fenceFd;
 
-	return requestDecompress(yuvAHB, inSbwcAHB);
+	return true;
 }
 
-// To do: Deferred free
 bool freeYuvAHB(AHardwareBuffer **inYuvAHB)
 {
-	AHardwareBuffer *sbwcAHB;
+	bool last = false;
 
 	if (traceEnabled)
 	{
@@ -302,49 +505,50 @@ bool freeYuvAHB(AHardwareBuffer **inYuvAHB)
 		return false;
 	}
 
-	if ((yuvToSbwc.count(*inYuvAHB) == 0) || (ref.at(*inYuvAHB) <= 0))
+	if (!releaseYuvAHB(*inYuvAHB, false, -1, &last))
 	{
-		ALOGE("[SBWC] %s: Invalid value \"Not registered YUV AHB\" %s:%d",
-				__func__, __FILE__, __LINE__);
 		return false;
 	}
-	// Multiple referenced
-	else if (ref.at(*inYuvAHB) > 1)
-	{
-		ref.at(*inYuvAHB) -= 1;
-
-		if (debugEnabled)
-		{
-			ALOGD("[SBWC] %s: Decrease ref counter AHB: %p ref: %" PRId32 "", __func__, *inYuvAHB, ref.at(*inYuvAHB));
-		}
-
-		sbwcAHB = yuvToSbwc.at(*inYuvAHB);
-		AHardwareBuffer_release(sbwcAHB);
 
-		return true;
+	if (last)
+	{
+		*inYuvAHB = nullptr;
 	}
 
-	sbwcAHB = yuvToSbwc.at(*inYuvAHB);
+	return true;
+}
 
-	sbwcToYuv.erase(sbwcAHB);
-	yuvToSbwc.erase(*inYuvAHB);
+bool freeYuvAHB(AHardwareBuffer **inYuvAHB, int releaseFenceFd)
+{
+	bool last = false;
 
-	if (debugEnabled)
+	if (traceEnabled)
 	{
-		ALOGD("[SBWC] %s: Deleted SBWC AHB: %p",
-				__func__, sbwcAHB);
-
-		ALOGD("[SBWC] %s: Deleted YUV AHB: %p",
-				__func__, *inYuvAHB);
+		ATRACE_CALL();
 	}
 
-	AHardwareBuffer_release(*inYuvAHB);
-	AHardwareBuffer_release(sbwcAHB);
+	if (inYuvAHB == nullptr || *inYuvAHB == nullptr)
+	{
+		ALOGE("[SBWC] %s: Invalid value \"%s\" %s:%d",
+				__func__,
+				(inYuvAHB == nullptr) || (*inYuvAHB == nullptr) ? "Null pointer" : "No YUV",
+				__FILE__,
+				__LINE__);
+		if (releaseFenceFd >= 0)
+		{
+			close(releaseFenceFd);
+		}
+		return false;
+	}
 
-	*inYuvAHB = nullptr;
+	if (!releaseYuvAHB(*inYuvAHB, true, releaseFenceFd, &last))
+	{
+		return false;
+	}
 
-	if ((sbwcToYuv.size() == 0) && (yuvToSbwc.size() == 0)) {
-		lastSrc = lastDst = 0;
+	if (last)
+	{
+		*inYuvAHB = nullptr;
 	}
 
 	return true;
@@ -382,7 +586,6 @@ uint32_t getByteStride(uint32_t format, uint32_t alloc_width, [[maybe_unused]] u
 AHardwareBuffer *newYuvAHB(AHardwareBuffer *sbwcAHB)
 {
 	AHardwareBuffer *yuvAHB = nullptr;
-	int64_t result = android::NO_ERROR;
 
 	if (sbwcAHB == nullptr || (!isSbwcFormat(sbwcAHB)))
 	{
@@ -394,61 +597,17 @@ AHardwareBuffer *newYuvAHB(AHardwareBuffer *sbwcAHB)
 		return nullptr;
 	}
 
-	if (sbwcToYuv.count(sbwcAHB) > 0)
-	{
-		AHardwareBuffer *yuvAHB = sbwcToYuv.at(sbwcAHB);
-
-		ref.at(yuvAHB) += 1;
-
-		if (debugEnabled)
-		{
-			ALOGD("[SBWC] %s: Increase ref counter AHB: %p ref: %" PRId32 "", __func__, yuvAHB, ref.at(yuvAHB));
-		}
-
-		AHardwareBuffer_acquire(sbwcAHB);
-
-		return yuvAHB;
-	}
-
-	// Allocate AHB per every request now
-	// To do: Make more efficiently
-	result = allocAHB(sbwcAHB, &yuvAHB);
-
-	if (result != android::NO_ERROR)
+	if (!acquireYuvAHB(sbwcAHB, &yuvAHB))
 	{
-		ALOGE("[SBWC] %s: \"YUV allocation failed\" %s:%d",
-				__func__, __FILE__, __LINE__);
 		return nullptr;
 	}
 
-	yuvToSbwc.insert({yuvAHB, sbwcAHB});
-	sbwcToYuv.insert({sbwcAHB, yuvAHB});
-
-	ref.insert({yuvAHB, 1});
-
-	if (debugEnabled)
-	{
-		const native_handle_t *handle = AHardwareBuffer_getNativeHandle(sbwcAHB);
-		uint32_t format = ExynosGraphicBufferMeta::get_format(handle);
-
-		ALOGD("[SBWC] %s: inSbwcAHB: %p format: 0x%" PRIX32 "",
-				__func__, sbwcAHB, format);
-
-		handle = AHardwareBuffer_getNativeHandle(yuvAHB);
-		format = ExynosGraphicBufferMeta::get_format(handle);
-
-		ALOGD("[SBWC] %s: outYuvAHB: %p format: 0x%" PRIX32 "",
-				__func__, yuvAHB, format);
-	}
-
-	AHardwareBuffer_acquire(sbwcAHB);
-
 	return yuvAHB;
 }
 
 bool freeYuvAHB(AHardwareBuffer *yuvAHB)
 {
-	AHardwareBuffer *sbwcAHB;
+	bool last = false;
 
 	if (yuvAHB == nullptr)
 	{
@@ -460,48 +619,42 @@ bool freeYuvAHB(AHardwareBuffer *yuvAHB)
 		return false;
 	}
 
-	if ((yuvToSbwc.count(yuvAHB) == 0) || (ref.at(yuvAHB) <= 0))
-	{
-		ALOGE("[SBWC] %s: Invalid value \"Not registered YUV AHB: %p\" %s:%d",
-				__func__, yuvAHB, __FILE__, __LINE__);
-		return false;
-	}
-	// Multiple referenced
-	else if (ref.at(yuvAHB) > 1)
-	{
-		ref.at(yuvAHB) -= 1;
-
-		if (debugEnabled)
-		{
-			ALOGD("[SBWC] %s: Decrease ref counter AHB: %p ref: %" PRId32 "", __func__, yuvAHB, ref.at(yuvAHB));
-		}
+	return releaseYuvAHB(yuvAHB, false, -1, &last);
+}
 
-		sbwcAHB = yuvToSbwc.at(yuvAHB);
-		AHardwareBuffer_release(sbwcAHB);
+//---------------------------------------------------------------------------------------
+// Internal functions
+//---------------------------------------------------------------------------------------
 
-		return true;
-	}
+void setDecompService(const android::sp<ISbwcDecompService> &service)
+{
+	std::lock_guard<std::mutex> lock(helperMutex);
 
-	sbwcAHB = yuvToSbwc.at(yuvAHB);
+	decompService = service;
+	lastSrc = lastDst = 0;
+}
 
-	sbwcToYuv.erase(sbwcAHB);
-	yuvToSbwc.erase(yuvAHB);
+size_t trimYuvPool()
+{
+	std::lock_guard<std::mutex> lock(helperMutex);
+	size_t count = yuvPool.size();
 
-	if (debugEnabled)
+	for (auto &pooled : yuvPool)
 	{
-		ALOGD("[SBWC] %s: Deleted SBWC AHB: %p", __func__, sbwcAHB);
-
-		ALOGD("[SBWC] %s: Deleted YUV AHB: %p", __func__, yuvAHB);
+		releasePooled(pooled);
 	}
 
-	AHardwareBuffer_release(yuvAHB);
-	AHardwareBuffer_release(sbwcAHB);
+	yuvPool.clear();
+	yuvPoolSize = 0;
 
-	if ((sbwcToYuv.size() == 0) && (yuvToSbwc.size() == 0)) {
-		lastSrc = lastDst = 0;
-	}
+	return count;
+}
 
-	return true;
+PoolStats getYuvPoolStats()
+{
+	std::lock_guard<std::mutex> lock(helperMutex);
+
+	return yuvPoolStats;
 }
 
 //---------------------------------------------------------------------------------------
@@ -550,64 +703,580 @@ static bool is10Bit(uint32_t format)
         }
 }
 
-static int64_t allocAHB(AHardwareBuffer *inSbwcAHB, AHardwareBuffer **outYuvAHB)
+static void getYuvDesc(AHardwareBuffer *inSbwcAHB, AHardwareBuffer_Desc *outDesc)
 {
 	const native_handle_t *handle = AHardwareBuffer_getNativeHandle(inSbwcAHB);
-	AHardwareBuffer_Desc desc;
 
-	desc.width = ExynosGraphicBufferMeta::get_width(handle);
-	desc.height = ExynosGraphicBufferMeta::get_height(handle);
-	desc.layers = 1;
-	desc.rfu0 = 0;
-	desc.rfu1 = 0;
-	desc.usage = ExynosGraphicBufferMeta::get_usage(handle);
-	desc.format = AHARDWAREBUFFER_FORMAT_Y8Cb8Cr8_420;
+	outDesc->width = ExynosGraphicBufferMeta::get_width(handle);
+	outDesc->height = ExynosGraphicBufferMeta::get_height(handle);
+	outDesc->layers = 1;
+	outDesc->stride = 0;
+	outDesc->rfu0 = 0;
+	outDesc->rfu1 = 0;
+	outDesc->usage = ExynosGraphicBufferMeta::get_usage(handle);
+	outDesc->format = AHARDWAREBUFFER_FORMAT_Y8Cb8Cr8_420;
 
 	switch (ExynosGraphicBufferMeta::get_format(handle)) {
 		case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN_10B_SBWC:
-			desc.format = HAL_PIXEL_FORMAT_YCBCR_P010; // 0x36
+			outDesc->format = HAL_PIXEL_FORMAT_YCBCR_P010; // 0x36
 	}
 
 	/*
 	 * AHardwareBuffer allocation allowed YUV format as AHARDWAREBUFFER_FORMAT_Y8Cb8Cr8_420 only
 	 * So we need to set 10bit flag to allocate 10bit format
 	 */
-	desc.usage |= is10Bit(ExynosGraphicBufferMeta::get_format(handle)) ? SBWC_REQUEST_10BIT : 0;
-
-	return AHardwareBuffer_allocate(&desc, outYuvAHB);
+	outDesc->usage |= is10Bit(ExynosGraphicBufferMeta::get_format(handle)) ? SBWC_REQUEST_10BIT : 0;
 }
 
-static uint32_t getAttr(const native_handle_t *handle)
+static bool isSameDesc(const AHardwareBuffer_Desc &a, const AHardwareBuffer_Desc &b)
 {
-	uint32_t attr = 0;
-	uint64_t usage = ExynosGraphicBufferMeta::get_usage(handle);
+	return (a.width == b.width) && (a.height == b.height) && (a.layers == b.layers)
+		&& (a.format == b.format) && (a.usage == b.usage);
+}
 
-	// To do: Use function from libexynosgraphicbuffer_core instead magic number
-	if (usage & (1ULL << 14))
+static bool isReusable(PooledAHB &inPooled)
+{
+	// Still written by a decompression requested before it was freed
+	if (busyYuv.count(inPooled.ahb) > 0)
 	{
-		attr |= SBWCDECODER_ATTR_SECURE_BUFFER;
+		return false;
 	}
 
-	return attr;
-}
+	auto &fenceFds = inPooled.gate.fenceFds;
 
-static bool requestDecompress(AHardwareBuffer *inYuvAHB, AHardwareBuffer *inSbwcAHB)
-{
-	const native_handle_t *yuvHandle = AHardwareBuffer_getNativeHandle(inYuvAHB);
-	const native_handle_t *sbwcHandle = AHardwareBuffer_getNativeHandle(inSbwcAHB);
+	while (!fenceFds.empty())
+	{
+		struct pollfd pfd = { .fd = fenceFds.back(), .events = POLLIN, .revents = 0 };
 
-	android::hardware::hidl_handle yuvHidlHandle(yuvHandle);
-	android::hardware::hidl_handle sbwcHidlHandle(sbwcHandle);
+		if (poll(&pfd, 1, 0) != 1)
+		{
+			return false;
+		}
+
+		close(fenceFds.back());
+		fenceFds.pop_back();
+	}
+
+	return true;
+}
+
+static void releasePooled(PooledAHB &inPooled)
+{
+	for (int fenceFd : inPooled.gate.fenceFds)
+	{
+		close(fenceFd);
+	}
+	inPooled.gate.fenceFds.clear();
+
+	AHardwareBuffer_release(inPooled.ahb);
+}
+
+static int64_t allocAHB(AHardwareBuffer *inSbwcAHB, AHardwareBuffer **outYuvAHB)
+{
+	AHardwareBuffer_Desc desc;
+	int64_t result;
+
+	getYuvDesc(inSbwcAHB, &desc);
+
+	// The most recently freed first, the least likely to be released soon
+	for (auto it = yuvPool.begin(); it != yuvPool.end(); ++it)
+	{
+		if (isSameDesc(it->desc, desc) && isReusable(*it))
+		{
+			*outYuvAHB = it->ahb;
+			yuvDesc[it->ahb] = desc;
+			yuvPoolSize -= it->size;
+			yuvPool.erase(it);
+			yuvPoolStats.hits++;
+
+			if (debugEnabled)
+			{
+				ALOGD("[SBWC] %s: Reuse YUV AHB: %p", __func__, *outYuvAHB);
+			}
+
+			return android::NO_ERROR;
+		}
+	}
+
+	result = AHardwareBuffer_allocate(&desc, outYuvAHB);
+
+	if (result == android::NO_ERROR)
+	{
+		yuvDesc[*outYuvAHB] = desc;
+		yuvPoolStats.allocations++;
+	}
+
+	return result;
+}
+
+static void poolAHB(AHardwareBuffer *inYuvAHB, ReleaseGate &&inGate)
+{
+	const native_handle_t *handle = AHardwareBuffer_getNativeHandle(inYuvAHB);
+	auto desc = yuvDesc.find(inYuvAHB);
+	auto now = std::chrono::steady_clock::now();
+	size_t size = 0;
+
+	for (int i = 0; i < ExynosGraphicBufferMeta::get_num_image_fds(handle); i++)
+	{
+		size += ExynosGraphicBufferMeta::get_size(handle, i);
+	}
+
+	if (desc == yuvDesc.end() || inGate.unfenced || size > poolBudget)
+	{
+		if (desc != yuvDesc.end())
+		{
+			yuvDesc.erase(desc);
+		}
+		for (int fenceFd : inGate.fenceFds)
+		{
+			close(fenceFd);
+		}
+		AHardwareBuffer_release(inYuvAHB);
+		return;
+	}
 
-	static android::sp<ISbwcDecompService> sbwcDecompService = nullptr;
+	yuvPool.push_front({inYuvAHB, desc->second, size, now, std::move(inGate)});
+	yuvPoolSize += size;
+	yuvDesc.erase(desc);
 
-	if ((lastSrc == yuvHandle) && (lastDst == sbwcHandle)) {
-		if (debugEnabled) {
-			ALOGD("[SBWC] Skip decompress because same request");
+	// The least recently freed go first
+	while (yuvPoolSize > poolBudget)
+	{
+		if (debugEnabled)
+		{
+			ALOGD("[SBWC] %s: Over budget, released YUV AHB: %p", __func__, yuvPool.back().ahb);
 		}
+
+		releasePooled(yuvPool.back());
+		yuvPoolSize -= yuvPool.back().size;
+		yuvPool.pop_back();
+	}
+
+	// The pool thread releases the buffer once it times out
+	helperThreads.startPool();
+	poolCondition.notify_one();
+}
+
+static std::chrono::steady_clock::time_point expirePool(std::chrono::steady_clock::time_point now)
+{
+	while (!yuvPool.empty() && (yuvPool.back().freedAt + poolTimeout <= now))
+	{
+		if (debugEnabled)
+		{
+			ALOGD("[SBWC] %s: Timed out, released YUV AHB: %p", __func__, yuvPool.back().ahb);
+		}
+
+		releasePooled(yuvPool.back());
+		yuvPoolSize -= yuvPool.back().size;
+		yuvPool.pop_back();
+	}
+
+	if (yuvPool.empty())
+	{
+		return std::chrono::steady_clock::time_point::max();
+	}
+
+	return yuvPool.back().freedAt + poolTimeout;
+}
+
+static bool acquireYuvAHB(AHardwareBuffer *inSbwcAHB, AHardwareBuffer **outYuvAHB)
+{
+	std::lock_guard<std::mutex> lock(helperMutex);
+	AHardwareBuffer *yuvAHB = nullptr;
+	int64_t result = android::NO_ERROR;
+
+	if (sbwcToYuv.count(inSbwcAHB) > 0)
+	{
+		yuvAHB = sbwcToYuv.at(inSbwcAHB);
+
+		*outYuvAHB = yuvAHB;
+
+		ref.at(yuvAHB) += 1;
+
+		if (debugEnabled)
+		{
+			ALOGD("[SBWC] %s: Increase ref counter AHB: %p ref: %" PRId32 "", __func__, yuvAHB, ref.at(yuvAHB));
+		}
+
+		AHardwareBuffer_acquire(inSbwcAHB);
+
 		return true;
 	}
 
+	result = allocAHB(inSbwcAHB, &yuvAHB);
+
+	if (result != android::NO_ERROR)
+	{
+		ALOGE("[SBWC] %s: \"YUV allocation failed\" %s:%d",
+				__func__, __FILE__, __LINE__);
+		return false;
+	}
+
+	yuvToSbwc.insert({yuvAHB, inSbwcAHB});
+	sbwcToYuv.insert({inSbwcAHB, yuvAHB});
+
+	ref[yuvAHB] = 1;
+
+	*outYuvAHB = yuvAHB;
+
+	if (debugEnabled)
+	{
+		const native_handle_t *handle = AHardwareBuffer_getNativeHandle(inSbwcAHB);
+		uint32_t format = ExynosGraphicBufferMeta::get_format(handle);
+
+		ALOGD("[SBWC] %s: inSbwcAHB: %p format: 0x%" PRIX32 "",
+				__func__, inSbwcAHB, format);
+
+		handle = AHardwareBuffer_getNativeHandle(yuvAHB);
+		format = ExynosGraphicBufferMeta::get_format(handle);
+
+		ALOGD("[SBWC] %s: outYuvAHB: %p format: 0x%" PRIX32 "",
+				__func__, yuvAHB, format);
+	}
+
+	AHardwareBuffer_acquire(inSbwcAHB);
+
+	return true;
+}
+
+static bool releaseYuvAHB(AHardwareBuffer *inYuvAHB, bool inFenced, int inFenceFd, bool *outLast)
+{
+	std::lock_guard<std::mutex> lock(helperMutex);
+	AHardwareBuffer *sbwcAHB;
+
+	*outLast = false;
+
+	if ((yuvToSbwc.count(inYuvAHB) == 0) || (ref.at(inYuvAHB) <= 0))
+	{
+		ALOGE("[SBWC] %s: Invalid value \"Not registered YUV AHB: %p\" %s:%d",
+				__func__, inYuvAHB, __FILE__, __LINE__);
+		if (inFenceFd >= 0)
+		{
+			close(inFenceFd);
+		}
+		return false;
+	}
+
+	// The GPU work of every user is waited for before the pool reuses it, or released if unknown
+	ReleaseGate &gate = yuvGates[inYuvAHB];
+
+	if (!inFenced)
+	{
+		gate.unfenced = true;
+	}
+	else if (inFenceFd >= 0)
+	{
+		gate.fenceFds.push_back(inFenceFd);
+	}
+
+	// Multiple referenced
+	if (ref.at(inYuvAHB) > 1)
+	{
+		ref.at(inYuvAHB) -= 1;
+
+		if (debugEnabled)
+		{
+			ALOGD("[SBWC] %s: Decrease ref counter AHB: %p ref: %" PRId32 "", __func__, inYuvAHB, ref.at(inYuvAHB));
+		}
+
+		sbwcAHB = yuvToSbwc.at(inYuvAHB);
+		AHardwareBuffer_release(sbwcAHB);
+
+		return true;
+	}
+
+	sbwcAHB = yuvToSbwc.at(inYuvAHB);
+
+	sbwcToYuv.erase(sbwcAHB);
+	yuvToSbwc.erase(inYuvAHB);
+	ref.erase(inYuvAHB);
+
+	if (debugEnabled)
+	{
+		ALOGD("[SBWC] %s: Deleted SBWC AHB: %p", __func__, sbwcAHB);
+
+		ALOGD("[SBWC] %s: Deleted YUV AHB: %p", __func__, inYuvAHB);
+	}
+
+	// The next SBWC buffer written to it is not the same request
+	if (lastSrc == AHardwareBuffer_getNativeHandle(inYuvAHB))
+	{
+		lastSrc = lastDst = 0;
+	}
+
+	ReleaseGate lastGate = std::move(gate);
+	yuvGates.erase(inYuvAHB);
+
+	poolAHB(inYuvAHB, std::move(lastGate));
+	AHardwareBuffer_release(sbwcAHB);
+
+	if ((sbwcToYuv.size() == 0) && (yuvToSbwc.size() == 0)) {
+		lastSrc = lastDst = 0;
+	}
+
+	*outLast = true;
+
+	return true;
+}
+
+static int createFence(int *outWorkerFd)
+{
+	int fenceFd = eventfd(0, EFD_CLOEXEC | EFD_SEMAPHORE);
+
+	if (fenceFd < 0)
+	{
+		ALOGE("[SBWC] %s: \"eventfd failed\" errno: %d %s:%d",
+				__func__, errno, __FILE__, __LINE__);
+		return -1;
+	}
+
+	// The worker thread has its own fd, the caller may close its one before the decompression is done
+	*outWorkerFd = fcntl(fenceFd, F_DUPFD_CLOEXEC, 0);
+
+	if (*outWorkerFd < 0)
+	{
+		ALOGE("[SBWC] %s: \"fence dup failed\" errno: %d %s:%d",
+				__func__, errno, __FILE__, __LINE__);
+		close(fenceFd);
+		return -1;
+	}
+
+	return fenceFd;
+}
+
+static bool startDecompress(AHardwareBuffer *inSbwcAHB, bool inAsync, DecompJob *outJob, int *outFenceFd)
+{
+	std::lock_guard<std::mutex> lock(helperMutex);
+
+	*outFenceFd = -1;
+
+	if (sbwcToYuv.count(inSbwcAHB) <= 0)
+	{
+		ALOGE("[SBWC] %s: Invalid value \"Not registered SBWC AHB\" AHB: %p %s:%d",
+				__func__, inSbwcAHB, __FILE__, __LINE__);
+		return false;
+	}
+
+	AHardwareBuffer *yuvAHB = sbwcToYuv.at(inSbwcAHB);
+	auto busy = busyYuv.find(yuvAHB);
+	DecompJob job = {yuvAHB, inSbwcAHB, -1, outJob->result};
+
+	if (inAsync || (busy != busyYuv.end()))
+	{
+		*outFenceFd = createFence(&job.fenceFd);
+
+		if (*outFenceFd < 0)
+		{
+			return false;
+		}
+	}
+
+	// Both buffers stay alive until the decompression is done, even if they are freed before
+	AHardwareBuffer_acquire(yuvAHB);
+	AHardwareBuffer_acquire(inSbwcAHB);
+
+	if (busy != busyYuv.end())
+	{
+		// Done by the thread decompressing to the same YUV buffer, after the current one
+		busy->second.push_back(job);
+	}
+	else if (inAsync)
+	{
+		busyYuv[yuvAHB];
+		helperThreads.post(job);
+	}
+	else
+	{
+		busyYuv[yuvAHB];
+		*outJob = job;
+	}
+
+	return true;
+}
+
+static bool doDecompress(const DecompJob &inJob, DecompJob *outNext)
+{
+	bool done = requestDecompress(inJob.yuvAHB, inJob.sbwcAHB);
+
+	// Not busy anymore once the fence signals, the pool can give it again
+	{
+		std::lock_guard<std::mutex> lock(helperMutex);
+		auto &queued = busyYuv.at(inJob.yuvAHB);
+
+		if (inJob.result != nullptr)
+		{
+			*inJob.result = done;
+		}
+
+		if (queued.empty())
+		{
+			*outNext = {nullptr, nullptr, -1, nullptr};
+			busyYuv.erase(inJob.yuvAHB);
+		}
+		else
+		{
+			*outNext = queued.front();
+			queued.pop_front();
+		}
+	}
+
+	if (inJob.fenceFd >= 0)
+	{
+		uint64_t count = FENCE_SIGNALED;
+
+		if (write(inJob.fenceFd, &count, sizeof(count)) != sizeof(count))
+		{
+			ALOGE("[SBWC] %s: \"fence signal failed\" errno: %d %s:%d",
+					__func__, errno, __FILE__, __LINE__);
+		}
+		close(inJob.fenceFd);
+	}
+
+	AHardwareBuffer_release(inJob.yuvAHB);
+	AHardwareBuffer_release(inJob.sbwcAHB);
+
+	return done;
+}
+
+static void decompressLoop(DecompJob inJob)
+{
+	DecompJob job = inJob;
+
+	while (job.yuvAHB != nullptr)
+	{
+		DecompJob next = {nullptr, nullptr, -1, nullptr};
+
+		doDecompress(job, &next);
+		job = next;
+	}
+}
+
+static void poolLoop(const bool &stopping)
+{
+	std::unique_lock<std::mutex> lock(helperMutex);
+
+	while (!stopping)
+	{
+		auto next = expirePool(std::chrono::steady_clock::now());
+
+		if (next == std::chrono::steady_clock::time_point::max())
+		{
+			poolCondition.wait(lock);
+		}
+		else
+		{
+			poolCondition.wait_until(lock, next);
+		}
+	}
+}
+
+HelperThreads::~HelperThreads()
+{
+	{
+		std::lock_guard<std::mutex> lock(helperMutex);
+		mStopping = true;
+	}
+	workerCondition.notify_all();
+	poolCondition.notify_all();
+
+	// The queued decompressions are done first, their fences are waited for
+	for (auto &worker : mWorkers)
+	{
+		worker.join();
+	}
+	if (mPoolThread.joinable())
+	{
+		mPoolThread.join();
+	}
+}
+
+void HelperThreads::post(const DecompJob &inJob)
+{
+	mJobs.push_back(inJob);
+
+	if ((mIdle < mJobs.size()) && (mWorkers.size() < MAX_WORKERS))
+	{
+		mWorkers.emplace_back(&HelperThreads::workerLoop, this);
+	}
+	else
+	{
+		workerCondition.notify_one();
+	}
+}
+
+void HelperThreads::startPool()
+{
+	if (!mPoolThread.joinable())
+	{
+		mPoolThread = std::thread(poolLoop, std::cref(mStopping));
+	}
+}
+
+void HelperThreads::workerLoop()
+{
+	std::unique_lock<std::mutex> lock(helperMutex);
+
+	while (true)
+	{
+		if (mJobs.empty())
+		{
+			if (mStopping)
+			{
+				return;
+			}
+
+			mIdle++;
+			workerCondition.wait(lock);
+			mIdle--;
+			continue;
+		}
+
+		DecompJob job = mJobs.front();
+		mJobs.pop_front();
+
+		lock.unlock();
+		decompressLoop(job);
+		lock.lock();
+	}
+}
+
+static uint32_t getAttr(const native_handle_t *handle)
+{
+	uint32_t attr = 0;
+	uint64_t usage = ExynosGraphicBufferMeta::get_usage(handle);
+
+	// To do: Use function from libexynosgraphicbuffer_core instead magic number
+	if (usage & (1ULL << 14))
+	{
+		attr |= SBWCDECODER_ATTR_SECURE_BUFFER;
+	}
+
+	return attr;
+}
+
+static bool requestDecompress(AHardwareBuffer *inYuvAHB, AHardwareBuffer *inSbwcAHB)
+{
+	const native_handle_t *yuvHandle = AHardwareBuffer_getNativeHandle(inYuvAHB);
+	const native_handle_t *sbwcHandle = AHardwareBuffer_getNativeHandle(inSbwcAHB);
+
+	android::hardware::hidl_handle yuvHidlHandle(yuvHandle);
+	android::hardware::hidl_handle sbwcHidlHandle(sbwcHandle);
+
+	android::sp<ISbwcDecompService> sbwcDecompService;
+
+	{
+		std::lock_guard<std::mutex> lock(helperMutex);
+
+		if ((lastSrc == yuvHandle) && (lastDst == sbwcHandle)) {
+			if (debugEnabled) {
+				ALOGD("[SBWC] Skip decompress because same request");
+			}
+			return true;
+		}
+
+		sbwcDecompService = decompService;
+	}
+
 	if (sbwcDecompService == nullptr)
 	{
 		sbwcDecompService = ISbwcDecompService::getService();
@@ -617,6 +1286,12 @@ static bool requestDecompress(AHardwareBuffer *inYuvAHB, AHardwareBuffer *inSbwc
 					__func__, __FILE__, __LINE__);
 			return false;
 		}
+
+		std::lock_guard<std::mutex> lock(helperMutex);
+		if (decompService == nullptr)
+		{
+			decompService = sbwcDecompService;
+		}
 	}
 
 	uint32_t attr = getAttr(yuvHandle);
@@ -626,12 +1301,21 @@ static bool requestDecompress(AHardwareBuffer *inYuvAHB, AHardwareBuffer *inSbwc
 	{
 		ALOGE("[SBWC] %s: \"SbwcDecompService decompression failed\" %s:%d",
 					__func__, __FILE__, __LINE__);
+		std::lock_guard<std::mutex> lock(helperMutex);
 		lastSrc = lastDst = 0;
 		return false;
 	}
 
-	lastSrc = yuvHandle;
-	lastDst = sbwcHandle;
+	{
+		std::lock_guard<std::mutex> lock(helperMutex);
+
+		// Unless the YUV buffer was given to another SBWC buffer meanwhile
+		if ((yuvToSbwc.count(inYuvAHB) > 0) && (yuvToSbwc.at(inYuvAHB) == inSbwcAHB))
+		{
+			lastSrc = yuvHandle;
+			lastDst = sbwcHandle;
+		}
+	}
 
 	if (debugEnabled)
 	{
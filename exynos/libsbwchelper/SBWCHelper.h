@@ -40,19 +40,55 @@ bool ContainsSbwcData(AHardwareBuffer *inAHB);
 bool newYuvAHB(AHardwareBuffer *inSbwcAHB, AHardwareBuffer **outYuvAHB);
 
 /** Request decompress to SBWCHelper
+ *
+ * The decompression is done on the calling thread, unless decompressions of the same
+ * buffer requested with decompressAsync() are still to be done: it waits for them then.
+ * The decompressions of different buffers are not serialized.
  *
  * @param[in] inSbwcAHB The buffer to decompress
  * @return result
  */
 bool decompress(AHardwareBuffer *inSbwcAHB);
 
+/** Request decompress to SBWCHelper without waiting for it
+ *
+ * The YUV buffer of inSbwcAHB is written after the decompressions of the same buffer
+ * requested before, the decompressions of other buffers run at the same time.
+ * outFenceFd becomes readable, for poll() or sync_wait(), once it is done, and stays so
+ * however many times it is waited for or read. A failed decompression is logged, the
+ * YUV buffer is left as it was. The caller owns outFenceFd and has to close it.
+ *
+ * @param[in] inSbwcAHB The buffer to decompress
+ * @param[out] outFenceFd fd signaled when the decompression is done
+ * @return whether the decompression is requested
+ */
+bool decompressAsync(AHardwareBuffer *inSbwcAHB, int *outFenceFd);
+
 /** Inform SBWCHelper that you are no longer using YUV AHB to avoid memory leak
+ *
+ * As the GPU may still read it, it is released once no one uses it: use the overload
+ * taking the release fence to have it reused for the next SBWC buffer instead.
  *
  * @param[in] Double pointer of the buffer want to free
  * @return result
  */
 bool freeYuvAHB(AHardwareBuffer **inYuvAHB);
 
+/** Inform SBWCHelper that you are no longer using YUV AHB, once releaseFenceFd signals
+ *
+ * The buffer is kept for a while to be given to the next SBWC buffer of the same size
+ * and format, up to vendor.sbwchelper.pool.size_kb for vendor.sbwchelper.pool.timeout_ms.
+ * It is not given again before the release fences of all its users signal, typically
+ * the fence of the last GPU work sampling its EGLImage. If one of them freed it with
+ * the overload without a fence, it is released instead.
+ * SBWCHelper owns releaseFenceFd and closes it, even on failure.
+ *
+ * @param[in] Double pointer of the buffer want to free
+ * @param[in] releaseFenceFd fence signaled when the caller's GPU work is done, -1 if it is
+ * @return result
+ */
+bool freeYuvAHB(AHardwareBuffer **inYuvAHB, int releaseFenceFd);
+
 /** Derive byte stride of a SBWC buffer
  *
  * @param[in] format SBWC buffer format to use in stride calculation
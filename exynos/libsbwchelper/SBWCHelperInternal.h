@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2021 Samsung Electronics Co. Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SBWC_HELPER_INTERNAL_H_
+#define SBWC_HELPER_INTERNAL_H_
+
+#include <utils/StrongPointer.h>
+#include <vendor/samsung_slsi/hardware/SbwcDecompService/1.0/ISbwcDecompService.h>
+
+namespace SBWCHelper
+{
+
+/* What the pool of YUV buffers saved */
+struct PoolStats
+{
+	size_t hits;		// YUV buffers given again from the pool
+	size_t allocations;	// YUV buffers allocated
+};
+
+/** Replace SbwcDecompService, for tests
+ *
+ * @param[in] service The service to use, nullptr to get SbwcDecompService again
+ */
+void setDecompService(const android::sp<vendor::samsung_slsi::hardware::SbwcDecompService::V1_0::ISbwcDecompService> &service);
+
+/** Release the YUV buffers kept for reuse, for tests
+ *
+ * @return number of YUV buffers released
+ */
+size_t trimYuvPool();
+
+/** Get the counters of the pool of YUV buffers, for tests
+ *
+ * @return counters since the process started
+ */
+PoolStats getYuvPoolStats();
+
+} // namespace SBWCHelper
+
+#endif // SBWC_HELPER_INTERNAL_H_
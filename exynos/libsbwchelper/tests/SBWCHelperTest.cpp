@@ -14,7 +14,15 @@
  * limitations under the License.
  */
 
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 #include <log/log.h>
 #include <gtest/gtest.h>
@@ -23,11 +31,15 @@
 
 #include "exynos_format.h"
 #include "../SBWCHelper.h"
+#include "../SBWCHelperInternal.h"
 #include "SBWCHelperTestHelper.h"
 #include "ExynosGraphicBufferCore.h"
 
 using namespace android;
 using namespace vendor::graphics;
+using namespace vendor::samsung_slsi::hardware::SbwcDecompService::V1_0;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::Return;
 
 TEST(SBWCHelperTest, YUVFormatCheck)
 {
@@ -387,6 +399,448 @@ TEST(SBWCHelperTest, FreeYuvAHBMoreThanAlloc)
 	EXPECT_FALSE(SBWCHelper::freeYuvAHB(&yuvAHB));
 }
 
+//---------------------------------------------------------------------------------------
+// With a fake SbwcDecompService
+//---------------------------------------------------------------------------------------
+
+/** SbwcDecompService taking the time of a decompression by the hardware */
+class FakeSbwcDecompService : public ISbwcDecompService
+{
+public:
+	explicit FakeSbwcDecompService(std::chrono::microseconds cost)
+		: mCost(cost), mDecodes(0), mInFlight(0), mMaxInFlight(0), mWaitFor(0) {}
+
+	Return<int32_t> decode(const hidl_handle &srcHandle, const hidl_handle &dstHandle, uint32_t attr) override
+	{
+		return decodeWithCropAndFps(srcHandle, dstHandle, attr, 0, 0, 0);
+	}
+
+	Return<int32_t> decodeWithFramerate(const hidl_handle &srcHandle, const hidl_handle &dstHandle,
+			uint32_t attr, uint32_t framerate) override
+	{
+		return decodeWithCropAndFps(srcHandle, dstHandle, attr, 0, 0, framerate);
+	}
+
+	Return<int32_t> decodeWithCrop(const hidl_handle &srcHandle, const hidl_handle &dstHandle,
+			uint32_t attr, uint32_t cropWidth, uint32_t cropHeight) override
+	{
+		return decodeWithCropAndFps(srcHandle, dstHandle, attr, cropWidth, cropHeight, 0);
+	}
+
+	Return<int32_t> decodeWithCropAndFps(const hidl_handle &, const hidl_handle &,
+			uint32_t, uint32_t, uint32_t, uint32_t) override
+	{
+		int inFlight = ++mInFlight;
+		int maxInFlight = mMaxInFlight;
+
+		while ((inFlight > maxInFlight) && !mMaxInFlight.compare_exchange_weak(maxInFlight, inFlight));
+
+		auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		while ((mInFlight < mWaitFor) && (std::chrono::steady_clock::now() < timeout))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		std::this_thread::sleep_for(mCost);
+		mInFlight--;
+		mDecodes++;
+		return NO_ERROR;
+	}
+
+	int decodes() const { return mDecodes; }
+	// the most decode() calls at the same time
+	int maxInFlight() const { return mMaxInFlight; }
+	// make decode() wait, up to a second, for count calls at the same time
+	void waitForInFlight(int count) { mWaitFor = count; }
+
+private:
+	std::chrono::microseconds mCost;
+	std::atomic<int> mDecodes;
+	std::atomic<int> mInFlight;
+	std::atomic<int> mMaxInFlight;
+	std::atomic<int> mWaitFor;
+};
+
+class SBWCHelperFakeServiceTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		printTestName();
+
+		mService = new FakeSbwcDecompService(std::chrono::microseconds(3000));
+		SBWCHelper::setDecompService(mService);
+		SBWCHelper::trimYuvPool();
+		mStats = SBWCHelper::getYuvPoolStats();
+	}
+
+	void TearDown() override
+	{
+		SBWCHelper::trimYuvPool();
+		SBWCHelper::setDecompService(nullptr);
+	}
+
+	/** Pool counters since the test started */
+	SBWCHelper::PoolStats poolStats()
+	{
+		SBWCHelper::PoolStats stats = SBWCHelper::getYuvPoolStats();
+
+		return { stats.hits - mStats.hits, stats.allocations - mStats.allocations };
+	}
+
+	sp<FakeSbwcDecompService> mService;
+	SBWCHelper::PoolStats mStats;
+};
+
+/** Wait for a fence of SBWCHelper::decompressAsync() and close it
+ *
+ * @param[in] fenceFd fence to wait for
+ * @return whether it signaled and stays signaled once read
+ */
+static bool waitFence(int fenceFd)
+{
+	struct pollfd pfd = { .fd = fenceFd, .events = POLLIN, .revents = 0 };
+	uint64_t count = 0;
+	bool signaled = (poll(&pfd, 1, 1000) == 1)
+		&& (read(fenceFd, &count, sizeof(count)) == sizeof(count))
+		&& (poll(&pfd, 1, 0) == 1);
+
+	close(fenceFd);
+
+	return signaled;
+}
+
+TEST_F(SBWCHelperFakeServiceTest, PoolReusesYuvAHB)
+{
+	sp<GraphicBuffer> firstGB = newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC);
+	sp<GraphicBuffer> secondGB = newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC);
+
+	AHardwareBuffer *yuvAHB = nullptr;
+	EXPECT_TRUE(SBWCHelper::newYuvAHB(firstGB->toAHardwareBuffer(), &yuvAHB));
+
+	AHardwareBuffer *firstYuvAHB = yuvAHB;
+	EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB, -1));
+
+	// The same size and format, the freed YUV buffer is given again
+	EXPECT_TRUE(SBWCHelper::newYuvAHB(secondGB->toAHardwareBuffer(), &yuvAHB));
+	EXPECT_EQ(yuvAHB, firstYuvAHB);
+	EXPECT_EQ(poolStats().hits, 1u);
+	EXPECT_EQ(poolStats().allocations, 1u);
+
+	// It was decompressed from the first buffer, it is not skipped as the same request
+	EXPECT_TRUE(SBWCHelper::decompress(secondGB->toAHardwareBuffer()));
+	EXPECT_EQ(mService->decodes(), 1);
+
+	EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB, -1));
+	EXPECT_EQ(SBWCHelper::trimYuvPool(), 1u);
+}
+
+TEST_F(SBWCHelperFakeServiceTest, PoolWaitsForReleaseFence)
+{
+	sp<GraphicBuffer> firstGB = newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC);
+	sp<GraphicBuffer> secondGB = newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC);
+	sp<GraphicBuffer> thirdGB = newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC);
+
+	// Signaled once written, as the release fence of the GPU
+	int releaseFenceFd = eventfd(0, EFD_CLOEXEC);
+	int signalFd = dup(releaseFenceFd);
+	ASSERT_GE(signalFd, 0);
+
+	AHardwareBuffer *yuvAHB = nullptr;
+	EXPECT_TRUE(SBWCHelper::newYuvAHB(firstGB->toAHardwareBuffer(), &yuvAHB));
+
+	AHardwareBuffer *firstYuvAHB = yuvAHB;
+	EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB, releaseFenceFd));
+
+	// The GPU may still read it
+	AHardwareBuffer *secondYuvAHB = nullptr;
+	EXPECT_TRUE(SBWCHelper::newYuvAHB(secondGB->toAHardwareBuffer(), &secondYuvAHB));
+	EXPECT_NE(secondYuvAHB, firstYuvAHB);
+	EXPECT_EQ(poolStats().hits, 0u);
+
+	uint64_t one = 1;
+	EXPECT_EQ(write(signalFd, &one, sizeof(one)), (ssize_t)sizeof(one));
+	close(signalFd);
+
+	EXPECT_TRUE(SBWCHelper::newYuvAHB(thirdGB->toAHardwareBuffer(), &yuvAHB));
+	EXPECT_EQ(yuvAHB, firstYuvAHB);
+	EXPECT_EQ(poolStats().hits, 1u);
+	EXPECT_EQ(poolStats().allocations, 2u);
+
+	EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB, -1));
+	EXPECT_TRUE(SBWCHelper::freeYuvAHB(&secondYuvAHB, -1));
+}
+
+TEST_F(SBWCHelperFakeServiceTest, PoolReleasesFreedWithoutFence)
+{
+	sp<GraphicBuffer> firstGB = newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC);
+	sp<GraphicBuffer> secondGB = newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC);
+
+	AHardwareBuffer *yuvAHB = nullptr;
+	EXPECT_TRUE(SBWCHelper::newYuvAHB(firstGB->toAHardwareBuffer(), &yuvAHB));
+	EXPECT_TRUE(SBWCHelper::newYuvAHB(firstGB->toAHardwareBuffer(), &yuvAHB));
+
+	// One user says when the GPU is done, the other does not: never reused
+	EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB, -1));
+	EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB));
+	EXPECT_TRUE(yuvAHB == nullptr);
+
+	EXPECT_TRUE(SBWCHelper::newYuvAHB(secondGB->toAHardwareBuffer(), &yuvAHB));
+	EXPECT_EQ(poolStats().hits, 0u);
+	EXPECT_EQ(poolStats().allocations, 2u);
+
+	EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB));
+	EXPECT_EQ(SBWCHelper::trimYuvPool(), 0u);
+}
+
+TEST_F(SBWCHelperFakeServiceTest, PoolKeepsFormatsApart)
+{
+	sp<GraphicBuffer> sbwcGB = newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC);
+	sp<GraphicBuffer> sbwc10BitGB = newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_10B_SBWC);
+
+	AHardwareBuffer *yuvAHB = nullptr;
+	EXPECT_TRUE(SBWCHelper::newYuvAHB(sbwcGB->toAHardwareBuffer(), &yuvAHB));
+
+	AHardwareBuffer *freedYuvAHB = yuvAHB;
+	EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB, -1));
+
+	EXPECT_TRUE(SBWCHelper::newYuvAHB(sbwc10BitGB->toAHardwareBuffer(), &yuvAHB));
+	EXPECT_NE(yuvAHB, freedYuvAHB);
+
+	const native_handle_t *handle = AHardwareBuffer_getNativeHandle(yuvAHB);
+	EXPECT_TRUE(ExynosGraphicBufferMeta::get_format(handle) == HAL_PIXEL_FORMAT_EXYNOS_YCbCr_P010_M);
+
+	EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB));
+}
+
+TEST_F(SBWCHelperFakeServiceTest, DecompressAsync)
+{
+	sp<GraphicBuffer> sbwcGB = newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC);
+	AHardwareBuffer *sbwcAHB = sbwcGB->toAHardwareBuffer();
+	int fenceFd = -1;
+
+	EXPECT_FALSE(SBWCHelper::decompressAsync(nullptr, &fenceFd));
+	EXPECT_FALSE(SBWCHelper::decompressAsync(sbwcAHB, nullptr));
+	EXPECT_FALSE(SBWCHelper::decompressAsync(sbwcAHB, &fenceFd));
+
+	AHardwareBuffer *yuvAHB = nullptr;
+	EXPECT_TRUE(SBWCHelper::newYuvAHB(sbwcAHB, &yuvAHB));
+
+	ASSERT_TRUE(SBWCHelper::decompressAsync(sbwcAHB, &fenceFd));
+	EXPECT_TRUE(waitFence(fenceFd));
+	EXPECT_EQ(mService->decodes(), 1);
+
+	// Freed before the decompression is done
+	ASSERT_TRUE(SBWCHelper::decompressAsync(sbwcAHB, &fenceFd));
+	EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB));
+	EXPECT_TRUE(waitFence(fenceFd));
+}
+
+TEST_F(SBWCHelperFakeServiceTest, DecompressesBuffersInParallel)
+{
+	std::vector<sp<GraphicBuffer>> sbwcGBs;
+	std::vector<AHardwareBuffer*> yuvAHBs(4, nullptr);
+	std::vector<int> fenceFds(3, -1);
+
+	for (size_t i = 0; i < yuvAHBs.size(); i++)
+	{
+		sbwcGBs.push_back(newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC));
+		EXPECT_TRUE(SBWCHelper::newYuvAHB(sbwcGBs[i]->toAHardwareBuffer(), &yuvAHBs[i]));
+	}
+
+	// A sync decompression does not wait for the async ones of other buffers
+	mService->waitForInFlight((int)yuvAHBs.size());
+	for (size_t i = 0; i < fenceFds.size(); i++)
+	{
+		ASSERT_TRUE(SBWCHelper::decompressAsync(sbwcGBs[i]->toAHardwareBuffer(), &fenceFds[i]));
+	}
+	EXPECT_TRUE(SBWCHelper::decompress(sbwcGBs[3]->toAHardwareBuffer()));
+
+	for (int fenceFd : fenceFds)
+	{
+		EXPECT_TRUE(waitFence(fenceFd));
+	}
+
+	EXPECT_EQ(mService->decodes(), 4);
+	EXPECT_EQ(mService->maxInFlight(), 4);
+
+	for (auto &yuvAHB : yuvAHBs)
+	{
+		EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB, -1));
+	}
+}
+
+TEST_F(SBWCHelperFakeServiceTest, DecompressesBufferInOrder)
+{
+	sp<GraphicBuffer> sbwcGB = newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC);
+	AHardwareBuffer *sbwcAHB = sbwcGB->toAHardwareBuffer();
+	AHardwareBuffer *yuvAHB = nullptr;
+	int firstFenceFd = -1;
+	int secondFenceFd = -1;
+
+	EXPECT_TRUE(SBWCHelper::newYuvAHB(sbwcAHB, &yuvAHB));
+
+	ASSERT_TRUE(SBWCHelper::decompressAsync(sbwcAHB, &firstFenceFd));
+	ASSERT_TRUE(SBWCHelper::decompressAsync(sbwcAHB, &secondFenceFd));
+
+	// Returns after the async decompressions of the same buffer
+	EXPECT_TRUE(SBWCHelper::decompress(sbwcAHB));
+
+	struct pollfd pfds[2] = {
+		{ .fd = firstFenceFd, .events = POLLIN, .revents = 0 },
+		{ .fd = secondFenceFd, .events = POLLIN, .revents = 0 },
+	};
+	EXPECT_EQ(poll(pfds, 2, 0), 2);
+	EXPECT_TRUE(waitFence(firstFenceFd));
+	EXPECT_TRUE(waitFence(secondFenceFd));
+
+	EXPECT_EQ(mService->maxInFlight(), 1);
+
+	EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB, -1));
+}
+
+TEST_F(SBWCHelperFakeServiceTest, DecompressesOnBoundedWorkers)
+{
+	std::vector<sp<GraphicBuffer>> sbwcGBs;
+	std::vector<AHardwareBuffer*> yuvAHBs(16, nullptr);
+	std::vector<int> fenceFds(yuvAHBs.size(), -1);
+
+	for (size_t i = 0; i < yuvAHBs.size(); i++)
+	{
+		sbwcGBs.push_back(newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC));
+		EXPECT_TRUE(SBWCHelper::newYuvAHB(sbwcGBs[i]->toAHardwareBuffer(), &yuvAHBs[i]));
+		ASSERT_TRUE(SBWCHelper::decompressAsync(sbwcGBs[i]->toAHardwareBuffer(), &fenceFds[i]));
+	}
+
+	// Every buffer is decompressed, by 4 worker threads at most
+	for (int fenceFd : fenceFds)
+	{
+		EXPECT_TRUE(waitFence(fenceFd));
+	}
+
+	EXPECT_EQ(mService->decodes(), (int)yuvAHBs.size());
+	EXPECT_LE(mService->maxInFlight(), 4);
+
+	for (auto &yuvAHB : yuvAHBs)
+	{
+		EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB, -1));
+	}
+}
+
+TEST_F(SBWCHelperFakeServiceTest, NewYuvAHBAndFreeYuvAHBFromThreads)
+{
+	std::vector<std::thread> threads;
+
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([]
+		{
+			sp<GraphicBuffer> sbwcGB = newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC);
+			AHardwareBuffer *sbwcAHB = sbwcGB->toAHardwareBuffer();
+
+			for (int i = 0; i < 20; i++)
+			{
+				AHardwareBuffer *yuvAHB = nullptr;
+				EXPECT_TRUE(SBWCHelper::newYuvAHB(sbwcAHB, &yuvAHB));
+				EXPECT_TRUE(SBWCHelper::decompress(sbwcAHB));
+				EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB, -1));
+			}
+		});
+	}
+
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	// No more YUV buffers than the threads using one at the same time
+	EXPECT_LE(SBWCHelper::trimYuvPool(), 4u);
+}
+
+/*
+ * An app scrolling through SBWC camera images: for every image, a YUV buffer,
+ * its decompression, then the work of the app before it uses the YUV buffer.
+ * The timings depend on the load of the device, they are printed only.
+ */
+static const int SCROLL_IMAGES = 30;
+static const std::chrono::microseconds APP_WORK(3000);
+
+enum ScrollMode
+{
+	SCROLL_SYNC_NO_POOL,	// The helper before the pool and decompressAsync()
+	SCROLL_SYNC,
+	SCROLL_ASYNC,
+};
+
+static double scroll(const std::vector<sp<GraphicBuffer>> &images, ScrollMode mode)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	for (auto &image : images)
+	{
+		AHardwareBuffer *sbwcAHB = image->toAHardwareBuffer();
+		AHardwareBuffer *yuvAHB = nullptr;
+		int fenceFd = -1;
+
+		EXPECT_TRUE(SBWCHelper::newYuvAHB(sbwcAHB, &yuvAHB));
+
+		if (mode == SCROLL_ASYNC)
+		{
+			EXPECT_TRUE(SBWCHelper::decompressAsync(sbwcAHB, &fenceFd));
+			std::this_thread::sleep_for(APP_WORK);
+			EXPECT_TRUE(waitFence(fenceFd));
+		}
+		else
+		{
+			EXPECT_TRUE(SBWCHelper::decompress(sbwcAHB));
+			std::this_thread::sleep_for(APP_WORK);
+		}
+
+		// The app is done with it, as its GPU work
+		EXPECT_TRUE(SBWCHelper::freeYuvAHB(&yuvAHB, -1));
+
+		if (mode == SCROLL_SYNC_NO_POOL)
+		{
+			SBWCHelper::trimYuvPool();
+		}
+	}
+
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+TEST_F(SBWCHelperFakeServiceTest, ScrollBenchmark)
+{
+	std::vector<sp<GraphicBuffer>> images;
+
+	for (int i = 0; i < SCROLL_IMAGES; i++)
+	{
+		images.push_back(newFHDGB(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC));
+	}
+
+	double noPool = scroll(images, SCROLL_SYNC_NO_POOL);
+	SBWCHelper::PoolStats noPoolStats = poolStats();
+	double sync = scroll(images, SCROLL_SYNC);
+	SBWCHelper::PoolStats syncStats = poolStats();
+	double async = scroll(images, SCROLL_ASYNC);
+	SBWCHelper::PoolStats asyncStats = poolStats();
+
+	std::cout << "[SBWC] " << SCROLL_IMAGES << " images, decompress and app work "
+		<< APP_WORK.count() << " us each" << std::endl;
+	std::cout << "[SBWC] allocation per image, decompress(): " << noPool / SCROLL_IMAGES << " ms per image" << std::endl;
+	std::cout << "[SBWC] pooled, decompress():               " << sync / SCROLL_IMAGES << " ms per image" << std::endl;
+	std::cout << "[SBWC] pooled, decompressAsync():          " << async / SCROLL_IMAGES << " ms per image" << std::endl;
+
+	EXPECT_EQ(mService->decodes(), SCROLL_IMAGES * 3);
+
+	// An allocation per image without the pool, a single one with it
+	EXPECT_EQ(noPoolStats.allocations, (size_t)SCROLL_IMAGES);
+	EXPECT_EQ(noPoolStats.hits, 0u);
+	EXPECT_EQ(syncStats.allocations - noPoolStats.allocations, 1u);
+	EXPECT_EQ(syncStats.hits - noPoolStats.hits, (size_t)SCROLL_IMAGES - 1);
+	EXPECT_EQ(asyncStats.allocations - syncStats.allocations, 0u);
+	EXPECT_EQ(asyncStats.hits - syncStats.hits, (size_t)SCROLL_IMAGES);
+}
+
 int main(int argc, char* argv[])
 {
 	::testing::InitGoogleTest(&argc, argv);
@@ -15,6 +15,8 @@
  * limitations under the License.
  */
 
+#include <mutex>
+
 #include <log/log.h>
 
 #include <ExynosGraphicBuffer.h>
@@ -118,6 +120,12 @@ SbwcWrapper::~SbwcWrapper()
     ATRACE_CALL();
 }
 
+/*
+ * Every DpuSbwcDecoder opens the same frame buffer, decodes on the same reserved
+ * window and powers it down when it is done, so one of them decodes at a time.
+ */
+static std::mutex sDpuMutex;
+
 static bool decodeDPU(void *decoderHandle, buffer_handle_t srcBH, buffer_handle_t dstBH, unsigned int attr,
                       unsigned int cropWidth, unsigned int cropHeight)
 {
@@ -153,6 +161,8 @@ static bool decodeDPU(void *decoderHandle, buffer_handle_t srcBH, buffer_handle_
         dstLen[i] = ExynosGraphicBufferMeta::get_size(dstBH, i);
     }
 
+    std::lock_guard<std::mutex> lock(sDpuMutex);
+
     if (!SbwcDecoderDPU->decodeSBWC(srcFmt, dstFmt, dataspace,
         cropWidth, cropHeight,
 	ExynosGraphicBufferMeta::get_width(dstBH), ExynosGraphicBufferMeta::get_height(dstBH),
@@ -247,7 +247,7 @@ Return<Status> UsbGadget::reset() {
         return Status::ERROR;
     }
 
-    usleep(kDisconnectWaitUs);
+    waitForUdcState(kGadgetName, "not attached", kDisconnectWaitUs / 1000);
 
     if (!WriteStringToFile(kGadgetName, PULLUP_PATH)) {
         ALOGI("Gadget cannot be pulled up");
@@ -317,6 +317,10 @@ V1_0::Status UsbGadget::setupFunctions(uint64_t functions,
             return Status::ERROR;
     }
 
+    // Drop the links left over from the previous configuration.
+    if (unlinkFunctionsFrom(CONFIG_PATH, i))
+        return Status::ERROR;
+
     // Pull up the gadget right away when there are no ffs functions.
     if (!ffsEnabled) {
         if (!WriteStringToFile(kGadgetName, PULLUP_PATH))
@@ -355,7 +359,8 @@ Return<void> UsbGadget::setCurrentUsbFunctions(uint64_t functions,
     mCurrentUsbFunctions = functions;
     mCurrentUsbFunctionsApplied = false;
 
-    // Unlink the gadget and stop the monitor if running.
+    // Pull down the gadget and stop the monitor if running. The function
+    // links are updated in place by setupFunctions.
     V1_0::Status status = tearDownGadget();
     if (status != Status::SUCCESS) {
         goto error;
@@ -364,9 +369,13 @@ Return<void> UsbGadget::setCurrentUsbFunctions(uint64_t functions,
     ALOGI("Returned from tearDown gadget");
 
     // Leave the gadget pulled down to give time for the host to sense disconnect.
-    usleep(kDisconnectWaitUs);
+    waitForUdcState(kGadgetName, "not attached", kDisconnectWaitUs / 1000);
 
     if (functions == static_cast<uint64_t>(GadgetFunction::NONE)) {
+        if (unlinkFunctions(CONFIG_PATH)) {
+            status = Status::ERROR;
+            goto error;
+        }
         if (callback == NULL)
             return Void();
         Return<void> ret = callback->setCurrentUsbFunctionsCb(functions, Status::SUCCESS);
@@ -66,6 +66,8 @@ using ::android::hardware::usb::gadget::MonitorFfs;
 using ::android::hardware::usb::gadget::resetGadget;
 using ::android::hardware::usb::gadget::setVidPid;
 using ::android::hardware::usb::gadget::unlinkFunctions;
+using ::android::hardware::usb::gadget::unlinkFunctionsFrom;
+using ::android::hardware::usb::gadget::waitForUdcState;
 using ::android::hardware::usb::gadget::V1_0::Status;
 using ::android::hardware::usb::gadget::V1_0::IUsbGadgetCallback;
 using ::android::hardware::usb::gadget::V1_2::IUsbGadget;
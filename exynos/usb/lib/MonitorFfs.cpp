@@ -91,39 +91,76 @@ static void displayInotifyEvent(struct inotify_event* i) {
     if (i->len > 0) ALOGE("        name = %s\n", i->name);
 }
 
+bool MonitorFfs::endpointsPresent() {
+    for (int i = 0; i < static_cast<int>(mEndpointList.size()); i++) {
+        if (access(mEndpointList.at(i).c_str(), R_OK)) {
+            if (kDebug) ALOGI("%s absent", mEndpointList.at(i).c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MonitorFfs::pullUpGadget() {
+    if (!WriteStringToFile(mGadgetName, PULLUP_PATH)) return false;
+
+    lock_guard<mutex> lock(mLock);
+    mCurrentUsbFunctionsApplied = true;
+    if (mCallback) mCallback(mCurrentUsbFunctionsApplied, mPayload);
+    gadgetPullup = true;
+    ALOGI("GADGET pulled up");
+    // notify the main thread to signal userspace.
+    mCv.notify_all();
+    return true;
+}
+
 void* MonitorFfs::startMonitorFd(void* param) {
     MonitorFfs* monitorFfs = (MonitorFfs*)param;
     char buf[kBufferSize];
     bool writeUdc = true, stopMonitor = false;
     struct epoll_event events[kEpollEvents];
     steady_clock::time_point disconnect;
-
-    bool descriptorWritten = true;
-    for (int i = 0; i < static_cast<int>(monitorFfs->mEndpointList.size()); i++) {
-        if (access(monitorFfs->mEndpointList.at(i).c_str(), R_OK)) {
-            descriptorWritten = false;
-            break;
-        }
+    // A pull up is attempted at pullUpAt and retried every kPullUpRetryMs
+    // until pullUpDeadline while the UDC refuses to bind the functions.
+    bool pullUpPending = false;
+    steady_clock::time_point pullUpAt, pullUpDeadline;
+
+    // pull up right away if the endpoints are already present.
+    if (monitorFfs->endpointsPresent()) {
+        pullUpPending = true;
+        pullUpAt = steady_clock::now();
+        pullUpDeadline = pullUpAt + microseconds(kPullUpDelay);
     }
 
-    // notify here if the endpoints are already present.
-    if (descriptorWritten) {
-        usleep(kPullUpDelay);
-        if (!!WriteStringToFile(monitorFfs->mGadgetName, PULLUP_PATH)) {
-            lock_guard<mutex> lock(monitorFfs->mLock);
-            monitorFfs->mCurrentUsbFunctionsApplied = true;
-            monitorFfs->mCallback(monitorFfs->mCurrentUsbFunctionsApplied, monitorFfs->mPayload);
-            gadgetPullup = true;
-            writeUdc = false;
-            ALOGI("GADGET pulled up");
-            monitorFfs->mCv.notify_all();
+    while (!stopMonitor) {
+        int timeout = -1;
+
+        if (pullUpPending) {
+            steady_clock::time_point now = steady_clock::now();
+
+            if (now >= pullUpAt) {
+                if (monitorFfs->pullUpGadget()) {
+                    writeUdc = false;
+                    pullUpPending = false;
+                } else if (now >= pullUpDeadline) {
+                    ALOGE("GADGET pull up failed");
+                    pullUpPending = false;
+                } else {
+                    pullUpAt = now + std::chrono::milliseconds(kPullUpRetryMs);
+                }
+            }
+
+            if (pullUpPending)
+                timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                  pullUpAt - now + std::chrono::milliseconds(1)).count();
         }
-    }
 
-    while (!stopMonitor) {
-        int nrEvents = epoll_wait(monitorFfs->mEpollFd, events, kEpollEvents, -1);
+        int nrEvents = epoll_wait(monitorFfs->mEpollFd, events, kEpollEvents, timeout);
 
-        if (nrEvents <= 0) {
+        // Timed out for the next pull up attempt.
+        if (nrEvents == 0) continue;
+
+        if (nrEvents < 0) {
             ALOGE("epoll wait did not return descriptor number");
             continue;
         }
@@ -140,37 +177,26 @@ void* MonitorFfs::startMonitorFd(void* param) {
 
                     p += sizeof(struct inotify_event) + event->len;
 
-                    bool descriptorPresent = true;
-                    for (int j = 0; j < static_cast<int>(monitorFfs->mEndpointList.size()); j++) {
-                        if (access(monitorFfs->mEndpointList.at(j).c_str(), R_OK)) {
-                            if (kDebug) ALOGI("%s absent", monitorFfs->mEndpointList.at(j).c_str());
-                            descriptorPresent = false;
-                            break;
-                        }
-                    }
+                    bool descriptorPresent = monitorFfs->endpointsPresent();
 
-                    if (!descriptorPresent && !writeUdc) {
-                        if (kDebug) ALOGI("endpoints not up");
-                        writeUdc = true;
-                        disconnect = std::chrono::steady_clock::now();
-                    } else if (descriptorPresent && writeUdc) {
+                    if (!descriptorPresent) {
+                        if (!writeUdc) {
+                            if (kDebug) ALOGI("endpoints not up");
+                            writeUdc = true;
+                            disconnect = std::chrono::steady_clock::now();
+                        }
+                        pullUpPending = false;
+                    } else if (writeUdc && !pullUpPending) {
                         steady_clock::time_point temp = steady_clock::now();
 
+                        // Keep the gadget down long enough for the host to
+                        // notice that the ep owner went away.
+                        pullUpPending = true;
+                        pullUpAt = temp;
                         if (std::chrono::duration_cast<microseconds>(temp - disconnect).count() <
                             kPullUpDelay)
-                            usleep(kPullUpDelay);
-
-                        if (!!WriteStringToFile(monitorFfs->mGadgetName, PULLUP_PATH)) {
-                            lock_guard<mutex> lock(monitorFfs->mLock);
-                            monitorFfs->mCurrentUsbFunctionsApplied = true;
-                            monitorFfs->mCallback(monitorFfs->mCurrentUsbFunctionsApplied,
-                                                  monitorFfs->mPayload);
-                            ALOGI("GADGET pulled up");
-                            writeUdc = false;
-                            gadgetPullup = true;
-                            // notify the main thread to signal userspace.
-                            monitorFfs->mCv.notify_all();
-                        }
+                            pullUpAt = disconnect + microseconds(kPullUpDelay);
+                        pullUpDeadline = pullUpAt + microseconds(kPullUpDelay);
                     }
                 }
             } else {
@@ -205,6 +231,7 @@ void MonitorFfs::reset() {
     for (std::vector<int>::size_type i = 0; i != mWatchFd.size(); i++)
         inotify_rm_watch(mInotifyFd, mWatchFd[i]);
 
+    mWatchFd.clear();
     mEndpointList.clear();
     gadgetPullup = false;
     mCallback = NULL;
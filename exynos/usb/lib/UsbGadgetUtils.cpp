@@ -24,6 +24,10 @@ namespace usb {
 namespace gadget {
 
 int unlinkFunctions(const char* path) {
+    return unlinkFunctionsFrom(path, 0);
+}
+
+int unlinkFunctionsFrom(const char* path, int index) {
     DIR* config = opendir(path);
     struct dirent* function;
     char filepath[kMaxFilePathLength];
@@ -34,7 +38,8 @@ int unlinkFunctions(const char* path) {
     // d_type does not seems to be supported in /config
     // so filtering by name.
     while (((function = readdir(config)) != NULL)) {
-        if ((strstr(function->d_name, FUNCTION_NAME) == NULL)) continue;
+        if (strncmp(function->d_name, FUNCTION_NAME, strlen(FUNCTION_NAME))) continue;
+        if (atoi(function->d_name + strlen(FUNCTION_NAME)) < index) continue;
         // build the path for each file in the folder.
         sprintf(filepath, "%s/%s", path, function->d_name);
         ret = remove(filepath);
@@ -64,9 +69,30 @@ int addEpollFd(const unique_fd& epfd, const unique_fd& fd) {
 int linkFunction(const char* function, int index) {
     char functionPath[kMaxFilePathLength];
     char link[kMaxFilePathLength];
+    char target[kMaxFilePathLength];
+    ssize_t len;
 
     sprintf(functionPath, "%s%s", FUNCTIONS_PATH, function);
     sprintf(link, "%s%d", FUNCTION_PATH, index);
+
+    // configfs reports the link target as a relative path, so only the
+    // function name is compared.
+    len = readlink(link, target, sizeof(target) - 1);
+    if (len > 0) {
+        const char* name;
+
+        target[len] = '\0';
+        name = strrchr(target, '/');
+        if (!strcmp(name ? name + 1 : target, function)) {
+            if (kDebug) ALOGI("Keeping symlink %s -> %s", link, functionPath);
+            return 0;
+        }
+    }
+
+    // The functions are ordered by the time they were linked, so everything
+    // from this index on has to be linked again.
+    if (unlinkFunctionsFrom(CONFIG_PATH, index)) return -1;
+
     if (symlink(functionPath, link)) {
         ALOGE("Cannot create symlink %s -> %s errno:%d", link, functionPath, errno);
         return -1;
@@ -74,6 +100,71 @@ int linkFunction(const char* function, int index) {
     return 0;
 }
 
+static bool isUdcState(int fd, const char* state) {
+    char buf[kBufferSize];
+    size_t stateLen = strlen(state);
+    ssize_t len = TEMP_FAILURE_RETRY(pread(fd, buf, sizeof(buf) - 1, 0));
+
+    if (len < 0) return false;
+    buf[len] = '\0';
+
+    return !strncmp(buf, state, stateLen) && (buf[stateLen] == '\n' || buf[stateLen] == '\0');
+}
+
+bool waitForUdcState(const char* gadget, const char* state, int timeout_ms) {
+    string statePath = string(UDC_CLASS_PATH) + gadget + "/state";
+    struct epoll_event events[kEpollEvents];
+    struct epoll_event event;
+    bool notified = false;
+
+    unique_fd fd(open(statePath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+        ALOGE("Cannot open %s errno:%d", statePath.c_str(), errno);
+        return false;
+    }
+
+    if (isUdcState(fd, state)) return true;
+
+    unique_fd epollFd(epoll_create1(EPOLL_CLOEXEC));
+    unique_fd inotifyFd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+    if (epollFd == -1 || inotifyFd == -1) {
+        ALOGE("Cannot wait for UDC state errno:%d", errno);
+        return false;
+    }
+
+    // sysfs signals attribute changes with POLLPRI. Files that are not sysfs
+    // attributes cannot be polled and are watched with inotify instead.
+    event.data.fd = fd;
+    event.events = EPOLLPRI | EPOLLERR;
+    if (!epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event)) notified = true;
+
+    if (inotify_add_watch(inotifyFd, statePath.c_str(), IN_MODIFY | IN_CLOSE_WRITE) != -1 &&
+        !addEpollFd(epollFd, inotifyFd))
+        notified = true;
+
+    steady_clock::time_point deadline = steady_clock::now() + timeout_ms * 1ms;
+    while (true) {
+        int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                deadline - steady_clock::now()).count();
+        if (remaining <= 0) break;
+
+        int nrEvents = epoll_wait(epollFd, events, kEpollEvents,
+                                  notified ? remaining : std::min(remaining, kPullUpRetryMs));
+        for (int i = 0; i < nrEvents; i++) {
+            if (events[i].data.fd == inotifyFd) {
+                char buf[kBufferSize];
+                while (read(inotifyFd, buf, sizeof(buf)) > 0) {
+                }
+            }
+        }
+
+        if (isUdcState(fd, state)) return true;
+    }
+
+    ALOGI("UDC %s did not reach state %s within %d ms", gadget, state, timeout_ms);
+    return false;
+}
+
 Status setVidPid(const char* vid, const char* pid) {
     if (!WriteStringToFile(vid, VENDOR_ID_PATH)) return Status::ERROR;
 
@@ -119,8 +210,6 @@ Status resetGadget() {
 
     if (!WriteStringToFile("0", DESC_USE_PATH)) return Status::ERROR;
 
-    if (unlinkFunctions(CONFIG_PATH)) return Status::ERROR;
-
     return Status::SUCCESS;
 }
 
@@ -131,27 +220,27 @@ Status addGenericAndroidFunctions(MonitorFfs* monitorFfs, uint64_t functions, bo
         ALOGI("setCurrentUsbFunctions mtp");
         if (!WriteStringToFile("1", DESC_USE_PATH)) return Status::ERROR;
 
-        if (!monitorFfs->addInotifyFd("/dev/usb-ffs/mtp/")) return Status::ERROR;
+        if (!monitorFfs->addInotifyFd(FFS_PATH "mtp/")) return Status::ERROR;
 
         if (linkFunction("ffs.mtp", (*functionCount)++)) return Status::ERROR;
 
         // Add endpoints to be monitored.
-        monitorFfs->addEndPoint("/dev/usb-ffs/mtp/ep1");
-        monitorFfs->addEndPoint("/dev/usb-ffs/mtp/ep2");
-        monitorFfs->addEndPoint("/dev/usb-ffs/mtp/ep3");
+        monitorFfs->addEndPoint(FFS_PATH "mtp/ep1");
+        monitorFfs->addEndPoint(FFS_PATH "mtp/ep2");
+        monitorFfs->addEndPoint(FFS_PATH "mtp/ep3");
     } else if (((functions & GadgetFunction::PTP) != 0)) {
         *ffsEnabled = true;
         ALOGI("setCurrentUsbFunctions ptp");
         if (!WriteStringToFile("1", DESC_USE_PATH)) return Status::ERROR;
 
-        if (!monitorFfs->addInotifyFd("/dev/usb-ffs/ptp/")) return Status::ERROR;
+        if (!monitorFfs->addInotifyFd(FFS_PATH "ptp/")) return Status::ERROR;
 
         if (linkFunction("ffs.ptp", (*functionCount)++)) return Status::ERROR;
 
         // Add endpoints to be monitored.
-        monitorFfs->addEndPoint("/dev/usb-ffs/ptp/ep1");
-        monitorFfs->addEndPoint("/dev/usb-ffs/ptp/ep2");
-        monitorFfs->addEndPoint("/dev/usb-ffs/ptp/ep3");
+        monitorFfs->addEndPoint(FFS_PATH "ptp/ep1");
+        monitorFfs->addEndPoint(FFS_PATH "ptp/ep2");
+        monitorFfs->addEndPoint(FFS_PATH "ptp/ep3");
     }
 
     if ((functions & GadgetFunction::MIDI) != 0) {
@@ -193,11 +282,11 @@ Status addGenericAndroidFunctions(MonitorFfs* monitorFfs, uint64_t functions, bo
 
 Status addAdb(MonitorFfs* monitorFfs, int* functionCount) {
     ALOGI("setCurrentUsbFunctions Adb");
-    if (!monitorFfs->addInotifyFd("/dev/usb-ffs/adb/")) return Status::ERROR;
+    if (!monitorFfs->addInotifyFd(FFS_PATH "adb/")) return Status::ERROR;
 
     if (linkFunction("ffs.adb", (*functionCount)++)) return Status::ERROR;
-    monitorFfs->addEndPoint("/dev/usb-ffs/adb/ep1");
-    monitorFfs->addEndPoint("/dev/usb-ffs/adb/ep2");
+    monitorFfs->addEndPoint(FFS_PATH "adb/ep1");
+    monitorFfs->addEndPoint(FFS_PATH "adb/ep2");
     ALOGI("Service started");
     return Status::SUCCESS;
 }
@@ -27,6 +27,7 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
 #include <sys/inotify.h>
@@ -35,6 +36,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <utils/Log.h>
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
 #include <mutex>
@@ -52,6 +54,8 @@ constexpr int kEpollEvents = 10;
 constexpr bool kDebug = false;
 constexpr int kDisconnectWaitUs = 100000;
 constexpr int kPullUpDelay = 500000;
+// Interval at which a refused pull up is retried until kPullUpDelay runs out.
+constexpr int kPullUpRetryMs = 10;
 constexpr int kShutdownMonitor = 100;
 
 constexpr char kBuildType[] = "ro.build.type";
@@ -59,7 +63,17 @@ constexpr char kPersistentVendorConfig[] = "persist.vendor.usb.usbradio.config";
 constexpr char kVendorConfig[] = "vendor.usb.config";
 constexpr char kVendorRndisConfig[] = "vendor.usb.rndis.config";
 
+// The configfs, sysfs and functionfs roots may be overridden at build time so
+// that the helpers can run against a fake tree (see tests/).
+#ifndef GADGET_PATH
 #define GADGET_PATH "/config/usb_gadget/g1/"
+#endif
+#ifndef UDC_CLASS_PATH
+#define UDC_CLASS_PATH "/sys/class/udc/"
+#endif
+#ifndef FFS_PATH
+#define FFS_PATH "/dev/usb-ffs/"
+#endif
 #define PULLUP_PATH GADGET_PATH "UDC"
 #define PERSISTENT_BOOT_MODE "ro.bootmode"
 #define VENDOR_ID_PATH GADGET_PATH "idVendor"
@@ -130,6 +144,11 @@ class MonitorFfs {
     // Monitor State
     bool mMonitorRunning;
 
+    // Returns true when all the endpoints in mEndpointList are present.
+    bool endpointsPresent();
+    // Writes the gadget name into the UDC and notifies the waiters.
+    bool pullUpGadget();
+
   public:
     MonitorFfs(const char* const gadget);
     // Inits all the UniqueFds.
@@ -159,8 +178,14 @@ class MonitorFfs {
 int addEpollFd(const unique_fd& epfd, const unique_fd& fd);
 // Removes all the usb functions link in the specified path.
 int unlinkFunctions(const char* path);
-// Craetes a configfs link for the function.
+// Removes the usb function links numbered index and above in the specified path.
+int unlinkFunctionsFrom(const char* path, int index);
+// Craetes a configfs link for the function. A link that already points to the
+// function is kept; otherwise it is replaced together with all the links after
+// it so that the order of the functions in the configuration is preserved.
 int linkFunction(const char* function, int index);
+// Waits up to timeout_ms for the UDC of the gadget to report the given state.
+bool waitForUdcState(const char* gadget, const char* state, int timeout_ms);
 // Sets the USB VID and PID.
 Status setVidPid(const char* vid, const char* pid);
 // Extracts vendor functions from the vendor init properties.
@@ -170,7 +195,8 @@ Status addAdb(MonitorFfs* monitorFfs, int* functionCount);
 // Adds all applicable generic android usb functions other than ADB.
 Status addGenericAndroidFunctions(MonitorFfs* monitorFfs, uint64_t functions, bool* ffsEnabled,
                                   int* functionCount);
-// Pulls down USB gadget.
+// Pulls down USB gadget. The function links are left in place so that the next
+// configuration only has to touch the links that change.
 Status resetGadget();
 
 }  // namespace gadget
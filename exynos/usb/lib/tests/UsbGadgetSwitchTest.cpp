@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs the gadget helpers against a fake configfs/UDC/functionfs tree.
+// GADGET_PATH, UDC_CLASS_PATH and FFS_PATH point below TEST_ROOT (see
+// Android.bp); the tree is put on a tmpfs when the test may mount one.
+
+#define LOG_TAG "libusbconfigfs_test"
+
+#include <UsbGadgetCommon.h>
+
+#include <gtest/gtest.h>
+
+#include <poll.h>
+#include <atomic>
+
+using namespace android::hardware::usb::gadget;
+
+namespace {
+
+constexpr char kGadgetName[] = "fake.udc";
+constexpr int kSwitchTimeoutMs = 3000;
+constexpr int kDaemonStartMs = 5;
+
+const char* const kFfsFunctions[] = {"mtp", "ptp", "adb"};
+
+void makeDir(const string& path) {
+    ASSERT_TRUE(!mkdir(path.c_str(), 0755) || errno == EEXIST) << path;
+}
+
+void makeDirs(const string& path) {
+    for (size_t slash = path.find('/', 1); slash != string::npos; slash = path.find('/', slash + 1))
+        makeDir(path.substr(0, slash));
+}
+
+void makeFile(const string& path, const char* content) {
+    ASSERT_TRUE(WriteStringToFile(content, path)) << path;
+}
+
+string udcStatePath() {
+    return string(UDC_CLASS_PATH) + kGadgetName + "/state";
+}
+
+ino_t linkInode(int index) {
+    struct stat st;
+    string link = FUNCTION_PATH + std::to_string(index);
+
+    return lstat(link.c_str(), &st) ? 0 : st.st_ino;
+}
+
+// Plays the UDC driver: reports "configured" once the gadget is bound and
+// "not attached" once it is pulled down.
+class FakeUdc {
+  public:
+    void start() {
+        mInotifyFd.reset(inotify_init1(IN_CLOEXEC));
+        ASSERT_NE(-1, mInotifyFd.get());
+        ASSERT_NE(-1, inotify_add_watch(mInotifyFd, PULLUP_PATH, IN_CLOSE_WRITE));
+        mEventFd.reset(eventfd(0, EFD_CLOEXEC));
+        ASSERT_NE(-1, mEventFd.get());
+        mThread = thread([this] { run(); });
+    }
+
+    void stop() {
+        uint64_t flag = 1;
+
+        if (!mThread.joinable()) return;
+        write(mEventFd, &flag, sizeof(flag));
+        mThread.join();
+    }
+
+  private:
+    void run() {
+        struct pollfd fds[2] = {{mInotifyFd, POLLIN, 0}, {mEventFd, POLLIN, 0}};
+        char buf[kBufferSize];
+
+        while (poll(fds, 2, -1) > 0 && !(fds[1].revents & POLLIN)) {
+            string udc;
+
+            read(mInotifyFd, buf, sizeof(buf));
+            android::base::ReadFileToString(PULLUP_PATH, &udc);
+            WriteStringToFile(udc.find(kGadgetName) == 0 ? "configured\n" : "not attached\n",
+                              udcStatePath());
+        }
+    }
+
+    unique_fd mInotifyFd;
+    unique_fd mEventFd;
+    thread mThread;
+};
+
+class UsbGadgetSwitchTest : public ::testing::Test {
+  protected:
+    UsbGadgetSwitchTest() : mMonitor(kGadgetName), mMounted(false) {}
+
+    void SetUp() override {
+        makeDirs(TEST_ROOT "/");
+        mMounted = !mount("tmpfs", TEST_ROOT, "tmpfs", 0, "size=1m");
+
+        makeDirs(CONFIG_PATH);
+        makeDirs(OS_DESC_PATH);
+        makeDirs(FUNCTIONS_PATH);
+        unlinkFunctions(CONFIG_PATH);
+        for (const char* file : {PULLUP_PATH, VENDOR_ID_PATH, PRODUCT_ID_PATH, DEVICE_CLASS_PATH,
+                                 DEVICE_SUB_CLASS_PATH, DEVICE_PROTOCOL_PATH, DESC_USE_PATH})
+            makeFile(file, "");
+        for (const char* function : {"ffs.mtp", "ffs.ptp", "ffs.adb", "rndis.gs4", "midi.gs5"})
+            makeDir(string(FUNCTIONS_PATH) + function);
+
+        makeDirs(string(UDC_CLASS_PATH) + kGadgetName + "/");
+        makeFile(udcStatePath(), "not attached\n");
+
+        for (const char* ffs : kFfsFunctions) makeDirs(string(FFS_PATH) + ffs + "/");
+        runDaemons(static_cast<uint64_t>(GadgetFunction::NONE));
+
+        mUdc.start();
+    }
+
+    void TearDown() override {
+        mMonitor.reset();
+        for (thread& daemon : mDaemons) daemon.join();
+        mUdc.stop();
+        if (mMounted) umount(TEST_ROOT);
+    }
+
+    static void appliedCallback(bool functionsApplied, void* payload) {
+        static_cast<UsbGadgetSwitchTest*>(payload)->mApplied = functionsApplied;
+    }
+
+    // Stands in for the ep owners: a daemon of a function that is enabled
+    // writes its descriptors shortly after the switch, the others go away.
+    void runDaemons(uint64_t functions) {
+        const GadgetFunction masks[] = {GadgetFunction::MTP, GadgetFunction::PTP,
+                                        GadgetFunction::ADB};
+
+        for (int i = 0; i < 3; i++) {
+            string dir = string(FFS_PATH) + kFfsFunctions[i] + "/";
+            int eps = i == 2 ? 2 : 3;
+
+            if (!(functions & masks[i])) {
+                for (int ep = 1; ep <= eps; ep++) unlink((dir + "ep" + std::to_string(ep)).c_str());
+                continue;
+            }
+            if (!access((dir + "ep1").c_str(), R_OK)) continue;
+
+            mDaemons.emplace_back([dir, eps] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(kDaemonStartMs));
+                for (int ep = 1; ep <= eps; ep++)
+                    WriteStringToFile("", dir + "ep" + std::to_string(ep));
+            });
+        }
+    }
+
+    // Mirrors UsbGadget::setCurrentUsbFunctions and returns the time it took
+    // until the gadget was pulled up again.
+    int64_t switchTo(uint64_t functions) {
+        steady_clock::time_point start = steady_clock::now();
+        bool ffsEnabled = false;
+        int count = 0;
+
+        EXPECT_EQ(Status::SUCCESS, resetGadget());
+        mMonitor.reset();
+        mApplied = false;
+        EXPECT_TRUE(waitForUdcState(kGadgetName, "not attached", kDisconnectWaitUs / 1000));
+
+        runDaemons(functions);
+
+        EXPECT_EQ(Status::SUCCESS,
+                  addGenericAndroidFunctions(&mMonitor, functions, &ffsEnabled, &count));
+        if (functions & GadgetFunction::ADB) {
+            ffsEnabled = true;
+            EXPECT_EQ(Status::SUCCESS, addAdb(&mMonitor, &count));
+        }
+        EXPECT_EQ(0, unlinkFunctionsFrom(CONFIG_PATH, count));
+
+        if (!ffsEnabled) {
+            EXPECT_TRUE(WriteStringToFile(kGadgetName, PULLUP_PATH));
+        } else {
+            mMonitor.registerFunctionsAppliedCallback(&appliedCallback, this);
+            mMonitor.startMonitor();
+            EXPECT_TRUE(mMonitor.waitForPullUp(kSwitchTimeoutMs));
+            EXPECT_TRUE(mApplied);
+        }
+        EXPECT_TRUE(waitForUdcState(kGadgetName, "configured", kSwitchTimeoutMs));
+
+        return std::chrono::duration_cast<microseconds>(steady_clock::now() - start).count();
+    }
+
+    MonitorFfs mMonitor;
+    FakeUdc mUdc;
+    vector<thread> mDaemons;
+    std::atomic<bool> mApplied;
+    bool mMounted;
+};
+
+}  // namespace
+
+TEST_F(UsbGadgetSwitchTest, LinksOnlyChangedFunctions) {
+    switchTo(static_cast<uint64_t>(GadgetFunction::MTP));
+    ino_t mtp = linkInode(0);
+    ASSERT_NE(0u, mtp);
+
+    switchTo(GadgetFunction::MTP | GadgetFunction::ADB);
+    EXPECT_EQ(mtp, linkInode(0));
+    ino_t adb = linkInode(1);
+    EXPECT_NE(0u, adb);
+
+    // The first function changes, so the adb link is created again after it.
+    switchTo(GadgetFunction::PTP | GadgetFunction::ADB);
+    EXPECT_NE(mtp, linkInode(0));
+    EXPECT_NE(0u, linkInode(1));
+
+    switchTo(static_cast<uint64_t>(GadgetFunction::PTP));
+    EXPECT_NE(0u, linkInode(0));
+    EXPECT_EQ(0u, linkInode(1));
+
+    EXPECT_EQ(0, unlinkFunctions(CONFIG_PATH));
+    EXPECT_EQ(0u, linkInode(0));
+}
+
+TEST_F(UsbGadgetSwitchTest, UdcStateWaitTimesOut) {
+    steady_clock::time_point start = steady_clock::now();
+
+    EXPECT_FALSE(waitForUdcState(kGadgetName, "configured", 20));
+    EXPECT_GE(steady_clock::now() - start, 20ms);
+
+    EXPECT_TRUE(WriteStringToFile(kGadgetName, PULLUP_PATH));
+    EXPECT_TRUE(waitForUdcState(kGadgetName, "configured", kSwitchTimeoutMs));
+}
+
+TEST_F(UsbGadgetSwitchTest, SwitchLatency) {
+    const struct {
+        const char* name;
+        uint64_t functions;
+    } kSteps[] = {
+            {"mtp", static_cast<uint64_t>(GadgetFunction::MTP)},
+            {"mtp,adb", GadgetFunction::MTP | GadgetFunction::ADB},
+            {"ptp,adb", GadgetFunction::PTP | GadgetFunction::ADB},
+            {"rndis,adb", GadgetFunction::RNDIS | GadgetFunction::ADB},
+            {"adb", static_cast<uint64_t>(GadgetFunction::ADB)},
+            {"rndis", static_cast<uint64_t>(GadgetFunction::RNDIS)},
+            {"mtp", static_cast<uint64_t>(GadgetFunction::MTP)},
+    };
+    int64_t total = 0;
+
+    for (const auto& step : kSteps) {
+        int64_t us = switchTo(step.functions);
+
+        printf("switch to %-10s %6.1f ms\n", step.name, us / 1000.0);
+        // Previously every switch paid kDisconnectWaitUs plus kPullUpDelay
+        // whenever the endpoints were already up.
+        EXPECT_LT(us, kPullUpDelay);
+        total += us;
+    }
+    printf("average switch %6.1f ms\n", total / 1000.0 / (sizeof(kSteps) / sizeof(kSteps[0])));
+}
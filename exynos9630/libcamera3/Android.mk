@@ -65,6 +65,17 @@ LOCAL_CFLAGS += -DUSES_HIFI_LLS
 LOCAL_SHARED_LIBRARIES += libexynoscamera_hifills_plugin
 endif
 
+ifeq ($(BOARD_CAMERA_USES_NODE_COMPLETION_DISPATCHER), true)
+LOCAL_CFLAGS += -DUSE_NODE_COMPLETION_DISPATCHER
+endif
+
+ifeq ($(BOARD_CAMERA_USES_BUFFER_RETENTION_POOL), true)
+LOCAL_CFLAGS += -DUSE_BUFFER_RETENTION_POOL
+ifneq ($(BOARD_CAMERA_BUFFER_RETENTION_BUDGET_MB),)
+LOCAL_CFLAGS += -DBUFFER_RETENTION_POOL_BUDGET_MB=$(BOARD_CAMERA_BUFFER_RETENTION_BUDGET_MB)
+endif
+endif
+
 LOCAL_C_INCLUDES += \
 	$(LOCAL_PATH)/../include \
 	$(LOCAL_PATH)/../libcamera3 \
@@ -126,6 +137,7 @@ LOCAL_SRC_FILES = \
 	../../exynos/libcamera3/common_v2/ExynosCameraUtils.cpp \
 	../../exynos/libcamera3/common_v2/ExynosCameraNode.cpp \
 	../../exynos/libcamera3/common_v2/ExynosCameraNodeJpegHAL.cpp \
+	../../exynos/libcamera3/common_v2/ExynosCameraNodeDispatcher.cpp \
 	../../exynos/libcamera3/common_v2/ExynosCameraFrameSelector.cpp \
 	../../exynos/libcamera3/common_v2/ExynosCameraFrameFactoryBase.cpp \
 	../../exynos/libcamera3/common_v2/SensorInfos/ExynosCameraSensorInfoBase.cpp \
@@ -145,6 +157,7 @@ LOCAL_SRC_FILES = \
 	../../exynos/libcamera3/common_v2/Pipes2/ExynosCameraPipePP.cpp \
 	../../exynos/libcamera3/common_v2/Buffers/ExynosCameraBufferManager.cpp \
 	../../exynos/libcamera3/common_v2/Buffers/ExynosCameraBufferSupplier.cpp \
+	../../exynos/libcamera3/common_v2/Buffers/ExynosCameraBufferRetentionPool.cpp \
 	../../exynos/libcamera3/common_v2/Activities/ExynosCameraActivityBase.cpp \
 	../../exynos/libcamera3/common_v2/Activities/ExynosCameraActivityAutofocus.cpp \
 	../../exynos/libcamera3/common_v2/Activities/ExynosCameraActivityFlash.cpp \
@@ -225,6 +238,10 @@ ifeq ($(BOARD_CAMERA_USES_SLSI_PLUGIN), true)
 include $(TOP)/hardware/samsung_slsi/exynos/libcamera3/common_v2/PlugIn/converter/libs/Android.mk
 endif
 
+# the tests of common_v2 are built with the flags of the library
+EXYNOS_CAMERA3_CFLAGS := $(LOCAL_CFLAGS)
+EXYNOS_CAMERA3_C_INCLUDES := $(LOCAL_C_INCLUDES)
+
 include $(BUILD_SHARED_LIBRARY)
 
 
@@ -320,3 +337,7 @@ ifeq ($(BOARD_CAMERA_USES_SLSI_PLUGIN), true)
 # plugIn
 include $(TOP)/hardware/samsung_slsi/exynos/libcamera3/common_v2/PlugIn/Android.mk
 endif
+
+#################
+# tests
+include $(TOP)/hardware/samsung_slsi/exynos/libcamera3/common_v2/tests/Android.mk
@@ -136,6 +136,17 @@ ifeq ($(BOARD_CAMERA_USES_3AA_DNG), true)
 LOCAL_CFLAGS += -DBOARD_CAMERA_3AA_DNG
 endif
 
+ifeq ($(BOARD_CAMERA_USES_NODE_COMPLETION_DISPATCHER), true)
+LOCAL_CFLAGS += -DUSE_NODE_COMPLETION_DISPATCHER
+endif
+
+ifeq ($(BOARD_CAMERA_USES_BUFFER_RETENTION_POOL), true)
+LOCAL_CFLAGS += -DUSE_BUFFER_RETENTION_POOL
+ifneq ($(BOARD_CAMERA_BUFFER_RETENTION_BUDGET_MB),)
+LOCAL_CFLAGS += -DBUFFER_RETENTION_POOL_BUDGET_MB=$(BOARD_CAMERA_BUFFER_RETENTION_BUDGET_MB)
+endif
+endif
+
 ifneq ($(LOCAL_PROJECT_DIR),)
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/../libcamera3/Vendor/$(LOCAL_PROJECT_DIR)
 else
@@ -155,6 +166,7 @@ LOCAL_SRC_FILES = \
 	../../exynos/libcamera3/common_v2/ExynosCameraUtils.cpp \
 	../../exynos/libcamera3/common_v2/ExynosCameraNode.cpp \
 	../../exynos/libcamera3/common_v2/ExynosCameraNodeJpegHAL.cpp \
+	../../exynos/libcamera3/common_v2/ExynosCameraNodeDispatcher.cpp \
 	../../exynos/libcamera3/common_v2/ExynosCameraFrameSelector.cpp \
 	../../exynos/libcamera3/common_v2/ExynosCameraFrameFactoryBase.cpp \
 	../../exynos/libcamera3/common_v2/SensorInfos/ExynosCameraSensorInfoBase.cpp \
@@ -174,6 +186,7 @@ LOCAL_SRC_FILES = \
 	../../exynos/libcamera3/common_v2/Pipes2/ExynosCameraPipePP.cpp \
 	../../exynos/libcamera3/common_v2/Buffers/ExynosCameraBufferManager.cpp \
 	../../exynos/libcamera3/common_v2/Buffers/ExynosCameraBufferSupplier.cpp \
+	../../exynos/libcamera3/common_v2/Buffers/ExynosCameraBufferRetentionPool.cpp \
 	../../exynos/libcamera3/common_v2/Activities/ExynosCameraActivityBase.cpp \
 	../../exynos/libcamera3/common_v2/Activities/ExynosCameraActivityAutofocus.cpp \
 	../../exynos/libcamera3/common_v2/Activities/ExynosCameraActivityFlash.cpp \
@@ -281,6 +294,10 @@ ifeq ($(BOARD_CAMERA_USES_SLSI_PLUGIN), true)
 include $(TOP)/hardware/samsung_slsi/exynos/libcamera3/common_v2/PlugIn/converter/libs/Android.mk
 endif
 
+# the tests of common_v2 are built with the flags of the library
+EXYNOS_CAMERA3_CFLAGS := $(LOCAL_CFLAGS)
+EXYNOS_CAMERA3_C_INCLUDES := $(LOCAL_C_INCLUDES)
+
 include $(BUILD_SHARED_LIBRARY)
 
 
@@ -422,3 +439,7 @@ ifeq ($(BOARD_CAMERA_USES_SLSI_PLUGIN), true)
 # plugIn
 include $(TOP)/hardware/samsung_slsi/exynos/libcamera3/common_v2/PlugIn/Android.mk
 endif
+
+#################
+# tests
+include $(TOP)/hardware/samsung_slsi/exynos/libcamera3/common_v2/tests/Android.mk
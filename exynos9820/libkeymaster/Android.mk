@@ -68,3 +68,33 @@ LOCAL_PROPRIETARY_MODULE := true
 endif
 
 include $(BUILD_SHARED_LIBRARY)
+
+ifeq ($(BOARD_USES_KEYMASTER_VER1), true)
+# Host test of the TEE interface against a stub of libMcClient
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := keystore_tee_staging_test
+LOCAL_CPPFLAGS := -Wall
+LOCAL_CPPFLAGS += -Wextra
+LOCAL_CPPFLAGS += -Werror
+LOCAL_CPPFLAGS += -std=c++17
+LOCAL_CFLAGS := -DNDEBUG
+
+LOCAL_SRC_FILES := \
+	ver1/src/tlcTeeKeymaster_if.cpp \
+	ver1/src/km_encodings.cpp \
+	ver1/src/km_shared_util.cpp \
+	ver1/src/km_util.cpp \
+	ver1/src/serialization.cpp \
+	ver1/test/mc_client_stub.cpp \
+	ver1/test/test_tee_staging.cpp
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/ver1/include \
+	$(MOBICORE_PATH)/ClientLib/include \
+	hardware/libhardware/include/ \
+	system/core/libcutils/include/
+
+LOCAL_SHARED_LIBRARIES := libcrypto
+
+include $(BUILD_HOST_NATIVE_TEST)
+endif
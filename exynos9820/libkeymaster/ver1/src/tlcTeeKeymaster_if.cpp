@@ -31,6 +31,7 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <sys/mman.h>
 #include <hardware/keymaster_defs.h>
 #include "tlcTeeKeymasterM_if.h"
 #include "buildTag.h"
@@ -220,9 +221,37 @@ extern inline void keymaster_free_param_values(keymaster_key_param_t* param, siz
 extern inline void keymaster_free_param_set(keymaster_key_param_set_t* set);
 extern inline void keymaster_free_characteristics(keymaster_key_characteristics_t* characteristics);
 
+/**
+ * Size of the staging arena of a session.
+ *
+ * It is large enough for the buffers of any single command with a full
+ * INPUT_CHUNK_SIZE update() chunk and its output, so that only unusually
+ * large payloads fall back to mapping the caller's buffer with mcMap().
+ */
+#define STAGING_ARENA_SIZE (4096*16)
+#define STAGING_ALIGN 8
+#define STAGING_MAX_REGIONS 8
+
+/**
+ * A buffer staged in the arena in place of being mapped.
+ */
+struct staging_region {
+    uint8_t    *buf;    /**< buffer of the caller */
+    uint32_t   offset;  /**< offset in the arena */
+    uint32_t   len;
+    bool       live;
+};
+
 struct TEE_Session {
     tciMessage_ptr      pTci;
     mcSessionHandle_t   sessionHandle;
+    /* Staging arena, mapped once for the lifetime of the session. NULL if
+     * it could not be set up, then every buffer is mapped on its own. */
+    uint8_t             *arena;
+    mcBulkMap_t         arenaInfo;
+    uint32_t            arenaTop;
+    uint32_t            nRegions;
+    struct staging_region regions[STAGING_MAX_REGIONS];
 };
 
 /* ExySp: add timeout to check setting property */
@@ -455,16 +484,112 @@ static uint32_t key_blob_max_size(
     return plain_material_size + 32;
 }
 
+/**
+ * Secure world address of \p offset in the staging arena.
+ */
+static void stage_address(
+    const struct TEE_Session *session,
+    uint32_t offset,
+    mcBulkMap_t *bufinfo)
+{
+#if ( __WORDSIZE == 64 )
+    bufinfo->sVirtualAddr = session->arenaInfo.sVirtualAddr + offset;
+#else
+    bufinfo->sVirtualAddr = (uint8_t*)session->arenaInfo.sVirtualAddr + offset;
+#endif
+}
+
+/**
+ * Copy a buffer into the staging arena with a bump allocation.
+ *
+ * @return whether the buffer was staged; if not it has to be mapped
+ */
+static bool stage_buffer(
+    struct TEE_Session *session,
+    const uint8_t *buf, uint32_t buflen,
+    mcBulkMap_t *bufinfo)
+{
+    uint32_t offset = (session->arenaTop + STAGING_ALIGN - 1) & ~(STAGING_ALIGN - 1);
+
+    if ((session->arena == NULL) ||
+        (session->nRegions == STAGING_MAX_REGIONS) ||
+        (offset > STAGING_ARENA_SIZE) ||
+        (buflen > STAGING_ARENA_SIZE - offset))
+    {
+        return false;
+    }
+
+    struct staging_region *region = &session->regions[session->nRegions++];
+    region->buf = const_cast<uint8_t*>(buf);
+    region->offset = offset;
+    region->len = buflen;
+    region->live = true;
+    memcpy(session->arena + offset, buf, buflen);
+    session->arenaTop = offset + buflen;
+
+    stage_address(session, offset, bufinfo);
+    bufinfo->sVirtualLen = buflen;
+    return true;
+}
+
+/**
+ * Copy a staged buffer back to the caller and release its arena space.
+ *
+ * The arena is a stack: space is only reclaimed once the regions above it
+ * are released as well, which happens at the latest when the command ends.
+ *
+ * @return whether \p bufinfo referred to a staged buffer
+ */
+static bool unstage_buffer(
+    struct TEE_Session *session,
+    const uint8_t *buf,
+    const mcBulkMap_t *bufinfo)
+{
+    for (uint32_t i = session->nRegions; i-- > 0; ) {
+        struct staging_region *region = &session->regions[i];
+        mcBulkMap_t info;
+
+        stage_address(session, region->offset, &info);
+        if (!region->live || (region->buf != buf) ||
+            (info.sVirtualAddr != bufinfo->sVirtualAddr))
+        {
+            continue;
+        }
+
+        /* The TA may have written to it, as it would to a mapped buffer */
+        memcpy(region->buf, session->arena + region->offset, region->len);
+        memset(session->arena + region->offset, 0, region->len);
+        region->live = false;
+
+        while ((session->nRegions > 0) &&
+               !session->regions[session->nRegions - 1].live)
+        {
+            session->nRegions--;
+        }
+        session->arenaTop = (session->nRegions > 0) ?
+            session->regions[session->nRegions - 1].offset +
+            session->regions[session->nRegions - 1].len : 0;
+        return true;
+    }
+    return false;
+}
+
 /**
  * Map a buffer.
+ *
+ * Buffers fitting in the staging arena are copied there instead, which
+ * saves the round trips to the secure world of mcMap() and mcUnmap().
  */
 static keymaster_error_t map_buffer(
-    mcSessionHandle_t* session_handle,
+    struct TEE_Session *session,
     const uint8_t *buf, uint32_t buflen,
     mcBulkMap_t *bufinfo)
 {
     if ((buf != NULL) && (buflen != 0)) {
-        mcResult_t mcRet = mcMap(session_handle, (void*)buf, buflen, bufinfo);
+        if (stage_buffer(session, buf, buflen, bufinfo)) {
+            return KM_ERROR_OK;
+        }
+        mcResult_t mcRet = mcMap(&session->sessionHandle, (void*)buf, buflen, bufinfo);
         if (mcRet != MC_DRV_OK) {
             LOG_E("%s: mcMap() returned 0x%08x", __func__, mcRet);
             return KM_ERROR_SECURE_HW_COMMUNICATION_FAILED;
@@ -475,17 +600,23 @@ static keymaster_error_t map_buffer(
 
 /**
  * Unmap a buffer.
+ *
+ * \p bufinfo is cleared, so that unmapping it again is harmless.
  */
 static void unmap_buffer(
-    mcSessionHandle_t* session_handle,
+    struct TEE_Session *session,
     const uint8_t *buf,
     mcBulkMap_t *bufinfo)
 {
     if (bufinfo->sVirtualAddr != 0) {
-        mcResult_t mcRet = mcUnmap(session_handle, (void*)buf, bufinfo);
-        if (mcRet != MC_DRV_OK) {
-            LOG_E("%s: mcUnmap() returned 0x%08x", __func__, mcRet);
+        if (!unstage_buffer(session, buf, bufinfo)) {
+            mcResult_t mcRet = mcUnmap(&session->sessionHandle, (void*)buf, bufinfo);
+            if (mcRet != MC_DRV_OK) {
+                LOG_E("%s: mcUnmap() returned 0x%08x", __func__, mcRet);
+            }
         }
+        bufinfo->sVirtualAddr = 0;
+        bufinfo->sVirtualLen = 0;
     }
 }
 
@@ -595,6 +726,24 @@ int TEE_Open(TEE_SessionHandle *pSessionHandle)
         rc = -EBUSY;
         goto end_device;
     }
+
+    /* Map the staging arena. Without it the session still works, mapping
+     * each buffer on its own. */
+    session->arena = (uint8_t *)mmap(NULL, STAGING_ARENA_SIZE,
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (session->arena == MAP_FAILED) {
+        LOG_W("%s: cannot allocate the staging arena", __func__);
+        session->arena = NULL;
+    } else {
+        mcRet = mcMap(&session->sessionHandle, session->arena,
+                      STAGING_ARENA_SIZE, &session->arenaInfo);
+        if (MC_DRV_OK != mcRet) {
+            LOG_W("%s: mcMap() of the staging arena returned %d", __func__, mcRet);
+            munmap(session->arena, STAGING_ARENA_SIZE);
+            session->arena = NULL;
+        }
+    }
+
     *pSessionHandle = (TEE_SessionHandle)session;
 
     goto end;
@@ -621,6 +770,15 @@ void TEE_Close(TEE_SessionHandle sessionHandle)
     }
     struct TEE_Session *session = (struct TEE_Session *)sessionHandle;
 
+    /* Unmap the staging arena */
+    if (session->arena != NULL) {
+        mcRet = mcUnmap(&session->sessionHandle, session->arena, &session->arenaInfo);
+        if (MC_DRV_OK != mcRet) {
+            LOG_E("%s: mcUnmap() returned %d", __func__, mcRet);
+        }
+        munmap(session->arena, STAGING_ARENA_SIZE);
+    }
+
     /* Close session */
     mcRet = mcCloseSession(&session->sessionHandle);
     if (MC_DRV_OK != mcRet) {
@@ -664,7 +822,7 @@ keymaster_error_t TEE_AddRngEntropy(
     CHECK_RESULT_OK(copy_to_scoped_buf(data, dataLength, data1));
 
     /* Map data */
-    CHECK_RESULT_OK( map_buffer(session_handle, data1.buf.get(), data1.size, &dataInfo) );
+    CHECK_RESULT_OK( map_buffer(session, data1.buf.get(), data1.size, &dataInfo) );
 
     /* Update TCI buffer */
     tci->command.header.commandId = CMD_ID_TEE_ADD_RNG_ENTROPY;
@@ -674,7 +832,7 @@ keymaster_error_t TEE_AddRngEntropy(
     CHECK_RESULT_OK( transact(session_handle, tci) );
 
 end:
-    unmap_buffer(session_handle, data1.buf.get(), &dataInfo);
+    unmap_buffer(session, data1.buf.get(), &dataInfo);
     if (data1.buf) {
         memset(data1.buf.get(), 0, data1.size);
     }
@@ -741,7 +899,7 @@ keymaster_error_t TEE_GenerateKey(
         serializedData, params, true, 0, rsa_pubexp));
 
     /* Map key generation parameters */
-    CHECK_RESULT_OK( map_buffer(session_handle, serializedData.buf.get(), serializedData.size, &paramsInfo) );
+    CHECK_RESULT_OK( map_buffer(session, serializedData.buf.get(), serializedData.size, &paramsInfo) );
 
     /* Allocate memory for key material */
     key_blob->key_material_size = key_blob_max_size(
@@ -749,14 +907,14 @@ keymaster_error_t TEE_GenerateKey(
     CHECK_RESULT_OK(km_alloc((uint8_t**)&key_blob->key_material, key_blob->key_material_size));
 
     /* Map key blob buffer */
-    CHECK_RESULT_OK( map_buffer(session_handle,
+    CHECK_RESULT_OK( map_buffer(session,
         key_blob->key_material, key_blob->key_material_size, &keyBlobInfo) );
 
     if (characteristics != NULL) {
         /* Allocate memory for the key characteristics. */
         CHECK_RESULT_OK(km_alloc(&key_chars, KM_CHARACTERISTICS_SIZE));
         /* Map buffer for key characteristics. */
-        CHECK_RESULT_OK( map_buffer(session_handle,
+        CHECK_RESULT_OK( map_buffer(session,
             key_chars, KM_CHARACTERISTICS_SIZE, &characteristicsInfo) );
     }
 
@@ -776,16 +934,18 @@ keymaster_error_t TEE_GenerateKey(
     key_blob->key_material_size = tci->generate_key.key_blob.data_length;
 
     if (characteristics != NULL) { // Give characteristics to caller.
+        /* Copy the characteristics out of the staging arena first */
+        unmap_buffer(session, key_chars, &characteristicsInfo);
         CHECK_RESULT_OK(km_deserialize_characteristics(
             *characteristics, key_chars, KM_CHARACTERISTICS_SIZE));
     }
 end:
-    unmap_buffer(session_handle, serializedData.buf.get(), &paramsInfo);
+    unmap_buffer(session, serializedData.buf.get(), &paramsInfo);
     if (key_blob != NULL) {
-        unmap_buffer(session_handle, key_blob->key_material, &keyBlobInfo);
+        unmap_buffer(session, key_blob->key_material, &keyBlobInfo);
     }
     if (characteristics != NULL) {
-        unmap_buffer(session_handle, key_chars, &characteristicsInfo);
+        unmap_buffer(session, key_chars, &characteristicsInfo);
     }
 
     free(key_chars);
@@ -839,19 +999,19 @@ keymaster_error_t TEE_GetKeyCharacteristics(
     if ( key_blob != NULL ) {
         /* Hack to ensure that non-writable memory can be mapped. */
         CHECK_RESULT_OK( copy_to_scoped_buf(key_blob->key_material, key_blob->key_material_size, key_blob1) );
-        CHECK_RESULT_OK( map_buffer(session_handle,
+        CHECK_RESULT_OK( map_buffer(session,
         key_blob1.buf.get(), key_blob->key_material_size, &keyBlobInfo) );
     }
     if ( client_id != NULL ) {
         /* Hack to ensure that non-writable memory can be mapped. */
         CHECK_RESULT_OK( copy_to_scoped_buf(client_id->data, client_id->data_length, client_id1));
-        CHECK_RESULT_OK( map_buffer(session_handle,
+        CHECK_RESULT_OK( map_buffer(session,
             client_id1.buf.get(), client_id1.size, &clientIdInfo) );
     }
     if ( app_data != NULL ) {
         /* Hack to ensure that non-writable memory can be mapped. */
         CHECK_RESULT_OK( copy_to_scoped_buf(app_data->data, app_data->data_length, app_data1));
-        CHECK_RESULT_OK( map_buffer(session_handle,
+        CHECK_RESULT_OK( map_buffer(session,
             app_data1.buf.get(), app_data1.size, &appDataInfo) );
     }
 
@@ -859,7 +1019,7 @@ keymaster_error_t TEE_GetKeyCharacteristics(
     CHECK_RESULT_OK(km_alloc(&key_chars, KM_CHARACTERISTICS_SIZE));
 
     /* Map buffer for serialized key characteristics */
-    CHECK_RESULT_OK( map_buffer(session_handle,
+    CHECK_RESULT_OK( map_buffer(session,
         key_chars, KM_CHARACTERISTICS_SIZE, &characteristicsInfo) );
 
     /* Now the get_key_characteristics command */
@@ -875,22 +1035,23 @@ keymaster_error_t TEE_GetKeyCharacteristics(
 
     CHECK_RESULT_OK( transact(session_handle, tci) );
 
-    /* Deserialize */
+    /* Deserialize, once copied out of the staging arena */
+    unmap_buffer(session, key_chars, &characteristicsInfo);
     CHECK_RESULT_OK(km_deserialize_characteristics(
         *characteristics, key_chars, KM_CHARACTERISTICS_SIZE));
 
 end:
     if (key_blob1.buf) {
-        unmap_buffer(session_handle, key_blob1.buf.get(), &keyBlobInfo);
+        unmap_buffer(session, key_blob1.buf.get(), &keyBlobInfo);
     }
     if (client_id1.buf) {
-        unmap_buffer(session_handle, client_id1.buf.get(), &clientIdInfo);
+        unmap_buffer(session, client_id1.buf.get(), &clientIdInfo);
     }
     if (app_data1.buf) {
-        unmap_buffer(session_handle, app_data1.buf.get(), &appDataInfo);
+        unmap_buffer(session, app_data1.buf.get(), &appDataInfo);
     }
 	if (key_chars != NULL) {
-    	unmap_buffer(session_handle, key_chars, &characteristicsInfo);
+    	unmap_buffer(session, key_chars, &characteristicsInfo);
 	}
 
 	free(key_chars);
@@ -1157,7 +1318,7 @@ keymaster_error_t TEE_ImportKey(
         serializedData, params, true, keySizeInBits, rsa_pubexp));
 
     /* Map key parameters */
-    CHECK_RESULT_OK( map_buffer(session_handle,
+    CHECK_RESULT_OK( map_buffer(session,
         serializedData.buf.get(), serializedData.size, &paramsInfo) );
 
     /* Allocate memory for key blob */
@@ -1166,18 +1327,18 @@ keymaster_error_t TEE_ImportKey(
     CHECK_RESULT_OK(km_alloc((uint8_t**)&key_blob->key_material, key_blob->key_material_size));
 
     /* Map key data */
-    CHECK_RESULT_OK( map_buffer(session_handle,
+    CHECK_RESULT_OK( map_buffer(session,
         km_key_data, km_key_data_len, &keyDataInfo) );
 
     /* Map key blob buffer */
-    CHECK_RESULT_OK( map_buffer(session_handle,
+    CHECK_RESULT_OK( map_buffer(session,
         key_blob->key_material, key_blob->key_material_size, &keyBlobInfo) );
 
     if (characteristics != NULL) {
         /* Allocate memory for the serialized key characteristics.*/
         CHECK_RESULT_OK(km_alloc(&key_chars, KM_CHARACTERISTICS_SIZE));
          /* Map buffer for key characteristics. */
-        CHECK_RESULT_OK( map_buffer(session_handle,
+        CHECK_RESULT_OK( map_buffer(session,
             key_chars, KM_CHARACTERISTICS_SIZE, &characteristicsInfo) );
     }
 
@@ -1199,18 +1360,20 @@ keymaster_error_t TEE_ImportKey(
     key_blob->key_material_size = tci->import_key.key_blob.data_length;
 
     if (characteristics != NULL) { // Give characteristics to caller.
+        /* Copy the characteristics out of the staging arena first */
+        unmap_buffer(session, key_chars, &characteristicsInfo);
         CHECK_RESULT_OK(km_deserialize_characteristics(
             *characteristics, key_chars, KM_CHARACTERISTICS_SIZE));
     }
 
 end:
-    unmap_buffer(session_handle, serializedData.buf.get(), &paramsInfo);
-    unmap_buffer(session_handle, km_key_data, &keyDataInfo);
+    unmap_buffer(session, serializedData.buf.get(), &paramsInfo);
+    unmap_buffer(session, km_key_data, &keyDataInfo);
     if (key_blob != NULL) {
-        unmap_buffer(session_handle, (uint8_t*)key_blob->key_material, &keyBlobInfo);
+        unmap_buffer(session, (uint8_t*)key_blob->key_material, &keyBlobInfo);
     }
     if (key_chars != NULL) {
-        unmap_buffer(session_handle, key_chars, &characteristicsInfo);
+        unmap_buffer(session, key_chars, &characteristicsInfo);
     }
 
     free(km_key_data);
@@ -1270,20 +1433,20 @@ keymaster_error_t TEE_ExportKey(
     if ( key_to_export != NULL ) {
         /* Hack to ensure that non-writable memory can be mapped. */
         CHECK_RESULT_OK( copy_to_scoped_buf(key_to_export->key_material, key_to_export->key_material_size, key_to_export1) );
-        CHECK_RESULT_OK( map_buffer(session_handle,
+        CHECK_RESULT_OK( map_buffer(session,
         key_to_export1.buf.get(), key_to_export->key_material_size, &keyBlobInfo) );
     }
 
     if ( client_id != NULL ) {
         /* Hack to ensure that non-writable memory can be mapped. */
         CHECK_RESULT_OK( copy_to_scoped_buf(client_id->data, client_id->data_length, client_id1));
-        CHECK_RESULT_OK( map_buffer(session_handle,
+        CHECK_RESULT_OK( map_buffer(session,
             client_id1.buf.get(), client_id1.size, &clientIdInfo) );
     }
     if ( app_data != NULL ) {
         /* Hack to ensure that non-writable memory can be mapped. */
         CHECK_RESULT_OK( copy_to_scoped_buf(app_data->data, app_data->data_length, app_data1));
-        CHECK_RESULT_OK( map_buffer(session_handle,
+        CHECK_RESULT_OK( map_buffer(session,
             app_data1.buf.get(), app_data1.size, &appDataInfo) );
     }
 
@@ -1307,7 +1470,7 @@ keymaster_error_t TEE_ExportKey(
     CHECK_RESULT_OK(km_alloc(&core_pub_data, core_pub_data_len));
 
     /* Map buffer */
-    CHECK_RESULT_OK( map_buffer(session_handle, core_pub_data, core_pub_data_len, &keyDataInfo) );
+    CHECK_RESULT_OK( map_buffer(session, core_pub_data, core_pub_data_len, &keyDataInfo) );
 
     /* Now the export_key command */
     tci->command.header.commandId = CMD_ID_TEE_EXPORT_KEY;
@@ -1321,6 +1484,9 @@ keymaster_error_t TEE_ExportKey(
     tci->export_key.key_data.data_length = core_pub_data_len;
     CHECK_RESULT_OK( transact(session_handle, tci) );
 
+    /* Copy the public key data out of the staging arena */
+    unmap_buffer(session, (uint8_t*)core_pub_data, &keyDataInfo);
+
     /* Allocate and fill buffer for encoded key data for passing to caller */
     CHECK_RESULT_OK(encode_key(export_format, key_type, key_size,
         core_pub_data, core_pub_data_len, export_data));
@@ -1328,15 +1494,15 @@ keymaster_error_t TEE_ExportKey(
 end:
     if (key_to_export1.buf)
     {
-        unmap_buffer(session_handle, key_to_export1.buf.get(), &keyBlobInfo);
+        unmap_buffer(session, key_to_export1.buf.get(), &keyBlobInfo);
     }
     if (client_id1.buf) {
-        unmap_buffer(session_handle, client_id1.buf.get(), &clientIdInfo);
+        unmap_buffer(session, client_id1.buf.get(), &clientIdInfo);
     }
     if (app_data1.buf) {
-        unmap_buffer(session_handle, app_data1.buf.get(), &appDataInfo);
+        unmap_buffer(session, app_data1.buf.get(), &appDataInfo);
     }
-    unmap_buffer(session_handle, (uint8_t*)core_pub_data, &keyDataInfo);
+    unmap_buffer(session, (uint8_t*)core_pub_data, &keyDataInfo);
 
     if (ret != KM_ERROR_OK) {
         if (export_data != NULL) {
@@ -1397,18 +1563,18 @@ keymaster_error_t TEE_Begin(
         serializedData, params, false, 0, 0));
 
     /* Map params */
-    CHECK_RESULT_OK( map_buffer(session_handle,
+    CHECK_RESULT_OK( map_buffer(session,
         serializedData.buf.get(), serializedData.size, &paramsInfo) );
 
     if ( key->key_material != NULL ) {
         /* Workaround to ensure that non-writable memory can be mapped. */
         CHECK_RESULT_OK( copy_to_scoped_buf(key->key_material, key->key_material_size, key_blob) );
-        CHECK_RESULT_OK( map_buffer(session_handle,
+        CHECK_RESULT_OK( map_buffer(session,
             key_blob.buf.get(), key_blob.size, &keyBlobInfo) );
     }
 
     /* Map serialized_out_params */
-    CHECK_RESULT_OK( map_buffer(session_handle,
+    CHECK_RESULT_OK( map_buffer(session,
         serialized_out_params, TEE_BEGIN_OUT_PARAMS_SIZE, &outParamsInfo) );
 
     /* Update TCI buffer */
@@ -1428,6 +1594,9 @@ keymaster_error_t TEE_Begin(
 
     CHECK_RESULT_OK( transact(session_handle, tci) );
 
+    /* Copy out_params out of the staging arena */
+    unmap_buffer(session, serialized_out_params, &outParamsInfo);
+
     /* Deserialize out_params */
     if (out_params != NULL) {
         uint8_t *pos = serialized_out_params;
@@ -1450,12 +1619,12 @@ end:
             out_params->length = 0;
         }
     }
-    unmap_buffer(session_handle, serializedData.buf.get(), &paramsInfo);
+    unmap_buffer(session, serializedData.buf.get(), &paramsInfo);
     /* unmap key_blob */
     if (key_blob.buf) {
-        unmap_buffer(session_handle, key_blob.buf.get(), &keyBlobInfo);
+        unmap_buffer(session, key_blob.buf.get(), &keyBlobInfo);
     }
-    unmap_buffer(session_handle, serialized_out_params, &outParamsInfo);
+    unmap_buffer(session, serialized_out_params, &outParamsInfo);
 
     LOG_D("TEE_Begin exiting with %d", ret);
     return ret;
@@ -1547,7 +1716,6 @@ static keymaster_error_t split_update_chunks(
     uint8_t *output, const uint8_t *output_limit, size_t *output_used_r)
 {
     keymaster_error_t ret = KM_ERROR_OK;
-    mcSessionHandle_t *session_handle = &session->sessionHandle;
     const uint8_t *inp, *inp_limit;
     uint8_t *output_window = NULL;
     keymaster_key_param_t *param_buf = NULL, *aad_param;
@@ -1627,6 +1795,13 @@ static keymaster_error_t split_update_chunks(
         bool maybe_last_time = true;
         size_t budget = INPUT_CHUNK_SIZE;
 
+        /* Release the windows of the last chunk before anything else, so
+         * that the chunk buffers are staged in the same arena space on
+         * each iteration.
+         */
+        unmap_buffer(session, output_window, &output_map);
+        unmap_buffer(session, input_window.buf.get(), &input_map);
+
         /* First, handle the parameters.  This is actually the fiddliest bit.
          * If there's AAD still to come, or we haven't done this part, then
          * we serialize the parameters.  This ensures that we submit the AAD
@@ -1638,7 +1813,7 @@ static keymaster_error_t split_update_chunks(
          */
         if (must_reserialize_params) {
             PRINT_PARAM_SET(&my_params);
-            unmap_buffer(session_handle,
+            unmap_buffer(session,
                 serialized_params.buf.get(), &param_map);
             if (!aad_param) {
                 must_reserialize_params = false;
@@ -1657,7 +1832,7 @@ static keymaster_error_t split_update_chunks(
             }
             CHECK_RESULT_OK(km_serialize_params(serialized_params,
                 &my_params, false, 0, 0));
-            CHECK_RESULT_OK(map_buffer(session_handle,
+            CHECK_RESULT_OK(map_buffer(session,
                 serialized_params.buf.get(), serialized_params.size,
                 &param_map));
             if (aad_param && aad >= aad_limit) {
@@ -1674,8 +1849,7 @@ static keymaster_error_t split_update_chunks(
          * available for this.  We certainly don't want any old buffer from
          * last time hanging around.
          */
-        unmap_buffer(session_handle, input_window.buf.get(), &input_map);
-        input_window.buf.release();
+        input_window.buf.reset();
         if (inp && budget) {
             size_t n = inp_limit - inp;
             if (n > budget) {
@@ -1684,7 +1858,7 @@ static keymaster_error_t split_update_chunks(
             }
             budget -= n;
             CHECK_RESULT_OK(copy_to_scoped_buf(inp, n, input_window));
-            CHECK_RESULT_OK(map_buffer(session_handle,
+            CHECK_RESULT_OK(map_buffer(session,
                 input_window.buf.get(), n, &input_map));
         }
 
@@ -1699,7 +1873,6 @@ static keymaster_error_t split_update_chunks(
          * should hand over the whole of the caller's output buffer because
          * it was presumably provided for some good reason.
          */
-        unmap_buffer(session_handle, output_window, &output_map);
         if (output) {
             size_t n = output_limit - output;
             if (!maybe_last_time) {
@@ -1707,7 +1880,7 @@ static keymaster_error_t split_update_chunks(
                 if (n > avail) n = avail;
             }
             output_window = output;
-            CHECK_RESULT_OK(map_buffer(session_handle,
+            CHECK_RESULT_OK(map_buffer(session,
                 output_window, n, &output_map));
         }
 
@@ -1738,9 +1911,9 @@ static keymaster_error_t split_update_chunks(
     }
 
 end:
-    unmap_buffer(session_handle, serialized_params.buf.get(), &param_map);
-    unmap_buffer(session_handle, input_window.buf.get(), &input_map);
-    unmap_buffer(session_handle, output_window, &output_map);
+    unmap_buffer(session, serialized_params.buf.get(), &param_map);
+    unmap_buffer(session, input_window.buf.get(), &input_map);
+    unmap_buffer(session, output_window, &output_map);
     free(param_buf);
     return ret;
 }
@@ -1858,12 +2031,12 @@ keymaster_error_t TEE_Finish(
         serializedData, params, false, 0, 0));
 
     /* Map params */
-    CHECK_RESULT_OK( map_buffer(session_handle,
+    CHECK_RESULT_OK( map_buffer(session,
         serializedData.buf.get(), serializedData.size, &paramsInfo) );
 
     /* Map signature buffer */
     if (signature1.buf) {
-        CHECK_RESULT_OK( map_buffer(session_handle, signature1.buf.get(), signature1.size, &signatureInfo) );
+        CHECK_RESULT_OK( map_buffer(session, signature1.buf.get(), signature1.size, &signatureInfo) );
     }
 
     if (output != NULL) {
@@ -1881,7 +2054,7 @@ keymaster_error_t TEE_Finish(
 
         if (output->data_length != 0) {
             CHECK_RESULT_OK(km_alloc((uint8_t**)&output->data, output->data_length));
-            CHECK_RESULT_OK( map_buffer(session_handle,
+            CHECK_RESULT_OK( map_buffer(session,
                 (uint8_t*)output->data, output->data_length, &outputInfo) );
         }
     }
@@ -1904,12 +2077,12 @@ keymaster_error_t TEE_Finish(
     }
 
 end:
-    unmap_buffer(session_handle, serializedData.buf.get(), &paramsInfo);
+    unmap_buffer(session, serializedData.buf.get(), &paramsInfo);
     if (signature1.buf) {
-        unmap_buffer(session_handle, signature1.buf.get(), &signatureInfo);
+        unmap_buffer(session, signature1.buf.get(), &signatureInfo);
     }
     if (output != NULL) {
-        unmap_buffer(session_handle, (uint8_t*)output->data, &outputInfo);
+        unmap_buffer(session, (uint8_t*)output->data, &outputInfo);
     }
 
     if (ret != KM_ERROR_OK) {
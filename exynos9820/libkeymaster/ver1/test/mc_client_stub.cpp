@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2020 TRUSTONIC LIMITED
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the TRUSTONIC LIMITED nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+#include <vector>
+
+#include "MobiCoreDriverApi.h"
+#include "tlTeeKeymaster_Api.h"
+#include "serialization.h"
+#include "cutils/properties.h"
+#include "mc_client_stub.h"
+
+#define STUB_SVA_BASE 0x100000
+#define STUB_PAGE_SIZE 4096
+
+namespace {
+
+struct mapping {
+    uint8_t  *buf;
+    uint32_t len;
+};
+
+struct stub_state {
+    tciMessage_ptr tci;
+    std::map<uint32_t, mapping> mappings;   /* by secure virtual address */
+    uint32_t next_sva;
+    uint32_t map_limit;
+    uint32_t switch_cost;
+    uint32_t finish_length;
+    struct mc_stub_stats stats;
+};
+
+stub_state g_stub = { NULL, {}, STUB_SVA_BASE, UINT32_MAX, 0, 16, {0, 0, 0, 0, 0} };
+
+void world_switch(void)
+{
+    struct timespec start, now;
+
+    if (g_stub.switch_cost == 0) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec) * 1000000 +
+             (now.tv_nsec - start.tv_nsec) / 1000 < g_stub.switch_cost);
+}
+
+uint32_t sva_of(const mcBulkMap_t *info)
+{
+    return (uint32_t)(uintptr_t)info->sVirtualAddr;
+}
+
+/* What the TA sees at a secure address, NULL if it is not mapped */
+uint8_t *ta_buffer(data_blob_t blob)
+{
+    if (blob.data == 0) {
+        return NULL;
+    }
+    auto it = g_stub.mappings.upper_bound(blob.data);
+    if (it == g_stub.mappings.begin()) {
+        return NULL;
+    }
+    --it;
+    uint32_t offset = blob.data - it->first;
+    if ((offset > it->second.len) || (blob.data_length > it->second.len - offset)) {
+        return NULL;
+    }
+    return it->second.buf + offset;
+}
+
+uint32_t ta_count_aad(data_blob_t params)
+{
+    keymaster_key_param_set_t param_set = { NULL, 0 };
+    uint8_t *pos = ta_buffer(params);
+    uint32_t remain = params.data_length;
+    uint32_t aad = 0;
+
+    if ((pos == NULL) || (deserialize_param_set(&param_set, &pos, &remain) != KM_ERROR_OK)) {
+        return 0;
+    }
+    for (size_t i = 0; i < param_set.length; i++) {
+        if (param_set.params[i].tag == KM_TAG_ASSOCIATED_DATA) {
+            aad += param_set.params[i].blob.data_length;
+        }
+    }
+    keymaster_free_param_set(&param_set);
+    return aad;
+}
+
+/* Copy an output of the TA to where the caller mapped it */
+keymaster_error_t ta_write(data_blob_t *blob, const uint8_t *data, uint32_t len)
+{
+    uint8_t *out = ta_buffer(*blob);
+
+    if ((out == NULL) || (blob->data_length < len)) {
+        return KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+    }
+    memcpy(out, data, len);
+    blob->data_length = len;
+    return KM_ERROR_OK;
+}
+
+/* hw_enforced: algorithm and key size of the stub key, no sw_enforced */
+keymaster_error_t ta_write_characteristics(data_blob_t *blob)
+{
+    keymaster_key_param_t hw[2];
+    keymaster_key_param_set_t hw_set = { hw, 2 };
+    scoped_buf_ptr_t hw_enforced;
+
+    if (blob->data == 0) {
+        return KM_ERROR_OK;
+    }
+    hw[0].tag = KM_TAG_ALGORITHM;
+    hw[0].enumerated = KM_ALGORITHM_EC;
+    hw[1].tag = KM_TAG_KEY_SIZE;
+    hw[1].integer = MC_STUB_KEY_SIZE;
+    keymaster_error_t ret = km_serialize_params(hw_enforced, &hw_set, false, 0, 0);
+    if (ret != KM_ERROR_OK) {
+        return ret;
+    }
+
+    std::vector<uint8_t> chars(hw_enforced.buf.get(), hw_enforced.buf.get() + hw_enforced.size);
+    chars.resize(chars.size() + 4);
+    return ta_write(blob, chars.data(), chars.size());
+}
+
+/* curve | x_len | y_len | x | y of the stub key, the P-256 base point */
+keymaster_error_t ta_write_public_key(data_blob_t *blob)
+{
+    static const uint8_t x[32] = {
+        0x6b, 0x17, 0xd1, 0xf2, 0xe1, 0x2c, 0x42, 0x47, 0xf8, 0xbc, 0xe6, 0xe5, 0x63, 0xa4, 0x40, 0xf2,
+        0x77, 0x03, 0x7d, 0x81, 0x2d, 0xeb, 0x33, 0xa0, 0xf4, 0xa1, 0x39, 0x45, 0xd8, 0x98, 0xc2, 0x96,
+    };
+    static const uint8_t y[32] = {
+        0x4f, 0xe3, 0x42, 0xe2, 0xfe, 0x1a, 0x7f, 0x9b, 0x8e, 0xe7, 0xeb, 0x4a, 0x7c, 0x0f, 0x9e, 0x16,
+        0x2b, 0xce, 0x33, 0x57, 0x6b, 0x31, 0x5e, 0xce, 0xcb, 0xb6, 0x40, 0x68, 0x37, 0xbf, 0x51, 0xf5,
+    };
+    uint8_t data[12 + sizeof(x) + sizeof(y)];
+
+    set_u32(data, 3); /* ec_curve_nist_p256 */
+    set_u32(data + 4, sizeof(x));
+    set_u32(data + 8, sizeof(y));
+    memcpy(data + 12, x, sizeof(x));
+    memcpy(data + 12 + sizeof(x), y, sizeof(y));
+    return ta_write(blob, data, sizeof(data));
+}
+
+/* KM_TAG_NONCE, as for an operation asking the TA to choose the nonce */
+keymaster_error_t ta_write_out_params(data_blob_t *blob)
+{
+    uint8_t nonce[MC_STUB_NONCE_LENGTH];
+    keymaster_key_param_t param;
+    keymaster_key_param_set_t param_set = { &param, 1 };
+    scoped_buf_ptr_t out_params;
+
+    if (blob->data == 0) {
+        return KM_ERROR_OK;
+    }
+    memset(nonce, MC_STUB_NONCE_BYTE, sizeof(nonce));
+    param.tag = KM_TAG_NONCE;
+    param.blob.data = nonce;
+    param.blob.data_length = sizeof(nonce);
+    keymaster_error_t ret = km_serialize_params(out_params, &param_set, false, 0, 0);
+    if (ret != KM_ERROR_OK) {
+        return ret;
+    }
+    return ta_write(blob, out_params.buf.get(), out_params.size);
+}
+
+/* Write an output blob of the (packed) TCI through an aligned copy */
+keymaster_error_t ta_output(void *tci_blob, keymaster_error_t (*write)(data_blob_t *))
+{
+    data_blob_t blob;
+
+    memcpy(&blob, tci_blob, sizeof(blob));
+    keymaster_error_t ret = write(&blob);
+    memcpy(tci_blob, &blob, sizeof(blob));
+    return ret;
+}
+
+keymaster_error_t ta_command(tciMessage_ptr tci)
+{
+    switch (tci->command.header.commandId) {
+        case CMD_ID_TEE_GENERATE_KEY:
+            return ta_output(&tci->generate_key.characteristics, ta_write_characteristics);
+        case CMD_ID_TEE_IMPORT_KEY:
+            return ta_output(&tci->import_key.characteristics, ta_write_characteristics);
+        case CMD_ID_TEE_GET_KEY_CHARACTERISTICS:
+            return ta_output(&tci->get_key_characteristics.characteristics, ta_write_characteristics);
+        case CMD_ID_TEE_GET_KEY_INFO:
+            tci->get_key_info.key_type = KM_ALGORITHM_EC;
+            tci->get_key_info.key_size = MC_STUB_KEY_SIZE;
+            return KM_ERROR_OK;
+        case CMD_ID_TEE_EXPORT_KEY:
+            return ta_output(&tci->export_key.key_data, ta_write_public_key);
+        case CMD_ID_TEE_GET_OPERATION_INFO:
+            tci->get_operation_info.algorithm = KM_ALGORITHM_AES;
+            tci->get_operation_info.data_length = g_stub.finish_length;
+            return KM_ERROR_OK;
+        case CMD_ID_TEE_BEGIN:
+            tci->begin.handle = 1;
+            return ta_output(&tci->begin.out_params, ta_write_out_params);
+        case CMD_ID_TEE_UPDATE: {
+            uint8_t *input = ta_buffer(tci->update.input);
+            uint8_t *output = ta_buffer(tci->update.output);
+            uint32_t n = tci->update.input.data_length;
+
+            if ((n > 0) && ((input == NULL) || (output == NULL) ||
+                            (tci->update.output.data_length < n))) {
+                return KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+            }
+            g_stub.stats.aad_bytes += ta_count_aad(tci->update.params);
+            for (uint32_t i = 0; i < n; i++) {
+                output[i] = input[i] ^ MC_STUB_XOR_KEY;
+            }
+            tci->update.input_consumed = n;
+            tci->update.output.data_length = n;
+            return KM_ERROR_OK;
+        }
+        case CMD_ID_TEE_FINISH: {
+            uint8_t *output = ta_buffer(tci->finish.output);
+
+            if ((output == NULL) || (tci->finish.output.data_length < g_stub.finish_length)) {
+                return KM_ERROR_INSUFFICIENT_BUFFER_SPACE;
+            }
+            memset(output, MC_STUB_FINISH_BYTE, g_stub.finish_length);
+            tci->finish.output.data_length = g_stub.finish_length;
+            return KM_ERROR_OK;
+        }
+        default:
+            return KM_ERROR_OK;
+    }
+}
+
+} // namespace
+
+void mc_stub_reset(void)
+{
+    g_stub.mappings.clear();
+    g_stub.next_sva = STUB_SVA_BASE;
+    g_stub.map_limit = UINT32_MAX;
+    g_stub.switch_cost = 0;
+    g_stub.finish_length = 16;
+    memset(&g_stub.stats, 0, sizeof(g_stub.stats));
+}
+
+void mc_stub_get_stats(struct mc_stub_stats *stats)
+{
+    *stats = g_stub.stats;
+    stats->live_maps = g_stub.mappings.size();
+}
+
+void mc_stub_set_map_limit(uint32_t len)
+{
+    g_stub.map_limit = len;
+}
+
+void mc_stub_set_switch_cost(uint32_t usec)
+{
+    g_stub.switch_cost = usec;
+}
+
+void mc_stub_set_finish_length(uint32_t len)
+{
+    g_stub.finish_length = len;
+}
+
+/* The secure OS is always up */
+int property_get(const char *, char *value, const char *)
+{
+    strcpy(value, "true");
+    return strlen(value);
+}
+
+mcResult_t mcOpenDevice(uint32_t)
+{
+    return MC_DRV_OK;
+}
+
+mcResult_t mcCloseDevice(uint32_t)
+{
+    return MC_DRV_OK;
+}
+
+mcResult_t mcMallocWsm(uint32_t, uint32_t, uint32_t len, uint8_t **wsm, uint32_t)
+{
+    *wsm = (uint8_t *)calloc(1, len);
+    return (*wsm != NULL) ? MC_DRV_OK : MC_DRV_ERR_NO_FREE_MEMORY;
+}
+
+mcResult_t mcFreeWsm(uint32_t, uint8_t *wsm)
+{
+    free(wsm);
+    return MC_DRV_OK;
+}
+
+mcResult_t mcOpenSession(mcSessionHandle_t *session, const mcUuid_t *, uint8_t *tci, uint32_t)
+{
+    g_stub.tci = (tciMessage_ptr)tci;
+    session->sessionId = 1;
+    return MC_DRV_OK;
+}
+
+mcResult_t mcCloseSession(mcSessionHandle_t *)
+{
+    g_stub.tci = NULL;
+    return MC_DRV_OK;
+}
+
+mcResult_t mcNotify(mcSessionHandle_t *)
+{
+    g_stub.stats.notifications++;
+    world_switch();
+    keymaster_error_t ret = ta_command(g_stub.tci);
+    g_stub.tci->response.header.responseId = RSP_ID(g_stub.tci->command.header.commandId);
+    g_stub.tci->response.header.returnCode = ret;
+    return MC_DRV_OK;
+}
+
+mcResult_t mcWaitNotification(mcSessionHandle_t *, int32_t)
+{
+    return MC_DRV_OK;
+}
+
+mcResult_t mcMap(mcSessionHandle_t *, void *buf, uint32_t len, mcBulkMap_t *mapInfo)
+{
+    g_stub.stats.maps++;
+    world_switch();
+    if (len > g_stub.map_limit) {
+        return MC_DRV_ERR_NO_FREE_MEMORY;
+    }
+
+    uint32_t sva = g_stub.next_sva;
+    g_stub.next_sva += (len + 2 * STUB_PAGE_SIZE - 1) & ~(STUB_PAGE_SIZE - 1);
+    g_stub.mappings[sva] = { (uint8_t *)buf, len };
+#if ( __WORDSIZE == 64 )
+    mapInfo->sVirtualAddr = sva;
+#else
+    mapInfo->sVirtualAddr = (void *)(uintptr_t)sva;
+#endif
+    mapInfo->sVirtualLen = len;
+    return MC_DRV_OK;
+}
+
+mcResult_t mcUnmap(mcSessionHandle_t *, void *buf, mcBulkMap_t *mapInfo)
+{
+    g_stub.stats.unmaps++;
+    world_switch();
+    auto it = g_stub.mappings.find(sva_of(mapInfo));
+    if ((it == g_stub.mappings.end()) || (it->second.buf != buf)) {
+        return MC_DRV_ERR_BULK_UNMAPPING;
+    }
+    g_stub.mappings.erase(it);
+    return MC_DRV_OK;
+}
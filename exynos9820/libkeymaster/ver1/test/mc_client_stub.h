@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2020 TRUSTONIC LIMITED
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the TRUSTONIC LIMITED nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MC_CLIENT_STUB_H__
+#define __MC_CLIENT_STUB_H__
+
+#include <stdint.h>
+
+/**
+ * Host stand-in for libMcClient.
+ *
+ * It counts the calls reaching the driver and plays the Keymaster TA:
+ * every key is an EC key of MC_STUB_KEY_SIZE bits whose public key is the
+ * P-256 base point, begin() outputs a nonce of MC_STUB_NONCE_BYTE bytes,
+ * update() outputs the input XORed with MC_STUB_XOR_KEY and finish()
+ * outputs MC_STUB_FINISH_BYTE bytes.
+ */
+
+#define MC_STUB_KEY_SIZE     256
+#define MC_STUB_NONCE_LENGTH 12
+#define MC_STUB_NONCE_BYTE   0x3c
+#define MC_STUB_XOR_KEY      0x5a
+#define MC_STUB_FINISH_BYTE  0xa5
+
+struct mc_stub_stats {
+    uint32_t maps;          /**< mcMap() calls */
+    uint32_t unmaps;        /**< mcUnmap() calls */
+    uint32_t notifications; /**< mcNotify() calls */
+    uint32_t live_maps;     /**< buffers currently mapped */
+    uint32_t aad_bytes;     /**< associated data received by update() */
+};
+
+/** Reset the counters and the settings below. */
+void mc_stub_reset(void);
+void mc_stub_get_stats(struct mc_stub_stats *stats);
+/** Make mcMap() fail for buffers longer than len. */
+void mc_stub_set_map_limit(uint32_t len);
+/** Busy wait usec in each call switching to the secure world. */
+void mc_stub_set_switch_cost(uint32_t usec);
+/** Length of the output of finish(). */
+void mc_stub_set_finish_length(uint32_t len);
+
+#endif /* __MC_CLIENT_STUB_H__ */
@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2020 TRUSTONIC LIMITED
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the TRUSTONIC LIMITED nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <chrono>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+
+#include <hardware/keymaster_defs.h>
+#include "tlcTeeKeymasterM_if.h"
+#include "mc_client_stub.h"
+
+namespace {
+
+const uint8_t kKeyBlob[96] = { 0x4b, 0x4d };
+const uint8_t kNonce[12] = { 0x01, 0x02, 0x03 };
+
+class TeeStagingTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mc_stub_reset();
+    }
+
+    TEE_SessionHandle open() {
+        TEE_SessionHandle session = NULL;
+        EXPECT_EQ(0, TEE_Open(&session));
+        return session;
+    }
+
+    static mc_stub_stats stats() {
+        mc_stub_stats s;
+        mc_stub_get_stats(&s);
+        return s;
+    }
+};
+
+keymaster_error_t gcm_begin(TEE_SessionHandle session, keymaster_operation_handle_t *handle)
+{
+    keymaster_key_param_t params[5];
+    keymaster_key_blob_t key = { kKeyBlob, sizeof(kKeyBlob) };
+
+    params[0].tag = KM_TAG_PURPOSE;
+    params[0].enumerated = KM_PURPOSE_ENCRYPT;
+    params[1].tag = KM_TAG_ALGORITHM;
+    params[1].enumerated = KM_ALGORITHM_AES;
+    params[2].tag = KM_TAG_BLOCK_MODE;
+    params[2].enumerated = KM_MODE_GCM;
+    params[3].tag = KM_TAG_MAC_LENGTH;
+    params[3].integer = 128;
+    params[4].tag = KM_TAG_NONCE;
+    params[4].blob.data = kNonce;
+    params[4].blob.data_length = sizeof(kNonce);
+
+    keymaster_key_param_set_t param_set = { params, 5 };
+    return TEE_Begin(session, KM_PURPOSE_ENCRYPT, &key, &param_set, NULL, handle);
+}
+
+/* update() with aad_len bytes of associated data, checking the output */
+void gcm_update(TEE_SessionHandle session, keymaster_operation_handle_t handle,
+                size_t aad_len, size_t input_len)
+{
+    std::vector<uint8_t> aad(aad_len, 0x11);
+    std::vector<uint8_t> input(input_len);
+    keymaster_key_param_t param;
+    keymaster_key_param_set_t param_set = { &param, 1 };
+    keymaster_blob_t in = { input.data(), input.size() };
+    keymaster_blob_t out = { NULL, 0 };
+    size_t consumed = 0;
+
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = (uint8_t)(i * 7);
+    }
+    param.tag = KM_TAG_ASSOCIATED_DATA;
+    param.blob.data = aad.data();
+    param.blob.data_length = aad.size();
+
+    ASSERT_EQ(KM_ERROR_OK, TEE_Update(session, handle, aad_len ? &param_set : NULL,
+                                      &in, &consumed, NULL, &out));
+    EXPECT_EQ(input_len, consumed);
+    ASSERT_EQ(input_len, out.data_length);
+    for (size_t i = 0; i < input_len; i++) {
+        if (out.data[i] != (input[i] ^ MC_STUB_XOR_KEY)) {
+            ADD_FAILURE() << "output differs at " << i;
+            break;
+        }
+    }
+    free((void *)out.data);
+}
+
+void gcm_finish(TEE_SessionHandle session, keymaster_operation_handle_t handle,
+                size_t tag_len)
+{
+    keymaster_blob_t out = { NULL, 0 };
+
+    ASSERT_EQ(KM_ERROR_OK, TEE_Finish(session, handle, NULL, NULL, NULL, &out));
+    ASSERT_EQ(tag_len, out.data_length);
+    for (size_t i = 0; i < tag_len; i++) {
+        if (out.data[i] != MC_STUB_FINISH_BYTE) {
+            ADD_FAILURE() << "tag differs at " << i;
+            break;
+        }
+    }
+    free((void *)out.data);
+}
+
+void gcm_operation(TEE_SessionHandle session, size_t aad_len, size_t input_len, int updates)
+{
+    keymaster_operation_handle_t handle = 0;
+
+    ASSERT_EQ(KM_ERROR_OK, gcm_begin(session, &handle));
+    for (int i = 0; i < updates; i++) {
+        gcm_update(session, handle, i ? 0 : aad_len, input_len);
+    }
+    gcm_finish(session, handle, 16);
+}
+
+/* The outputs of the TA, not the zeroed buffers they were staged from */
+void expect_stub_characteristics(keymaster_key_characteristics_t *chars)
+{
+    ASSERT_NE(nullptr, chars);
+    ASSERT_EQ(2u, chars->hw_enforced.length);
+    EXPECT_EQ(KM_TAG_ALGORITHM, chars->hw_enforced.params[0].tag);
+    EXPECT_EQ(KM_ALGORITHM_EC, chars->hw_enforced.params[0].enumerated);
+    EXPECT_EQ(KM_TAG_KEY_SIZE, chars->hw_enforced.params[1].tag);
+    EXPECT_EQ((uint32_t)MC_STUB_KEY_SIZE, chars->hw_enforced.params[1].integer);
+    EXPECT_EQ(0u, chars->sw_enforced.length);
+    keymaster_free_characteristics(chars);
+    free(chars);
+}
+
+} // namespace
+
+TEST_F(TeeStagingTest, OperationUsesArenaOnly) {
+    TEE_SessionHandle session = open();
+    ASSERT_NE(nullptr, session);
+    EXPECT_EQ(1u, stats().maps);
+
+    gcm_operation(session, 64, 1000, 4);
+
+    /* Nothing but the arena mapped at TEE_Open() */
+    EXPECT_EQ(1u, stats().maps);
+    EXPECT_EQ(0u, stats().unmaps);
+    EXPECT_EQ(1u, stats().live_maps);
+    EXPECT_EQ(64u, stats().aad_bytes);
+
+    TEE_Close(session);
+    EXPECT_EQ(1u, stats().unmaps);
+    EXPECT_EQ(0u, stats().live_maps);
+}
+
+TEST_F(TeeStagingTest, ChunkedUpdateReusesArena) {
+    TEE_SessionHandle session = open();
+    ASSERT_NE(nullptr, session);
+
+    /* Several INPUT_CHUNK_SIZE chunks, AAD spilling over the first one */
+    gcm_operation(session, 20000, 100000, 1);
+    gcm_operation(session, 0, 300000, 2);
+
+    EXPECT_EQ(1u, stats().maps);
+    EXPECT_EQ(0u, stats().unmaps);
+    EXPECT_EQ(20000u, stats().aad_bytes);
+
+    TEE_Close(session);
+}
+
+TEST_F(TeeStagingTest, LargeBufferIsMapped) {
+    TEE_SessionHandle session = open();
+    ASSERT_NE(nullptr, session);
+    keymaster_operation_handle_t handle = 0;
+
+    mc_stub_set_finish_length(256 * 1024);
+    ASSERT_EQ(KM_ERROR_OK, gcm_begin(session, &handle));
+    gcm_update(session, handle, 16, 512);
+    gcm_finish(session, handle, 256 * 1024);
+
+    /* The finish() output does not fit in the arena */
+    EXPECT_EQ(2u, stats().maps);
+    EXPECT_EQ(1u, stats().unmaps);
+    EXPECT_EQ(1u, stats().live_maps);
+
+    TEE_Close(session);
+    EXPECT_EQ(0u, stats().live_maps);
+}
+
+TEST_F(TeeStagingTest, WorksWithoutArena) {
+    mc_stub_set_map_limit(32 * 1024);
+    TEE_SessionHandle session = open();
+    ASSERT_NE(nullptr, session);
+
+    gcm_operation(session, 64, 1000, 4);
+    gcm_operation(session, 20000, 100000, 1);
+
+    EXPECT_LT(1u, stats().maps);
+    EXPECT_EQ(stats().maps - 1, stats().unmaps);
+    EXPECT_EQ(0u, stats().live_maps);
+    EXPECT_EQ(20064u, stats().aad_bytes);
+
+    TEE_Close(session);
+}
+
+TEST_F(TeeStagingTest, GenerateKeyReturnsCharacteristics) {
+    TEE_SessionHandle session = open();
+    ASSERT_NE(nullptr, session);
+    keymaster_key_param_t params[3];
+    keymaster_key_param_set_t param_set = { params, 3 };
+    keymaster_key_blob_t key = { NULL, 0 };
+    keymaster_key_characteristics_t *chars = NULL;
+
+    params[0].tag = KM_TAG_ALGORITHM;
+    params[0].enumerated = KM_ALGORITHM_EC;
+    params[1].tag = KM_TAG_KEY_SIZE;
+    params[1].integer = MC_STUB_KEY_SIZE;
+    params[2].tag = KM_TAG_PURPOSE;
+    params[2].enumerated = KM_PURPOSE_SIGN;
+
+    ASSERT_EQ(KM_ERROR_OK, TEE_GenerateKey(session, &param_set, &key, &chars));
+    expect_stub_characteristics(chars);
+    free((void *)key.key_material);
+
+    chars = NULL;
+    ASSERT_EQ(KM_ERROR_OK, TEE_GetKeyCharacteristics(session, &key, NULL, NULL, &chars));
+    expect_stub_characteristics(chars);
+
+    EXPECT_EQ(1u, stats().maps);
+    TEE_Close(session);
+}
+
+TEST_F(TeeStagingTest, ImportKeyReturnsCharacteristics) {
+    TEE_SessionHandle session = open();
+    ASSERT_NE(nullptr, session);
+    const uint8_t raw[16] = { 0x6b };
+    keymaster_key_param_t params[3];
+    keymaster_key_param_set_t param_set = { params, 3 };
+    keymaster_blob_t key_data = { raw, sizeof(raw) };
+    keymaster_key_blob_t key = { NULL, 0 };
+    keymaster_key_characteristics_t *chars = NULL;
+
+    params[0].tag = KM_TAG_ALGORITHM;
+    params[0].enumerated = KM_ALGORITHM_AES;
+    params[1].tag = KM_TAG_KEY_SIZE;
+    params[1].integer = 128;
+    params[2].tag = KM_TAG_PURPOSE;
+    params[2].enumerated = KM_PURPOSE_ENCRYPT;
+
+    ASSERT_EQ(KM_ERROR_OK, TEE_ImportKey(session, &param_set, KM_KEY_FORMAT_RAW,
+                                         &key_data, &key, &chars));
+    expect_stub_characteristics(chars);
+    free((void *)key.key_material);
+
+    EXPECT_EQ(1u, stats().maps);
+    TEE_Close(session);
+}
+
+TEST_F(TeeStagingTest, ExportKeyEncodesPublicKey) {
+    TEE_SessionHandle session = open();
+    ASSERT_NE(nullptr, session);
+    keymaster_key_blob_t key = { kKeyBlob, sizeof(kKeyBlob) };
+    keymaster_blob_t export_data = { NULL, 0 };
+
+    ASSERT_EQ(KM_ERROR_OK, TEE_ExportKey(session, KM_KEY_FORMAT_X509, &key,
+                                         NULL, NULL, &export_data));
+    /* SubjectPublicKeyInfo of an uncompressed P-256 point */
+    EXPECT_EQ(91u, export_data.data_length);
+    free((void *)export_data.data);
+
+    EXPECT_EQ(1u, stats().maps);
+    TEE_Close(session);
+}
+
+TEST_F(TeeStagingTest, BeginReturnsOutParams) {
+    TEE_SessionHandle session = open();
+    ASSERT_NE(nullptr, session);
+    keymaster_key_param_t param;
+    keymaster_key_param_set_t param_set = { &param, 1 };
+    keymaster_key_param_set_t out_params = { NULL, 0 };
+    keymaster_key_blob_t key = { kKeyBlob, sizeof(kKeyBlob) };
+    keymaster_operation_handle_t handle = 0;
+
+    param.tag = KM_TAG_PURPOSE;
+    param.enumerated = KM_PURPOSE_ENCRYPT;
+    ASSERT_EQ(KM_ERROR_OK, TEE_Begin(session, KM_PURPOSE_ENCRYPT, &key, &param_set,
+                                     &out_params, &handle));
+    ASSERT_EQ(1u, out_params.length);
+    EXPECT_EQ(KM_TAG_NONCE, out_params.params[0].tag);
+    ASSERT_EQ((size_t)MC_STUB_NONCE_LENGTH, out_params.params[0].blob.data_length);
+    for (size_t i = 0; i < MC_STUB_NONCE_LENGTH; i++) {
+        EXPECT_EQ(MC_STUB_NONCE_BYTE, out_params.params[0].blob.data[i]);
+    }
+    keymaster_free_param_set(&out_params);
+    EXPECT_EQ(KM_ERROR_OK, TEE_Abort(session, handle));
+
+    TEE_Close(session);
+}
+
+TEST_F(TeeStagingTest, GcmUpdateLoopOverhead) {
+    const int kOperations = 200;
+    const uint32_t kSwitchCost = 20; /* us, per ioctl reaching the secure world */
+
+    for (bool arena : { false, true }) {
+        mc_stub_reset();
+        if (!arena) {
+            mc_stub_set_map_limit(32 * 1024);
+        }
+        TEE_SessionHandle session = open();
+        ASSERT_NE(nullptr, session);
+        mc_stub_set_switch_cost(kSwitchCost);
+
+        mc_stub_stats before = stats();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kOperations; i++) {
+            gcm_operation(session, 32, 1024, 4);
+        }
+        double us = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+        mc_stub_stats after = stats();
+
+        printf("%-9s: %7.1f us per begin/4x update(1KiB)/finish, "
+               "%5.1f mcMap + %5.1f mcUnmap, %4.1f notifications\n",
+               arena ? "arena" : "per-call", us / kOperations,
+               (double)(after.maps - before.maps) / kOperations,
+               (double)(after.unmaps - before.unmaps) / kOperations,
+               (double)(after.notifications - before.notifications) / kOperations);
+
+        if (arena) {
+            EXPECT_EQ(before.maps, after.maps);
+            EXPECT_EQ(before.unmaps, after.unmaps);
+        }
+        TEE_Close(session);
+    }
+}
@@ -55,6 +55,7 @@
 #include "MobiCoreDriverApi.h"  /* MC session */
 #include "sth2ProxyApi.h"
 #include "FSD2.h"
+#include "FSD2Storage.h"
 
 #define MAX_SECTOR_SIZE                 4096
 #define SECTOR_NUM                      200 // So DEFAULT_WORKSPACE_SIZE is 800k-ish
@@ -63,238 +64,6 @@
 
 extern const std::string& getTbStoragePath();
 
-/*----------------------------------------------------------------------------
- * Utilities functions
- *----------------------------------------------------------------------------*/
-
-/* There is no equivalent in the TEEC_ERROR_XXX list to indicate that the
- * storage is not available, so locally define the error here.
- */
-#define TEE_ERROR_STORAGE_NOT_AVAILABLE     ((TEEC_Result)0xF0100003)
-
-static TEEC_Result errno2serror() {
-    switch (errno) {
-        case EINVAL:
-            return TEEC_ERROR_BAD_PARAMETERS;
-        case ENOENT:
-            return TEEC_ERROR_ITEM_NOT_FOUND;
-        case ENOSPC:
-            return TEEC_ERROR_STORAGE_NO_SPACE;
-        case ENOMEM:
-            return TEEC_ERROR_OUT_OF_MEMORY;
-        case EBADF:
-        case EACCES:
-        default:
-            return TEE_ERROR_STORAGE_NOT_AVAILABLE;
-    }
-}
-
-class Partition {
-    std::string name_;
-    std::string dir_name_;
-    std::string base_name_;
-    bool        read_only_;
-    FILE*       fd_;
-    off_t       size_;
-    int reopenWrite() {
-        if (read_only_) {
-            if (!::freopen(name(), "r+b", fd_)) {
-                return -1;
-            }
-            read_only_ = false;
-        }
-        return 0;
-    }
-public:
-    Partition(std::string dirName, std::string baseName):
-            dir_name_(dirName), base_name_(baseName), read_only_(true),
-            fd_(NULL), size_(0) {
-        if (dir_name_.back() != '/') {
-            dir_name_.append("/");
-        }
-        name_ = dir_name_ + base_name_;
-    }
-    const char* name() const {
-        return name_.c_str();
-    }
-    off_t size() {
-        if (size_ == 0) {
-            struct stat st;
-            if (::stat(name(), &st)) {
-                return -1;
-            }
-            size_ = st.st_size;
-        }
-        return size_;
-    }
-    TEEC_Result create() {
-        LOG_I("%s: Create storage file \"%s\"", __func__, name());
-        // Create base directory storage directory if necessary, parent is assumed to exist
-        if (::mkdir(dir_name_.c_str(), 0700) && (errno != EEXIST)) {
-            LOG_ERRNO("creating storage folder");
-            return errno2serror();
-        }
-
-        fd_ = ::fopen(name(), "w+b");
-        if (!fd_) {
-            LOG_ERRNO("creating storage file");
-            return errno2serror();
-        }
-        read_only_ = false;
-        return TEEC_SUCCESS;
-    }
-    TEEC_Result destroy() {
-        if (!fd_) {
-            /* The partition is not open */
-            return TEEC_ERROR_BAD_STATE;
-        }
-
-        /* Try to erase the file */
-        if (::unlink(name())) {
-            /* File in use or OS didn't allow the operation */
-            return errno2serror();
-        }
-
-        return TEEC_SUCCESS;
-    }
-    TEEC_Result open() {
-        /* Open the file */
-        LOG_I("%s: Open storage file \"%s\"", __func__, name());
-        fd_ = ::fopen(name(), "rb");
-        if (!fd_) {
-            LOG_E("%s: %s opening storage file \"%s\"", __func__,
-                  strerror(errno), name());
-            return errno2serror();
-        }
-        read_only_ = true;
-        LOG_I("%s: storage file \"%s\" successfully open (size: %ld KB / %ld B))",
-              __func__, name(), size() / 1024, size());
-        return TEEC_SUCCESS;
-    }
-    TEEC_Result close() {
-        if (!fd_) {
-            /* The partition is not open */
-            return TEEC_ERROR_BAD_STATE;
-        }
-
-        ::fclose(fd_);
-        fd_ = NULL;
-
-        return TEEC_SUCCESS;
-    }
-    TEEC_Result read(uint8_t* buf, uint32_t length, uint32_t offset) {
-        if (!fd_) {
-            /* The partition is not open */
-            return TEEC_ERROR_BAD_STATE;
-        }
-
-        if (::fseek(fd_, offset, SEEK_SET)) {
-            LOG_E("%s: fseek error: %s", __func__, strerror(errno));
-            return errno2serror();
-        }
-
-        if (::fread(buf, length, 1, fd_) != 1) {
-            if (feof(fd_)) {
-                LOG_E("%s: fread error: End-Of-File detected", __func__);
-                return TEEC_ERROR_ITEM_NOT_FOUND;
-            }
-            LOG_E("%s: fread error: %s", __func__, strerror(errno));
-            return errno2serror();
-        }
-
-        return TEEC_SUCCESS;
-    }
-    TEEC_Result write(const uint8_t* buf, uint32_t length, uint32_t offset) {
-        if (!fd_) {
-            /* The partition is not open */
-            return TEEC_ERROR_BAD_STATE;
-        }
-
-        if (reopenWrite()) {
-            LOG_ERRNO("freopen");
-            return errno2serror();
-        }
-
-        if (::fseek(fd_, offset, SEEK_SET)) {
-            LOG_E("%s: fseek error: %s", __func__, strerror(errno));
-            return errno2serror();
-        }
-
-        if (::fwrite(buf, length, 1, fd_) != 1) {
-            LOG_E("%s: fwrite error: %s", __func__, strerror(errno));
-            return errno2serror();
-        }
-        return TEEC_SUCCESS;
-    }
-    TEEC_Result sync() {
-        if (!fd_) {
-            /* The partition is not open */
-            return TEEC_ERROR_BAD_STATE;
-        }
-
-        /*
-         * First make sure that the data in the stdio buffers is flushed to the
-         * file descriptor
-         */
-        if (::fflush(fd_)) {
-            return errno2serror();
-        }
-
-        /* Then synchronize the file descriptor with the file-system */
-        if (::fdatasync(fileno(fd_))) {
-            return errno2serror();
-        }
-
-        return TEEC_SUCCESS;
-    }
-    TEEC_Result resize(off_t new_size) {
-        if (!fd_) {
-            /* The partition is not open */
-            return TEEC_ERROR_BAD_STATE;
-        }
-
-        if (reopenWrite()) {
-            LOG_ERRNO("freopen");
-            return errno2serror();
-        }
-
-        if (new_size == size()) {
-            return TEEC_SUCCESS;
-        }
-
-        if (new_size > size()) {
-            /*
-             * Enlarge the partition file. Make sure we actually write some
-             * non-zero data into the new sectors. Otherwise, some file-system
-             * might not really reserve the storage space but use a sparse
-             * representation. In this case, a subsequent write instruction
-             * could fail due to out-of-space, which we want to avoid.
-             */
-            if (::fseek(fd_, 0, SEEK_END)) {
-                LOG_E("%s: fseek error: %s", __func__, strerror(errno));
-                return errno2serror();
-            }
-
-            off_t count = new_size - size();
-            while (count) {
-                if (::fputc(0xA5, fd_) != 0xA5) {
-                    LOG_E("%s: fputc error: %s", __func__, strerror(errno));
-                    return errno2serror();
-                }
-                count--;
-            }
-        } else {
-            /* Truncate the partition file */
-            if (::ftruncate(fileno(fd_), new_size)) {
-                return errno2serror();
-            }
-        }
-        // Update size
-        size_ = new_size;
-        return TEEC_SUCCESS;
-    }
-};
-
 union Dci {
       STH2_delegation_exchange_buffer_t exchange_buffer;
       struct {
@@ -314,9 +83,15 @@ struct FileSystem::Impl {
     /*
      * The 16 possible partitions
      */
-    Partition* partitions[16] = { nullptr };
+    Partition* partitions[FSD2_PARTITION_NUM] = { nullptr };
     bool valid = false;
 
+    /*
+     * Planner and executor of the instruction buffers, keeps its buffers
+     * from one command to the next
+     */
+    DelegationBatch batch;
+
     /*
      * Communication buffer, includes the workspace
      */
@@ -324,8 +99,8 @@ struct FileSystem::Impl {
 
 
     // thread value does not matter, only initialised for code checkers
-    Impl(const std::vector<std::string>& partition_paths) {
-        if (partition_paths.size() > 16) {
+    Impl(const std::vector<std::string>& partition_paths): batch(partitions) {
+        if (partition_paths.size() > FSD2_PARTITION_NUM) {
             LOG_E("The FileSystem does not support more than 16 partitions");
             return;
         }
@@ -353,7 +128,6 @@ struct FileSystem::Impl {
     }
     void run();
     int executeCommand();
-    const char* getCommandtypeString(uint32_t nInstructionID);
 };
 
 FileSystem::FileSystem(const std::vector<std::string>& partition_paths):
@@ -484,209 +258,14 @@ void FileSystem::Impl::run() {
     LOG_W("%s: Exiting Filesystem thread", __func__);
 }
 
-/*----------------------------------------------------------------------------
- * Instructions
- *----------------------------------------------------------------------------*/
-
 /*----------------------------------------------------------------------------
  * Command dispatcher function
  *----------------------------------------------------------------------------*/
-/* Debug function to show the command name */
-const char* FileSystem::Impl::getCommandtypeString(uint32_t nInstructionID) {
-    switch (nInstructionID&0x0F) {
-        case DELEGATION_INSTRUCTION_PARTITION_CREATE:
-            return "PARTITION_CREATE";
-        case DELEGATION_INSTRUCTION_PARTITION_OPEN:
-            return "PARTITION_OPEN";
-        case DELEGATION_INSTRUCTION_PARTITION_READ:
-            return "PARTITION_READ";
-        case DELEGATION_INSTRUCTION_PARTITION_WRITE:
-            return "PARTITION_WRITE";
-        case DELEGATION_INSTRUCTION_PARTITION_SET_SIZE:
-            return "PARTITION_SET_SIZE";
-        case DELEGATION_INSTRUCTION_PARTITION_SYNC:
-            return "PARTITION_SYNC";
-        case DELEGATION_INSTRUCTION_PARTITION_CLOSE:
-            return "PARTITION_CLOSE";
-        case DELEGATION_INSTRUCTION_PARTITION_DESTROY:
-            return "PARTITION_DESTROY";
-        default:
-            return "UNKNOWN";
-    }
-}
-
 int FileSystem::Impl::executeCommand() {
-    TEEC_Result    nError;
-    uint32_t       nInstructionsIndex;
-    uint32_t       nInstructionsBufferSize =
-        dci.exchange_buffer.nInstructionsBufferSize;
-
-
-    LOG_D("%s: nInstructionsBufferSize=%d", __func__, nInstructionsBufferSize);
-
-    /* Reset the operation results */
-    nError = TEEC_SUCCESS;
-    dci.exchange_buffer.sAdministrativeData.nSyncExecuted = 0;
-    ::memset(dci.exchange_buffer.sAdministrativeData.nPartitionErrorStates, 0,
-             sizeof(dci.exchange_buffer.sAdministrativeData.nPartitionErrorStates));
-    ::memset(dci.exchange_buffer.sAdministrativeData.nPartitionOpenSizes, 0,
-             sizeof(dci.exchange_buffer.sAdministrativeData.nPartitionOpenSizes));
-
-    /* Execute the instructions */
-    nInstructionsIndex = 0;
-    while (true) {
-        DELEGATION_INSTRUCTION* pInstruction;
-        uint32_t nInstructionID;
-        pInstruction = (DELEGATION_INSTRUCTION*)(
-                           &dci.exchange_buffer.sInstructions[nInstructionsIndex/4]);
-        if (nInstructionsIndex + 4 > nInstructionsBufferSize) {
-            LOG_D("%s: Instruction buffer end, size = %i", __func__,
-                  nInstructionsBufferSize);
-            return 0;
-        }
-
-        nInstructionID = pInstruction->sGeneric.nInstructionID;
-        nInstructionsIndex += 4;
-
-        LOG_D("%s: nInstructionID=0x%02X [%s], nInstructionsIndex=%d", __func__,
-              nInstructionID, getCommandtypeString(nInstructionID), nInstructionsIndex);
-
-        /* Partition-specific instruction */
-        uint32_t nPartitionID = (nInstructionID & 0xF0) >> 4;
-        Partition* partition = partitions[nPartitionID];
-        if (dci.exchange_buffer.sAdministrativeData.nPartitionErrorStates[nPartitionID]
-                == TEEC_SUCCESS) {
-            /* Execute the instruction only if there is currently no error on the partition */
-            switch (nInstructionID & 0x0F) {
-                case DELEGATION_INSTRUCTION_PARTITION_CREATE: {
-                    nError = partition->create();
-                    LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d err=0x%08X", __func__,
-                          (nInstructionID & 0x0F), nPartitionID, nError);
-                    break;
-                }
-                case DELEGATION_INSTRUCTION_PARTITION_OPEN: {
-                    nError = partition->open();
-                    LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d pSize=%ld err=0x%08X", __func__,
-                          (nInstructionID & 0x0F), nPartitionID, partition->size() / sector_size,
-                          nError);
-                    if (nError == TEEC_SUCCESS) {
-                        dci.exchange_buffer.sAdministrativeData.nPartitionOpenSizes[nPartitionID] =
-                            static_cast<unsigned int>(partition->size() / sector_size);
-                    }
-                    break;
-                }
-                case DELEGATION_INSTRUCTION_PARTITION_READ: {
-                    /* Parse parameters */
-                    uint32_t nSectorID;
-                    uint32_t nWorkspaceOffset;
-                    if (nInstructionsIndex + 8 > nInstructionsBufferSize) {
-                        return 0;
-                    }
-
-                    nSectorID = pInstruction->sReadWrite.nSectorID;
-                    nWorkspaceOffset = pInstruction->sReadWrite.nWorkspaceOffset;
-                    nInstructionsIndex += 8;
-                    LOG_D("%s: >Partition %1X: read sector 0x%08X into workspace at offset 0x%08X",
-                          __func__, nPartitionID, nSectorID, nWorkspaceOffset);
-                    nError = partition->read(dci.exchange_buffer.sWorkspace + nWorkspaceOffset,
-                                             sector_size, nSectorID * sector_size);
-                    LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d sid=%d woff=%d err=0x%08X", __func__,
-                          (nInstructionID & 0x0F), nPartitionID, nSectorID, nWorkspaceOffset, nError);
-                    break;
-                }
-                case DELEGATION_INSTRUCTION_PARTITION_WRITE: {
-                    /* Parse parameters */
-                    uint32_t nSectorID;
-                    uint32_t nWorkspaceOffset;
-                    if (nInstructionsIndex + 8 > nInstructionsBufferSize) {
-                        return 0;
-                    }
-
-                    nSectorID = pInstruction->sReadWrite.nSectorID;
-                    nWorkspaceOffset = pInstruction->sReadWrite.nWorkspaceOffset;
-                    nInstructionsIndex += 8;
-                    LOG_D("%s: >Partition %1X: write sector 0x%X from workspace at offset 0x%X",
-                          __func__, nPartitionID, nSectorID, nWorkspaceOffset);
-                    nError = partition->write(dci.exchange_buffer.sWorkspace + nWorkspaceOffset,
-                                              sector_size, nSectorID * sector_size);
-                    LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d sid=%d woff=%d err=0x%08X", __func__,
-                          (nInstructionID & 0x0F), nPartitionID, nSectorID, nWorkspaceOffset, nError);
-                    break;
-                }
-                case DELEGATION_INSTRUCTION_PARTITION_SYNC: {
-                    nError = partition->sync();
-                    LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d err=0x%08X", __func__,
-                          (nInstructionID & 0x0F), nPartitionID, nError);
-                    if (nError == TEEC_SUCCESS) {
-                        dci.exchange_buffer.sAdministrativeData.nSyncExecuted++;
-                    }
-                    break;
-                }
-                case DELEGATION_INSTRUCTION_PARTITION_SET_SIZE: {
-                    // nNewSize is a number of sectors
-                    uint32_t nNewSize;
-                    if (nInstructionsIndex + 4 > nInstructionsBufferSize) {
-                        return 0;
-                    }
-
-                    nNewSize = pInstruction->sSetSize.nNewSize;
-                    nInstructionsIndex += 4;
-                    nError = partition->resize(nNewSize * sector_size);
-                    LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d nNewSize=%d err=0x%08X", __func__,
-                          (nInstructionID & 0x0F), nPartitionID, nNewSize, nError);
-                    break;
-                }
-                case DELEGATION_INSTRUCTION_PARTITION_CLOSE: {
-                    nError = partition->close();
-                    LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d err=0x%08X", __func__,
-                          (nInstructionID & 0x0F), nPartitionID, nError);
-                    break;
-                }
-                case DELEGATION_INSTRUCTION_PARTITION_DESTROY: {
-                    nError = partition->destroy();
-                    LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d err=0x%08X", __func__,
-                          (nInstructionID & 0x0F), nPartitionID, nError);
-                    break;
-                }
-                default: {
-                    LOG_E("%s: Unknown instruction identifier: %02X", __func__, nInstructionID);
-                    nError = TEEC_ERROR_BAD_PARAMETERS;
-                    break;
-                }
-            }
-            dci.exchange_buffer.sAdministrativeData.nPartitionErrorStates[nPartitionID] =
-                nError;
-        } else {
-            /* Skip the instruction if there is currently error on the partition */
-            switch (nInstructionID & 0x0F) {
-                case DELEGATION_INSTRUCTION_PARTITION_CREATE:
-                case DELEGATION_INSTRUCTION_PARTITION_OPEN:
-                case DELEGATION_INSTRUCTION_PARTITION_SYNC:
-                case DELEGATION_INSTRUCTION_PARTITION_CLOSE:
-                case DELEGATION_INSTRUCTION_PARTITION_DESTROY:
-                    break;
-                case DELEGATION_INSTRUCTION_PARTITION_READ:
-                case DELEGATION_INSTRUCTION_PARTITION_WRITE: {
-                    if (nInstructionsIndex + 8 > nInstructionsBufferSize) {
-                        return 0;
-                    }
-                    nInstructionsIndex += 8;
-                    break;
-                }
-                case DELEGATION_INSTRUCTION_PARTITION_SET_SIZE: {
-                    if (nInstructionsIndex + 4 > nInstructionsBufferSize) {
-                        return 0;
-                    }
-                    nInstructionsIndex += 4;
-                    break;
-                }
-                default: {
-                    LOG_E("%s: Unknown instruction identifier: %02X", __func__, nInstructionID);
-                    /* OMS: update partition error with BAD PARAM ? */
-                    break;
-                }
-            }
-        }
-    }
+    /*
+     * The sector reads and writes are coalesced and only made durable by the
+     * sync instructions, see DelegationBatch
+     */
+    batch.execute(&dci.exchange_buffer, sector_size);
     return 0;
 }
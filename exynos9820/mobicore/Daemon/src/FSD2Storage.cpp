@@ -0,0 +1,558 @@
+/*
+ * Copyright (c) 2013-2017 TRUSTONIC LIMITED
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the TRUSTONIC LIMITED nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Filesystem v2 storage.
+ *
+ * Plans and executes the storage instructions received from STH
+ */
+
+#include <algorithm>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "dynamic_log.h"
+
+#include "FSD2Storage.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX                         1024
+#endif
+
+/*----------------------------------------------------------------------------
+ * Utilities functions
+ *----------------------------------------------------------------------------*/
+
+/* There is no equivalent in the TEEC_ERROR_XXX list to indicate that the
+ * storage is not available, so locally define the error here.
+ */
+#define TEE_ERROR_STORAGE_NOT_AVAILABLE     ((TEEC_Result)0xF0100003)
+
+static TEEC_Result errno2serror() {
+    switch (errno) {
+        case EINVAL:
+            return TEEC_ERROR_BAD_PARAMETERS;
+        case ENOENT:
+            return TEEC_ERROR_ITEM_NOT_FOUND;
+        case ENOSPC:
+            return TEEC_ERROR_STORAGE_NO_SPACE;
+        case ENOMEM:
+            return TEEC_ERROR_OUT_OF_MEMORY;
+        case EBADF:
+        case EACCES:
+        default:
+            return TEE_ERROR_STORAGE_NOT_AVAILABLE;
+    }
+}
+
+/*----------------------------------------------------------------------------
+ * Partition
+ *----------------------------------------------------------------------------*/
+
+Partition::Partition(std::string dirName, std::string baseName):
+        dir_name_(dirName), base_name_(baseName), read_only_(true),
+        fd_(-1), size_(0), io_calls_(0) {
+    if (dir_name_.back() != '/') {
+        dir_name_.append("/");
+    }
+    name_ = dir_name_ + base_name_;
+}
+
+Partition::~Partition() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+int Partition::reopenWrite() {
+    if (read_only_) {
+        int fd = ::open(name(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            return -1;
+        }
+        ::close(fd_);
+        fd_ = fd;
+        read_only_ = false;
+    }
+    return 0;
+}
+
+off_t Partition::size() {
+    if (size_ == 0) {
+        struct stat st;
+        if (::stat(name(), &st)) {
+            return -1;
+        }
+        size_ = st.st_size;
+    }
+    return size_;
+}
+
+TEEC_Result Partition::create() {
+    LOG_I("%s: Create storage file \"%s\"", __func__, name());
+    // Create base directory storage directory if necessary, parent is assumed to exist
+    if (::mkdir(dir_name_.c_str(), 0700) && (errno != EEXIST)) {
+        LOG_ERRNO("creating storage folder");
+        return errno2serror();
+    }
+
+    fd_ = ::open(name(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd_ < 0) {
+        LOG_ERRNO("creating storage file");
+        return errno2serror();
+    }
+    read_only_ = false;
+    return TEEC_SUCCESS;
+}
+
+TEEC_Result Partition::destroy() {
+    if (fd_ < 0) {
+        /* The partition is not open */
+        return TEEC_ERROR_BAD_STATE;
+    }
+
+    /* Try to erase the file */
+    if (::unlink(name())) {
+        /* File in use or OS didn't allow the operation */
+        return errno2serror();
+    }
+
+    return TEEC_SUCCESS;
+}
+
+TEEC_Result Partition::open() {
+    /* Open the file */
+    LOG_I("%s: Open storage file \"%s\"", __func__, name());
+    fd_ = ::open(name(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        LOG_E("%s: %s opening storage file \"%s\"", __func__,
+              strerror(errno), name());
+        return errno2serror();
+    }
+    read_only_ = true;
+    LOG_I("%s: storage file \"%s\" successfully open (size: %ld KB / %ld B))",
+          __func__, name(), size() / 1024, size());
+    return TEEC_SUCCESS;
+}
+
+TEEC_Result Partition::close() {
+    if (fd_ < 0) {
+        /* The partition is not open */
+        return TEEC_ERROR_BAD_STATE;
+    }
+
+    ::close(fd_);
+    fd_ = -1;
+
+    return TEEC_SUCCESS;
+}
+
+TEEC_Result Partition::transfer(bool write, const struct iovec* iov, int count,
+                                off_t offset, int* done) {
+    const size_t sector_size = iov[0].iov_len;
+    ssize_t len;
+
+    if (write) {
+        len = TEMP_FAILURE_RETRY(::pwritev(fd_, iov, count, offset));
+    } else {
+        len = TEMP_FAILURE_RETRY(::preadv(fd_, iov, count, offset));
+    }
+    io_calls_++;
+
+    if (len == static_cast<ssize_t>(count * sector_size)) {
+        *done = count;
+        return TEEC_SUCCESS;
+    }
+
+    /*
+     * Short transfer or error: go on sector by sector, so that the error
+     * returned is the one of the first sector which cannot be transferred.
+     */
+    *done = (len > 0) ? static_cast<int>(len / sector_size) : 0;
+    for (; *done < count; (*done)++) {
+        uint8_t* buf = static_cast<uint8_t*>(iov[*done].iov_base);
+        off_t sector_offset = offset + static_cast<off_t>(*done) * sector_size;
+        size_t pos = 0;
+
+        while (pos < sector_size) {
+            if (write) {
+                len = TEMP_FAILURE_RETRY(::pwrite(fd_, buf + pos, sector_size - pos,
+                                                  sector_offset + pos));
+            } else {
+                len = TEMP_FAILURE_RETRY(::pread(fd_, buf + pos, sector_size - pos,
+                                                 sector_offset + pos));
+            }
+            io_calls_++;
+
+            if (len < 0) {
+                LOG_E("%s: %s error: %s", __func__, write ? "pwrite" : "pread",
+                      strerror(errno));
+                return errno2serror();
+            }
+            if (len == 0) {
+                if (write) {
+                    LOG_E("%s: pwrite error: nothing written", __func__);
+                    return TEEC_ERROR_STORAGE_NO_SPACE;
+                }
+                LOG_E("%s: pread error: End-Of-File detected", __func__);
+                return TEEC_ERROR_ITEM_NOT_FOUND;
+            }
+            pos += len;
+        }
+    }
+
+    return TEEC_SUCCESS;
+}
+
+TEEC_Result Partition::read(const struct iovec* iov, int count, off_t offset, int* done) {
+    *done = 0;
+    if (fd_ < 0) {
+        /* The partition is not open */
+        return TEEC_ERROR_BAD_STATE;
+    }
+
+    return transfer(false, iov, count, offset, done);
+}
+
+TEEC_Result Partition::write(const struct iovec* iov, int count, off_t offset, int* done) {
+    *done = 0;
+    if (fd_ < 0) {
+        /* The partition is not open */
+        return TEEC_ERROR_BAD_STATE;
+    }
+
+    if (reopenWrite()) {
+        LOG_ERRNO("reopen");
+        return errno2serror();
+    }
+
+    return transfer(true, iov, count, offset, done);
+}
+
+TEEC_Result Partition::sync() {
+    if (fd_ < 0) {
+        /* The partition is not open */
+        return TEEC_ERROR_BAD_STATE;
+    }
+
+    /*
+     * Nothing is buffered in user space, the writes only need to be
+     * synchronized with the file-system
+     */
+    io_calls_++;
+    if (::fdatasync(fd_)) {
+        return errno2serror();
+    }
+
+    return TEEC_SUCCESS;
+}
+
+TEEC_Result Partition::resize(off_t new_size) {
+    if (fd_ < 0) {
+        /* The partition is not open */
+        return TEEC_ERROR_BAD_STATE;
+    }
+
+    if (reopenWrite()) {
+        LOG_ERRNO("reopen");
+        return errno2serror();
+    }
+
+    if (new_size == size()) {
+        return TEEC_SUCCESS;
+    }
+
+    if (new_size > size()) {
+        /*
+         * Enlarge the partition file. Make sure we actually write some
+         * non-zero data into the new sectors. Otherwise, some file-system
+         * might not really reserve the storage space but use a sparse
+         * representation. In this case, a subsequent write instruction
+         * could fail due to out-of-space, which we want to avoid.
+         */
+        off_t offset = ::lseek(fd_, 0, SEEK_END);
+        if (offset < 0) {
+            LOG_E("%s: lseek error: %s", __func__, strerror(errno));
+            return errno2serror();
+        }
+
+        uint8_t pattern[4096];
+        ::memset(pattern, 0xA5, sizeof(pattern));
+        off_t count = new_size - size();
+        while (count) {
+            size_t length = static_cast<size_t>(
+                                std::min(count, static_cast<off_t>(sizeof(pattern))));
+            ssize_t len = TEMP_FAILURE_RETRY(::pwrite(fd_, pattern, length, offset));
+            if (len <= 0) {
+                LOG_E("%s: pwrite error: %s", __func__, len ? strerror(errno) : "nothing written");
+                return len ? errno2serror() : TEEC_ERROR_STORAGE_NO_SPACE;
+            }
+            offset += len;
+            count -= len;
+        }
+    } else {
+        /* Truncate the partition file */
+        if (::ftruncate(fd_, new_size)) {
+            return errno2serror();
+        }
+    }
+    // Update size
+    size_ = new_size;
+    return TEEC_SUCCESS;
+}
+
+/*----------------------------------------------------------------------------
+ * Instructions
+ *----------------------------------------------------------------------------*/
+
+/* Debug function to show the command name */
+const char* DelegationBatch::getCommandtypeString(uint32_t nInstructionID) {
+    switch (nInstructionID&0x0F) {
+        case DELEGATION_INSTRUCTION_PARTITION_CREATE:
+            return "PARTITION_CREATE";
+        case DELEGATION_INSTRUCTION_PARTITION_OPEN:
+            return "PARTITION_OPEN";
+        case DELEGATION_INSTRUCTION_PARTITION_READ:
+            return "PARTITION_READ";
+        case DELEGATION_INSTRUCTION_PARTITION_WRITE:
+            return "PARTITION_WRITE";
+        case DELEGATION_INSTRUCTION_PARTITION_SET_SIZE:
+            return "PARTITION_SET_SIZE";
+        case DELEGATION_INSTRUCTION_PARTITION_SYNC:
+            return "PARTITION_SYNC";
+        case DELEGATION_INSTRUCTION_PARTITION_CLOSE:
+            return "PARTITION_CLOSE";
+        case DELEGATION_INSTRUCTION_PARTITION_DESTROY:
+            return "PARTITION_DESTROY";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+/*
+ * Parse the whole instruction buffer. A truncated instruction ends the
+ * buffer, as it did when the instructions were executed while parsed.
+ */
+void DelegationBatch::plan(STH2_delegation_exchange_buffer_t* exchange_buffer,
+                           uint32_t sector_size) {
+    uint32_t nInstructionsIndex = 0;
+    uint32_t nInstructionsBufferSize = exchange_buffer->nInstructionsBufferSize;
+
+    operations_.clear();
+    iovs_.clear();
+
+    while (nInstructionsIndex + 4 <= nInstructionsBufferSize) {
+        DELEGATION_INSTRUCTION* pInstruction = (DELEGATION_INSTRUCTION*)(
+                &exchange_buffer->sInstructions[nInstructionsIndex/4]);
+        Operation operation = {};
+
+        operation.instruction_id = pInstruction->sGeneric.nInstructionID;
+        nInstructionsIndex += 4;
+
+        switch (operation.instruction_id & 0x0F) {
+            case DELEGATION_INSTRUCTION_PARTITION_READ:
+            case DELEGATION_INSTRUCTION_PARTITION_WRITE: {
+                if (nInstructionsIndex + 8 > nInstructionsBufferSize) {
+                    return;
+                }
+
+                uint32_t nSectorID = pInstruction->sReadWrite.nSectorID;
+                struct iovec iov;
+                iov.iov_base = exchange_buffer->sWorkspace + pInstruction->sReadWrite.nWorkspaceOffset;
+                iov.iov_len = sector_size;
+                nInstructionsIndex += 8;
+                stats_.instructions++;
+
+                /* Extend the previous run if this is its next sector */
+                if (!operations_.empty()) {
+                    Operation& last = operations_.back();
+                    if ((last.instruction_id == operation.instruction_id) &&
+                            (last.sector_id + last.iov_count == nSectorID) && (nSectorID != 0) &&
+                            (last.iov_count < IOV_MAX)) {
+                        iovs_.push_back(iov);
+                        last.iov_count++;
+                        continue;
+                    }
+                }
+
+                operation.sector_id = nSectorID;
+                operation.iov_index = static_cast<uint32_t>(iovs_.size());
+                operation.iov_count = 1;
+                iovs_.push_back(iov);
+                break;
+            }
+            case DELEGATION_INSTRUCTION_PARTITION_SET_SIZE: {
+                if (nInstructionsIndex + 4 > nInstructionsBufferSize) {
+                    return;
+                }
+
+                operation.new_size = pInstruction->sSetSize.nNewSize;
+                nInstructionsIndex += 4;
+                stats_.instructions++;
+                break;
+            }
+            default:
+                stats_.instructions++;
+                break;
+        }
+        operations_.push_back(operation);
+    }
+}
+
+void DelegationBatch::execute(STH2_delegation_exchange_buffer_t* exchange_buffer,
+                              uint32_t sector_size) {
+    DELEGATION_ADMINISTRATIVE_DATA& admin = exchange_buffer->sAdministrativeData;
+    uint64_t io_calls = 0;
+
+    LOG_D("%s: nInstructionsBufferSize=%d", __func__,
+          exchange_buffer->nInstructionsBufferSize);
+
+    /* Reset the operation results */
+    admin.nSyncExecuted = 0;
+    ::memset(admin.nPartitionErrorStates, 0, sizeof(admin.nPartitionErrorStates));
+    ::memset(admin.nPartitionOpenSizes, 0, sizeof(admin.nPartitionOpenSizes));
+
+    ::memset(&stats_, 0, sizeof(stats_));
+    for (int i = 0; i < FSD2_PARTITION_NUM; i++) {
+        if (partitions_[i]) {
+            io_calls -= partitions_[i]->ioCalls();
+        }
+    }
+
+    plan(exchange_buffer, sector_size);
+
+    /* Execute the instructions */
+    for (size_t i = 0; i < operations_.size(); i++) {
+        const Operation& operation = operations_[i];
+        uint32_t nInstructionID = operation.instruction_id;
+        TEEC_Result nError;
+
+        LOG_D("%s: nInstructionID=0x%02X [%s]", __func__,
+              nInstructionID, getCommandtypeString(nInstructionID));
+
+        /* Partition-specific instruction */
+        uint32_t nPartitionID = (nInstructionID & 0xF0) >> 4;
+        Partition* partition = partitions_[nPartitionID];
+        if (admin.nPartitionErrorStates[nPartitionID] != TEEC_SUCCESS) {
+            /* Skip the instruction if there is currently error on the partition */
+            if ((nInstructionID & 0x0F) == 0 ||
+                    (nInstructionID & 0x0F) > DELEGATION_INSTRUCTION_PARTITION_DESTROY) {
+                LOG_E("%s: Unknown instruction identifier: %02X", __func__, nInstructionID);
+                /* OMS: update partition error with BAD PARAM ? */
+            }
+            continue;
+        }
+
+        /* Execute the instruction only if there is currently no error on the partition */
+        switch (nInstructionID & 0x0F) {
+            case DELEGATION_INSTRUCTION_PARTITION_CREATE: {
+                nError = partition->create();
+                LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d err=0x%08X", __func__,
+                      (nInstructionID & 0x0F), nPartitionID, nError);
+                break;
+            }
+            case DELEGATION_INSTRUCTION_PARTITION_OPEN: {
+                nError = partition->open();
+                LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d pSize=%ld err=0x%08X", __func__,
+                      (nInstructionID & 0x0F), nPartitionID, partition->size() / sector_size,
+                      nError);
+                if (nError == TEEC_SUCCESS) {
+                    admin.nPartitionOpenSizes[nPartitionID] =
+                        static_cast<unsigned int>(partition->size() / sector_size);
+                }
+                break;
+            }
+            case DELEGATION_INSTRUCTION_PARTITION_READ:
+            case DELEGATION_INSTRUCTION_PARTITION_WRITE: {
+                off_t offset = static_cast<off_t>(operation.sector_id) * sector_size;
+                const struct iovec* iov = &iovs_[operation.iov_index];
+                int done;
+                if ((nInstructionID & 0x0F) == DELEGATION_INSTRUCTION_PARTITION_READ) {
+                    nError = partition->read(iov, operation.iov_count, offset, &done);
+                } else {
+                    nError = partition->write(iov, operation.iov_count, offset, &done);
+                }
+                stats_.sectors += done;
+                LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d sid=%d count=%d done=%d err=0x%08X",
+                      __func__, (nInstructionID & 0x0F), nPartitionID, operation.sector_id,
+                      operation.iov_count, done, nError);
+                break;
+            }
+            case DELEGATION_INSTRUCTION_PARTITION_SYNC: {
+                nError = partition->sync();
+                LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d err=0x%08X", __func__,
+                      (nInstructionID & 0x0F), nPartitionID, nError);
+                if (nError == TEEC_SUCCESS) {
+                    admin.nSyncExecuted++;
+                }
+                break;
+            }
+            case DELEGATION_INSTRUCTION_PARTITION_SET_SIZE: {
+                // nNewSize is a number of sectors
+                nError = partition->resize(static_cast<off_t>(operation.new_size) * sector_size);
+                LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d nNewSize=%d err=0x%08X", __func__,
+                      (nInstructionID & 0x0F), nPartitionID, operation.new_size, nError);
+                break;
+            }
+            case DELEGATION_INSTRUCTION_PARTITION_CLOSE: {
+                nError = partition->close();
+                LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d err=0x%08X", __func__,
+                      (nInstructionID & 0x0F), nPartitionID, nError);
+                break;
+            }
+            case DELEGATION_INSTRUCTION_PARTITION_DESTROY: {
+                nError = partition->destroy();
+                LOG_D("%s: INSTRUCTION: ID=0x%x pid=%d err=0x%08X", __func__,
+                      (nInstructionID & 0x0F), nPartitionID, nError);
+                break;
+            }
+            default: {
+                LOG_E("%s: Unknown instruction identifier: %02X", __func__, nInstructionID);
+                nError = TEEC_ERROR_BAD_PARAMETERS;
+                break;
+            }
+        }
+        admin.nPartitionErrorStates[nPartitionID] = nError;
+    }
+
+    for (int i = 0; i < FSD2_PARTITION_NUM; i++) {
+        if (partitions_[i]) {
+            io_calls += partitions_[i]->ioCalls();
+        }
+    }
+    stats_.io_calls = static_cast<uint32_t>(io_calls);
+    LOG_D("%s: %u instructions, %u sectors transferred in %u I/O calls", __func__,
+          stats_.instructions, stats_.sectors, stats_.io_calls);
+}
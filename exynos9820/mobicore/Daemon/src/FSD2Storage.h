@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2013-2017 TRUSTONIC LIMITED
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the TRUSTONIC LIMITED nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FSD2_STORAGE_H_
+#define FSD2_STORAGE_H_
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "tee_client_api.h"     /* TEEC_Result */
+#include "sth2ProxyApi.h"
+
+#define FSD2_PARTITION_NUM              16
+
+/**
+ * One storage file, accessed through a raw file descriptor.
+ *
+ * Sector data is transferred with positional vectored calls, so a run of
+ * adjacent sectors costs a single system call and nothing is buffered in
+ * user space: the data only has to reach the disk on sync().
+ */
+class Partition {
+    std::string name_;
+    std::string dir_name_;
+    std::string base_name_;
+    bool        read_only_;
+    int         fd_;
+    off_t       size_;
+    uint64_t    io_calls_;
+    int reopenWrite();
+    TEEC_Result transfer(bool write, const struct iovec* iov, int count,
+                         off_t offset, int* done);
+public:
+    Partition(std::string dirName, std::string baseName);
+    ~Partition();
+    const char* name() const {
+        return name_.c_str();
+    }
+    off_t size();
+    /**
+     * Number of system calls issued to transfer or synchronize data so far.
+     */
+    uint64_t ioCalls() const {
+        return io_calls_;
+    }
+    TEEC_Result create();
+    TEEC_Result destroy();
+    TEEC_Result open();
+    TEEC_Result close();
+    /**
+     * Read/write count sectors starting at offset, one iovec per sector, all
+     * of the same length. On failure, done is the number of leading sectors
+     * which were transferred completely and the error is the one of the next.
+     */
+    TEEC_Result read(const struct iovec* iov, int count, off_t offset, int* done);
+    TEEC_Result write(const struct iovec* iov, int count, off_t offset, int* done);
+    TEEC_Result sync();
+    TEEC_Result resize(off_t new_size);
+};
+
+/**
+ * Executes the instruction buffers of the service delegation exchange buffer.
+ *
+ * The whole buffer is parsed first, and consecutive instructions reading (or
+ * writing) consecutive sectors of the same partition are merged into one
+ * run. The runs are then executed in order, with the same result as the
+ * instruction by instruction execution: once an instruction fails on a
+ * partition, the following ones on that partition are skipped.
+ */
+class DelegationBatch {
+public:
+    struct Stats {
+        uint32_t instructions;
+        uint32_t sectors;
+        uint32_t io_calls;
+    };
+
+    DelegationBatch(Partition* const* partitions): partitions_(partitions) {
+        ::memset(&stats_, 0, sizeof(stats_));
+    }
+    void execute(STH2_delegation_exchange_buffer_t* exchange_buffer, uint32_t sector_size);
+    /**
+     * Figures of the last execute(), for debug and benchmarking.
+     */
+    const Stats& stats() const {
+        return stats_;
+    }
+    static const char* getCommandtypeString(uint32_t nInstructionID);
+
+private:
+    struct Operation {
+        uint32_t instruction_id;
+        uint32_t sector_id;     /* READ/WRITE: first sector of the run */
+        uint32_t new_size;      /* SET_SIZE */
+        uint32_t iov_index;     /* READ/WRITE: run in iovs_ */
+        uint32_t iov_count;
+    };
+
+    void plan(STH2_delegation_exchange_buffer_t* exchange_buffer, uint32_t sector_size);
+
+    Partition* const* partitions_;
+    std::vector<Operation> operations_;
+    std::vector<struct iovec> iovs_;
+    Stats stats_;
+};
+
+#endif /* FSD2_STORAGE_H_ */
@@ -55,6 +55,7 @@
 #include "mcVersionHelper.h"
 
 #include "PrivateRegistry.h"
+#include "RegistryIndex.h"
 
 #include <tee_client_api.h>
 #include "uuid_attestation.h"
@@ -74,16 +75,14 @@
 #define SP_CONT_FILE_EXT ".spcont"
 #define TL_CONT_FILE_EXT ".tlcont"
 #define DATA_CONT_FILE_EXT ".datacont"
-#define TL_BIN_FILE_EXT ".tlbin"
-#define GP_TA_BIN_FILE_EXT ".tabin"
-#define GP_TA_SPID_FILE_EXT ".spid"
 
 static std::vector<std::string> search_paths;
 static std::string tb_storage_path;
+static RegistryIndex registry_index;
 
 //------------------------------------------------------------------------------
 static std::string byteArrayToString(const void* bytes, size_t elems) {
-    auto cbytes = static_cast<const char*>(bytes);
+    auto cbytes = static_cast<const unsigned char*>(bytes);
     char hx[elems * 2 + 1];
 
     for (size_t i = 0; i < elems; i++) {
@@ -204,6 +203,7 @@ static std::string getTASpidFilePath(const mcUuid_t* uuid, int registry) {
 void setSearchPaths(const std::vector<std::string>& paths) {
     search_paths = paths;
     tb_storage_path = search_paths[0] + "/TbStorage";
+    registry_index.setPaths(search_paths);
 }
 
 static inline bool isAllZeros(const unsigned char* so, uint32_t size) {
@@ -939,117 +939,26 @@ mcResult_t mcRegistryReadData(uint32_t context, const mcCid_t* cid, mcPid_t,
 
 
 //------------------------------------------------------------------------------
-static uint32_t getFileContent(
-    const char* pPath,
-    uint8_t** ppContent) {
-    FILE*   pStream;
-    long    filesize;
-    uint8_t* content = NULL;
-    size_t res = 0;
-
-    /* Open the file */
-    pStream = fopen(pPath, "rb");
-    if (pStream == NULL) {
-        LOG_E("Error: Cannot open file: %s.", pPath);
-        return 0;
-    }
-
-    if (fseek(pStream, 0L, SEEK_END) != 0) {
-        LOG_E("Error: Cannot read file: %s.", pPath);
-        goto error;
-    }
-
-    filesize = ftell(pStream);
-    if (filesize < 0) {
-        LOG_E("Error: Cannot get the file size: %s.", pPath);
-        goto error;
-    }
-
-    if (filesize == 0) {
-        LOG_E("Error: Empty file: %s.", pPath);
-        goto error;
-    }
-
-    /* Set the file pointer at the beginning of the file */
-    if (fseek(pStream, 0L, SEEK_SET) != 0) {
-        LOG_E("Error: Cannot read file: %s.", pPath);
-        goto error;
-    }
-
-    /* Allocate a buffer for the content */
-    content = new uint8_t[filesize];
-    if (content == NULL) {
-        LOG_E("Error: Cannot read file: Out of memory.");
-        goto error;
-    }
-
-    /* Read data from the file into the buffer */
-    res = fread(content, filesize, 1, pStream);
-    if (ferror(pStream)) {
-        LOG_E("Error: Cannot read file: %s.", pPath);
-        goto error;
-    }
-    if (res < 1) {
-        //File is shorter than expected
-        if (feof(pStream)) {
-            LOG_E("Error: EOF reached: %s.", pPath);
-        }
-        goto error;
-    }
-
-    /* Close the file */
-    fclose(pStream);
-    *ppContent = content;
-
-    /* Return number of bytes read */
-    return static_cast<uint32_t>(filesize);
-
-error:
-    if (content != NULL) {
-        delete[] content;
-    }
-    fclose(pStream);
-    return 0;
-}
-
-//------------------------------------------------------------------------------
-static bool mcCheckUuid(const mcUuid_t* uuid, const char* filename) {
-    uint8_t*    pTAData = NULL;
-    uint32_t    nTASize;
-    bool        res;
-
-    nTASize = getFileContent(filename, &pTAData);
-    if (nTASize == 0) {
+static bool mcCheckUuid(const mcUuid_t* uuid, const RegistryIndex::File& ta) {
+    if (!ta.readable) {
         LOG_E("err: Trusted Application not found.");
         return false;
     }
 
     // Check blob size
-    if (nTASize < sizeof(mclfHeaderV24_t)) {
-        delete[] pTAData;
-        LOG_E("getFileContent failed - TA length is less than header size");
+    if (!ta.header_read) {
+        LOG_E("mcCheckUuid() - TA length is less than header size");
         return false;
     }
 
-    mclfHeaderV2_t* header20 = reinterpret_cast<mclfHeaderV2_t*>(pTAData);
-
     // Check header version
-    if (header20->intro.version < MC_MAKE_VERSION(2, 4)) {
-        delete[] pTAData;
+    if (ta.version < MC_MAKE_VERSION(2, 4)) {
         LOG_E("mcCheckUuid() - TA blob header version is less than 2.4");
         return false;
     }
 
     // Check uuid
-    if (memcmp(uuid, &header20->uuid, sizeof(mcUuid_t)) == 0) {
-        res = true;
-    } else {
-        res = false;
-    }
-
-    delete[] pTAData;
-
-    return res;
+    return memcmp(uuid, &ta.uuid, sizeof(mcUuid_t)) == 0;
 }
 
 //this function deletes all the files owned by a GP TA and stored in the tbase secure storage dir.
@@ -1087,65 +996,39 @@ mcResult_t mcRegistryCleanupGPTAStorage(const mcUuid_t* uuid) {
 }
 
 static void deleteSPTA(const mcUuid_t* uuid, const mcSpid_t spid) {
-    DIR*            dp;
-    struct dirent*  de;
     int             e;
 
     // Delete TABIN and SPID files - we loop searching required spid file
-    if (NULL != (dp = opendir(search_paths[0].c_str()))) {
-        while (NULL != (de = readdir(dp))) {
-            std::string spidFile;
-            std::string tabinFile;
-            std::string tabinUuid;
-            size_t pch_dot, pch_slash;
-            spidFile = search_paths[0] + "/" + std::string(de->d_name);
-            pch_dot = spidFile.find_last_of('.');
-            if (pch_dot == std::string::npos) {
-                continue;
-            }
-            pch_slash = spidFile.find_last_of('/');
-            if ((pch_slash != std::string::npos) && (pch_slash > pch_dot)) {
-                continue;
-            }
-            if (spidFile.substr(pch_dot).compare(GP_TA_SPID_FILE_EXT) != 0) {
-                continue;
-            }
-
-            mcSpid_t curSpid = 0;
+    for (const auto& spidFile : registry_index.listWritable(GP_TA_SPID_FILE_EXT)) {
+        mcSpid_t curSpid = spidFile.spid_read ? spidFile.spid : 0;
+        if (spid != curSpid) {
+            continue;
+        }
 
-            int fd = open(spidFile.c_str(), O_RDONLY);
-            if (fd != -1) {
-                if (read(fd, &curSpid, sizeof(mcSpid_t))!=sizeof(mcSpid_t)) {
-                    curSpid = 0;
-                }
-                close(fd);
+        std::string tabinUuid = spidFile.name.substr(0,
+                                spidFile.name.size() - strlen(GP_TA_SPID_FILE_EXT));
+        RegistryIndex::File tabin;
+        if (!registry_index.find(tabinUuid + GP_TA_BIN_FILE_EXT, false, &tabin)) {
+            LOG_E("err: Trusted Application not found.");
+            continue;
+        }
+        if (mcCheckUuid(uuid, tabin)) {
+            LOG_D("Remove TA storage %s", tabinUuid.c_str());
+            if (0 != (e = CleanupGPTAStorage(tabinUuid.c_str()))) {
+                LOG_E("Remove TA storage failed! errno: %d", e);
+                /* Discard error */
             }
-            if (spid == curSpid) {
-                tabinFile =  spidFile.substr(0, pch_dot) + GP_TA_BIN_FILE_EXT;
-                if (mcCheckUuid(uuid, tabinFile.c_str())) {
-                    tabinUuid = spidFile.substr(0, pch_dot);
-                    tabinUuid = tabinUuid.substr(tabinUuid.find_last_of('/')+1);
-                    LOG_D("Remove TA storage %s", tabinUuid.c_str());
-                    if (0 != (e = CleanupGPTAStorage(tabinUuid.c_str()))) {
-                        LOG_E("Remove TA storage failed! errno: %d", e);
-                        /* Discard error */
-                    }
-                    LOG_D("Remove TA file %s", tabinFile.c_str());
-                    if (0 != (e = remove(tabinFile.c_str()))) {
-                        LOG_E("Remove TA file failed! errno: %d", e);
-                        /* Discard error */
-                    }
-                    LOG_D("Remove spid file %s", spidFile.c_str());
-                    if (0 != (e = remove(spidFile.c_str()))) {
-                        LOG_E("Remove spid file failed! errno: %d", e);
-                        /* Discard error */
-                    }
-                    break;
-                }
+            LOG_D("Remove TA file %s", tabin.path.c_str());
+            if (0 != (e = remove(tabin.path.c_str()))) {
+                LOG_E("Remove TA file failed! errno: %d", e);
+                /* Discard error */
             }
-        }
-        if (dp) {
-            closedir(dp);
+            LOG_D("Remove spid file %s", spidFile.path.c_str());
+            if (0 != (e = remove(spidFile.path.c_str()))) {
+                LOG_E("Remove spid file failed! errno: %d", e);
+                /* Discard error */
+            }
+            break;
         }
     }
 }
@@ -1313,23 +1196,23 @@ mcResult_t mcRegistryGetTrustletInfo(const mcUuid_t* uuid, bool isGpUuid,
         return MC_DRV_ERR_INVALID_PARAMETER;
     }
 
-    if (isGpUuid) {
-        path = getTABinFilePath(uuid, MC_REGISTRY_ALL);
-    } else {
-        path = getTlBinFilePath(uuid, MC_REGISTRY_ALL);
-    }
+    // The index is kept up to date with the registry directories, this does
+    // not touch the file system
+    std::string name = byteArrayToString(uuid, sizeof(*uuid));
+    RegistryIndex::File file;
+    registry_index.find(name + (isGpUuid ? GP_TA_BIN_FILE_EXT : TL_BIN_FILE_EXT), true, &file);
+    path = file.path;
 
     *spid = 0;
     if (isGpUuid) {
-        std::string taspidFilePath = getTASpidFilePath(uuid, MC_REGISTRY_ALL);
-        int fd = open(taspidFilePath.c_str(), O_RDONLY);
-        if (fd >= 0) {
-            bool failed = read(fd, spid, sizeof(*spid)) != sizeof(*spid);
-            close(fd);
-            if (failed) {
-                LOG_E("Could not read SPID (%d)", errno);
+        RegistryIndex::File spidFile;
+        if (registry_index.find(name + GP_TA_SPID_FILE_EXT, true, &spidFile) &&
+                spidFile.readable) {
+            if (!spidFile.spid_read) {
+                LOG_E("Could not read SPID from %s", spidFile.path.c_str());
                 return MC_DRV_ERR_TRUSTLET_NOT_FOUND;
             }
+            *spid = spidFile.spid;
         }
     }
 
@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2013-2018 TRUSTONIC LIMITED
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the TRUSTONIC LIMITED nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/** Mobicore Driver Registry index.
+ *
+ * Keeps the trustlet binaries of the registry indexed by file name, so that
+ * opening a session does not have to probe every registry directory.
+ *
+ * @file
+ * @ingroup MCD_MCDIMPL_DAEMON_REG
+ */
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "mcLoadFormat.h"
+
+#include "RegistryIndex.h"
+
+#include "dynamic_log.h"
+
+#define REGISTRY_INDEX_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                               IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#define REGISTRY_PARENT_EVENTS (IN_CREATE | IN_MOVED_TO | IN_ONLYDIR | IN_MASK_ADD)
+
+//------------------------------------------------------------------------------
+static bool hasExtension(const std::string& name, const char* ext) {
+    size_t len = strlen(ext);
+    return (name.size() > len) && (name.compare(name.size() - len, len, ext) == 0);
+}
+
+//------------------------------------------------------------------------------
+static bool isIndexed(const std::string& name) {
+    return hasExtension(name, GP_TA_BIN_FILE_EXT) || hasExtension(name, GP_TA_SPID_FILE_EXT) ||
+           hasExtension(name, TL_BIN_FILE_EXT);
+}
+
+//------------------------------------------------------------------------------
+static void splitPath(const std::string& path, std::string* parent, std::string* name) {
+    size_t end = path.find_last_not_of('/');
+    size_t pos = (end == std::string::npos) ? std::string::npos : path.rfind('/', end);
+
+    if (pos == std::string::npos) {
+        *parent = ".";
+        *name = path.substr(0, end + 1);
+    } else {
+        *parent = pos ? path.substr(0, pos) : "/";
+        *name = path.substr(pos + 1, end - pos);
+    }
+}
+
+//------------------------------------------------------------------------------
+template<typename Func>
+static void listDir(const std::string& path, Func func) {
+    DIR* dp = opendir(path.c_str());
+    struct dirent* de;
+
+    if (dp == NULL) {
+        return;
+    }
+    while (NULL != (de = readdir(dp))) {
+        if (de->d_name[0] != '.') {
+            func(std::string(de->d_name));
+        }
+    }
+    closedir(dp);
+}
+
+//------------------------------------------------------------------------------
+RegistryIndex::~RegistryIndex() {
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+    }
+}
+
+//------------------------------------------------------------------------------
+void RegistryIndex::setPaths(const std::vector<std::string>& paths) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+    }
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        LOG_ERRNO("inotify_init1");
+    }
+
+    dirs_.clear();
+    dirs_.resize(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        dirs_[i].path = paths[i];
+        watch(dirs_[i]);
+    }
+}
+
+//------------------------------------------------------------------------------
+bool RegistryIndex::probe(const std::string& path, File* file) {
+    struct stat st;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    file->readable = false;
+    file->header_read = false;
+    file->spid_read = false;
+    if (fd < 0) {
+        /* Present but not readable still hides the other registries */
+        if (stat(path.c_str(), &st)) {
+            return false;
+        }
+        file->size = st.st_size;
+        return true;
+    }
+
+    file->readable = true;
+    file->size = (fstat(fd, &st) == 0) ? st.st_size : 0;
+    if (hasExtension(path, GP_TA_SPID_FILE_EXT)) {
+        file->spid_read = pread(fd, &file->spid, sizeof(file->spid), 0) == sizeof(file->spid);
+    } else {
+        mclfHeaderV24_t header;
+        if (pread(fd, &header, sizeof(header), 0) == sizeof(header)) {
+            const mclfHeaderV2_t& header20 = header.mclfHeaderV2.mclfHeaderV2;
+            file->header_read = true;
+            file->version = header20.intro.version;
+            file->service_type = header20.serviceType;
+            memcpy(&file->uuid, &header20.uuid, sizeof(file->uuid));
+        }
+    }
+    close(fd);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void RegistryIndex::update(Dir& dir, const std::string& name) {
+    if (!isIndexed(name)) {
+        return;
+    }
+
+    File file;
+    file.name = name;
+    file.path = dir.path + "/" + name;
+    if (probe(file.path, &file)) {
+        dir.files[name] = file;
+    } else {
+        dir.files.erase(name);
+    }
+}
+
+//------------------------------------------------------------------------------
+void RegistryIndex::watch(Dir& dir) {
+    dir.files.clear();
+    dir.wd = -1;
+    if (inotify_fd_ < 0) {
+        return;
+    }
+
+    /* Watch first, so that no change is missed while scanning */
+    dir.wd = inotify_add_watch(inotify_fd_, dir.path.c_str(), REGISTRY_INDEX_EVENTS);
+    if (dir.wd < 0) {
+        /* Try again in case it was created before the parent was watched */
+        watchParent(dir);
+        dir.wd = inotify_add_watch(inotify_fd_, dir.path.c_str(), REGISTRY_INDEX_EVENTS);
+        if (dir.wd < 0) {
+            return;
+        }
+    }
+    unwatchParent(dir);
+    listDir(dir.path, [&](const std::string& name) {
+        update(dir, name);
+    });
+    LOG_D("Registry %s indexed, %zu files", dir.path.c_str(), dir.files.size());
+}
+
+//------------------------------------------------------------------------------
+void RegistryIndex::watchParent(Dir& dir) {
+    if (dir.parent_wd >= 0) {
+        return;
+    }
+
+    std::string parent, name;
+    splitPath(dir.path, &parent, &name);
+    dir.parent_wd = inotify_add_watch(inotify_fd_, parent.c_str(), REGISTRY_PARENT_EVENTS);
+    if (dir.parent_wd < 0) {
+        LOG_W("Cannot watch %s for registry %s", parent.c_str(), dir.path.c_str());
+    }
+}
+
+//------------------------------------------------------------------------------
+void RegistryIndex::unwatchParent(Dir& dir) {
+    int wd = dir.parent_wd;
+
+    if (wd < 0) {
+        return;
+    }
+    dir.parent_wd = -1;
+
+    /* The same directory may be the parent of another registry, or one */
+    for (const auto& other : dirs_) {
+        if ((other.parent_wd == wd) || (other.wd == wd)) {
+            return;
+        }
+    }
+    inotify_rm_watch(inotify_fd_, wd);
+}
+
+//------------------------------------------------------------------------------
+void RegistryIndex::sync() {
+    if (inotify_fd_ < 0) {
+        return;
+    }
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(inotify_fd_, buf, sizeof(buf))) > 0) {
+        for (char* ptr = buf; ptr < buf + len;) {
+            auto event = reinterpret_cast<const struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                LOG_W("Registry index events lost, rescanning");
+                for (auto& dir : dirs_) {
+                    watch(dir);
+                }
+                continue;
+            }
+
+            for (auto& dir : dirs_) {
+                if (dir.parent_wd == event->wd) {
+                    std::string parent, name;
+                    splitPath(dir.path, &parent, &name);
+                    if (event->mask & IN_IGNORED) {
+                        /* Parent gone, looked up on the file system from now */
+                        dir.parent_wd = -1;
+                    } else if (event->len && (name == event->name)) {
+                        watch(dir);
+                    }
+                    continue;
+                }
+                if (dir.wd != event->wd) {
+                    continue;
+                }
+                if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                    /* Looked up on the file system until it is back */
+                    inotify_rm_watch(inotify_fd_, dir.wd);
+                    watch(dir);
+                } else if (event->len) {
+                    if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                        dir.files.erase(event->name);
+                    } else {
+                        update(dir, event->name);
+                    }
+                }
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+bool RegistryIndex::findIn(Dir& dir, const std::string& name, File* file) {
+    if (dir.wd < 0) {
+        file->name = name;
+        file->path = dir.path + "/" + name;
+        return probe(file->path, file);
+    }
+
+    auto it = dir.files.find(name);
+    if (it == dir.files.end()) {
+        return false;
+    }
+    *file = it->second;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool RegistryIndex::find(const std::string& name, bool all, File* file) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    *file = File();
+    if (dirs_.empty()) {
+        return false;
+    }
+
+    sync();
+    if (all) {
+        for (size_t i = 1; i < dirs_.size(); i++) {
+            if (findIn(dirs_[i], name, file)) {
+                return true;
+            }
+        }
+    }
+    if (findIn(dirs_[0], name, file)) {
+        return true;
+    }
+
+    *file = File();
+    file->name = name;
+    file->path = dirs_[0].path + "/" + name;
+    return false;
+}
+
+//------------------------------------------------------------------------------
+std::vector<RegistryIndex::File> RegistryIndex::listWritable(const std::string& ext) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<File> files;
+
+    if (dirs_.empty()) {
+        return files;
+    }
+
+    sync();
+    Dir& dir = dirs_[0];
+    if (dir.wd < 0) {
+        listDir(dir.path, [&](const std::string& name) {
+            File file;
+            if (hasExtension(name, ext.c_str()) && findIn(dir, name, &file)) {
+                files.push_back(file);
+            }
+        });
+        return files;
+    }
+
+    for (const auto& it : dir.files) {
+        if (hasExtension(it.first, ext.c_str())) {
+            files.push_back(it.second);
+        }
+    }
+    return files;
+}
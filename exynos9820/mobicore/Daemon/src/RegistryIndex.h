@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2013-2017 TRUSTONIC LIMITED
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the TRUSTONIC LIMITED nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef MOBICORE_REGISTRY_INDEX_H_
+#define MOBICORE_REGISTRY_INDEX_H_
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "MobiCoreDriverApi.h"
+
+#define TL_BIN_FILE_EXT ".tlbin"
+#define GP_TA_BIN_FILE_EXT ".tabin"
+#define GP_TA_SPID_FILE_EXT ".spid"
+
+/** In-memory index of the trustlet binaries and SPID files of the registry.
+ *
+ * Each registry directory is scanned once, reading only the MCLF header of
+ * the binaries, and then kept up to date from inotify events, which are
+ * consumed before every lookup. A directory which cannot be watched (yet) is
+ * looked up on the file system directly, and indexed when its parent reports
+ * it was created.
+ */
+class RegistryIndex {
+public:
+    struct File {
+        std::string name;
+        std::string path;
+        off_t       size = 0;
+        bool        readable = false;
+        /* Binaries: MCLF header fields, valid if the file holds a v2.4 header */
+        bool        header_read = false;
+        uint32_t    version = 0;
+        uint32_t    service_type = 0;
+        mcUuid_t    uuid;
+        /* SPID files: content, valid if the file holds a full SPID */
+        bool        spid_read = false;
+        mcSpid_t    spid = 0;
+    };
+
+    ~RegistryIndex();
+
+    /** Sets the registry directories, the first one is the writable one.
+     */
+    void setPaths(const std::vector<std::string>& paths);
+
+    /** Looks up a file by name. With all set, the read-only registries are
+     * searched first and the writable one last, otherwise only the writable
+     * one is.
+     * @return true if found; otherwise file->path is the path the file would
+     * have in the writable registry.
+     */
+    bool find(const std::string& name, bool all, File* file);
+
+    /** Lists the files of the writable registry with the given extension.
+     */
+    std::vector<File> listWritable(const std::string& ext);
+
+    /** Reads the header of a binary, or the content of a SPID file.
+     * @return false if the file does not exist.
+     */
+    static bool probe(const std::string& path, File* file);
+
+private:
+    struct Dir {
+        std::string path;
+        int         wd = -1;
+        int         parent_wd = -1;
+        std::unordered_map<std::string, File> files;
+    };
+
+    void watch(Dir& dir);
+    void watchParent(Dir& dir);
+    void unwatchParent(Dir& dir);
+    void update(Dir& dir, const std::string& name);
+    void sync();
+    bool findIn(Dir& dir, const std::string& name, File* file);
+
+    std::mutex mutex_;
+    int inotify_fd_ = -1;
+    std::vector<Dir> dirs_;
+};
+
+#endif // MOBICORE_REGISTRY_INDEX_H_
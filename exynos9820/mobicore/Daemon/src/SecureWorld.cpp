@@ -186,11 +186,43 @@ static bool getTrustletContainer(const struct mc_admin_request* request,
     return true;
 }
 
-static bool readTrustlet(const std::string& path, std::string* buffer,
-                        uint32_t* service_type) {
+// Read-only mapping of a trustlet binary, passed to the driver without copy.
+// The file stays open: a file truncated under the mapping would fault on
+// access, so the size is checked again before the mapping is handed over.
+class TrustletMapping {
+    void* addr_ = MAP_FAILED;
+    size_t size_ = 0;
+    int fd_ = -1;
+public:
+    ~TrustletMapping() {
+        unmap();
+    }
+    void unmap() {
+        if (addr_ != MAP_FAILED) {
+            ::munmap(addr_, size_);
+            addr_ = MAP_FAILED;
+            size_ = 0;
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+    bool map(const std::string& path, uint32_t* service_type);
+    bool revalidate() const;
+    const void* data() const {
+        return addr_;
+    }
+    size_t size() const {
+        return size_;
+    }
+};
+
+bool TrustletMapping::map(const std::string& path, uint32_t* service_type) {
     *service_type = SERVICE_TYPE_ILLEGAL;
+    unmap();
 
-    int fd = ::open(path.c_str(), O_RDONLY);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
     if (fd < 0) {
         LOG_W("Cannot open trustlet %s (%s)", path.c_str(), strerror(errno));
         return false;
@@ -203,6 +235,16 @@ static bool readTrustlet(const std::string& path, std::string* buffer,
         return false;
     }
 
+    /* Give service type to driver so it knows how to allocate and copy.
+     * Read from the file, the mapping is not touched by the daemon */
+    mclfHeaderV2_t header;
+    if (::pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+        LOG_W("Cannot read header of trustlet %s", path.c_str());
+        ::close(fd);
+        errno = EINVAL;
+        return false;
+    }
+
     void* addr = ::mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
     if (addr == MAP_FAILED) {
         MY_LOG_ERRNO("mapping file to memory");
@@ -210,19 +252,28 @@ static bool readTrustlet(const std::string& path, std::string* buffer,
         return false;
     }
 
-    /* Give service type to driver so it knows how to allocate and copy */
-    mclfHeaderV2_t* header = static_cast<mclfHeaderV2_t*>(addr);
-    *service_type = header->serviceType;
-    buffer->resize(stat.st_size);
-    ::memcpy(&(*buffer)[0], addr, buffer->length());
-    ::munmap(addr, stat.st_size);
-    ::close(fd);
+    *service_type = header.serviceType;
+    addr_ = addr;
+    size_ = stat.st_size;
+    fd_ = fd;
+    return true;
+}
+
+bool TrustletMapping::revalidate() const {
+    struct stat stat;
+
+    if ((fd_ < 0) || (::fstat(fd_, &stat) < 0) ||
+            (static_cast<size_t>(stat.st_size) < size_)) {
+        LOG_W("Trustlet was truncated after it was mapped");
+        errno = EIO;
+        return false;
+    }
     return true;
 }
 
 static bool getTrustlet(const struct mc_admin_request* request,
                         struct mc_admin_response* response,
-                        std::string* buffer) {
+                        TrustletMapping* trustlet) {
     const mcUuid_t* uuid = reinterpret_cast<const mcUuid_t*>(&request->uuid);
     std::string path;
 
@@ -247,10 +298,10 @@ static bool getTrustlet(const struct mc_admin_request* request,
         return false;
     }
 
-    if (!readTrustlet(path, buffer, &response->service_type)) {
+    if (!trustlet->map(path, &response->service_type)) {
         response->error_no = errno;
     } else {
-        response->length = static_cast<uint32_t>(buffer->length());
+        response->length = static_cast<uint32_t>(trustlet->size());
         LOG_D("Read spid %u and mmap'd trustlet from %s, total size: %u",
               response->spid, path.c_str(), response->length);
     }
@@ -381,11 +432,11 @@ int SecureWorld::loadDriver(const std::string& path) {
     bool load_with_uuid = false;
     uint32_t service_type;
 
-    std::string buffer;
+    TrustletMapping trustlet;
     size_t slash_pos = path.find_first_of('/');
     if (slash_pos != std::string::npos) {
         // a path to blob is passed.
-        if (!readTrustlet(path, &buffer, &service_type)) {
+        if (!trustlet.map(path, &service_type)) {
             return -1;
         }
     } else {
@@ -418,7 +469,7 @@ int SecureWorld::loadDriver(const std::string& path) {
             return -1;
         }
         // check if the uuid corresponds to a blob in the registry
-        if (!readTrustlet(srv_path_in_registry, &buffer, &service_type)) {
+        if (!trustlet.map(srv_path_in_registry, &service_type)) {
             // otherwise we pass the uuid without the blob to the SWd.
             LOG_D("Passing only UUID %s to SWd", path.c_str());
             ::memcpy(&info.uuid, &uuid, sizeof(uuid));
@@ -429,8 +480,11 @@ int SecureWorld::loadDriver(const std::string& path) {
     info.spid = 0;
 
     if(!load_with_uuid) {
-        info.address = reinterpret_cast<uintptr_t>(&buffer[0]);
-        info.length = static_cast<uint32_t>(buffer.length());
+        if (!trustlet.revalidate()) {
+            return -1;
+        }
+        info.address = reinterpret_cast<uintptr_t>(trustlet.data());
+        info.length = static_cast<uint32_t>(trustlet.size());
     } else {
         info.address = 0;
         info.length = 0;
@@ -534,6 +588,7 @@ void SecureWorld::Impl::run() {
         memset(&response, 0, sizeof(response));
         response.request_id = command_id++;
         std::string buffer;
+        TrustletMapping trustlet;
 
         switch (request.command) {
             case MC_DRV_GET_ROOT_CONTAINER:
@@ -546,7 +601,7 @@ void SecureWorld::Impl::run() {
                 getTrustletContainer(&request, &response, &buffer);
                 break;
             case MC_DRV_GET_TRUSTLET:
-                getTrustlet(&request, &response, &buffer);
+                getTrustlet(&request, &response, &trustlet);
                 break;
             case MC_DRV_SIGNAL_CRASH: {
                 LOG_C("TEE HALTED");
@@ -571,6 +626,12 @@ void SecureWorld::Impl::run() {
                 response.error_no = EBADRQC;
         }
 
+        if (trustlet.size() && !trustlet.revalidate()) {
+            response.error_no = errno;
+            response.length = 0;
+            trustlet.unmap();
+        }
+
         LOG_D("Response errno %d length %u", response.error_no, response.length);
         ssize_t ret = ::write(device_fd, &response, sizeof(response));
         if (ret != sizeof(response)) {
@@ -578,7 +639,9 @@ void SecureWorld::Impl::run() {
             ret = -1;
         } else if (response.length > 0) {
             ssize_t expected_length = response.length;
-            ret = ::write(device_fd, buffer.c_str(), response.length);
+            const char* data = trustlet.size() ?
+                               static_cast<const char*>(trustlet.data()) : buffer.c_str();
+            ret = ::write(device_fd, data, response.length);
             if (ret != expected_length) {
                 LOG_ERRNO("Sending response data to driver");
                 ret = -1;
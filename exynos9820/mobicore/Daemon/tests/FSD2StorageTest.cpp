@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2013-2017 TRUSTONIC LIMITED
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the TRUSTONIC LIMITED nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Runs synthesized delegation instruction buffers against partitions on a
+ * tmpfs, checks the results and reports the throughput of the coalesced
+ * execution next to the former stdio one (fseek + fread/fwrite per sector).
+ */
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "FSD2Storage.h"
+
+namespace {
+
+const uint32_t kSectorSize = 4096;
+const uint32_t kWorkspaceSectors = 192;
+
+/* Same layout as the DCI of the daemon */
+union ExchangeBuffer {
+    STH2_delegation_exchange_buffer_t exchange_buffer;
+    struct {
+        char padding[sizeof(STH2_delegation_exchange_buffer_t)];
+        uint8_t workspace[kWorkspaceSectors * kSectorSize];
+    };
+};
+
+/* Writes an instruction buffer the way SPT2 does */
+class Instructions {
+    STH2_delegation_exchange_buffer_t* buffer_;
+    uint32_t words_;
+    void push(uint32_t word) {
+        buffer_->sInstructions[words_++] = word;
+        buffer_->nInstructionsBufferSize = words_ * 4;
+    }
+public:
+    Instructions(STH2_delegation_exchange_buffer_t* buffer): buffer_(buffer), words_(0) {
+        buffer_->nInstructionsBufferSize = 0;
+    }
+    Instructions& op(uint32_t pid, uint32_t id) {
+        push((pid << 4) | id);
+        return *this;
+    }
+    Instructions& read(uint32_t pid, uint32_t sector, uint32_t slot) {
+        op(pid, DELEGATION_INSTRUCTION_PARTITION_READ);
+        push(sector);
+        push(slot * kSectorSize);
+        return *this;
+    }
+    Instructions& write(uint32_t pid, uint32_t sector, uint32_t slot) {
+        op(pid, DELEGATION_INSTRUCTION_PARTITION_WRITE);
+        push(sector);
+        push(slot * kSectorSize);
+        return *this;
+    }
+    Instructions& setSize(uint32_t pid, uint32_t sectors) {
+        op(pid, DELEGATION_INSTRUCTION_PARTITION_SET_SIZE);
+        push(sectors);
+        return *this;
+    }
+};
+
+/* Execution of the read/write instructions before the batches, for reference */
+class LegacyPartition {
+    FILE* fd_;
+public:
+    LegacyPartition(const std::string& name): fd_(::fopen(name.c_str(), "r+b")) {}
+    ~LegacyPartition() {
+        if (fd_) {
+            ::fclose(fd_);
+        }
+    }
+    bool execute(STH2_delegation_exchange_buffer_t* exchange_buffer) {
+        uint32_t* words = exchange_buffer->sInstructions;
+        for (uint32_t i = 0; i < exchange_buffer->nInstructionsBufferSize / 4; i += 3) {
+            uint8_t* buf = exchange_buffer->sWorkspace + words[i + 2];
+            if (::fseek(fd_, words[i + 1] * kSectorSize, SEEK_SET)) {
+                return false;
+            }
+            if ((words[i] & 0x0F) == DELEGATION_INSTRUCTION_PARTITION_READ) {
+                if (::fread(buf, kSectorSize, 1, fd_) != 1) {
+                    return false;
+                }
+            } else if (::fwrite(buf, kSectorSize, 1, fd_) != 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+    bool sync() {
+        return !::fflush(fd_) && !::fdatasync(fileno(fd_));
+    }
+};
+
+class FSD2StorageTest: public ::testing::Test {
+protected:
+    std::string dir_;
+    Partition* partitions_[FSD2_PARTITION_NUM];
+    ExchangeBuffer* exchange_;
+    STH2_delegation_exchange_buffer_t* buffer_;
+    DelegationBatch* batch_;
+
+    void SetUp() override {
+        /* Use a tmpfs when there is one, the disk speed is not what is measured */
+        char dir[] = "/dev/shm/fsd2_test_XXXXXX";
+        char tmp_dir[] = "/tmp/fsd2_test_XXXXXX";
+        dir_ = ::mkdtemp(dir) ? dir : ::mkdtemp(tmp_dir);
+        ASSERT_FALSE(dir_.empty());
+
+        for (int i = 0; i < FSD2_PARTITION_NUM; i++) {
+            char file_name[16];
+            snprintf(file_name, sizeof(file_name), "Store_%1X.tf", i);
+            partitions_[i] = new Partition(dir_, file_name);
+        }
+        exchange_ = new ExchangeBuffer();
+        buffer_ = &exchange_->exchange_buffer;
+        batch_ = new DelegationBatch(partitions_);
+    }
+
+    void TearDown() override {
+        delete batch_;
+        delete exchange_;
+        for (int i = 0; i < FSD2_PARTITION_NUM; i++) {
+            ::unlink(partitions_[i]->name());
+            delete partitions_[i];
+        }
+        ::rmdir(dir_.c_str());
+    }
+
+    uint8_t* slot(uint32_t index) {
+        return buffer_->sWorkspace + index * kSectorSize;
+    }
+
+    void fillSlot(uint32_t index, uint8_t value) {
+        ::memset(slot(index), value, kSectorSize);
+    }
+
+    uint32_t error(uint32_t pid) {
+        return buffer_->sAdministrativeData.nPartitionErrorStates[pid];
+    }
+
+    void execute() {
+        batch_->execute(buffer_, kSectorSize);
+    }
+
+    /* Creates partition pid with sectors sectors, sector n filled with n */
+    void createPartition(uint32_t pid, uint32_t sectors) {
+        Instructions(buffer_)
+            .op(pid, DELEGATION_INSTRUCTION_PARTITION_CREATE)
+            .setSize(pid, sectors);
+        execute();
+        ASSERT_EQ(TEEC_SUCCESS, error(pid));
+
+        for (uint32_t first = 0; first < sectors; first += kWorkspaceSectors) {
+            Instructions in(buffer_);
+            for (uint32_t i = first; i < sectors && i < first + kWorkspaceSectors; i++) {
+                fillSlot(i - first, static_cast<uint8_t>(i));
+                in.write(pid, i, i - first);
+            }
+            execute();
+            ASSERT_EQ(TEEC_SUCCESS, error(pid));
+        }
+
+        Instructions(buffer_).op(pid, DELEGATION_INSTRUCTION_PARTITION_SYNC);
+        execute();
+        ASSERT_EQ(TEEC_SUCCESS, error(pid));
+    }
+};
+
+} // namespace
+
+TEST_F(FSD2StorageTest, CoalescesAdjacentSectors) {
+    createPartition(0, 64);
+
+    Instructions in(buffer_);
+    for (uint32_t i = 0; i < 64; i++) {
+        in.write(0, i, i);
+    }
+    in.op(0, DELEGATION_INSTRUCTION_PARTITION_SYNC);
+    execute();
+    /* one pwritev for the 64 sectors and the fdatasync */
+    EXPECT_EQ(2u, batch_->stats().io_calls);
+    EXPECT_EQ(64u, batch_->stats().sectors);
+    EXPECT_EQ(1u, buffer_->sAdministrativeData.nSyncExecuted);
+
+    Instructions(buffer_)
+        .op(0, DELEGATION_INSTRUCTION_PARTITION_CLOSE)
+        .op(0, DELEGATION_INSTRUCTION_PARTITION_OPEN);
+    execute();
+    EXPECT_EQ(TEEC_SUCCESS, error(0));
+    EXPECT_EQ(64u, buffer_->sAdministrativeData.nPartitionOpenSizes[0]);
+
+    /* adjacent sectors into scattered workspace slots still make one run */
+    in = Instructions(buffer_);
+    for (uint32_t i = 0; i < 64; i++) {
+        in.read(0, i, 127 - i);
+    }
+    ::memset(buffer_->sWorkspace, 0xFF, kWorkspaceSectors * kSectorSize);
+    execute();
+    EXPECT_EQ(TEEC_SUCCESS, error(0));
+    EXPECT_EQ(1u, batch_->stats().io_calls);
+    EXPECT_EQ(0u, buffer_->sAdministrativeData.nSyncExecuted);
+    for (uint32_t i = 0; i < 64; i++) {
+        EXPECT_EQ(i, slot(127 - i)[0]);
+        EXPECT_EQ(i, slot(127 - i)[kSectorSize - 1]);
+    }
+
+    /* a write after the read of the same sector is a separate run */
+    fillSlot(0, 0xAB);
+    Instructions(buffer_).read(0, 3, 1).write(0, 3, 0).write(0, 4, 0).write(0, 9, 0).read(0, 3, 2);
+    execute();
+    EXPECT_EQ(TEEC_SUCCESS, error(0));
+    EXPECT_EQ(4u, batch_->stats().io_calls);
+    EXPECT_EQ(5u, batch_->stats().instructions);
+    EXPECT_EQ(3, slot(1)[0]);
+    EXPECT_EQ(0xAB, slot(2)[0]);
+}
+
+TEST_F(FSD2StorageTest, KeepsPartitionErrors) {
+    createPartition(0, 8);
+    createPartition(1, 8);
+
+    fillSlot(20, 0xCD);
+    ::memset(slot(10), 0xFF, 4 * kSectorSize);
+    Instructions(buffer_)
+        .read(0, 6, 10).read(0, 7, 11).read(0, 8, 12).read(0, 9, 13)
+        .write(0, 0, 20)
+        .op(0, DELEGATION_INSTRUCTION_PARTITION_SYNC)
+        .read(1, 5, 14)
+        .op(1, DELEGATION_INSTRUCTION_PARTITION_SYNC);
+    execute();
+
+    /* the sectors before the end of file are read, the partition fails at the first after */
+    EXPECT_EQ(TEEC_ERROR_ITEM_NOT_FOUND, error(0));
+    EXPECT_EQ(6, slot(10)[0]);
+    EXPECT_EQ(7, slot(11)[0]);
+    EXPECT_EQ(0xFF, slot(13)[0]);
+    EXPECT_EQ(TEEC_SUCCESS, error(1));
+    EXPECT_EQ(5, slot(14)[0]);
+    EXPECT_EQ(1u, buffer_->sAdministrativeData.nSyncExecuted);
+
+    /* the write after the failure was skipped, and errors do not outlive the batch */
+    Instructions(buffer_).read(0, 0, 15);
+    execute();
+    EXPECT_EQ(TEEC_SUCCESS, error(0));
+    EXPECT_EQ(0, slot(15)[0]);
+
+    /* not open */
+    Instructions(buffer_).read(2, 0, 0).op(2, DELEGATION_INSTRUCTION_PARTITION_SYNC);
+    execute();
+    EXPECT_EQ(TEEC_ERROR_BAD_STATE, error(2));
+    EXPECT_EQ(0u, buffer_->sAdministrativeData.nSyncExecuted);
+}
+
+TEST_F(FSD2StorageTest, IgnoresTruncatedInstruction) {
+    createPartition(0, 4);
+
+    fillSlot(0, 0xEE);
+    Instructions(buffer_).write(0, 1, 0).write(0, 2, 0);
+    buffer_->nInstructionsBufferSize -= 4;
+    execute();
+    EXPECT_EQ(TEEC_SUCCESS, error(0));
+    EXPECT_EQ(1u, batch_->stats().instructions);
+
+    Instructions(buffer_).read(0, 1, 1).read(0, 2, 2);
+    execute();
+    EXPECT_EQ(0xEE, slot(1)[0]);
+    EXPECT_EQ(2, slot(2)[0]);
+}
+
+TEST_F(FSD2StorageTest, Throughput) {
+    const uint32_t kPartitionSectors = 1024;
+    const int kBatches = 200;
+    const struct {
+        const char* name;
+        uint32_t run;       /* adjacent sectors per run, all the workspace when 0 */
+        bool write;
+    } kPatterns[] = {
+        { "sequential read",  0, false },
+        { "sequential write", 0, true  },
+        { "8-sector runs",    8, true  },
+        { "scattered write",  1, true  },
+    };
+
+    createPartition(0, kPartitionSectors);
+
+    for (auto& pattern : kPatterns) {
+        std::mt19937 rng(1234);
+        std::vector<uint32_t> first;
+        uint32_t run = pattern.run ? pattern.run : kWorkspaceSectors;
+
+        for (int batch = 0; batch < kBatches; batch++) {
+            first.push_back(rng() % (kPartitionSectors / run) * run);
+        }
+
+        double seconds[2];
+        uint64_t io_calls = 0;
+        for (int legacy = 0; legacy < 2; legacy++) {
+            LegacyPartition reference(partitions_[0]->name());
+            auto start = std::chrono::steady_clock::now();
+
+            for (int batch = 0; batch < kBatches; batch++) {
+                Instructions in(buffer_);
+                for (uint32_t i = 0; i < kWorkspaceSectors; i++) {
+                    /* runs spread over the partition when they are short */
+                    uint32_t sector = (first[batch] + (i / run) * run * 7 + i % run) %
+                                      kPartitionSectors;
+                    if (pattern.write) {
+                        in.write(0, sector, i);
+                    } else {
+                        in.read(0, sector, i);
+                    }
+                }
+                if (legacy) {
+                    ASSERT_TRUE(reference.execute(buffer_));
+                } else {
+                    execute();
+                    ASSERT_EQ(TEEC_SUCCESS, error(0));
+                    io_calls += batch_->stats().io_calls;
+                }
+            }
+            if (pattern.write) {
+                if (legacy) {
+                    ASSERT_TRUE(reference.sync());
+                } else {
+                    ASSERT_EQ(TEEC_SUCCESS, partitions_[0]->sync());
+                }
+            }
+            seconds[legacy] = std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - start).count();
+        }
+
+        double sectors = static_cast<double>(kBatches) * kWorkspaceSectors;
+        printf("%-16s: %9.0f -> %9.0f sectors/s, %5.1f I/O calls per batch of %u sectors\n",
+               pattern.name, sectors / seconds[1], sectors / seconds[0],
+               static_cast<double>(io_calls) / kBatches, kWorkspaceSectors);
+
+        /* one call per run */
+        EXPECT_LE(io_calls, static_cast<uint64_t>(kBatches) * (kWorkspaceSectors / run + 1));
+    }
+}
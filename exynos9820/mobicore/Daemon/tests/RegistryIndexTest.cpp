@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2013-2018 TRUSTONIC LIMITED
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the TRUSTONIC LIMITED nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Checks the registry index against the file system lookups it replaces and
+ * measures the trustlet lookup done on every session open, with a few
+ * hundred synthetic TAs spread over the registry directories.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <gtest/gtest.h>
+
+#include "mcLoadFormat.h"
+#include "mcVersionHelper.h"
+#include "PrivateRegistry.h"
+#include "RegistryIndex.h"
+
+namespace {
+
+const int kTaCount = 300;
+const size_t kTaSize = 64 * 1024;
+
+std::string hexName(const mcUuid_t& uuid) {
+    char hx[sizeof(uuid) * 2 + 1];
+    for (size_t i = 0; i < sizeof(uuid); i++) {
+        snprintf(&hx[i * 2], 3, "%02x", uuid.value[i]);
+    }
+    return hx;
+}
+
+void writeFile(const std::string& path, const void* data, size_t size) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    ASSERT_GE(fd, 0) << path;
+    ASSERT_EQ(static_cast<ssize_t>(size), write(fd, data, size));
+    close(fd);
+}
+
+void writeTa(const std::string& dir, const mcUuid_t& uuid, mcSpid_t spid) {
+    std::vector<uint8_t> blob(kTaSize, 0x5A);
+    auto header = reinterpret_cast<mclfHeaderV24_t*>(&blob[0]);
+    mclfHeaderV2_t& header20 = header->mclfHeaderV2.mclfHeaderV2;
+    header20.intro.version = MC_MAKE_VERSION(2, 4);
+    header20.serviceType = SERVICE_TYPE_SP_TRUSTLET;
+    header20.uuid = uuid;
+    header->gp_level = 1;
+
+    writeFile(dir + "/" + hexName(uuid) + GP_TA_BIN_FILE_EXT, &blob[0], blob.size());
+    writeFile(dir + "/" + hexName(uuid) + GP_TA_SPID_FILE_EXT, &spid, sizeof(spid));
+}
+
+/* The lookup of mcRegistryGetTrustletInfo before the index */
+std::string legacyFind(const std::vector<std::string>& dirs, const std::string& name) {
+    for (size_t i = 1; i < dirs.size(); i++) {
+        std::string path = dirs[i] + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0) {
+            return path;
+        }
+    }
+    return dirs[0] + "/" + name;
+}
+
+mcResult_t legacyGetTrustletInfo(const std::vector<std::string>& dirs, const mcUuid_t& uuid,
+                                 mcSpid_t* spid, std::string& path) {
+    path = legacyFind(dirs, hexName(uuid) + GP_TA_BIN_FILE_EXT);
+    *spid = 0;
+    int fd = open(legacyFind(dirs, hexName(uuid) + GP_TA_SPID_FILE_EXT).c_str(), O_RDONLY);
+    if (fd >= 0) {
+        bool failed = read(fd, spid, sizeof(*spid)) != sizeof(*spid);
+        close(fd);
+        if (failed) {
+            return MC_DRV_ERR_TRUSTLET_NOT_FOUND;
+        }
+    }
+    return MC_DRV_OK;
+}
+
+class RegistryIndexTest: public ::testing::Test {
+protected:
+    std::string root_;
+    std::vector<std::string> dirs_;
+    std::vector<mcUuid_t> uuids_;
+
+    void SetUp() override {
+        char dir[] = "/dev/shm/mcregistry_XXXXXX";
+        char tmp_dir[] = "/tmp/mcregistry_XXXXXX";
+        root_ = mkdtemp(dir) ? dir : mkdtemp(tmp_dir);
+        ASSERT_FALSE(root_.empty());
+
+        for (const char* name : {"/data", "/vendor", "/system"}) {
+            dirs_.push_back(root_ + name);
+            ASSERT_EQ(0, mkdir(dirs_.back().c_str(), 0700));
+        }
+
+        std::mt19937 rng(1234);
+        for (int i = 0; i < kTaCount; i++) {
+            mcUuid_t uuid;
+            for (auto& byte : uuid.value) {
+                byte = static_cast<uint8_t>(rng());
+            }
+            uuids_.push_back(uuid);
+            writeTa(dirs_[i % dirs_.size()], uuid, static_cast<mcSpid_t>(i + 1));
+        }
+    }
+
+    void TearDown() override {
+        std::string cmd = "rm -rf " + root_;
+        ASSERT_EQ(0, system(cmd.c_str()));
+    }
+
+    void expectLegacyResult(const mcUuid_t& uuid) {
+        std::string path, legacy_path;
+        mcSpid_t spid, legacy_spid;
+
+        mcResult_t legacy_res = legacyGetTrustletInfo(dirs_, uuid, &legacy_spid, legacy_path);
+        EXPECT_EQ(legacy_res, mcRegistryGetTrustletInfo(&uuid, true, &spid, path));
+        EXPECT_EQ(legacy_path, path);
+        if (legacy_res == MC_DRV_OK) {
+            EXPECT_EQ(legacy_spid, spid);
+        }
+    }
+};
+
+} // namespace
+
+TEST_F(RegistryIndexTest, MatchesFileSystemLookup) {
+    setSearchPaths(dirs_);
+
+    for (const auto& uuid : uuids_) {
+        expectLegacyResult(uuid);
+    }
+
+    mcUuid_t unknown;
+    memset(&unknown, 0xEE, sizeof(unknown));
+    expectLegacyResult(unknown);
+}
+
+TEST_F(RegistryIndexTest, FollowsRegistryChanges) {
+    const mcUuid_t& uuid = uuids_[0];   /* in the writable registry */
+    std::string name = hexName(uuid);
+
+    /* the system registry appears after the index was built */
+    std::string system_dir = dirs_[2] + ".new";
+    ASSERT_EQ(0, rename(dirs_[2].c_str(), system_dir.c_str()));
+    setSearchPaths(dirs_);
+    expectLegacyResult(uuids_[2]);
+    ASSERT_EQ(0, rename(system_dir.c_str(), dirs_[2].c_str()));
+    expectLegacyResult(uuids_[2]);
+
+    /* a new SPID */
+    mcSpid_t spid = 0x1234;
+    writeFile(dirs_[0] + "/" + name + GP_TA_SPID_FILE_EXT, &spid, sizeof(spid));
+    expectLegacyResult(uuid);
+
+    /* the same TA in a read-only registry takes precedence */
+    writeTa(dirs_[1], uuid, 0x4321);
+    expectLegacyResult(uuid);
+
+    /* a truncated SPID file */
+    writeFile(dirs_[1] + "/" + name + GP_TA_SPID_FILE_EXT, &spid, 2);
+    expectLegacyResult(uuid);
+
+    unlink((dirs_[1] + "/" + name + GP_TA_BIN_FILE_EXT).c_str());
+    unlink((dirs_[1] + "/" + name + GP_TA_SPID_FILE_EXT).c_str());
+    expectLegacyResult(uuid);
+
+    /* removed, and then renamed into place */
+    std::string tabin = dirs_[0] + "/" + name + GP_TA_BIN_FILE_EXT;
+    ASSERT_EQ(0, rename(tabin.c_str(), (root_ + "/moved").c_str()));
+    expectLegacyResult(uuid);
+    ASSERT_EQ(0, rename((root_ + "/moved").c_str(), tabin.c_str()));
+    expectLegacyResult(uuid);
+}
+
+TEST_F(RegistryIndexTest, IndexesRecreatedRegistry) {
+    setSearchPaths(dirs_);
+
+    /* the vendor registry goes away, and comes back with a different TA */
+    std::string vendor_dir = dirs_[1] + ".old";
+    ASSERT_EQ(0, rename(dirs_[1].c_str(), vendor_dir.c_str()));
+    for (int i = 0; i < 10; i++) {
+        expectLegacyResult(uuids_[1]);
+    }
+    ASSERT_EQ(0, mkdir(dirs_[1].c_str(), 0700));
+    expectLegacyResult(uuids_[1]);
+    writeTa(dirs_[1], uuids_[0], 0x4321);
+    expectLegacyResult(uuids_[0]);
+    expectLegacyResult(uuids_[1]);
+
+    /* changes to the old directory are not seen any more */
+    writeTa(vendor_dir, uuids_[3], 0x5678);
+    expectLegacyResult(uuids_[3]);
+}
+
+TEST_F(RegistryIndexTest, CleanupTrustletRemovesGpTa) {
+    setSearchPaths(dirs_);
+
+    const mcUuid_t& uuid = uuids_[3];   /* in the writable registry, spid 4 */
+    std::string name = hexName(uuid);
+    std::string tlcont = dirs_[0] + "/" + name + ".40000000.tlcont";
+    writeFile(tlcont, "tlcont", 6);
+
+    EXPECT_EQ(MC_DRV_OK, mcRegistryCleanupTrustlet(&uuid, 4));
+    EXPECT_NE(0, access((dirs_[0] + "/" + name + GP_TA_BIN_FILE_EXT).c_str(), F_OK));
+    EXPECT_NE(0, access((dirs_[0] + "/" + name + GP_TA_SPID_FILE_EXT).c_str(), F_OK));
+    EXPECT_NE(0, access(tlcont.c_str(), F_OK));
+
+    /* the other TAs of the writable registry are still there */
+    expectLegacyResult(uuids_[6]);
+    expectLegacyResult(uuid);
+}
+
+TEST_F(RegistryIndexTest, SessionOpenLookupLatency) {
+    const int kLookups = 20000;
+    std::mt19937 rng(42);
+    std::vector<int64_t> latency[2];
+
+    setSearchPaths(dirs_);
+
+    for (int i = 0; i < kLookups; i++) {
+        const mcUuid_t& uuid = uuids_[rng() % uuids_.size()];
+        for (int legacy = 0; legacy < 2; legacy++) {
+            std::string path;
+            mcSpid_t spid;
+            auto start = std::chrono::steady_clock::now();
+            if (legacy) {
+                legacyGetTrustletInfo(dirs_, uuid, &spid, path);
+            } else {
+                mcRegistryGetTrustletInfo(&uuid, true, &spid, path);
+            }
+            latency[legacy].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now() - start).count());
+        }
+    }
+
+    for (auto& samples : latency) {
+        std::sort(samples.begin(), samples.end());
+    }
+    printf("%d TAs, trustlet lookup p50 %6.2f us -> %6.2f us, p99 %6.2f us -> %6.2f us\n",
+           kTaCount,
+           latency[1][kLookups / 2] / 1000.0, latency[0][kLookups / 2] / 1000.0,
+           latency[1][kLookups * 99 / 100] / 1000.0, latency[0][kLookups * 99 / 100] / 1000.0);
+    EXPECT_LT(latency[0][kLookups / 2], latency[1][kLookups / 2]);
+}
@@ -1124,7 +1124,7 @@ bool AcrylicCompositorG2D9810::executeG2D(int fence[], unsigned int num_fences,
     // We use max hdr register count because we could not calculate the count here.
     // num_extra_regs is updated after to set the hdr register unlike mHdrWriter.
     unsigned int num_hdrlib_coef = 0;
-    if (!mHdrWriter.getCommandCount()) {
+    if (!mHdrWriter.hasHdrMode()) {
         for (unsigned int i = 0; i < MAX_HDR_SET; i++) {
             if (mHdrLibCoef[i].hdr_en) {
                 num_hdrlib_coef = NUM_HDR_REGS;
@@ -1137,11 +1137,13 @@ bool AcrylicCompositorG2D9810::executeG2D(int fence[], unsigned int num_fences,
 
     unsigned int count = cscMatrixWriter.write(mTask.commands.extra);
 
-    if (mHdrWriter.getCommandCount()) {
+    if (mHdrWriter.hasHdrMode()) {
         mHdrWriter.write(mTask.commands.extra + count);
     } else if (num_hdrlib_coef) {
         mTask.commands.num_extra_regs += setHdrLibCommand(mTask.commands.extra + count);
         setHdrLayerCommand(mTask, layer_premult);
+        // the library coefficients overwrite the banks that the writer programmed
+        mHdrWriter.discardCommands();
     }
 
     debug_show_g2d_task(mTask);
@@ -1149,17 +1151,19 @@ bool AcrylicCompositorG2D9810::executeG2D(int fence[], unsigned int num_fences,
     if (ioctlG2D() < 0) {
         ALOGERR("Failed to process a task");
         show_g2d_task(mTask);
+        mHdrWriter.discardCommands();
         return false;
     }
 
-    mHdrWriter.putCommands();
-
     if (!!(mTask.flags & G2D_FLAG_ERROR)) {
         ALOGE("Error occurred during processing a task to G2D");
         show_g2d_task(mTask);
+        mHdrWriter.discardCommands();
         return false;
     }
 
+    mHdrWriter.putCommands();
+
     getCanvas().clearSettingModified();
     getCanvas().setFence(-1);
 
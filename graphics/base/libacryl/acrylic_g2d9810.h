@@ -89,6 +89,20 @@ public:
         return mCmds ? mCmds->command_count : 0;
     }
 
+    // The writer may leave the coefficients of the previous task in G2D and
+    // write no command. The HDR modes of the layers tell if the writer uses them.
+    bool hasHdrMode() {
+        if (!mCmds)
+            return false;
+
+        for (unsigned int i = 0; i < mCmds->layer_count; i++) {
+            if (mCmds->layer_hdr_mode[i].value)
+                return true;
+        }
+
+        return false;
+    }
+
     unsigned int write(g2d_reg *regs) {
         if (mCmds) {
             memcpy(regs, mCmds->commands, sizeof(*regs) * mCmds->command_count);
@@ -109,6 +123,15 @@ public:
             mCmds = nullptr;
         }
     }
+
+    // Drops the commands that G2D failed to process without putting them.
+    // Also called when the HDR coefficients are programmed without the writer.
+    // The writer then writes the coefficients again for the next task.
+    void discardCommands() {
+        if (mWriter)
+            mWriter->discardCommands();
+        mCmds = nullptr;
+    }
 };
 
 struct g2d_fmt;
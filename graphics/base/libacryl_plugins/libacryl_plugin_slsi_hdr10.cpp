@@ -15,7 +15,9 @@
  *  See the License for the specific language governing permissions and
  *  limitations under the License.
  */
+#include <atomic>
 #include <cassert>
+#include <cstring>
 
 #include <system/graphics.h>
 
@@ -396,8 +398,17 @@ uint32_t eotfOffset[NUM_EOTF_COEFFICIENTS] = {0x3200, 0x3000};
 uint32_t gmOffset[NUM_GM_COEFFICIENTS]     = {0x3500, 0x3400};
 uint32_t tmOffset[NUM_TM_COEFFICIENTS]     = {0x3700, 0x3600};
 
+enum { HDR_MATRIX_MAX_INDEX = 2 };
+
+// Coefficient tables held by each bank of the HDR processor.
+// The tables are static, so a bank is identified by the table it points to.
+struct HDRMatrixBanks {
+    uint32_t *eotf[HDR_MATRIX_MAX_INDEX];
+    uint32_t *gm[HDR_MATRIX_MAX_INDEX];
+    uint32_t *tm[HDR_MATRIX_MAX_INDEX];
+};
+
 class HDRMatrixWriter {
-    enum { HDR_MATRIX_MAX_INDEX = 2 };
 public:
     HDRMatrixWriter(unsigned int dataspace)
                     : eotfMatrix{0}, gmMatrix{0}, tmMatrix{0},
@@ -462,21 +473,38 @@ public:
         return count;
     }
 
-    unsigned int write(g2d_reg regs[]) {
+    // Writes the coefficients of the configured banks.
+    // If @programmed is given, banks that already hold the required table are skipped
+    // and @programmed is updated with the tables written.
+    unsigned int write(g2d_reg regs[], HDRMatrixBanks *programmed = nullptr) {
         unsigned int count = 0;
 
         for (unsigned int i = 0; i < eotfCount; i++)
-            count += writeMatrix(&regs[count], eotfMatrix[i], eotfOffset[i], NUM_EOTF_COEFFICIENTS);
+            count += writeBank(&regs[count], eotfMatrix[i], eotfOffset[i], NUM_EOTF_COEFFICIENTS,
+                               programmed ? &programmed->eotf[i] : nullptr);
 
         for (unsigned int i = 0; i < gmCount; i++)
-            count += writeMatrix(&regs[count], gmMatrix[i], gmOffset[i], NUM_GM_COEFFICIENTS);
+            count += writeBank(&regs[count], gmMatrix[i], gmOffset[i], NUM_GM_COEFFICIENTS,
+                               programmed ? &programmed->gm[i] : nullptr);
 
         for (unsigned int i = 0; i < tmCount; i++)
-            count += writeMatrix(&regs[count], tmMatrix[i], tmOffset[i], NUM_TM_COEFFICIENTS);
+            count += writeBank(&regs[count], tmMatrix[i], tmOffset[i], NUM_TM_COEFFICIENTS,
+                               programmed ? &programmed->tm[i] : nullptr);
 
         return count;
     }
 private:
+    unsigned int writeBank(g2d_reg regs[], uint32_t matrix[], uint32_t offset, unsigned int count,
+                           uint32_t **programmed) {
+        if (programmed) {
+            if (*programmed == matrix)
+                return 0;
+            *programmed = matrix;
+        }
+
+        return writeMatrix(regs, matrix, offset, count);
+    }
+
     unsigned int writeMatrix(g2d_reg regs[], uint32_t matrix[], uint32_t offset, unsigned int count) {
         for (unsigned int idx = 0; idx < count; idx++) {
             regs[idx].offset = offset;
@@ -533,6 +561,21 @@ private:
 #define NUM_HDR_COEFFICIENTS  (2 * (NUM_EOTF_COEFFICIENTS + NUM_GM_COEFFICIENTS + NUM_TM_COEFFICIENTS))
 #define NUM_HDR_REGS (NUM_HDR_COEFFICIENTS + MAX_LAYER_COUNT)
 
+// The command list of the previous frame is kept and reused as it is
+// if the target dataspace and the (dataspace, max luminance, premult) of every layer
+// are not changed.
+//
+// Only the coefficient banks whose tables differ from the ones written by the previous
+// command list are emitted.
+// A command list is regarded as written when it is returned by putCommands(). The caller
+// should not put a command list that G2D failed to process, and should call
+// discardCommands() instead or when it programs the HDR coefficients by itself.
+// The command count is zero when no bank needs to be written but the layer HDR modes
+// still enable the HDR processing with the banks programmed before.
+// It relies on G2D keeping the HDR coefficient registers between tasks. The writers of
+// a process share a generation of the G2D coefficients: a writer forgets its banks once
+// another writer put or discarded commands after it. Tasks of writers that are not
+// serialized, or G2D clients in other processes, are not tracked.
 class G2DHdr10CommandWriter: public IG2DHdr10CommandWriter {
     int mLayerMap;
     int mLayerAlphaMap;
@@ -540,9 +583,65 @@ class G2DHdr10CommandWriter: public IG2DHdr10CommandWriter {
     int mLayerDataspace[MAX_LAYER_COUNT];
     unsigned int mLayerMaxLuminance[MAX_LAYER_COUNT];
     struct g2d_commandlist mCommandList;
+
+    // configuration that mCommandList is built for
+    bool mCacheValid;
+    int mCachedLayerMap;
+    int mCachedLayerAlphaMap;
+    int mCachedTargetDataspace;
+    int mCachedLayerDataspace[MAX_LAYER_COUNT];
+    unsigned int mCachedLayerMaxLuminance[MAX_LAYER_COUNT];
+    // banks programmed by the command lists put so far
+    HDRMatrixBanks mProgrammedBanks;
+    // banks programmed after mCommandList is written
+    HDRMatrixBanks mPendingBanks;
+    // mCommandList is returned by getCommands() and is not put yet
+    bool mCommandsPending;
+    // generation of the G2D coefficients after mProgrammedBanks are written
+    unsigned int mGeneration;
+
+    static std::atomic<unsigned int> sGeneration;
+
+    void forgetProgrammedBanks() {
+        memset(&mProgrammedBanks, 0, sizeof(mProgrammedBanks));
+        mCacheValid = false;
+    }
+
+    bool isCachedConfiguration(int layerMap, int layerAlphaMap) {
+        if (!mCacheValid || (layerMap != mCachedLayerMap) ||
+            (layerAlphaMap != mCachedLayerAlphaMap) || (mTargetDataspace != mCachedTargetDataspace))
+            return false;
+
+        for (unsigned int i = 0; i < MAX_LAYER_COUNT; i++) {
+            if (!(layerMap & (1 << i)))
+                continue;
+
+            if ((mLayerDataspace[i] != mCachedLayerDataspace[i]) ||
+                (mLayerMaxLuminance[i] != mCachedLayerMaxLuminance[i]))
+                return false;
+        }
+
+        return true;
+    }
+
+    void updateCachedConfiguration(int layerMap, int layerAlphaMap) {
+        mCachedLayerMap = layerMap;
+        mCachedLayerAlphaMap = layerAlphaMap;
+        mCachedTargetDataspace = mTargetDataspace;
+        memcpy(mCachedLayerDataspace, mLayerDataspace, sizeof(mCachedLayerDataspace));
+        memcpy(mCachedLayerMaxLuminance, mLayerMaxLuminance, sizeof(mCachedLayerMaxLuminance));
+        mCacheValid = true;
+    }
 public:
     G2DHdr10CommandWriter() : mLayerMap(0), mLayerAlphaMap(0), mTargetDataspace(HAL_DATASPACE_TRANSFER_SRGB),
-                              mCommandList{nullptr, nullptr, 0, 0} {
+                              mLayerDataspace{0}, mLayerMaxLuminance{0},
+                              mCommandList{nullptr, nullptr, 0, 0}, mCacheValid(false),
+                              mCachedLayerMap(0), mCachedLayerAlphaMap(0), mCachedTargetDataspace(0),
+                              mCachedLayerDataspace{0}, mCachedLayerMaxLuminance{0} {
+        memset(&mProgrammedBanks, 0, sizeof(mProgrammedBanks));
+        memset(&mPendingBanks, 0, sizeof(mPendingBanks));
+        mCommandsPending = false;
+        mGeneration = sGeneration.load();
     }
     ~G2DHdr10CommandWriter() { delete [] mCommandList.commands; }
 
@@ -588,6 +687,24 @@ public:
             mCommandList.layer_hdr_mode = cmds + NUM_HDR_COEFFICIENTS;
         }
 
+        // Another writer programmed G2D after the banks of this writer are written.
+        if (mGeneration != sGeneration.load())
+            forgetProgrammedBanks();
+
+        // The previous command list is not put, so G2D may not have written it.
+        // Build the list again against the banks known to be programmed.
+        if (mCommandsPending)
+            mCacheValid = false;
+
+        if (isCachedConfiguration(LayerMap, LayerAlphaMap)) {
+            // all banks required by the cached list are already programmed
+            mCommandList.command_count = 0;
+            mCommandsPending = true;
+            return &mCommandList;
+        }
+
+        mCacheValid = false;
+
         HDRMatrixWriter hdrMatrixWriter(mTargetDataspace);
 
         mCommandList.layer_count = 0;
@@ -612,16 +729,32 @@ public:
             mCommandList.layer_count++;
         }
 
-        mCommandList.command_count = hdrMatrixWriter.write(mCommandList.commands);
+        mPendingBanks = mProgrammedBanks;
+        mCommandList.command_count = hdrMatrixWriter.write(mCommandList.commands, &mPendingBanks);
+        mCommandsPending = true;
+
+        updateCachedConfiguration(LayerMap, LayerAlphaMap);
 
         return &mCommandList;
     }
 
     void putCommands(struct g2d_commandlist __unused *commands) {
         assert(commands == &mCommandList);
+        mProgrammedBanks = mPendingBanks;
+        mCommandsPending = false;
+        mGeneration = ++sGeneration;
+    }
+
+    void discardCommands() {
+        // G2D may have written a part of the commands: none of the banks are known
+        forgetProgrammedBanks();
+        mCommandsPending = false;
+        sGeneration++;
     }
 };
 
+std::atomic<unsigned int> G2DHdr10CommandWriter::sGeneration(0);
+
 IG2DHdr10CommandWriter *IG2DHdr10CommandWriter::createInstance() {
     return new G2DHdr10CommandWriter();
 }
@@ -0,0 +1,192 @@
+/*
+ *  libacryl_plugins/tests/Hdr10CommandWriterBenchmark.cpp
+ *
+ *   Copyright 2018 Samsung Electronics Co., Ltd.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <system/graphics.h>
+#include <hardware/exynos/g2d9810_hdr_plugin.h>
+
+namespace {
+
+struct LayerDesc {
+    int dataspace;
+    unsigned int maxLuminance;
+    bool premult;
+};
+
+typedef std::vector<LayerDesc> Frame;
+
+const int kSrgb = HAL_DATASPACE_V0_SRGB;
+const int kHdr10 = HAL_DATASPACE_STANDARD_BT2020 | HAL_DATASPACE_TRANSFER_ST2084 | HAL_DATASPACE_RANGE_LIMITED;
+const int kHlg = HAL_DATASPACE_STANDARD_BT2020 | HAL_DATASPACE_TRANSFER_HLG | HAL_DATASPACE_RANGE_LIMITED;
+const int kP3 = HAL_DATASPACE_DISPLAY_P3;
+
+struct Replay {
+    unsigned int frames;
+    unsigned int regs;
+};
+
+struct g2d_commandlist *submit(IG2DHdr10CommandWriter *writer, int target, const Frame &frame) {
+    for (unsigned int i = 0; i < frame.size(); i++) {
+        writer->setLayerStaticMetadata(i, frame[i].dataspace, 0, frame[i].maxLuminance);
+        writer->setLayerImageInfo(i, 0, frame[i].premult);
+    }
+    writer->setTargetInfo(target, nullptr);
+
+    return writer->getCommands();
+}
+
+// Replays @frames and checks every command list against the one built from scratch.
+// The reference lists are not put: G2D is programmed by @writer only.
+// Every @failPeriod-th task fails in G2D, so its command list is not written nor put.
+Replay replay(const char *name, int target, const std::vector<Frame> &frames, unsigned int failPeriod = 0) {
+    std::unique_ptr<IG2DHdr10CommandWriter> writer(IG2DHdr10CommandWriter::createInstance());
+    std::map<uint32_t, uint32_t> g2dRegs;
+    Replay result = {0, 0};
+
+    for (const Frame &frame : frames) {
+        bool failed = failPeriod && ((result.frames % failPeriod) == failPeriod - 1);
+        struct g2d_commandlist *cmds = submit(writer.get(), target, frame);
+        std::unique_ptr<IG2DHdr10CommandWriter> fresh(IG2DHdr10CommandWriter::createInstance());
+        struct g2d_commandlist *ref = submit(fresh.get(), target, frame);
+
+        EXPECT_EQ(ref == nullptr, cmds == nullptr);
+        if (cmds && ref) {
+            EXPECT_EQ(ref->layer_count, cmds->layer_count);
+            for (unsigned int i = 0; i < ref->layer_count; i++) {
+                EXPECT_EQ(ref->layer_hdr_mode[i].offset, cmds->layer_hdr_mode[i].offset);
+                EXPECT_EQ(ref->layer_hdr_mode[i].value, cmds->layer_hdr_mode[i].value);
+            }
+            EXPECT_LE(cmds->command_count, ref->command_count);
+            result.regs += cmds->command_count;
+            if (!failed) {
+                for (unsigned int i = 0; i < cmds->command_count; i++)
+                    g2dRegs[cmds->commands[i].offset] = cmds->commands[i].value;
+                writer->putCommands(cmds);
+
+                // G2D holds the coefficients that the layers are converted with
+                for (unsigned int i = 0; i < ref->command_count; i++)
+                    EXPECT_EQ(ref->commands[i].value, g2dRegs[ref->commands[i].offset]);
+            }
+        }
+        result.frames++;
+    }
+
+    printf("%-28s %5u frames, %7.1f register writes/frame (%u bytes/frame)\n", name,
+           result.frames, static_cast<double>(result.regs) / result.frames,
+           static_cast<unsigned int>(result.regs * sizeof(g2d_reg) / result.frames));
+
+    return result;
+}
+
+} // namespace
+
+TEST(Hdr10CommandWriterBenchmark, HdrVideoOverUi)
+{
+    std::vector<Frame> frames(600, Frame{{kHdr10, 1000, false}, {kSrgb, 0, true}, {kSrgb, 0, true}});
+
+    Replay r = replay("HDR10 video + UI", kSrgb, frames);
+
+    EXPECT_EQ(600u, r.frames);
+}
+
+TEST(Hdr10CommandWriterBenchmark, HdrVideoLuminanceChange)
+{
+    std::vector<Frame> frames;
+
+    // mastering luminance of the stream changes every second
+    for (unsigned int i = 0; i < 600; i++)
+        frames.push_back(Frame{{kHdr10, (i / 60) % 2 ? 4000u : 1000u, false}, {kSrgb, 0, true}});
+
+    replay("HDR10 luminance switching", kSrgb, frames);
+}
+
+TEST(Hdr10CommandWriterBenchmark, HlgVideoWithPopup)
+{
+    std::vector<Frame> frames;
+
+    // a P3 popup comes and goes over HLG video
+    for (unsigned int i = 0; i < 600; i++) {
+        Frame frame{{kHlg, 1000, false}, {kSrgb, 0, true}};
+        if ((i / 90) % 2)
+            frame.push_back({kP3, 0, true});
+        frames.push_back(frame);
+    }
+
+    replay("HLG video + P3 popup", kSrgb, frames);
+}
+
+TEST(Hdr10CommandWriterBenchmark, UiOnly)
+{
+    std::vector<Frame> frames(600, Frame{{kSrgb, 0, true}, {kSrgb, 0, true}});
+
+    Replay r = replay("sRGB UI only", kSrgb, frames);
+
+    EXPECT_EQ(0u, r.regs);
+}
+
+TEST(Hdr10CommandWriterBenchmark, FailedTasks)
+{
+    std::vector<Frame> frames;
+
+    for (unsigned int i = 0; i < 600; i++)
+        frames.push_back(Frame{{kHdr10, (i / 60) % 2 ? 4000u : 1000u, false}, {kSrgb, 0, true}});
+
+    // every 7th task fails, including the first one at 4000 nits
+    replay("HDR10 with failing tasks", kSrgb, frames, 7);
+}
+
+TEST(Hdr10CommandWriterBenchmark, SharedG2D)
+{
+    std::unique_ptr<IG2DHdr10CommandWriter> video(IG2DHdr10CommandWriter::createInstance());
+    std::unique_ptr<IG2DHdr10CommandWriter> popup(IG2DHdr10CommandWriter::createInstance());
+    Frame videoFrame{{kHdr10, 1000, false}, {kSrgb, 0, true}};
+    Frame popupFrame{{kHlg, 1000, false}, {kP3, 0, true}};
+    std::map<uint32_t, uint32_t> g2dRegs;
+
+    // two writers take turns on G2D, and the HDR library programs it in between
+    for (unsigned int i = 0; i < 60; i++) {
+        IG2DHdr10CommandWriter *writer = (i % 3) ? video.get() : popup.get();
+        const Frame &frame = (i % 3) ? videoFrame : popupFrame;
+        struct g2d_commandlist *cmds = submit(writer, kSrgb, frame);
+        std::unique_ptr<IG2DHdr10CommandWriter> fresh(IG2DHdr10CommandWriter::createInstance());
+        struct g2d_commandlist *ref = submit(fresh.get(), kSrgb, frame);
+
+        ASSERT_TRUE(cmds != nullptr);
+        ASSERT_TRUE(ref != nullptr);
+
+        if ((i % 10) == 9) {
+            for (unsigned int j = 0; j < ref->command_count; j++)
+                g2dRegs[ref->commands[j].offset] = ~0U;
+            writer->discardCommands();
+            continue;
+        }
+
+        for (unsigned int j = 0; j < cmds->command_count; j++)
+            g2dRegs[cmds->commands[j].offset] = cmds->commands[j].value;
+        writer->putCommands(cmds);
+
+        for (unsigned int j = 0; j < ref->command_count; j++)
+            EXPECT_EQ(ref->commands[j].value, g2dRegs[ref->commands[j].offset]) << "task " << i;
+    }
+}
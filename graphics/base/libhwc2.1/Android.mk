@@ -81,6 +81,7 @@ LOCAL_SRC_FILES := \
 	display/ExynosDisplay.cpp \
 	display/ExynosDisplayDrmInterface.cpp \
 	display/ExynosDrmFramebufferManager.cpp \
+	display/ExynosDrmStateShadow.cpp \
 	display/ExynosDisplayFbInterface.cpp \
 	display/ExynosDisplayInterface.cpp \
 	display/ExynosLayer.cpp \
@@ -318,3 +319,18 @@ LOCAL_MODULE := hwcomposer_unittest
 
 include $(TOP)/hardware/samsung_slsi/graphics/base/BoardConfigCFlags.mk
 include $(BUILD_EXECUTABLE)
+
+################################################################################
+include $(CLEAR_VARS)
+
+LOCAL_SHARED_LIBRARIES := liblog libutils libdrm
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/display
+
+LOCAL_SRC_FILES := \
+	display/ExynosDrmStateShadow.cpp \
+	unittests/DrmStateShadowTest.cpp
+
+LOCAL_CFLAGS += -Wno-unused-parameter
+LOCAL_MODULE := hwcomposer_drmstateshadow_test
+
+include $(BUILD_HOST_NATIVE_TEST)
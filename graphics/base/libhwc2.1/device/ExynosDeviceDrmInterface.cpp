@@ -17,6 +17,7 @@
 #include <drm/drm_mode.h>
 #include "exynos_drm_modifier.h"
 #include "ExynosDeviceDrmInterface.h"
+#include "ExynosDrmStateShadow.h"
 #include "ExynosHWCDebug.h"
 #include <hardware/hwcomposer_defs.h>
 #include "DeconDrmHeader.h"
@@ -157,6 +158,7 @@ int32_t ExynosDeviceDrmInterface::getRestrictions(struct dpp_restrictions_info_v
 }
 
 void ExynosDeviceDrmInterface::HandleEvent(uint64_t timestamp_us) {
+    DrmStateShadow::getInstance().invalidate();
     if (mHotplugHandler == NULL)
         return;
     mHotplugHandler->handleHotplug();
@@ -195,6 +197,7 @@ void ExynosDeviceDrmInterface::setDppChannelRestriction(struct dpp_ch_restrictio
         common_restriction.restriction.scale_up = 1;
 }
 void ExynosDeviceDrmInterface::HandlePanelEvent(uint64_t timestamp_us) {
+    DrmStateShadow::getInstance().invalidate();
     if (mPanelResetHandler == NULL)
         return;
     mPanelResetHandler->handlePanelReset();
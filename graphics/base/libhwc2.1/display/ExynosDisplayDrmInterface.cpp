@@ -35,20 +35,6 @@ constexpr float CONSTANT_FOR_DP_MIN_LUMINANCE = 255.0f * 255.0f / 100.0f;
 constexpr auto nsecsPerSec = std::chrono::nanoseconds(1s).count();
 constexpr bool kUseBufferCaching = true;
 
-typedef struct _drmModeAtomicReqItem drmModeAtomicReqItem, *drmModeAtomicReqItemPtr;
-
-struct _drmModeAtomicReqItem {
-    uint32_t object_id;
-    uint32_t property_id;
-    uint64_t value;
-};
-
-struct _drmModeAtomicReq {
-    uint32_t cursor;
-    uint32_t size_items;
-    drmModeAtomicReqItemPtr items;
-};
-
 extern struct exynos_hwc_control exynosHWCControl;
 static const int32_t kUmPerInch = 25400;
 
@@ -63,6 +49,7 @@ ExynosDisplayDrmInterface::ExynosDisplayDrmInterface()
       mDrmConnector(nullptr) {
     mType = INTERFACE_TYPE_DRM;
     mDrmReq.init(this);
+    mDrmReq.setDeltaCommit(true);
 }
 
 ExynosDisplayDrmInterface::~ExynosDisplayDrmInterface() {
@@ -70,16 +57,12 @@ ExynosDisplayDrmInterface::~ExynosDisplayDrmInterface() {
         removeFbs(mDrmDevice->fd(), mOldFbIds);
         removeFbs(mDrmDevice->fd(), mFbIds);
 
-        if (mActiveModeState.blob_id)
-            mDrmDevice->DestroyPropertyBlob(mActiveModeState.blob_id);
-        if (mActiveModeState.old_blob_id)
-            mDrmDevice->DestroyPropertyBlob(mActiveModeState.old_blob_id);
-        if (mDesiredModeState.blob_id)
-            mDrmDevice->DestroyPropertyBlob(mDesiredModeState.blob_id);
-        if (mDesiredModeState.old_blob_id)
-            mDrmDevice->DestroyPropertyBlob(mDesiredModeState.old_blob_id);
-        if (mPartialRegionState.blob_id)
-            mDrmDevice->DestroyPropertyBlob(mPartialRegionState.blob_id);
+        mStateShadow.releaseBlob(mActiveModeState.blob_id);
+        mStateShadow.releaseBlob(mActiveModeState.old_blob_id);
+        mStateShadow.releaseBlob(mDesiredModeState.blob_id);
+        mStateShadow.releaseBlob(mDesiredModeState.old_blob_id);
+        mStateShadow.releaseBlob(mPartialRegionState.blob_id);
+        mStateShadow.releaseBlob(mHdrOutputMetaBlobId);
     }
 }
 
@@ -247,6 +230,14 @@ void ExynosDisplayDrmInterface::initDrmDevice(DrmDevice *drmDevice, int drmDispl
         return;
     }
 
+    mStateShadow.init(
+        [drmDevice](void *data, size_t length, uint32_t *blobId) -> int {
+            return drmDevice->CreatePropertyBlob(data, length, blobId);
+        },
+        [drmDevice](uint32_t blobId) -> int {
+            return drmDevice->DestroyPropertyBlob(blobId);
+        });
+
     if (mDisplayIdentifier.type != HWC_DISPLAY_EXTERNAL)
         mWritebackInfo.init(mDrmDevice, drmDisplayId);
 
@@ -271,6 +262,8 @@ void ExynosDisplayDrmInterface::initDrmDevice(DrmDevice *drmDevice, int drmDispl
 
     getLowPowerDrmModeModeInfo();
 
+    initDeltaPolicies();
+
     if (!mDrmDevice->planes().empty()) {
         auto &plane = mDrmDevice->planes().front();
         parseBlendEnums(plane->blend_property());
@@ -301,6 +294,32 @@ void ExynosDisplayDrmInterface::initDrmDevice(DrmDevice *drmDevice, int drmDispl
     return;
 }
 
+void ExynosDisplayDrmInterface::initDeltaPolicies() {
+    /*
+     * Fds, fence pointers and writeback properties are not registered,
+     * they are added to every commit.
+     */
+    for (auto &plane : mDrmDevice->planes()) {
+        for (auto property : {&plane->crtc_property(),
+                              &plane->crtc_x_property(), &plane->crtc_y_property(),
+                              &plane->crtc_w_property(), &plane->crtc_h_property(),
+                              &plane->src_x_property(), &plane->src_y_property(),
+                              &plane->src_w_property(), &plane->src_h_property(),
+                              &plane->rotation_property(), &plane->blend_property(),
+                              &plane->zpos_property(), &plane->alpha_property(),
+                              &plane->colormap_property(), &plane->standard_property(),
+                              &plane->transfer_property(), &plane->range_property(),
+                              &plane->virtual8k_split_property()})
+            mStateShadow.setDeltaPolicy(property->id(), DrmStateShadow::DELTA_VALUE);
+        mStateShadow.setDeltaPolicy(plane->fb_property().id(), DrmStateShadow::DELTA_ZERO);
+    }
+
+    mStateShadow.setDeltaPolicy(mDrmCrtc->partial_region_property().id(),
+                                DrmStateShadow::DELTA_BLOB);
+    mStateShadow.setDeltaPolicy(mDrmConnector->hdr_output_meta().id(),
+                                DrmStateShadow::DELTA_BLOB);
+}
+
 void ExynosDisplayDrmInterface::Callback(
     int display, int64_t timestamp) {
     mVsyncHandler->handleVsync(timestamp);
@@ -391,6 +410,8 @@ int32_t ExynosDisplayDrmInterface::setPowerMode(int32_t mode) {
                                            dpms_value)) != NO_ERROR) {
         HWC_LOGE(mDisplayIdentifier, "setPower mode ret (%d)", ret);
     }
+    /* The planes can be reset by the driver */
+    mStateShadow.invalidate();
 
     if (mode == HWC_POWER_MODE_OFF) {
         if (mDisplayIdentifier.type == HWC_DISPLAY_VIRTUAL) {
@@ -752,8 +773,7 @@ int32_t ExynosDisplayDrmInterface::createModeBlob(const DrmMode &mode,
     mode.ToDrmModeModeInfo(&drm_mode);
 
     modeBlob = 0;
-    int ret = mDrmDevice->CreatePropertyBlob(&drm_mode, sizeof(drm_mode),
-                                             &modeBlob);
+    int ret = mStateShadow.internBlob(&drm_mode, sizeof(drm_mode), modeBlob);
     if (ret) {
         HWC_LOGE(mDisplayIdentifier, "Failed to create mode property blob %d", ret);
         return ret;
@@ -789,7 +809,8 @@ int32_t ExynosDisplayDrmInterface::clearActiveDrmMode() {
     DrmModeAtomicReq drmReq(this);
 
     if (mActiveModeState.blob_id) {
-        mDrmDevice->DestroyPropertyBlob(mActiveModeState.blob_id);
+        mStateShadow.releaseBlob(mActiveModeState.blob_id);
+        mStateShadow.releaseBlob(mActiveModeState.old_blob_id);
         mActiveModeState.reset();
     }
 
@@ -1094,6 +1115,8 @@ int32_t ExynosDisplayDrmInterface::setFrameStaticMeta(DrmModeAtomicReq &drmReq,
 
     if (config.metaParcel != nullptr) {
         struct hdr_output_metadata drm_hdr_meta;
+        /* The blob is interned by its content, padding included */
+        memset(&drm_hdr_meta, 0, sizeof(drm_hdr_meta));
         drm_hdr_meta.hdmi_metadata_type1.display_primaries[0].x =
             static_cast<__u16>(config.metaParcel->sHdrStaticInfo.sType1.mR.x);
         drm_hdr_meta.hdmi_metadata_type1.display_primaries[0].y =
@@ -1116,13 +1139,16 @@ int32_t ExynosDisplayDrmInterface::setFrameStaticMeta(DrmModeAtomicReq &drmReq,
             static_cast<__u16>(config.metaParcel->sHdrStaticInfo.sType1.mMaxFrameAverageLightLevel);
 
         uint32_t blob_id = 0;
-        ret = mDrmDevice->CreatePropertyBlob(&drm_hdr_meta, sizeof(drm_hdr_meta), &blob_id);
+        ret = mStateShadow.internBlob(&drm_hdr_meta, sizeof(drm_hdr_meta), blob_id);
         if (ret || (blob_id == 0)) {
             HWC_LOGE(mDisplayIdentifier, "Failed to create static meta"
                                          "blob id=%d, ret=%d",
                      blob_id, ret);
             return ret;
         }
+        /* Previous blob is released after commit, same meta keeps the same blob */
+        drmReq.addOldBlob(mHdrOutputMetaBlobId);
+        mHdrOutputMetaBlobId = blob_id;
 
         if ((ret = drmReq.atomicAddProperty(mDrmConnector->id(),
                                             mDrmConnector->hdr_output_meta(),
@@ -1130,11 +1156,29 @@ int32_t ExynosDisplayDrmInterface::setFrameStaticMeta(DrmModeAtomicReq &drmReq,
             HWC_LOGE(mDisplayIdentifier, "Failed to set hdr_output_meta property %d", ret);
             return ret;
         }
+        mHdrOutputMetaUpdated = true;
     }
 
     return ret;
 }
 
+int32_t ExynosDisplayDrmInterface::clearFrameStaticMeta(DrmModeAtomicReq &drmReq) {
+    if (mHdrOutputMetaUpdated || (mHdrOutputMetaBlobId == 0))
+        return NO_ERROR;
+
+    /* No HDR layer in this frame: clear the meta and release its blob after commit */
+    int ret = drmReq.atomicAddProperty(mDrmConnector->id(),
+                                       mDrmConnector->hdr_output_meta(), 0);
+    if (ret < 0) {
+        HWC_LOGE(mDisplayIdentifier, "Failed to clear hdr_output_meta property %d", ret);
+        return ret;
+    }
+    drmReq.addOldBlob(mHdrOutputMetaBlobId);
+    mHdrOutputMetaBlobId = 0;
+
+    return NO_ERROR;
+}
+
 int32_t ExynosDisplayDrmInterface::setupPartialRegion(
     exynos_dpu_data &dpuData, DrmModeAtomicReq &drmReq) {
     if (!mDrmCrtc->partial_region_property().id())
@@ -1152,8 +1196,7 @@ int32_t ExynosDisplayDrmInterface::setupPartialRegion(
     if ((mPartialRegionState.blob_id == 0) ||
         mPartialRegionState.isUpdated(partial_rect)) {
         uint32_t blob_id = 0;
-        ret = mDrmDevice->CreatePropertyBlob(&partial_rect,
-                                             sizeof(partial_rect), &blob_id);
+        ret = mStateShadow.internBlob(&partial_rect, sizeof(partial_rect), blob_id);
         if (ret || (blob_id == 0)) {
             HWC_LOGE(mDisplayIdentifier, "Failed to create partial region "
                                          "blob id=%d, ret=%d",
@@ -1294,6 +1337,7 @@ int32_t ExynosDisplayDrmInterface::deliverWinConfigData(exynos_dpu_data &dpuData
     }
 
     size_t virtualPlaneIndex = 0;
+    mHdrOutputMetaUpdated = false;
     for (exynos_win_config_data &config : dpuData.configs) {
         if ((config.state != config.WIN_STATE_BUFFER) &&
             (config.state != config.WIN_STATE_COLOR) &&
@@ -1348,6 +1392,9 @@ int32_t ExynosDisplayDrmInterface::deliverWinConfigData(exynos_dpu_data &dpuData
         }
     }
 
+    if ((ret = clearFrameStaticMeta(mDrmReq)) < 0)
+        return ret;
+
     /* Disable unused plane */
     disablePlanes(mDrmReq, planeEnableInfo);
 
@@ -1598,8 +1645,8 @@ int32_t ExynosDisplayDrmInterface::DrmModeAtomicReq::atomicAddProperty(
     }
 
     if (property.id()) {
-        int ret = drmModeAtomicAddProperty(mPset, id,
-                                           property.id(), value);
+        int ret = mDrmDisplayInterface->mStateShadow.addProperty(mPset, id, property.id(),
+                                                                 value, mDeltaCommit);
         if (ret < 0) {
             HWC_LOGE(mDrmDisplayInterface->mDisplayIdentifier, "%s:: Failed to add property %d(%s) for id(%d), ret(%d)",
                      __func__, property.id(), property.name().c_str(), id, ret);
@@ -1695,6 +1742,7 @@ int ExynosDisplayDrmInterface::DrmModeAtomicReq::commit(uint32_t flags, bool log
         HWC_LOGE(mDrmDisplayInterface->mDisplayIdentifier, "commit error");
         setError(ret);
     }
+    mDrmDisplayInterface->mStateShadow.commitDone(mPset, flags, ret);
 
     return ret;
 }
@@ -2044,6 +2092,7 @@ bool ExynosDisplayDrmInterface::updateHdrSinkInfo() {
 
 void ExynosDisplayDrmInterface::onDisplayRemoved() {
     mFBManager.onDisplayRemoved(mDisplayIdentifier.type);
+    mStateShadow.invalidate();
 }
 
 int32_t ExynosDisplayDrmInterface::setWorkingVsyncPeriodProp(DrmModeAtomicReq &drmReq) {
@@ -28,6 +28,7 @@
 #include "ExynosMPP.h"
 #include "ExynosHWCTypes.h"
 #include "ExynosDrmFramebufferManager.h"
+#include "ExynosDrmStateShadow.h"
 #include "drmconnector.h"
 #include "drmcrtc.h"
 #include "vsyncworker.h"
@@ -64,6 +65,8 @@ class ExynosDisplayDrmInterface : public ExynosDisplayInterface,
         void reset();
         void setError(int err) { mError = err; };
         int getError() { return mError; };
+        /* Leave out the properties committed already, see DrmStateShadow */
+        void setDeltaCommit(bool enable) { mDeltaCommit = enable; };
         int32_t atomicAddProperty(const uint32_t id,
                                   const DrmProperty &property,
                                   uint64_t value, bool optional = false);
@@ -73,21 +76,24 @@ class ExynosDisplayDrmInterface : public ExynosDisplayInterface,
             mOldBlobs.push_back(blob_id);
         };
         int destroyOldBlobs() {
+            /* A reference is dropped once, so the list is cleared even on error */
+            int err = NO_ERROR;
             for (auto &blob : mOldBlobs) {
-                int ret = mDrmDisplayInterface->mDrmDevice->DestroyPropertyBlob(blob);
+                int ret = mDrmDisplayInterface->mStateShadow.releaseBlob(blob);
                 if (ret) {
                     HWC_LOGE(mDrmDisplayInterface->mDisplayIdentifier,
                              "Failed to destroy old blob after commit %d", ret);
-                    return ret;
+                    err = ret;
                 }
             }
             mOldBlobs.clear();
-            return NO_ERROR;
+            return err;
         };
 
       private:
         drmModeAtomicReqPtr mPset = nullptr;
         int mError = 0;
+        bool mDeltaCommit = false;
         ExynosDisplayDrmInterface *mDrmDisplayInterface = NULL;
         /* Destroy old blobs after commit */
         std::vector<uint32_t> mOldBlobs;
@@ -262,6 +268,7 @@ class ExynosDisplayDrmInterface : public ExynosDisplayInterface,
 
     int32_t setFrameStaticMeta(DrmModeAtomicReq &drmReq,
                                const exynos_win_config_data &config);
+    int32_t clearFrameStaticMeta(DrmModeAtomicReq &drmReq);
 
     int32_t setupPartialRegion(exynos_dpu_data &dpuData,
                                DrmModeAtomicReq &drmReq);
@@ -276,6 +283,7 @@ class ExynosDisplayDrmInterface : public ExynosDisplayInterface,
     void parseColorModeEnums(const DrmProperty &property);
     void parsePanelTypeEnums(const DrmProperty &property);
     void parseVirtual8kEnums(const DrmProperty &property);
+    void initDeltaPolicies();
 
     void disablePlanes(DrmModeAtomicReq &drmReq,
                        uint32_t *planeEnableInfo = nullptr);
@@ -329,6 +337,9 @@ class ExynosDisplayDrmInterface : public ExynosDisplayInterface,
     ModeState mActiveModeState;
     ModeState mDesiredModeState;
     PartialRegionState mPartialRegionState;
+    uint32_t mHdrOutputMetaBlobId = 0;
+    /* hdr_output_meta is set by a layer of the frame being committed */
+    bool mHdrOutputMetaUpdated = false;
     /* Mapping plane id to ExynosMPP, key is plane id */
     std::unordered_map<uint32_t, ExynosMPP *> mExynosMPPsForPlane;
 
@@ -343,6 +354,7 @@ class ExynosDisplayDrmInterface : public ExynosDisplayInterface,
     DrmWritebackInfo mWritebackInfo;
 
     FramebufferManager &mFBManager = FramebufferManager::getInstance();
+    DrmStateShadow &mStateShadow = DrmStateShadow::getInstance();
 
     DrmModeAtomicReq mDrmReq;
     ColorRequest mColorRequest;
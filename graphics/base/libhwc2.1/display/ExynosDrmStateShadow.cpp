@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <errno.h>
+#include <log/log.h>
+#include <string.h>
+#include <utils/Errors.h>
+#include <drm/drm_mode.h>
+#include <string_view>
+#include "ExynosDrmStateShadow.h"
+
+ANDROID_SINGLETON_STATIC_INSTANCE(DrmStateShadow);
+
+void DrmStateShadow::init(CreateBlobFunc createBlob, DestroyBlobFunc destroyBlob) {
+    Mutex::Autolock lock(mMutex);
+    mCreateBlob = createBlob;
+    mDestroyBlob = destroyBlob;
+}
+
+void DrmStateShadow::setDeltaPolicy(uint32_t propertyId, DeltaPolicy policy) {
+    if (propertyId == 0)
+        return;
+
+    Mutex::Autolock lock(mMutex);
+    mDeltaPolicies[propertyId] = policy;
+}
+
+DrmStateShadow::DeltaPolicy DrmStateShadow::getDeltaPolicy(uint32_t propertyId) {
+    auto it = mDeltaPolicies.find(propertyId);
+    if (it == mDeltaPolicies.end())
+        return DELTA_NONE;
+    return it->second;
+}
+
+bool DrmStateShadow::isCommitted(uint32_t objectId, uint32_t propertyId, uint64_t value) {
+    Mutex::Autolock lock(mMutex);
+    DeltaPolicy policy = getDeltaPolicy(propertyId);
+    if ((policy == DELTA_NONE) ||
+        ((policy == DELTA_ZERO) && (value != 0)))
+        return false;
+
+    auto it = mCommitted.find(getKey(objectId, propertyId));
+    return ((it != mCommitted.end()) && (it->second == value));
+}
+
+void DrmStateShadow::update(uint32_t objectId, uint32_t propertyId, uint64_t value) {
+    Mutex::Autolock lock(mMutex);
+    if (getDeltaPolicy(propertyId) == DELTA_NONE)
+        return;
+
+    mCommitted[getKey(objectId, propertyId)] = value;
+}
+
+void DrmStateShadow::invalidate() {
+    Mutex::Autolock lock(mMutex);
+    mCommitted.clear();
+}
+
+int DrmStateShadow::addProperty(drmModeAtomicReqPtr pset, uint32_t objectId,
+                                uint32_t propertyId, uint64_t value, bool deltaCommit) {
+    if (deltaCommit && isCommitted(objectId, propertyId, value))
+        return NO_ERROR;
+
+    return drmModeAtomicAddProperty(pset, objectId, propertyId, value);
+}
+
+void DrmStateShadow::commitDone(drmModeAtomicReqPtr pset, uint32_t flags, int ret) {
+    /* Next commits carry the full state */
+    if ((ret < 0) || (flags & DRM_MODE_ATOMIC_ALLOW_MODESET)) {
+        invalidate();
+        return;
+    }
+
+    if (flags & DRM_MODE_ATOMIC_TEST_ONLY)
+        return;
+
+    for (int i = 0; i < drmModeAtomicGetCursor(pset); i++)
+        update(pset->items[i].object_id, pset->items[i].property_id, pset->items[i].value);
+}
+
+int32_t DrmStateShadow::internBlob(const void *data, size_t length, uint32_t &blobId) {
+    Mutex::Autolock lock(mMutex);
+    size_t hash = std::hash<std::string_view>()(
+        std::string_view(static_cast<const char *>(data), length));
+
+    auto range = mBlobsByHash.equal_range(hash);
+    for (auto it = range.first; it != range.second; it++) {
+        Blob &blob = mBlobs[it->second];
+        if ((blob.data.size() == length) &&
+            (memcmp(blob.data.data(), data, length) == 0)) {
+            blob.refCount++;
+            blobId = it->second;
+            return NO_ERROR;
+        }
+    }
+
+    blobId = 0;
+    if (!mCreateBlob)
+        return -EINVAL;
+
+    int ret = mCreateBlob(const_cast<void *>(data), length, &blobId);
+    if (ret || (blobId == 0)) {
+        ALOGE("%s:: Failed to create blob, blob id=%d, ret=%d", __func__, blobId, ret);
+        return ret ? ret : -EINVAL;
+    }
+
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    mBlobs[blobId] = {std::vector<uint8_t>(bytes, bytes + length), hash, 1};
+    mBlobsByHash.emplace(hash, blobId);
+
+    return NO_ERROR;
+}
+
+int32_t DrmStateShadow::releaseBlob(uint32_t blobId) {
+    if (blobId == 0)
+        return NO_ERROR;
+
+    Mutex::Autolock lock(mMutex);
+    auto it = mBlobs.find(blobId);
+    if (it != mBlobs.end()) {
+        if (--it->second.refCount > 0)
+            return NO_ERROR;
+
+        auto range = mBlobsByHash.equal_range(it->second.hash);
+        for (auto hashIt = range.first; hashIt != range.second; hashIt++) {
+            if (hashIt->second == blobId) {
+                mBlobsByHash.erase(hashIt);
+                break;
+            }
+        }
+        mBlobs.erase(it);
+    }
+
+    /* The kernel can give this id to the next blob */
+    forgetBlob(blobId);
+
+    if (!mDestroyBlob)
+        return -EINVAL;
+
+    return mDestroyBlob(blobId);
+}
+
+void DrmStateShadow::forgetBlob(uint32_t blobId) {
+    for (auto it = mCommitted.begin(); it != mCommitted.end();) {
+        if ((it->second == blobId) &&
+            (getDeltaPolicy((uint32_t)it->first) == DELTA_BLOB))
+            it = mCommitted.erase(it);
+        else
+            it++;
+    }
+}
+
+size_t DrmStateShadow::getCommittedCount() {
+    Mutex::Autolock lock(mMutex);
+    return mCommitted.size();
+}
+
+size_t DrmStateShadow::getBlobCount() {
+    Mutex::Autolock lock(mMutex);
+    return mBlobs.size();
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _EXYNOSDRMSTATESHADOW_H
+#define _EXYNOSDRMSTATESHADOW_H
+#include <sys/types.h>
+#include <utils/Mutex.h>
+#include <utils/Singleton.h>
+#include <xf86drmMode.h>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+using namespace android;
+
+/* libdrm does not export the items of a request */
+typedef struct _drmModeAtomicReqItem drmModeAtomicReqItem, *drmModeAtomicReqItemPtr;
+
+struct _drmModeAtomicReqItem {
+    uint32_t object_id;
+    uint32_t property_id;
+    uint64_t value;
+};
+
+struct _drmModeAtomicReq {
+    uint32_t cursor;
+    uint32_t size_items;
+    drmModeAtomicReqItemPtr items;
+};
+
+/*
+ * Shadow copy of the plane, crtc and connector properties of the last
+ * successful atomic commits, and the property blobs interned by content.
+ *
+ * Planes can move between displays, so there is one shadow for the drm
+ * device, keyed by object id and property id. A commit can leave out the
+ * properties that are already committed with the same value.
+ * invalidate() drops the shadow, so that the next commits carry the full
+ * state again. It is called after a commit error, a modeset, a power mode
+ * change and hotplug.
+ */
+class DrmStateShadow : public Singleton<DrmStateShadow> {
+  public:
+    enum DeltaPolicy : uint32_t {
+        // always added to the commit, default of every property
+        DELTA_NONE = 0,
+        // left out if the same value is committed
+        DELTA_VALUE,
+        // left out if 0 is committed, a non zero fb id can be reused after RmFB
+        DELTA_ZERO,
+        // DELTA_VALUE of a blob id, forgotten when the blob is destroyed
+        DELTA_BLOB,
+    };
+
+    using CreateBlobFunc = std::function<int(void *data, size_t length, uint32_t *blobId)>;
+    using DestroyBlobFunc = std::function<int(uint32_t blobId)>;
+
+    DrmStateShadow(){};
+    void init(CreateBlobFunc createBlob, DestroyBlobFunc destroyBlob);
+
+    void setDeltaPolicy(uint32_t propertyId, DeltaPolicy policy);
+
+    // true if value can be left out of the next commit of objectId
+    bool isCommitted(uint32_t objectId, uint32_t propertyId, uint64_t value);
+    // this value is committed successfully
+    void update(uint32_t objectId, uint32_t propertyId, uint64_t value);
+    void invalidate();
+
+    // adds the property to pset, unless deltaCommit and isCommitted()
+    int addProperty(drmModeAtomicReqPtr pset, uint32_t objectId, uint32_t propertyId,
+                    uint64_t value, bool deltaCommit);
+    // updates the shadow with pset, ret is the result of its drmModeAtomicCommit()
+    void commitDone(drmModeAtomicReqPtr pset, uint32_t flags, int ret);
+
+    // returns a blob with the same content if there is, and takes a reference of it
+    int32_t internBlob(const void *data, size_t length, uint32_t &blobId);
+    // drops a reference, the blob is destroyed with the last one.
+    // a blob id that was not interned is destroyed directly
+    int32_t releaseBlob(uint32_t blobId);
+
+    size_t getCommittedCount();
+    size_t getBlobCount();
+
+  private:
+    struct Blob {
+        std::vector<uint8_t> data;
+        size_t hash;
+        uint32_t refCount;
+    };
+
+    static uint64_t getKey(uint32_t objectId, uint32_t propertyId) {
+        return ((uint64_t)objectId << 32) | propertyId;
+    };
+    DeltaPolicy getDeltaPolicy(uint32_t propertyId); // REQUIRES(mMutex)
+    void forgetBlob(uint32_t blobId);                // REQUIRES(mMutex)
+
+    CreateBlobFunc mCreateBlob;
+    DestroyBlobFunc mDestroyBlob;
+
+    std::unordered_map<uint32_t, DeltaPolicy> mDeltaPolicies;
+    // committed value, key is getKey(object id, property id)
+    std::unordered_map<uint64_t, uint64_t> mCommitted;
+    // interned blobs, key is blob id
+    std::unordered_map<uint32_t, Blob> mBlobs;
+    std::unordered_multimap<size_t, uint32_t> mBlobsByHash;
+
+    Mutex mMutex;
+};
+#endif
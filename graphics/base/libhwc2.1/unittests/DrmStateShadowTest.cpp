@@ -0,0 +1,519 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "ExynosDrmStateShadow.h"
+
+/*
+ * Replays a composition trace against a stub drm device, once with every
+ * property in every commit as before, once with DrmStateShadow.
+ * Both have to leave the same state in the device.
+ * The requests are libdrm atomic requests built and committed through
+ * DrmStateShadow::addProperty() and commitDone(), as DrmModeAtomicReq does.
+ */
+
+namespace {
+
+constexpr uint32_t kNumPlanes = 6;
+constexpr uint32_t kPlaneIdBase = 30;
+constexpr uint32_t kCrtcId = 100;
+constexpr uint32_t kConnectorId = 200;
+
+enum {
+    PROP_CRTC_ID = 1,
+    PROP_FB_ID,
+    PROP_CRTC_X,
+    PROP_CRTC_Y,
+    PROP_CRTC_W,
+    PROP_CRTC_H,
+    PROP_SRC_X,
+    PROP_SRC_Y,
+    PROP_SRC_W,
+    PROP_SRC_H,
+    PROP_ROTATION,
+    PROP_BLEND,
+    PROP_ZPOS,
+    PROP_ALPHA,
+    PROP_STANDARD,
+    PROP_TRANSFER,
+    PROP_RANGE,
+    PROP_IN_FENCE_FD,
+    PROP_HDR_FD,
+    PROP_OUT_FENCE_PTR,
+    PROP_PARTIAL_REGION,
+    PROP_HDR_OUTPUT_META,
+};
+
+/* Atomic state of the objects, and the blobs as the kernel keeps them */
+class StubDrmDevice {
+  public:
+    int createBlob(void *data, size_t length, uint32_t *blobId) {
+        /* the kernel idr gives the lowest free id */
+        uint32_t id = 1;
+        while (mBlobs.count(id))
+            id++;
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        mBlobs[id] = std::vector<uint8_t>(bytes, bytes + length);
+        mBlobHandles.insert(id);
+        *blobId = id;
+        mCreatedBlobs++;
+        return 0;
+    }
+    int destroyBlob(uint32_t blobId) {
+        if (mBlobHandles.erase(blobId) == 0)
+            return -ENOENT;
+        mDestroyedBlobs++;
+        freeUnusedBlobs();
+        return 0;
+    }
+    int commit(drmModeAtomicReqPtr pset) {
+        mCommits++;
+        if (mFailNextCommit) {
+            mFailNextCommit = false;
+            return -EINVAL;
+        }
+        for (int i = 0; i < drmModeAtomicGetCursor(pset); i++) {
+            drmModeAtomicReqItem &item = pset->items[i];
+            mProperties++;
+            /* fds and pointers are consumed by the commit */
+            if ((item.property_id == PROP_IN_FENCE_FD) ||
+                (item.property_id == PROP_HDR_FD) ||
+                (item.property_id == PROP_OUT_FENCE_PTR))
+                continue;
+            mState[{item.object_id, item.property_id}] = item.value;
+        }
+        freeUnusedBlobs();
+        return 0;
+    }
+    /* a destroyed blob is kept, and keeps its id, while the state has it */
+    void freeUnusedBlobs() {
+        for (auto it = mBlobs.begin(); it != mBlobs.end();) {
+            bool used = mBlobHandles.count(it->first);
+            for (auto &e : mState) {
+                if (isBlobProperty(e.first.second) && (e.second == it->first))
+                    used = true;
+            }
+            if (used)
+                it++;
+            else
+                it = mBlobs.erase(it);
+        }
+    }
+    static bool isBlobProperty(uint32_t propertyId) {
+        return (propertyId == PROP_PARTIAL_REGION) || (propertyId == PROP_HDR_OUTPUT_META);
+    }
+    /* a blob id in the state is resolved to its content */
+    std::map<std::pair<uint32_t, uint32_t>, std::vector<uint8_t>> resolvedState() {
+        std::map<std::pair<uint32_t, uint32_t>, std::vector<uint8_t>> state;
+        for (auto &e : mState) {
+            const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&e.second);
+            std::vector<uint8_t> value(bytes, bytes + sizeof(e.second));
+            if (isBlobProperty(e.first.second)) {
+                auto blob = mBlobs.find((uint32_t)e.second);
+                value = (blob != mBlobs.end()) ? blob->second : std::vector<uint8_t>();
+            }
+            state[e.first] = value;
+        }
+        return state;
+    }
+
+    std::map<std::pair<uint32_t, uint32_t>, uint64_t> mState;
+    std::map<uint32_t, std::vector<uint8_t>> mBlobs;
+    std::set<uint32_t> mBlobHandles;
+    uint32_t mCommits = 0;
+    uint32_t mProperties = 0;
+    uint32_t mCreatedBlobs = 0;
+    uint32_t mDestroyedBlobs = 0;
+    bool mFailNextCommit = false;
+};
+
+struct Layer {
+    uint32_t plane;
+    int32_t x, y, w, h;
+    uint32_t fbId;
+    uint32_t zpos;
+    bool hdr;
+};
+
+struct Frame {
+    std::vector<Layer> layers;
+    uint16_t partialRect[4];
+    uint16_t hdrMaxLuminance;
+    bool modeset;
+    bool fail;
+};
+
+/*
+ * The frame setup of ExynosDisplayDrmInterface::deliverWinConfigData(),
+ * the requests go through the same DrmStateShadow calls as DrmModeAtomicReq.
+ */
+class TraceComposer {
+  public:
+    TraceComposer(StubDrmDevice &device, bool deltaCommit)
+          : mDevice(device), mDeltaCommit(deltaCommit), mPset(drmModeAtomicAlloc()) {
+        mShadow.init(
+            [this](void *data, size_t length, uint32_t *blobId) -> int {
+                return mDevice.createBlob(data, length, blobId);
+            },
+            [this](uint32_t blobId) -> int {
+                return mDevice.destroyBlob(blobId);
+            });
+        for (uint32_t prop = PROP_CRTC_ID; prop <= PROP_RANGE; prop++)
+            mShadow.setDeltaPolicy(prop, DrmStateShadow::DELTA_VALUE);
+        mShadow.setDeltaPolicy(PROP_FB_ID, DrmStateShadow::DELTA_ZERO);
+        mShadow.setDeltaPolicy(PROP_PARTIAL_REGION, DrmStateShadow::DELTA_BLOB);
+        mShadow.setDeltaPolicy(PROP_HDR_OUTPUT_META, DrmStateShadow::DELTA_BLOB);
+    }
+    ~TraceComposer() {
+        releaseOldBlobs();
+        mShadow.releaseBlob(mPartialBlob);
+        mShadow.releaseBlob(mHdrBlob);
+        drmModeAtomicFree(mPset);
+    }
+
+    int presentFrame(const Frame &frame) {
+        if (frame.modeset) {
+            /* the mode commit has ALLOW_MODESET */
+            drmModeAtomicSetCursor(mPset, 0);
+            add(kCrtcId, PROP_OUT_FENCE_PTR, 0x1000);
+            mShadow.commitDone(mPset, DRM_MODE_ATOMIC_ALLOW_MODESET, mDevice.commit(mPset));
+        }
+        drmModeAtomicSetCursor(mPset, 0);
+
+        if (memcmp(mPartialRect, frame.partialRect, sizeof(mPartialRect)) || !mPartialBlob) {
+            uint32_t blobId = 0;
+            if (internBlob(frame.partialRect, sizeof(frame.partialRect), blobId))
+                return -EINVAL;
+            mOldBlobs.push_back(mPartialBlob);
+            mPartialBlob = blobId;
+            memcpy(mPartialRect, frame.partialRect, sizeof(mPartialRect));
+        }
+        add(kCrtcId, PROP_PARTIAL_REGION, mPartialBlob);
+        add(kCrtcId, PROP_OUT_FENCE_PTR, 0x1000);
+
+        bool planeEnabled[kNumPlanes] = {false};
+        bool hdrMetaUpdated = false;
+        for (auto &layer : frame.layers) {
+            uint32_t planeId = kPlaneIdBase + layer.plane;
+            add(planeId, PROP_CRTC_ID, kCrtcId);
+            add(planeId, PROP_FB_ID, layer.fbId);
+            add(planeId, PROP_CRTC_X, layer.x);
+            add(planeId, PROP_CRTC_Y, layer.y);
+            add(planeId, PROP_CRTC_W, layer.w);
+            add(planeId, PROP_CRTC_H, layer.h);
+            add(planeId, PROP_SRC_X, 0);
+            add(planeId, PROP_SRC_Y, 0);
+            add(planeId, PROP_SRC_W, (uint64_t)layer.w << 16);
+            add(planeId, PROP_SRC_H, (uint64_t)layer.h << 16);
+            add(planeId, PROP_ROTATION, 1);
+            add(planeId, PROP_BLEND, 2);
+            add(planeId, PROP_ZPOS, layer.zpos);
+            add(planeId, PROP_ALPHA, 0xff);
+            add(planeId, PROP_IN_FENCE_FD, 40 + layer.plane);
+            add(planeId, PROP_STANDARD, layer.hdr ? 6 : 1);
+            add(planeId, PROP_TRANSFER, layer.hdr ? 7 : 3);
+            add(planeId, PROP_RANGE, 1);
+            if (layer.hdr) {
+                /* setFrameStaticMeta() */
+                uint16_t meta[8] = {34000, 16000, 13250, 34500, 7500, 3000,
+                                    frame.hdrMaxLuminance, 1};
+                uint32_t blobId = 0;
+                if (internBlob(meta, sizeof(meta), blobId))
+                    return -EINVAL;
+                mOldBlobs.push_back(mHdrBlob);
+                mHdrBlob = blobId;
+                add(kConnectorId, PROP_HDR_OUTPUT_META, mHdrBlob);
+                hdrMetaUpdated = true;
+            }
+            add(planeId, PROP_HDR_FD, (uint64_t)-1);
+            planeEnabled[layer.plane] = true;
+        }
+        /* clearFrameStaticMeta() */
+        if (!hdrMetaUpdated && mHdrBlob) {
+            add(kConnectorId, PROP_HDR_OUTPUT_META, 0);
+            mOldBlobs.push_back(mHdrBlob);
+            mHdrBlob = 0;
+        }
+        for (uint32_t plane = 0; plane < kNumPlanes; plane++) {
+            if (planeEnabled[plane])
+                continue;
+            add(kPlaneIdBase + plane, PROP_CRTC_ID, 0);
+            add(kPlaneIdBase + plane, PROP_FB_ID, 0);
+        }
+
+        if (frame.fail)
+            mDevice.mFailNextCommit = true;
+        int ret = mDevice.commit(mPset);
+        mShadow.commitDone(mPset, DRM_MODE_ATOMIC_NONBLOCK, ret);
+        releaseOldBlobs();
+        return ret;
+    }
+
+    DrmStateShadow mShadow;
+
+  private:
+    void add(uint32_t objectId, uint32_t propertyId, uint64_t value) {
+        ASSERT_GE(mShadow.addProperty(mPset, objectId, propertyId, value, mDeltaCommit), 0);
+    }
+    int32_t internBlob(const void *data, size_t length, uint32_t &blobId) {
+        if (mDeltaCommit)
+            return mShadow.internBlob(data, length, blobId);
+        /* as before, one blob per request */
+        return mDevice.createBlob(const_cast<void *>(data), length, &blobId);
+    }
+    void releaseOldBlobs() {
+        for (auto blobId : mOldBlobs)
+            mShadow.releaseBlob(blobId);
+        mOldBlobs.clear();
+    }
+
+    StubDrmDevice &mDevice;
+    bool mDeltaCommit;
+    drmModeAtomicReqPtr mPset;
+    std::vector<uint32_t> mOldBlobs;
+    uint16_t mPartialRect[4] = {0, 0, 0, 0};
+    uint32_t mPartialBlob = 0;
+    uint32_t mHdrBlob = 0;
+};
+
+/*
+ * Home screen with a status bar, a video with an hdr layer,
+ * layers moving during an animation, a resolution change
+ * and a commit the driver rejects.
+ */
+std::vector<Frame> makeTrace() {
+    std::vector<Frame> trace;
+    uint32_t fbId = 1000;
+
+    for (int i = 0; i < 120; i++) {
+        Frame frame = {};
+        frame.layers.push_back({0, 0, 0, 1080, 2400, fbId++, 0, false});
+        frame.layers.push_back({1, 0, 0, 1080, 80, (i % 30) ? 900u : fbId++, 1, false});
+        uint16_t rect[4] = {0, 0, 1080, 2400};
+        memcpy(frame.partialRect, rect, sizeof(rect));
+        trace.push_back(frame);
+    }
+    for (int i = 0; i < 30; i++) {
+        Frame frame = {};
+        frame.layers.push_back({0, 0, 0, 1080, 2400, 900, 0, false});
+        frame.layers.push_back({2, 0, 2400 - 80 * i, 1080, 80 * i, fbId++, 1, false});
+        uint16_t rect[4] = {0, (uint16_t)(2400 - 80 * i), 1080, 2400};
+        memcpy(frame.partialRect, rect, sizeof(rect));
+        trace.push_back(frame);
+    }
+    for (int i = 0; i < 240; i++) {
+        Frame frame = {};
+        frame.layers.push_back({3, 0, 600, 1080, 608, fbId++, 0, true});
+        frame.layers.push_back({4, 0, 1208, 1080, 200, (i % 60) ? 901u : fbId++, 1, false});
+        frame.hdrMaxLuminance = (i < 120) ? 1000 : 4000;
+        uint16_t rect[4] = {0, 0, 1080, 2400};
+        memcpy(frame.partialRect, rect, sizeof(rect));
+        frame.modeset = (i == 60);
+        frame.fail = (i == 180);
+        trace.push_back(frame);
+    }
+    /* back to sdr, the hdr meta is cleared */
+    for (int i = 0; i < 60; i++) {
+        Frame frame = {};
+        frame.layers.push_back({0, 0, 0, 1080, 2400, fbId++, 0, false});
+        uint16_t rect[4] = {0, 0, 1080, 2400};
+        memcpy(frame.partialRect, rect, sizeof(rect));
+        trace.push_back(frame);
+    }
+    return trace;
+}
+
+} // namespace
+
+class DrmStateShadowTest : public testing::Test {
+public:
+    void SetUp() {}
+    void TearDown() {}
+};
+
+TEST_F(DrmStateShadowTest, replayKeepsDeviceState) {
+    std::vector<Frame> trace = makeTrace();
+    StubDrmDevice fullDevice, deltaDevice;
+    TraceComposer fullComposer(fullDevice, false);
+    TraceComposer deltaComposer(deltaDevice, true);
+
+    for (size_t i = 0; i < trace.size(); i++) {
+        int fullRet = fullComposer.presentFrame(trace[i]);
+        int deltaRet = deltaComposer.presentFrame(trace[i]);
+        ASSERT_EQ(fullRet, deltaRet) << "frame " << i;
+        ASSERT_EQ(fullDevice.resolvedState(), deltaDevice.resolvedState()) << "frame " << i;
+    }
+
+    printf("%zu frames : properties %u -> %u (%.1f / commit -> %.1f / commit), "
+           "blobs created %u -> %u\n",
+           trace.size(), fullDevice.mProperties, deltaDevice.mProperties,
+           (double)fullDevice.mProperties / fullDevice.mCommits,
+           (double)deltaDevice.mProperties / deltaDevice.mCommits,
+           fullDevice.mCreatedBlobs, deltaDevice.mCreatedBlobs);
+
+    EXPECT_LT(deltaDevice.mProperties * 3, fullDevice.mProperties);
+    /* full partial rect, 30 of the animation, full rect again and 2 hdr meta */
+    EXPECT_EQ(deltaDevice.mCreatedBlobs, 1u + 30u + 1u + 2u);
+    /* the replaced blobs are destroyed after commit, only the partial rect is left */
+    EXPECT_EQ(deltaDevice.mBlobHandles.size(), 1u);
+    EXPECT_EQ(fullDevice.mBlobHandles.size(), 1u);
+    EXPECT_EQ(deltaComposer.mShadow.getBlobCount(), deltaDevice.mBlobHandles.size());
+}
+
+TEST_F(DrmStateShadowTest, fullStateAfterInvalidate) {
+    StubDrmDevice device;
+    TraceComposer composer(device, true);
+    Frame frame = {};
+    frame.layers.push_back({0, 0, 0, 1080, 2400, 1000, 0, false});
+    uint16_t rect[4] = {0, 0, 1080, 2400};
+    memcpy(frame.partialRect, rect, sizeof(rect));
+
+    ASSERT_EQ(composer.presentFrame(frame), 0);
+    uint32_t fullCommit = device.mProperties;
+
+    frame.layers[0].fbId = 1001;
+    ASSERT_EQ(composer.presentFrame(frame), 0);
+    uint32_t deltaCommit = device.mProperties - fullCommit;
+    /* fb, in fence, hdr fd and out fence */
+    EXPECT_EQ(deltaCommit, 4u);
+
+    frame.fail = true;
+    frame.layers[0].fbId = 1002;
+    EXPECT_LT(composer.presentFrame(frame), 0);
+    EXPECT_EQ(composer.mShadow.getCommittedCount(), 0u);
+
+    frame.fail = false;
+    uint32_t before = device.mProperties;
+    ASSERT_EQ(composer.presentFrame(frame), 0);
+    EXPECT_EQ(device.mProperties - before, fullCommit);
+
+    composer.mShadow.invalidate();
+    before = device.mProperties;
+    ASSERT_EQ(composer.presentFrame(frame), 0);
+    EXPECT_EQ(device.mProperties - before, fullCommit);
+}
+
+TEST_F(DrmStateShadowTest, hdrMetaCleared) {
+    StubDrmDevice device;
+    TraceComposer composer(device, true);
+    Frame frame = {};
+    frame.layers.push_back({0, 0, 0, 1080, 2400, 1000, 0, true});
+    frame.hdrMaxLuminance = 1000;
+    uint16_t rect[4] = {0, 0, 1080, 2400};
+    memcpy(frame.partialRect, rect, sizeof(rect));
+
+    const std::pair<uint32_t, uint32_t> hdrMeta(kConnectorId, PROP_HDR_OUTPUT_META);
+    ASSERT_EQ(composer.presentFrame(frame), 0);
+    ASSERT_NE(device.resolvedState()[hdrMeta].size(), 0u);
+    EXPECT_EQ(device.mBlobHandles.size(), 2u);
+
+    frame.layers[0].hdr = false;
+    frame.layers[0].fbId = 1001;
+    ASSERT_EQ(composer.presentFrame(frame), 0);
+    /* the meta is detached from the connector and the blob is destroyed */
+    EXPECT_EQ(device.resolvedState()[hdrMeta].size(), 0u);
+    EXPECT_EQ(device.mBlobHandles.size(), 1u);
+    EXPECT_EQ(composer.mShadow.getBlobCount(), 1u);
+    EXPECT_TRUE(composer.mShadow.isCommitted(kConnectorId, PROP_HDR_OUTPUT_META, 0));
+
+    /* the same meta comes back in a new blob */
+    frame.layers[0].hdr = true;
+    ASSERT_EQ(composer.presentFrame(frame), 0);
+    EXPECT_NE(device.resolvedState()[hdrMeta].size(), 0u);
+    EXPECT_EQ(device.mCreatedBlobs, 3u);
+}
+
+TEST_F(DrmStateShadowTest, internBlob) {
+    StubDrmDevice device;
+    DrmStateShadow shadow;
+    shadow.init(
+        [&device](void *data, size_t length, uint32_t *blobId) -> int {
+            return device.createBlob(data, length, blobId);
+        },
+        [&device](uint32_t blobId) -> int {
+            return device.destroyBlob(blobId);
+        });
+    shadow.setDeltaPolicy(PROP_HDR_OUTPUT_META, DrmStateShadow::DELTA_BLOB);
+
+    uint16_t metaA[4] = {1, 2, 3, 4};
+    uint16_t metaB[4] = {1, 2, 3, 5};
+    uint32_t a = 0, a2 = 0, b = 0;
+    ASSERT_EQ(shadow.internBlob(metaA, sizeof(metaA), a), 0);
+    ASSERT_EQ(shadow.internBlob(metaA, sizeof(metaA), a2), 0);
+    ASSERT_EQ(shadow.internBlob(metaB, sizeof(metaB), b), 0);
+    EXPECT_EQ(a, a2);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(device.mCreatedBlobs, 2u);
+
+    shadow.update(kConnectorId, PROP_HDR_OUTPUT_META, a);
+    EXPECT_TRUE(shadow.isCommitted(kConnectorId, PROP_HDR_OUTPUT_META, a));
+
+    EXPECT_EQ(shadow.releaseBlob(a), 0);
+    EXPECT_EQ(device.mDestroyedBlobs, 0u);
+    EXPECT_TRUE(shadow.isCommitted(kConnectorId, PROP_HDR_OUTPUT_META, a));
+
+    /* the id can be given to another content */
+    EXPECT_EQ(shadow.releaseBlob(a2), 0);
+    EXPECT_EQ(device.mDestroyedBlobs, 1u);
+    EXPECT_FALSE(shadow.isCommitted(kConnectorId, PROP_HDR_OUTPUT_META, a));
+
+    uint32_t c = 0;
+    uint16_t metaC[4] = {9, 9, 9, 9};
+    ASSERT_EQ(shadow.internBlob(metaC, sizeof(metaC), c), 0);
+    EXPECT_EQ(c, a);
+    EXPECT_FALSE(shadow.isCommitted(kConnectorId, PROP_HDR_OUTPUT_META, c));
+
+    shadow.releaseBlob(b);
+    shadow.releaseBlob(c);
+    EXPECT_EQ(shadow.getBlobCount(), 0u);
+    EXPECT_TRUE(device.mBlobHandles.empty());
+
+    /* not interned, destroyed directly */
+    uint32_t raw = 0;
+    device.createBlob(metaA, sizeof(metaA), &raw);
+    EXPECT_EQ(shadow.releaseBlob(raw), 0);
+    EXPECT_TRUE(device.mBlobHandles.empty());
+}
+
+TEST_F(DrmStateShadowTest, deltaPolicy) {
+    DrmStateShadow shadow;
+    shadow.setDeltaPolicy(PROP_CRTC_X, DrmStateShadow::DELTA_VALUE);
+    shadow.setDeltaPolicy(PROP_FB_ID, DrmStateShadow::DELTA_ZERO);
+
+    uint32_t planeId = kPlaneIdBase;
+    shadow.update(planeId, PROP_CRTC_X, 10);
+    shadow.update(planeId, PROP_FB_ID, 1000);
+    shadow.update(planeId, PROP_IN_FENCE_FD, 42);
+
+    EXPECT_TRUE(shadow.isCommitted(planeId, PROP_CRTC_X, 10));
+    EXPECT_FALSE(shadow.isCommitted(planeId, PROP_CRTC_X, 11));
+    EXPECT_FALSE(shadow.isCommitted(planeId + 1, PROP_CRTC_X, 10));
+    /* a fb id is always sent, 0 is not */
+    EXPECT_FALSE(shadow.isCommitted(planeId, PROP_FB_ID, 1000));
+    EXPECT_FALSE(shadow.isCommitted(planeId, PROP_IN_FENCE_FD, 42));
+    EXPECT_EQ(shadow.getCommittedCount(), 2u);
+
+    shadow.update(planeId, PROP_FB_ID, 0);
+    EXPECT_TRUE(shadow.isCommitted(planeId, PROP_FB_ID, 0));
+}
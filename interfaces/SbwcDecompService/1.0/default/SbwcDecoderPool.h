@@ -0,0 +1,182 @@
+/*
+ * Copyright Samsung Electronics Co.,LTD.
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VENDOR_SAMSUNG_SLSI_HARDWARE_SBWCDECOMPSERVICE_V1_0_SBWCDECODERPOOL_H
+#define VENDOR_SAMSUNG_SLSI_HARDWARE_SBWCDECOMPSERVICE_V1_0_SBWCDECODERPOOL_H
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace vendor {
+namespace samsung_slsi {
+namespace hardware {
+namespace SbwcDecompService {
+namespace V1_0 {
+namespace implementation {
+
+/*
+ * Decoder instances shared by the binder threads of the service.
+ * Up to `instances` decoders are created on first need, and a caller decodes
+ * with a decoder of its own instead of queuing behind a single one.
+ * When they are all busy, the callers wait for the next free decoder in the
+ * order of their deadline, the arrival plus one frame at the requested
+ * framerate: a 60 fps stream goes before a 1 fps one that came at the same
+ * time, but not before one that has been waiting for longer than a frame.
+ * At most `maxWaiting` callers wait, the others are refused with -EWOULDBLOCK.
+ */
+template<class Decoder>
+class SbwcDecoderPool {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Factory = std::function<std::unique_ptr<Decoder>()>;
+
+    class Lease {
+    public:
+        Lease() : mPool(nullptr), mDecoder(nullptr) {}
+        Lease(Lease &&other) : mPool(other.mPool), mDecoder(other.mDecoder) {
+            other.mPool = nullptr;
+            other.mDecoder = nullptr;
+        }
+        Lease &operator=(Lease &&other) {
+            if (this != &other) {
+                reset();
+                std::swap(mPool, other.mPool);
+                std::swap(mDecoder, other.mDecoder);
+            }
+            return *this;
+        }
+        ~Lease() { reset(); }
+
+        Decoder *get() const { return mDecoder; }
+        Decoder *operator->() const { return mDecoder; }
+
+        void reset() {
+            if (mPool)
+                mPool->release(mDecoder);
+            mPool = nullptr;
+            mDecoder = nullptr;
+        }
+
+    private:
+        friend class SbwcDecoderPool;
+        Lease(SbwcDecoderPool *pool, Decoder *decoder) : mPool(pool), mDecoder(decoder) {}
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        SbwcDecoderPool *mPool;
+        Decoder *mDecoder;
+    };
+
+    SbwcDecoderPool(size_t instances, size_t maxWaiting, Factory factory)
+        : mInstances(instances), mMaxWaiting(maxWaiting), mFactory(std::move(factory)), mSequence(0) {
+    }
+
+    /* Every Lease has to be gone */
+    ~SbwcDecoderPool() = default;
+
+    /* 0, -EWOULDBLOCK when too many callers wait, or -ENOMEM */
+    int acquire(uint32_t framerate, Lease *lease) {
+        std::unique_lock<std::mutex> lock(mMutex);
+
+        if (mIdle.empty() && mDecoders.size() < mInstances && mWaiting.empty()) {
+            std::unique_ptr<Decoder> decoder = mFactory();
+            if (!decoder)
+                return -ENOMEM;
+            mDecoders.push_back(std::move(decoder));
+            *lease = Lease(this, mDecoders.back().get());
+            return 0;
+        }
+
+        if (!mIdle.empty() && mWaiting.empty()) {
+            *lease = Lease(this, mIdle.back());
+            mIdle.pop_back();
+            return 0;
+        }
+
+        if (mWaiting.size() >= mMaxWaiting)
+            return -EWOULDBLOCK;
+
+        Clock::duration frame = std::chrono::seconds(1);
+        if (framerate)
+            frame /= framerate;
+
+        Waiter waiter;
+        auto it = mWaiting.emplace(std::make_pair(Clock::now() + frame, mSequence++), &waiter).first;
+        mCondition.wait(lock, [&waiter] { return waiter.decoder != nullptr; });
+        mWaiting.erase(it);
+
+        *lease = Lease(this, waiter.decoder);
+        return 0;
+    }
+
+    size_t waiting() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mWaiting.size();
+    }
+
+private:
+    struct Waiter {
+        Decoder *decoder = nullptr;
+    };
+
+    void release(Decoder *decoder) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            // the earliest deadline without a decoder yet, the first ones may not have woken up
+            for (auto &entry : mWaiting) {
+                if (!entry.second->decoder) {
+                    entry.second->decoder = decoder;
+                    decoder = nullptr;
+                    break;
+                }
+            }
+            if (decoder)
+                mIdle.push_back(decoder);
+        }
+        mCondition.notify_all();
+    }
+
+    const size_t mInstances;
+    const size_t mMaxWaiting;
+    Factory mFactory;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::vector<std::unique_ptr<Decoder>> mDecoders;
+    std::vector<Decoder *> mIdle;
+    std::map<std::pair<Clock::time_point, uint64_t>, Waiter *> mWaiting;
+    uint64_t mSequence;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace SbwcDecompService
+}  // namespace hardware
+}  // namespace samsung_slsi
+}  // namespace vendor
+
+#endif
@@ -37,6 +37,12 @@ namespace implementation {
 
 using ::vendor::graphics::ExynosGraphicBufferMeta;
 
+SbwcDecompService::SbwcDecompService()
+    : mDecoderPool(SBWC_DECODER_INSTANCES, SBWC_DECOMP_THREADS,
+                   [] { return std::unique_ptr<SbwcWrapper>(new SbwcWrapper()); })
+{
+}
+
 // Methods from ::vendor::samsung_slsi::hardware::SbwcDecompService::V1_0::ISbwcDecompService follow.
 
 Return<int32_t> SbwcDecompService::decode(const hidl_handle &srcHandle, const hidl_handle &dstHandle,
@@ -66,20 +72,8 @@ Return<int32_t> SbwcDecompService::decodeWithCrop(const hidl_handle &srcHandle,
 Return<int32_t> SbwcDecompService::decodeWithCropAndFps(const hidl_handle &srcHandle, const hidl_handle &dstHandle,
                                                         uint32_t attr, uint32_t cropWidth, uint32_t cropHeight, uint32_t framerate)
 {
-    static std::mutex mDecompMutex;
-
     ATRACE_CALL();
 
-    std::lock_guard<std::mutex> lock(mDecompMutex);
-
-    static SbwcWrapper *decoder;
-
-    if (!decoder) {
-        decoder = new SbwcWrapper();
-        if (!decoder)
-            return android::NO_MEMORY;
-    }
-
     auto *srcBH = const_cast<native_handle_t*>(srcHandle.getNativeHandle());
     if (!srcBH)
         return android::BAD_VALUE;
@@ -88,6 +82,13 @@ Return<int32_t> SbwcDecompService::decodeWithCropAndFps(const hidl_handle &srcHa
     if (!dstBH)
         return android::BAD_VALUE;
 
+    SbwcDecoderPool<SbwcWrapper>::Lease decoder;
+    int ret = mDecoderPool.acquire(framerate, &decoder);
+    if (ret) {
+        ALOGE("failed to get a decoder (%d)", ret);
+        return ret == -EWOULDBLOCK ? android::WOULD_BLOCK : android::NO_MEMORY;
+    }
+
     if (!decoder->decode(static_cast<void*>(srcBH), static_cast<void*>(dstBH), attr, cropWidth, cropHeight, framerate)) {
         ALOGE("decode is failed");
         return android::BAD_VALUE;
@@ -24,6 +24,12 @@
 
 #include <log/log.h>
 
+#include <memory>
+#include <vector>
+
+#include <hardware/exynos/sbwcwrapper.h>
+#include "SbwcDecoderPool.h"
+
 namespace vendor {
 namespace samsung_slsi {
 namespace hardware {
@@ -34,7 +40,15 @@ namespace implementation {
 using ::android::hardware::hidl_handle;
 using ::android::hardware::Return;
 
+// decoders decoding at the same time, each has its own instance of the IPs.
+// libsbwcwrapper still decodes with one DPU at a time, they share its window.
+#define SBWC_DECODER_INSTANCES  2
+// binder threads, the calls beyond SBWC_DECODER_INSTANCES wait for a decoder
+#define SBWC_DECOMP_THREADS     6
+
 struct SbwcDecompService : public ISbwcDecompService {
+    SbwcDecompService();
+
     // Methods from ::vendor::samsung_slsi::hardware::SbwcDecompService::V1_0::ISbwcDecompService follow.
     Return<int32_t> decode(const hidl_handle &srcHandle, const hidl_handle &dstHandle, uint32_t attr) override;
     Return<int32_t> decodeWithFramerate(const hidl_handle &srcHandle, const hidl_handle &dstHandle, uint32_t attr, uint32_t framerate) override;
@@ -43,6 +57,8 @@ struct SbwcDecompService : public ISbwcDecompService {
 
     // Methods from ::android::hidl::base::V1_0::IBase follow.
 
+private:
+    SbwcDecoderPool<SbwcWrapper> mDecoderPool;
 };
 
 
@@ -33,7 +33,7 @@ int main() {
     ALOGD("SbwcDecompService start");
 
     android::hardware::configureRpcThreadpool(
-    1 /* maxThreads */,
+    SBWC_DECOMP_THREADS /* maxThreads */,
     true /* callerWillJoin */
     );
 
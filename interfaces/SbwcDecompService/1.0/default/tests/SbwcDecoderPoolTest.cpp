@@ -0,0 +1,241 @@
+/*
+ * Copyright Samsung Electronics Co.,LTD.
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+
+#include <gtest/gtest.h>
+
+#include "../SbwcDecoderPool.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+using namespace vendor::samsung_slsi::hardware::SbwcDecompService::V1_0::implementation;
+using Clock = std::chrono::steady_clock;
+
+/*
+ * Stub of SbwcWrapper. A decode takes the time of the hardware, during which
+ * the calling thread sleeps, so decoders run in parallel whatever the number
+ * of CPUs of the host.
+ */
+const std::chrono::microseconds kDecodeCost(2000);
+const int kDecodesPerClient = 50;
+// SBWC_DECODER_INSTANCES of the service
+const int kInstances = 2;
+
+class StubDecoder {
+public:
+    StubDecoder() {
+        sInstances++;
+    }
+
+    bool decode(void *, void *, unsigned int, unsigned int, unsigned int, unsigned int) {
+        std::this_thread::sleep_for(kDecodeCost);
+        return true;
+    }
+
+    static std::atomic<int> sInstances;
+};
+
+std::atomic<int> StubDecoder::sInstances(0);
+
+using Pool = SbwcDecoderPool<StubDecoder>;
+
+std::unique_ptr<StubDecoder> newDecoder() {
+    return std::unique_ptr<StubDecoder>(new StubDecoder());
+}
+
+struct StressResult {
+    double decodesPerSec;
+    double p50Ms;
+    double p99Ms;
+};
+
+/* decodeWithCropAndFps() of the service for `clients` clients calling back to back */
+StressResult stress(size_t instances, int clients) {
+    Pool pool(instances, clients, newDecoder);
+    std::vector<std::vector<double>> latencies(clients);
+    std::vector<std::thread> threads;
+    std::atomic<int> failures(0);
+
+    auto start = Clock::now();
+    for (int c = 0; c < clients; c++) {
+        threads.emplace_back([&, c] {
+            // mixed clients: a 60 fps stream, thumbnails, screenshots
+            uint32_t framerate = c % 3 == 0 ? 60 : 1000;
+
+            for (int i = 0; i < kDecodesPerClient; i++) {
+                auto begin = Clock::now();
+                Pool::Lease decoder;
+                if (pool.acquire(framerate, &decoder) || !decoder->decode(nullptr, nullptr, 0, 0, 0, framerate))
+                    failures++;
+                decoder.reset();
+                latencies[c].push_back(std::chrono::duration<double, std::milli>(Clock::now() - begin).count());
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    EXPECT_EQ(failures, 0);
+
+    std::vector<double> all;
+    for (auto &l : latencies)
+        all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+
+    return { all.size() / elapsed, all[all.size() / 2], all[all.size() * 99 / 100] };
+}
+
+TEST(SbwcDecoderPoolTest, Throughput)
+{
+    printf("%-8s %-10s %12s %10s %10s\n", "clients", "instances", "decodes/s", "p50 ms", "p99 ms");
+
+    for (int clients = 1; clients <= 8; clients++) {
+        // a single instance is the service before the pool, serialized behind one mutex
+        StressResult single = stress(1, clients);
+        StressResult pooled = stress(kInstances, clients);
+
+        printf("%-8d %-10d %12.0f %10.2f %10.2f\n", clients, 1,
+               single.decodesPerSec, single.p50Ms, single.p99Ms);
+        printf("%-8d %-10d %12.0f %10.2f %10.2f\n", clients, kInstances,
+               pooled.decodesPerSec, pooled.p50Ms, pooled.p99Ms);
+
+        // the latencies are too noisy on a loaded host to be compared
+        if (clients >= kInstances) {
+            EXPECT_GT(pooled.decodesPerSec, single.decodesPerSec * 1.3);
+        }
+    }
+}
+
+TEST(SbwcDecoderPoolTest, CreatesInstancesOnDemand)
+{
+    StubDecoder::sInstances = 0;
+    Pool pool(4, 4, newDecoder);
+
+    Pool::Lease first, second;
+    ASSERT_EQ(pool.acquire(30, &first), 0);
+    first.reset();
+    ASSERT_EQ(pool.acquire(30, &first), 0);
+    EXPECT_EQ(StubDecoder::sInstances, 1);
+
+    ASSERT_EQ(pool.acquire(30, &second), 0);
+    EXPECT_NE(first.get(), second.get());
+    EXPECT_EQ(StubDecoder::sInstances, 2);
+}
+
+TEST(SbwcDecoderPoolTest, FactoryFailure)
+{
+    Pool pool(1, 1, [] { return std::unique_ptr<StubDecoder>(); });
+    Pool::Lease decoder;
+
+    EXPECT_EQ(pool.acquire(30, &decoder), -ENOMEM);
+    EXPECT_EQ(decoder.get(), nullptr);
+}
+
+void waitForWaiters(Pool &pool, size_t count) {
+    while (pool.waiting() != count)
+        std::this_thread::sleep_for(1ms);
+}
+
+TEST(SbwcDecoderPoolTest, HigherFramerateFirst)
+{
+    Pool pool(1, 4, newDecoder);
+    std::vector<uint32_t> order;
+    std::mutex orderMutex;
+    std::vector<std::thread> threads;
+
+    Pool::Lease busy;
+    ASSERT_EQ(pool.acquire(30, &busy), 0);
+
+    for (uint32_t framerate : { 1u, 5u, 60u }) {
+        threads.emplace_back([&, framerate] {
+            Pool::Lease decoder;
+            ASSERT_EQ(pool.acquire(framerate, &decoder), 0);
+            std::lock_guard<std::mutex> lock(orderMutex);
+            order.push_back(framerate);
+        });
+        waitForWaiters(pool, threads.size());
+    }
+
+    busy.reset();
+    for (auto &thread : threads)
+        thread.join();
+
+    EXPECT_EQ(order, std::vector<uint32_t>({ 60u, 5u, 1u }));
+}
+
+TEST(SbwcDecoderPoolTest, EarlierDeadlineFirst)
+{
+    Pool pool(1, 4, newDecoder);
+    std::vector<uint32_t> order;
+    std::mutex orderMutex;
+    std::vector<std::thread> threads;
+
+    Pool::Lease busy;
+    ASSERT_EQ(pool.acquire(30, &busy), 0);
+
+    // the 1000 fps caller comes more than a 2 fps frame after the 2 fps one
+    for (uint32_t framerate : { 2u, 1000u }) {
+        threads.emplace_back([&, framerate] {
+            Pool::Lease decoder;
+            ASSERT_EQ(pool.acquire(framerate, &decoder), 0);
+            std::lock_guard<std::mutex> lock(orderMutex);
+            order.push_back(framerate);
+        });
+        waitForWaiters(pool, threads.size());
+        if (framerate == 2u)
+            std::this_thread::sleep_for(600ms);
+    }
+
+    busy.reset();
+    for (auto &thread : threads)
+        thread.join();
+
+    EXPECT_EQ(order, std::vector<uint32_t>({ 2u, 1000u }));
+}
+
+TEST(SbwcDecoderPoolTest, BoundedQueue)
+{
+    Pool pool(1, 1, newDecoder);
+
+    Pool::Lease busy;
+    ASSERT_EQ(pool.acquire(30, &busy), 0);
+
+    std::thread waiter([&] {
+        Pool::Lease decoder;
+        EXPECT_EQ(pool.acquire(30, &decoder), 0);
+    });
+    waitForWaiters(pool, 1);
+
+    Pool::Lease refused;
+    EXPECT_EQ(pool.acquire(30, &refused), -EWOULDBLOCK);
+    EXPECT_EQ(refused.get(), nullptr);
+
+    busy.reset();
+    waiter.join();
+    EXPECT_EQ(pool.waiting(), 0u);
+}
+
+}  // namespace
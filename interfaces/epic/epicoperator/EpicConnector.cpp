@@ -1,8 +1,13 @@
 #include "EpicConnector.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <set>
+#include <thread>
 #include <vector>
 
 #include <android/log.h>
+#include <cutils/properties.h>
 
 #include <dlfcn.h>
 #include <unistd.h>
@@ -10,17 +15,129 @@
 using ::android::hardware::hidl_vec;
 
 namespace epic {
-	EpicConnector::EpicConnector()
+	/*
+	 * Sends the transitions of the connectors when they are due, one at a time.
+	 * Created with the first transition and never destroyed, the thread may
+	 * still wait on it at exit.
+	 */
+	class EpicDispatcher {
+	public:
+		static EpicDispatcher &get()
+		{
+			static EpicDispatcher &dispatcher = *new EpicDispatcher();
+			return dispatcher;
+		}
+
+		void schedule(EpicConnector *connector)
+		{
+			mPending.insert(connector);
+			if (!mStarted) {
+				std::thread(&EpicDispatcher::run, this).detach();
+				mStarted = true;
+			}
+			mCondition.notify_one();
+		}
+
+		void remove(EpicConnector *connector)
+		{
+			mPending.erase(connector);
+		}
+
+		void wait_idle(std::unique_lock<std::mutex> &lock, EpicConnector *connector)
+		{
+			mIdle.wait(lock, [connector] { return connector->mInFlight == 0; });
+		}
+
+		void notify_sent()
+		{
+			mCondition.notify_one();
+			mIdle.notify_all();
+		}
+
+		std::mutex mMutex;
+
+	private:
+		EpicDispatcher() : mStarted(false) {}
+
+		void run()
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+
+			for (;;) {
+				EpicConnector::Clock::time_point now = EpicConnector::Clock::now();
+				EpicConnector::Clock::time_point next = EpicConnector::Clock::time_point::max();
+				EpicConnector *ready = nullptr;
+				EpicConnector::LockState *state = nullptr;
+				std::string condition_name;
+
+				for (auto it = mPending.begin(); it != mPending.end();) {
+					EpicConnector *connector = *it;
+
+					// being flushed by its owner
+					if (connector->mInFlight) {
+						++it;
+						continue;
+					}
+
+					EpicConnector::Clock::time_point due = connector->next_transition(&state, &condition_name);
+					if (due == EpicConnector::Clock::time_point::max()) {
+						it = mPending.erase(it);
+						continue;
+					}
+
+					if (due <= now) {
+						ready = connector;
+						break;
+					}
+
+					next = std::min(next, due);
+					++it;
+				}
+
+				if (ready != nullptr)
+					ready->send_transition(lock, state, condition_name);
+				else if (next == EpicConnector::Clock::time_point::max())
+					mCondition.wait(lock);
+				else
+					mCondition.wait_until(lock, next);
+			}
+		}
+
+		bool mStarted;
+		std::condition_variable mCondition;
+		std::condition_variable mIdle;
+		std::set<EpicConnector *> mPending;
+	};
+
+	EpicConnector::EpicConnector() :
+		mReleaseDelay(std::max(0, property_get_int32(PROP_RELEASE_DELAY, DEFAULT_RELEASE_DELAY_MS))),
+		mOptionLock(false),
+		mInFlight(0)
+	{
+	}
+
+	EpicConnector::EpicConnector(const sp<IEpicRequest> &request, std::chrono::milliseconds release_delay) :
+		mRequest(request),
+		mReleaseDelay(release_delay),
+		mOptionLock(false),
+		mInFlight(0)
 	{
 	}
 
 	EpicConnector::~EpicConnector()
 	{
+		EpicDispatcher &dispatcher = EpicDispatcher::get();
+
+		flush();
+
+		std::lock_guard<std::mutex> lock(dispatcher.mMutex);
+		dispatcher.remove(this);
 	}
 
 	void EpicConnector::alloc_request(int scenario_id)
 	{
-		getService();
+		if (mRequest == nullptr)
+			getService();
 		if (mRequest == nullptr)
 			return;
 
@@ -29,7 +146,8 @@ namespace epic {
 
 	void EpicConnector::alloc_request(int *scenario_id_list, int len)
 	{
-		getService();
+		if (mRequest == nullptr)
+			getService();
 		if (mRequest == nullptr)
 			return;
 
@@ -43,7 +161,8 @@ namespace epic {
 			mHandle == nullptr)
 			return false;
 
-		return mRequest->acquire_lock(mHandle);
+		std::unique_lock<std::mutex> lock(EpicDispatcher::get().mMutex);
+		return request(lock, mLock, std::string(), true);
 	}
 
 	bool EpicConnector::acquire(unsigned int value, unsigned int usec)
@@ -52,7 +171,8 @@ namespace epic {
 			mHandle == nullptr)
 			return false;
 
-		return mRequest->acquire_lock_option(mHandle, value, usec);
+		flush();
+		return option_acquired(mRequest->acquire_lock_option(mHandle, value, usec));
 	}
 
 	bool EpicConnector::acquire(unsigned int *value, unsigned int *usec, int len)
@@ -61,10 +181,12 @@ namespace epic {
 			mHandle == nullptr)
 			return false;
 
+		flush();
+
 		std::vector<unsigned int> value_vec(value, value + len);
 		std::vector<unsigned int> usec_vec(usec, usec + len);
 
-		return mRequest->acquire_lock_multi_option(mHandle, value_vec, usec_vec);
+		return option_acquired(mRequest->acquire_lock_multi_option(mHandle, value_vec, usec_vec));
 	}
 
 	bool EpicConnector::acquire_conditional(std::string &condition_name)
@@ -73,7 +195,8 @@ namespace epic {
 			mHandle == nullptr)
 			return false;
 
-		return mRequest->acquire_lock_conditional(mHandle, condition_name.c_str());
+		std::unique_lock<std::mutex> lock(EpicDispatcher::get().mMutex);
+		return request(lock, mConditions[condition_name], condition_name, true);
 	}
 
 	bool EpicConnector::release()
@@ -82,7 +205,18 @@ namespace epic {
 			mHandle == nullptr)
 			return false;
 
-		return mRequest->release_lock(mHandle);
+		std::unique_lock<std::mutex> lock(EpicDispatcher::get().mMutex);
+
+		// the service holds the lock of an option acquire whatever the plain lock is
+		if (mOptionLock) {
+			mOptionLock = false;
+			EpicDispatcher::get().wait_idle(lock, this);
+			mLock.applied = true;
+			mLock.wanted = false;
+			return send_transition(lock, &mLock, std::string());
+		}
+
+		return request(lock, mLock, std::string(), false);
 	}
 
 	bool EpicConnector::release_conditional(std::string &condition_name)
@@ -91,7 +225,20 @@ namespace epic {
 			mHandle == nullptr)
 			return false;
 
-		return mRequest->release_lock_conditional(mHandle, condition_name.c_str());
+		std::unique_lock<std::mutex> lock(EpicDispatcher::get().mMutex);
+		return request(lock, mConditions[condition_name], condition_name, false);
+	}
+
+	void EpicConnector::flush()
+	{
+		EpicDispatcher &dispatcher = EpicDispatcher::get();
+		std::unique_lock<std::mutex> lock(dispatcher.mMutex);
+		LockState *state = nullptr;
+		std::string condition_name;
+
+		dispatcher.wait_idle(lock, this);
+		while (next_transition(&state, &condition_name) != Clock::time_point::max())
+			send_transition(lock, state, condition_name);
 	}
 
 	void EpicConnector::getService()
@@ -100,4 +247,102 @@ namespace epic {
 		if (mRequest == nullptr)
 			__android_log_print(ANDROID_LOG_INFO, "EPICOPERATOR", "Couldn't get service EPIC HIDL!");
 	}
+
+	bool EpicConnector::option_acquired(bool ret)
+	{
+		if (ret) {
+			std::lock_guard<std::mutex> lock(EpicDispatcher::get().mMutex);
+			mOptionLock = true;
+		}
+
+		return ret;
+	}
+
+	// with the mutex of the dispatcher held
+	bool EpicConnector::request(std::unique_lock<std::mutex> &lock, LockState &state,
+			const std::string &condition_name, bool acquire)
+	{
+		EpicDispatcher &dispatcher = EpicDispatcher::get();
+
+		// the transition in flight may be of this lock
+		dispatcher.wait_idle(lock, this);
+
+		state.wanted = acquire;
+		if (state.wanted == state.applied)
+			return true;
+
+		if (acquire || mReleaseDelay.count() == 0)
+			return send_transition(lock, &state, condition_name);
+
+		// the result of a delayed release is only logged
+		state.release_time = Clock::now() + mReleaseDelay;
+		dispatcher.schedule(this);
+
+		return true;
+	}
+
+	// with the mutex of the dispatcher held, the time the earliest transition is due
+	EpicConnector::Clock::time_point EpicConnector::next_transition(LockState **state, std::string *condition_name)
+	{
+		Clock::time_point next = Clock::time_point::max();
+
+		auto consider = [&](LockState &candidate, const std::string &name) {
+			if (candidate.wanted == candidate.applied)
+				return;
+
+			Clock::time_point due = candidate.wanted ? Clock::time_point::min() : candidate.release_time;
+			if (due < next) {
+				next = due;
+				*state = &candidate;
+				*condition_name = name;
+			}
+		};
+
+		consider(mLock, std::string());
+		for (auto &condition : mConditions)
+			consider(condition.second, condition.first);
+
+		return next;
+	}
+
+	// with the mutex of the dispatcher held, released during the call
+	bool EpicConnector::send_transition(std::unique_lock<std::mutex> &lock, LockState *state, const std::string &condition_name)
+	{
+		bool acquire = state->wanted;
+		bool conditional = (state != &mLock);
+		bool ret;
+
+		mInFlight++;
+		lock.unlock();
+
+		if (conditional && acquire)
+			ret = mRequest->acquire_lock_conditional(mHandle, condition_name.c_str());
+		else if (conditional)
+			ret = mRequest->release_lock_conditional(mHandle, condition_name.c_str());
+		else if (acquire)
+			ret = mRequest->acquire_lock(mHandle);
+		else
+			ret = mRequest->release_lock(mHandle);
+
+		lock.lock();
+		mInFlight--;
+
+		if (!acquire) {
+			if (!ret)
+				__android_log_print(ANDROID_LOG_INFO, "EPICOPERATOR", "Couldn't release %s!",
+						conditional ? condition_name.c_str() : "lock");
+			state->applied = false;
+		} else if (ret) {
+			state->applied = true;
+		} else {
+			// the caller of the old synchronous acquire saw the failure and did not retry
+			__android_log_print(ANDROID_LOG_INFO, "EPICOPERATOR", "Couldn't acquire %s!",
+					conditional ? condition_name.c_str() : "lock");
+			state->wanted = false;
+		}
+
+		EpicDispatcher::get().notify_sent();
+
+		return ret;
+	}
 }
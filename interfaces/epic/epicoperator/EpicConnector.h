@@ -5,12 +5,28 @@ using ::vendor::samsung_slsi::hardware::epic::V1_0::IEpicRequest;
 using ::vendor::samsung_slsi::hardware::epic::V1_0::IEpicHandle;
 using ::android::sp;
 
+#include <chrono>
+#include <map>
+#include <mutex>
 #include <string>
 
 namespace epic {
+	/*
+	 * The lock and the conditional locks requested through a connector are
+	 * tracked here, and only their transitions reach the service, from a
+	 * dispatcher thread shared by the connectors of the process.
+	 * An acquire of a lock already held, or a release of one not held, costs
+	 * no call. A release waits for the release delay, and an acquire within
+	 * it cancels both: a codec acquiring and releasing every frame keeps the
+	 * lock across frames instead of calling the service twice a frame.
+	 * Acquires and undelayed releases are sent synchronously and return the
+	 * result of the service. The option acquires are sent after the pending
+	 * transitions, and the release following one always reaches the service.
+	 */
 	class EpicConnector {
 	public:
 		EpicConnector();
+		EpicConnector(const sp<IEpicRequest> &request, std::chrono::milliseconds release_delay);
 		~EpicConnector();
 
 		void alloc_request(int scenario_id);
@@ -20,13 +36,42 @@ namespace epic {
 		bool acquire(unsigned int value, unsigned int usec);
 		bool acquire(unsigned int *value, unsigned int *usec, int len);
 		bool acquire_conditional(std::string &condition_name);
+		// true once a delayed release is accepted, the service is called later
 		bool release();
 		bool release_conditional(std::string &condition_name);
+		// send the pending transitions now, releases included
+		void flush();
+
+		constexpr static const char *PROP_RELEASE_DELAY = "vendor.epic.release_delay_ms";
+		constexpr static const int DEFAULT_RELEASE_DELAY_MS = 50;
 
 	private:
+		friend class EpicDispatcher;
+
+		using Clock = std::chrono::steady_clock;
+
+		struct LockState {
+			bool wanted = false;
+			bool applied = false;
+			Clock::time_point release_time;
+		};
+
 		void getService();
+		bool option_acquired(bool ret);
+		bool request(std::unique_lock<std::mutex> &lock, LockState &state,
+				const std::string &condition_name, bool acquire);
+		Clock::time_point next_transition(LockState **state, std::string *condition_name);
+		bool send_transition(std::unique_lock<std::mutex> &lock, LockState *state, const std::string &condition_name);
 
 		sp<IEpicRequest> mRequest;
 		sp<IEpicHandle> mHandle;
+
+		// guarded by the mutex of the dispatcher
+		std::chrono::milliseconds mReleaseDelay;
+		LockState mLock;
+		std::map<std::string, LockState> mConditions;
+		// the service holds the lock of an option acquire
+		bool mOptionLock;
+		int mInFlight;
 	};
 }
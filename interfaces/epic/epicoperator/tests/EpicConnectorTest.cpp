@@ -0,0 +1,278 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+
+#include <gtest/gtest.h>
+
+#include "../EpicConnector.h"
+
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+class MockEpicHandle : public IEpicHandle {
+public:
+	Return<void> init(int64_t) override { return Void(); }
+	Return<int64_t> get_handle() override { return 1; }
+	Return<void> diagonostic() override { return Void(); }
+};
+
+/* Records the calls a connector makes, in order */
+class MockEpicRequest : public IEpicRequest {
+public:
+	MockEpicRequest() : mAcquireResult(1) {}
+
+	Return<sp<IEpicHandle>> init(int32_t) override { return sp<IEpicHandle>(new MockEpicHandle()); }
+	Return<sp<IEpicHandle>> init_multi(const hidl_vec<int32_t> &) override { return sp<IEpicHandle>(new MockEpicHandle()); }
+	Return<uint32_t> update_handle_id(const sp<IEpicHandle> &, const hidl_string &) override { return record("update_handle_id"); }
+	Return<uint32_t> acquire_lock(const sp<IEpicHandle> &) override { return record("acquire_lock", mAcquireResult); }
+	Return<uint32_t> release_lock(const sp<IEpicHandle> &) override { return record("release_lock"); }
+	Return<uint32_t> acquire_lock_option(const sp<IEpicHandle> &, uint32_t, uint32_t) override { return record("acquire_lock_option"); }
+	Return<uint32_t> acquire_lock_multi_option(const sp<IEpicHandle> &, const hidl_vec<uint32_t> &,
+			const hidl_vec<uint32_t> &) override { return record("acquire_lock_multi_option"); }
+	Return<uint32_t> acquire_lock_conditional(const sp<IEpicHandle> &, const hidl_string &name) override
+	{
+		return record("acquire_lock_conditional " + std::string(name.c_str()), mAcquireResult);
+	}
+	Return<uint32_t> release_lock_conditional(const sp<IEpicHandle> &, const hidl_string &name) override
+	{
+		return record("release_lock_conditional " + std::string(name.c_str()));
+	}
+	Return<uint32_t> perf_hint(const sp<IEpicHandle> &, const hidl_string &) override { return record("perf_hint"); }
+	Return<uint32_t> hint_release(const sp<IEpicHandle> &, const hidl_string &) override { return record("hint_release"); }
+
+	std::vector<std::string> calls()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mCalls;
+	}
+
+	bool wait_calls(size_t count)
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		return mCondition.wait_for(lock, 1s, [&] { return mCalls.size() >= count; });
+	}
+
+	std::atomic<uint32_t> mAcquireResult;
+
+private:
+	uint32_t record(const std::string &call, uint32_t ret = 1)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mCalls.push_back(call);
+		mCondition.notify_all();
+		return ret;
+	}
+
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	std::vector<std::string> mCalls;
+};
+
+class EpicConnectorTest : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		mMock = sp<MockEpicRequest>(new MockEpicRequest());
+	}
+
+	std::unique_ptr<epic::EpicConnector> connect(std::chrono::milliseconds release_delay)
+	{
+		std::unique_ptr<epic::EpicConnector> connector(new epic::EpicConnector(mMock, release_delay));
+		connector->alloc_request(30000);
+		return connector;
+	}
+
+	sp<MockEpicRequest> mMock;
+};
+
+TEST_F(EpicConnectorTest, RedundantTransitionsAreDropped)
+{
+	auto connector = connect(0ms);
+
+	EXPECT_TRUE(connector->acquire());
+	EXPECT_TRUE(connector->acquire());
+	ASSERT_TRUE(mMock->wait_calls(1));
+	EXPECT_TRUE(connector->acquire());
+
+	EXPECT_TRUE(connector->release());
+	ASSERT_TRUE(mMock->wait_calls(2));
+	EXPECT_TRUE(connector->release());
+
+	std::this_thread::sleep_for(20ms);
+	EXPECT_EQ(mMock->calls(), std::vector<std::string>({ "acquire_lock", "release_lock" }));
+}
+
+TEST_F(EpicConnectorTest, AcquireCancelsDelayedRelease)
+{
+	auto connector = connect(100ms);
+	std::string condition("video_decoder");
+
+	EXPECT_TRUE(connector->acquire_conditional(condition));
+	ASSERT_TRUE(mMock->wait_calls(1));
+
+	EXPECT_TRUE(connector->release_conditional(condition));
+	std::this_thread::sleep_for(20ms);
+	EXPECT_TRUE(connector->acquire_conditional(condition));
+	EXPECT_TRUE(connector->release_conditional(condition));
+
+	ASSERT_TRUE(mMock->wait_calls(2));
+	EXPECT_EQ(mMock->calls(), std::vector<std::string>({
+		"acquire_lock_conditional video_decoder",
+		"release_lock_conditional video_decoder",
+	}));
+}
+
+TEST_F(EpicConnectorTest, LocksAreTrackedApart)
+{
+	auto connector = connect(0ms);
+	std::string decoder("video_decoder");
+	std::string encoder("video_encoder");
+
+	EXPECT_TRUE(connector->acquire_conditional(decoder));
+	ASSERT_TRUE(mMock->wait_calls(1));
+	EXPECT_TRUE(connector->acquire_conditional(encoder));
+	ASSERT_TRUE(mMock->wait_calls(2));
+	EXPECT_TRUE(connector->acquire());
+	ASSERT_TRUE(mMock->wait_calls(3));
+
+	EXPECT_EQ(mMock->calls(), std::vector<std::string>({
+		"acquire_lock_conditional video_decoder",
+		"acquire_lock_conditional video_encoder",
+		"acquire_lock",
+	}));
+}
+
+TEST_F(EpicConnectorTest, OptionFollowsPendingRelease)
+{
+	auto connector = connect(1000ms);
+
+	EXPECT_TRUE(connector->acquire());
+	ASSERT_TRUE(mMock->wait_calls(1));
+	EXPECT_TRUE(connector->release());
+	EXPECT_TRUE(connector->acquire(100, 1000));
+
+	EXPECT_EQ(mMock->calls(), std::vector<std::string>({
+		"acquire_lock",
+		"release_lock",
+		"acquire_lock_option",
+	}));
+}
+
+TEST_F(EpicConnectorTest, DestructorSendsPendingRelease)
+{
+	auto connector = connect(1000ms);
+
+	EXPECT_TRUE(connector->acquire());
+	ASSERT_TRUE(mMock->wait_calls(1));
+	EXPECT_TRUE(connector->release());
+	connector.reset();
+
+	EXPECT_EQ(mMock->calls(), std::vector<std::string>({ "acquire_lock", "release_lock" }));
+}
+
+TEST_F(EpicConnectorTest, FailedAcquireIsNotRetried)
+{
+	auto connector = connect(0ms);
+
+	mMock->mAcquireResult = 0;
+	EXPECT_FALSE(connector->acquire());
+	ASSERT_TRUE(mMock->wait_calls(1));
+	std::this_thread::sleep_for(20ms);
+	EXPECT_EQ(mMock->calls().size(), 1u);
+
+	// a new request is sent again
+	mMock->mAcquireResult = 1;
+	EXPECT_TRUE(connector->acquire());
+	ASSERT_TRUE(mMock->wait_calls(2));
+	EXPECT_TRUE(connector->release());
+	ASSERT_TRUE(mMock->wait_calls(3));
+}
+
+TEST_F(EpicConnectorTest, OptionIsReleased)
+{
+	auto connector = connect(1000ms);
+	unsigned int value[] = { 100, 200 };
+	unsigned int usec[] = { 1000, 1000 };
+
+	EXPECT_TRUE(connector->acquire(100, 1000));
+	EXPECT_TRUE(connector->release());
+	EXPECT_TRUE(connector->acquire(value, usec, 2));
+	EXPECT_TRUE(connector->acquire());
+	EXPECT_TRUE(connector->release());
+	EXPECT_TRUE(connector->release());
+
+	EXPECT_EQ(mMock->calls(), std::vector<std::string>({
+		"acquire_lock_option",
+		"release_lock",
+		"acquire_lock_multi_option",
+		"acquire_lock",
+		"release_lock",
+	}));
+}
+
+TEST_F(EpicConnectorTest, NoServiceNoRequest)
+{
+	epic::EpicConnector connector(nullptr, 0ms);
+	std::string condition("video_decoder");
+
+	EXPECT_FALSE(connector.acquire());
+	EXPECT_FALSE(connector.acquire_conditional(condition));
+	EXPECT_FALSE(connector.release());
+}
+
+/*
+ * EpicVideoDecodingOperator acquires its condition when a frame is queued to
+ * the decoder and releases it when the frame is out.
+ */
+size_t decode(const sp<MockEpicRequest> &mock, std::chrono::milliseconds release_delay, int fps, int frames)
+{
+	std::chrono::microseconds frame(1000000 / fps);
+	std::string condition("video_decoder");
+	size_t before = mock->calls().size();
+
+	{
+		epic::EpicConnector connector(mock, release_delay);
+		connector.alloc_request(30000);
+
+		for (int i = 0; i < frames; i++) {
+			connector.acquire_conditional(condition);
+			std::this_thread::sleep_for(frame * 4 / 10);
+			connector.release_conditional(condition);
+			std::this_thread::sleep_for(frame * 6 / 10);
+		}
+	}
+
+	return mock->calls().size() - before;
+}
+
+TEST_F(EpicConnectorTest, DecodePatterns)
+{
+	printf("%-6s %8s %12s %14s %14s\n", "fps", "frames", "synchronous", "no delay", "delay");
+
+	for (int fps : { 30, 60, 120 }) {
+		int frames = fps / 2;
+		size_t undelayed = decode(mMock, 0ms, fps, frames);
+		size_t delayed = decode(mMock, std::chrono::milliseconds(epic::EpicConnector::DEFAULT_RELEASE_DELAY_MS),
+				fps, frames);
+
+		printf("%-6d %8d %12d %14zu %14zu\n", fps, frames, 2 * frames, undelayed, delayed);
+
+		EXPECT_LE(undelayed, 2u * frames);
+		// the lock is held across the frames and released once at the end
+		EXPECT_LE(delayed, 4u);
+	}
+}
+
+}  // namespace
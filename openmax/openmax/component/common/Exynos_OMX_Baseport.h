@@ -170,6 +170,7 @@ typedef struct _EXYNOS_OMX_BASEPORT
 
     OMX_COLOR_FORMATTYPE          *supportFormat;
     EXYNOS_METADATA_TYPE           eMetaDataType;
+    OMX_HANDLETYPE                 hMetaDataCache;   /* graphic buffers in metadata mode : encoder input */
     OMX_BOOL                       bNeedContigMem;   /* contiguous memory : WFD(HDCP) */
     PLANE_TYPE                     ePlaneType;
 
@@ -743,12 +743,15 @@ OMX_BOOL Exynos_CSC_InputData(OMX_COMPONENTTYPE *pOMXComponent, EXYNOS_OMX_DATA
             range.eColorFormat  = eColorFormat;  /* OMX_COLOR_FormatAndroidOpaque */
             stride              = range.nWidth;
 
-            err = Exynos_OSAL_LockMetaData(pInputBuf,
-                                           range,
-                                           &stride, &bufferInfo,
-                                           pInputPort->eMetaDataType);
+            /* HW CSC only takes the fds : the buffer does not have to be mapped */
+            err = Exynos_OSAL_MetaDataCache_Lock(pInputPort->hMetaDataCache,
+                                                 pInputBuf,
+                                                 range,
+                                                 &stride, &bufferInfo,
+                                                 pInputPort->eMetaDataType,
+                                                 (csc_method == CSC_METHOD_HW)? METADATA_ACCESS_DEVICE:METADATA_ACCESS_CPU);
             if (err != OMX_ErrorNone) {
-                Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%p][%s]: Failed to Exynos_OSAL_LockMetaData (err:0x%x)",
+                Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%p][%s]: Failed to Exynos_OSAL_MetaDataCache_Lock (err:0x%x)",
                                                     pExynosComponent, __FUNCTION__, err);
                 goto EXIT;
             }
@@ -988,7 +991,7 @@ OMX_BOOL Exynos_CSC_InputData(OMX_COMPONENTTYPE *pOMXComponent, EXYNOS_OMX_DATA
     ret = (csc_ret != CSC_ErrorNone)? OMX_FALSE:OMX_TRUE;
 
     if (pInputPort->eMetaDataType & METADATA_TYPE_BUFFER_LOCK)
-        Exynos_OSAL_UnlockMetaData(pInputBuf, pInputPort->eMetaDataType);
+        Exynos_OSAL_MetaDataCache_Unlock(pInputPort->hMetaDataCache, pInputBuf, pInputPort->eMetaDataType);
 
 EXIT:
     FunctionOut();
@@ -2137,6 +2140,9 @@ OMX_ERRORTYPE Exynos_OMX_VideoEncodeComponentInit(OMX_IN OMX_HANDLETYPE hCompone
     pVideoEnc->eControlRate[INPUT_PORT_INDEX] = OMX_Video_ControlRateVariable;
 
     pExynosPort->eMetaDataType = METADATA_TYPE_DISABLED;
+#ifdef USE_ANDROID
+    pExynosPort->hMetaDataCache = Exynos_OSAL_MetaDataCache_Create();
+#endif
 
     /* Output port */
     pExynosPort = &pExynosComponent->pExynosPort[OUTPUT_PORT_INDEX];
@@ -2236,6 +2242,12 @@ OMX_ERRORTYPE Exynos_OMX_VideoEncodeComponentDeinit(OMX_IN OMX_HANDLETYPE hCompo
 
 #ifdef USE_ANDROID
     Exynos_OSAL_ReleasePerformanceHandle(pVideoEnc->pPerfHandle);
+
+    pExynosPort = &pExynosComponent->pExynosPort[INPUT_PORT_INDEX];
+    if (pExynosPort->hMetaDataCache != NULL) {
+        Exynos_OSAL_MetaDataCache_Terminate(pExynosPort->hMetaDataCache);
+        pExynosPort->hMetaDataCache = NULL;
+    }
 #endif
 
     if (pVideoEnc->bEncDRCSync == OMX_TRUE) {
@@ -470,6 +470,10 @@ OMX_ERRORTYPE Exynos_OMX_FreeBuffer(
                     ; /* None*/
                 }
 
+                /* the graphic buffers sent through this header can go away with it */
+                if (pExynosPort->hMetaDataCache != NULL)
+                    Exynos_OSAL_MetaDataCache_Reset(pExynosPort->hMetaDataCache);
+
                 pExynosPort->assignedBufferNum--;
 
                 if (pExynosPort->bufferStateAllocate[i] & HEADER_STATE_ALLOCATED) {
@@ -653,7 +657,7 @@ OMX_ERRORTYPE Exynos_OMX_FlushPort(
         if (pExynosPort->processData.bufferHeader != NULL) {
             if (nPortIndex == INPUT_PORT_INDEX) {
                 if (pExynosPort->eMetaDataType & METADATA_TYPE_BUFFER_LOCK)
-                    Exynos_OSAL_UnlockMetaData(pExynosPort->processData.bufferHeader->pBuffer, pExynosPort->eMetaDataType);
+                    Exynos_OSAL_MetaDataCache_Unlock(pExynosPort->hMetaDataCache, pExynosPort->processData.bufferHeader->pBuffer, pExynosPort->eMetaDataType);
 
                 Exynos_OMX_InputBufferReturn(pOMXComponent, pExynosPort->processData.bufferHeader);
             } else if (nPortIndex == OUTPUT_PORT_INDEX) {
@@ -669,7 +673,7 @@ OMX_ERRORTYPE Exynos_OMX_FlushPort(
                                                   pExynosPort->extendBufferHeader[i].OMXBufferHeader);
                 } else if (nPortIndex == INPUT_PORT_INDEX) {
                     if (pExynosPort->eMetaDataType & METADATA_TYPE_BUFFER_LOCK)
-                        Exynos_OSAL_UnlockMetaData(pExynosPort->extendBufferHeader[i].OMXBufferHeader->pBuffer, pExynosPort->eMetaDataType);
+                        Exynos_OSAL_MetaDataCache_Unlock(pExynosPort->hMetaDataCache, pExynosPort->extendBufferHeader[i].OMXBufferHeader->pBuffer, pExynosPort->eMetaDataType);
 
                     Exynos_OMX_InputBufferReturn(pOMXComponent,
                                                  pExynosPort->extendBufferHeader[i].OMXBufferHeader);
@@ -678,6 +682,9 @@ OMX_ERRORTYPE Exynos_OMX_FlushPort(
         }
     }
 
+    if (pExynosPort->hMetaDataCache != NULL)
+        Exynos_OSAL_MetaDataCache_Reset(pExynosPort->hMetaDataCache);
+
     if (pExynosPort->bufferSemID != NULL) {
         while (1) {
             OMX_S32 cnt = 0;
@@ -2611,10 +2618,13 @@ OMX_ERRORTYPE Exynos_Shared_BufferToData(
             range.eColorFormat  = pExynosPort->portDefinition.format.video.eColorFormat;
             stride              = range.nWidth;
 
-            ret = Exynos_OSAL_LockMetaData(pUseBuffer->bufferHeader->pBuffer,
-                                           range,
-                                           &stride, &bufferInfo,
-                                           pExynosPort->eMetaDataType);
+            /* the pixels are only read by MFC : mapped once, without the CPU cache maintenance per frame */
+            ret = Exynos_OSAL_MetaDataCache_Lock(pExynosPort->hMetaDataCache,
+                                                 pUseBuffer->bufferHeader->pBuffer,
+                                                 range,
+                                                 &stride, &bufferInfo,
+                                                 pExynosPort->eMetaDataType,
+                                                 METADATA_ACCESS_ADDRESS);
             if (ret != OMX_ErrorNone) {
                 /* if dataLen is zero with EOS flag, it is not an error.
                  * in this case, buffer handle can be null by framework.
@@ -2629,11 +2639,11 @@ OMX_ERRORTYPE Exynos_Shared_BufferToData(
                     pData->nFlags        = pUseBuffer->nFlags;
                     pData->pPrivate      = pUseBuffer->pPrivate;
                     pData->bufferHeader  = pUseBuffer->bufferHeader;
-                    Exynos_OSAL_Log(EXYNOS_LOG_ESSENTIAL, "[%s]: Failed to Exynos_OSAL_LockMetaData() but, this buffer is for EOS handling.", __FUNCTION__);
+                    Exynos_OSAL_Log(EXYNOS_LOG_ESSENTIAL, "[%s]: Failed to Exynos_OSAL_MetaDataCache_Lock() but, this buffer is for EOS handling.", __FUNCTION__);
                     goto EXIT;
                 }
 
-                Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s]: Failed to Exynos_OSAL_LockMetaData (err:0x%x)",
+                Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s]: Failed to Exynos_OSAL_MetaDataCache_Lock (err:0x%x)",
                                     __FUNCTION__, ret);
                 goto EXIT;
             }
@@ -2703,7 +2713,7 @@ OMX_ERRORTYPE Exynos_Shared_DataToBuffer(
     pUseBuffer->pPrivate              = pData->pPrivate;
 
     if (pExynosPort->eMetaDataType & METADATA_TYPE_BUFFER_LOCK)
-        Exynos_OSAL_UnlockMetaData(pUseBuffer->bufferHeader->pBuffer, pExynosPort->eMetaDataType);
+        Exynos_OSAL_MetaDataCache_Unlock(pExynosPort->hMetaDataCache, pUseBuffer->bufferHeader->pBuffer, pExynosPort->eMetaDataType);
 
 EXIT:
     FunctionOut();
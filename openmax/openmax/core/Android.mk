@@ -90,3 +90,40 @@ endif
 LOCAL_CFLAGS += -Wno-unused-variable -Wno-unused-label
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libExynosOMX_FakeComponent
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := tests/Exynos_OMX_Fake_Component.c
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(EXYNOS_OMX_INC)/exynos \
+	$(EXYNOS_OMX_INC)/khronos \
+	$(EXYNOS_OMX_TOP)/osal
+LOCAL_CFLAGS := -DUSE_KHRONOS_OMX_HEADER
+LOCAL_LDLIBS := -ldl
+
+include $(BUILD_HOST_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libExynosOMX_Core_register_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	Exynos_OMX_Component_Register.c \
+	tests/Exynos_OMX_Component_Register_Test.cpp
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(EXYNOS_OMX_INC)/exynos \
+	$(EXYNOS_OMX_INC)/khronos \
+	$(EXYNOS_OMX_TOP)/osal \
+	$(EXYNOS_OMX_TOP)/component/common
+LOCAL_CFLAGS := -DUSE_KHRONOS_OMX_HEADER -DUSE_DISABLE_RAPID_COMPONENT_LOAD \
+	-DEXYNOS_OMX_MANIFEST_PATH=\"omx_manifest\" \
+	-Wno-unused-variable -Wno-unused-label -Wno-unused-function
+LOCAL_REQUIRED_MODULES := libExynosOMX_FakeComponent
+LOCAL_SHARED_LIBRARIES := libExynosOMX_FakeComponent
+LOCAL_LDLIBS := -ldl
+
+include $(BUILD_HOST_NATIVE_TEST)
@@ -27,11 +27,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 #include <errno.h>
 #include <assert.h>
-#include <dirent.h>
 
 #include "OMX_Component.h"
 #include "Exynos_OSAL_Memory.h"
@@ -44,6 +48,48 @@
 #define EXYNOS_LOG_TAG    "EXYNOS_COMP_REGS"
 #include "Exynos_OSAL_Log.h"
 
+#ifndef EXYNOS_OMX_MANIFEST_PATH
+#define EXYNOS_OMX_MANIFEST_PATH        "/data/vendor/media/exynos_omx_components"
+#endif
+#define EXYNOS_OMX_MANIFEST_MAGIC       0x584D4F45  /* "EOMX" */
+#define EXYNOS_OMX_MANIFEST_VERSION     1
+
+/*
+ * result of Exynos_OMX_COMPONENT_Library_Register() for every component
+ * library, keyed by its path, size and mtime. it lets the registration skip
+ * loading the libraries which did not change since the last scan.
+ */
+typedef struct _EXYNOS_OMX_MANIFEST_LIB
+{
+    OMX_U8  libName[MAX_OMX_COMPONENT_LIBNAME_SIZE];
+    OMX_S64 size;
+    OMX_S64 mtimeSec;
+    OMX_S64 mtimeNsec;
+    OMX_U32 compIndex;
+    OMX_U32 compNum;
+} EXYNOS_OMX_MANIFEST_LIB;
+
+typedef struct _EXYNOS_OMX_MANIFEST
+{
+    OMX_U32                     magic;
+    OMX_U32                     version;
+    OMX_U32                     libNum;
+    OMX_U32                     compNum;
+    EXYNOS_OMX_MANIFEST_LIB     libs[MAX_OMX_COMPONENT_NUM];
+    ExynosRegisterComponentType comps[MAX_OMX_COMPONENT_NUM];
+} EXYNOS_OMX_MANIFEST;
+
+/* a reference on every library used so far, kept until unregistration */
+typedef struct _EXYNOS_OMX_LIBRARY
+{
+    OMX_U8          libName[MAX_OMX_COMPONENT_LIBNAME_SIZE];
+    OMX_HANDLETYPE  libHandle;
+} EXYNOS_OMX_LIBRARY;
+
+static EXYNOS_OMX_LIBRARY gLibraryList[MAX_OMX_COMPONENT_NUM];
+static int                gLibraryNum = 0;
+static pthread_mutex_t    gLibraryMutex = PTHREAD_MUTEX_INITIALIZER;
+
 static EXYNOS_OMX_COMPONENT_REGLIST gTableComponents[] = {
 #ifndef USE_CUSTOM_COMPONENT_SUPPORT
     /* Video Decoder */
@@ -534,21 +580,340 @@ EXIT:
     return;
 }
 
+#ifdef USE_DISABLE_RAPID_COMPONENT_LOAD
+/* the string ends in its field, a manifest from disk is not trusted */
+static OMX_BOOL isStringInField(const OMX_U8 *pStr, size_t nSize)
+{
+    return (memchr(pStr, '\0', nSize) != NULL)? OMX_TRUE:OMX_FALSE;
+}
+
+static OMX_BOOL isValidComponent(ExynosRegisterComponentType *pComponent)
+{
+    unsigned int i;
+
+    if ((isStringInField(pComponent->componentName, MAX_OMX_COMPONENT_NAME_SIZE) == OMX_FALSE) ||
+        (pComponent->totalRoleNum > MAX_OMX_COMPONENT_ROLE_NUM))
+        return OMX_FALSE;
+
+    for (i = 0; i < pComponent->totalRoleNum; i++) {
+        if (isStringInField(pComponent->roles[i], MAX_OMX_COMPONENT_ROLE_SIZE) == OMX_FALSE)
+            return OMX_FALSE;
+    }
+
+    return OMX_TRUE;
+}
+
+static OMX_BOOL isValidManifest(EXYNOS_OMX_MANIFEST *pManifest)
+{
+    unsigned int i;
+
+    if ((pManifest->magic != EXYNOS_OMX_MANIFEST_MAGIC) ||
+        (pManifest->version != EXYNOS_OMX_MANIFEST_VERSION) ||
+        (pManifest->libNum > MAX_OMX_COMPONENT_NUM) ||
+        (pManifest->compNum > MAX_OMX_COMPONENT_NUM))
+        return OMX_FALSE;
+
+    for (i = 0; i < pManifest->libNum; i++) {
+        EXYNOS_OMX_MANIFEST_LIB *pLib = &pManifest->libs[i];
+
+        if ((isStringInField(pLib->libName, MAX_OMX_COMPONENT_LIBNAME_SIZE) == OMX_FALSE) ||
+            (pLib->compIndex > pManifest->compNum) ||
+            (pLib->compNum > (pManifest->compNum - pLib->compIndex)))
+            return OMX_FALSE;
+    }
+
+    for (i = 0; i < pManifest->compNum; i++) {
+        if (isValidComponent(&pManifest->comps[i]) == OMX_FALSE)
+            return OMX_FALSE;
+    }
+
+    return OMX_TRUE;
+}
+
+static void getManifestPath(char *pPath, int nSize)
+{
+    /* 32bit and 64bit processes scan different directories */
+    snprintf(pPath, nSize, "%s%s", EXYNOS_OMX_MANIFEST_PATH, (IS_64BIT_OS? "64":"32"));
+}
+
+static OMX_BOOL readManifest(EXYNOS_OMX_MANIFEST *pManifest)
+{
+    char    path[PATH_MAX];
+    ssize_t len = 0;
+    int     fd  = -1;
+
+    getManifestPath(path, sizeof(path));
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        Exynos_OSAL_Log(EXYNOS_LOG_INFO, "[%s] no manifest(%s)", __FUNCTION__, path);
+        goto ERROR;
+    }
+
+    len = read(fd, pManifest, sizeof(EXYNOS_OMX_MANIFEST));
+    close(fd);
+
+    if ((len != (ssize_t)sizeof(EXYNOS_OMX_MANIFEST)) ||
+        (isValidManifest(pManifest) == OMX_FALSE)) {
+        Exynos_OSAL_Log(EXYNOS_LOG_WARNING, "[%s] ignore invalid manifest(%s)", __FUNCTION__, path);
+        goto ERROR;
+    }
+
+    return OMX_TRUE;
+
+ERROR:
+    pManifest->libNum  = 0;
+    pManifest->compNum = 0;
+
+    return OMX_FALSE;
+}
+
+static void writeManifest(EXYNOS_OMX_MANIFEST *pManifest)
+{
+    char    path[PATH_MAX];
+    char    tmpPath[PATH_MAX + 16];
+    ssize_t len = 0;
+    int     fd  = -1;
+
+    getManifestPath(path, sizeof(path));
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%d", path, (int)getpid());
+
+    pManifest->magic   = EXYNOS_OMX_MANIFEST_MAGIC;
+    pManifest->version = EXYNOS_OMX_MANIFEST_VERSION;
+
+    fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        Exynos_OSAL_Log(EXYNOS_LOG_WARNING, "[%s] Failed to open(%s): %s", __FUNCTION__, tmpPath, strerror(errno));
+        return;
+    }
+
+    len = write(fd, pManifest, sizeof(EXYNOS_OMX_MANIFEST));
+    close(fd);
+
+    /* the rename keeps the readers of other processes from seeing a partial file */
+    if ((len != (ssize_t)sizeof(EXYNOS_OMX_MANIFEST)) ||
+        (rename(tmpPath, path) != 0)) {
+        Exynos_OSAL_Log(EXYNOS_LOG_WARNING, "[%s] Failed to store manifest(%s)", __FUNCTION__, path);
+        unlink(tmpPath);
+        return;
+    }
+
+    Exynos_OSAL_Log(EXYNOS_LOG_INFO, "[%s] %d libraries, %d components", __FUNCTION__, pManifest->libNum, pManifest->compNum);
+}
+
+static EXYNOS_OMX_MANIFEST_LIB *findManifestLib(
+    EXYNOS_OMX_MANIFEST *pManifest,
+    char                *sLibName,
+    struct stat         *pStat)
+{
+    unsigned int i;
+
+    for (i = 0; i < pManifest->libNum; i++) {
+        EXYNOS_OMX_MANIFEST_LIB *pLib = &pManifest->libs[i];
+
+        if (Exynos_OSAL_Strcmp(pLib->libName, sLibName) != 0)
+            continue;
+
+        if ((pLib->size == (OMX_S64)pStat->st_size) &&
+            (pLib->mtimeSec == (OMX_S64)pStat->st_mtim.tv_sec) &&
+            (pLib->mtimeNsec == (OMX_S64)pStat->st_mtim.tv_nsec))
+            return pLib;
+
+        break;
+    }
+
+    return NULL;
+}
+
+/* loads the library to ask for its components, returns their number or -1 */
+static int queryLibrary(
+    char                        *sLibName,
+    ExynosRegisterComponentType *pComponents,
+    int                          nMaxComponents)
+{
+    OMX_HANDLETYPE                soHandle             = NULL;
+    ExynosRegisterComponentType **exynosComponentsTemp = NULL;
+    const char                   *errorMsg             = NULL;
+    int                           componentNum         = -1;
+    int                           i;
+
+    int (*Exynos_OMX_COMPONENT_Library_Register)(ExynosRegisterComponentType **exynosComponents);
+
+    soHandle = Exynos_OSAL_dlopen(sLibName, RTLD_NOW);
+    if (soHandle == NULL) {
+        Exynos_OSAL_Log(EXYNOS_LOG_WARNING, "dlopen failed: %s", Exynos_OSAL_dlerror());
+        return -1;
+    }
+
+    Exynos_OSAL_dlerror();    /* clear error*/
+    Exynos_OMX_COMPONENT_Library_Register = Exynos_OSAL_dlsym(soHandle, "Exynos_OMX_COMPONENT_Library_Register");
+    if (Exynos_OMX_COMPONENT_Library_Register == NULL) {
+        if ((errorMsg = Exynos_OSAL_dlerror()) != NULL)
+            Exynos_OSAL_Log(EXYNOS_LOG_WARNING, "dlsym failed: %s", errorMsg);
+        goto EXIT;
+    }
+
+    componentNum = (*Exynos_OMX_COMPONENT_Library_Register)(NULL);
+    if ((componentNum < 0) ||
+        (componentNum > nMaxComponents)) {
+        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] too many components(%d) in %s", __FUNCTION__, componentNum, sLibName);
+        componentNum = -1;
+        goto EXIT;
+    }
+
+    exynosComponentsTemp = (ExynosRegisterComponentType **)Exynos_OSAL_Malloc(sizeof(ExynosRegisterComponentType *) * (componentNum + 1));
+    if (exynosComponentsTemp == NULL) {
+        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] Failed to Exynos_OSAL_Malloc()", __FUNCTION__);
+        componentNum = -1;
+        goto EXIT;
+    }
+
+    /* the library fills the entries in place */
+    for (i = 0; i < componentNum; i++) {
+        Exynos_OSAL_Memset(&pComponents[i], 0, sizeof(ExynosRegisterComponentType));
+        exynosComponentsTemp[i] = &pComponents[i];
+    }
+
+    (*Exynos_OMX_COMPONENT_Library_Register)(exynosComponentsTemp);
+
+    Exynos_OSAL_Free(exynosComponentsTemp);
+    exynosComponentsTemp = NULL;
+
+    /* the entries go to the manifest and are copied with Strcpy */
+    for (i = 0; i < componentNum; i++) {
+        if (isValidComponent(&pComponents[i]) == OMX_FALSE) {
+            Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] invalid component name or role in %s", __FUNCTION__, sLibName);
+            componentNum = -1;
+            goto EXIT;
+        }
+    }
+
+EXIT:
+    Exynos_OSAL_dlclose(soHandle);
+    soHandle = NULL;
+
+    return componentNum;
+}
+
+static void addComponents(
+    char                         *sLibName,
+    ExynosRegisterComponentType  *pComponents,
+    int                           nComponents,
+    EXYNOS_OMX_COMPONENT_REGLIST *pComponentList,
+    int                          *pNumComponents)
+{
+    int i, j;
+
+    for (i = 0; i < nComponents; i++) {
+#ifdef DISABLE_CODEC_COMP
+        OMX_BOOL skip = OMX_FALSE;
+
+        for (j = 0; j < (int)(sizeof(gDisableComponents)/sizeof(gDisableComponents[0])); j++) {
+            if (Exynos_OSAL_Strstr((const char *)pComponents[i].componentName, gDisableComponents[j]) != NULL) {
+                skip = OMX_TRUE;
+                break;
+            }
+        }
+
+        if (skip == OMX_TRUE)
+            continue;
+#endif
+        if ((*pNumComponents) >= MAX_OMX_COMPONENT_NUM) {
+            Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] too many components, %s is dropped", __FUNCTION__, pComponents[i].componentName);
+            continue;
+        }
+
+        Exynos_OSAL_Strcpy(pComponentList[*pNumComponents].component.componentName, pComponents[i].componentName);
+        for (j = 0; (j < (int)pComponents[i].totalRoleNum) && (j < MAX_OMX_COMPONENT_ROLE_NUM); j++)
+            Exynos_OSAL_Strcpy(pComponentList[*pNumComponents].component.roles[j], pComponents[i].roles[j]);
+        pComponentList[*pNumComponents].component.totalRoleNum = j;
+
+        Exynos_OSAL_Strcpy(pComponentList[*pNumComponents].libName, sLibName);
+
+        (*pNumComponents)++;
+    }
+
+    return;
+}
+
+/*
+ * registers the components of one library. they are taken from the manifest
+ * of the last scan when the library did not change, otherwise the library is
+ * loaded and the new manifest is marked to be stored.
+ */
+static void registLibrary(
+    char                         *sLibName,
+    EXYNOS_OMX_MANIFEST          *pOldManifest,
+    EXYNOS_OMX_MANIFEST          *pNewManifest,
+    OMX_BOOL                     *pbManifestChanged,
+    EXYNOS_OMX_COMPONENT_REGLIST *pComponentList,
+    int                          *pNumComponents)
+{
+    EXYNOS_OMX_MANIFEST_LIB     *pOldLib     = NULL;
+    EXYNOS_OMX_MANIFEST_LIB     *pNewLib     = NULL;
+    ExynosRegisterComponentType *pComponents = NULL;
+    int                          componentNum = 0;
+    struct stat                  st;
+
+    if (stat(sLibName, &st) != 0) {
+        Exynos_OSAL_Log(EXYNOS_LOG_WARNING, "[%s] Failed to stat(%s)", __FUNCTION__, sLibName);
+        return;
+    }
+
+    if (pNewManifest->libNum >= MAX_OMX_COMPONENT_NUM) {
+        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] too many libraries, %s is dropped", __FUNCTION__, sLibName);
+        return;
+    }
+
+    pComponents = &pNewManifest->comps[pNewManifest->compNum];
+
+    pOldLib = findManifestLib(pOldManifest, sLibName, &st);
+    if ((pOldLib != NULL) &&
+        ((pNewManifest->compNum + pOldLib->compNum) <= MAX_OMX_COMPONENT_NUM)) {
+        componentNum = pOldLib->compNum;
+        Exynos_OSAL_Memcpy(pComponents, &pOldManifest->comps[pOldLib->compIndex],
+                           sizeof(ExynosRegisterComponentType) * componentNum);
+    } else {
+        Exynos_OSAL_Log(EXYNOS_LOG_INFO, "Loading the library: %s", sLibName);
+        componentNum = queryLibrary(sLibName, pComponents, MAX_OMX_COMPONENT_NUM - pNewManifest->compNum);
+        if (componentNum < 0)
+            return;
+
+        *pbManifestChanged = OMX_TRUE;
+    }
+
+    pNewLib = &pNewManifest->libs[pNewManifest->libNum];
+    Exynos_OSAL_Strcpy(pNewLib->libName, sLibName);
+    pNewLib->size      = (OMX_S64)st.st_size;
+    pNewLib->mtimeSec  = (OMX_S64)st.st_mtim.tv_sec;
+    pNewLib->mtimeNsec = (OMX_S64)st.st_mtim.tv_nsec;
+    pNewLib->compIndex = pNewManifest->compNum;
+    pNewLib->compNum   = componentNum;
+
+    pNewManifest->libNum++;
+    pNewManifest->compNum += componentNum;
+
+    addComponents(sLibName, pComponents, componentNum, pComponentList, pNumComponents);
+
+    return;
+}
+#endif
+
 OMX_ERRORTYPE Exynos_OMX_Component_Register(EXYNOS_OMX_COMPONENT_REGLIST **compList, OMX_U32 *compNum)
 {
     OMX_ERRORTYPE  ret = OMX_ErrorNone;
-    int            componentNum = 0, totalCompNum = 0;
+    int            totalCompNum = 0;
     const char    *libPath = NULL;
     char          *libName = NULL;
-    const char    *errorMsg = NULL;
     DIR           *dir = NULL;
     struct dirent *d = NULL;
 
-    int i, j;
-
-    int (*Exynos_OMX_COMPONENT_Library_Register)(ExynosRegisterComponentType **exynosComponents);
-    ExynosRegisterComponentType **exynosComponentsTemp = NULL;
     EXYNOS_OMX_COMPONENT_REGLIST *componentList        = NULL;
+#ifdef USE_DISABLE_RAPID_COMPONENT_LOAD
+    EXYNOS_OMX_MANIFEST          *pOldManifest         = NULL;
+    EXYNOS_OMX_MANIFEST          *pNewManifest         = NULL;
+    OMX_BOOL                      bManifestChanged     = OMX_FALSE;
+#endif
 
     FunctionIn();
 
@@ -576,92 +941,37 @@ OMX_ERRORTYPE Exynos_OMX_Component_Register(EXYNOS_OMX_COMPONENT_REGLIST **compL
         goto EXIT;
     }
 
-    while ((d = readdir(dir)) != NULL) {
-        OMX_HANDLETYPE soHandle = NULL;
+#ifdef USE_DISABLE_RAPID_COMPONENT_LOAD
+    pOldManifest = (EXYNOS_OMX_MANIFEST *)Exynos_OSAL_Malloc(sizeof(EXYNOS_OMX_MANIFEST));
+    pNewManifest = (EXYNOS_OMX_MANIFEST *)Exynos_OSAL_Malloc(sizeof(EXYNOS_OMX_MANIFEST));
+    if ((pOldManifest == NULL) ||
+        (pNewManifest == NULL)) {
+        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] Failed to Exynos_OSAL_Malloc()", __FUNCTION__);
+        ret = OMX_ErrorInsufficientResources;
+        goto EXIT;
+    }
+    Exynos_OSAL_Memset(pNewManifest, 0, sizeof(EXYNOS_OMX_MANIFEST));
 
-        if (Exynos_OSAL_CheckLibName(d->d_name) == 0) {
-            Exynos_OSAL_Log(EXYNOS_LOG_INFO, "Loading the library: %s", d->d_name);
+    if (readManifest(pOldManifest) == OMX_FALSE)
+        bManifestChanged = OMX_TRUE;
+#endif
 
+    while ((d = readdir(dir)) != NULL) {
+        if (Exynos_OSAL_CheckLibName(d->d_name) == 0) {
 #ifndef USE_DISABLE_RAPID_COMPONENT_LOAD
+            Exynos_OSAL_Log(EXYNOS_LOG_INFO, "Loading the library: %s", d->d_name);
             registComponent(d->d_name, componentList, &totalCompNum);
 #else
+            if ((Exynos_OSAL_Strlen(libPath) + Exynos_OSAL_Strlen(d->d_name)) >= MAX_OMX_COMPONENT_LIBNAME_SIZE) {
+                Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] too long library path, %s is dropped", __FUNCTION__, d->d_name);
+                continue;
+            }
+
             Exynos_OSAL_Memset(libName, 0, MAX_OMX_COMPONENT_LIBNAME_SIZE);
             Exynos_OSAL_Strcpy(libName, (OMX_PTR)libPath);
             Exynos_OSAL_Strcat(libName, d->d_name);
 
-            if ((soHandle = Exynos_OSAL_dlopen(libName, RTLD_NOW)) != NULL) {
-                Exynos_OSAL_dlerror();    /* clear error*/
-                if ((Exynos_OMX_COMPONENT_Library_Register = Exynos_OSAL_dlsym(soHandle, "Exynos_OMX_COMPONENT_Library_Register")) != NULL) {
-                    componentNum = (*Exynos_OMX_COMPONENT_Library_Register)(NULL);
-                    exynosComponentsTemp = (ExynosRegisterComponentType **)Exynos_OSAL_Malloc(sizeof(ExynosRegisterComponentType *) * componentNum);
-                    if (exynosComponentsTemp == NULL) {
-                        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] Failed to Exynos_OSAL_Malloc()", __FUNCTION__);
-                        ret = OMX_ErrorInsufficientResources;
-                        goto EXIT;
-                    }
-
-                    for (i = 0; i < componentNum; i++) {
-                        exynosComponentsTemp[i] = Exynos_OSAL_Malloc(sizeof(ExynosRegisterComponentType));
-                        if (exynosComponentsTemp[i] == NULL) {
-                            Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] Failed to Exynos_OSAL_Malloc()", __FUNCTION__);
-                            for (j = 0; j < i; j++) {
-                                Exynos_OSAL_Free(exynosComponentsTemp[j]);
-                                exynosComponentsTemp[j] = NULL;
-                            }
-
-                            Exynos_OSAL_Free(exynosComponentsTemp);
-                            exynosComponentsTemp = NULL;
-                            ret = OMX_ErrorInsufficientResources;
-                            goto EXIT;
-                        }
-
-                        Exynos_OSAL_Memset(exynosComponentsTemp[i], 0, sizeof(ExynosRegisterComponentType));
-                    }
-
-                    (*Exynos_OMX_COMPONENT_Library_Register)(exynosComponentsTemp);
-
-                    for (i = 0; i < componentNum; i++) {
-#ifdef DISABLE_CODEC_COMP
-                        OMX_BOOL skip = OMX_FALSE;
-                        int j;
-
-                        for (j = 0; j < sizeof(gDisableComponents)/sizeof(gDisableComponents[0]); j++) {
-                            if (Exynos_OSAL_Strstr(exynosComponentsTemp[i]->componentName, gDisableComponents[j]) != NULL) {
-                                skip = OMX_TRUE;
-                                break;
-                            }
-                        }
-
-                        if (skip == OMX_TRUE)
-                            continue;
-#endif
-                        Exynos_OSAL_Strcpy(componentList[totalCompNum].component.componentName, exynosComponentsTemp[i]->componentName);
-                        for (j = 0; j < (int)exynosComponentsTemp[i]->totalRoleNum; j++)
-                            Exynos_OSAL_Strcpy(componentList[totalCompNum].component.roles[j], exynosComponentsTemp[i]->roles[j]);
-                        componentList[totalCompNum].component.totalRoleNum = exynosComponentsTemp[i]->totalRoleNum;
-
-                        Exynos_OSAL_Strcpy(componentList[totalCompNum].libName, libName);
-
-                        totalCompNum++;
-                    }
-
-                    for (i = 0; i < componentNum; i++) {
-                        Exynos_OSAL_Free(exynosComponentsTemp[i]);
-                        exynosComponentsTemp[i] = NULL;
-                    }
-
-                    Exynos_OSAL_Free(exynosComponentsTemp);
-                    exynosComponentsTemp = NULL;
-                } else {
-                    if ((errorMsg = Exynos_OSAL_dlerror()) != NULL)
-                        Exynos_OSAL_Log(EXYNOS_LOG_WARNING, "dlsym failed: %s", errorMsg);
-                }
-
-                Exynos_OSAL_dlclose(soHandle);
-                soHandle = NULL;
-            } else {
-                Exynos_OSAL_Log(EXYNOS_LOG_WARNING, "dlopen failed: %s", Exynos_OSAL_dlerror());
-            }
+            registLibrary(libName, pOldManifest, pNewManifest, &bManifestChanged, componentList, &totalCompNum);
 #endif
         } else {
             /* not a component name line. skip */
@@ -669,6 +979,15 @@ OMX_ERRORTYPE Exynos_OMX_Component_Register(EXYNOS_OMX_COMPONENT_REGLIST **compL
         }
     }
 
+#ifdef USE_DISABLE_RAPID_COMPONENT_LOAD
+    /* a library was removed */
+    if (pNewManifest->libNum != pOldManifest->libNum)
+        bManifestChanged = OMX_TRUE;
+
+    if (bManifestChanged == OMX_TRUE)
+        writeManifest(pNewManifest);
+#endif
+
     *compList = componentList;
     *compNum = totalCompNum;
 
@@ -689,6 +1008,18 @@ EXIT:
         libName = NULL;
     }
 
+#ifdef USE_DISABLE_RAPID_COMPONENT_LOAD
+    if (pOldManifest != NULL) {
+        Exynos_OSAL_Free(pOldManifest);
+        pOldManifest = NULL;
+    }
+
+    if (pNewManifest != NULL) {
+        Exynos_OSAL_Free(pNewManifest);
+        pNewManifest = NULL;
+    }
+#endif
+
     FunctionOut();
 
     return ret;
@@ -697,6 +1028,15 @@ EXIT:
 OMX_ERRORTYPE Exynos_OMX_Component_Unregister(EXYNOS_OMX_COMPONENT_REGLIST *componentList)
 {
     OMX_ERRORTYPE ret = OMX_ErrorNone;
+    int i;
+
+    pthread_mutex_lock(&gLibraryMutex);
+    for (i = 0; i < gLibraryNum; i++) {
+        Exynos_OSAL_dlclose(gLibraryList[i].libHandle);
+        gLibraryList[i].libHandle = NULL;
+    }
+    gLibraryNum = 0;
+    pthread_mutex_unlock(&gLibraryMutex);
 
     Exynos_OSAL_Free(componentList);
 
@@ -704,6 +1044,46 @@ EXIT:
     return ret;
 }
 
+/*
+ * maps the library once, when one of its components is used for the first
+ * time. components still take their own reference, which only bumps the
+ * reference count of the library that is already loaded.
+ */
+static OMX_ERRORTYPE pinLibrary(OMX_U8 *sLibName)
+{
+    OMX_ERRORTYPE  ret       = OMX_ErrorNone;
+    OMX_HANDLETYPE libHandle = NULL;
+    int i;
+
+    pthread_mutex_lock(&gLibraryMutex);
+
+    for (i = 0; i < gLibraryNum; i++) {
+        if (Exynos_OSAL_Strcmp(gLibraryList[i].libName, sLibName) == 0)
+            goto EXIT;
+    }
+
+    libHandle = Exynos_OSAL_dlopen((OMX_STRING)sLibName, RTLD_NOW);
+    if (libHandle == NULL) {
+        ret = OMX_ErrorInvalidComponentName;
+        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] Failed to Exynos_OSAL_dlopen(%s): %s", __FUNCTION__, sLibName, Exynos_OSAL_dlerror());
+        goto EXIT;
+    }
+
+    if (gLibraryNum >= MAX_OMX_COMPONENT_NUM) {
+        Exynos_OSAL_dlclose(libHandle);
+        goto EXIT;
+    }
+
+    Exynos_OSAL_Strcpy(gLibraryList[gLibraryNum].libName, sLibName);
+    gLibraryList[gLibraryNum].libHandle = libHandle;
+    gLibraryNum++;
+
+EXIT:
+    pthread_mutex_unlock(&gLibraryMutex);
+
+    return ret;
+}
+
 OMX_ERRORTYPE Exynos_OMX_ComponentAPICheck(OMX_COMPONENTTYPE *component)
 {
     OMX_ERRORTYPE ret = OMX_ErrorNone;
@@ -747,6 +1127,10 @@ OMX_ERRORTYPE Exynos_OMX_ComponentLoad(EXYNOS_OMX_COMPONENT *exynos_component)
 
     OMX_ERRORTYPE (*Exynos_OMX_ComponentInit)(OMX_HANDLETYPE hComponent, OMX_STRING componentName);
 
+    ret = pinLibrary(exynos_component->libName);
+    if (ret != OMX_ErrorNone)
+        goto EXIT;
+
     libHandle = Exynos_OSAL_dlopen((OMX_STRING)exynos_component->libName, RTLD_NOW);
     if (libHandle == NULL) {
         ret = OMX_ErrorInvalidComponentName;
@@ -46,7 +46,6 @@ typedef struct _EXYNOS_OMX_COMPONENT_REGLIST
     OMX_U8  libName[MAX_OMX_COMPONENT_LIBNAME_SIZE];
 } EXYNOS_OMX_COMPONENT_REGLIST;
 
-struct EXYNOS_OMX_COMPONENT;
 typedef struct _EXYNOS_OMX_COMPONENT
 {
     OMX_U8                        componentName[MAX_OMX_COMPONENT_NAME_SIZE];
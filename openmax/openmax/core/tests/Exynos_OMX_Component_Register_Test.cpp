@@ -0,0 +1,369 @@
+/*
+ *
+ * Copyright 2026 Samsung Electronics S.LSI Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Registers copies of libExynosOMX_FakeComponent.so with
+ * USE_DISABLE_RAPID_COMPONENT_LOAD, the path that loads every component
+ * library at init. The OSAL is replaced here so that the library directory
+ * points to the copies and the dlopen calls that map a library are counted.
+ * The manifest is stored in the current directory (EXYNOS_OMX_MANIFEST_PATH).
+ */
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "Exynos_OMX_Component_Register.h"
+#include "Exynos_OSAL_ETC.h"
+#include "Exynos_OSAL_Library.h"
+#include "Exynos_OSAL_Log.h"
+#include "Exynos_OSAL_Memory.h"
+
+namespace {
+
+const int kLibraryNum = 12;
+
+std::string gLibPath;
+int gMapped = 0;
+
+} // namespace
+
+extern "C" {
+
+void *Exynos_OSAL_dlopen(const char *filename, int flag)
+{
+    void *handle = dlopen(filename, RTLD_NOW | RTLD_NOLOAD);
+
+    if (handle != NULL)
+        dlclose(handle);
+    else
+        gMapped++;
+
+    return dlopen(filename, flag);
+}
+
+void *Exynos_OSAL_dlsym(void *handle, const char *symbol) { return dlsym(handle, symbol); }
+int Exynos_OSAL_dlclose(void *handle) { return dlclose(handle); }
+const char *Exynos_OSAL_dlerror(void) { return dlerror(); }
+const char *Exynos_OSAL_GetLibPath(void) { return gLibPath.c_str(); }
+
+int Exynos_OSAL_CheckLibName(char *pLibName)
+{
+    size_t len = strlen(pLibName);
+
+    if (strncmp(pLibName, "libOMX.Exynos.", strlen("libOMX.Exynos.")) ||
+        (len < 3) || strcmp(pLibName + len - 3, ".so"))
+        return -1;
+
+    return 0;
+}
+
+OMX_PTR Exynos_OSAL_Malloc(OMX_U32 size) { return malloc(size); }
+void Exynos_OSAL_Free(OMX_PTR addr) { free(addr); }
+OMX_PTR Exynos_OSAL_Memset(OMX_PTR dest, OMX_S32 c, OMX_S32 n) { return memset(dest, c, n); }
+OMX_PTR Exynos_OSAL_Memcpy(OMX_PTR dest, OMX_PTR src, OMX_S32 n) { return memcpy(dest, src, n); }
+
+size_t Exynos_OSAL_Strcpy(OMX_PTR dest, OMX_PTR src)
+{
+    strcpy((char *)dest, (const char *)src);
+    return strlen((const char *)dest);
+}
+
+OMX_S32 Exynos_OSAL_Strncmp(OMX_PTR str1, OMX_PTR str2, size_t num)
+{
+    return strncmp((const char *)str1, (const char *)str2, num);
+}
+
+OMX_S32 Exynos_OSAL_Strcmp(OMX_PTR str1, OMX_PTR str2)
+{
+    return strcmp((const char *)str1, (const char *)str2);
+}
+
+const char *Exynos_OSAL_Strstr(const char *str1, const char *str2) { return strstr(str1, str2); }
+
+size_t Exynos_OSAL_Strcat(OMX_PTR dest, OMX_PTR src)
+{
+    strcat((char *)dest, (const char *)src);
+    return strlen((const char *)dest);
+}
+
+size_t Exynos_OSAL_Strlen(const char *str) { return strlen(str); }
+
+void _Exynos_OSAL_Log(EXYNOS_LOG_LEVEL logLevel, const char *tag, const char *msg, ...)
+{
+    (void)logLevel;
+    (void)tag;
+    (void)msg;
+}
+
+} // extern "C"
+
+namespace {
+
+std::string libraryName(int i)
+{
+    return gLibPath + "libOMX.Exynos.Fake" + std::to_string(i) + ".Decoder.so";
+}
+
+bool copyFile(const std::string &from, const std::string &to)
+{
+    std::vector<char> data;
+    char buf[64 * 1024];
+    ssize_t len;
+    int in = open(from.c_str(), O_RDONLY);
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    bool ok = (in >= 0) && (out >= 0);
+
+    while (ok && (len = read(in, buf, sizeof(buf))) > 0)
+        ok = write(out, buf, len) == len;
+
+    if (in >= 0)
+        close(in);
+    if (out >= 0)
+        close(out);
+
+    return ok;
+}
+
+const char *manifestName()
+{
+    return (sizeof(void *) == 8)? "omx_manifest64":"omx_manifest32";
+}
+
+bool readFile(const std::string &name, std::vector<char> *data)
+{
+    struct stat st;
+    int fd = open(name.c_str(), O_RDONLY);
+    bool ok = (fd >= 0) && (fstat(fd, &st) == 0);
+
+    if (ok) {
+        data->resize(st.st_size);
+        ok = read(fd, data->data(), data->size()) == (ssize_t)data->size();
+    }
+    if (fd >= 0)
+        close(fd);
+
+    return ok;
+}
+
+bool writeFile(const std::string &name, const std::vector<char> &data)
+{
+    int fd = open(name.c_str(), O_WRONLY | O_TRUNC);
+    bool ok = (fd >= 0) && (write(fd, data.data(), data.size()) == (ssize_t)data.size());
+
+    if (fd >= 0)
+        close(fd);
+
+    return ok;
+}
+
+class ExynosOMXComponentRegisterTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char dir[] = "/tmp/exynos_omx_register.XXXXXX";
+        Dl_info info;
+        void *fake = dlopen("libExynosOMX_FakeComponent.so", RTLD_NOW);
+
+        ASSERT_NE(nullptr, fake) << dlerror();
+        ASSERT_NE(0, dladdr(dlsym(fake, "Exynos_OMX_ComponentInit"), &info));
+        std::string source = info.dli_fname;
+        dlclose(fake);
+
+        ASSERT_NE(nullptr, mkdtemp(dir));
+        mDir = dir;
+        gLibPath = mDir + "/omx/";
+        ASSERT_EQ(0, mkdir(gLibPath.c_str(), 0755));
+        for (int i = 0; i < kLibraryNum; i++)
+            ASSERT_TRUE(copyFile(source, libraryName(i)));
+
+        ASSERT_EQ(0, getcwd(mCwd, sizeof(mCwd)) == NULL);
+        ASSERT_EQ(0, chdir(mDir.c_str()));
+    }
+
+    void TearDown() override {
+        if (mCwd[0] != '\0') {
+            EXPECT_EQ(0, chdir(mCwd));
+        }
+        if (!mDir.empty()) {
+            EXPECT_EQ(0, system(("rm -rf " + mDir).c_str()));
+        }
+    }
+
+    /* returns the component names, sorted */
+    static std::vector<std::string> registerComponents(int *mapped) {
+        EXYNOS_OMX_COMPONENT_REGLIST *list = NULL;
+        std::vector<std::string> names;
+        OMX_U32 num = 0;
+
+        gMapped = 0;
+        EXPECT_EQ(OMX_ErrorNone, Exynos_OMX_Component_Register(&list, &num));
+        *mapped = gMapped;
+
+        for (OMX_U32 i = 0; i < num; i++) {
+            EXPECT_EQ(1u, list[i].component.totalRoleNum);
+            EXPECT_STREQ("video_decoder.fake", (const char *)list[i].component.roles[0]);
+            names.push_back(std::string((const char *)list[i].component.componentName) + "@" +
+                            (const char *)list[i].libName);
+        }
+        std::sort(names.begin(), names.end());
+
+        Exynos_OMX_Component_Unregister(list);
+
+        return names;
+    }
+
+    std::string mDir;
+    char mCwd[PATH_MAX] = "";
+};
+
+} // namespace
+
+TEST_F(ExynosOMXComponentRegisterTest, WarmInitLoadsNoLibrary) {
+    int mapped;
+    std::vector<std::string> cold = registerComponents(&mapped);
+
+    ASSERT_EQ(2u * kLibraryNum, cold.size());
+    EXPECT_EQ(kLibraryNum, mapped);
+    EXPECT_NE(cold.end(), std::find(cold.begin(), cold.end(),
+                                    "OMX.Exynos.Fake0.Decoder.secure@" + libraryName(0)));
+
+    std::vector<std::string> warm = registerComponents(&mapped);
+    EXPECT_EQ(cold, warm);
+    EXPECT_EQ(0, mapped);
+}
+
+TEST_F(ExynosOMXComponentRegisterTest, ChangedLibrariesAreRescanned) {
+    struct timespec times[2] = {{0, UTIME_OMIT}, {1000, 0}};
+    int mapped;
+
+    registerComponents(&mapped);
+
+    /* a new build of one library, another one is gone */
+    ASSERT_EQ(0, utimensat(AT_FDCWD, libraryName(3).c_str(), times, 0));
+    ASSERT_EQ(0, unlink(libraryName(5).c_str()));
+
+    std::vector<std::string> names = registerComponents(&mapped);
+    EXPECT_EQ(2u * (kLibraryNum - 1), names.size());
+    EXPECT_EQ(1, mapped);
+
+    registerComponents(&mapped);
+    EXPECT_EQ(0, mapped);
+
+    /* a damaged manifest only costs a rescan */
+    ASSERT_EQ(0, truncate(manifestName(), 100));
+    EXPECT_EQ(names, registerComponents(&mapped));
+    EXPECT_EQ(kLibraryNum - 1, mapped);
+}
+
+TEST_F(ExynosOMXComponentRegisterTest, UnterminatedManifestStringsAreRescanned) {
+    std::vector<char> data;
+    int mapped;
+
+    std::vector<std::string> names = registerComponents(&mapped);
+
+    /* the name of the first library fills its field, after magic, version, libNum and compNum */
+    ASSERT_TRUE(readFile(manifestName(), &data));
+    ASSERT_GT(data.size(), 4 * sizeof(OMX_U32) + MAX_OMX_COMPONENT_LIBNAME_SIZE);
+    memset(&data[4 * sizeof(OMX_U32)], 'x', MAX_OMX_COMPONENT_LIBNAME_SIZE);
+    ASSERT_TRUE(writeFile(manifestName(), data));
+    EXPECT_EQ(names, registerComponents(&mapped));
+    EXPECT_EQ(kLibraryNum, mapped);
+
+    /* a role fills its field */
+    ASSERT_TRUE(readFile(manifestName(), &data));
+    std::string role = "video_decoder.fake";
+    auto it = std::search(data.begin(), data.end(), role.begin(), role.end());
+    ASSERT_NE(data.end(), it);
+    ASSERT_GE(data.end() - it, MAX_OMX_COMPONENT_ROLE_SIZE);
+    std::fill(it, it + MAX_OMX_COMPONENT_ROLE_SIZE, 'x');
+    ASSERT_TRUE(writeFile(manifestName(), data));
+    EXPECT_EQ(names, registerComponents(&mapped));
+    EXPECT_EQ(kLibraryNum, mapped);
+
+    registerComponents(&mapped);
+    EXPECT_EQ(0, mapped);
+}
+
+TEST_F(ExynosOMXComponentRegisterTest, ComponentLibraryIsLoadedOnce) {
+    EXYNOS_OMX_COMPONENT_REGLIST *list = NULL;
+    OMX_U32 num = 0;
+
+    ASSERT_EQ(OMX_ErrorNone, Exynos_OMX_Component_Register(&list, &num));
+    ASSERT_GT(num, 0u);
+
+    gMapped = 0;
+    for (int i = 0; i < 20; i++) {
+        EXYNOS_OMX_COMPONENT component;
+
+        memset(&component, 0, sizeof(component));
+        strcpy((char *)component.libName, (const char *)list[i % 2].libName);
+        strcpy((char *)component.componentName, (const char *)list[i % 2].component.componentName);
+
+        ASSERT_EQ(OMX_ErrorNone, Exynos_OMX_ComponentLoad(&component));
+        ASSERT_NE(nullptr, component.pOMXComponent);
+        ASSERT_EQ(OMX_ErrorNone, Exynos_OMX_ComponentUnload(&component));
+    }
+    EXPECT_LE(gMapped, 2);
+
+    std::string libName = (const char *)list[0].libName;
+    Exynos_OMX_Component_Unregister(list);
+
+    void *handle = dlopen(libName.c_str(), RTLD_NOW | RTLD_NOLOAD);
+    EXPECT_EQ(nullptr, handle);
+    if (handle != NULL)
+        dlclose(handle);
+}
+
+TEST_F(ExynosOMXComponentRegisterTest, StartupTime) {
+    const int kRuns = 20;
+    std::vector<double> cold, warm;
+    int coldMapped = 0, warmMapped = 0;
+
+    for (int i = 0; i < kRuns; i++) {
+        unlink(manifestName());
+
+        auto start = std::chrono::steady_clock::now();
+        registerComponents(&coldMapped);
+        cold.push_back(std::chrono::duration<double, std::micro>(
+                           std::chrono::steady_clock::now() - start).count());
+
+        start = std::chrono::steady_clock::now();
+        registerComponents(&warmMapped);
+        warm.push_back(std::chrono::duration<double, std::micro>(
+                           std::chrono::steady_clock::now() - start).count());
+    }
+
+    std::sort(cold.begin(), cold.end());
+    std::sort(warm.begin(), warm.end());
+    printf("%d libraries, median init: cold %.1f us (%d mapped) -> warm %.1f us (%d mapped)\n",
+           kLibraryNum, cold[kRuns / 2], coldMapped, warm[kRuns / 2], warmMapped);
+
+    EXPECT_EQ(kLibraryNum, coldMapped);
+    EXPECT_EQ(0, warmMapped);
+}
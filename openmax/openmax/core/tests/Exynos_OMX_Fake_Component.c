@@ -0,0 +1,110 @@
+/*
+ *
+ * Copyright 2026 Samsung Electronics S.LSI Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * @file       Exynos_OMX_Fake_Component.c
+ * @brief      component library used by the core registration test. it is
+ *             copied as libOMX.Exynos.<name>.so and registers
+ *             OMX.Exynos.<name> and OMX.Exynos.<name>.secure
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "Exynos_OMX_Component_Register.h"
+
+static void getName(char *pName, size_t nSize)
+{
+    const char *pBase = NULL;
+    Dl_info     info;
+
+    pName[0] = '\0';
+
+    if ((dladdr((void *)getName, &info) == 0) ||
+        (info.dli_fname == NULL))
+        return;
+
+    pBase = strrchr(info.dli_fname, '/');
+    pBase = (pBase != NULL)? pBase + 1:info.dli_fname;
+
+    /* libOMX.Exynos.<name>.so */
+    if (strlen(pBase) > strlen("lib") + strlen(".so"))
+        snprintf(pName, nSize, "%.*s", (int)(strlen(pBase) - strlen("lib") - strlen(".so")), pBase + strlen("lib"));
+}
+
+int Exynos_OMX_COMPONENT_Library_Register(ExynosRegisterComponentType **exynosComponents)
+{
+    char name[MAX_OMX_COMPONENT_NAME_SIZE - sizeof(".secure")];
+
+    if (exynosComponents == NULL)
+        goto EXIT;
+
+    getName(name, sizeof(name));
+
+    snprintf((char *)exynosComponents[0]->componentName, MAX_OMX_COMPONENT_NAME_SIZE, "%s", name);
+    snprintf((char *)exynosComponents[0]->roles[0], MAX_OMX_COMPONENT_ROLE_SIZE, "video_decoder.fake");
+    exynosComponents[0]->totalRoleNum = 1;
+
+    snprintf((char *)exynosComponents[1]->componentName, MAX_OMX_COMPONENT_NAME_SIZE, "%s.secure", name);
+    snprintf((char *)exynosComponents[1]->roles[0], MAX_OMX_COMPONENT_ROLE_SIZE, "video_decoder.fake");
+    exynosComponents[1]->totalRoleNum = 1;
+
+EXIT:
+    return 2;
+}
+
+static OMX_ERRORTYPE Fake_Function(void)
+{
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE Fake_ComponentDeInit(OMX_HANDLETYPE hComponent)
+{
+    (void)hComponent;
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE Exynos_OMX_ComponentInit(OMX_HANDLETYPE hComponent, OMX_STRING componentName)
+{
+    OMX_COMPONENTTYPE *pOMXComponent = (OMX_COMPONENTTYPE *)hComponent;
+    void              *pFunction     = (void *)Fake_Function;
+
+    (void)componentName;
+
+    pOMXComponent->GetComponentVersion    = pFunction;
+    pOMXComponent->SendCommand            = pFunction;
+    pOMXComponent->GetParameter           = pFunction;
+    pOMXComponent->SetParameter           = pFunction;
+    pOMXComponent->GetConfig              = pFunction;
+    pOMXComponent->SetConfig              = pFunction;
+    pOMXComponent->GetExtensionIndex      = pFunction;
+    pOMXComponent->GetState               = pFunction;
+    pOMXComponent->ComponentTunnelRequest = pFunction;
+    pOMXComponent->UseBuffer              = pFunction;
+    pOMXComponent->AllocateBuffer         = pFunction;
+    pOMXComponent->FreeBuffer             = pFunction;
+    pOMXComponent->EmptyThisBuffer        = pFunction;
+    pOMXComponent->FillThisBuffer         = pFunction;
+    pOMXComponent->SetCallbacks           = pFunction;
+    pOMXComponent->UseEGLImage            = pFunction;
+    pOMXComponent->ComponentRoleEnum      = pFunction;
+    pOMXComponent->ComponentDeInit        = Fake_ComponentDeInit;
+
+    return OMX_ErrorNone;
+}
@@ -176,7 +176,8 @@ LOCAL_C_INCLUDES := \
 ifeq ($(BOARD_USE_ANDROID), true)
 LOCAL_SRC_FILES += \
 	Exynos_OSAL_Android.cpp \
-	Exynos_OSAL_ImageConverter.cpp
+	Exynos_OSAL_ImageConverter.cpp \
+	Exynos_OSAL_MetaDataCache.c
 
 LOCAL_STATIC_LIBRARIES += libVendorVideoApi
 
@@ -223,3 +224,23 @@ endif
 LOCAL_CFLAGS += -Wno-unused-variable -Wno-unused-label
 
 include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libExynosOMX_OSAL_metadatacache_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	Exynos_OSAL_MetaDataCache.c \
+	Exynos_OSAL_Mutex.c \
+	tests/Exynos_OSAL_MetaDataCache_Test.cpp
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH) \
+	$(EXYNOS_OMX_INC)/exynos \
+	$(EXYNOS_OMX_INC)/khronos \
+	$(EXYNOS_OMX_TOP)/core \
+	$(EXYNOS_OMX_TOP)/component/common \
+	$(EXYNOS_VIDEO_CODEC)/include
+LOCAL_CFLAGS := -DUSE_KHRONOS_OMX_HEADER \
+	-Wno-unused-variable -Wno-unused-label -Wno-unused-function
+
+include $(BUILD_HOST_NATIVE_TEST)
@@ -28,6 +28,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/dma-buf.h>
 
 #include <cutils/properties.h>
 #include <media/hardware/OMXPluginBase.h>
@@ -1247,6 +1250,218 @@ EXIT:
     return ret;
 }
 
+OMX_ERRORTYPE Exynos_OSAL_GetGraphicBuffer(
+    OMX_IN OMX_PTR                  pBuffer,
+    OMX_IN EXYNOS_METADATA_TYPE     eMetaType,
+    OMX_OUT OMX_PTR                *pHandle,
+    OMX_OUT OMX_U64                *pBufferId)
+{
+    OMX_ERRORTYPE   ret     = OMX_ErrorNone;
+    OMX_PTR         handle  = NULL;
+
+    FunctionIn();
+
+    if ((pBuffer == NULL) ||
+        (pHandle == NULL) ||
+        (pBufferId == NULL)) {
+        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] invalid parameter", __FUNCTION__);
+        ret = OMX_ErrorBadParameter;
+        goto EXIT;
+    }
+
+    if (eMetaType == METADATA_TYPE_GRAPHIC) {
+        VideoGrallocMetadata *pMetaData = (VideoGrallocMetadata *)pBuffer;
+
+        if ((pMetaData->eType != kMetadataBufferTypeGrallocSource) ||
+            (pMetaData->pHandle == NULL)) {
+            Exynos_OSAL_Log(EXYNOS_LOG_WARNING, "[%s] GrallocSource: invalid type(0x%x) or handle(%p)",
+                                                __FUNCTION__, pMetaData->eType, pMetaData->pHandle);
+            ret = OMX_ErrorBadParameter;
+            goto EXIT;
+        }
+
+        handle = (OMX_PTR)pMetaData->pHandle;
+    } else {
+        handle = pBuffer;
+    }
+
+    *pHandle    = handle;
+    *pBufferId  = ExynosGraphicBufferMeta::get_buffer_id((buffer_handle_t)handle);
+
+EXIT:
+    FunctionOut();
+
+    return ret;
+}
+
+OMX_ERRORTYPE Exynos_OSAL_DescribeGraphicBuffer(
+    OMX_IN OMX_PTR                          handle,
+    OMX_OUT OMX_U32                        *pStride,
+    OMX_OUT EXYNOS_OMX_MULTIPLANE_BUFFER   *pBufferInfo)
+{
+    OMX_ERRORTYPE   ret             = OMX_ErrorNone;
+    buffer_handle_t bufferHandle    = (buffer_handle_t)handle;
+
+    FunctionIn();
+
+    if ((handle == NULL) ||
+        (pStride == NULL) ||
+        (pBufferInfo == NULL)) {
+        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] invalid parameter", __FUNCTION__);
+        ret = OMX_ErrorBadParameter;
+        goto EXIT;
+    }
+
+    {
+        ExynosGraphicBufferMeta graphicBuffer(bufferHandle);
+
+        Exynos_OSAL_Memset(pBufferInfo, 0, sizeof(EXYNOS_OMX_MULTIPLANE_BUFFER));
+
+        pBufferInfo->fd[0] = graphicBuffer.fd;
+        pBufferInfo->fd[1] = graphicBuffer.fd1;
+        pBufferInfo->fd[2] = graphicBuffer.fd2;
+        pBufferInfo->addr[2] = graphicBuffer.get_video_metadata(bufferHandle);
+        pBufferInfo->eColorFormat = Exynos_OSAL_HAL2OMXColorFormat(graphicBuffer.format);
+
+        if ((graphicBuffer.producer_usage & OMX_GRALLOC_USAGE_PROTECTED) ||
+            (graphicBuffer.consumer_usage & OMX_GRALLOC_USAGE_PROTECTED)) {
+            /* in case of DRM, same as lockBuffer() */
+            pBufferInfo->addr[0] = INT_TO_PTR(graphicBuffer.fd);
+            pBufferInfo->addr[1] = INT_TO_PTR(graphicBuffer.fd1);
+
+            if ((pBufferInfo->addr[2] == NULL) && (graphicBuffer.fd2 > 0)) /* except for private data buffer */
+                pBufferInfo->addr[2] = INT_TO_PTR(graphicBuffer.fd2);
+        }
+
+        *pStride = (OMX_U32)graphicBuffer.stride;
+
+        Exynos_OSAL_Log(EXYNOS_LOG_TRACE, "[%s] handle(%p), FD(%u, %u, %u), format(0x%x)",
+                                            __FUNCTION__, handle, pBufferInfo->fd[0], pBufferInfo->fd[1], pBufferInfo->fd[2],
+                                            pBufferInfo->eColorFormat);
+    }
+
+EXIT:
+    FunctionOut();
+
+    return ret;
+}
+
+OMX_ERRORTYPE Exynos_OSAL_MapGraphicBuffer(
+    OMX_IN OMX_PTR                          handle,
+    OMX_IN EXYNOS_OMX_LOCK_RANGE            range,
+    OMX_OUT OMX_PTR                        *phMapping,
+    OMX_OUT OMX_U32                        *pStride,
+    OMX_OUT EXYNOS_OMX_MULTIPLANE_BUFFER   *pBufferInfo)
+{
+    OMX_ERRORTYPE   ret             = OMX_ErrorNone;
+    buffer_handle_t bufferHandle    = (buffer_handle_t)handle;
+    buffer_handle_t importedHandle  = NULL;
+
+    static GraphicBufferMapper &mapper(GraphicBufferMapper::get());
+
+    FunctionIn();
+
+    if ((handle == NULL) ||
+        (phMapping == NULL)) {
+        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] invalid parameter", __FUNCTION__);
+        ret = OMX_ErrorBadParameter;
+        goto EXIT;
+    }
+
+    {
+        /* the buffer is imported again, so that the mapping does not depend on the lifetime of handle */
+        ExynosGraphicBufferMeta graphicBuffer(bufferHandle);
+
+        auto err = mapper.importBuffer(bufferHandle, graphicBuffer.width, graphicBuffer.height, 1,
+                                       graphicBuffer.frameworkFormat,
+                                       ExynosGraphicBufferMeta::get_usage(bufferHandle),
+                                       graphicBuffer.stride, &importedHandle);
+        if (err != ::android::NO_ERROR) {
+            Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] Failed to mapper.importBuffer()", __FUNCTION__);
+            ret = OMX_ErrorUndefined;
+            goto EXIT;
+        }
+    }
+
+    ret = lockBuffer((OMX_PTR)importedHandle, range.nWidth, range.nHeight, range.eColorFormat, pStride, pBufferInfo);
+    if (ret != OMX_ErrorNone) {
+        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s]: Failed to lockBuffer (err:0x%x)", __FUNCTION__, ret);
+        mapper.freeBuffer(importedHandle);
+        goto EXIT;
+    }
+
+    pBufferInfo->eColorFormat = getBufferFormat((OMX_PTR)importedHandle);
+    *phMapping = (OMX_PTR)importedHandle;
+
+EXIT:
+    FunctionOut();
+
+    return ret;
+}
+
+OMX_ERRORTYPE Exynos_OSAL_UnmapGraphicBuffer(OMX_IN OMX_PTR hMapping)
+{
+    OMX_ERRORTYPE ret = OMX_ErrorNone;
+
+    static GraphicBufferMapper &mapper(GraphicBufferMapper::get());
+
+    FunctionIn();
+
+    ret = unlockBuffer(hMapping);
+    if (ret != OMX_ErrorNone)
+        goto EXIT;
+
+    mapper.freeBuffer((buffer_handle_t)hMapping);
+
+EXIT:
+    FunctionOut();
+
+    return ret;
+}
+
+OMX_ERRORTYPE Exynos_OSAL_SyncGraphicBuffer(
+    OMX_IN OMX_PTR  hMapping,
+    OMX_IN OMX_BOOL bStart)
+{
+    OMX_ERRORTYPE   ret             = OMX_ErrorNone;
+    buffer_handle_t bufferHandle    = (buffer_handle_t)hMapping;
+    struct dma_buf_sync sync;
+
+    FunctionIn();
+
+    if (hMapping == NULL) {
+        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] invalid parameter", __FUNCTION__);
+        ret = OMX_ErrorBadParameter;
+        goto EXIT;
+    }
+
+    /* only a buffer allocated as cacheable needs it, as in the lock of gralloc */
+    if ((ExynosGraphicBufferMeta::get_usage(bufferHandle) & (uint64_t)BufferUsage::CPU_READ_MASK) !=
+            (uint64_t)BufferUsage::CPU_READ_OFTEN)
+        goto EXIT;
+
+    sync.flags = DMA_BUF_SYNC_READ | ((bStart == OMX_TRUE)? DMA_BUF_SYNC_START:DMA_BUF_SYNC_END);
+
+    {
+        ExynosGraphicBufferMeta graphicBuffer(bufferHandle);
+        int fds[MAX_BUFFER_PLANE] = { graphicBuffer.fd, graphicBuffer.fd1, graphicBuffer.fd2 };
+        int i;
+
+        for (i = 0; i < MAX_BUFFER_PLANE; i++) {
+            if (fds[i] < 0)
+                continue;
+
+            if (ioctl(fds[i], DMA_BUF_IOCTL_SYNC, &sync) < 0)
+                Exynos_OSAL_Log(EXYNOS_LOG_WARNING, "[%s] Failed to sync fd(%d) : %d", __FUNCTION__, fds[i], errno);
+        }
+    }
+
+EXIT:
+    FunctionOut();
+
+    return ret;
+}
+
 OMX_HANDLETYPE Exynos_OSAL_RefCount_Create()
 {
     OMX_ERRORTYPE            ret    = OMX_ErrorNone;
@@ -0,0 +1,352 @@
+/*
+ *
+ * Copyright 2020 Samsung Electronics S.LSI Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * @file        Exynos_OSAL_MetaDataCache.c
+ * @brief       per port cache of the graphic buffers received as metadata
+ * @version     1.0.0
+ * @history
+ *   2020.06.15 : Create
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Exynos_OMX_Basecomponent.h"
+#include "Exynos_OMX_Def.h"
+
+#include "Exynos_OSAL_Memory.h"
+#include "Exynos_OSAL_Mutex.h"
+#include "Exynos_OSAL_Platform.h"
+
+#undef  EXYNOS_LOG_TAG
+#define EXYNOS_LOG_TAG    "Exynos_OSAL_MetaDataCache"
+//#define EXYNOS_LOG_OFF
+#include "Exynos_OSAL_Log.h"
+
+#define MAX_METADATA_CACHE_ENTRY MAX_BUFFER_REF
+
+typedef struct _EXYNOS_OMX_METADATA_CACHE_ENTRY {
+    OMX_PTR                         handle;         /* NULL : free entry */
+    OMX_U64                         nBufferId;
+    OMX_U32                         nStride;
+    EXYNOS_OMX_MULTIPLANE_BUFFER    bufferInfo;
+    OMX_PTR                         hMapping;       /* NULL : not mapped */
+    EXYNOS_OMX_LOCK_RANGE           mapRange;
+    OMX_BOOL                        bSynced;        /* between Lock(METADATA_ACCESS_CPU) and Unlock */
+    OMX_U32                         nLastUsed;
+} EXYNOS_OMX_METADATA_CACHE_ENTRY;
+
+typedef struct _EXYNOS_OMX_METADATA_CACHE {
+    OMX_HANDLETYPE                  hMutex;
+    OMX_U32                         nUseCount;
+    EXYNOS_OMX_METADATA_CACHE_ENTRY entry[MAX_METADATA_CACHE_ENTRY];
+} EXYNOS_OMX_METADATA_CACHE;
+
+static OMX_BOOL isCacheable(EXYNOS_METADATA_TYPE eMetaType)
+{
+    return ((eMetaType == METADATA_TYPE_GRAPHIC) ||
+            (eMetaType == METADATA_TYPE_GRAPHIC_HANDLE))? OMX_TRUE:OMX_FALSE;
+}
+
+static void releaseEntry(EXYNOS_OMX_METADATA_CACHE_ENTRY *pEntry)
+{
+    if (pEntry->hMapping != NULL) {
+        if (pEntry->bSynced == OMX_TRUE)
+            Exynos_OSAL_SyncGraphicBuffer(pEntry->hMapping, OMX_FALSE);
+
+        Exynos_OSAL_UnmapGraphicBuffer(pEntry->hMapping);
+    }
+
+    Exynos_OSAL_Memset(pEntry, 0, sizeof(EXYNOS_OMX_METADATA_CACHE_ENTRY));
+}
+
+static EXYNOS_OMX_METADATA_CACHE_ENTRY *findEntry(
+    EXYNOS_OMX_METADATA_CACHE   *pCache,
+    OMX_PTR                      handle)
+{
+    int i;
+
+    for (i = 0; i < MAX_METADATA_CACHE_ENTRY; i++) {
+        if (pCache->entry[i].handle == handle)
+            return &pCache->entry[i];
+    }
+
+    return NULL;
+}
+
+/* a free entry, or the least recently used one that is not accessed by the CPU now */
+static EXYNOS_OMX_METADATA_CACHE_ENTRY *getFreeEntry(EXYNOS_OMX_METADATA_CACHE *pCache)
+{
+    EXYNOS_OMX_METADATA_CACHE_ENTRY *pVictim = NULL;
+    int i;
+
+    for (i = 0; i < MAX_METADATA_CACHE_ENTRY; i++) {
+        EXYNOS_OMX_METADATA_CACHE_ENTRY *pEntry = &pCache->entry[i];
+
+        if (pEntry->handle == NULL)
+            return pEntry;
+
+        if ((pEntry->bSynced == OMX_FALSE) &&
+            ((pVictim == NULL) ||
+             ((OMX_S32)(pEntry->nLastUsed - pVictim->nLastUsed) < 0)))
+            pVictim = pEntry;
+    }
+
+    if (pVictim != NULL)
+        releaseEntry(pVictim);
+
+    return pVictim;
+}
+
+OMX_HANDLETYPE Exynos_OSAL_MetaDataCache_Create()
+{
+    EXYNOS_OMX_METADATA_CACHE *pCache = NULL;
+
+    FunctionIn();
+
+    pCache = (EXYNOS_OMX_METADATA_CACHE *)Exynos_OSAL_Malloc(sizeof(EXYNOS_OMX_METADATA_CACHE));
+    if (pCache == NULL) {
+        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] Failed to Malloc", __FUNCTION__);
+        goto EXIT;
+    }
+
+    Exynos_OSAL_Memset(pCache, 0, sizeof(EXYNOS_OMX_METADATA_CACHE));
+
+    if (Exynos_OSAL_MutexCreate(&pCache->hMutex) != OMX_ErrorNone) {
+        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] Failed to MutexCreate", __FUNCTION__);
+        Exynos_OSAL_Free(pCache);
+        pCache = NULL;
+        goto EXIT;
+    }
+
+EXIT:
+    FunctionOut();
+
+    return (OMX_HANDLETYPE)pCache;
+}
+
+OMX_ERRORTYPE Exynos_OSAL_MetaDataCache_Reset(OMX_HANDLETYPE hCache)
+{
+    OMX_ERRORTYPE              ret      = OMX_ErrorNone;
+    EXYNOS_OMX_METADATA_CACHE *pCache   = (EXYNOS_OMX_METADATA_CACHE *)hCache;
+    int i;
+
+    FunctionIn();
+
+    if (pCache == NULL) {
+        ret = OMX_ErrorBadParameter;
+        goto EXIT;
+    }
+
+    Exynos_OSAL_MutexLock(pCache->hMutex);
+
+    for (i = 0; i < MAX_METADATA_CACHE_ENTRY; i++) {
+        if (pCache->entry[i].handle != NULL)
+            releaseEntry(&pCache->entry[i]);
+    }
+
+    Exynos_OSAL_MutexUnlock(pCache->hMutex);
+
+EXIT:
+    FunctionOut();
+
+    return ret;
+}
+
+OMX_ERRORTYPE Exynos_OSAL_MetaDataCache_Terminate(OMX_HANDLETYPE hCache)
+{
+    OMX_ERRORTYPE              ret      = OMX_ErrorNone;
+    EXYNOS_OMX_METADATA_CACHE *pCache   = (EXYNOS_OMX_METADATA_CACHE *)hCache;
+
+    FunctionIn();
+
+    if (pCache == NULL) {
+        ret = OMX_ErrorBadParameter;
+        goto EXIT;
+    }
+
+    Exynos_OSAL_MetaDataCache_Reset(hCache);
+
+    Exynos_OSAL_MutexTerminate(pCache->hMutex);
+    Exynos_OSAL_Free(pCache);
+
+EXIT:
+    FunctionOut();
+
+    return ret;
+}
+
+OMX_ERRORTYPE Exynos_OSAL_MetaDataCache_Lock(
+    OMX_IN OMX_HANDLETYPE                   hCache,
+    OMX_IN OMX_PTR                          pBuffer,
+    OMX_IN EXYNOS_OMX_LOCK_RANGE            range,
+    OMX_OUT OMX_U32                        *pStride,
+    OMX_OUT EXYNOS_OMX_MULTIPLANE_BUFFER   *pBufferInfo,
+    OMX_IN EXYNOS_METADATA_TYPE             eMetaType,
+    OMX_IN EXYNOS_METADATA_ACCESS           eAccess)
+{
+    OMX_ERRORTYPE                    ret        = OMX_ErrorNone;
+    EXYNOS_OMX_METADATA_CACHE       *pCache     = (EXYNOS_OMX_METADATA_CACHE *)hCache;
+    EXYNOS_OMX_METADATA_CACHE_ENTRY *pEntry     = NULL;
+    OMX_PTR                          handle     = NULL;
+    OMX_U64                          nBufferId  = 0;
+
+    FunctionIn();
+
+    if ((pCache == NULL) ||
+        (isCacheable(eMetaType) == OMX_FALSE)) {
+        ret = Exynos_OSAL_LockMetaData(pBuffer, range, pStride, pBufferInfo, eMetaType);
+        goto EXIT;
+    }
+
+    if ((pStride == NULL) ||
+        (pBufferInfo == NULL)) {
+        Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] invalid parameter", __FUNCTION__);
+        ret = OMX_ErrorBadParameter;
+        goto EXIT;
+    }
+
+    ret = Exynos_OSAL_GetGraphicBuffer(pBuffer, eMetaType, &handle, &nBufferId);
+    if (ret != OMX_ErrorNone)
+        goto EXIT;
+
+    Exynos_OSAL_MutexLock(pCache->hMutex);
+
+    pEntry = findEntry(pCache, handle);
+    if ((pEntry != NULL) &&
+        (pEntry->nBufferId != nBufferId)) {
+        /* the handle was reused by another buffer */
+        Exynos_OSAL_Log(EXYNOS_LOG_TRACE, "[%s] handle(%p) : buffer id is changed", __FUNCTION__, handle);
+        releaseEntry(pEntry);
+        pEntry = NULL;
+    }
+
+    if (pEntry == NULL) {
+        pEntry = getFreeEntry(pCache);
+        if (pEntry == NULL) {
+            Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] no entry is available", __FUNCTION__);
+            ret = OMX_ErrorInsufficientResources;
+            goto EXIT_LOCK;
+        }
+
+        ret = Exynos_OSAL_DescribeGraphicBuffer(handle, &pEntry->nStride, &pEntry->bufferInfo);
+        if (ret != OMX_ErrorNone) {
+            Exynos_OSAL_Memset(pEntry, 0, sizeof(EXYNOS_OMX_METADATA_CACHE_ENTRY));
+            goto EXIT_LOCK;
+        }
+
+        pEntry->handle      = handle;
+        pEntry->nBufferId   = nBufferId;
+    }
+
+    if ((pEntry->hMapping != NULL) &&
+        ((pEntry->mapRange.nWidth != range.nWidth) ||
+         (pEntry->mapRange.nHeight != range.nHeight) ||
+         (pEntry->mapRange.eColorFormat != range.eColorFormat)) &&
+        (eAccess != METADATA_ACCESS_DEVICE)) {
+        if (pEntry->bSynced == OMX_TRUE) {
+            Exynos_OSAL_SyncGraphicBuffer(pEntry->hMapping, OMX_FALSE);
+            pEntry->bSynced = OMX_FALSE;
+        }
+
+        Exynos_OSAL_UnmapGraphicBuffer(pEntry->hMapping);
+        pEntry->hMapping = NULL;
+        pEntry->bufferInfo.addr[0] = NULL;
+        pEntry->bufferInfo.addr[1] = NULL;
+    }
+
+    /* a secure buffer is addressed by its fds, there is nothing to map */
+    if ((eAccess != METADATA_ACCESS_DEVICE) &&
+        (pEntry->bufferInfo.addr[0] == NULL)) {
+        EXYNOS_OMX_MULTIPLANE_BUFFER mapInfo;
+        OMX_U32                      nStride = 0;
+
+        ret = Exynos_OSAL_MapGraphicBuffer(handle, range, &pEntry->hMapping, &nStride, &mapInfo);
+        if (ret != OMX_ErrorNone) {
+            Exynos_OSAL_Log(EXYNOS_LOG_ERROR, "[%s] Failed to map handle(%p)", __FUNCTION__, handle);
+            pEntry->hMapping = NULL;
+            goto EXIT_LOCK;
+        }
+
+        pEntry->mapRange            = range;
+        pEntry->bufferInfo.addr[0]  = mapInfo.addr[0];
+        pEntry->bufferInfo.addr[1]  = mapInfo.addr[1];
+    }
+
+    if ((eAccess == METADATA_ACCESS_CPU) &&
+        (pEntry->hMapping != NULL) &&
+        (pEntry->bSynced == OMX_FALSE)) {
+        Exynos_OSAL_SyncGraphicBuffer(pEntry->hMapping, OMX_TRUE);
+        pEntry->bSynced = OMX_TRUE;
+    }
+
+    pEntry->nLastUsed = ++pCache->nUseCount;
+
+    *pStride = pEntry->nStride;
+    Exynos_OSAL_Memcpy(pBufferInfo, &pEntry->bufferInfo, sizeof(EXYNOS_OMX_MULTIPLANE_BUFFER));
+
+EXIT_LOCK:
+    Exynos_OSAL_MutexUnlock(pCache->hMutex);
+
+EXIT:
+    FunctionOut();
+
+    return ret;
+}
+
+OMX_ERRORTYPE Exynos_OSAL_MetaDataCache_Unlock(
+    OMX_IN OMX_HANDLETYPE           hCache,
+    OMX_IN OMX_PTR                  pBuffer,
+    OMX_IN EXYNOS_METADATA_TYPE     eMetaType)
+{
+    OMX_ERRORTYPE                    ret        = OMX_ErrorNone;
+    EXYNOS_OMX_METADATA_CACHE       *pCache     = (EXYNOS_OMX_METADATA_CACHE *)hCache;
+    EXYNOS_OMX_METADATA_CACHE_ENTRY *pEntry     = NULL;
+    OMX_PTR                          handle     = NULL;
+    OMX_U64                          nBufferId  = 0;
+
+    FunctionIn();
+
+    if ((pCache == NULL) ||
+        (isCacheable(eMetaType) == OMX_FALSE)) {
+        ret = Exynos_OSAL_UnlockMetaData(pBuffer, eMetaType);
+        goto EXIT;
+    }
+
+    ret = Exynos_OSAL_GetGraphicBuffer(pBuffer, eMetaType, &handle, &nBufferId);
+    if (ret != OMX_ErrorNone)
+        goto EXIT;
+
+    Exynos_OSAL_MutexLock(pCache->hMutex);
+
+    /* the mapping stays until the cache is reset */
+    pEntry = findEntry(pCache, handle);
+    if ((pEntry != NULL) &&
+        (pEntry->bSynced == OMX_TRUE)) {
+        Exynos_OSAL_SyncGraphicBuffer(pEntry->hMapping, OMX_FALSE);
+        pEntry->bSynced = OMX_FALSE;
+    }
+
+    Exynos_OSAL_MutexUnlock(pCache->hMutex);
+
+EXIT:
+    FunctionOut();
+
+    return ret;
+}
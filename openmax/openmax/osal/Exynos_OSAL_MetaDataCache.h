@@ -0,0 +1,93 @@
+/*
+ *
+ * Copyright 2020 Samsung Electronics S.LSI Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * @file        Exynos_OSAL_MetaDataCache.h
+ * @brief       per port cache of the graphic buffers received as metadata
+ * @version     1.0.0
+ * @history
+ *   2020.06.15 : Create
+ */
+
+#ifndef Exynos_OSAL_METADATACACHE
+#define Exynos_OSAL_METADATACACHE
+
+#include "OMX_Types.h"
+#include "OMX_Core.h"
+#include "Exynos_OMX_Def.h"
+#include "Exynos_OMX_Baseport.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum _EXYNOS_METADATA_ACCESS {
+    METADATA_ACCESS_DEVICE  = 0,    /* only the fds are used : the buffer is not mapped */
+    METADATA_ACCESS_ADDRESS,        /* a VA is needed, but the CPU does not touch the pixels */
+    METADATA_ACCESS_CPU,            /* the CPU reads the pixels */
+} EXYNOS_METADATA_ACCESS;
+
+/*
+ * The same few graphic buffers are queued again and again in metadata mode.
+ * The cache keeps what was resolved for a buffer (format, stride, fds) and,
+ * once an address was needed, its mapping as well, so a frame only costs
+ * a lookup. Entries are keyed by the buffer handle and its gralloc buffer id.
+ * The mappings are released by Exynos_OSAL_MetaDataCache_Reset() that has
+ * to be called on port flush and on buffer free.
+ * A mapping is only made for METADATA_ACCESS_ADDRESS and METADATA_ACCESS_CPU,
+ * and only the latter pays for the CPU cache maintenance on every frame.
+ * Metadata types other than METADATA_TYPE_GRAPHIC(_HANDLE) and a NULL cache
+ * are passed to Exynos_OSAL_LockMetaData()/Exynos_OSAL_UnlockMetaData().
+ */
+OMX_HANDLETYPE Exynos_OSAL_MetaDataCache_Create();
+OMX_ERRORTYPE Exynos_OSAL_MetaDataCache_Reset(OMX_HANDLETYPE hCache);
+OMX_ERRORTYPE Exynos_OSAL_MetaDataCache_Terminate(OMX_HANDLETYPE hCache);
+OMX_ERRORTYPE Exynos_OSAL_MetaDataCache_Lock(OMX_IN OMX_HANDLETYPE hCache,
+                                             OMX_IN OMX_PTR pBuffer,
+                                             OMX_IN EXYNOS_OMX_LOCK_RANGE range,
+                                             OMX_OUT OMX_U32 *pStride,
+                                             OMX_OUT EXYNOS_OMX_MULTIPLANE_BUFFER *pBufferInfo,
+                                             OMX_IN EXYNOS_METADATA_TYPE eMetaType,
+                                             OMX_IN EXYNOS_METADATA_ACCESS eAccess);
+OMX_ERRORTYPE Exynos_OSAL_MetaDataCache_Unlock(OMX_IN OMX_HANDLETYPE hCache,
+                                               OMX_IN OMX_PTR pBuffer,
+                                               OMX_IN EXYNOS_METADATA_TYPE eMetaType);
+
+/* graphic buffer access, implemented by the platform (Exynos_OSAL_Android.cpp) */
+OMX_ERRORTYPE Exynos_OSAL_GetGraphicBuffer(OMX_IN OMX_PTR pBuffer,
+                                           OMX_IN EXYNOS_METADATA_TYPE eMetaType,
+                                           OMX_OUT OMX_PTR *pHandle,
+                                           OMX_OUT OMX_U64 *pBufferId);
+/* fds, format, stride and video metadata, without mapping the buffer */
+OMX_ERRORTYPE Exynos_OSAL_DescribeGraphicBuffer(OMX_IN OMX_PTR handle,
+                                                OMX_OUT OMX_U32 *pStride,
+                                                OMX_OUT EXYNOS_OMX_MULTIPLANE_BUFFER *pBufferInfo);
+/* maps the buffer through its own reference, that stays valid after the handle is gone */
+OMX_ERRORTYPE Exynos_OSAL_MapGraphicBuffer(OMX_IN OMX_PTR handle,
+                                           OMX_IN EXYNOS_OMX_LOCK_RANGE range,
+                                           OMX_OUT OMX_PTR *phMapping,
+                                           OMX_OUT OMX_U32 *pStride,
+                                           OMX_OUT EXYNOS_OMX_MULTIPLANE_BUFFER *pBufferInfo);
+OMX_ERRORTYPE Exynos_OSAL_UnmapGraphicBuffer(OMX_IN OMX_PTR hMapping);
+/* CPU cache maintenance around a CPU access through the mapping */
+OMX_ERRORTYPE Exynos_OSAL_SyncGraphicBuffer(OMX_IN OMX_PTR hMapping, OMX_IN OMX_BOOL bStart);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
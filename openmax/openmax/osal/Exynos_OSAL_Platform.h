@@ -33,6 +33,7 @@
 
 #include "Exynos_OSAL_Android.h"
 #include "Exynos_OSAL_ImageConverter.h"
+#include "Exynos_OSAL_MetaDataCache.h"
 
 #ifdef __cplusplus
 extern "C" {
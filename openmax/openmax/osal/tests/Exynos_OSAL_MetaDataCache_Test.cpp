@@ -0,0 +1,367 @@
+/*
+ *
+ * Copyright 2020 Samsung Electronics S.LSI Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the metadata cache of the encoder input port against a stub mapper.
+ * The graphic buffer functions of Exynos_OSAL_Android.cpp are replaced here
+ * and count the gralloc calls they would make: a lock for a map (import and
+ * lock) and an unlock for an unmap. Exynos_OSAL_LockMetaData() and
+ * Exynos_OSAL_UnlockMetaData() stand for the uncached path, a lock and an
+ * unlock per frame.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "Exynos_OMX_Basecomponent.h"
+#include "Exynos_OMX_Def.h"
+#include "Exynos_OSAL_Log.h"
+#include "Exynos_OSAL_Memory.h"
+#include "Exynos_OSAL_Platform.h"
+
+namespace {
+
+const OMX_U32 kGrallocSource = 1;   /* kMetadataBufferTypeGrallocSource */
+const int kFps = 60;
+const int kSeconds = 10;
+const int kBufferNum = 4;           /* slots of the input surface */
+
+struct FakeBuffer {
+    OMX_U64 id;
+    int fd;
+    OMX_U32 stride;
+    OMX_COLOR_FORMATTYPE format;
+    bool secure;
+    char pixels[64];
+};
+
+/* VideoGrallocMetadata */
+struct FakeMetaData {
+    OMX_U32 type;
+    FakeBuffer *handle;
+};
+
+struct FakeMapping {
+    FakeBuffer *buffer;
+};
+
+struct Counters {
+    int lock;
+    int unlock;
+    int describe;
+    int syncStart;
+    int syncEnd;
+    int mapped;     /* mappings alive */
+};
+
+Counters gCount;
+
+OMX_ERRORTYPE fillInfo(FakeBuffer *buffer, OMX_U32 *pStride, EXYNOS_OMX_MULTIPLANE_BUFFER *pBufferInfo, bool map)
+{
+    memset(pBufferInfo, 0, sizeof(*pBufferInfo));
+    pBufferInfo->fd[0] = buffer->fd;
+    pBufferInfo->eColorFormat = buffer->format;
+    if (buffer->secure) {
+        pBufferInfo->addr[0] = (OMX_PTR)(intptr_t)buffer->fd;
+    } else if (map) {
+        pBufferInfo->addr[0] = buffer->pixels;
+        pBufferInfo->addr[1] = buffer->pixels + 32;
+    }
+    *pStride = buffer->stride;
+
+    return OMX_ErrorNone;
+}
+
+FakeBuffer *getHandle(OMX_PTR pBuffer, EXYNOS_METADATA_TYPE eMetaType)
+{
+    if (eMetaType == METADATA_TYPE_GRAPHIC) {
+        FakeMetaData *meta = (FakeMetaData *)pBuffer;
+        return (meta->type == kGrallocSource)? meta->handle:NULL;
+    }
+
+    return (FakeBuffer *)pBuffer;
+}
+
+} // namespace
+
+extern "C" {
+
+OMX_PTR Exynos_OSAL_Malloc(OMX_U32 size) { return malloc(size); }
+void Exynos_OSAL_Free(OMX_PTR addr) { free(addr); }
+OMX_PTR Exynos_OSAL_Memset(OMX_PTR dest, OMX_S32 c, OMX_S32 n) { return memset(dest, c, n); }
+OMX_PTR Exynos_OSAL_Memcpy(OMX_PTR dest, OMX_PTR src, OMX_S32 n) { return memcpy(dest, src, n); }
+
+void _Exynos_OSAL_Log(EXYNOS_LOG_LEVEL logLevel, const char *tag, const char *msg, ...)
+{
+    (void)logLevel;
+    (void)tag;
+    (void)msg;
+}
+
+OMX_ERRORTYPE Exynos_OSAL_LockMetaData(OMX_PTR pBuffer, EXYNOS_OMX_LOCK_RANGE range, OMX_U32 *pStride,
+                                       EXYNOS_OMX_MULTIPLANE_BUFFER *pBufferInfo, EXYNOS_METADATA_TYPE eMetaType)
+{
+    FakeBuffer *buffer = getHandle(pBuffer, eMetaType);
+
+    (void)range;
+    if (buffer == NULL)
+        return OMX_ErrorBadParameter;
+
+    gCount.lock++;
+    return fillInfo(buffer, pStride, pBufferInfo, true);
+}
+
+OMX_ERRORTYPE Exynos_OSAL_UnlockMetaData(OMX_PTR pBuffer, EXYNOS_METADATA_TYPE eMetaType)
+{
+    if (getHandle(pBuffer, eMetaType) == NULL)
+        return OMX_ErrorBadParameter;
+
+    gCount.unlock++;
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE Exynos_OSAL_GetGraphicBuffer(OMX_PTR pBuffer, EXYNOS_METADATA_TYPE eMetaType,
+                                           OMX_PTR *pHandle, OMX_U64 *pBufferId)
+{
+    FakeBuffer *buffer = getHandle(pBuffer, eMetaType);
+
+    if (buffer == NULL)
+        return OMX_ErrorBadParameter;
+
+    *pHandle = buffer;
+    *pBufferId = buffer->id;
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE Exynos_OSAL_DescribeGraphicBuffer(OMX_PTR handle, OMX_U32 *pStride,
+                                                EXYNOS_OMX_MULTIPLANE_BUFFER *pBufferInfo)
+{
+    gCount.describe++;
+    return fillInfo((FakeBuffer *)handle, pStride, pBufferInfo, false);
+}
+
+OMX_ERRORTYPE Exynos_OSAL_MapGraphicBuffer(OMX_PTR handle, EXYNOS_OMX_LOCK_RANGE range, OMX_PTR *phMapping,
+                                           OMX_U32 *pStride, EXYNOS_OMX_MULTIPLANE_BUFFER *pBufferInfo)
+{
+    FakeMapping *mapping = new FakeMapping { (FakeBuffer *)handle };
+
+    (void)range;
+    gCount.lock++;
+    gCount.mapped++;
+    *phMapping = mapping;
+    return fillInfo(mapping->buffer, pStride, pBufferInfo, true);
+}
+
+OMX_ERRORTYPE Exynos_OSAL_UnmapGraphicBuffer(OMX_PTR hMapping)
+{
+    gCount.unlock++;
+    gCount.mapped--;
+    delete (FakeMapping *)hMapping;
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE Exynos_OSAL_SyncGraphicBuffer(OMX_PTR hMapping, OMX_BOOL bStart)
+{
+    (void)hMapping;
+    if (bStart == OMX_TRUE)
+        gCount.syncStart++;
+    else
+        gCount.syncEnd++;
+    return OMX_ErrorNone;
+}
+
+} // extern "C"
+
+namespace {
+
+class ExynosOSALMetaDataCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        memset(&gCount, 0, sizeof(gCount));
+
+        for (int i = 0; i < kBufferNum; i++) {
+            mBuffers[i] = FakeBuffer { (OMX_U64)(100 + i), 10 + i, 1920,
+                                       (OMX_COLOR_FORMATTYPE)OMX_COLOR_Format32BitRGBA8888, false, {} };
+            mMeta[i] = FakeMetaData { kGrallocSource, &mBuffers[i] };
+        }
+
+        mRange.nWidth = 1920;
+        mRange.nHeight = 1080;
+        mRange.eColorFormat = (OMX_COLOR_FORMATTYPE)OMX_COLOR_FormatAndroidOpaque;
+
+        mCache = Exynos_OSAL_MetaDataCache_Create();
+        ASSERT_NE(nullptr, mCache);
+    }
+
+    void TearDown() override {
+        if (mCache != NULL)
+            Exynos_OSAL_MetaDataCache_Terminate(mCache);
+        EXPECT_EQ(0, gCount.mapped);
+    }
+
+    /* the input of the SW CSC path of the encoder, for kSeconds at kFps */
+    void encode(OMX_HANDLETYPE hCache, EXYNOS_METADATA_ACCESS eAccess) {
+        for (int frame = 0; frame < kFps * kSeconds; frame++) {
+            int slot = frame % kBufferNum;
+            EXYNOS_OMX_MULTIPLANE_BUFFER info;
+            OMX_U32 stride = 0;
+
+            ASSERT_EQ(OMX_ErrorNone, Exynos_OSAL_MetaDataCache_Lock(hCache, &mMeta[slot], mRange, &stride, &info,
+                                                                   METADATA_TYPE_GRAPHIC, eAccess));
+            EXPECT_EQ(mBuffers[slot].stride, stride);
+            EXPECT_EQ((unsigned long)mBuffers[slot].fd, info.fd[0]);
+            EXPECT_EQ(mBuffers[slot].format, info.eColorFormat);
+            if (eAccess == METADATA_ACCESS_DEVICE) {
+                EXPECT_EQ(nullptr, info.addr[0]);
+            } else {
+                EXPECT_EQ(mBuffers[slot].pixels, info.addr[0]);
+            }
+
+            ASSERT_EQ(OMX_ErrorNone, Exynos_OSAL_MetaDataCache_Unlock(hCache, &mMeta[slot], METADATA_TYPE_GRAPHIC));
+        }
+    }
+
+    FakeBuffer mBuffers[kBufferNum];
+    FakeMetaData mMeta[kBufferNum];
+    EXYNOS_OMX_LOCK_RANGE mRange;
+    OMX_HANDLETYPE mCache = NULL;
+};
+
+TEST_F(ExynosOSALMetaDataCacheTest, SurfaceEncoding) {
+    const int frames = kFps * kSeconds;
+
+    encode(NULL, METADATA_ACCESS_CPU);
+    Counters uncached = gCount;
+
+    memset(&gCount, 0, sizeof(gCount));
+    encode(mCache, METADATA_ACCESS_CPU);
+    Counters cached = gCount;
+
+    printf("%d frames at %d fps from %d buffers, lock/unlock: %d/%d -> %d/%d, cache maintenance: %d/%d\n",
+           frames, kFps, kBufferNum, uncached.lock, uncached.unlock, cached.lock, cached.unlock,
+           cached.syncStart, cached.syncEnd);
+
+    EXPECT_EQ(frames, uncached.lock);
+    EXPECT_EQ(frames, uncached.unlock);
+
+    EXPECT_EQ(kBufferNum, cached.lock);
+    EXPECT_EQ(0, cached.unlock);
+    EXPECT_EQ(kBufferNum, cached.describe);
+    EXPECT_EQ(frames, cached.syncStart);
+    EXPECT_EQ(frames, cached.syncEnd);
+    EXPECT_EQ(kBufferNum, cached.mapped);
+}
+
+TEST_F(ExynosOSALMetaDataCacheTest, DeviceAccessIsNotMapped) {
+    encode(mCache, METADATA_ACCESS_DEVICE);
+
+    EXPECT_EQ(0, gCount.lock);
+    EXPECT_EQ(0, gCount.unlock);
+    EXPECT_EQ(0, gCount.syncStart);
+    EXPECT_EQ(kBufferNum, gCount.describe);
+}
+
+TEST_F(ExynosOSALMetaDataCacheTest, AddressAccessIsMappedOnce) {
+    encode(mCache, METADATA_ACCESS_ADDRESS);
+
+    EXPECT_EQ(kBufferNum, gCount.lock);
+    EXPECT_EQ(0, gCount.unlock);
+    EXPECT_EQ(0, gCount.syncStart);
+    EXPECT_EQ(0, gCount.syncEnd);
+}
+
+TEST_F(ExynosOSALMetaDataCacheTest, ResetReleasesTheMappings) {
+    encode(mCache, METADATA_ACCESS_CPU);
+    ASSERT_EQ(kBufferNum, gCount.mapped);
+
+    /* port flush */
+    EXPECT_EQ(OMX_ErrorNone, Exynos_OSAL_MetaDataCache_Reset(mCache));
+    EXPECT_EQ(0, gCount.mapped);
+    EXPECT_EQ(kBufferNum, gCount.unlock);
+
+    encode(mCache, METADATA_ACCESS_CPU);
+    EXPECT_EQ(kBufferNum * 2, gCount.lock);
+    EXPECT_EQ(kBufferNum * 2, gCount.describe);
+}
+
+TEST_F(ExynosOSALMetaDataCacheTest, ReusedHandleIsResolvedAgain) {
+    EXYNOS_OMX_MULTIPLANE_BUFFER info;
+    OMX_U32 stride = 0;
+
+    encode(mCache, METADATA_ACCESS_CPU);
+
+    /* the same handle now stands for another buffer */
+    mBuffers[0].id = 200;
+    mBuffers[0].fd = 30;
+    mBuffers[0].stride = 2048;
+    mBuffers[0].format = OMX_COLOR_FormatYUV420SemiPlanar;
+
+    ASSERT_EQ(OMX_ErrorNone, Exynos_OSAL_MetaDataCache_Lock(mCache, &mMeta[0], mRange, &stride, &info,
+                                                           METADATA_TYPE_GRAPHIC, METADATA_ACCESS_CPU));
+    EXPECT_EQ(2048u, stride);
+    EXPECT_EQ(30u, info.fd[0]);
+    EXPECT_EQ(OMX_COLOR_FormatYUV420SemiPlanar, info.eColorFormat);
+    EXPECT_EQ(kBufferNum + 1, gCount.lock);
+    EXPECT_EQ(1, gCount.unlock);
+    EXPECT_EQ(kBufferNum, gCount.mapped);
+    ASSERT_EQ(OMX_ErrorNone, Exynos_OSAL_MetaDataCache_Unlock(mCache, &mMeta[0], METADATA_TYPE_GRAPHIC));
+}
+
+TEST_F(ExynosOSALMetaDataCacheTest, SecureBufferIsNotMapped) {
+    EXYNOS_OMX_MULTIPLANE_BUFFER info;
+    OMX_U32 stride = 0;
+
+    mBuffers[0].secure = true;
+
+    ASSERT_EQ(OMX_ErrorNone, Exynos_OSAL_MetaDataCache_Lock(mCache, &mMeta[0], mRange, &stride, &info,
+                                                           METADATA_TYPE_GRAPHIC, METADATA_ACCESS_CPU));
+    EXPECT_EQ((OMX_PTR)(intptr_t)mBuffers[0].fd, info.addr[0]);
+    EXPECT_EQ(0, gCount.lock);
+    EXPECT_EQ(0, gCount.syncStart);
+    ASSERT_EQ(OMX_ErrorNone, Exynos_OSAL_MetaDataCache_Unlock(mCache, &mMeta[0], METADATA_TYPE_GRAPHIC));
+}
+
+TEST_F(ExynosOSALMetaDataCacheTest, InvalidMetaDataFails) {
+    EXYNOS_OMX_MULTIPLANE_BUFFER info;
+    OMX_U32 stride = 0;
+    FakeMetaData eos = { kGrallocSource, NULL };
+
+    /* EOS without a buffer */
+    EXPECT_NE(OMX_ErrorNone, Exynos_OSAL_MetaDataCache_Lock(mCache, &eos, mRange, &stride, &info,
+                                                           METADATA_TYPE_GRAPHIC, METADATA_ACCESS_CPU));
+    EXPECT_EQ(0, gCount.describe);
+}
+
+TEST_F(ExynosOSALMetaDataCacheTest, OtherTypesAreNotCached) {
+    EXYNOS_OMX_MULTIPLANE_BUFFER info;
+    OMX_U32 stride = 0;
+
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(OMX_ErrorNone, Exynos_OSAL_MetaDataCache_Lock(mCache, &mBuffers[0], mRange, &stride, &info,
+                                                               METADATA_TYPE_UBM_BUFFER, METADATA_ACCESS_CPU));
+        ASSERT_EQ(OMX_ErrorNone, Exynos_OSAL_MetaDataCache_Unlock(mCache, &mBuffers[0], METADATA_TYPE_UBM_BUFFER));
+    }
+
+    EXPECT_EQ(3, gCount.lock);
+    EXPECT_EQ(3, gCount.unlock);
+    EXPECT_EQ(0, gCount.describe);
+}
+
+} // namespace
@@ -1760,6 +1760,11 @@ int sgpu_cs_submit(amdgpu_context_handle context,
  *	 returned in the case if submission was completed or timeout error
  *	 code.
  *
+ * \note A fence at or before one already seen signaled on the same ring,
+ *	 or before the value of a CPU mapped user fence of the ring, is
+ *	 reported expired without calling the kernel. The context keeps a
+ *	 reference of such a user fence buffer until the ring uses another one.
+ *
  * \sa amdgpu_cs_submit()
 */
 int amdgpu_cs_query_fence_status(struct amdgpu_cs_fence *fence,
@@ -33,6 +33,7 @@
 #include "xf86drm.h"
 #include "sgpu_drm.h"
 #include "amdgpu_internal.h"
+#include "amdgpu_asic_id_table.h"
 
 static int parse_one_line(struct amdgpu_device *dev, const char *line)
 {
@@ -104,7 +105,7 @@ out:
 	return r;
 }
 
-void amdgpu_parse_asic_ids(struct amdgpu_device *dev)
+drm_private void amdgpu_parse_asic_ids(struct amdgpu_device *dev)
 {
 	FILE *fp;
 	char *line = NULL;
@@ -115,8 +116,10 @@ void amdgpu_parse_asic_ids(struct amdgpu_device *dev)
 
 	fp = fopen(AMDGPU_ASIC_ID_TABLE, "r");
 	if (!fp) {
-		fprintf(stderr, "%s: %s\n", AMDGPU_ASIC_ID_TABLE,
-			strerror(errno));
+		/* The file is only an override of amdgpu_asic_ids */
+		if (errno != ENOENT)
+			fprintf(stderr, "%s: %s\n", AMDGPU_ASIC_ID_TABLE,
+				strerror(errno));
 		return;
 	}
 
@@ -159,3 +162,65 @@ void amdgpu_parse_asic_ids(struct amdgpu_device *dev)
 	free(line);
 	fclose(fp);
 }
+
+/*
+ * Last entry of amdgpu_asic_ids at or before (did, rev), NULL if there is none
+ * for the same did and model.
+ */
+static const struct amdgpu_asic_id *amdgpu_find_asic_id(uint32_t did,
+							 uint32_t rev)
+{
+	const struct amdgpu_asic_id *found = NULL;
+	int low = 0, high = AMDGPU_ASIC_ID_COUNT - 1;
+
+	while (low <= high) {
+		int mid = (low + high) / 2;
+		const struct amdgpu_asic_id *id = &amdgpu_asic_ids[mid];
+
+		if (id->did < did || (id->did == did && id->rev <= rev)) {
+			found = id;
+			low = mid + 1;
+		} else {
+			high = mid - 1;
+		}
+	}
+
+	if (!found || found->did != did ||
+	    AMDGPU_ASIC_REV_MODEL(found->rev) != AMDGPU_ASIC_REV_MODEL(rev))
+		return NULL;
+
+	return found;
+}
+
+static bool amdgpu_asic_id_known(uint32_t did)
+{
+	unsigned i;
+
+	for (i = 0; i < AMDGPU_ASIC_ID_COUNT; i++) {
+		if (amdgpu_asic_ids[i].did == did)
+			return true;
+	}
+	return false;
+}
+
+drm_private void amdgpu_find_marketing_name(struct amdgpu_device *dev)
+{
+	const struct amdgpu_asic_id *id;
+	uint32_t rev;
+
+	amdgpu_parse_asic_ids(dev);
+	if (dev->marketing_name)
+		return;
+
+	/* Model ID and generation */
+	rev = AMDGPU_ASIC_REV((dev->info.chip_rev >> 16) & 0xff,
+			      (dev->info.chip_rev >> 24) & 0xff);
+	id = amdgpu_find_asic_id(dev->info.asic_id, rev);
+	if (id) {
+		if (id->name)
+			dev->marketing_name = strdup(id->name);
+	} else if (amdgpu_asic_id_known(dev->info.asic_id)) {
+		fprintf(stderr, "%s: cannot parse chip revision: chip_rev %x\n",
+			__func__, dev->info.chip_rev);
+	}
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2020 Samsung Electronics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _AMDGPU_ASIC_ID_TABLE_H_
+#define _AMDGPU_ASIC_ID_TABLE_H_
+
+#include <stdint.h>
+
+/*
+ * Marketing names of the ASICs, sorted by did then rev.
+ *
+ * rev is made of the model id and the generation of chip_rev, see
+ * AMDGPU_ASIC_REV(). An entry covers the generations of its model up to
+ * the next entry, so a later generation without a name of its own has an
+ * entry with a NULL name.
+ *
+ * The AMDGPU_ASIC_ID_TABLE file, when it exists, overrides this table.
+ */
+#define AMDGPU_ASIC_REV(model, gen)	(((uint32_t)(model) << 8) | (gen))
+#define AMDGPU_ASIC_REV_MODEL(rev)	((rev) >> 8)
+
+struct amdgpu_asic_id {
+	uint32_t did;
+	uint32_t rev;
+	const char *name;
+};
+
+static const struct amdgpu_asic_id amdgpu_asic_ids[] = {
+	{ 0x73A0, AMDGPU_ASIC_REV(0x40, 0), "Samsung Xclipse Jupiter" },	/* Jupiter */
+	{ 0x73A0, AMDGPU_ASIC_REV(0x40, 1), NULL },
+	{ 0x73A0, AMDGPU_ASIC_REV(0x60, 0), "Samsung Xclipse 920" },		/* Voyager */
+	{ 0x73A0, AMDGPU_ASIC_REV(0x60, 1), "Samsung Xclipse 930" },		/* Viking */
+};
+
+#define AMDGPU_ASIC_ID_COUNT (sizeof(amdgpu_asic_ids) / sizeof(amdgpu_asic_ids[0]))
+
+#endif
@@ -562,6 +562,27 @@ drm_public int amdgpu_bo_cpu_map(amdgpu_bo_handle bo, void **cpu)
 	return 0;
 }
 
+/**
+ * Take one more reference of the CPU mapping of a buffer, without mapping it.
+ *
+ * \param   bo - \c [in] Buffer handle
+ *
+ * \return  CPU address of the buffer, NULL if it is not mapped.
+ *          A non NULL address is released with amdgpu_bo_cpu_unmap().
+*/
+drm_private void *amdgpu_bo_cpu_map_existing(amdgpu_bo_handle bo)
+{
+	void *cpu;
+
+	pthread_mutex_lock(&bo->cpu_access_mutex);
+	cpu = bo->cpu_ptr;
+	if (cpu)
+		bo->cpu_map_count++;
+	pthread_mutex_unlock(&bo->cpu_access_mutex);
+
+	return cpu;
+}
+
 drm_public int amdgpu_bo_cpu_unmap(amdgpu_bo_handle bo)
 {
 	int r;
@@ -40,9 +40,170 @@
 #include "sgpu_drm.h"
 #include "amdgpu_internal.h"
 
+/* Fences a wait copies on the stack, more are allocated */
+#define AMDGPU_WAIT_FENCES_ON_STACK 32
+
 static int amdgpu_cs_unreference_sem(amdgpu_semaphore_handle sem);
 static int amdgpu_cs_reset_sem(amdgpu_semaphore_handle sem);
 
+/*
+ * Signaled fence cache
+ *
+ * The scheduler of a ring signals the submissions of a context in order,
+ * so one sequence number per ring tells which fences have signaled : all
+ * the ones at or before the highest seen signaled by a wait or a query.
+ * When the last submissions to a ring carry a user fence that is CPU mapped,
+ * the sequence number the GPU wrote there is used as well.
+ * Fences known signaled are reported without a syscall.
+ *
+ * A fence that signaled with an error is reported by the kernel, and the
+ * cache must not hide it : after a reset or a wait error, the cache of the
+ * context is disabled for good.
+ */
+
+/* Sequence numbers are compared by distance, to stay right across wraparound */
+static inline bool amdgpu_cs_seq_passed(uint64_t seq, uint64_t signaled)
+{
+	return (int64_t)(seq - signaled) <= 0;
+}
+
+static bool amdgpu_cs_fence_cacheable(const struct amdgpu_cs_fence *fence)
+{
+	if (fence->fence == AMDGPU_NULL_SUBMIT_SEQ)
+		return false;
+	if (fence->ip_instance >= AMDGPU_HW_IP_INSTANCE_MAX_COUNT)
+		return false;
+
+	return !atomic_read(&fence->context->fence_cache_disabled);
+}
+
+static void amdgpu_cs_disable_fence_cache(amdgpu_context_handle context)
+{
+	atomic_set(&context->fence_cache_disabled, 1);
+}
+
+static void amdgpu_cs_update_signaled_seq(uint64_t *signaled_seq, uint64_t seq)
+{
+	uint64_t old = __atomic_load_n(signaled_seq, __ATOMIC_RELAXED);
+
+	do {
+		if (old != AMDGPU_NULL_SUBMIT_SEQ && amdgpu_cs_seq_passed(seq, old))
+			return;
+	} while (!__atomic_compare_exchange_n(signaled_seq, &old, seq, true,
+					      __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void amdgpu_cs_fence_signaled(const struct amdgpu_cs_fence *fence)
+{
+	amdgpu_context_handle context = fence->context;
+
+	if (!amdgpu_cs_fence_cacheable(fence))
+		return;
+
+	amdgpu_cs_update_signaled_seq(
+		&context->signaled_seq[fence->ip_type][fence->ip_instance][fence->ring],
+		fence->fence);
+}
+
+static bool amdgpu_cs_user_fence_signaled(const struct amdgpu_cs_fence *fence)
+{
+	amdgpu_context_handle context = fence->context;
+	struct amdgpu_user_fence *uf =
+		&context->user_fence[fence->ip_type][fence->ip_instance][fence->ring];
+	bool signaled = false;
+	uint64_t value;
+
+	if (!__atomic_load_n(&uf->cpu, __ATOMIC_RELAXED))
+		return false;
+
+	pthread_mutex_lock(&context->user_fence_mutex);
+	/* Older submissions did not write this memory */
+	if (uf->cpu && !amdgpu_cs_seq_passed(fence->fence, uf->first_seq - 1)) {
+		value = __atomic_load_n(uf->cpu, __ATOMIC_ACQUIRE);
+		/* Whatever the memory held before the first submission is ignored */
+		if (!amdgpu_cs_seq_passed(value, uf->first_seq - 1) &&
+		    amdgpu_cs_seq_passed(value, uf->last_seq)) {
+			amdgpu_cs_update_signaled_seq(
+				&context->signaled_seq[fence->ip_type][fence->ip_instance][fence->ring],
+				value);
+			signaled = amdgpu_cs_seq_passed(fence->fence, value);
+		}
+	}
+	pthread_mutex_unlock(&context->user_fence_mutex);
+
+	return signaled;
+}
+
+static bool amdgpu_cs_fence_known_signaled(const struct amdgpu_cs_fence *fence)
+{
+	amdgpu_context_handle context = fence->context;
+	uint64_t signaled;
+
+	if (!amdgpu_cs_fence_cacheable(fence))
+		return false;
+
+	signaled = __atomic_load_n(
+		&context->signaled_seq[fence->ip_type][fence->ip_instance][fence->ring],
+		__ATOMIC_ACQUIRE);
+	if (signaled != AMDGPU_NULL_SUBMIT_SEQ &&
+	    amdgpu_cs_seq_passed(fence->fence, signaled))
+		return true;
+
+	return amdgpu_cs_user_fence_signaled(fence);
+}
+
+/* user_fence_mutex is held */
+static void amdgpu_cs_release_user_fence(struct amdgpu_user_fence *uf)
+{
+	if (!uf->bo)
+		return;
+
+	__atomic_store_n(&uf->cpu, NULL, __ATOMIC_RELAXED);
+	amdgpu_bo_cpu_unmap(uf->bo);
+	amdgpu_bo_free(uf->bo);
+	uf->bo = NULL;
+}
+
+/**
+ * Keep the user fence of a submission, if the application has it CPU mapped
+ *
+ * \param   context     - \c [in] GPU Context
+ * \param   ibs_request - \c [in] Submitted request, with its seq_no
+*/
+static void amdgpu_cs_set_user_fence(amdgpu_context_handle context,
+				     struct amdgpu_cs_request *ibs_request)
+{
+	struct amdgpu_user_fence *uf;
+	amdgpu_bo_handle bo = ibs_request->fence_info.handle;
+	uint64_t offset = ibs_request->fence_info.offset;
+	void *cpu;
+
+	if (ibs_request->ip_instance >= AMDGPU_HW_IP_INSTANCE_MAX_COUNT)
+		return;
+
+	uf = &context->user_fence[ibs_request->ip_type][ibs_request->ip_instance][ibs_request->ring];
+
+	pthread_mutex_lock(&context->user_fence_mutex);
+	if (bo && uf->bo == bo && uf->offset == offset) {
+		uf->last_seq = ibs_request->seq_no;
+		pthread_mutex_unlock(&context->user_fence_mutex);
+		return;
+	}
+
+	amdgpu_cs_release_user_fence(uf);
+
+	cpu = bo ? amdgpu_bo_cpu_map_existing(bo) : NULL;
+	if (cpu) {
+		amdgpu_bo_inc_ref(bo);
+		uf->bo = bo;
+		uf->offset = offset;
+		uf->first_seq = ibs_request->seq_no;
+		uf->last_seq = ibs_request->seq_no;
+		__atomic_store_n(&uf->cpu, (uint64_t *)cpu + offset, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&context->user_fence_mutex);
+}
+
 /**
  * Create command submission context
  *
@@ -73,7 +234,11 @@ drm_public int amdgpu_cs_ctx_create3(amdgpu_device_handle dev,
 
 	r = pthread_mutex_init(&gpu_context->sequence_mutex, NULL);
 	if (r)
-		goto error;
+		goto error_sequence_mutex;
+
+	r = pthread_mutex_init(&gpu_context->user_fence_mutex, NULL);
+	if (r)
+		goto error_user_fence_mutex;
 
 	/* Create the context */
 	memset(&args, 0, sizeof(args));
@@ -95,7 +260,10 @@ drm_public int amdgpu_cs_ctx_create3(amdgpu_device_handle dev,
 	return 0;
 
 error:
+	pthread_mutex_destroy(&gpu_context->user_fence_mutex);
+error_user_fence_mutex:
 	pthread_mutex_destroy(&gpu_context->sequence_mutex);
+error_sequence_mutex:
 	free(gpu_context);
 	return r;
 }
@@ -158,9 +326,11 @@ drm_public int amdgpu_cs_ctx_free(amdgpu_context_handle context)
 					amdgpu_cs_reset_sem(sem);
 					amdgpu_cs_unreference_sem(sem);
 				}
+				amdgpu_cs_release_user_fence(&context->user_fence[i][j][k]);
 			}
 		}
 	}
+	pthread_mutex_destroy(&context->user_fence_mutex);
 	free(context);
 
 	return r;
@@ -218,6 +388,8 @@ drm_public int amdgpu_cs_query_reset_state(amdgpu_context_handle context,
 	if (!r) {
 		*state = args.out.state.reset_status;
 		*hangs = args.out.state.hangs;
+		if (*state != AMDGPU_CTX_NO_RESET)
+			amdgpu_cs_disable_fence_cache(context);
 	}
 	return r;
 }
@@ -236,8 +408,12 @@ drm_public int amdgpu_cs_query_reset_state2(amdgpu_context_handle context,
 	args.in.ctx_id = context->id;
 	r = drmCommandWriteRead(context->dev->fd, DRM_AMDGPU_CTX,
 				&args, sizeof(args));
-	if (!r)
+	if (!r) {
 		*flags = args.out.state.flags;
+		if (*flags & (AMDGPU_CTX_QUERY2_FLAGS_RESET |
+			      AMDGPU_CTX_QUERY2_FLAGS_GUILTY))
+			amdgpu_cs_disable_fence_cache(context);
+	}
 	return r;
 }
 
@@ -405,6 +581,7 @@ static int amdgpu_cs_submit_one(amdgpu_context_handle context,
 
 	ibs_request->seq_no = seq_no;
 	context->last_seq[ibs_request->ip_type][ibs_request->ip_instance][ibs_request->ring] = ibs_request->seq_no;
+	amdgpu_cs_set_user_fence(context, ibs_request);
 error_unlock:
 	pthread_mutex_unlock(&context->sequence_mutex);
 	return r;
@@ -524,14 +701,23 @@ drm_public int amdgpu_cs_query_fence_status(struct amdgpu_cs_fence *fence,
 		return 0;
 	}
 
+	if (amdgpu_cs_fence_known_signaled(fence)) {
+		*expired = true;
+		return 0;
+	}
+
 	*expired = false;
 
 	r = amdgpu_ioctl_wait_cs(fence->context, fence->ip_type,
 				fence->ip_instance, fence->ring,
 			       	fence->fence, timeout_ns, flags, &busy);
 
-	if (!r && !busy)
+	if (r) {
+		amdgpu_cs_disable_fence_cache(fence->context);
+	} else if (!busy) {
 		*expired = true;
+		amdgpu_cs_fence_signaled(fence);
+	}
 
 	return r;
 }
@@ -543,13 +729,19 @@ static int amdgpu_ioctl_wait_fences(struct amdgpu_cs_fence *fences,
 				    uint32_t *status,
 				    uint32_t *first)
 {
-	struct drm_amdgpu_fence *drm_fences;
+	struct drm_amdgpu_fence drm_fences_stack[AMDGPU_WAIT_FENCES_ON_STACK];
+	struct drm_amdgpu_fence *drm_fences = drm_fences_stack;
 	amdgpu_device_handle dev = fences[0].context->dev;
 	union drm_amdgpu_wait_fences args;
 	int r;
 	uint32_t i;
 
-	drm_fences = alloca(sizeof(struct drm_amdgpu_fence) * fence_count);
+	if (fence_count > AMDGPU_WAIT_FENCES_ON_STACK) {
+		drm_fences = malloc(sizeof(struct drm_amdgpu_fence) * fence_count);
+		if (!drm_fences)
+			return -ENOMEM;
+	}
+
 	for (i = 0; i < fence_count; i++) {
 		drm_fences[i].ctx_id = fences[i].context->id;
 		drm_fences[i].ip_type = fences[i].ip_type;
@@ -566,7 +758,11 @@ static int amdgpu_ioctl_wait_fences(struct amdgpu_cs_fence *fences,
 
 	r = drmIoctl(dev->fd, DRM_IOCTL_AMDGPU_WAIT_FENCES, &args);
 	if (r)
-		return -errno;
+		r = -errno;
+	if (drm_fences != drm_fences_stack)
+		free(drm_fences);
+	if (r)
+		return r;
 
 	*status = args.out.status;
 
@@ -583,7 +779,10 @@ drm_public int amdgpu_cs_wait_fences(struct amdgpu_cs_fence *fences,
 				     uint32_t *status,
 				     uint32_t *first)
 {
-	uint32_t i;
+	struct amdgpu_cs_fence pending_stack[AMDGPU_WAIT_FENCES_ON_STACK];
+	struct amdgpu_cs_fence *pending = pending_stack;
+	uint32_t i, pending_count = 0, signaled = 0;
+	int r;
 
 	/* Sanity check */
 	if (!fences || !status || !fence_count)
@@ -600,8 +799,59 @@ drm_public int amdgpu_cs_wait_fences(struct amdgpu_cs_fence *fences,
 
 	*status = 0;
 
-	return amdgpu_ioctl_wait_fences(fences, fence_count, wait_all,
-					timeout_ns, status, first);
+	if (wait_all) {
+		/* Only the fences not known signaled are waited */
+		if (fence_count > AMDGPU_WAIT_FENCES_ON_STACK) {
+			pending = malloc(sizeof(struct amdgpu_cs_fence) * fence_count);
+			if (!pending)
+				return -ENOMEM;
+		}
+		for (i = 0; i < fence_count; i++) {
+			if (!amdgpu_cs_fence_known_signaled(&fences[i]))
+				pending[pending_count++] = fences[i];
+		}
+
+		if (pending_count == 0) {
+			*status = 1;
+			if (first)
+				*first = 0;
+			r = 0;
+		} else {
+			r = amdgpu_ioctl_wait_fences(pending, pending_count, true,
+						     timeout_ns, status, first);
+			if (!r && *status) {
+				for (i = 0; i < pending_count; i++)
+					amdgpu_cs_fence_signaled(&pending[i]);
+			}
+		}
+		if (pending != pending_stack)
+			free(pending);
+	} else {
+		for (i = 0; i < fence_count; i++) {
+			if (amdgpu_cs_fence_known_signaled(&fences[i])) {
+				*status = 1;
+				if (first)
+					*first = i;
+				return 0;
+			}
+		}
+
+		r = amdgpu_ioctl_wait_fences(fences, fence_count, false,
+					     timeout_ns, status, &signaled);
+		if (!r && *status) {
+			if (signaled < fence_count)
+				amdgpu_cs_fence_signaled(&fences[signaled]);
+			if (first)
+				*first = signaled;
+		}
+	}
+
+	if (r) {
+		for (i = 0; i < fence_count; i++)
+			amdgpu_cs_disable_fence_cache(fences[i].context);
+	}
+
+	return r;
 }
 
 drm_public int sgpu_cs_wait_fences(const struct sgpu_param_cs_wait_fences *params,
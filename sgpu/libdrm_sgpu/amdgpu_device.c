@@ -51,10 +51,6 @@
 
 #define PTR_TO_UINT(x) ((unsigned)((intptr_t)(x)))
 
-#define FIELD_GET(_mask, _reg) (((_reg) & (_mask)) >> (ffs(_mask) - 1))
-#define GENMASK(h, l) \
-	(((~0u) << (l)) & ((~0u) >> (32 - 1 - (h))))
-
 static pthread_mutex_t dev_mutex = PTHREAD_MUTEX_INITIALIZER;
 static amdgpu_device_handle dev_list;
 
@@ -287,35 +283,6 @@ drm_public int amdgpu_device_initialize(int fd,
 	amdgpu_vamgr_init(&dev->vamgr_high, start, max,
 			  dev->dev_info.virtual_address_alignment);
 
-	/* PCI device id */
-	if (dev->info.asic_id == 0x73A0) {
-		char name[128];
-		const char *product = NULL;
-		int gen = FIELD_GET(GENMASK(31, 24),
-				    dev->info.chip_rev);
-
-		/* Model ID */
-		switch(FIELD_GET(GENMASK(23, 16), dev->info.chip_rev)) {
-		case 0x60: /* Voyager, Viking */
-			product = gen == 0 ? "920" :
-				"930";
-			break;
-		case 0x40: /* Jupiter */
-			if (gen == 0)
-				product = "Jupiter";
-			break;
-		default:
-			fprintf(stderr, "%s: cannot parse chip revision: chip_rev %x\n",
-				__func__, dev->info.chip_rev);
-			break;
-		}
-		if (product) {
-			snprintf(name, sizeof(name), "Samsung Xclipse %s",
-				 product);
-			dev->marketing_name = strdup(name);
-		}
-	}
-
 	*major_version = dev->major_version;
 	*minor_version = dev->minor_version;
 	*device_handle = dev;
@@ -350,6 +317,13 @@ drm_public int amdgpu_device_get_fd(amdgpu_device_handle device_handle)
 
 drm_public const char *amdgpu_get_marketing_name(amdgpu_device_handle dev)
 {
+	pthread_mutex_lock(&dev_mutex);
+	if (!dev->marketing_name_resolved) {
+		amdgpu_find_marketing_name(dev);
+		dev->marketing_name_resolved = true;
+	}
+	pthread_mutex_unlock(&dev_mutex);
+
 	return dev->marketing_name;
 }
 
@@ -75,7 +75,9 @@ struct amdgpu_device {
 	unsigned major_version;
 	unsigned minor_version;
 
+	/** Looked up by the first amdgpu_get_marketing_name() */
 	char *marketing_name;
+	bool marketing_name_resolved;
 	/** List of buffer handles. Protected by bo_table_mutex. */
 	struct handle_table bo_handles;
 	/** List of buffer GEM flink names. Protected by bo_table_mutex. */
@@ -119,6 +121,20 @@ struct amdgpu_bo_list {
 	uint32_t handle;
 };
 
+/**
+ * User fence memory of the last submissions to a ring.
+ * The GPU writes there the sequence number of each submission it completes,
+ * so a value between first_seq and last_seq tells what has signaled.
+ */
+struct amdgpu_user_fence {
+	/* Holds a reference and a CPU mapping of the fence buffer */
+	struct amdgpu_bo *bo;
+	volatile uint64_t *cpu;
+	uint64_t offset;
+	uint64_t first_seq;
+	uint64_t last_seq;
+};
+
 struct amdgpu_context {
 	struct amdgpu_device *dev;
 	/** Mutex for accessing fences and to maintain command submissions
@@ -128,6 +144,15 @@ struct amdgpu_context {
 	uint32_t id;
 	uint64_t last_seq[AMDGPU_HW_IP_NUM][AMDGPU_HW_IP_INSTANCE_MAX_COUNT][AMDGPU_CS_MAX_RINGS];
 	struct list_head sem_list[AMDGPU_HW_IP_NUM][AMDGPU_HW_IP_INSTANCE_MAX_COUNT][AMDGPU_CS_MAX_RINGS];
+	/** Highest sequence number seen signaled on each ring, 0 if none.
+	    Accessed with atomics. */
+	uint64_t signaled_seq[AMDGPU_HW_IP_NUM][AMDGPU_HW_IP_INSTANCE_MAX_COUNT][AMDGPU_CS_MAX_RINGS];
+	/** Protects user_fence */
+	pthread_mutex_t user_fence_mutex;
+	struct amdgpu_user_fence user_fence[AMDGPU_HW_IP_NUM][AMDGPU_HW_IP_INSTANCE_MAX_COUNT][AMDGPU_CS_MAX_RINGS];
+	/** Set when a reset or a wait error is seen : signaled_seq and
+	    user_fence are not used anymore, every query goes to the kernel. */
+	atomic_t fence_cache_disabled;
 };
 
 /**
@@ -151,10 +176,14 @@ drm_private void amdgpu_vamgr_deinit(struct amdgpu_bo_va_mgr *mgr);
 
 drm_private void amdgpu_parse_asic_ids(struct amdgpu_device *dev);
 
+drm_private void amdgpu_find_marketing_name(struct amdgpu_device *dev);
+
 drm_private int amdgpu_query_gpu_info_init(amdgpu_device_handle dev);
 
 drm_private uint64_t amdgpu_cs_calculate_timeout(uint64_t timeout);
 
+drm_private void *amdgpu_bo_cpu_map_existing(amdgpu_bo_handle bo);
+
 /**
  * Inline functions.
  */
@@ -0,0 +1,275 @@
+/*
+ * Copyright 2020 Samsung Electronics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Host benchmark of amdgpu_device_initialize()
+ *
+ * The device files are built into the benchmark, and the libdrm functions
+ * they call are replaced by a fake kernel that counts the syscalls they
+ * would make. The fcntl, fstat and close of the node, /dev/null here, are
+ * not counted. AMDGPU_ASIC_ID_TABLE is a file the benchmark writes and
+ * removes.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xf86drm.h"
+#include "sgpu_drm.h"
+#include "amdgpu_internal.h"
+#include "amdgpu_asic_id_table.h"
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n",	\
+				__FILE__, __LINE__, #cond);		\
+			exit(1);					\
+		}							\
+	} while (0)
+
+#define ITERATIONS	10000
+
+static struct {
+	uint32_t chip_rev;
+	uint32_t family;
+	unsigned syscalls;
+	unsigned dev_info_queries;
+	unsigned register_reads;
+} kernel = {
+	.chip_rev = 0x00600000,
+	.family = AMDGPU_FAMILY_NV,
+};
+
+/* The libdrm functions amdgpu_device.c and amdgpu_gpu_info.c use */
+drm_public drmVersionPtr drmGetVersion(int fd)
+{
+	drmVersionPtr version = calloc(1, sizeof(*version));
+
+	/* DRM_IOCTL_VERSION for the lengths, then for the strings */
+	kernel.syscalls += 2;
+	version->version_major = 3;
+	version->version_minor = 40;
+	return version;
+}
+
+drm_public void drmFreeVersion(drmVersionPtr version)
+{
+	free(version);
+}
+
+drm_public int drmGetNodeTypeFromFd(int fd)
+{
+	/* fstat */
+	kernel.syscalls++;
+	return DRM_NODE_RENDER;
+}
+
+drm_public char *drmGetPrimaryDeviceNameFromFd(int fd)
+{
+	/* at least a fstat, the scan of the nodes is not counted */
+	kernel.syscalls++;
+	return strdup("/dev/dri/card0");
+}
+
+drm_public int drmIoctl(int fd, unsigned long request, void *arg)
+{
+	kernel.syscalls++;
+	errno = EINVAL;
+	return -1;
+}
+
+drm_public int drmCommandWrite(int fd, unsigned long drmCommandIndex,
+			       void *data, unsigned long size)
+{
+	struct drm_amdgpu_info *request = data;
+	void *value = (void *)(uintptr_t)request->return_pointer;
+
+	kernel.syscalls++;
+	CHECK(drmCommandIndex == DRM_AMDGPU_INFO);
+
+	switch (request->query) {
+	case AMDGPU_INFO_ACCEL_WORKING:
+		*(uint32_t *)value = 1;
+		return 0;
+	case AMDGPU_INFO_DEV_INFO: {
+		struct drm_amdgpu_info_device *info = value;
+
+		kernel.dev_info_queries++;
+		memset(info, 0, request->return_size);
+		info->device_id = 0x73A0;
+		info->chip_rev = kernel.chip_rev;
+		info->family = kernel.family;
+		info->num_shader_engines = 2;
+		info->virtual_address_offset = 0x200000;
+		info->virtual_address_max = 0x800000000000ull;
+		info->virtual_address_alignment = 0x1000;
+		info->high_va_offset = 0xffff800000000000ull;
+		info->high_va_max = 0xffffffffffe00000ull;
+		return 0;
+	}
+	case AMDGPU_INFO_READ_MMR_REG:
+		kernel.register_reads++;
+		memset(value, 0, request->return_size);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+drm_public int drmCommandWriteRead(int fd, unsigned long drmCommandIndex,
+				   void *data, unsigned long size)
+{
+	kernel.syscalls++;
+	return -EINVAL;
+}
+
+drm_public void drmMsg(const char *format, ...)
+{
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static amdgpu_device_handle initialize(int fd)
+{
+	amdgpu_device_handle dev;
+	uint32_t major, minor;
+
+	CHECK(amdgpu_device_initialize(fd, &major, &minor, &dev) == 0);
+	CHECK(major == 3);
+	return dev;
+}
+
+/* Syscalls and time of the initialization of a device no one holds */
+static void measure(int fd, const char *name, unsigned iterations)
+{
+	uint64_t start, elapsed = 0;
+	unsigned syscalls = kernel.syscalls;
+	unsigned i;
+
+	for (i = 0; i < iterations; i++) {
+		amdgpu_device_handle dev;
+
+		start = now_ns();
+		dev = initialize(fd);
+		elapsed += now_ns() - start;
+		amdgpu_device_deinitialize(dev);
+	}
+
+	printf("%s: %.1f syscalls, %.0f ns per initialization\n", name,
+	       (double)(kernel.syscalls - syscalls) / iterations,
+	       (double)elapsed / iterations);
+}
+
+static void test_init(int fd)
+{
+	unsigned reads;
+
+	/* A family before AI reads the most registers */
+	kernel.family = AMDGPU_FAMILY_VI;
+	measure(fd, "first initialization", 1);
+	CHECK(kernel.dev_info_queries == 1);
+	CHECK(kernel.register_reads > 0);
+
+	/* Each initialization queries the kernel, the name lookup is not in it */
+	reads = kernel.register_reads;
+	measure(fd, "next initializations", ITERATIONS);
+	CHECK(kernel.dev_info_queries == 1 + ITERATIONS);
+	CHECK(kernel.register_reads == reads * (1 + ITERATIONS));
+	kernel.family = AMDGPU_FAMILY_NV;
+}
+
+static const char *marketing_name(int fd, uint32_t chip_rev)
+{
+	static char name[64];
+	amdgpu_device_handle dev;
+	const char *s;
+
+	kernel.chip_rev = chip_rev;
+	dev = initialize(fd);
+	s = amdgpu_get_marketing_name(dev);
+	snprintf(name, sizeof(name), "%s", s ? s : "");
+	amdgpu_device_deinitialize(dev);
+	return name;
+}
+
+static void test_marketing_name(int fd)
+{
+	amdgpu_device_handle dev;
+	unsigned i, syscalls;
+	FILE *fp;
+
+	for (i = 1; i < AMDGPU_ASIC_ID_COUNT; i++) {
+		CHECK(amdgpu_asic_ids[i - 1].did < amdgpu_asic_ids[i].did ||
+		      (amdgpu_asic_ids[i - 1].did == amdgpu_asic_ids[i].did &&
+		       amdgpu_asic_ids[i - 1].rev < amdgpu_asic_ids[i].rev));
+	}
+
+	unlink(AMDGPU_ASIC_ID_TABLE);
+	CHECK(!strcmp(marketing_name(fd, 0x00600000), "Samsung Xclipse 920"));
+	CHECK(!strcmp(marketing_name(fd, 0x01600000), "Samsung Xclipse 930"));
+	CHECK(!strcmp(marketing_name(fd, 0x02600000), "Samsung Xclipse 930"));
+	CHECK(!strcmp(marketing_name(fd, 0x00400000), "Samsung Xclipse Jupiter"));
+	CHECK(!strcmp(marketing_name(fd, 0x01400000), ""));
+	CHECK(!strcmp(marketing_name(fd, 0x00500000), ""));
+
+	/* The name is not looked up by the initialization */
+	kernel.chip_rev = 0x00400000;
+	dev = initialize(fd);
+	syscalls = kernel.syscalls;
+	CHECK(!strcmp(amdgpu_get_marketing_name(dev), "Samsung Xclipse Jupiter"));
+	CHECK(kernel.syscalls == syscalls);
+	amdgpu_device_deinitialize(dev);
+
+	/* The text file overrides the table */
+	fp = fopen(AMDGPU_ASIC_ID_TABLE, "w");
+	CHECK(fp);
+	fprintf(fp, "# comment\n1.0.0\n73A0,\t00,\tOverride Name\n");
+	fclose(fp);
+	CHECK(!strcmp(marketing_name(fd, 0x00400000), "Override Name"));
+	unlink(AMDGPU_ASIC_ID_TABLE);
+}
+
+int main(void)
+{
+	int fd = open("/dev/null", O_RDWR);
+
+	CHECK(fd >= 0);
+	test_init(fd);
+	test_marketing_name(fd);
+	close(fd);
+
+	printf("amdgpu device init benchmark passed\n");
+	return 0;
+}
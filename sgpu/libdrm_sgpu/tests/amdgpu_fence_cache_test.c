@@ -0,0 +1,563 @@
+/*
+ * Copyright 2020 Samsung Electronics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Host test of the signaled fence cache of amdgpu_cs.c
+ *
+ * amdgpu_cs.c is built into the test, and drmIoctl() and
+ * drmCommandWriteRead() are replaced by a fake kernel that counts the
+ * syscalls. The GPU completes the submissions of a ring in order when the
+ * test tells it to, and writes the user fence of the ones that have one.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xf86drm.h"
+#include "sgpu_drm.h"
+#include "amdgpu_internal.h"
+
+#define FAKE_FD		42
+#define FAKE_CTX_ID	7
+#define FAKE_BO_HANDLE	3
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n",	\
+				__FILE__, __LINE__, #cond);		\
+			exit(1);					\
+		}							\
+	} while (0)
+
+static struct {
+	uint64_t submitted[AMDGPU_HW_IP_NUM][AMDGPU_CS_MAX_RINGS];
+	uint64_t completed[AMDGPU_HW_IP_NUM][AMDGPU_CS_MAX_RINGS];
+	/* user fence offset of each submission, ~0 if none */
+	uint64_t fence_offset[AMDGPU_HW_IP_NUM][AMDGPU_CS_MAX_RINGS][256];
+	uint32_t reset_status;
+	unsigned wait_ioctls;
+} kernel;
+
+static uint64_t fence_memory[16];
+static struct amdgpu_bo fence_bo;
+static struct amdgpu_device device;
+
+static void fake_kernel_init(uint64_t first_seq)
+{
+	int i, j;
+
+	memset(&kernel, 0, sizeof(kernel));
+	for (i = 0; i < AMDGPU_HW_IP_NUM; i++) {
+		for (j = 0; j < AMDGPU_CS_MAX_RINGS; j++) {
+			kernel.submitted[i][j] = first_seq - 1;
+			kernel.completed[i][j] = first_seq - 1;
+		}
+	}
+
+	memset(fence_memory, 0, sizeof(fence_memory));
+	memset(&fence_bo, 0, sizeof(fence_bo));
+	atomic_set(&fence_bo.refcount, 1);
+	fence_bo.dev = &device;
+	fence_bo.handle = FAKE_BO_HANDLE;
+	pthread_mutex_init(&fence_bo.cpu_access_mutex, NULL);
+
+	memset(&device, 0, sizeof(device));
+	device.fd = FAKE_FD;
+}
+
+static bool fake_signaled(unsigned ip, unsigned ring, uint64_t seq)
+{
+	if (seq == AMDGPU_NULL_SUBMIT_SEQ)
+		return true;
+	return (int64_t)(seq - kernel.completed[ip][ring]) <= 0;
+}
+
+/* The GPU completes the submissions of a ring up to seq */
+static void fake_gpu_complete(unsigned ip, unsigned ring, uint64_t seq)
+{
+	while (!fake_signaled(ip, ring, seq)) {
+		uint64_t done = ++kernel.completed[ip][ring];
+		uint64_t offset;
+
+		if (done == AMDGPU_NULL_SUBMIT_SEQ)
+			done = ++kernel.completed[ip][ring];
+		offset = kernel.fence_offset[ip][ring][done & 255];
+		if (offset != ~0ull)
+			fence_memory[offset] = done;
+	}
+}
+
+static int fake_cs(union drm_amdgpu_cs *cs)
+{
+	uint64_t *chunk_array = (uint64_t *)(uintptr_t)cs->in.chunks;
+	uint64_t offset = ~0ull, seq;
+	unsigned ip = 0, ring = 0;
+	uint32_t i;
+
+	for (i = 0; i < cs->in.num_chunks; i++) {
+		struct drm_amdgpu_cs_chunk *chunk =
+			(struct drm_amdgpu_cs_chunk *)(uintptr_t)chunk_array[i];
+		struct drm_amdgpu_cs_chunk_data *data =
+			(struct drm_amdgpu_cs_chunk_data *)(uintptr_t)chunk->chunk_data;
+
+		if (chunk->chunk_id == AMDGPU_CHUNK_ID_IB) {
+			ip = data->ib_data.ip_type;
+			ring = data->ib_data.ring;
+		} else if (chunk->chunk_id == AMDGPU_CHUNK_ID_FENCE) {
+			CHECK(data->fence_data.handle == FAKE_BO_HANDLE);
+			offset = data->fence_data.offset / sizeof(uint64_t);
+		}
+	}
+
+	seq = ++kernel.submitted[ip][ring];
+	if (seq == AMDGPU_NULL_SUBMIT_SEQ)
+		seq = ++kernel.submitted[ip][ring];
+	kernel.fence_offset[ip][ring][seq & 255] = offset;
+	cs->out.handle = seq;
+	return 0;
+}
+
+static int fake_ctx(union drm_amdgpu_ctx *args)
+{
+	uint32_t op = args->in.op;
+
+	memset(&args->out, 0, sizeof(args->out));
+	switch (op) {
+	case AMDGPU_CTX_OP_ALLOC_CTX:
+		args->out.alloc.ctx_id = FAKE_CTX_ID;
+		return 0;
+	case AMDGPU_CTX_OP_FREE_CTX:
+		return 0;
+	case AMDGPU_CTX_OP_QUERY_STATE:
+		args->out.state.reset_status = kernel.reset_status;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Replaces the one of libdrm */
+drm_public int drmCommandWriteRead(int fd, unsigned long drmCommandIndex,
+				   void *data, unsigned long size)
+{
+	CHECK(fd == FAKE_FD);
+
+	switch (drmCommandIndex) {
+	case DRM_AMDGPU_CS:
+		return fake_cs(data);
+	case DRM_AMDGPU_CTX:
+		return fake_ctx(data);
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Replaces the one of libdrm */
+drm_public int drmIoctl(int fd, unsigned long request, void *arg)
+{
+	CHECK(fd == FAKE_FD);
+
+	kernel.wait_ioctls++;
+	if (kernel.reset_status != AMDGPU_CTX_NO_RESET) {
+		errno = ECANCELED;
+		return -1;
+	}
+
+	if (request == DRM_IOCTL_AMDGPU_WAIT_CS) {
+		union drm_amdgpu_wait_cs *args = arg;
+
+		CHECK(args->in.ctx_id == FAKE_CTX_ID);
+		args->out.status = !fake_signaled(args->in.ip_type, args->in.ring,
+						  args->in.handle);
+		return 0;
+	}
+
+	if (request == DRM_IOCTL_AMDGPU_WAIT_FENCES) {
+		union drm_amdgpu_wait_fences *args = arg;
+		struct drm_amdgpu_fence *fences =
+			(struct drm_amdgpu_fence *)(uintptr_t)args->in.fences;
+		uint32_t i, signaled = 0, first = 0;
+
+		for (i = 0; i < args->in.fence_count; i++) {
+			if (fake_signaled(fences[i].ip_type, fences[i].ring,
+					  fences[i].seq_no)) {
+				if (!signaled)
+					first = i;
+				signaled++;
+			}
+		}
+
+		memset(&args->out, 0, sizeof(args->out));
+		if (args->in.wait_all) {
+			args->out.status = (signaled == args->in.fence_count);
+		} else {
+			args->out.status = (signaled != 0);
+			args->out.first_signaled = first;
+		}
+		return 0;
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+/* The buffer functions amdgpu_cs.c uses, on fence_bo only */
+drm_private void *amdgpu_bo_cpu_map_existing(amdgpu_bo_handle bo)
+{
+	if (!bo->cpu_ptr)
+		return NULL;
+	bo->cpu_map_count++;
+	return bo->cpu_ptr;
+}
+
+drm_public int amdgpu_bo_cpu_unmap(amdgpu_bo_handle bo)
+{
+	CHECK(bo->cpu_map_count > 0);
+	bo->cpu_map_count--;
+	return 0;
+}
+
+drm_public void amdgpu_bo_inc_ref(amdgpu_bo_handle bo)
+{
+	atomic_inc(&bo->refcount);
+}
+
+drm_public int amdgpu_bo_free(amdgpu_bo_handle bo)
+{
+	/* The test holds the last reference */
+	CHECK(!atomic_dec_and_test(&bo->refcount));
+	return 0;
+}
+
+static uint64_t submit(amdgpu_context_handle context, unsigned ring,
+		       bool user_fence)
+{
+	struct amdgpu_cs_ib_info ib;
+	struct amdgpu_cs_request request;
+
+	memset(&ib, 0, sizeof(ib));
+	ib.size = 16;
+	memset(&request, 0, sizeof(request));
+	request.ip_type = AMDGPU_HW_IP_GFX;
+	request.ring = ring;
+	request.number_of_ibs = 1;
+	request.ibs = &ib;
+	if (user_fence) {
+		request.fence_info.handle = &fence_bo;
+		request.fence_info.offset = ring;
+	}
+
+	CHECK(amdgpu_cs_submit(context, 0, &request, 1) == 0);
+	return request.seq_no;
+}
+
+static struct amdgpu_cs_fence make_fence(amdgpu_context_handle context,
+					 unsigned ring, uint64_t seq)
+{
+	struct amdgpu_cs_fence fence;
+
+	memset(&fence, 0, sizeof(fence));
+	fence.context = context;
+	fence.ip_type = AMDGPU_HW_IP_GFX;
+	fence.ring = ring;
+	fence.fence = seq;
+	return fence;
+}
+
+/* Polls a fence, and checks the answer against the fake kernel */
+static bool query(amdgpu_context_handle context, unsigned ring, uint64_t seq)
+{
+	struct amdgpu_cs_fence fence = make_fence(context, ring, seq);
+	uint32_t expired;
+
+	CHECK(amdgpu_cs_query_fence_status(&fence, 0, 0, &expired) == 0);
+	CHECK(!!expired == fake_signaled(AMDGPU_HW_IP_GFX, ring, seq));
+	return expired;
+}
+
+/*
+ * An upload ring buffer split in chunks, each one tagged with the fence of
+ * the last submission that used it. Each frame writes CHUNKS_PER_FRAME
+ * chunks, and checks the fence of a chunk before it writes it again.
+ * The GPU is 2 frames late.
+ */
+#define RING_CHUNKS		64
+#define CHUNKS_PER_FRAME	4
+#define FRAMES			1000
+
+static double ring_recycling(bool user_fence, unsigned *queries)
+{
+	amdgpu_context_handle context;
+	uint64_t chunks[RING_CHUNKS] = {0};
+	unsigned frame, i, next = 0;
+	uint64_t seq;
+
+	fake_kernel_init(1);
+	if (user_fence) {
+		fence_bo.cpu_ptr = fence_memory;
+		fence_bo.cpu_map_count = 1;
+	}
+	CHECK(amdgpu_cs_ctx_create(&device, &context) == 0);
+
+	*queries = 0;
+	for (frame = 0; frame < FRAMES; frame++) {
+		for (i = 0; i < CHUNKS_PER_FRAME; i++) {
+			uint64_t *chunk = &chunks[next++ % RING_CHUNKS];
+
+			if (*chunk) {
+				CHECK(query(context, 0, *chunk));
+				(*queries)++;
+			}
+		}
+
+		seq = submit(context, 0, user_fence);
+		for (i = 0; i < CHUNKS_PER_FRAME; i++)
+			chunks[(next - 1 - i) % RING_CHUNKS] = seq;
+
+		if (seq > 2)
+			fake_gpu_complete(AMDGPU_HW_IP_GFX, 0, seq - 2);
+	}
+
+	CHECK(amdgpu_cs_ctx_free(context) == 0);
+	return (double)kernel.wait_ioctls / *queries;
+}
+
+static void test_ring_recycling(void)
+{
+	unsigned queries;
+	double per_query, per_query_user_fence;
+
+	/* Without the cache, every query is a syscall */
+	per_query = ring_recycling(false, &queries);
+	printf("ring recycling: %u queries, %.3f syscalls per query\n",
+	       queries, per_query);
+	CHECK(per_query <= 1.0 / CHUNKS_PER_FRAME);
+
+	per_query_user_fence = ring_recycling(true, &queries);
+	printf("ring recycling with user fence: %u queries, %.3f syscalls per query\n",
+	       queries, per_query_user_fence);
+	CHECK(kernel.wait_ioctls == 0);
+	CHECK(atomic_read(&fence_bo.refcount) == 1);
+	CHECK(fence_bo.cpu_map_count == 1);
+}
+
+static void test_user_fence(void)
+{
+	amdgpu_context_handle context;
+	uint64_t seq[4];
+	int i;
+
+	fake_kernel_init(1);
+	CHECK(amdgpu_cs_ctx_create(&device, &context) == 0);
+
+	/* Not CPU mapped : it is not read */
+	seq[0] = submit(context, 1, true);
+	fake_gpu_complete(AMDGPU_HW_IP_GFX, 1, seq[0]);
+	CHECK(query(context, 1, seq[0]));
+	CHECK(kernel.wait_ioctls == 1);
+	CHECK(fence_bo.cpu_map_count == 0);
+
+	fence_bo.cpu_ptr = fence_memory;
+	fence_bo.cpu_map_count = 1;
+	/* Stale content of the memory is not trusted */
+	fence_memory[1] = 1000;
+	for (i = 0; i < 4; i++)
+		seq[i] = submit(context, 1, true);
+	CHECK(fence_bo.cpu_map_count == 2);
+	CHECK(!query(context, 1, seq[0]));
+	CHECK(kernel.wait_ioctls == 2);
+
+	fake_gpu_complete(AMDGPU_HW_IP_GFX, 1, seq[2]);
+	kernel.wait_ioctls = 0;
+	CHECK(query(context, 1, seq[0]));
+	CHECK(query(context, 1, seq[2]));
+	CHECK(kernel.wait_ioctls == 0);
+	CHECK(!query(context, 1, seq[3]));
+	CHECK(kernel.wait_ioctls == 1);
+
+	/* Without a user fence, the mapping is given back */
+	submit(context, 1, false);
+	CHECK(fence_bo.cpu_map_count == 1);
+	CHECK(atomic_read(&fence_bo.refcount) == 1);
+
+	CHECK(amdgpu_cs_ctx_free(context) == 0);
+	fence_bo.cpu_ptr = NULL;
+	fence_bo.cpu_map_count = 0;
+}
+
+static void test_wait_fences(void)
+{
+	amdgpu_context_handle context;
+	struct amdgpu_cs_fence fences[3];
+	uint32_t status, first;
+	int i;
+
+	fake_kernel_init(1);
+	CHECK(amdgpu_cs_ctx_create(&device, &context) == 0);
+
+	for (i = 0; i < 3; i++)
+		fences[i] = make_fence(context, 2, submit(context, 2, false));
+
+	CHECK(amdgpu_cs_wait_fences(fences, 3, true, 0, &status, &first) == 0);
+	CHECK(status == 0);
+	CHECK(kernel.wait_ioctls == 1);
+
+	fake_gpu_complete(AMDGPU_HW_IP_GFX, 2, fences[1].fence);
+	CHECK(amdgpu_cs_wait_fences(fences, 3, false, 0, &status, &first) == 0);
+	CHECK(status == 1 && first == 0);
+	CHECK(kernel.wait_ioctls == 2);
+	/* The first fence is known signaled now */
+	CHECK(amdgpu_cs_wait_fences(fences, 3, false, 0, &status, &first) == 0);
+	CHECK(status == 1 && first == 0);
+	CHECK(kernel.wait_ioctls == 2);
+
+	/* Only the last one is waited */
+	fake_gpu_complete(AMDGPU_HW_IP_GFX, 2, fences[2].fence);
+	CHECK(query(context, 2, fences[1].fence));
+	CHECK(kernel.wait_ioctls == 3);
+	CHECK(amdgpu_cs_wait_fences(fences, 3, true, 0, &status, &first) == 0);
+	CHECK(status == 1);
+	CHECK(kernel.wait_ioctls == 4);
+	CHECK(amdgpu_cs_wait_fences(fences, 3, true, 0, &status, NULL) == 0);
+	CHECK(status == 1);
+	CHECK(kernel.wait_ioctls == 4);
+
+	CHECK(amdgpu_cs_ctx_free(context) == 0);
+}
+
+static void test_wait_many_fences(void)
+{
+	amdgpu_context_handle context;
+	struct amdgpu_cs_fence fences[100];
+	uint32_t status, first;
+	int i;
+
+	fake_kernel_init(1);
+	CHECK(amdgpu_cs_ctx_create(&device, &context) == 0);
+
+	/* More fences than a wait copies on the stack */
+	for (i = 0; i < 100; i++)
+		fences[i] = make_fence(context, 2, submit(context, 2, false));
+
+	CHECK(amdgpu_cs_wait_fences(fences, 100, true, 0, &status, &first) == 0);
+	CHECK(status == 0);
+	CHECK(kernel.wait_ioctls == 1);
+
+	fake_gpu_complete(AMDGPU_HW_IP_GFX, 2, fences[99].fence);
+	CHECK(amdgpu_cs_wait_fences(fences, 100, false, 0, &status, &first) == 0);
+	CHECK(status == 1 && first == 0);
+	CHECK(kernel.wait_ioctls == 2);
+	CHECK(amdgpu_cs_wait_fences(fences, 100, true, 0, &status, &first) == 0);
+	CHECK(status == 1);
+	CHECK(kernel.wait_ioctls == 3);
+	CHECK(amdgpu_cs_wait_fences(fences, 100, true, 0, &status, &first) == 0);
+	CHECK(status == 1);
+	CHECK(kernel.wait_ioctls == 3);
+
+	CHECK(amdgpu_cs_ctx_free(context) == 0);
+}
+
+static void test_reset(void)
+{
+	amdgpu_context_handle context;
+	uint32_t state, hangs, expired;
+	struct amdgpu_cs_fence fence;
+	uint64_t seq;
+
+	fake_kernel_init(1);
+	CHECK(amdgpu_cs_ctx_create(&device, &context) == 0);
+
+	seq = submit(context, 0, false);
+	fake_gpu_complete(AMDGPU_HW_IP_GFX, 0, seq);
+	CHECK(query(context, 0, seq));
+	CHECK(query(context, 0, seq));
+	CHECK(kernel.wait_ioctls == 1);
+
+	/* The kernel reports the reset : every query goes to it again */
+	kernel.reset_status = AMDGPU_CTX_GUILTY_RESET;
+	CHECK(amdgpu_cs_query_reset_state(context, &state, &hangs) == 0);
+	CHECK(state == AMDGPU_CTX_GUILTY_RESET);
+	fence = make_fence(context, 0, seq);
+	CHECK(amdgpu_cs_query_fence_status(&fence, 0, 0, &expired) == -ECANCELED);
+	CHECK(kernel.wait_ioctls == 2);
+
+	CHECK(amdgpu_cs_ctx_free(context) == 0);
+
+	/* A wait error disables the cache as well */
+	fake_kernel_init(1);
+	CHECK(amdgpu_cs_ctx_create(&device, &context) == 0);
+	seq = submit(context, 0, false);
+	fake_gpu_complete(AMDGPU_HW_IP_GFX, 0, seq);
+	kernel.reset_status = AMDGPU_CTX_INNOCENT_RESET;
+	fence = make_fence(context, 0, seq);
+	CHECK(amdgpu_cs_query_fence_status(&fence, 0, 0, &expired) == -ECANCELED);
+	kernel.reset_status = AMDGPU_CTX_NO_RESET;
+	CHECK(query(context, 0, seq));
+	CHECK(query(context, 0, seq));
+	CHECK(kernel.wait_ioctls == 3);
+
+	CHECK(amdgpu_cs_ctx_free(context) == 0);
+}
+
+static void test_wraparound(void)
+{
+	amdgpu_context_handle context;
+	uint64_t before, after;
+
+	fake_kernel_init(UINT64_MAX - 1);
+	CHECK(amdgpu_cs_ctx_create(&device, &context) == 0);
+
+	before = submit(context, 0, false);
+	submit(context, 0, false);
+	after = submit(context, 0, false);
+	CHECK(before == UINT64_MAX - 1);
+	CHECK(after == 1);
+
+	fake_gpu_complete(AMDGPU_HW_IP_GFX, 0, before);
+	CHECK(query(context, 0, before));
+	CHECK(!query(context, 0, after));
+
+	fake_gpu_complete(AMDGPU_HW_IP_GFX, 0, after);
+	CHECK(query(context, 0, after));
+	kernel.wait_ioctls = 0;
+	CHECK(query(context, 0, before));
+	CHECK(kernel.wait_ioctls == 0);
+
+	CHECK(amdgpu_cs_ctx_free(context) == 0);
+}
+
+int main(void)
+{
+	test_ring_recycling();
+	test_user_fence();
+	test_wait_fences();
+	test_wait_many_fences();
+	test_reset();
+	test_wraparound();
+
+	printf("amdgpu fence cache test passed\n");
+	return 0;
+}